@@ -0,0 +1 @@
+LIB_adserver_connector_CURRENT_VERSION:=20f76f3d44474cbc91a758d03f9a65d9
@@ -0,0 +1 @@
+LIB_adx_exchange_CURRENT_VERSION:=221a69e6306b19f5d07e101f70853458
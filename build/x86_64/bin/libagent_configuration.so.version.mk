@@ -0,0 +1 @@
+LIB_agent_configuration_CURRENT_VERSION:=e47b94d1fca5d96fc9d9a64e44471ed0
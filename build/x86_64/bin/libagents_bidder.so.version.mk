@@ -0,0 +1 @@
+LIB_agents_bidder_CURRENT_VERSION:=017f93de0cec81b1a3bbdcec89fad9d0
@@ -0,0 +1 @@
+LIB_algebra_CURRENT_VERSION:=3f5531a5efe6280964791d843be6d79b
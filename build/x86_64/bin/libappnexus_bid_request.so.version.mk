@@ -0,0 +1 @@
+LIB_appnexus_bid_request_CURRENT_VERSION:=1b16c666ee93fef26b566b2048279c8f
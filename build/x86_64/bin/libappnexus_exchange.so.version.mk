@@ -0,0 +1 @@
+LIB_appnexus_exchange_CURRENT_VERSION:=37d104dec75c107a3a0e1db38ed51bc6
@@ -0,0 +1 @@
+LIB_arch_CURRENT_VERSION:=dec9f2e1522de8e2d8aed3ad5c497e12
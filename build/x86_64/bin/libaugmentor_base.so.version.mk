@@ -0,0 +1 @@
+LIB_augmentor_base_CURRENT_VERSION:=885ef96c05316d1befae5b0bf5260f67
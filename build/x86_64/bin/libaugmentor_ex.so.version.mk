@@ -0,0 +1 @@
+LIB_augmentor_ex_CURRENT_VERSION:=b84212666ede05d2184246fa1c088b9b
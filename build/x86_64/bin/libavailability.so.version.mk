@@ -0,0 +1 @@
+LIB_availability_CURRENT_VERSION:=053479846cafda00d2af860925332ae4
@@ -0,0 +1 @@
+LIB_availability_node_impl_CURRENT_VERSION:=0f5093331d006b3b4e0d34a2e9017b75
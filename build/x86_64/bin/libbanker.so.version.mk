@@ -0,0 +1 @@
+LIB_banker_CURRENT_VERSION:=d51ab8c98158e0f9498be0812a67615f
@@ -0,0 +1 @@
+LIB_banker_temporary_server_CURRENT_VERSION:=a9b39a264a99670797d95a64b07cde9d
@@ -0,0 +1 @@
+LIB_bid_request_CURRENT_VERSION:=554524ac52a6ad4de55286a76b3a5fdc
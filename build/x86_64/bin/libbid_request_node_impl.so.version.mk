@@ -0,0 +1 @@
+LIB_bid_request_node_impl_CURRENT_VERSION:=c0969186d6eaa1bd3ce1d2156a98e608
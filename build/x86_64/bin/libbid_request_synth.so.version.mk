@@ -0,0 +1 @@
+LIB_bid_request_synth_CURRENT_VERSION:=b3e1c73d1f9ca4f00f51cc791c51343e
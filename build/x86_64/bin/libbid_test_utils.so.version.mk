@@ -0,0 +1 @@
+LIB_bid_test_utils_CURRENT_VERSION:=f23c31eafb7628ea16d92e9e76ebeba7
@@ -0,0 +1 @@
+LIB_bidding_agent_CURRENT_VERSION:=67ff97b38162ecb0c1a4510b8a3f73ca
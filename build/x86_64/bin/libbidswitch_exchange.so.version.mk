@@ -0,0 +1 @@
+LIB_bidswitch_exchange_CURRENT_VERSION:=b6b02fa19dbf525f365d3c39849942c4
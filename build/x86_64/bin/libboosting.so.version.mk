@@ -0,0 +1 @@
+LIB_boosting_CURRENT_VERSION:=17a42c43d6d839f0136219136a8a9cd7
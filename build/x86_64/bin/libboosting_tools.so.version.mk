@@ -0,0 +1 @@
+LIB_boosting_tools_CURRENT_VERSION:=7d33e8f4d86f9b7275ef490563e37d09
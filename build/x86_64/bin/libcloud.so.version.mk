@@ -0,0 +1 @@
+LIB_cloud_CURRENT_VERSION:=ef107ba90b55538903e87d84030c17ba
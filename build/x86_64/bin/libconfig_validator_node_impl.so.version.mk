@@ -0,0 +1 @@
+LIB_config_validator_node_impl_CURRENT_VERSION:=9d2dd144afda932d03f3e58a0a5174b2
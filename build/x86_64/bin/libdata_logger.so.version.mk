@@ -0,0 +1 @@
+LIB_data_logger_CURRENT_VERSION:=f494d19e543c2a9a8188f0d34190a558
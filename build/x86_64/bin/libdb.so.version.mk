@@ -0,0 +1 @@
+LIB_db_CURRENT_VERSION:=d716ff0cc2d46fd4c35ba7cc89a6ca4d
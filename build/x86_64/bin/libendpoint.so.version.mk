@@ -0,0 +1 @@
+LIB_endpoint_CURRENT_VERSION:=54f3f95d870a4aebe2b503980f8d69ce
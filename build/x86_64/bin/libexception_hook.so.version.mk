@@ -0,0 +1 @@
+LIB_exception_hook_CURRENT_VERSION:=f09943c1746133e8c6c5121d044c94de
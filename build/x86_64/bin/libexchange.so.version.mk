@@ -0,0 +1 @@
+LIB_exchange_CURRENT_VERSION:=5d1124589a774984d7b1ec163b164655
@@ -0,0 +1 @@
+LIB_fbx_bid_request_CURRENT_VERSION:=2f14a0e2077a733be7c9da754bf1af2d
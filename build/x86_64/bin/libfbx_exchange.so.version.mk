@@ -0,0 +1 @@
+LIB_fbx_exchange_CURRENT_VERSION:=f7828bf1e8216624d48adcd151fa85bc
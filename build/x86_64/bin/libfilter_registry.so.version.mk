@@ -0,0 +1 @@
+LIB_filter_registry_CURRENT_VERSION:=b80963aa2a89f520ef3cfcb2beb654d1
@@ -0,0 +1 @@
+LIB_gc_CURRENT_VERSION:=5e4c54de1f8154a6c3ab4e8224dc63b6
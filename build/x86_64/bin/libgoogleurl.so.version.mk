@@ -0,0 +1 @@
+LIB_googleurl_CURRENT_VERSION:=88714800a9b124d21ca2092c80cf3afc
@@ -0,0 +1 @@
+LIB_gumgum_exchange_CURRENT_VERSION:=28acec360d5c6380e17c803fac5cc0e9
@@ -0,0 +1 @@
+LIB_http_bidder_CURRENT_VERSION:=fe9c6d434636833d270daae1ad744991
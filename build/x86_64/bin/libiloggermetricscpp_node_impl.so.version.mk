@@ -0,0 +1 @@
+LIB_iloggermetricscpp_node_impl_CURRENT_VERSION:=5af2cf35880f63faeac3c977e4b27a9d
@@ -0,0 +1 @@
+LIB_integration_test_utils_CURRENT_VERSION:=dbf68c87727ecc758e1e94f447ddd31c
@@ -0,0 +1 @@
+LIB_js_CURRENT_VERSION:=80e50c40e9d8f4b9410f563864ed4ca5
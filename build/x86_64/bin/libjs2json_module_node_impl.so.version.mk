@@ -0,0 +1 @@
+LIB_js2json_module_node_impl_CURRENT_VERSION:=0d834d12851a4eebfe045ab36e6f9e3d
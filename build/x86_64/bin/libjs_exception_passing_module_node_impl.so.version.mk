@@ -0,0 +1 @@
+LIB_js_exception_passing_module_node_impl_CURRENT_VERSION:=b172136f78bbdd330091ffcc4fbf5ec8
@@ -0,0 +1 @@
+LIB_js_variable_arity_module_node_impl_CURRENT_VERSION:=f19a4b65d6ac06ddba2df1485f9a9037
@@ -0,0 +1 @@
+LIB_jsoncpp_CURRENT_VERSION:=7122f6c8038ae4cce46b0c40f05ed6f0
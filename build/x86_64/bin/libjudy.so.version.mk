@@ -0,0 +1 @@
+LIB_judy_CURRENT_VERSION:=4a442f07238d869921f116aa9474e042
@@ -0,0 +1 @@
+LIB_lapack_detect_CURRENT_VERSION:=627db8dc296a477233657cbd12e8e0de
@@ -0,0 +1 @@
+LIB_leveldb_CURRENT_VERSION:=dce666c9e07d1ae80cf79b3c08e6a943
@@ -0,0 +1 @@
+LIB_log_metrics_CURRENT_VERSION:=e2103c5d75983e11ef2294487d69acee
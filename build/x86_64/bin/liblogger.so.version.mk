@@ -0,0 +1 @@
+LIB_logger_CURRENT_VERSION:=93671de8890326bdb3c8e85c46db04bc
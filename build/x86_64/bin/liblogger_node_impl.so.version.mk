@@ -0,0 +1 @@
+LIB_logger_node_impl_CURRENT_VERSION:=14ae042e74915efa29e8a5b442da223f
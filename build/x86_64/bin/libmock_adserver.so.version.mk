@@ -0,0 +1 @@
+LIB_mock_adserver_CURRENT_VERSION:=a574e5c57be3de63282fe10e83c1bc18
@@ -0,0 +1 @@
+LIB_mock_banker_persistence_CURRENT_VERSION:=39b5490311d906845e251427f945710a
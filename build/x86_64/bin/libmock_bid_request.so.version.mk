@@ -0,0 +1 @@
+LIB_mock_bid_request_CURRENT_VERSION:=3ab1c582fa01a78ea62807c496648e83
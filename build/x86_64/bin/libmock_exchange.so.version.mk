@@ -0,0 +1 @@
+LIB_mock_exchange_CURRENT_VERSION:=a3a64a9ec683648e45f98e2a19c29c6c
@@ -0,0 +1 @@
+LIB_monitor_CURRENT_VERSION:=896ea2ea7742f79a1c784a4fd50bd580
@@ -0,0 +1 @@
+LIB_monitor_service_CURRENT_VERSION:=69d91921a27a797a996b74d00e94f1ac
@@ -0,0 +1 @@
+LIB_mopub_exchange_CURRENT_VERSION:=14916618d88e4cbb75e122292e1ab50a
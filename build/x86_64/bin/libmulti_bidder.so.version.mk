@@ -0,0 +1 @@
+LIB_multi_bidder_CURRENT_VERSION:=daf99261a37e956bb3b2ee87de0638bc
@@ -0,0 +1 @@
+LIB_neural_CURRENT_VERSION:=dc0b01ff2b6c1195c013844928f2c0ab
@@ -0,0 +1 @@
+LIB_nexage_exchange_CURRENT_VERSION:=b891452e6f1c513d05fc155a01021df1
@@ -0,0 +1 @@
+LIB_node_exception_tracing_CURRENT_VERSION:=ee2e5c527a9bbc8b38698d736d108042
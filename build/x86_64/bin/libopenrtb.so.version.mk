@@ -0,0 +1 @@
+LIB_openrtb_CURRENT_VERSION:=b491deb455e4a7028f9b11d297cae1ac
@@ -0,0 +1 @@
+LIB_openrtb_bid_request_CURRENT_VERSION:=53875e00cf4eda7064c8eb991af20dce
@@ -0,0 +1 @@
+LIB_openrtb_exchange_CURRENT_VERSION:=b31a968c843ccea8557b395eac1425b7
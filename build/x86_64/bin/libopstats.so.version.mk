@@ -0,0 +1 @@
+LIB_opstats_CURRENT_VERSION:=4fe00215fabedca4153f10ae10d388d0
@@ -0,0 +1 @@
+LIB_opstats_node_impl_CURRENT_VERSION:=260f0c1f8f24a4f3d13cd4ef8d3afcc9
@@ -0,0 +1 @@
+LIB_pipeline_CURRENT_VERSION:=cc3271b9639ab3584343c33d82bbdab8
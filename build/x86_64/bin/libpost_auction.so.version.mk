@@ -0,0 +1 @@
+LIB_post_auction_CURRENT_VERSION:=f4d088f4d4725baec4cf9dd53cdedc5c
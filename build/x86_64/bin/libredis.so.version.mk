@@ -0,0 +1 @@
+LIB_redis_CURRENT_VERSION:=11bf1f9646692bd586e11e072c36b650
@@ -0,0 +1 @@
+LIB_redis_migration_CURRENT_VERSION:=d83e3de59f0b40fbacbc72c5196be224
@@ -0,0 +1 @@
+LIB_rtb_CURRENT_VERSION:=ad7f2bf2ae9d1675da49b20bbec60f33
@@ -0,0 +1 @@
+LIB_rtb_node_impl_CURRENT_VERSION:=f7b8e8876641d8fcc57cc0b195ec1a25
@@ -0,0 +1 @@
+LIB_rtb_router_CURRENT_VERSION:=a0d6bcec347579c7c6c91e1da1c9fc85
@@ -0,0 +1 @@
+LIB_rtbkit_CURRENT_VERSION:=8eaf441ad1914d04b816958d70778d3f
@@ -0,0 +1 @@
+LIB_rtbkit_exchange_CURRENT_VERSION:=62c5bb22fba726d9786bda298af597bb
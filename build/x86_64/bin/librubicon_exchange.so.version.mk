@@ -0,0 +1 @@
+LIB_rubicon_exchange_CURRENT_VERSION:=cec21fff3c55326e96004305664c03b0
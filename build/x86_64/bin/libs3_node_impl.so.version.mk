@@ -0,0 +1 @@
+LIB_s3_node_impl_CURRENT_VERSION:=a014b0dfd32d3a8e131109a3eb1d6119
@@ -0,0 +1 @@
+LIB_services_CURRENT_VERSION:=d48335cf20be8ca4f7f119487c449525
@@ -0,0 +1 @@
+LIB_services_node_impl_CURRENT_VERSION:=f40043c3c0cdc4dd0c937caa5a2d6890
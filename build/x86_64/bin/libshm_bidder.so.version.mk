@@ -0,0 +1 @@
+LIB_shm_bidder_CURRENT_VERSION:=d0849570f0e57ebb32d2ff10b4fd2ae7
@@ -0,0 +1 @@
+LIB_signal_slot_test_module_node_impl_CURRENT_VERSION:=fd466a9fdf191795b7db7f0920161dee
@@ -0,0 +1 @@
+LIB_sigslot_CURRENT_VERSION:=d68925eeed3cad02e161dd021834f65c
@@ -0,0 +1 @@
+LIB_sigslot_node_impl_CURRENT_VERSION:=b276aaa0eb2747e344e970d1975e2e09
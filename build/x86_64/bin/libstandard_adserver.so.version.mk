@@ -0,0 +1 @@
+LIB_standard_adserver_CURRENT_VERSION:=041a595481b1871cc17f6c80b781391c
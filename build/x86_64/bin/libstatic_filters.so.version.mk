@@ -0,0 +1 @@
+LIB_static_filters_CURRENT_VERSION:=c145b46048392483526aaaeabe2bb9f6
@@ -0,0 +1 @@
+LIB_stats_CURRENT_VERSION:=64a3926a9d359138a117e8b1046a987b
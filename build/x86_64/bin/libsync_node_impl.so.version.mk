@@ -0,0 +1 @@
+LIB_sync_node_impl_CURRENT_VERSION:=914ee5767d74126cb54fb02f2dd3abb6
@@ -0,0 +1 @@
+LIB_sync_utils_node_impl_CURRENT_VERSION:=09b774fe61474bc2fa29e257454506fe
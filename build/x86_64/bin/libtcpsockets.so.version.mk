@@ -0,0 +1 @@
+LIB_tcpsockets_CURRENT_VERSION:=6405d6283bae27a8058d72109ec60358
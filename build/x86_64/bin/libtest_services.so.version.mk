@@ -0,0 +1 @@
+LIB_test_services_CURRENT_VERSION:=4ac440e64d47068cd8091ec614b0d359
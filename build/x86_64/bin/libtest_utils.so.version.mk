@@ -0,0 +1 @@
+LIB_test_utils_CURRENT_VERSION:=70afa64957f45c8fbfc839951e142ac6
@@ -0,0 +1 @@
+LIB_tinyxml2_CURRENT_VERSION:=d14c8de09caf3968246c49d010079039
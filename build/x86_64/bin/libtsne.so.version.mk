@@ -0,0 +1 @@
+LIB_tsne_CURRENT_VERSION:=2f4150fe08ce59a0a710408c2c9db935
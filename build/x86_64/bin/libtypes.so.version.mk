@@ -0,0 +1 @@
+LIB_types_CURRENT_VERSION:=aad83ed8442912ab0ab3a76c855980a2
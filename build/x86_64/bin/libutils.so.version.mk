@@ -0,0 +1 @@
+LIB_utils_CURRENT_VERSION:=ae2fde20d42d5cbd7505de80908bbc2b
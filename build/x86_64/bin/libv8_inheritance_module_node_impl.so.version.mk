@@ -0,0 +1 @@
+LIB_v8_inheritance_module_node_impl_CURRENT_VERSION:=59bcba09d32ddef4e96ad25cb82be5c3
@@ -0,0 +1 @@
+LIB_value_description_CURRENT_VERSION:=b8e22aaf2b0984c5b5dce1abbc86e357
@@ -0,0 +1 @@
+LIB_variadic_hash_CURRENT_VERSION:=2f1e75c59e7395f13632033885f7852c
@@ -0,0 +1 @@
+LIB_worker_task_CURRENT_VERSION:=ed7fb5dd5b0e26fea8b6c15a1b8f1560
@@ -0,0 +1 @@
+LIB_zeromq_CURRENT_VERSION:=60b7c1367fb8afd94074c21c5cd50cfd
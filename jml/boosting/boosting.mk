@@ -45,6 +45,8 @@ LIBBOOSTING_SOURCES := \
         feature_transform.cc \
         transform_list.cc \
         committee.cc \
+        flattened_classifier.cc \
+        histogram_training.cc \
         boosting_training.cc \
         null_classifier_generator.cc \
 	tree.cc \
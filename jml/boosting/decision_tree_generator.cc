@@ -16,6 +16,7 @@
 #include "stump_training.h"
 #include "stump_training_bin.h"
 #include "stump_regress.h"
+#include "histogram_training.h"
 #include "jml/utils/smart_ptr_utils.h"
 
 #include <boost/random/mersenne_twister.hpp>
@@ -35,6 +36,7 @@ namespace ML {
 
 Decision_Tree_Generator::
 Decision_Tree_Generator()
+    : binned_cache(new Binned_Dataset_Cache())
 {
     defaults();
 }
@@ -53,6 +55,7 @@ configure(const Configuration & config)
     config.find(max_depth, "max_depth");
     config.find(update_alg, "update_alg");
     config.find(random_feature_propn, "random_feature_propn");
+    config.find(histogram_bins, "histogram_bins");
 }
 
 void
@@ -64,6 +67,7 @@ defaults()
     max_depth = -1;
     update_alg = Stump::PROB;
     random_feature_propn = 1.0;
+    histogram_bins = 0;
 }
 
 Config_Options
@@ -79,7 +83,10 @@ options() const
         .add("update_alg", update_alg,
              "select the type of output that the tree gives")
         .add("random_feature_propn", random_feature_propn, "0.0-1.0",
-             "proportion of the features to enable (for random forests)");
+             "proportion of the features to enable (for random forests)")
+        .add("histogram_bins", histogram_bins, "0 or 2-255",
+             "quantize the features into this many bins and find the splits "
+             "from histograms; 0 means use the exact values");
     
     return result;
 }
@@ -138,6 +145,18 @@ generate(Thread_Context & context,
     return make_sp(current.make_copy());
 }
 
+struct Decision_Tree_Generator::Histogram_Problem {
+    Histogram_Problem(const Binned_Dataset & binned,
+                      const vector<Feature> & features)
+        : binned(binned), columns(binned.column_indexes(features))
+    {
+    }
+
+    const Binned_Dataset & binned;
+    vector<int> columns;        ///< Those of the features we can split on
+    Histogram_Weights weights;
+};
+
 Decision_Tree
 Decision_Tree_Generator::
 train_weighted(Thread_Context & context,
@@ -200,8 +219,32 @@ train_weighted(Thread_Context & context,
 
         for (unsigned x = 0;  x < weights_vec.size();  ++x)
             weights_vec[x] = &weights[x][0];
-        
-        result.tree.root = train_recursive
+
+        if (histogram_bins > 0) {
+            /* Bin all of the features, not only the ones selected, so that
+               the binning can be reused for the next tree. */
+            std::shared_ptr<const Binned_Dataset> binned
+                = binned_cache->get(data, predicted, features,
+                                    histogram_bins);
+
+            Histogram_Problem problem(*binned, filtered_features);
+            problem.weights.init(*binned, weights_vec, in_class,
+                                 advance == 0, advance);
+
+            vector<int> examples(data.example_count());
+            for (unsigned x = 0;  x < examples.size();  ++x)
+                examples[x] = x;
+
+            Histograms histograms(*binned, problem.weights.width);
+            histograms.accumulate(context, *binned, problem.columns,
+                                  problem.weights, &examples[0],
+                                  examples.size());
+
+            result.tree.root = train_recursive_histogram
+                (context, problem, examples, histograms, 0, max_depth,
+                 result.tree);
+        }
+        else result.tree.root = train_recursive
             (context, data, weights_vec, advance, filtered_features, in_class,
              0, max_depth, result.tree);
 
@@ -608,6 +651,51 @@ void split_dataset(const Training_Data & data,
     }
 }
 
+/** The leaf for the examples of the histograms, as fillin_leaf would make
+    it, and the weight of each label.
+*/
+template<class W>
+void fillin_histogram_leaf(Tree::Leaf & leaf,
+                           distribution<float> & class_weights,
+                           const Histograms & histograms,
+                           int nl,
+                           Stump::Update update_alg,
+                           float examples)
+{
+    /* The same W as calc_default_w gives, with all of the weight in the
+       MISSING bucket. */
+    W w(nl);
+    set_bucket(w, MISSING, &histograms.total[0], histograms.width);
+
+    class_weights = distribution<float>(nl);
+    for (unsigned j = 0;  j < 3;  ++j)
+        for (unsigned l = 0;  l < w.nl();  ++l)
+            class_weights[l] += w(l, j, true);
+
+    leaf.examples = examples;
+
+    double epsilon = xdiv<double>(1.0, examples);
+    get_probs(leaf.pred, w, update_alg, epsilon);
+}
+
+template<class W, class Z>
+void find_histogram_split(Thread_Context & context,
+                          const Feature_Space & fs,
+                          int nl, int trace,
+                          const Binned_Dataset & binned,
+                          const vector<int> & columns,
+                          const Histograms & histograms,
+                          Split & split, float & best_z)
+{
+    typedef Tree_Accum<W, Z, Stream_Tracer> Accum;
+    Accum accum(fs, nl, trace);
+
+    test_histograms<W>(context, binned, columns, histograms, accum);
+
+    split = accum.split();
+    best_z = accum.z();
+}
+
 } // file scope
 
 struct Decision_Tree_Generator::Train_Recursive_Job {
@@ -965,6 +1053,207 @@ train_recursive(Thread_Context & context,
     return node;
 }
 
+struct Decision_Tree_Generator::Train_Histogram_Job {
+
+    Tree::Ptr & ptr;
+    const Decision_Tree_Generator * generator;
+    Thread_Context context;
+    const Histogram_Problem & problem;
+    vector<int> & examples;
+    Histograms & histograms;
+    int depth;
+    int max_depth;
+    Tree & tree;
+
+    Train_Histogram_Job(Tree::Ptr & ptr,
+                        const Decision_Tree_Generator * generator,
+                        const Thread_Context & context,
+                        const Histogram_Problem & problem,
+                        vector<int> & examples,
+                        Histograms & histograms,
+                        int depth, int max_depth,
+                        Tree & tree)
+        : ptr(ptr), generator(generator), context(context),
+          problem(problem), examples(examples), histograms(histograms),
+          depth(depth), max_depth(max_depth), tree(tree)
+    {
+    }
+
+    void operator () ()
+    {
+        ptr = generator->train_recursive_histogram(context, problem,
+                                                   examples, histograms,
+                                                   depth, max_depth, tree);
+    }
+};
+
+Tree::Ptr
+Decision_Tree_Generator::
+train_recursive_histogram(Thread_Context & context,
+                          const Histogram_Problem & problem,
+                          vector<int> & examples,
+                          Histograms & histograms,
+                          int depth, int max_depth,
+                          Tree & tree) const
+{
+    if (depth > 100 && max_depth == -1)
+        throw Exception("Decision_Tree_Generator::train_recursive_histogram(): "
+                        "depth of 100 reached");
+
+    const Binned_Dataset & binned = problem.binned;
+    bool binsym = problem.weights.binsym;
+    int nl = binned.label_count;
+
+    double total_weight = problem.weights.total(examples.data(),
+                                                examples.size());
+
+    /* What would we have as a leaf if we were to stop splitting here? */
+    Tree::Leaf leaf;
+    distribution<float> class_weights;
+    if (binsym)
+        fillin_histogram_leaf<W_binsym>(leaf, class_weights, histograms, nl,
+                                        update_alg, total_weight);
+    else fillin_histogram_leaf<W_normal>(leaf, class_weights, histograms, nl,
+                                         update_alg, total_weight);
+
+    int numNonZeroClasses = 0;
+    for (auto c: class_weights)
+        if (c != 0.0)
+            numNonZeroClasses += 1;
+
+    /* Same conditions as train_recursive */
+    if (class_weights.max() == 1.0
+        || depth == max_depth
+        || numNonZeroClasses <= 1
+        || total_weight < 1.0
+        || class_weights.total() == 0.0
+        || examples.size() == 1) {
+        Tree::Leaf * result = tree.new_leaf();
+        *result = leaf;
+        return result;
+    }
+
+    Split split;
+    float best_z = 0.0;
+
+    if (binsym)
+        find_histogram_split<W_binsym, Z_binsym>
+            (context, *model.feature_space(), nl, trace, binned,
+             problem.columns, histograms, split, best_z);
+    else find_histogram_split<W_normal, Z_normal>
+            (context, *model.feature_space(), nl, trace, binned,
+             problem.columns, histograms, split, best_z);
+
+    if (split.feature() == MISSING_FEATURE) {
+        cerr << "WARNING: no feature found in decision tree split" << endl;
+        Tree::Leaf * result = tree.new_leaf();
+        *result = leaf;
+        return result;
+    }
+
+    /* Split the examples.  All of the values in a bin go the same way, so
+       we only need to apply the split to one value per bin. */
+    const Binned_Dataset::Column & column
+        = binned.columns.at(binned.column_index(split.feature()));
+
+    int decisions[256];
+    for (int b = 0;  b < column.num_bins;  ++b)
+        decisions[b] = split.apply(column.values[b]);
+    decisions[column.num_bins] = MISSING;
+
+    vector<int> branch_examples[3];
+    const uint8_t * bins = &column.bins[0];
+    for (unsigned i = 0;  i < examples.size();  ++i) {
+        int x = examples[i];
+        branch_examples[decisions[bins[x]]].push_back(x);
+    }
+
+    vector<int>().swap(examples);
+
+    /* Accumulate the histograms of the smaller branches, and get the one
+       of the largest by subtracting them from ours. */
+    int largest = 0;
+    for (int b = 1;  b < 3;  ++b)
+        if (branch_examples[b].size() > branch_examples[largest].size())
+            largest = b;
+
+    Histograms branch_histograms[3];
+    for (int b = 0;  b < 3;  ++b) {
+        if (b == largest) continue;
+        branch_histograms[b].init(binned, histograms.width);
+        branch_histograms[b].accumulate(context, binned, problem.columns,
+                                        problem.weights,
+                                        branch_examples[b].data(),
+                                        branch_examples[b].size());
+    }
+
+    branch_histograms[largest].swap(histograms);
+    for (int b = 0;  b < 3;  ++b)
+        if (b != largest)
+            branch_histograms[largest].subtract(branch_histograms[b]);
+
+    Tree::Node * node = tree.new_node();
+    node->split = split;
+    node->z = best_z;
+    node->examples = total_weight;
+    node->pred = leaf.pred;
+
+    int group_to_wait_for = -1;
+
+    auto do_branch = [&] (Tree::Ptr & ptr, int b)
+        {
+            size_t n = branch_examples[b].size();
+
+            if (n > 1024) {
+                // Worth multithreading... do it
+                if (group_to_wait_for == -1)
+                    group_to_wait_for
+                        = context.worker().get_group(NO_JOB,
+                                                     "decision tree",
+                                                     context.group());
+
+                Thread_Context child_context
+                    = context.child(group_to_wait_for);
+
+                Train_Histogram_Job job(ptr, this, child_context, problem,
+                                        branch_examples[b],
+                                        branch_histograms[b],
+                                        depth + 1, max_depth, tree);
+
+                context.worker().add(job, "train decision tree branch",
+                                     child_context.group());
+            }
+            else if (n > 0)
+                ptr = train_recursive_histogram(context, problem,
+                                                branch_examples[b],
+                                                branch_histograms[b],
+                                                depth + 1, max_depth, tree);
+            else {
+                // Leaf only
+                ptr = tree.new_leaf();
+                distribution<float> unused;
+                if (binsym)
+                    fillin_histogram_leaf<W_binsym>
+                        (*ptr.leaf(), unused, branch_histograms[b], nl,
+                         update_alg, 0.0);
+                else fillin_histogram_leaf<W_normal>
+                        (*ptr.leaf(), unused, branch_histograms[b], nl,
+                         update_alg, 0.0);
+            }
+        };
+
+    do_branch(node->child_true, true);
+    do_branch(node->child_false, false);
+    do_branch(node->child_missing, MISSING);
+
+    if (group_to_wait_for != -1) {
+        context.worker().unlock_group(group_to_wait_for);
+        context.worker().run_until_finished(group_to_wait_for);
+    }
+
+    return node;
+}
+
 Tree::Ptr
 Decision_Tree_Generator::
 train_recursive_regression(Thread_Context & context,
@@ -17,6 +17,10 @@
 namespace ML {
 
 
+struct Binned_Dataset_Cache;
+struct Histograms;
+
+
 /*****************************************************************************/
 /* DECISION_TREE_GENERATOR                                                  */
 /*****************************************************************************/
@@ -71,6 +75,15 @@ public:
     Stump::Update update_alg;
     float random_feature_propn;
 
+    /** If non-zero, the features are quantized into this many bins (at most
+        255) and the splits are found from histograms of the bins.  See
+        histogram_training.h.
+    */
+    int histogram_bins;
+
+    /** Keeps the quantized data from one call to the next. */
+    std::shared_ptr<Binned_Dataset_Cache> binned_cache;
+
     /* Once init has been called, we clone our potential models from this
        one. */
     Decision_Tree model;
@@ -99,6 +112,20 @@ public:
                                const distribution<float> & in_class,
                                int depth, int max_depth, Tree & tree) const;
 
+    /** What train_recursive_histogram needs that doesn't change from one
+        node to the next. */
+    struct Histogram_Problem;
+
+    /** Train over the given examples, whose histograms are given.  Both
+        are consumed.
+    */
+    Tree::Ptr
+    train_recursive_histogram(Thread_Context & context,
+                              const Histogram_Problem & problem,
+                              std::vector<int> & examples,
+                              Histograms & histograms,
+                              int depth, int max_depth, Tree & tree) const;
+
     void do_branch(Tree::Ptr & ptr,
                    int & group_to_wait_on,
                    Thread_Context & context,
@@ -112,6 +139,7 @@ public:
                    Tree & tree) const;
     
     struct Train_Recursive_Job;
+    struct Train_Histogram_Job;
 };
 
 
@@ -0,0 +1,347 @@
+/* flattened_classifier.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tree based classifiers compiled into flat arrays for batch prediction.
+*/
+
+#include "flattened_classifier.h"
+#include "decision_tree.h"
+#include "boosted_stumps.h"
+#include "committee.h"
+#include "stump.h"
+#include "feature_space.h"
+#include "jml/utils/floating_point.h"
+#include "jml/arch/exception.h"
+#include <map>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* FLATTENED_CLASSIFIER                                                      */
+/*****************************************************************************/
+
+struct Flattened_Classifier::Feature_Index {
+    Feature_Index(const Feature_Space & fs,
+                  const std::vector<Feature> & features)
+        : fs(fs)
+    {
+        for (unsigned i = 0;  i < features.size();  ++i)
+            index.insert(make_pair(features[i], i));
+    }
+
+    const Feature_Space & fs;
+    std::map<Feature, int> index;
+
+    int operator () (const Feature & feature) const
+    {
+        auto it = index.find(feature);
+        if (it == index.end())
+            throw Exception("Flattened_Classifier: feature %s needed by the "
+                            "classifier is not in the features",
+                            fs.print(feature).c_str());
+        return it->second;
+    }
+};
+
+Flattened_Classifier::
+Flattened_Classifier()
+    : output(RAW), feature_count_(0)
+{
+}
+
+Flattened_Classifier::
+Flattened_Classifier(const Classifier_Impl & classifier,
+                     const std::vector<Feature> & features)
+    : output(RAW), feature_count_(0)
+{
+    compile(classifier, features);
+}
+
+void
+Flattened_Classifier::
+swap(Flattened_Classifier & other)
+{
+    nodes.swap(other.nodes);
+    leaves.swap(other.leaves);
+    roots.swap(other.roots);
+    bias.swap(other.bias);
+    std::swap(output, other.output);
+    std::swap(feature_count_, other.feature_count_);
+}
+
+bool
+Flattened_Classifier::
+supported(const Classifier_Impl & classifier)
+{
+    if (dynamic_cast<const Decision_Tree *>(&classifier))
+        return true;
+    if (dynamic_cast<const Boosted_Stumps *>(&classifier))
+        return true;
+    if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+        for (auto & member: committee->classifiers) {
+            if (!supported(*member))
+                return false;
+            // The output transformation can't be applied to a member
+            auto stumps = dynamic_cast<const Boosted_Stumps *>(member.get());
+            if (stumps && stumps->output != Boosted_Stumps::RAW)
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void
+Flattened_Classifier::
+compile(const Classifier_Impl & classifier,
+        const std::vector<Feature> & features)
+{
+    Flattened_Classifier result;
+    result.feature_count_ = features.size();
+    result.bias.resize(classifier.label_count(), 0.0);
+
+    // Leaf zero is empty, for the missing branches of the trees
+    result.leaves.resize(classifier.label_count(), 0.0);
+
+    Feature_Index index(*classifier.feature_space(), features);
+    result.add_classifier(classifier, 1.0, true, index);
+
+    swap(result);
+}
+
+void
+Flattened_Classifier::
+add_classifier(const Classifier_Impl & classifier, float weight, bool top,
+               const Feature_Index & index)
+{
+    if (classifier.label_count() != label_count())
+        throw Exception("Flattened_Classifier: classifier has %zd labels "
+                        "instead of %zd",
+                        classifier.label_count(), label_count());
+
+    if (auto tree = dynamic_cast<const Decision_Tree *>(&classifier)) {
+        roots.push_back(add_tree(tree->tree.root, weight, index));
+    }
+    else if (auto stumps = dynamic_cast<const Boosted_Stumps *>(&classifier)) {
+        if (stumps->output != Boosted_Stumps::RAW) {
+            if (!top)
+                throw Exception("Flattened_Classifier: can't flatten boosted "
+                                "stumps with a transformed output within a "
+                                "committee");
+            output = stumps->output == Boosted_Stumps::LOGIT
+                ? LOGIT : LOGIT_NORM;
+        }
+
+        if (stumps->bias.size())
+            bias += weight * stumps->bias;
+
+        for (auto & stump: stumps->stumps)
+            roots.push_back(add_stump(stump.first, stump.second.action,
+                                      weight, index));
+    }
+    else if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+        if (committee->bias.size())
+            bias += weight * committee->bias;
+
+        for (unsigned i = 0;  i < committee->classifiers.size();  ++i) {
+            if (committee->weights[i] == 0.0) continue;
+            add_classifier(*committee->classifiers[i],
+                           weight * committee->weights[i], false, index);
+        }
+    }
+    else throw Exception("Flattened_Classifier: can't flatten a %s "
+                         "classifier", classifier.class_id().c_str());
+}
+
+int
+Flattened_Classifier::
+add_tree(const Tree::Ptr & ptr, float weight, const Feature_Index & index)
+{
+    if (!ptr) return -1;
+
+    if (!ptr.node())
+        return add_leaf(ptr.leaf()->pred, weight);
+
+    const Tree::Node & node = *ptr.node();
+
+    int result = add_split(node.split, index);
+
+    // Can't keep a reference into nodes, which grows as we recurse
+    int child_false = add_tree(node.child_false, weight, index);
+    int child_true = add_tree(node.child_true, weight, index);
+    int child_missing = add_tree(node.child_missing, weight, index);
+
+    nodes[result].child[false] = child_false;
+    nodes[result].child[true] = child_true;
+    nodes[result].child[MISSING] = child_missing;
+
+    return result;
+}
+
+int
+Flattened_Classifier::
+add_stump(const Split & split, const Action & action, float weight,
+          const Feature_Index & index)
+{
+    int result = add_split(split, index);
+
+    int child_false = add_leaf(action.pred_false, weight);
+    int child_true = add_leaf(action.pred_true, weight);
+    int child_missing = add_leaf(action.pred_missing, weight);
+
+    nodes[result].child[false] = child_false;
+    nodes[result].child[true] = child_true;
+    nodes[result].child[MISSING] = child_missing;
+
+    return result;
+}
+
+int
+Flattened_Classifier::
+add_split(const Split & split, const Feature_Index & index)
+{
+    Node node;
+    node.feature = index(split.feature());
+    node.split_val = split.split_val();
+    node.op = split.op();
+    node.child[0] = node.child[1] = node.child[2] = -1;
+
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+int
+Flattened_Classifier::
+add_leaf(const distribution<float> & pred, float weight)
+{
+    // Nothing to add; use the empty leaf
+    if (pred.empty()) return -1;
+
+    if (pred.size() != label_count())
+        throw Exception("Flattened_Classifier: leaf has %zd labels instead "
+                        "of %zd", pred.size(), label_count());
+
+    int result = -(int)leaves.size() - 1;
+    for (unsigned i = 0;  i < pred.size();  ++i)
+        leaves.push_back(pred[i] * weight);
+    return result;
+}
+
+namespace {
+
+/** Number of examples that go down each tree together. */
+enum { BLOCK_SIZE = 32 };
+
+/** Same as Split::apply(float), but branch free. */
+JML_ALWAYS_INLINE int
+apply_split(float val, float split_val, int op)
+{
+    int all = (val < split_val) | ((val == split_val) << 1) | 4;
+    int result = (all >> op) & 1;
+    return val != val ? MISSING : result;
+}
+
+} // file scope
+
+void
+Flattened_Classifier::
+predict(const float * X, size_t n, float * out) const
+{
+    int nl = label_count();
+    size_t nf = feature_count_;
+
+    const Node * nodes = &this->nodes[0];
+    const float * leaves = &this->leaves[0];
+
+    double accum[BLOCK_SIZE * nl];
+    int current[BLOCK_SIZE];
+
+    for (size_t first = 0;  first < n;  first += BLOCK_SIZE) {
+        int nb = std::min<size_t>(BLOCK_SIZE, n - first);
+        const float * block = X + first * nf;
+
+        for (int i = 0;  i < nb;  ++i)
+            std::copy(bias.begin(), bias.end(), accum + i * nl);
+
+        for (unsigned t = 0;  t < roots.size();  ++t) {
+            std::fill(current, current + nb, roots[t]);
+
+            /* Take all of the examples of the block one level down the tree
+               at a time.  They don't depend on each other, so the loads of
+               the nodes and features of one overlap with the others. */
+            for (bool more = roots[t] >= 0;  more;) {
+                more = false;
+                for (int i = 0;  i < nb;  ++i) {
+                    int c = current[i];
+                    if (c < 0) continue;
+                    const Node & node = nodes[c];
+                    float val = block[i * nf + node.feature];
+                    c = node.child[apply_split(val, node.split_val, node.op)];
+                    current[i] = c;
+                    more |= c >= 0;
+                }
+            }
+
+            if (JML_LIKELY(nl == 2)) {
+                for (int i = 0;  i < nb;  ++i) {
+                    const float * leaf = leaves - current[i] - 1;
+                    accum[i * 2] += leaf[0];
+                    accum[i * 2 + 1] += leaf[1];
+                }
+            }
+            else {
+                for (int i = 0;  i < nb;  ++i) {
+                    const float * leaf = leaves - current[i] - 1;
+                    for (int j = 0;  j < nl;  ++j)
+                        accum[i * nl + j] += leaf[j];
+                }
+            }
+        }
+
+        float * result = out + first * nl;
+
+        if (output == RAW) {
+            std::copy(accum, accum + nb * nl, result);
+            continue;
+        }
+
+        for (int i = 0;  i < nb;  ++i) {
+            double total = 0.0;
+            for (int j = 0;  j < nl;  ++j) {
+                float r = accum[i * nl + j];
+                /* Avoid an overflow from the exp. */
+                if (r > fp_traits<float>::max_exp_arg * 0.9)
+                    r = fp_traits<float>::max_exp_arg * 0.9;
+                double e = exp(r);
+                double x = e / (e + (1.0 / e));
+                total += x;
+                result[i * nl + j] = x;
+            }
+
+            if (output != LOGIT_NORM) continue;
+
+            for (int j = 0;  j < nl;  ++j) {
+                if ((float)total == 0.0F)
+                    result[i * nl + j] = 1.0 / nl;
+                else result[i * nl + j] /= total;
+            }
+        }
+    }
+}
+
+Label_Dist
+Flattened_Classifier::
+predict(const float * features) const
+{
+    Label_Dist result(label_count());
+    predict(features, 1, &result[0]);
+    return result;
+}
+
+} // namespace ML
@@ -0,0 +1,119 @@
+/* flattened_classifier.h                                          -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tree based classifiers compiled into flat arrays for batch prediction.
+*/
+
+#ifndef __boosting__flattened_classifier_h__
+#define __boosting__flattened_classifier_h__
+
+
+#include "classifier.h"
+#include "tree.h"
+#include "split.h"
+#include <vector>
+
+
+namespace ML {
+
+
+class Action;
+
+
+/*****************************************************************************/
+/* FLATTENED_CLASSIFIER                                                      */
+/*****************************************************************************/
+
+/** A Decision_Tree, Boosted_Stumps or a Committee of them compiled for
+    prediction only.
+
+    All of the trees (a stump being a tree with a single node) are laid out
+    one after the other in a single array of nodes, in depth first order,
+    and the leaf predictions, already multiplied by the weight of their
+    tree, are in a second array.  Committees are flattened into the trees
+    of their members.  Predicting doesn't follow any pointers nor make any
+    virtual calls, and predicting many examples at once runs each tree over
+    a block of them, while it's in the cache.
+
+    The examples are dense vectors of floats, with one value per feature in
+    the order given to compile(); a NaN value means that the feature is
+    missing.  The results are the same as those of the classifier's
+    optimized predict with the Optimization_Info obtained from optimize()
+    over the same features, up to float rounding.
+*/
+
+class Flattened_Classifier {
+public:
+    Flattened_Classifier();
+
+    /** Compile the given classifier for examples with the given features.
+        Throws if the classifier can't be flattened or needs a feature that
+        isn't in the list.
+    */
+    Flattened_Classifier(const Classifier_Impl & classifier,
+                         const std::vector<Feature> & features);
+
+    void compile(const Classifier_Impl & classifier,
+                 const std::vector<Feature> & features);
+
+    /** Can the given classifier be flattened? */
+    static bool supported(const Classifier_Impl & classifier);
+
+    size_t label_count() const { return bias.size(); }
+    size_t feature_count() const { return feature_count_; }
+    size_t tree_count() const { return roots.size(); }
+    size_t node_count() const { return nodes.size(); }
+
+    /** Predict the n examples in X, which has feature_count() values per
+        example, putting the label_count() values for each in out.
+    */
+    void predict(const float * X, size_t n, float * out) const;
+
+    /** Predict a single example. */
+    Label_Dist predict(const float * features) const;
+
+    void swap(Flattened_Classifier & other);
+
+private:
+    /** Transformation of the output, as for Boosted_Stumps. */
+    enum Output {
+        RAW,
+        LOGIT,
+        LOGIT_NORM
+    };
+
+    /** A split of a tree.  The children are indexed by the result of the
+        split (false, true or MISSING); a negative child is a leaf, whose
+        values start at leaves[-child - 1].
+    */
+    struct Node {
+        int feature;       ///< Index of the feature in the examples
+        float split_val;
+        int op;            ///< Split::Op
+        int child[3];
+    };
+
+    std::vector<Node> nodes;
+    std::vector<float> leaves;   ///< label_count() values per leaf
+    std::vector<int> roots;      ///< Node or leaf at the root of each tree
+    distribution<float> bias;
+    Output output;
+    size_t feature_count_;
+
+    /** Where the compilation gets the index of each feature. */
+    struct Feature_Index;
+
+    void add_classifier(const Classifier_Impl & classifier, float weight,
+                        bool top, const Feature_Index & index);
+    int add_tree(const Tree::Ptr & ptr, float weight,
+                 const Feature_Index & index);
+    int add_stump(const Split & split, const Action & action, float weight,
+                  const Feature_Index & index);
+    int add_split(const Split & split, const Feature_Index & index);
+    int add_leaf(const distribution<float> & pred, float weight);
+};
+
+} // namespace ML
+
+
+#endif /* __boosting__flattened_classifier_h__ */
@@ -0,0 +1,419 @@
+/* histogram_training.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Split finding over histograms of quantized features.
+*/
+
+#include "histogram_training.h"
+#include "training_index.h"
+#include "feature_space.h"
+#include "jml/arch/sse2.h"
+#include "jml/arch/exception.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* BINNED_DATASET                                                            */
+/*****************************************************************************/
+
+Binned_Dataset::
+Binned_Dataset()
+    : label_count(0), generation_(0), max_bins_(0), bin_count_(0)
+{
+}
+
+Binned_Dataset::
+Binned_Dataset(const Training_Data & data,
+               const Feature & predicted,
+               const std::vector<Feature> & features,
+               int max_bins)
+    : label_count(0), generation_(0), max_bins_(0), bin_count_(0)
+{
+    init(data, predicted, features, max_bins);
+}
+
+void
+Binned_Dataset::
+init(const Training_Data & data,
+     const Feature & predicted,
+     const std::vector<Feature> & features,
+     int max_bins)
+{
+    if (max_bins < 2 || max_bins > 255)
+        throw Exception("Binned_Dataset: max_bins must be between 2 and 255, "
+                        "not %d", max_bins);
+
+    this->predicted = predicted;
+    label_count = data.label_count(predicted);
+
+    const vector<Label> & data_labels = data.index().labels(predicted);
+    labels.assign(data_labels.begin(), data_labels.end());
+
+    const Feature_Space & fs = *data.feature_space();
+
+    columns.clear();
+    columns.reserve(features.size());
+    column_index_.clear();
+    bin_count_ = 0;
+
+    for (unsigned i = 0;  i < features.size();  ++i) {
+        const Feature & feature = features[i];
+
+        /* Don't predict the label with the label! */
+        if (feature == predicted) continue;
+        if (column_index_.count(feature)) continue;
+
+        Column column;
+        column.feature = feature;
+
+        // Our Kind hides some of the Feature_Types
+        switch (fs.info(feature).type()) {
+        case ML::REAL:
+        case ML::BOOLEAN:
+            bin_ordered(column, data, max_bins);
+            break;
+
+        case ML::CATEGORICAL:
+        case ML::STRING:
+            bin_categorical(column, data, max_bins);
+            break;
+
+        case ML::PRESENCE:
+            bin_presence(column, data);
+            break;
+
+        default:
+            // Nothing can be learnt from the others
+            continue;
+        }
+
+        column.offset = bin_count_;
+        bin_count_ += column.num_bins + 1;
+
+        column_index_[feature] = columns.size();
+        columns.push_back(std::move(column));
+    }
+
+    generation_ = data.generation();
+    features_ = features;
+    max_bins_ = max_bins;
+}
+
+bool
+Binned_Dataset::
+matches(const Training_Data & data,
+        const Feature & predicted,
+        const std::vector<Feature> & features,
+        int max_bins) const
+{
+    return data.generation() == generation_
+        && predicted == this->predicted
+        && max_bins == max_bins_
+        && features == features_;
+}
+
+int
+Binned_Dataset::
+column_index(const Feature & feature) const
+{
+    auto it = column_index_.find(feature);
+    if (it == column_index_.end()) return -1;
+    return it->second;
+}
+
+std::vector<int>
+Binned_Dataset::
+column_indexes(const std::vector<Feature> & features) const
+{
+    vector<int> result;
+    for (unsigned i = 0;  i < features.size();  ++i) {
+        int c = column_index(features[i]);
+        if (c != -1) result.push_back(c);
+    }
+    return result;
+}
+
+void
+Binned_Dataset::
+bin_ordered(Column & column, const Training_Data & data, int max_bins)
+{
+    column.kind = ORDERED;
+
+    size_t nx = data.example_count();
+
+    /* Use the index's buckets, so that we test the same split points as the
+       Stump_Trainer does.  Its algorithm can make a few too many of them,
+       in which case we ask for fewer until they fit. */
+    int num_buckets = max_bins;
+    for (;;) {
+        Joint_Index index
+            = data.index().dist(column.feature, BY_EXAMPLE,
+                                IC_VALUE | IC_EXAMPLE | IC_BUCKET,
+                                num_buckets);
+
+        int nb = index.bucket_count();
+        if (nb > max_bins) {
+            num_buckets = std::max<int>(2, num_buckets * max_bins / nb - 1);
+            continue;
+        }
+
+        column.num_bins = nb;
+        column.args = index.bucket_vals();
+        column.values.assign(nb, NAN);
+        column.bins.assign(nx, nb);
+
+        int last_example = -1;
+        for (unsigned i = 0;  i < index.size();  ++i) {
+            int example = index[i].example();
+            if (example == last_example) continue;  // only the first value
+            last_example = example;
+
+            float value = index[i].value();
+            if (isnanf(value)) continue;
+
+            int bucket = index[i].bucket();
+            column.bins[example] = bucket;
+            if (isnanf(column.values[bucket]))
+                column.values[bucket] = value;
+        }
+
+        break;
+    }
+
+    // Buckets that didn't get a value get one that they would contain
+    for (int b = 0;  b < column.num_bins;  ++b) {
+        if (!isnanf(column.values[b])) continue;
+        column.values[b] = b == 0 ? -INFINITY : column.args[b - 1];
+    }
+}
+
+void
+Binned_Dataset::
+bin_categorical(Column & column, const Training_Data & data, int max_bins)
+{
+    column.kind = CATEGORICAL;
+
+    size_t nx = data.example_count();
+
+    const Dataset_Index::Freqs & freqs = data.index().freqs(column.feature);
+
+    /* Keep the most frequent values if there are too many; the others all
+       go in the last bin. */
+    vector<pair<float, float> > kept(freqs.begin(), freqs.end());
+    bool other = kept.size() > max_bins;
+    if (other) {
+        std::sort(kept.begin(), kept.end(),
+                  [] (const pair<float, float> & p1,
+                      const pair<float, float> & p2)
+                  {
+                      return p1.second > p2.second
+                          || (p1.second == p2.second && p1.first < p2.first);
+                  });
+        kept.resize(max_bins - 1);
+        std::sort(kept.begin(), kept.end());
+    }
+
+    column.num_bins = kept.size() + other;
+    column.args.clear();
+    for (unsigned i = 0;  i < kept.size();  ++i)
+        column.args.push_back(kept[i].first);
+    column.values = column.args;
+    if (other) column.values.push_back(NAN);
+    column.bins.assign(nx, column.num_bins);
+
+    Joint_Index index
+        = data.index().dist(column.feature, BY_EXAMPLE,
+                            IC_VALUE | IC_EXAMPLE);
+
+    int last_example = -1;
+    for (unsigned i = 0;  i < index.size();  ++i) {
+        int example = index[i].example();
+        if (example == last_example) continue;
+        last_example = example;
+
+        float value = index[i].value();
+        if (isnanf(value)) continue;
+
+        auto it = std::lower_bound(column.args.begin(), column.args.end(),
+                                   value);
+        if (it != column.args.end() && *it == value)
+            column.bins[example] = it - column.args.begin();
+        else {
+            column.bins[example] = kept.size();
+            // Any value that's not a candidate will do for the split
+            if (isnanf(column.values.back()))
+                column.values.back() = value;
+        }
+    }
+}
+
+void
+Binned_Dataset::
+bin_presence(Column & column, const Training_Data & data)
+{
+    column.kind = PRESENCE;
+    column.num_bins = 1;
+    column.args.assign(1, 0.5);
+    column.values.assign(1, 1.0);
+    column.bins.assign(data.example_count(), 1);
+
+    Joint_Index index
+        = data.index().dist(column.feature, BY_EXAMPLE,
+                            IC_VALUE | IC_EXAMPLE);
+
+    for (unsigned i = 0;  i < index.size();  ++i) {
+        if (index[i].missing()) continue;
+        column.bins[index[i].example()] = 0;
+        column.values[0] = index[i].value();
+    }
+}
+
+
+/*****************************************************************************/
+/* BINNED_DATASET_CACHE                                                      */
+/*****************************************************************************/
+
+std::shared_ptr<const Binned_Dataset>
+Binned_Dataset_Cache::
+get(const Training_Data & data,
+    const Feature & predicted,
+    const std::vector<Feature> & features,
+    int max_bins)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (last && last->matches(data, predicted, features, max_bins))
+        return last;
+
+    last.reset();
+    last.reset(new Binned_Dataset(data, predicted, features, max_bins));
+    return last;
+}
+
+
+/*****************************************************************************/
+/* HISTOGRAMS                                                                */
+/*****************************************************************************/
+
+namespace {
+
+using SIMD::v2di;
+
+/** Add the weights of the examples to the bins of one column.  The widths
+    are always even, so a pair of values is added at a time.  The weights
+    are in the same order as the examples.
+*/
+void
+accumulate_column(int64_t * sums, int width,
+                  const uint8_t * bins, const int * examples,
+                  const int64_t * weights, size_t n)
+{
+    if (width == 2) {
+        for (size_t i = 0;  i < n;  ++i) {
+            v2di * bin = (v2di *)(sums + bins[examples[i]] * 2);
+            *bin += *(const v2di *)(weights + i * 2);
+        }
+        return;
+    }
+
+    for (size_t i = 0;  i < n;  ++i) {
+        v2di * bin = (v2di *)(sums + bins[examples[i]] * width);
+        const v2di * w = (const v2di *)(weights + i * width);
+        for (int j = 0;  j < width / 2;  ++j)
+            bin[j] += w[j];
+    }
+}
+
+} // file scope
+
+void
+Histograms::
+init(const Binned_Dataset & binned, int width)
+{
+    this->width = width;
+    total.clear();
+    total.resize(width);
+    sums.clear();
+    sums.resize(binned.bin_count() * width);
+}
+
+void
+Histograms::
+accumulate(Thread_Context & context,
+           const Binned_Dataset & binned,
+           const std::vector<int> & columns,
+           const Histogram_Weights & weights,
+           const int * examples, size_t n)
+{
+    if (weights.width != width)
+        throw Exception("Histograms::accumulate(): wrong width");
+
+    if (n == 0) return;
+
+    /* Gather the weights of the examples once, so that each column reads
+       them in order. */
+    vector<int64_t> gathered(n * width);
+    for (size_t i = 0;  i < n;  ++i) {
+        const int64_t * w = weights[examples[i]];
+        int64_t * g = &gathered[i * width];
+        for (int j = 0;  j < width;  ++j) {
+            g[j] = w[j];
+            total[j] += w[j];
+        }
+    }
+
+    auto doColumn = [&] (int i)
+        {
+            const Binned_Dataset::Column & column = binned.columns[columns[i]];
+            accumulate_column(&sums[column.offset * width], width,
+                              &column.bins[0], examples, &gathered[0], n);
+        };
+
+    size_t nc = columns.size();
+
+    // Not worth the overhead of the jobs for small nodes
+    if (context.worker().threads() == 0 || n * nc < 65536) {
+        for (unsigned i = 0;  i < nc;  ++i)
+            doColumn(i);
+        return;
+    }
+
+    run_in_parallel(0, nc, doColumn, context.group(),
+                    "accumulate histograms", "accumulate histogram column",
+                    context.worker());
+}
+
+void
+Histograms::
+subtract(const Histograms & other)
+{
+    if (other.width != width || other.sums.size() != sums.size())
+        throw Exception("Histograms::subtract(): histograms don't match");
+
+    for (int j = 0;  j < width;  ++j)
+        total[j] -= other.total[j];
+
+    if (sums.empty()) return;
+
+    v2di * s = (v2di *)&sums[0];
+    const v2di * o = (const v2di *)&other.sums[0];
+    for (size_t i = 0, n = sums.size() / 2;  i < n;  ++i)
+        s[i] -= o[i];
+}
+
+void
+Histograms::
+swap(Histograms & other)
+{
+    std::swap(width, other.width);
+    total.swap(other.total);
+    sums.swap(other.sums);
+}
+
+} // namespace ML
@@ -0,0 +1,402 @@
+/* histogram_training.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Split finding over histograms of quantized features, for training trees
+   and stumps over large datasets.
+*/
+
+#ifndef __boosting__histogram_training_h__
+#define __boosting__histogram_training_h__
+
+
+#include "training_data.h"
+#include "thread_context.h"
+#include "fixed_point_accum.h"
+#include "feature_info.h"
+#include "split_fwd.h"
+#include "jml/utils/worker_task.h"
+#include <boost/multi_array.hpp>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <stdint.h>
+#include <cmath>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* BINNED_DATASET                                                            */
+/*****************************************************************************/
+
+/** The features of a Training_Data quantized into at most 255 bins each,
+    once, and stored column by column with one byte per example.
+
+    REAL and BOOLEAN features use the same buckets as the dataset index
+    does for Stump_Trainer::test_buckets, so that the candidate split
+    points are the same.  CATEGORICAL and STRING features have one bin per
+    value; when there are too many values, the least frequent ones share a
+    last bin that is never a candidate by itself.  PRESENCE features have
+    a single bin.  The bin after the last one of each column holds the
+    examples where the feature is missing.
+
+    An example with several values for a feature is binned on the first
+    one only, rather than having its weight spread over all of them.
+*/
+
+struct Binned_Dataset {
+    Binned_Dataset();
+
+    Binned_Dataset(const Training_Data & data,
+                   const Feature & predicted,
+                   const std::vector<Feature> & features,
+                   int max_bins = 255);
+
+    void init(const Training_Data & data,
+              const Feature & predicted,
+              const std::vector<Feature> & features,
+              int max_bins = 255);
+
+    /** Was this made by init() with the same arguments?  The data is
+        recognized by its generation, so another Training_Data, or the same
+        one after its examples changed, doesn't match.
+    */
+    bool matches(const Training_Data & data,
+                 const Feature & predicted,
+                 const std::vector<Feature> & features,
+                 int max_bins) const;
+
+    enum Kind {
+        ORDERED,      ///< Candidates split the bins in two, in order
+        CATEGORICAL,  ///< Each candidate is one of the bins
+        PRESENCE      ///< The only candidate is being present or not
+    };
+
+    struct Column {
+        Feature feature;
+        Kind kind;
+        int num_bins;               ///< Bin num_bins is for missing values
+        std::vector<float> args;    ///< Split value of each candidate
+        std::vector<float> values;  ///< A value in each bin
+        std::vector<uint8_t> bins;  ///< Bin of each example
+        size_t offset;              ///< Of the column's bins in a histogram
+    };
+
+    size_t example_count() const { return labels.size(); }
+
+    /** Number of bins over all of the columns, missing ones included. */
+    size_t bin_count() const { return bin_count_; }
+
+    /** Index of the column for the given feature, or -1. */
+    int column_index(const Feature & feature) const;
+
+    /** Indexes of the columns of those of the features that have one. */
+    std::vector<int> column_indexes(const std::vector<Feature> & features)
+        const;
+
+    Feature predicted;
+    int label_count;
+    std::vector<int> labels;
+    std::vector<Column> columns;
+
+private:
+    uint64_t generation_;       ///< Of the data we were made from
+    std::vector<Feature> features_;
+    int max_bins_;
+    size_t bin_count_;
+    std::map<Feature, int> column_index_;
+
+    void bin_ordered(Column & column, const Training_Data & data,
+                     int max_bins);
+    void bin_categorical(Column & column, const Training_Data & data,
+                         int max_bins);
+    void bin_presence(Column & column, const Training_Data & data);
+};
+
+
+/*****************************************************************************/
+/* BINNED_DATASET_CACHE                                                      */
+/*****************************************************************************/
+
+/** Keeps the last Binned_Dataset made, so that a generator called once per
+    boosting iteration over the same data only bins it once.
+*/
+
+struct Binned_Dataset_Cache {
+    std::shared_ptr<const Binned_Dataset>
+    get(const Training_Data & data,
+        const Feature & predicted,
+        const std::vector<Feature> & features,
+        int max_bins);
+
+private:
+    std::mutex lock;
+    std::shared_ptr<const Binned_Dataset> last;
+};
+
+
+/*****************************************************************************/
+/* HISTOGRAM_WEIGHTS                                                         */
+/*****************************************************************************/
+
+/** What each example adds to the bin it falls into, as the fixed point
+    values that W_binsym (width 2, indexed by !label) or W_normal (width
+    2 * nl, indexed by label * 2 + correct) accumulate.  As the sums are
+    then exact, the W values are the same as those of the Stump_Trainer
+    whatever order the examples are added in, and the histogram of a node
+    can be obtained by subtracting those of its siblings from its parent's.
+*/
+
+struct Histogram_Weights {
+    Histogram_Weights()
+        : width(0), binsym(false)
+    {
+    }
+
+    /** Initialize from the same arguments as Stump_Trainer::calc_default_w
+        takes.
+    */
+    template<class Weights, class ExampleWeights>
+    void init(const Binned_Dataset & binned,
+              const Weights & weights,
+              const ExampleWeights & ex_weights,
+              bool binsym, int advance)
+    {
+        size_t nx = binned.example_count();
+        int nl = binned.label_count;
+
+        this->binsym = binsym;
+        width = binsym ? 2 : 2 * nl;
+        values.clear();
+        values.resize(nx * width);
+        example_weights.resize(nx);
+
+        for (unsigned x = 0;  x < nx;  ++x) {
+            example_weights[x] = ex_weights[x];
+            if (ex_weights[x] == 0.0) continue;
+            float weight = ex_weights[x];
+            int label = binned.labels[x];
+            const float * it = &weights[x][0];
+            int64_t * v = &values[x * width];
+
+            if (binsym) {
+                v[!label] = FixedPointAccum64(*it * weight).hl;
+                continue;
+            }
+
+            for (int l = 0;  l < nl;  ++l, it += advance)
+                v[l * 2 + (label == l)] = FixedPointAccum64(*it * weight).hl;
+        }
+    }
+
+    const int64_t * operator [] (int example) const
+    {
+        return &values[example * width];
+    }
+
+    /** Sum of the example weights of the given examples; the same as the
+        total of train_recursive's in_class for the node.
+    */
+    double total(const int * examples, size_t n) const
+    {
+        double result = 0.0;
+        for (unsigned i = 0;  i < n;  ++i)
+            result += example_weights[examples[i]];
+        return result;
+    }
+
+    int width;
+    bool binsym;
+    std::vector<int64_t> values;
+    std::vector<float> example_weights;
+};
+
+
+/*****************************************************************************/
+/* HISTOGRAMS                                                                */
+/*****************************************************************************/
+
+/** The sums of the Histogram_Weights of a set of examples, for each bin of
+    each column of a Binned_Dataset.
+*/
+
+struct Histograms {
+    Histograms()
+        : width(0)
+    {
+    }
+
+    Histograms(const Binned_Dataset & binned, int width)
+    {
+        init(binned, width);
+    }
+
+    void init(const Binned_Dataset & binned, int width);
+
+    /** Add the given examples to the bins of the given columns.  The
+        columns are done in parallel when there's enough work to go around.
+    */
+    void accumulate(Thread_Context & context,
+                    const Binned_Dataset & binned,
+                    const std::vector<int> & columns,
+                    const Histogram_Weights & weights,
+                    const int * examples, size_t n);
+
+    /** Remove the examples of the other histograms, which must be of a
+        subset of ours.
+    */
+    void subtract(const Histograms & other);
+
+    void swap(Histograms & other);
+
+    const int64_t * bin(const Binned_Dataset::Column & column, int b) const
+    {
+        return &sums[(column.offset + b) * width];
+    }
+
+    int width;
+    std::vector<int64_t> total;  ///< Over all of the examples
+    std::vector<int64_t> sums;   ///< Over the examples in each bin
+};
+
+
+/*****************************************************************************/
+/* TEST_HISTOGRAMS                                                           */
+/*****************************************************************************/
+
+/** Set a bucket of a W_binsym or W_normal from sums of Histogram_Weights. */
+template<class W>
+void set_bucket(W & w, int bucket, const int64_t * sums, int width)
+{
+    for (int i = 0;  i < width;  ++i) {
+        FixedPointAccum64 value;
+        value.hl = sums[i];
+        w(i / 2, bucket, i % 2) = value;
+    }
+}
+
+/** Set the bucket to first - second. */
+template<class W>
+void set_bucket(W & w, int bucket, const int64_t * first,
+                const int64_t * second, int width)
+{
+    for (int i = 0;  i < width;  ++i) {
+        FixedPointAccum64 value;
+        value.hl = first[i] - second[i];
+        w(i / 2, bucket, i % 2) = value;
+    }
+}
+
+/** Test the candidate splits of one column.  The candidates and the W
+    values passed to the results are the same as Stump_Trainer's
+    test_buckets for ordered columns and test_presence for presence ones.
+    For categorical ones, they are the same as test_categorical's, except
+    that the split on missing or not is tried whenever anything's missing.
+*/
+template<class W, class Results>
+void test_histogram(const Binned_Dataset & binned,
+                    const Binned_Dataset::Column & column,
+                    const Histograms & hist,
+                    Results & results)
+{
+    int width = hist.width;
+    const int64_t * missing_sums = hist.bin(column, column.num_bins);
+
+    // Weight of the examples with the feature
+    int64_t present[width];
+    bool any_present = false;
+    for (int i = 0;  i < width;  ++i) {
+        present[i] = hist.total[i] - missing_sums[i];
+        any_present = any_present || present[i] != 0;
+    }
+
+    W w(binned.label_count);
+    set_bucket(w, MISSING, missing_sums, width);
+
+    double missing;
+
+    if (column.kind == Binned_Dataset::PRESENCE) {
+        if (!any_present) return;
+        set_bucket(w, true, present, width);
+        if (!results.start(column.feature, w, missing)) return;
+        results.add_presence(column.feature, w, 0.5, missing);
+        results.finish(column.feature);
+        return;
+    }
+
+    if (column.kind == Binned_Dataset::CATEGORICAL) {
+        if (!any_present) return;
+        set_bucket(w, false, present, width);
+        if (!results.start(column.feature, w, missing)) return;
+        if (missing > 0.0)
+            results.add(column.feature, w, -INFINITY, missing);
+
+        for (unsigned b = 0;  b < column.args.size();  ++b) {
+            const int64_t * sums = hist.bin(column, b);
+            set_bucket(w, true, sums, width);
+            set_bucket(w, false, present, sums, width);
+            results.add(column.feature, w, column.args[b], missing);
+        }
+
+        results.finish(column.feature);
+        return;
+    }
+
+    set_bucket(w, true, present, width);
+    if (!results.start(column.feature, w, missing)) return;
+
+    /* We need at least 2 buckets or one bucket and some missing values
+       in order to make a split. */
+    if (column.num_bins + (missing > 0.0) < 2) return;
+
+    if (missing > 0.0)
+        results.add(column.feature, w, -INFINITY, missing);
+
+    /* Move the bins from true to false one at a time. */
+    int64_t below[width];
+    std::fill(below, below + width, 0);
+
+    for (int b = 0;  b < column.num_bins - 1;  ++b) {
+        const int64_t * sums = hist.bin(column, b);
+        for (int i = 0;  i < width;  ++i)
+            below[i] += sums[i];
+
+        set_bucket(w, false, below, width);
+        set_bucket(w, true, present, below, width);
+        results.add(column.feature, w, column.args[b], missing);
+    }
+
+    results.finish(column.feature);
+}
+
+/** Test the candidate splits of the given columns, in parallel. */
+template<class W, class Results>
+void test_histograms(Thread_Context & context,
+                     const Binned_Dataset & binned,
+                     const std::vector<int> & columns,
+                     const Histograms & hist,
+                     Results & results)
+{
+    auto doColumn = [&] (int i)
+        {
+            test_histogram<W>(binned, binned.columns[columns[i]], hist,
+                              results);
+        };
+
+    if (context.worker().threads() == 0 || columns.size() < 8) {
+        for (unsigned i = 0;  i < columns.size();  ++i)
+            doColumn(i);
+        return;
+    }
+
+    run_in_parallel(0, columns.size(), doColumn, context.group(),
+                    "test histograms", "test histogram column",
+                    context.worker());
+}
+
+} // namespace ML
+
+
+#endif /* __boosting__histogram_training_h__ */
@@ -21,6 +21,7 @@
 #include "stump_accum.h"
 #include "stump_regress.h"
 #include "binary_symmetric.h"
+#include "histogram_training.h"
 #include "jml/utils/environment.h"
 #include "jml/utils/info.h"
 #include "jml/arch/tick_counter.h"
@@ -60,6 +61,7 @@ struct Ticks {
 
 Stump_Generator::
 Stump_Generator()
+    : binned_cache(new Binned_Dataset_Cache())
 {
     defaults();
 }
@@ -79,6 +81,7 @@ configure(const Configuration & config)
     config.find(trace,                "trace");
     config.find(update_alg,           "update_alg");
     config.find(ignore_highest,       "ignore_highest");
+    config.find(histogram_bins,       "histogram_bins");
 }
 
 void
@@ -91,6 +94,7 @@ defaults()
     trace = 0;
     update_alg = Stump::NORMAL;
     ignore_highest = 0.0;
+    histogram_bins = 0;
 }
 
 Config_Options
@@ -107,6 +111,9 @@ options() const
              "select the harshness of the update algorithm")
         .add("ignore_highest", ignore_highest, "0.0<=N<1.0",
              "ignore the examples witht the highest N% of weights")
+        .add("histogram_bins", histogram_bins, "0 or 2-255",
+             "quantize the features into this many bins and find the splits "
+             "from histograms; 0 means use the exact values")
         .add("trace", trace, "0-",
              "trace training (very detailed) to given level");
 
@@ -449,6 +456,55 @@ train_all(Thread_Context & context,
             
         all_best = accum.results(data, model.predicted());
     }
+    else if (histogram_bins > 0) {
+        /* Find the splits from histograms of the quantized features. */
+        std::shared_ptr<const Binned_Dataset> binned
+            = binned_cache->get(data, model.predicted(), features_,
+                                histogram_bins);
+        vector<int> columns = binned->column_indexes(features);
+
+        Histogram_Weights hist_weights;
+        hist_weights.init(*binned, weights, example_weights, bin_sym,
+                          get_advance(weights));
+
+        vector<int> examples;
+        for (unsigned x = 0;  x < nx;  ++x)
+            if (example_weights[x] != 0.0)
+                examples.push_back(x);
+
+        Thread_Context hist_context(worker, context.group());
+
+        Histograms histograms(*binned, hist_weights.width);
+        histograms.accumulate(hist_context, *binned, columns, hist_weights,
+                              examples.data(), examples.size());
+
+        if (bin_sym) {
+            typedef W_binsym W;
+            typedef Z_binsym Z;
+            typedef C_any C;
+
+            typedef Stump_Accum<W, Z, C, Stream_Tracer, Locked> Accum;
+            Accum accum(feature_space, fair, committee_size, update_alg, trace);
+
+            test_histograms<W>(hist_context, *binned, columns, histograms,
+                               accum);
+
+            all_best = accum.results(data, model.predicted());
+        }
+        else {
+            typedef W_normal W;
+            typedef Z_normal Z;
+            typedef C_any C;
+
+            typedef Stump_Accum<W, Z, C, Stream_Tracer, Locked> Accum;
+            Accum accum(feature_space, fair, committee_size, update_alg, trace);
+
+            test_histograms<W>(hist_context, *binned, columns, histograms,
+                               accum);
+
+            all_best = accum.results(data, model.predicted());
+        }
+    }
     else if (!bin_sym) {
         /* If we have a single dimensional weights array, we need to expand
            it. */
@@ -17,6 +17,9 @@
 namespace ML {
 
 
+struct Binned_Dataset_Cache;
+
+
 /*****************************************************************************/
 /* STUMP_GENERATOR                                                           */
 /*****************************************************************************/
@@ -73,6 +76,15 @@ public:
     Stump::Update update_alg;
     float feature_prop;
 
+    /** If non-zero, the features are quantized into this many bins (at most
+        255) and the splits are found from histograms of the bins.  See
+        histogram_training.h.
+    */
+    int histogram_bins;
+
+    /** Keeps the quantized data from one call to the next. */
+    std::shared_ptr<Binned_Dataset_Cache> binned_cache;
+
     /* Once init has been called, we clone our potential models from this
        one. */
     Stump model;
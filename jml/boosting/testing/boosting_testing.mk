@@ -6,6 +6,10 @@ $(eval $(call test,glz_classifier_test,boosting utils arch worker_task,boost))
 $(eval $(call test,probabilizer_test,boosting utils arch,boost))
 $(eval $(call test,feature_info_test,boosting utils arch,boost))
 $(eval $(call test,weighted_training_test,boosting,boost))
+$(eval $(call test,flattened_classifier_test,boosting,boost))
+$(eval $(call test,flattened_classifier_bench,boosting utils arch,boost manual))
+$(eval $(call test,histogram_training_test,boosting utils arch worker_task,boost))
+$(eval $(call test,histogram_training_bench,boosting utils arch worker_task,boost manual))
 
 $(eval $(call program,dataset_nan_test,boosting utils arch boosting_tools))
 
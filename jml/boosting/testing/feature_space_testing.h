@@ -0,0 +1,42 @@
+/* feature_space_testing.h                                         -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Feature spaces shared by the boosting tests and benchmarks.
+*/
+
+#ifndef __boosting__feature_space_testing_h__
+#define __boosting__feature_space_testing_h__
+
+
+#include "jml/boosting/dense_features.h"
+#include "jml/arch/format.h"
+
+
+namespace ML {
+
+
+/** A feature space with a boolean label, LABEL, followed by numFeatures
+    real features named f0, f1, ...
+*/
+inline std::shared_ptr<Dense_Feature_Space>
+boolean_label_feature_space(int numFeatures)
+{
+    auto result = std::make_shared<Dense_Feature_Space>();
+    result->add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    for (int i = 0;  i < numFeatures;  ++i)
+        result->add_feature(format("f%d", i), REAL);
+    return result;
+}
+
+/** The features of the examples: all but the label. */
+inline std::vector<Feature>
+example_features(const Dense_Feature_Space & fs)
+{
+    return std::vector<Feature>(fs.features().begin() + 1,
+                                fs.features().end());
+}
+
+} // namespace ML
+
+
+#endif /* __boosting__feature_space_testing_h__ */
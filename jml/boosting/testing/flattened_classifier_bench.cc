@@ -0,0 +1,94 @@
+/* flattened_classifier_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Speed of the optimized predict of a committee of 500 decision trees
+   against the same committee flattened, one example at a time and in
+   batches.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/boosting/flattened_classifier.h"
+#include "jml/arch/timers.h"
+#include "feature_space_testing.h"
+#include "flattened_classifier_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+enum {
+    NumTrees = 500,
+    Depth = 8,
+    NumFeatures = 100,
+    NumExamples = 20000
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_flattened_committee )
+{
+    auto fs = boolean_label_feature_space(NumFeatures);
+    auto committee = random_committee(fs, NumTrees, Depth, 1);
+    vector<Feature> features = example_features(*fs);
+
+    Optimization_Info info = committee->optimize(features);
+
+    Timer timer;
+    Flattened_Classifier flattened(*committee, features);
+    cerr << ML::format("flattened %zd trees with %zd nodes in %.1fms",
+                       flattened.tree_count(), flattened.node_count(),
+                       timer.elapsed_wall() * 1000)
+         << endl;
+
+    vector<float> X = random_examples(NumExamples, NumFeatures, 0.05, 2);
+
+    vector<float> optimized(NumExamples * 2);
+    timer.restart();
+    for (unsigned i = 0;  i < NumExamples;  ++i) {
+        Label_Dist dist = committee->predict(&X[i * NumFeatures], info);
+        optimized[i * 2] = dist[0];
+        optimized[i * 2 + 1] = dist[1];
+    }
+    double optimizedTime = timer.elapsed_wall();
+
+    vector<float> single(NumExamples * 2);
+    timer.restart();
+    for (unsigned i = 0;  i < NumExamples;  ++i)
+        flattened.predict(&X[i * NumFeatures], 1, &single[i * 2]);
+    double singleTime = timer.elapsed_wall();
+
+    vector<float> batch(NumExamples * 2);
+    timer.restart();
+    flattened.predict(&X[0], NumExamples, &batch[0]);
+    double batchTime = timer.elapsed_wall();
+
+    for (unsigned i = 0;  i < NumExamples * 2;  ++i) {
+        BOOST_REQUIRE_SMALL(batch[i] - optimized[i], 1e-3f);
+        BOOST_REQUIRE_EQUAL(batch[i], single[i]);
+    }
+
+    cerr << ML::format("%d trees of depth %d, %d features, %d examples",
+                       NumTrees, Depth, NumFeatures, NumExamples)
+         << endl;
+    cerr << ML::format("%-20s %12s %10s", "", "examples/s", "speedup")
+         << endl;
+
+    auto report = [&] (const char * name, double elapsed)
+        {
+            cerr << ML::format("%-20s %12.0f %9.2fx",
+                               name, NumExamples / elapsed,
+                               optimizedTime / elapsed)
+                 << endl;
+        };
+
+    report("optimized_predict", optimizedTime);
+    report("flattened, single", singleTime);
+    report("flattened, batch", batchTime);
+
+    BOOST_CHECK_LT(batchTime, optimizedTime);
+}
@@ -0,0 +1,100 @@
+/* flattened_classifier_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test that the flattened classifiers predict the same as the originals.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/boosting/flattened_classifier.h"
+#include "feature_space_testing.h"
+#include "flattened_classifier_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+enum {
+    NumFeatures = 20,
+    NumExamples = 1000
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_flattened_committee )
+{
+    auto fs = boolean_label_feature_space(NumFeatures);
+    auto committee = random_committee(fs, 50, 6, 1);
+    vector<Feature> features = example_features(*fs);
+
+    Flattened_Classifier flattened(*committee, features);
+    BOOST_CHECK_EQUAL(flattened.label_count(), 2);
+    BOOST_CHECK_EQUAL(flattened.feature_count(), NumFeatures);
+    BOOST_CHECK_EQUAL(flattened.tree_count(), 50);
+
+    Optimization_Info info = committee->optimize(features);
+
+    vector<float> X = random_examples(NumExamples, NumFeatures, 0.1, 2);
+    vector<float> out(NumExamples * 2);
+    flattened.predict(&X[0], NumExamples, &out[0]);
+
+    for (unsigned i = 0;  i < NumExamples;  ++i) {
+        const float * x = &X[i * NumFeatures];
+        Label_Dist expected = committee->predict(x, info);
+        BOOST_REQUIRE_SMALL(out[i * 2] - expected[0], 1e-4f);
+        BOOST_REQUIRE_SMALL(out[i * 2 + 1] - expected[1], 1e-4f);
+
+        // One at a time gives the same as in a batch
+        Label_Dist single = flattened.predict(x);
+        BOOST_REQUIRE_EQUAL(single[0], out[i * 2]);
+        BOOST_REQUIRE_EQUAL(single[1], out[i * 2 + 1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_flattened_boosted_stumps )
+{
+    auto fs = boolean_label_feature_space(NumFeatures);
+    auto stumps = random_stumps(fs, 200, 3);
+    stumps->output = Boosted_Stumps::LOGIT;
+    vector<Feature> features = example_features(*fs);
+
+    BOOST_CHECK(Flattened_Classifier::supported(*stumps));
+    Flattened_Classifier flattened(*stumps, features);
+
+    vector<float> X = random_examples(NumExamples, NumFeatures, 0.1, 4);
+    vector<float> out(NumExamples * 2);
+    flattened.predict(&X[0], NumExamples, &out[0]);
+
+    for (unsigned i = 0;  i < NumExamples;  ++i) {
+        vector<float> values = { 0.0 };
+        values.insert(values.end(), &X[i * NumFeatures],
+                      &X[(i + 1) * NumFeatures]);
+        Label_Dist expected = stumps->predict(*fs->encode(values));
+        BOOST_REQUIRE_SMALL(out[i * 2] - expected[0], 1e-4f);
+        BOOST_REQUIRE_SMALL(out[i * 2 + 1] - expected[1], 1e-4f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_flattened_unsupported )
+{
+    auto fs = boolean_label_feature_space(NumFeatures);
+
+    // Missing features
+    auto committee = random_committee(fs, 5, 4, 5);
+    vector<Feature> features = example_features(*fs);
+    features.pop_back();
+    BOOST_CHECK_THROW(Flattened_Classifier(*committee, features),
+                      ML::Exception);
+
+    // The logit of the members of a committee can't be flattened
+    auto stumps = random_stumps(fs, 10, 6);
+    stumps->output = Boosted_Stumps::LOGIT;
+    committee->add(stumps);
+    BOOST_CHECK(!Flattened_Classifier::supported(*committee));
+    BOOST_CHECK_THROW(Flattened_Classifier(*committee, example_features(*fs)),
+                      ML::Exception);
+}
@@ -0,0 +1,118 @@
+/* flattened_classifier_testing.h                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Random tree based classifiers and examples to test and benchmark the
+   flattened classifier with.
+*/
+
+#ifndef __boosting__flattened_classifier_testing_h__
+#define __boosting__flattened_classifier_testing_h__
+
+
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/decision_tree.h"
+#include "jml/boosting/committee.h"
+#include "jml/boosting/boosted_stumps.h"
+#include "jml/boosting/stump.h"
+#include <random>
+#include <cmath>
+
+
+namespace ML {
+
+
+inline Label_Dist
+random_dist(std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> value(-1.0, 1.0);
+    Label_Dist result(2);
+    result[0] = value(rng);
+    result[1] = value(rng);
+    return result;
+}
+
+inline Tree::Ptr
+random_subtree(Tree & tree, const Dense_Feature_Space & fs, int depth,
+               std::mt19937 & rng)
+{
+    if (depth == 0)
+        return tree.new_leaf(random_dist(rng), 1.0);
+
+    std::uniform_int_distribution<int> feature(1, fs.features().size() - 1);
+    std::uniform_real_distribution<float> value(0.0, 1.0);
+
+    Tree::Node * node = tree.new_node();
+    node->split = Split(fs.features()[feature(rng)], value(rng), Split::LESS);
+    node->pred = random_dist(rng);
+    node->examples = 1.0;
+    node->child_true = random_subtree(tree, fs, depth - 1, rng);
+    node->child_false = random_subtree(tree, fs, depth - 1, rng);
+    // Like a trained tree, one that doesn't know what to do with a missing
+    // value stops there
+    node->child_missing = random_subtree(tree, fs, 0, rng);
+    return node;
+}
+
+/** A committee of numTrees random trees of the given depth. */
+inline std::shared_ptr<Committee>
+random_committee(const std::shared_ptr<Dense_Feature_Space> & fs,
+                 int numTrees, int depth, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> weight(0.5, 1.5);
+
+    auto result = std::make_shared<Committee>(fs, fs->features()[0]);
+
+    for (int i = 0;  i < numTrees;  ++i) {
+        auto tree = std::make_shared<Decision_Tree>(fs, fs->features()[0]);
+        tree->tree.root = random_subtree(tree->tree, *fs, depth, rng);
+        result->add(tree, weight(rng));
+    }
+
+    return result;
+}
+
+/** Boosted stumps over random splits of the features. */
+inline std::shared_ptr<Boosted_Stumps>
+random_stumps(const std::shared_ptr<Dense_Feature_Space> & fs,
+              int numStumps, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> feature(1, fs->features().size() - 1);
+    std::uniform_real_distribution<float> value(0.0, 1.0);
+
+    auto result = std::make_shared<Boosted_Stumps>(fs, fs->features()[0]);
+
+    for (int i = 0;  i < numStumps;  ++i) {
+        Stump stump(fs->features()[0], fs->features()[feature(rng)],
+                    value(rng), random_dist(rng), random_dist(rng),
+                    random_dist(rng), Stump::NORMAL, fs);
+        result->insert(stump);
+    }
+
+    return result;
+}
+
+/** numExamples examples with numFeatures values uniform in [0, 1], each of
+    which is missing with the given probability.
+*/
+inline std::vector<float>
+random_examples(size_t numExamples, int numFeatures, float missing, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> value(0.0, 1.0);
+
+    std::vector<float> result(numExamples * numFeatures);
+    for (auto & v: result) {
+        v = value(rng);
+        if (value(rng) < missing)
+            v = NAN;
+    }
+
+    return result;
+}
+
+} // namespace ML
+
+
+#endif /* __boosting__flattened_classifier_testing_h__ */
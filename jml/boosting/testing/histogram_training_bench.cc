@@ -0,0 +1,159 @@
+/* histogram_training_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Speed and accuracy of decision tree and stump training with and without
+   histograms, over a synthetic dataset of 10 million examples with 100
+   features.  The size can be changed with the HISTOGRAM_BENCH_EXAMPLES,
+   HISTOGRAM_BENCH_FEATURES and HISTOGRAM_BENCH_DEPTH environment
+   variables.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+#include "jml/boosting/histogram_training.h"
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/stump_generator.h"
+#include "jml/arch/timers.h"
+#include "jml/utils/environment.h"
+#include "feature_space_testing.h"
+#include "histogram_training_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+Env_Option<int> numExamples("HISTOGRAM_BENCH_EXAMPLES", 10000000);
+Env_Option<int> numFeatures("HISTOGRAM_BENCH_FEATURES", 100);
+Env_Option<int> maxDepth("HISTOGRAM_BENCH_DEPTH", 8);
+
+struct Bench_Data {
+    Bench_Data()
+        : fs(boolean_label_feature_space(numFeatures)),
+          data(fs),
+          features(example_features(*fs))
+    {
+        Timer timer;
+        synthetic_dataset(data, *fs, numExamples, 10000, 0.02, 1);
+        cerr << ML::format("generated %d examples with %d features in %.1fs",
+                           (int)numExamples, (int)numFeatures,
+                           timer.elapsed_wall())
+             << endl;
+
+        timer.restart();
+        data.preindex(fs->features()[0], features);
+        cerr << ML::format("indexed in %.1fs", timer.elapsed_wall()) << endl;
+
+        timer.restart();
+        Binned_Dataset binned(data, fs->features()[0], features);
+        cerr << ML::format("binned into %zd bins in %.1fs",
+                           binned.bin_count(), timer.elapsed_wall())
+             << endl;
+
+        /* Binary symmetric weights sum to one half, as the fixed point
+           accumulators can't hold a total of one. */
+        size_t nx = data.example_count();
+        weights.resize(boost::extents[nx][1]);
+        std::fill(weights.data(), weights.data() + nx, 0.5 / nx);
+    }
+
+    std::shared_ptr<Dense_Feature_Space> fs;
+    Training_Data data;
+    vector<Feature> features;
+    boost::multi_array<float, 2> weights;
+};
+
+/** Train once with the given configuration to fill the generator's cache of
+    the binned dataset, as boosting would over its iterations, and then
+    again for the timing.
+*/
+template<class Generator, class Result>
+double time_training(Bench_Data & bench, const std::string & config_options,
+                     Result & result,
+                     std::function<Result (Generator &, Thread_Context &)>
+                         train)
+{
+    Configuration config;
+    config.parse_string(config_options, "inbuilt config file");
+
+    Generator generator;
+    generator.configure(config);
+    generator.init(bench.fs, bench.fs->features()[0]);
+
+    Thread_Context context;
+
+    if (generator.histogram_bins > 0)
+        train(generator, context);
+
+    Timer timer;
+    result = train(generator, context);
+    return timer.elapsed_wall();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_histogram_training )
+{
+    Bench_Data bench;
+
+    cerr << ML::format("%-20s %10s %10s %10s", "", "seconds", "speedup",
+                       "accuracy")
+         << endl;
+
+    double exactTime = 0.0;
+
+    auto report = [&] (const char * name, double elapsed,
+                       const Classifier_Impl & trained)
+        {
+            if (exactTime == 0.0) exactTime = elapsed;
+            float accuracy = trained.accuracy(bench.data).first;
+            cerr << ML::format("%-20s %10.2f %9.2fx %10.4f",
+                               name, elapsed, exactTime / elapsed, accuracy)
+                 << endl;
+            return accuracy;
+        };
+
+    auto trainTree = [&] (Decision_Tree_Generator & generator,
+                          Thread_Context & context)
+        {
+            return generator.train_weighted(context, bench.data,
+                                            bench.weights, bench.features,
+                                            maxDepth);
+        };
+
+    Decision_Tree exact, hist;
+    double elapsed = time_training<Decision_Tree_Generator, Decision_Tree>
+        (bench, "", exact, trainTree);
+    float exactAccuracy = report("tree", elapsed, exact);
+
+    elapsed = time_training<Decision_Tree_Generator, Decision_Tree>
+        (bench, "histogram_bins=255", hist, trainTree);
+    float histAccuracy = report("tree, histograms", elapsed, hist);
+
+    BOOST_CHECK_GT(histAccuracy, exactAccuracy - 0.01);
+
+    auto trainStump = [&] (Stump_Generator & generator,
+                           Thread_Context & context)
+        {
+            return generator.train_weighted(context, bench.data,
+                                            bench.weights, bench.features);
+        };
+
+    exactTime = 0.0;
+
+    Stump exactStump, histStump;
+    elapsed = time_training<Stump_Generator, Stump>
+        (bench, "", exactStump, trainStump);
+    report("stump", elapsed, exactStump);
+
+    elapsed = time_training<Stump_Generator, Stump>
+        (bench, "histogram_bins=255", histStump, trainStump);
+    report("stump, histograms", elapsed, histStump);
+
+    BOOST_CHECK(exactStump.split == histStump.split);
+}
@@ -0,0 +1,336 @@
+/* histogram_training_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of split finding from histograms.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+
+#include "jml/boosting/histogram_training.h"
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/stump_generator.h"
+#include "jml/boosting/training_index.h"
+#include "jml/db/persistent.h"
+#include "feature_space_testing.h"
+#include "histogram_training_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_binned_dataset )
+{
+    auto fs = std::make_shared<Dense_Feature_Space>();
+    fs->add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs->add_feature("dense", REAL);
+    fs->add_feature("few", REAL);
+    fs->add_feature("boolean", BOOLEAN);
+    fs->add_feature("category", CATEGORICAL);
+
+    Training_Data data(fs);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    vector<distribution<float> > rows;
+
+    for (unsigned x = 0;  x < 1000;  ++x) {
+        distribution<float> features(5);
+        features[0] = x % 2;
+        features[1] = uniform(rng);
+        features[2] = x % 10 == 0 ? NAN : x % 20;
+        features[3] = x % 3 == 0;
+        // 400 odd categories, and 7 more frequent ones
+        features[4] = x % 3 == 0 ? x % 7 : x % 600;
+        data.add_example(fs->encode(features));
+        rows.push_back(features);
+    }
+
+    vector<Feature> features = example_features(*fs);
+    data.preindex(fs->features()[0], features);
+
+    Binned_Dataset binned(data, fs->features()[0], features, 255);
+
+    BOOST_REQUIRE_EQUAL(binned.columns.size(), features.size());
+    BOOST_CHECK_EQUAL(binned.example_count(), data.example_count());
+
+    for (unsigned c = 0;  c < binned.columns.size();  ++c) {
+        const Binned_Dataset::Column & column = binned.columns[c];
+        BOOST_CHECK_EQUAL(column.feature, features[c]);
+        BOOST_CHECK_LE(column.num_bins, 255);
+
+        for (unsigned x = 0;  x < data.example_count();  ++x) {
+            float value = rows[x][c + 1];
+            int bin = column.bins[x];
+
+            if (std::isnan(value)) {
+                BOOST_CHECK_EQUAL(bin, column.num_bins);
+                continue;
+            }
+
+            BOOST_REQUIRE_LT(bin, column.num_bins);
+
+            if (column.kind == Binned_Dataset::ORDERED) {
+                if (bin > 0)
+                    BOOST_CHECK_GE(value, column.args[bin - 1]);
+                if (bin < column.num_bins - 1)
+                    BOOST_CHECK_LT(value, column.args[bin]);
+            }
+            else if (bin < column.args.size())
+                BOOST_CHECK_EQUAL(value, column.args[bin]);
+            else {
+                // In the shared bin, so not one of the candidates
+                BOOST_CHECK(std::find(column.args.begin(), column.args.end(),
+                                      value)
+                            == column.args.end());
+            }
+        }
+    }
+
+    BOOST_CHECK_GT(binned.columns[0].num_bins, 200);
+    BOOST_CHECK_EQUAL(binned.columns[1].num_bins, 18);
+    BOOST_CHECK_EQUAL(binned.columns[2].num_bins, 2);
+
+    // The frequent categories were all kept
+    const Binned_Dataset::Column & category = binned.columns.back();
+    BOOST_CHECK_EQUAL(category.kind, Binned_Dataset::CATEGORICAL);
+    BOOST_CHECK_EQUAL(category.num_bins, 255);
+    for (unsigned v = 0;  v < 7;  ++v)
+        BOOST_CHECK(std::find(category.args.begin(), category.args.end(), v)
+                    != category.args.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_binned_dataset_cache )
+{
+    auto fs = boolean_label_feature_space(10);
+    vector<Feature> features = example_features(*fs);
+    Feature label = fs->features()[0];
+
+    Binned_Dataset_Cache cache;
+
+    Training_Data data(fs);
+    synthetic_dataset(data, *fs, 1000, 100, 0.0, 5);
+
+    auto first = cache.get(data, label, features, 255);
+    BOOST_CHECK_EQUAL(cache.get(data, label, features, 255), first);
+    vector<float> args = first->columns[0].args;
+
+    // Same labels, different feature values: the data has to be binned
+    // again
+    for (unsigned x = 0;  x < data.example_count();  ++x)
+        data.modify_feature(x, features[0], data[x][features[0]] * 0.5);
+    auto second = cache.get(data, label, features, 255);
+    BOOST_CHECK_NE(second, first);
+    BOOST_CHECK(second->columns[0].args != args);
+
+    // Likewise when the same object is filled again, as when a generator
+    // is reused across folds
+    data.clear();
+    synthetic_dataset(data, *fs, 1000, 100, 0.0, 5);
+    auto third = cache.get(data, label, features, 255);
+    BOOST_CHECK_NE(third, second);
+    BOOST_CHECK(third->columns[0].args == args);
+
+    Training_Data copy(data);
+    BOOST_CHECK_NE(copy.generation(), data.generation());
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_subtraction )
+{
+    auto fs = boolean_label_feature_space(10);
+    Training_Data data(fs);
+    synthetic_dataset(data, *fs, 5000, 1000, 0.1, 2);
+
+    vector<Feature> features = example_features(*fs);
+    data.preindex(fs->features()[0], features);
+
+    Binned_Dataset binned(data, fs->features()[0], features);
+    vector<int> columns = binned.column_indexes(features);
+
+    size_t nx = data.example_count();
+    boost::multi_array<float, 2> weights(boost::extents[nx][2]);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        weights[x][0] = (1.0 + x % 3) / (4.0 * nx);
+        weights[x][1] = (1.0 + x % 5) / (6.0 * nx);
+    }
+
+    Histogram_Weights hist_weights;
+    hist_weights.init(binned, weights, distribution<float>(nx, 1.0),
+                      false, 1);
+    BOOST_CHECK_EQUAL(hist_weights.width, 4);
+
+    vector<int> all, odd, even;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        all.push_back(x);
+        (x % 2 ? odd : even).push_back(x);
+    }
+
+    Thread_Context context;
+
+    Histograms hist_all(binned, hist_weights.width);
+    hist_all.accumulate(context, binned, columns, hist_weights,
+                        &all[0], all.size());
+    Histograms hist_odd(binned, hist_weights.width);
+    hist_odd.accumulate(context, binned, columns, hist_weights,
+                        &odd[0], odd.size());
+    Histograms hist_even(binned, hist_weights.width);
+    hist_even.accumulate(context, binned, columns, hist_weights,
+                         &even[0], even.size());
+
+    // Exact, since it's all fixed point
+    hist_all.subtract(hist_odd);
+    BOOST_CHECK(hist_all.sums == hist_even.sums);
+    BOOST_CHECK(hist_all.total == hist_even.total);
+}
+
+namespace {
+
+/** Train the same thing with and without histograms. */
+template<class Generator>
+void train_both(const std::string & config_options,
+                std::function<void (Generator &)> train)
+{
+    Configuration config;
+    config.parse_string(config_options, "inbuilt config file");
+
+    Generator generator;
+    generator.configure(config);
+    train(generator);
+
+    config.parse_string("histogram_bins=255", "inbuilt config file");
+    generator.configure(config);
+    BOOST_CHECK_EQUAL(generator.histogram_bins, 255);
+    train(generator);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_histogram_stumps_match )
+{
+    auto fs = boolean_label_feature_space(10);
+    Training_Data data(fs);
+    synthetic_dataset(data, *fs, 5000, 100, 0.0, 3);
+
+    vector<Feature> features = example_features(*fs);
+    data.preindex(fs->features()[0], features);
+
+    size_t nx = data.example_count();
+
+    Thread_Context context;
+
+    /* The features are dense enough that the stump trainer uses the same
+       buckets as we do, so we get the same stumps, both for binary
+       symmetric weights and for ones per label.  The Z values can differ
+       in the last bit as the default W is summed differently. */
+    for (int nw: { 1, 2 }) {
+        boost::multi_array<float, 2> weights(boost::extents[nx][nw]);
+        for (unsigned x = 0;  x < nx;  ++x)
+            for (unsigned l = 0;  l < nw;  ++l)
+                weights[x][l] = (1.0 + (x + l) % 4) / (2.5 * nx * nw);
+
+        vector<Stump> trained;
+        train_both<Stump_Generator>
+            ("committee_size=3",
+             [&] (Stump_Generator & generator)
+             {
+                 generator.init(fs, fs->features()[0]);
+                 trained.push_back(generator.train_weighted(context, data,
+                                                            weights,
+                                                            features));
+             });
+
+        BOOST_REQUIRE_EQUAL(trained.size(), 2);
+        cerr << trained[0].print() << endl;
+        BOOST_CHECK(trained[0].split == trained[1].split);
+        BOOST_CHECK_CLOSE(trained[0].Z, trained[1].Z, 0.0001);
+        BOOST_CHECK_EQUAL(trained[0].print(), trained[1].print());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_trees )
+{
+    auto fs = boolean_label_feature_space(10);
+    Training_Data data(fs);
+    synthetic_dataset(data, *fs, 20000, 1000, 0.05, 4);
+
+    vector<Feature> features = example_features(*fs);
+    data.preindex(fs->features()[0], features);
+
+    size_t nx = data.example_count();
+
+    Thread_Context context;
+
+    for (int nw: { 1, 2 }) {
+        boost::multi_array<float, 2> weights(boost::extents[nx][nw]);
+        for (unsigned x = 0;  x < nx;  ++x)
+            for (unsigned l = 0;  l < nw;  ++l)
+                weights[x][l] = 1.0 / (2.0 * nx * nw);
+
+        /* The root is found from the same buckets and W values. */
+        vector<Decision_Tree> roots;
+        train_both<Decision_Tree_Generator>
+            ("",
+             [&] (Decision_Tree_Generator & generator)
+             {
+                 generator.init(fs, fs->features()[0]);
+                 roots.push_back(generator.train_weighted(context, data,
+                                                          weights, features,
+                                                          1));
+             });
+
+        BOOST_REQUIRE_EQUAL(roots.size(), 2);
+        BOOST_REQUIRE(roots[0].tree.root.node());
+        BOOST_REQUIRE(roots[1].tree.root.node());
+        cerr << roots[0].print() << endl;
+        BOOST_CHECK(roots[0].tree.root.node()->split
+                    == roots[1].tree.root.node()->split);
+        BOOST_CHECK_EQUAL(roots[0].tree.root.node()->z,
+                          roots[1].tree.root.node()->z);
+        BOOST_CHECK_EQUAL(roots[0].print(), roots[1].print());
+
+        /* Further down, the trainer re-buckets the examples it has left
+           while we keep the buckets of the whole dataset, so the trees are
+           different but within a tenth of a percent as accurate. */
+        vector<Decision_Tree> trees;
+        train_both<Decision_Tree_Generator>
+            ("",
+             [&] (Decision_Tree_Generator & generator)
+             {
+                 generator.init(fs, fs->features()[0]);
+                 trees.push_back(generator.train_weighted(context, data,
+                                                          weights, features,
+                                                          6));
+             });
+
+        BOOST_REQUIRE_EQUAL(trees.size(), 2);
+
+        float accuracy = trees[0].accuracy(data).first;
+        float hist_accuracy = trees[1].accuracy(data).first;
+
+        cerr << "accuracy " << accuracy << " with histograms "
+             << hist_accuracy << endl;
+
+        BOOST_CHECK_GT(hist_accuracy, 0.8);
+        BOOST_CHECK_GE(hist_accuracy, accuracy - 0.001);
+
+        /* The tree can go through a round trip like any other. */
+        Decision_Tree reconstituted;
+        {
+            std::ostringstream stream;
+            DB::Store_Writer store(stream);
+            trees[1].serialize(store);
+            std::istringstream istream(stream.str());
+            DB::Store_Reader reader(istream);
+            reconstituted.reconstitute(reader, fs);
+        }
+        BOOST_CHECK_EQUAL(reconstituted.print(), trees[1].print());
+    }
+}
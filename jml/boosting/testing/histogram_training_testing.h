@@ -0,0 +1,61 @@
+/* histogram_training_testing.h                                    -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Synthetic datasets to test and benchmark histogram training with.
+*/
+
+#ifndef __boosting__histogram_training_testing_h__
+#define __boosting__histogram_training_testing_h__
+
+
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/training_data.h"
+#include <random>
+#include <cmath>
+
+
+namespace ML {
+
+
+/** numExamples examples whose features are uniform in [0, 1), rounded to
+    the given number of distinct values, and missing with the given
+    probability.  The label depends on the first few features, with some
+    noise.
+*/
+inline void
+synthetic_dataset(Training_Data & data, const Dense_Feature_Space & fs,
+                  size_t numExamples, int numValues, float missing,
+                  int seed)
+{
+    int nf = fs.features().size() - 1;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    for (size_t i = 0;  i < numExamples;  ++i) {
+        distribution<float> features(nf + 1);
+
+        for (int j = 1;  j <= nf;  ++j) {
+            features[j] = std::floor(uniform(rng) * numValues) / numValues;
+            if (uniform(rng) < missing)
+                features[j] = NAN;
+        }
+
+        auto value = [&] (int j)
+            {
+                return j <= nf && !std::isnan(features[j])
+                    ? features[j] : 0.5f;
+            };
+
+        float score = value(1) + value(2) * value(3) - 0.5 * value(4)
+            + 0.3 * (uniform(rng) - 0.5);
+        features[0] = score > 0.5;
+
+        data.add_example(fs.encode(features));
+    }
+}
+
+} // namespace ML
+
+
+#endif /* __boosting__histogram_training_testing_h__ */
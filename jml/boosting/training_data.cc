@@ -18,6 +18,7 @@
 #include "jml/db/persistent.h"
 #include "jml/utils/hash_map.h"
 #include "jml/arch/demangle.h"
+#include <atomic>
 
 
 using namespace std;
@@ -33,8 +34,15 @@ namespace ML {
 /*****************************************************************************/
 
 
+namespace {
+
+std::atomic<uint64_t> last_generation(0);
+
+} // file scope
+
 Training_Data::Training_Data()
 {
+    new_generation();
 }
 
 Training_Data::
@@ -48,6 +56,7 @@ Training_Data::Training_Data(const Training_Data & other)
     : data_(other.data_), index_(other.index_),
       feature_space_(other.feature_space_), dirty_(other.dirty_)
 {
+    new_generation();
 }
 
 Training_Data::~Training_Data()
@@ -66,6 +75,7 @@ void Training_Data::clear()
     data_.clear();
     index_.reset();
     dirty_ = false;
+    new_generation();
 }
     
 void Training_Data::swap(Training_Data & other)
@@ -74,6 +84,12 @@ void Training_Data::swap(Training_Data & other)
     std::swap(index_, other.index_);
     std::swap(feature_space_, other.feature_space_);
     std::swap(dirty_, other.dirty_);
+    std::swap(generation_, other.generation_);
+}
+
+void Training_Data::new_generation()
+{
+    generation_ = ++last_generation;
 }
     
 std::vector<Feature>
@@ -157,6 +173,7 @@ std::shared_ptr<Feature_Set> & Training_Data::modify(int example)
 {
     std::shared_ptr<Feature_Set> & fs = data_.at(example);
     dirty_ = true;
+    new_generation();
     if (!fs.unique())
         fs.reset(fs->make_copy());
     return fs;
@@ -189,6 +206,7 @@ add_example(const std::shared_ptr<Feature_Set> & example)
     data_.push_back(example);
 
     dirty_ = true;
+    new_generation();
 
     return example_num;
 }
@@ -226,6 +244,7 @@ modify_feature(int example_number,
     mut_fs->replace(feature, new_val);
 
     dirty_ = true;
+    new_generation();
 
     return old_val;
 }
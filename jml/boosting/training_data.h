@@ -213,6 +213,13 @@ public:
         return generate_index();
     }
 
+    /** Number that identifies the current contents of this object.  It
+        changes whenever examples are added or modified through it, and is
+        never shared with another Training_Data object, even one created
+        at the same address.  Used to recognise data that was seen before.
+    */
+    uint64_t generation() const { return generation_; }
+
 protected:
     /** Data for all our examples. */
     typedef std::vector<std::shared_ptr<Feature_Set> > data_type;
@@ -228,6 +235,11 @@ protected:
     */
     mutable bool dirty_;
 
+    uint64_t generation_;
+
+    /** Give the data a new generation number. */
+    void new_generation();
+
     /** Notify that the given feature needs to be reindexed */
     void notify_needs_reindex(const Feature & feature)
     {
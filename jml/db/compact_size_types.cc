@@ -117,7 +117,7 @@ void encode_compact(char * & first, char * last, unsigned long long val)
 {
     /* Length depends upon highest bit / 7 */
     int highest = highest_bit(val);
-    int idx = highest / 7;
+    int idx = std::min(highest / 7, 8);
     int len = idx + 1;
 
     if (first + len > last)
@@ -53,18 +53,17 @@ template<typename T,
 std::string
 serializeToString(const T & t, X * = 0)
 {
-    std::ostringstream stream;
-    ML::DB::Store_Writer writer(stream);
+    ML::DB::Store_Writer writer;
+    writer.open_buffer();
     t.serialize(writer);
-    return stream.str();
+    return writer.release_buffer();
 }
 
 
 template<typename T>
 T reconstituteFromString(const std::string & str)
 {
-    std::istringstream stream(str);
-    ML::DB::Store_Reader store(stream);
+    ML::DB::Store_Reader store(str.data(), str.size());
     T result;
     result.reconstitute(store);
     return result;
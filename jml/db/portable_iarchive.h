@@ -35,6 +35,8 @@
 #include <set>
 #include <boost/array.hpp>
 #include "jml/utils/string_functions.h"
+#include "jml/compiler/compiler.h"
+#include <string.h>
 
 namespace boost {
 
@@ -96,6 +98,23 @@ public:
         pos_ += amount;
     }
 
+    /** Copy the next size bytes out and skip over them.  When the bytes
+        are already in memory (always the case for a buffer), this is
+        just a bounds check and a memcpy.
+    */
+    void read_binary(void * address, size_t size)
+    {
+        if (JML_LIKELY(size <= avail())) {
+            memcpy(address, pos_, size);
+            pos_ += size;
+            offset_ += size;
+            return;
+        }
+        must_have(size);
+        memcpy(address, pos_, size);
+        skip(size);
+    }
+
     //const char * start() const { return start_; }
     const char * pos() const { return pos_; }
     const char * end() const { return end_; }
@@ -135,6 +154,19 @@ public:
     portable_bin_iarchive(std::istream & stream);
     portable_bin_iarchive(const char * c, size_t sz);
 
+    /** Decode a compact_size_t, with the common single byte case
+        inline.
+    */
+    unsigned long long read_compact_size()
+    {
+        if (JML_LIKELY(avail() && (unsigned char)**this < 128)) {
+            unsigned long long result = (unsigned char)**this;
+            skip(1);
+            return result;
+        }
+        return decode_compact(*this);
+    }
+
     void load(unsigned char & x)
     {
         load_binary(&x, 1);
@@ -180,8 +212,7 @@ public:
 
     void load(unsigned long & x)
     {
-        compact_size_t sz(*this);
-        x = sz;
+        x = read_compact_size();
     }
 
     void load(signed long & x)
@@ -192,8 +223,7 @@ public:
 
     void load(unsigned long long & x)
     {
-        compact_size_t sz(*this);
-        x = sz;
+        x = read_compact_size();
     }
 
     void load(signed long long & x)
@@ -234,14 +264,19 @@ public:
 
     void load(std::string & str)
     {
-        compact_size_t size(*this);
+        size_t size = read_compact_size();
+        if (JML_LIKELY(size <= avail())) {
+            str.assign(pos(), size);
+            skip(size);
+            return;
+        }
         str.resize(size);
         load_binary(&str[0], size);
     }
 
     void load(const char * & str)
     {
-        compact_size_t size(*this);
+        size_t size = read_compact_size();
         char * res = new char[size];  // keep track of this?
         load_binary(res, size);
         str = res;
@@ -250,7 +285,7 @@ public:
     template<class T, class A>
     void load(std::vector<T, A> & vec)
     {
-        compact_size_t sz(*this);
+        size_t sz = read_compact_size();
 
         std::vector<T, A> v;
         v.reserve(sz);
@@ -265,7 +300,7 @@ public:
     template<class K, class V, class L, class A>
     void load(std::map<K, V, L, A> & res)
     {
-        compact_size_t sz(*this);
+        size_t sz = read_compact_size();
 
         std::map<K, V, L, A> m;
         for (unsigned i = 0;  i < sz;  ++i) {
@@ -281,7 +316,7 @@ public:
     template<class K, class V, class H, class P, class A>
     void load(std::unordered_map<K, V, H, P, A> & res)
     {
-        compact_size_t sz(*this);
+        size_t sz = read_compact_size();
 
         std::unordered_map<K, V, H, P, A> m;
         for (unsigned i = 0;  i < sz;  ++i) {
@@ -297,7 +332,7 @@ public:
     template<class V, class L, class A>
     void load(std::set<V, L, A> & res)
     {
-        compact_size_t sz(*this);
+        size_t sz = read_compact_size();
 
         std::set<V, L, A> m;
         for (unsigned i = 0;  i < sz;  ++i) {
@@ -345,10 +380,7 @@ public:
 
     void load_binary(void * address, size_t size)
     {
-        must_have(size);
-        std::copy(pos(), pos() + size,
-                  reinterpret_cast<char *>(address));
-        skip(size);
+        read_binary(address, size);
     }
 
     // Anything with a serialize() method gets to be serialized
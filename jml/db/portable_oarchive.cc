@@ -37,23 +37,24 @@ namespace DB {
 /*****************************************************************************/
 
 portable_bin_oarchive::portable_bin_oarchive()
-    : stream(0), offset_(0)
+    : stream(0), offset_(0), buf_start_(0), buf_pos_(0), buf_end_(0)
 {
 }
 
 portable_bin_oarchive::portable_bin_oarchive(const std::string & filename)
     : stream(new filter_ostream(filename)), owned_stream(stream),
-      offset_(0)
+      offset_(0), buf_start_(0), buf_pos_(0), buf_end_(0)
 {
 }
 
 portable_bin_oarchive::portable_bin_oarchive(std::ostream & stream)
-    : stream(&stream), offset_(0)
+    : stream(&stream), offset_(0), buf_start_(0), buf_pos_(0), buf_end_(0)
 {
 }
 
 void portable_bin_oarchive::open(const std::string & filename)
 {
+    close_buffer();
     stream = new filter_ostream(filename.c_str());
     owned_stream.reset(stream);
     offset_ = 0;
@@ -61,11 +62,68 @@ void portable_bin_oarchive::open(const std::string & filename)
 
 void portable_bin_oarchive::open(std::ostream & stream)
 {
+    close_buffer();
     this->stream = &stream;
     owned_stream.reset();
     offset_ = 0;
 }
 
+void portable_bin_oarchive::open_buffer(size_t initial_capacity)
+{
+    stream = 0;
+    owned_stream.reset();
+    offset_ = 0;
+
+    buffer_.resize(std::max<size_t>(initial_capacity, 16));
+    buf_start_ = buf_pos_ = &buffer_[0];
+    buf_end_ = buf_start_ + buffer_.size();
+}
+
+std::string portable_bin_oarchive::release_buffer()
+{
+    if (!buf_start_)
+        throw Exception("portable_bin_oarchive::release_buffer(): "
+                        "not in buffer mode");
+    buffer_.resize(buf_pos_ - buf_start_);
+    std::string result;
+    result.swap(buffer_);
+    close_buffer();
+    return result;
+}
+
+void portable_bin_oarchive::close_buffer()
+{
+    buffer_.clear();
+    buf_start_ = buf_pos_ = buf_end_ = 0;
+}
+
+void
+portable_bin_oarchive::
+save_binary_slow(const void * address, size_t size)
+{
+    if (buf_start_) {
+        // Out of room in the buffer; grow it geometrically
+        size_t used = buf_pos_ - buf_start_;
+        size_t capacity = std::max(buffer_.size() * 2, used + size);
+        buffer_.resize(capacity);
+        buf_start_ = &buffer_[0];
+        buf_pos_ = buf_start_ + used;
+        buf_end_ = buf_start_ + capacity;
+
+        memcpy(buf_pos_, address, size);
+        buf_pos_ += size;
+        offset_ += size;
+        return;
+    }
+
+    if (!stream)
+        throw Exception("Writing to unopened portable_bin_oarchive");
+    stream->write((char *)address, size);
+    offset_ += size;
+    if (!*stream)
+        throw Exception("Error writing to stream");
+}
+
 void
 portable_bin_oarchive::
 save(const Nested_Writer & writer)
@@ -29,6 +29,7 @@
 #include "serialization_order.h"
 #include "jml/utils/floating_point.h"
 #include "compact_size_types.h"
+#include "jml/compiler/compiler.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/type_traits.hpp>
 #include <boost/utility.hpp>
@@ -65,6 +66,21 @@ public:
     void open(const std::string & filename);
     void open(std::ostream & stream);
 
+    /** Write into an internal, contiguous memory buffer rather than a
+        stream.  This avoids all of the iostream machinery and is the
+        fastest way to serialize to a string.  The buffer starts with
+        the given capacity and doubles as needed.
+    */
+    void open_buffer(size_t initial_capacity = 256);
+
+    /** Return the contents of the buffer opened with open_buffer(),
+        without copying it.  The archive is closed afterwards.
+    */
+    std::string release_buffer();
+
+    /** Is the archive writing into an internal buffer? */
+    bool is_buffer() const { return buf_start_ != 0; }
+
     void save(unsigned char x)
     {
         save_binary(&x, 1);
@@ -114,32 +130,22 @@ public:
     
     void save(unsigned long x)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
-        compact_size_t sz(x);
-        sz.serialize(*this);
+        save_compact_size(x);
     }
 
     void save(signed long x)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
         compact_int_t sz(x);
         sz.serialize(*this);
     }
 
     void save(unsigned long long x)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
-        compact_size_t sz(x);
-        sz.serialize(*this);
+        save_compact_size(x);
     }
 
     void save(signed long long x)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
         compact_int_t sz(x);
         sz.serialize(*this);
     }
@@ -173,27 +179,21 @@ public:
 
     void save(const std::string & str)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
-        compact_size_t size(str.length());
-        size.serialize(*this);
-        save_binary(&str[0], size);
+        save_compact_size(str.length());
+        save_binary(str.data(), str.length());
     }
 
     void save(const char * str)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
-        compact_size_t size(strlen(str));
-        size.serialize(*this);
+        size_t size = strlen(str);
+        save_compact_size(size);
         save_binary(str, size);
     }
 
     template<class T, class A>
     void save(const std::vector<T, A> & vec)
     {
-        compact_size_t size(vec.size());
-        size.serialize(*this);
+        save_compact_size(vec.size());
         for (unsigned i = 0;  i < vec.size();  ++i)
             *this << vec[i];
     }
@@ -201,8 +201,7 @@ public:
     template<class K, class V, class L, class A>
     void save(const std::map<K, V, L, A> & m)
     {
-        compact_size_t size(m.size());
-        size.serialize(*this);
+        save_compact_size(m.size());
         for (typename std::map<K, V, L, A>::const_iterator
                  it = m.begin(), end = m.end();
              it != end;  ++it)
@@ -212,8 +211,7 @@ public:
     template<class K, class V, class H, class P, class A>
     void save(const std::unordered_map<K, V, H, P, A> & m)
     {
-        compact_size_t size(m.size());
-        size.serialize(*this);
+        save_compact_size(m.size());
         for (typename std::unordered_map<K, V, H, P, A>::const_iterator
                  it = m.begin(), end = m.end();
              it != end;  ++it)
@@ -223,8 +221,7 @@ public:
     template<class V, class L, class A>
     void save(const std::set<V, L, A> & m)
     {
-        compact_size_t size(m.size());
-        size.serialize(*this);
+        save_compact_size(m.size());
         for (typename std::set<V, L, A>::const_iterator
                  it = m.begin(), end = m.end();
              it != end;  ++it)
@@ -260,12 +257,26 @@ public:
 
     void save_binary(const void * address, size_t size)
     {
-        if (!stream)
-            throw Exception("Writing to unopened portable_bin_oarchive");
-        stream->write((char *)address, size);
-        offset_ += size;
-        if (!stream)
-            throw Exception("Error writing to stream");
+        if (JML_LIKELY(size <= size_t(buf_end_ - buf_pos_))) {
+            memcpy(buf_pos_, address, size);
+            buf_pos_ += size;
+            offset_ += size;
+            return;
+        }
+        save_binary_slow(address, size);
+    }
+
+    /** Same encoding as compact_size_t::serialize(), but with the common
+        single byte case inline.
+    */
+    void save_compact_size(unsigned long long val)
+    {
+        if (JML_LIKELY(val < 128 && buf_pos_ != buf_end_)) {
+            *buf_pos_++ = val;
+            ++offset_;
+            return;
+        }
+        encode_compact(*this, val);
     }
 
     /** Warning: doesn't do byte order conversions or anything like that. */
@@ -297,6 +308,16 @@ private:
     std::ostream * stream;
     std::shared_ptr<std::ostream> owned_stream;
     size_t offset_;
+
+    /* Buffer mode.  When not in buffer mode, buf_pos_ == buf_end_ == 0
+       so that the fast path in save_binary is never taken. */
+    std::string buffer_;
+    char * buf_start_;
+    char * buf_pos_;
+    char * buf_end_;
+
+    void save_binary_slow(const void * address, size_t size);
+    void close_buffer();
 };
 
 
@@ -0,0 +1,153 @@
+/* buffer_archive_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test that the memory buffer mode of the portable archives produces
+   exactly the same bytes as the stream mode.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/db/persistent.h"
+#include "jml/db/compact_size_types.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <limits>
+
+
+using namespace ML;
+using namespace ML::DB;
+using namespace std;
+
+
+namespace {
+
+struct Record {
+    int i;
+    double d;
+    std::string s;
+    std::vector<unsigned long long> sizes;
+    std::map<std::string, int> m;
+
+    void serialize(Store_Writer & store) const
+    {
+        store << i << d << s << sizes << m;
+    }
+
+    void reconstitute(Store_Reader & store)
+    {
+        store >> i >> d >> s >> sizes >> m;
+    }
+
+    bool operator == (const Record & other) const
+    {
+        return i == other.i && d == other.d && s == other.s
+            && sizes == other.sizes && m == other.m;
+    }
+};
+
+Record makeRecord(int n)
+{
+    Record result;
+    result.i = n;
+    result.d = n * 1.5;
+    result.s = string(n % 300, 'a' + n % 26);
+
+    unsigned long long val = 1;
+    for (unsigned i = 0;  i < 64;  ++i, val <<= 1) {
+        result.sizes.push_back(val - 1);
+        result.sizes.push_back(val);
+    }
+    result.sizes.push_back(std::numeric_limits<unsigned long long>::max());
+
+    for (unsigned i = 0;  i < n % 10;  ++i)
+        result.m[to_string(i)] = i * n;
+    return result;
+}
+
+std::string serializeWithStream(const Record & r)
+{
+    ostringstream stream;
+    {
+        Store_Writer store(stream);
+        r.serialize(store);
+    }
+    return stream.str();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_buffer_same_as_stream )
+{
+    for (unsigned n = 0;  n < 1000;  ++n) {
+        Record r = makeRecord(n);
+        string s1 = serializeWithStream(r);
+        string s2 = serializeToString(r);
+        BOOST_REQUIRE_EQUAL(s1, s2);
+
+        Record r2 = reconstituteFromString<Record>(s2);
+        BOOST_REQUIRE(r == r2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_buffer_growth )
+{
+    Store_Writer store;
+    store.open_buffer(1);
+    BOOST_CHECK(store.is_buffer());
+
+    string big(100000, 'x');
+    for (unsigned i = 0;  i < 100;  ++i)
+        store << i << big;
+    BOOST_CHECK_EQUAL(store.offset(), 100 * (4 + 3 + big.size()));
+
+    string result = store.release_buffer();
+    BOOST_CHECK(!store.is_buffer());
+    BOOST_CHECK_EQUAL(result.size(), 100 * (4 + 3 + big.size()));
+
+    Store_Reader reader(result.data(), result.size());
+    for (unsigned i = 0;  i < 100;  ++i) {
+        unsigned j;
+        string s;
+        reader >> j >> s;
+        BOOST_CHECK_EQUAL(i, j);
+        BOOST_CHECK(s == big);
+    }
+    BOOST_CHECK_EQUAL(reader.avail(), 0);
+
+    // Reading past the end must still be detected
+    unsigned char c;
+    BOOST_CHECK_THROW(reader >> c, ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_size_encodings )
+{
+    unsigned long long val = 1;
+    for (unsigned i = 0;  i < 64;  ++i, val <<= 1) {
+        for (unsigned long long v: { val - 1, val, val + 1 }) {
+            char buf[9];
+            char * p = buf;
+            encode_compact(p, buf + 9, v);
+
+            Store_Writer store;
+            store.open_buffer();
+            store << v;
+            string s = store.release_buffer();
+            BOOST_REQUIRE_EQUAL(s, string(buf, p));
+
+            Store_Reader reader(s.data(), s.size());
+            unsigned long long v2;
+            reader >> v2;
+            BOOST_REQUIRE_EQUAL(v, v2);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_unopened_archive )
+{
+    Store_Writer store;
+    BOOST_CHECK(!store.is_buffer());
+    BOOST_CHECK_THROW(store << 1, ML::Exception);
+    BOOST_CHECK_THROW(store << std::string("hello"), ML::Exception);
+    BOOST_CHECK_THROW(store.release_buffer(), ML::Exception);
+}
@@ -1,2 +1,3 @@
 $(eval $(call test,compact_size_type_test,utils arch db,boost))
 $(eval $(call test,serialize_reconstitute_test,utils arch db,boost))
+$(eval $(call test,buffer_archive_test,utils arch db,boost))
@@ -203,6 +203,64 @@ struct Dense_Layer : public Layer {
                 Parameters & gradient,
                 Parameters * dgradient,
                 double example_weight) const;    
+
+
+    /*************************************************************************/
+    /* BATCHED PROPAGATION                                                   */
+    /*************************************************************************/
+
+    /* These do the activations and gradients of the whole batch with a
+       gemm each.  Examples with missing inputs go through the single
+       example code. */
+
+    using Layer::fprop_batch;
+
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
+    template<typename F>
+    void fprop_batch(size_t n, const F * inputs,
+                     F * temp_space, size_t temp_space_size,
+                     F * outputs) const;
+
+    using Layer::bprop_batch;
+
+    virtual void
+    bprop_batch(size_t n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    virtual void
+    bprop_batch(size_t n,
+                const double * inputs,
+                const double * outputs,
+                const double * temp_space, size_t temp_space_size,
+                const double * output_errors,
+                double * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    template<typename F>
+    void bprop_batch(size_t n,
+                     const F * inputs,
+                     const F * outputs,
+                     const F * temp_space, size_t temp_space_size,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     const float * example_weights) const;
     
     /** Add in our parameters to the params object. */
     virtual void add_parameters(Parameters & params);
@@ -12,6 +12,7 @@
 #include "jml/db/persistent.h"
 #include "jml/arch/demangle.h"
 #include "jml/algebra/matrix_ops.h"
+#include "jml/algebra/lapack.h"
 #include "jml/arch/simd_vector.h"
 #include "jml/utils/string_functions.h"
 #include "jml/boosting/registry.h"
@@ -664,6 +665,189 @@ bbprop(const double * inputs,
 
 namespace {
 
+/** The weights as a matrix of F that can be passed to gemm.  They only need
+    to be converted when the precisions differ.
+*/
+template<typename F>
+const F * gemm_weights(const boost::multi_array<F, 2> & weights,
+                       std::vector<F> & storage)
+{
+    return weights.data();
+}
+
+template<typename F, typename Float>
+const F * gemm_weights(const boost::multi_array<Float, 2> & weights,
+                       std::vector<F> & storage)
+{
+    storage.assign(weights.data(), weights.data() + weights.num_elements());
+    return &storage[0];
+}
+
+template<typename F>
+bool any_missing(const F * values, size_t n)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        if (isnan(values[i])) return true;
+    return false;
+}
+
+} // file scope
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const F * inputs,
+            F * temp_space, size_t temp_space_size,
+            F * outputs) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::fprop_batch(): wrong temp space size");
+
+    if (n == 0) return;
+
+    // Activations start as the bias, and then C += X W
+    std::vector<F> act(n * no);
+    for (unsigned x = 0;  x < n;  ++x)
+        std::copy(bias.begin(), bias.end(), &act[x * no]);
+
+    std::vector<F> storage;
+    const F * w = gemm_weights(weights, storage);
+    LAPack::gemm('N', 'N', no, n, ni, 1.0, w, no, inputs, ni,
+                 1.0, &act[0], no);
+
+    // Examples with missing values got NaNs, and need redoing
+    for (unsigned x = 0;  x < n;  ++x)
+        if (any_missing(inputs + x * ni, ni))
+            activation(inputs + x * ni, &act[x * no]);
+
+    transfer_function->transfer(&act[0], outputs, n * no);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch<float>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch<double>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const F * inputs,
+            const F * outputs,
+            const F * temp_space, size_t temp_space_size,
+            const F * output_errors,
+            F * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::bprop_batch(): wrong temp size");
+
+    if (n == 0) return;
+
+    // Missing values need updates to other parameters, one by one
+    if (any_missing(inputs, n * ni)) {
+        Layer::bprop_batch(n, inputs, outputs, temp_space, temp_space_size,
+                           output_errors, input_errors, gradient,
+                           example_weights);
+        return;
+    }
+
+    // dbias for each example, and weighted by the example weight
+    std::vector<F> dbias(n * no);
+    transfer_function->derivative(outputs, &dbias[0], n * no);
+    SIMD::vec_prod(&dbias[0], output_errors, &dbias[0], n * no);
+
+    std::vector<F> wdbias(n * no);
+    double bias_updates[no];
+    std::fill(bias_updates, bias_updates + no, 0.0);
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        F k = example_weights ? example_weights[x] : 1.0;
+        const F * d = &dbias[x * no];
+        F * wd = &wdbias[x * no];
+        for (unsigned o = 0;  o < no;  ++o) {
+            wd[o] = k * d[o];
+            bias_updates[o] += wd[o];
+        }
+    }
+
+    gradient.vector(1, "bias").update(bias_updates, 1.0);
+
+    // Weight updates are X' (W dbias); one row per input
+    std::vector<F> weight_updates(ni * no);
+    LAPack::gemm('N', 'T', no, ni, n, 1.0, &wdbias[0], no, inputs, ni,
+                 0.0, &weight_updates[0], no);
+
+    Matrix_Parameter & dweights = gradient.matrix(0, "weights");
+    for (unsigned i = 0;  i < ni;  ++i)
+        dweights.update_row(i, &weight_updates[i * no], 1.0);
+
+    if (!input_errors) return;
+
+    std::vector<F> storage;
+    const F * w = gemm_weights(weights, storage);
+    LAPack::gemm('T', 'N', ni, n, no, 1.0, w, no, &dbias[0], no,
+                 0.0, input_errors, ni);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch<float>(n, inputs, outputs, temp_space, temp_space_size,
+                       output_errors, input_errors, gradient,
+                       example_weights);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch<double>(n, inputs, outputs, temp_space, temp_space_size,
+                        output_errors, input_errors, gradient,
+                        example_weights);
+}
+
+namespace {
+
 template<typename Float>
 void random_fill_range(Float * start, size_t size, float limit,
                        Thread_Context & context)
@@ -121,6 +121,81 @@ train_example(const float * data,
     return make_pair(sqrt(error), outputs[0]);
 }
 
+double
+Discriminative_Trainer::
+train_batch(const std::vector<const float *> & data,
+            const std::vector<Label> & labels,
+            const std::vector<float> & weights,
+            const Output_Encoder & encoder,
+            const int * examples, size_t n,
+            Parameters_Copy<double> & updates,
+            float * outputs) const
+{
+    if (n == 0) return 0.0;
+
+    int ni = layer->inputs(), no = layer->outputs();
+
+    /* The temporaries are for the whole batch, rather than per example. */
+    distribution<float> inputs(n * ni);
+    distribution<float> batch_weights(n);
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        int x = examples[i];
+        std::copy(data[x], data[x] + ni, &inputs[i * ni]);
+        batch_weights[i] = weights.size() ? weights.at(x) : 1.0;
+    }
+
+    /* fprop */
+
+    size_t temp_space_required
+        = layer->fprop_batch_temporary_space_required(n);
+    distribution<float> temp_space(temp_space_required);
+
+    distribution<float> batch_outputs(n * no);
+    layer->fprop_batch(n, &inputs[0],
+                       temp_space.empty() ? 0 : &temp_space[0],
+                       temp_space_required, &batch_outputs[0]);
+
+    /* error */
+
+    if (encoder.num_inputs != no)
+        throw Exception("output encoder and layer have different widths");
+
+    distribution<float> targets(n * no);
+    for (unsigned i = 0;  i < n;  ++i)
+        encoder.target(labels[examples[i]], &targets[i * no]);
+
+    distribution<float> derrors(n * no);
+    double total_rmse = 0.0;
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        const float * target = &targets[i * no];
+
+        double error = 0.0;
+        for (unsigned o = 0;  o < no;  ++o) {
+            float e = target[o] - batch_outputs[i * no + o];
+            error += e * e;
+            // TODO: get the loss function to do this...
+            derrors[i * no + o] = -2.0 * e;
+        }
+
+        total_rmse += sqrt(error);
+        outputs[i] = batch_outputs[i * no];
+    }
+
+    /* bprop */
+
+    layer->bprop_batch(n, &inputs[0], &batch_outputs[0],
+                       temp_space.empty() ? 0 : &temp_space[0],
+                       temp_space_required,
+                       &derrors[0],
+                       0 /* don't calculate input errors */,
+                       updates,
+                       &batch_weights[0]);
+
+    return total_rmse;
+}
+
 namespace {
 
 struct Train_Examples_Job {
@@ -169,32 +244,12 @@ struct Train_Examples_Job {
         Parameters_Copy<double> local_updates(*trainer.layer);
         local_updates.fill(0.0);
 
-        double total_rmse_local = 0.0;
-
         //cerr << "training from " << first << " to " << last << endl;
 
-        for (unsigned ix = first; ix < last;  ++ix) {
-            int x = examples[ix];
-
-            double rmse_contribution;
-            double output;
-
-            float weight = 1.0;
-            if (weights.size())
-                weight = weights.at(x);
-
-            //cerr << "x " << x << " weight " << weight << endl;
-
-            boost::tie(rmse_contribution, output)
-                = trainer.train_example(data[x],
-                                        labels[x],
-                                        local_updates,
-                                        output_encoder,
-                                        weight);
-            
-            outputs[ix] = output;
-            total_rmse_local += rmse_contribution;
-        }
+        double total_rmse_local
+            = trainer.train_batch(data, labels, weights, output_encoder,
+                                  &examples[first], last - first,
+                                  local_updates, &outputs[first]);
 
         Guard guard(updates_lock);
         total_rmse += total_rmse_local;
@@ -50,6 +50,19 @@ public:
                   Parameters_Copy<double> & updates,
                   float weight = 1.0) const;
 
+    /** Train the given examples as one batch, with a fprop_batch() and a
+        bprop_batch() over all of them.  The first output for each example
+        is written to outputs, and the sum of their RMSEs is returned.
+    */
+    double
+    train_batch(const std::vector<const float *> & data,
+                const std::vector<Label> & labels,
+                const std::vector<float> & weights,
+                const Output_Encoder & encoder,
+                const int * examples, size_t n,
+                Parameters_Copy<double> & updates,
+                float * outputs) const;
+
     std::pair<double, double>
     train_iter(const std::vector<distribution<float> > & data,
                const std::vector<Label> & labels,
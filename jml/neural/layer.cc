@@ -265,6 +265,104 @@ bprop(const distribution<double> & inputs,
                          output_errors, gradient, example_weight);
 }
 
+size_t
+Layer::
+fprop_batch_temporary_space_required(size_t n) const
+{
+    return n * fprop_temporary_space_required();
+}
+
+template<typename F>
+void
+Layer::
+fprop_batch_impl(size_t n, const F * inputs,
+                 F * temp_space, size_t temp_space_size,
+                 F * outputs) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t ts = fprop_temporary_space_required();
+
+    if (temp_space_size != n * ts)
+        throw Exception("Layer::fprop_batch(): wrong temp space size");
+
+    for (size_t x = 0;  x < n;  ++x)
+        fprop(inputs + x * ni, temp_space + x * ts, ts, outputs + x * no);
+}
+
+void
+Layer::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch_impl(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+void
+Layer::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch_impl(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<typename F>
+void
+Layer::
+bprop_batch_impl(size_t n,
+                 const F * inputs,
+                 const F * outputs,
+                 const F * temp_space, size_t temp_space_size,
+                 const F * output_errors,
+                 F * input_errors,
+                 Parameters & gradient,
+                 const float * example_weights) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t ts = fprop_temporary_space_required();
+
+    if (temp_space_size != n * ts)
+        throw Exception("Layer::bprop_batch(): wrong temp space size");
+
+    for (size_t x = 0;  x < n;  ++x)
+        bprop(inputs + x * ni, outputs + x * no, temp_space + x * ts, ts,
+              output_errors + x * no,
+              input_errors ? input_errors + x * ni : 0,
+              gradient,
+              example_weights ? example_weights[x] : 1.0);
+}
+
+void
+Layer::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch_impl(n, inputs, outputs, temp_space, temp_space_size,
+                     output_errors, input_errors, gradient, example_weights);
+}
+
+void
+Layer::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch_impl(n, inputs, outputs, temp_space, temp_space_size,
+                     output_errors, input_errors, gradient, example_weights);
+}
+
 namespace {
 
 template<typename F>
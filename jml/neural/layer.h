@@ -600,12 +600,108 @@ public:
     ///@}
 
 
+    /*************************************************************************/
+    /* BATCHED PROPAGATION                                                   */
+    /*************************************************************************/
+
+    /** \name Batched Propagation
+
+        These methods perform the fprop() and bprop() of n examples at once.
+        Each of the inputs, outputs and errors arguments is a row-major
+        matrix with one row of inputs() or outputs() elements per example,
+        and the temporary space is n times fprop_temporary_space_required()
+        elements, laid out however the layer likes.  Layers that can do
+        better than one example at a time (for example, by calling gemm)
+        should override them.
+
+        The default implementations loop over the examples calling fprop()
+        and bprop() with the temporary space of each example in turn.
+
+        @{
+    */
+
+    /** Return the amount of temporary space needed by fprop_batch() for a
+        batch of n examples.
+    */
+    virtual size_t fprop_batch_temporary_space_required(size_t n) const;
+
+    /** Forward propagate n examples.
+
+        \param n           Number of examples in the batch.
+        \param inputs      n x inputs() matrix of inputs.
+        \param temp_space  Array of temp_space_size uninitialized elements.
+        \param temp_space_size  The size of the temp_space array, which
+                           matches fprop_batch_temporary_space_required(n).
+        \param outputs     n x outputs() uninitialized matrix in which the
+                           outputs will be stored.
+    */
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    /** \copydoc fprop_batch */
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
+    /** Back propagate n examples, adding the weighted sum of their
+        gradients to gradient.  The arguments are those of bprop(), with a
+        row per example, except for:
+
+        \param input_errors n x inputs() matrix for the input errors, or null
+                          if they aren't needed.  Unlike for bprop(), it
+                          may not overlap output_errors.
+        \param example_weights Array of n weights, one per example, or null
+                          if they all have a weight of one.
+    */
+    virtual void
+    bprop_batch(size_t n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    /** \copydoc bprop_batch */
+    virtual void
+    bprop_batch(size_t n,
+                const double * inputs,
+                const double * outputs,
+                const double * temp_space, size_t temp_space_size,
+                const double * output_errors,
+                double * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    ///@}
+
+
 protected:
     std::string name_;
     size_t inputs_, outputs_;
 
     /** Contains a reference to our parameters. */
     Parameters_Ref parameters_;
+
+private:
+    template<typename F>
+    void fprop_batch_impl(size_t n, const F * inputs,
+                          F * temp_space, size_t temp_space_size,
+                          F * outputs) const;
+
+    template<typename F>
+    void bprop_batch_impl(size_t n,
+                          const F * inputs,
+                          const F * outputs,
+                          const F * temp_space, size_t temp_space_size,
+                          const F * output_errors,
+                          F * input_errors,
+                          Parameters & gradient,
+                          const float * example_weights) const;
 };
 
 inline std::ostream & operator << (std::ostream & stream, const Layer & layer)
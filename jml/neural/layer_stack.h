@@ -270,6 +270,71 @@ struct Layer_Stack : public Layer {
                         Parameters * dgradient,
                         double example_weight) const;
 
+
+
+    /*************************************************************************/
+    /* BATCHED PROPAGATION                                                   */
+    /*************************************************************************/
+
+    /* The temporary space is laid out as for fprop(), but with each
+       layer's temporary space and outputs for the whole batch:
+
+       +--------------+--------------+--------------+--------------+---...
+       | l0 tmp x n   | l0 out x n   | l1 tmp x n   | l1 out x n   | l2 tmp
+       +--------------+--------------+--------------+--------------+---...
+    */
+
+    virtual size_t fprop_batch_temporary_space_required(size_t n) const;
+
+    using Layer::fprop_batch;
+
+    template<typename F>
+    void fprop_batch(size_t n, const F * inputs,
+                     F * temp_space, size_t temp_space_size,
+                     F * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
+    using Layer::bprop_batch;
+
+    template<typename F>
+    void bprop_batch(size_t n,
+                     const F * inputs,
+                     const F * outputs,
+                     const F * temp_space, size_t temp_space_size,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     const float * example_weights) const;
+
+    virtual void
+    bprop_batch(size_t n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    virtual void
+    bprop_batch(size_t n,
+                const double * inputs,
+                const double * outputs,
+                const double * temp_space, size_t temp_space_size,
+                const double * output_errors,
+                double * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
     virtual void random_fill(float limit, Thread_Context & context);
 
     virtual void zero_fill();
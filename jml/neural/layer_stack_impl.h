@@ -475,6 +475,168 @@ bprop(const double * inputs,
                   output_errors, input_errors, gradient, example_weight);
 }
 
+template<class LayerT>
+size_t
+Layer_Stack<LayerT>::
+fprop_batch_temporary_space_required(size_t n) const
+{
+    size_t result = 0;
+
+    for (unsigned i = 0;  i < size();  ++i) {
+        if (i != 0) result += n * layers_[i]->inputs();
+        result += layers_[i]->fprop_batch_temporary_space_required(n);
+    }
+
+    return result;
+}
+
+template<class LayerT>
+template<class F>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const F * inputs,
+            F * temp_space, size_t temp_space_size,
+            F * outputs) const
+{
+    F * temp_space_end = temp_space + temp_space_size;
+
+    const F * curr_inputs = inputs;
+
+    for (unsigned i = 0;  i < size();  ++i) {
+        size_t layer_temp_space_size
+            = layers_[i]->fprop_batch_temporary_space_required(n);
+
+        F * curr_outputs
+            = (i == size() - 1
+               ? outputs
+               : temp_space + layer_temp_space_size);
+        
+        layers_[i]->fprop_batch(n, curr_inputs, temp_space,
+                                layer_temp_space_size, curr_outputs);
+
+        curr_inputs = curr_outputs;
+
+        temp_space += layer_temp_space_size;
+        if (i != size() - 1) temp_space += n * layers_[i]->outputs();
+
+        if (temp_space > temp_space_end
+            || (i == size() - 1 && temp_space != temp_space_end))
+            throw Exception("temp space out of sync");
+    }
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch<float>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch<double>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<class LayerT>
+template<typename F>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const F * inputs,
+            const F * outputs,
+            const F * temp_space, size_t temp_space_size,
+            const F * output_errors,
+            F * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    const F * temp_space_start = temp_space;
+    const F * curr_temp_space = temp_space + temp_space_size;
+
+    const F * curr_outputs = outputs;
+
+    /* The errors between the layers.  As the input and output errors of a
+       batch can't overlap, they alternate between two buffers. */
+    std::vector<F> error_storage[2];
+    if (size() > 1) {
+        error_storage[0].resize(n * max_internal_width());
+        error_storage[1].resize(n * max_internal_width());
+    }
+
+    for (int i = size() - 1;  i >= 0;  --i) {
+        size_t layer_temp_space_size
+            = layers_[i]->fprop_batch_temporary_space_required(n);
+
+        curr_temp_space -= layer_temp_space_size;
+
+        if (curr_temp_space < temp_space_start)
+            throw Exception("Layer temp space was out of sync");
+
+        const F * curr_inputs
+            = (i == 0 ? inputs : curr_temp_space - n * layers_[i]->inputs());
+
+        const F * curr_output_errors
+            = (i == size() - 1 ? output_errors : &error_storage[i % 2][0]);
+
+        F * curr_input_errors
+            = (i == 0 ? input_errors : &error_storage[(i + 1) % 2][0]);
+
+        layers_[i]->bprop_batch(n, curr_inputs, curr_outputs, curr_temp_space,
+                                layer_temp_space_size, curr_output_errors,
+                                curr_input_errors,
+                                gradient.subparams(i, layers_[i]->name()),
+                                example_weights);
+
+        curr_outputs = curr_inputs;
+        if (i != 0) curr_temp_space -= n * layers_[i]->inputs();
+    }
+
+    if (curr_temp_space != temp_space_start)
+        throw Exception("Layer_Stack::bprop_batch(): out of sync");
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch<float>(n, inputs, outputs, temp_space, temp_space_size,
+                       output_errors, input_errors, gradient,
+                       example_weights);
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    bprop_batch<double>(n, inputs, outputs, temp_space, temp_space_size,
+                        output_errors, input_errors, gradient,
+                        example_weights);
+}
+
 template<class LayerT>
 template<typename F>
 void
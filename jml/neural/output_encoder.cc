@@ -108,7 +108,14 @@ Output_Encoder::
 target(const Label & label) const
 {
     distribution<float> result(num_inputs);
-    
+    target(label, &result[0]);
+    return result;
+}
+
+void
+Output_Encoder::
+target(const Label & label, float * result) const
+{
     switch (mode) {
     case REGRESSION:
         result[0] = label;
@@ -128,8 +135,6 @@ target(const Label & label) const
     default:
         throw Exception("invalid output encoder class");
     }
-
-    return result;
 }
 
 float
@@ -51,6 +51,11 @@ struct Output_Encoder {
 
     distribution<float> target(const Label & label) const;
 
+    /** Same as above, but writes the num_inputs values of the target into
+        result rather than allocating them.
+    */
+    void target(const Label & label, float * result) const;
+
     inline float decode_value(float encoded) const;
 
     distribution<float> decode(const distribution<float> & encoded) const;
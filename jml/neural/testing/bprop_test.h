@@ -604,5 +604,84 @@ void bbprop_test_reconstruct(Layer & layerfwd, Thread_Context & context, double
     bbprop_test<Float>(layer, context, tolerance);
 }
 
+/** Check that fprop_batch() and bprop_batch() over n examples give the same
+    outputs, input errors and (weighted) gradient as fprop() and bprop() of
+    each example in turn.
+*/
+template<class Float, class Layer>
+void batch_test(Layer & layer, Thread_Context & context, int n = 17,
+                double tolerance = -1.0)
+{
+    // Only the rounding differs
+    if (tolerance == -1.0)
+        tolerance = (sizeof(Float) == sizeof(float) ? 1e-4 : 1e-9);
+
+    int ni = layer.inputs(), no = layer.outputs();
+
+    distribution<Float> inputs(n * ni);
+    for (unsigned i = 0;  i < n * ni;  ++i)
+        inputs[i] = 0.5 - context.random01();
+
+    if (layer.supports_missing_inputs()) {
+        for (unsigned i = 0;  i < ni;  i += 2)
+            inputs[ni + i] = numeric_limits<float>::quiet_NaN();
+    }
+
+    distribution<float> weights(n);
+    for (unsigned x = 0;  x < n;  ++x)
+        weights[x] = context.random01();
+
+    distribution<Float> output_errors(n * no);
+    for (unsigned i = 0;  i < n * no;  ++i)
+        output_errors[i] = 0.5 - context.random01();
+
+    // One at a time
+    size_t temp_space_size = layer.fprop_temporary_space_required();
+    distribution<Float> temp_space(temp_space_size + 1);
+    distribution<Float> outputs1(n * no), input_errors1(n * ni);
+    Parameters_Copy<Float> gradient1(layer, 0.0);
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        layer.fprop(&inputs[x * ni], &temp_space[0], temp_space_size,
+                    &outputs1[x * no]);
+        layer.bprop(&inputs[x * ni], &outputs1[x * no],
+                    &temp_space[0], temp_space_size,
+                    &output_errors[x * no], &input_errors1[x * ni],
+                    gradient1, weights[x]);
+    }
+
+    // All at once
+    size_t batch_temp_space_size
+        = layer.fprop_batch_temporary_space_required(n);
+    distribution<Float> batch_temp_space(batch_temp_space_size + 1);
+    distribution<Float> outputs2(n * no), input_errors2(n * ni);
+    Parameters_Copy<Float> gradient2(layer, 0.0);
+
+    layer.fprop_batch(n, &inputs[0], &batch_temp_space[0],
+                      batch_temp_space_size, &outputs2[0]);
+    layer.bprop_batch(n, &inputs[0], &outputs2[0],
+                      &batch_temp_space[0], batch_temp_space_size,
+                      &output_errors[0], &input_errors2[0],
+                      gradient2, &weights[0]);
+
+    auto check_close = [&] (const distribution<Float> & v1,
+                            const distribution<Float> & v2,
+                            const char * what)
+        {
+            BOOST_REQUIRE_EQUAL(v1.size(), v2.size());
+            for (unsigned i = 0;  i < v1.size();  ++i) {
+                if (std::abs(v1[i] - v2[i])
+                    <= tolerance * (1.0 + std::abs(v1[i])))
+                    continue;
+                BOOST_CHECK_MESSAGE(false, what << "[" << i << "]: "
+                                    << v1[i] << " != " << v2[i]);
+            }
+        };
+
+    check_close(outputs1, outputs2, "outputs");
+    check_close(input_errors1, input_errors2, "input_errors");
+    check_close(gradient1.values, gradient2.values, "gradient");
+}
+
 #endif /* __jml__neural__testing__bprop_test_h__ */
 
@@ -545,3 +545,44 @@ BOOST_AUTO_TEST_CASE( test_bbprop_tanh_double_none2 )
     bbprop_test<double>(layer, context);
 }
 
+
+BOOST_AUTO_TEST_CASE( test_batch_identity_float_none )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer("test", 20, 40, TF_IDENTITY, MV_NONE, context);
+
+    batch_test<float>(layer, context);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_tanh_double_none )
+{
+    Thread_Context context;
+    Dense_Layer<double> layer("test", 20, 40, TF_TANH, MV_NONE, context);
+
+    batch_test<double>(layer, context);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_tanh_float_layer_double_none )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer("test", 20, 40, TF_TANH, MV_NONE, context);
+
+    batch_test<double>(layer, context, 1);
+    batch_test<double>(layer, context, 64, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_tanh_float_dense )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer("test", 20, 40, TF_TANH, MV_DENSE, context);
+
+    batch_test<float>(layer, context);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_identity_double_input )
+{
+    Thread_Context context;
+    Dense_Layer<double> layer("test", 20, 40, TF_IDENTITY, MV_INPUT, context);
+
+    batch_test<double>(layer, context);
+}
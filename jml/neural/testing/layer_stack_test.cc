@@ -411,3 +411,34 @@ BOOST_AUTO_TEST_CASE( test_bprop_three_nonlinear_layers )
 
     bprop_test<double>(layers, context, 0.1);
 }
+
+BOOST_AUTO_TEST_CASE( test_batch_three_nonlinear_layers )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer1("test1", 5, 10, TF_TANH, MV_NONE, context);
+    Dense_Layer<float> layer2("test2", 10, 20, TF_TANH, MV_NONE, context);
+    Dense_Layer<float> layer3("test3", 20, 5, TF_TANH, MV_NONE,  context);
+
+    Layer_Stack<Dense_Layer<float> > layers("test_layers");
+    layers.add(make_unowned_sp(layer1));
+    layers.add(make_unowned_sp(layer2));
+    layers.add(make_unowned_sp(layer3));
+
+    batch_test<float>(layers, context);
+    batch_test<float>(layers, context, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_three_nonlinear_layers_missing )
+{
+    Thread_Context context;
+    Dense_Layer<double> layer1("test1", 5, 10, TF_TANH, MV_DENSE, context);
+    Dense_Layer<double> layer2("test2", 10, 20, TF_TANH, MV_NONE, context);
+    Dense_Layer<double> layer3("test3", 20, 5, TF_TANH, MV_NONE,  context);
+
+    Layer_Stack<Dense_Layer<double> > layers("test_layers");
+    layers.add(make_unowned_sp(layer1));
+    layers.add(make_unowned_sp(layer2));
+    layers.add(make_unowned_sp(layer3));
+
+    batch_test<double>(layers, context);
+}
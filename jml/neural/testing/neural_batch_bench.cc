@@ -0,0 +1,113 @@
+/* neural_batch_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Training throughput, in examples per second, of a three layer network
+   trained one example at a time and in batches.  The sizes can be changed
+   with the NEURAL_BENCH_EXAMPLES, NEURAL_BENCH_INPUTS and
+   NEURAL_BENCH_HIDDEN environment variables.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+#include "jml/neural/dense_layer.h"
+#include "jml/neural/layer_stack.h"
+#include "jml/neural/discriminative_trainer.h"
+#include "jml/neural/output_encoder.h"
+#include "jml/boosting/thread_context.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include "jml/utils/environment.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+Env_Option<int> numExamples("NEURAL_BENCH_EXAMPLES", 20000);
+Env_Option<int> numInputs("NEURAL_BENCH_INPUTS", 100);
+Env_Option<int> numHidden("NEURAL_BENCH_HIDDEN", 200);
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_batch_training )
+{
+    Thread_Context context;
+
+    int ni = numInputs, nh = numHidden, nx = numExamples;
+
+    Layer_Stack<Dense_Layer<float> > layers("bench");
+    layers.add(new Dense_Layer<float>("layer0", ni, nh, TF_TANH, MV_ZERO,
+                                      context));
+    layers.add(new Dense_Layer<float>("layer1", nh, nh, TF_TANH, MV_NONE,
+                                      context));
+    layers.add(new Dense_Layer<float>("layer2", nh, 1, TF_TANH, MV_NONE,
+                                      context));
+
+    Output_Encoder encoder;
+    encoder.configure(Feature_Info(BOOLEAN, false, true), layers);
+
+    vector<distribution<float> > data(nx, distribution<float>(ni));
+    vector<const float *> data_ptrs(nx);
+    vector<Label> labels(nx);
+    vector<float> weights;
+    vector<int> examples(nx);
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned i = 0;  i < ni;  ++i)
+            data[x][i] = 0.5 - context.random01();
+        labels[x] = data[x][0] + data[x][1] > 0.0;
+        data_ptrs[x] = &data[x][0];
+        examples[x] = x;
+    }
+
+    Discriminative_Trainer trainer;
+    trainer.layer = &layers;
+
+    Parameters_Copy<double> updates(layers, 0.0);
+
+    cerr << ML::format("%-20s %12s %10s", "", "examples/s", "speedup")
+         << endl;
+
+    Timer timer;
+    for (unsigned x = 0;  x < nx;  ++x)
+        trainer.train_example(data_ptrs[x], labels[x], updates, encoder);
+    double single_rate = nx / timer.elapsed_wall();
+
+    cerr << ML::format("%-20s %12.0f %9.2fx", "one at a time",
+                       single_rate, 1.0)
+         << endl;
+
+    Parameters_Copy<double> single_updates = updates;
+
+    vector<float> outputs(nx);
+
+    for (int batch_size: { 1, 16, 64, 256, 1024 }) {
+        updates.fill(0.0);
+
+        timer.restart();
+        for (unsigned x = 0;  x < nx;  x += batch_size) {
+            int n = std::min<int>(batch_size, nx - x);
+            trainer.train_batch(data_ptrs, labels, weights, encoder,
+                                &examples[x], n, updates, &outputs[x]);
+        }
+        double rate = nx / timer.elapsed_wall();
+
+        cerr << ML::format("%-20s %12.0f %9.2fx",
+                           ML::format("batches of %d", batch_size).c_str(),
+                           rate, rate / single_rate)
+             << endl;
+
+        // The same gradient either way, to within the rounding
+        double diff = 0.0, total = 0.0;
+        for (unsigned i = 0;  i < updates.values.size();  ++i) {
+            diff += fabs(updates.values[i] - single_updates.values[i]);
+            total += fabs(single_updates.values[i]);
+        }
+        BOOST_CHECK_LT(diff, total * 1e-4);
+    }
+}
@@ -9,4 +9,4 @@ $(eval $(call test,discriminative_trainer_test,neural,boost))
 $(eval $(call test,twoway_layer_test,neural utils arch db worker_task,boost manual))
 $(eval $(call test,perceptron_test,neural utils boosting worker_task,boost manual))
 $(eval $(call test,output_encoder_test,neural,boost))
-
+$(eval $(call test,neural_batch_bench,neural utils arch worker_task boosting,boost manual))
@@ -0,0 +1,104 @@
+/* tsne_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Time taken by the sparse, Barnes-Hut version of t-SNE to embed 100,000
+   clustered points, and by the exact version on a subset of them.  The
+   sizes can be changed with the TSNE_BENCH_POINTS, TSNE_BENCH_DIMS,
+   TSNE_BENCH_ITERATIONS and TSNE_BENCH_EXACT_POINTS environment variables.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+#include "jml/tsne/tsne.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include "jml/utils/environment.h"
+#include "tsne_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+Env_Option<int> numPoints("TSNE_BENCH_POINTS", 100000);
+Env_Option<int> numDims("TSNE_BENCH_DIMS", 50);
+Env_Option<int> numIterations("TSNE_BENCH_ITERATIONS", 1000);
+Env_Option<int> numExactPoints("TSNE_BENCH_EXACT_POINTS", 5000);
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_tsne )
+{
+    cerr << ML::format("%-24s %8s %10s %10s %10s", "", "points",
+                       "probs s", "tsne s", "accuracy")
+         << endl;
+
+    TSNE_Params params;
+    params.max_iter = numIterations;
+
+    vector<int> labels;
+    boost::multi_array<float, 2> X
+        = clustered_points(numPoints, numDims, 20, labels, 0.3);
+
+    Timer timer;
+    TSNE_Sparse_Probs sparse = vectors_to_probabilities_sparse(X);
+    double probsTime = timer.elapsed_wall();
+
+    timer.restart();
+    boost::multi_array<float, 2> Y = tsne(sparse, 2, params);
+    double tsneTime = timer.elapsed_wall();
+
+    double accuracy = neighbour_accuracy(Y, labels);
+
+    cerr << ML::format("%-24s %8d %10.2f %10.2f %10.4f", "Barnes-Hut",
+                       (int)numPoints, probsTime, tsneTime, accuracy)
+         << endl;
+
+    BOOST_CHECK_GT(accuracy, 0.9);
+
+    if (numExactPoints <= 0) return;
+
+    // The exact version is quadratic, so only on a subset
+    int n = std::min<int>(numExactPoints, numPoints);
+    boost::multi_array<float, 2> X_exact(boost::extents[n][numDims]);
+    X_exact = X[boost::indices[boost::multi_array_types::index_range(0, n)]
+                [boost::multi_array_types::index_range()]];
+    vector<int> labels_exact(labels.begin(), labels.begin() + n);
+
+    timer.restart();
+    boost::multi_array<float, 2> distances = vectors_to_distances(X_exact);
+    boost::multi_array<float, 2> dense
+        = distances_to_probabilities(distances, 1e-5, 30.0);
+    probsTime = timer.elapsed_wall();
+
+    timer.restart();
+    boost::multi_array<float, 2> Y_exact = tsne(dense, 2, params);
+    tsneTime = timer.elapsed_wall();
+
+    double exactAccuracy = neighbour_accuracy(Y_exact, labels_exact);
+
+    cerr << ML::format("%-24s %8d %10.2f %10.2f %10.4f", "exact",
+                       n, probsTime, tsneTime, exactAccuracy)
+         << endl;
+
+    timer.restart();
+    sparse = vectors_to_probabilities_sparse(X_exact);
+    probsTime = timer.elapsed_wall();
+
+    timer.restart();
+    boost::multi_array<float, 2> Y_bh = tsne(sparse, 2, params);
+    tsneTime = timer.elapsed_wall();
+
+    accuracy = neighbour_accuracy(Y_bh, labels_exact);
+
+    cerr << ML::format("%-24s %8d %10.2f %10.2f %10.4f", "Barnes-Hut",
+                       n, probsTime, tsneTime, accuracy)
+         << endl;
+
+    BOOST_CHECK_GT(accuracy, exactAccuracy - 0.02);
+}
@@ -0,0 +1,157 @@
+/* tsne_sparse_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the sparse, Barnes-Hut version of t-SNE against the exact one.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <algorithm>
+
+#include "jml/tsne/tsne.h"
+#include "jml/tsne/vantage_point_tree.h"
+#include "tsne_testing.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+struct Distance {
+    Distance(const boost::multi_array<float, 2> & X)
+        : X(X)
+    {
+    }
+
+    float operator () (int i, int j) const
+    {
+        float total = 0.0;
+        for (unsigned k = 0;  k < X.shape()[1];  ++k)
+            total += (X[i][k] - X[j][k]) * (X[i][k] - X[j][k]);
+        return sqrtf(total);
+    }
+
+    const boost::multi_array<float, 2> & X;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_vantage_point_tree )
+{
+    vector<int> labels;
+    boost::multi_array<float, 2> X = clustered_points(2000, 5, 10, labels);
+
+    Distance distance(X);
+    Vantage_Point_Tree<Distance> tree(2000, distance);
+
+    for (unsigned i = 0;  i < 2000;  i += 37) {
+        vector<pair<float, int> > expected;
+        for (unsigned j = 0;  j < 2000;  ++j)
+            if (j != i) expected.push_back(make_pair(distance(i, j), j));
+        std::sort(expected.begin(), expected.end());
+        expected.resize(10);
+
+        vector<pair<float, int> > found = tree.search(i, 10);
+        BOOST_REQUIRE_EQUAL(found.size(), 10);
+        for (unsigned k = 0;  k < 10;  ++k)
+            BOOST_CHECK_EQUAL(found[k].first, expected[k].first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_probabilities_match_dense )
+{
+    vector<int> labels;
+    boost::multi_array<float, 2> X = clustered_points(200, 10, 4, labels);
+
+    boost::multi_array<float, 2> distances = vectors_to_distances(X);
+    boost::multi_array<float, 2> dense
+        = distances_to_probabilities(distances, 1e-5, 20.0);
+
+    // With every point as a neighbour, it's the same thing
+    TSNE_Sparse_Probs sparse
+        = vectors_to_probabilities_sparse(X, 20.0, 199);
+    BOOST_CHECK_EQUAL(sparse.rows(), 200);
+    BOOST_CHECK_EQUAL(sparse.values.size(), 200 * 199);
+
+    boost::multi_array<float, 2> sparse_dense = sparse.to_dense();
+
+    for (unsigned i = 0;  i < 200;  ++i)
+        for (unsigned j = 0;  j < 200;  ++j)
+            BOOST_CHECK_SMALL(sparse_dense[i][j] - dense[i][j], 1e-4f);
+
+    // With fewer, each row still sums to one over its nearest neighbours
+    sparse = vectors_to_probabilities_sparse(X, 20.0);
+    BOOST_CHECK_EQUAL(sparse.values.size(), 200 * 60);
+    for (unsigned i = 0;  i < 200;  ++i) {
+        double total = 0.0;
+        for (unsigned e = sparse.offsets[i];  e < sparse.offsets[i + 1];  ++e) {
+            BOOST_CHECK_NE(sparse.indexes[e], i);
+            total += sparse.values[e];
+        }
+        BOOST_CHECK_CLOSE(total, 1.0, 0.01);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_barnes_hut_theta_zero_is_exact )
+{
+    vector<int> labels;
+    boost::multi_array<float, 2> X = clustered_points(150, 10, 3, labels);
+
+    boost::multi_array<float, 2> distances = vectors_to_distances(X);
+    boost::multi_array<float, 2> dense
+        = distances_to_probabilities(distances, 1e-5, 20.0);
+    TSNE_Sparse_Probs sparse
+        = vectors_to_probabilities_sparse(X, 20.0, 149);
+
+    /* With theta = 0, no cells are summarized so the gradient is the exact
+       one.  The optimization is chaotic enough that rounding differences
+       soon add up, so we only follow the first few steps. */
+    TSNE_Params params;
+    params.max_iter = 3;
+    params.theta = 0.0;
+
+    boost::multi_array<float, 2> Y_exact = tsne(dense, 2, params);
+    boost::multi_array<float, 2> Y_bh = tsne(sparse, 2, params);
+
+    double scale = 0.0, max_diff = 0.0;
+    for (unsigned i = 0;  i < 150;  ++i) {
+        for (unsigned k = 0;  k < 2;  ++k) {
+            scale = std::max<double>(scale, fabs(Y_exact[i][k]));
+            max_diff = std::max<double>(max_diff,
+                                        fabs(Y_exact[i][k] - Y_bh[i][k]));
+        }
+    }
+
+    cerr << "scale " << scale << " max difference " << max_diff << endl;
+    BOOST_CHECK_LT(max_diff, 0.001 * scale);
+}
+
+BOOST_AUTO_TEST_CASE( test_barnes_hut_quality )
+{
+    vector<int> labels;
+    boost::multi_array<float, 2> X = clustered_points(600, 20, 6, labels,
+                                                      0.5);
+
+    boost::multi_array<float, 2> distances = vectors_to_distances(X);
+    boost::multi_array<float, 2> dense
+        = distances_to_probabilities(distances, 1e-5, 30.0);
+    boost::multi_array<float, 2> Y_exact = tsne(dense, 2);
+
+    TSNE_Sparse_Probs sparse = vectors_to_probabilities_sparse(X, 30.0);
+    boost::multi_array<float, 2> Y_bh = tsne(sparse, 2);
+
+    double input_accuracy = neighbour_accuracy(X, labels);
+    double exact_accuracy = neighbour_accuracy(Y_exact, labels);
+    double bh_accuracy = neighbour_accuracy(Y_bh, labels);
+
+    cerr << "nearest neighbour accuracy: input " << input_accuracy
+         << " exact " << exact_accuracy << " Barnes-Hut " << bh_accuracy
+         << endl;
+
+    BOOST_CHECK_GT(exact_accuracy, input_accuracy - 0.05);
+    BOOST_CHECK_GT(bh_accuracy, exact_accuracy - 0.02);
+}
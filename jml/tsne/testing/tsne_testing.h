@@ -0,0 +1,84 @@
+/* tsne_testing.h                                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Clustered datasets to test and benchmark t-SNE with.
+*/
+
+#ifndef __jml__tsne__testing__tsne_testing_h__
+#define __jml__tsne__testing__tsne_testing_h__
+
+
+#include <boost/multi_array.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+
+
+namespace ML {
+
+
+/** numPoints points in numDims dimensions, around numClusters centres
+    that are uniform in [-1, 1) in each dimension.  The cluster of each
+    point is returned in labels.
+*/
+inline boost::multi_array<float, 2>
+clustered_points(int numPoints, int numDims, int numClusters,
+                 std::vector<int> & labels, float spread = 0.1,
+                 int seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.0, 1.0);
+    std::normal_distribution<float> normal(0.0, spread);
+
+    boost::multi_array<float, 2> centres(boost::extents[numClusters][numDims]);
+    for (int c = 0;  c < numClusters;  ++c)
+        for (int k = 0;  k < numDims;  ++k)
+            centres[c][k] = uniform(rng);
+
+    boost::multi_array<float, 2> result(boost::extents[numPoints][numDims]);
+    labels.resize(numPoints);
+
+    for (int i = 0;  i < numPoints;  ++i) {
+        int c = labels[i] = i % numClusters;
+        for (int k = 0;  k < numDims;  ++k)
+            result[i][k] = centres[c][k] + normal(rng);
+    }
+
+    return result;
+}
+
+/** Proportion of the first numTested points whose nearest neighbour in the
+    embedding Y has the same label.
+*/
+inline double
+neighbour_accuracy(const boost::multi_array<float, 2> & Y,
+                   const std::vector<int> & labels,
+                   int numTested = 1000)
+{
+    int n = Y.shape()[0], d = Y.shape()[1];
+    numTested = std::min(numTested, n);
+
+    int correct = 0;
+    for (int i = 0;  i < numTested;  ++i) {
+        float best = INFINITY;
+        int nearest = -1;
+        for (int j = 0;  j < n;  ++j) {
+            if (j == i) continue;
+            float dist = 0.0;
+            for (int k = 0;  k < d;  ++k)
+                dist += (Y[i][k] - Y[j][k]) * (Y[i][k] - Y[j][k]);
+            if (dist < best) {
+                best = dist;
+                nearest = j;
+            }
+        }
+        correct += labels[nearest] == labels[i];
+    }
+
+    return correct * 1.0 / numTested;
+}
+
+} // namespace ML
+
+
+#endif /* __jml__tsne__testing__tsne_testing_h__ */
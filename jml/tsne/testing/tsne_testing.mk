@@ -1,2 +1,4 @@
 $(eval $(call test,tsne_test,tsne utils arch,boost timed manual))
 $(eval $(call python_test,tsne_python_test,tsne,manual))
+$(eval $(call test,tsne_sparse_test,tsne utils arch,boost))
+$(eval $(call test,tsne_bench,tsne utils arch,boost manual))
@@ -26,6 +26,7 @@
 #include "jml/utils/guard.h"
 #include <boost/bind.hpp>
 #include "jml/utils/environment.h"
+#include "vantage_point_tree.h"
 
 using namespace std;
 
@@ -422,6 +423,164 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
     return P;
 }
 
+boost::multi_array<float, 2>
+TSNE_Sparse_Probs::
+to_dense() const
+{
+    int n = rows();
+    boost::multi_array<float, 2> result(boost::extents[n][n]);
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned k = offsets[i];  k < offsets[i + 1];  ++k)
+            result[i][indexes[k]] = values[k];
+    return result;
+}
+
+namespace {
+
+/** Euclidean distance between two rows of X, for the vantage point tree. */
+struct Row_Distance {
+    Row_Distance(const boost::multi_array<float, 2> & X)
+        : X(X), d(X.shape()[1])
+    {
+    }
+
+    float operator () (int i, int j) const
+    {
+        const float * xi = &X[i][0];
+        const float * xj = &X[j][0];
+        float total = 0.0f;
+        for (unsigned k = 0;  k < d;  ++k) {
+            float diff = xi[k] - xj[k];
+            total += diff * diff;
+        }
+        return sqrtf(total);
+    }
+
+    const boost::multi_array<float, 2> & X;
+    int d;
+};
+
+struct Sparse_Probabilities_Job {
+
+    const Vantage_Point_Tree<Row_Distance> & tree;
+    double tolerance;
+    double perplexity;
+    int k;
+    TSNE_Sparse_Probs & P;
+    distribution<float> & beta;
+    int i0;
+    int i1;
+
+    Sparse_Probabilities_Job(const Vantage_Point_Tree<Row_Distance> & tree,
+                             double tolerance,
+                             double perplexity,
+                             int k,
+                             TSNE_Sparse_Probs & P,
+                             distribution<float> & beta,
+                             int i0,
+                             int i1)
+        : tree(tree), tolerance(tolerance), perplexity(perplexity), k(k),
+          P(P), beta(beta), i0(i0), i1(i1)
+    {
+    }
+
+    void operator () ()
+    {
+        for (unsigned i = i0;  i < i1;  ++i) {
+            vector<pair<float, int> > neighbours = tree.search(i, k);
+            if (neighbours.size() != k)
+                throw Exception("wrong number of neighbours");
+
+            /* Probabilities don't change when all of the distances are
+               shifted, but this way the nearest doesn't underflow. */
+            distribution<float> D_row(k);
+            float nearest = neighbours[0].first * neighbours[0].first;
+            for (unsigned j = 0;  j < k;  ++j)
+                D_row[j] = neighbours[j].first * neighbours[j].first - nearest;
+
+            distribution<float> P_row;
+
+            try {
+                boost::tie(P_row, beta[i])
+                    = binary_search_perplexity(D_row, perplexity, -1,
+                                               tolerance);
+            } catch (const std::exception & exc) {
+                P_row = distribution<float>(k, 1.0 / k);
+            }
+
+            for (unsigned j = 0;  j < k;  ++j) {
+                P.indexes[i * k + j] = neighbours[j].second;
+                P.values[i * k + j] = P_row[j];
+            }
+        }
+    }
+};
+
+} // file scope
+
+TSNE_Sparse_Probs
+vectors_to_probabilities_sparse(const boost::multi_array<float, 2> & X,
+                                double perplexity,
+                                int num_neighbours,
+                                double tolerance)
+{
+    int n = X.shape()[0];
+
+    int k = num_neighbours;
+    if (k == -1) k = 3 * perplexity;
+    k = std::min(k, n - 1);
+
+    if (k < 1)
+        throw Exception("vectors_to_probabilities_sparse: need at least "
+                        "one neighbour");
+
+    Timer timer;
+
+    Vantage_Point_Tree<Row_Distance> tree(n, Row_Distance(X));
+
+    cerr << "built vantage point tree: " << timer.elapsed() << endl;
+    timer.restart();
+
+    TSNE_Sparse_Probs P;
+    P.offsets.resize(n + 1);
+    for (unsigned i = 0;  i <= n;  ++i)
+        P.offsets[i] = i * k;
+    P.indexes.resize(n * k);
+    P.values.resize(n * k);
+
+    distribution<float> beta(n, 1.0);
+
+    Worker_Task & worker = Worker_Task::instance(num_threads() - 1);
+
+    int group;
+    {
+        int parent = -1;  // no parent group
+        group = worker.get_group(NO_JOB, "", parent);
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+        
+        int chunk_size = 64;
+        
+        for (int i = 0;  i < n;  i += chunk_size) {
+            int i0 = i;
+            int i1 = min(n, i + chunk_size);
+            
+            worker.add(Sparse_Probabilities_Job
+                       (tree, tolerance, perplexity, k, P, beta, i0, i1),
+                       "", group);
+        }
+    }
+
+    worker.run_until_finished(group);
+
+    cerr << "calculated probabilities over " << k << " neighbours: "
+         << timer.elapsed() << endl;
+    cerr << "mean sigma is " << sqrt(1.0 / beta).mean() << endl;
+
+    return P;
+}
+
 boost::multi_array<float, 2>
 pca(boost::multi_array<float, 2> & coords, int num_dims)
 {
@@ -1173,4 +1332,449 @@ tsne(const boost::multi_array<float, 2> & probs,
     return Y;
 }
 
+
+/*****************************************************************************/
+/* BARNES-HUT T-SNE                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/** Space partitioning tree over the points of Y, where each node splits its
+    box in two along each of the d dimensions.  Each node knows the centre
+    of mass of its points, so that far enough away they can be treated as
+    a single point.  The points of a leaf are a range of the points array.
+*/
+struct BH_Tree {
+
+    BH_Tree(const boost::multi_array<float, 2> & Y)
+        : Y(Y), n(Y.shape()[0]), d(Y.shape()[1]), nchildren(1 << d)
+    {
+        if (d > 8)
+            throw Exception("Barnes-Hut t-SNE needs few dimensions");
+
+        points.resize(n);
+        for (unsigned i = 0;  i < n;  ++i)
+            points[i] = i;
+        codes.resize(n);
+        scratch.resize(n);
+
+        float centre[d], half[d];
+        for (unsigned k = 0;  k < d;  ++k) {
+            float mn = INFINITY, mx = -INFINITY;
+            for (unsigned i = 0;  i < n;  ++i) {
+                mn = std::min(mn, Y[i][k]);
+                mx = std::max(mx, Y[i][k]);
+            }
+            centre[k] = 0.5f * (mn + mx);
+            half[k] = 0.5f * (mx - mn) + 1e-5f;
+        }
+
+        nodes.reserve(2 * n);
+        nodes.resize(1);
+        build(0, 0, n, centre, half, 0);
+    }
+
+    struct Node {
+        int begin, end;     ///< Range of points
+        int first_child;    ///< -1 for a leaf
+        float diag_sqr;     ///< Square of the diagonal of the box
+    };
+
+    const boost::multi_array<float, 2> & Y;
+    int n, d, nchildren;
+    std::vector<Node> nodes;
+    std::vector<float> centres_of_mass;  // d per node
+    std::vector<int> points;
+    std::vector<int> codes, scratch;
+
+    void build(int node, int begin, int end,
+               const float * centre, const float * half, int depth)
+    {
+        nodes[node].begin = begin;
+        nodes[node].end = end;
+        nodes[node].first_child = -1;
+
+        float diag_sqr = 0.0f;
+        for (unsigned k = 0;  k < d;  ++k)
+            diag_sqr += 4.0f * half[k] * half[k];
+        nodes[node].diag_sqr = diag_sqr;
+
+        centres_of_mass.resize(nodes.size() * d);
+        float * com = &centres_of_mass[node * d];
+        std::fill(com, com + d, 0.0f);
+        for (unsigned p = begin;  p < end;  ++p)
+            for (unsigned k = 0;  k < d;  ++k)
+                com[k] += Y[points[p]][k];
+        if (end > begin)
+            for (unsigned k = 0;  k < d;  ++k)
+                com[k] /= (end - begin);
+
+        // Duplicate points would otherwise split forever
+        if (end - begin <= 1 || depth >= 32) return;
+
+        // Counting sort of the points into the children
+        int counts[nchildren + 1];
+        std::fill(counts, counts + nchildren + 1, 0);
+        for (unsigned p = begin;  p < end;  ++p) {
+            int code = 0;
+            for (unsigned k = 0;  k < d;  ++k)
+                code |= (Y[points[p]][k] > centre[k]) << k;
+            codes[p] = code;
+            ++counts[code + 1];
+        }
+        for (unsigned c = 0;  c < nchildren;  ++c)
+            counts[c + 1] += counts[c];
+
+        int pos[nchildren];
+        std::copy(counts, counts + nchildren, pos);
+        for (unsigned p = begin;  p < end;  ++p)
+            scratch[begin + pos[codes[p]]++] = points[p];
+        std::copy(scratch.begin() + begin, scratch.begin() + end,
+                  points.begin() + begin);
+
+        int first_child = nodes.size();
+        nodes[node].first_child = first_child;
+        nodes.resize(first_child + nchildren);
+
+        for (unsigned c = 0;  c < nchildren;  ++c) {
+            float child_centre[d], child_half[d];
+            for (unsigned k = 0;  k < d;  ++k) {
+                child_half[k] = 0.5f * half[k];
+                child_centre[k] = centre[k]
+                    + ((c >> k) & 1 ? child_half[k] : -child_half[k]);
+            }
+            build(first_child + c, begin + counts[c], begin + counts[c + 1],
+                  child_centre, child_half, depth + 1);
+        }
+    }
+
+    /** Add the unnormalized repulsive force on point i of the points of the
+        given node to neg, and the sum of their q_ij to sum_q.
+    */
+    void repulsion(int node, int i, const float * yi, float theta_sqr,
+                   double & sum_q, double * neg) const
+    {
+        const Node & nd = nodes[node];
+        if (nd.begin == nd.end) return;
+
+        if (nd.first_child == -1) {
+            for (unsigned p = nd.begin;  p < nd.end;  ++p) {
+                int j = points[p];
+                if (j == i) continue;
+                float diff[d], dist_sqr = 0.0f;
+                for (unsigned k = 0;  k < d;  ++k) {
+                    diff[k] = yi[k] - Y[j][k];
+                    dist_sqr += diff[k] * diff[k];
+                }
+                double q = 1.0 / (1.0 + dist_sqr);
+                sum_q += q;
+                for (unsigned k = 0;  k < d;  ++k)
+                    neg[k] += q * q * diff[k];
+            }
+            return;
+        }
+
+        const float * com = &centres_of_mass[node * d];
+        float diff[d], dist_sqr = 0.0f;
+        for (unsigned k = 0;  k < d;  ++k) {
+            diff[k] = yi[k] - com[k];
+            dist_sqr += diff[k] * diff[k];
+        }
+
+        /* As the diagonal is at least as long as the distance from any
+           point inside to the centre of mass, a point is never summarized
+           with its own cell while theta < 1. */
+        if (nd.diag_sqr < theta_sqr * dist_sqr) {
+            double m = nd.end - nd.begin;
+            double q = 1.0 / (1.0 + dist_sqr);
+            sum_q += m * q;
+            for (unsigned k = 0;  k < d;  ++k)
+                neg[k] += m * q * q * diff[k];
+            return;
+        }
+
+        for (unsigned c = 0;  c < nchildren;  ++c)
+            repulsion(nd.first_child + c, i, yi, theta_sqr, sum_q, neg);
+    }
+};
+
+struct BH_Gradient_Job {
+    const BH_Tree & tree;
+    const TSNE_Sparse_Probs & P;
+    float pfactor;
+    const boost::multi_array<float, 2> & Y;
+    boost::multi_array<float, 2> & pos;
+    boost::multi_array<float, 2> & neg;
+    double * sum_q;
+    float theta;
+    int i0, i1;
+
+    BH_Gradient_Job(const BH_Tree & tree,
+                    const TSNE_Sparse_Probs & P,
+                    float pfactor,
+                    const boost::multi_array<float, 2> & Y,
+                    boost::multi_array<float, 2> & pos,
+                    boost::multi_array<float, 2> & neg,
+                    double * sum_q,
+                    float theta,
+                    int i0, int i1)
+        : tree(tree), P(P), pfactor(pfactor), Y(Y), pos(pos), neg(neg),
+          sum_q(sum_q), theta(theta), i0(i0), i1(i1)
+    {
+    }
+
+    void operator () ()
+    {
+        int d = Y.shape()[1];
+
+        for (unsigned i = i0;  i < i1;  ++i) {
+            const float * yi = &Y[i][0];
+
+            // Attraction to the neighbours: sum_j p_ij q_ij Z (y_i - y_j)
+            double attr[d];
+            std::fill(attr, attr + d, 0.0);
+
+            for (unsigned e = P.offsets[i];  e < P.offsets[i + 1];  ++e) {
+                int j = P.indexes[e];
+                float diff[d], dist_sqr = 0.0f;
+                for (unsigned k = 0;  k < d;  ++k) {
+                    diff[k] = yi[k] - Y[j][k];
+                    dist_sqr += diff[k] * diff[k];
+                }
+                double pq = pfactor * P.values[e] / (1.0 + dist_sqr);
+                for (unsigned k = 0;  k < d;  ++k)
+                    attr[k] += pq * diff[k];
+            }
+
+            // Repulsion from everything: sum_j q_ij^2 Z^2 (y_i - y_j)
+            double rep[d];
+            std::fill(rep, rep + d, 0.0);
+            double q = 0.0;
+            tree.repulsion(0, i, yi, theta * theta, q, rep);
+
+            for (unsigned k = 0;  k < d;  ++k) {
+                pos[i][k] = attr[k];
+                neg[i][k] = rep[k];
+            }
+            sum_q[i] = q;
+        }
+    }
+};
+
+/** Turn the conditional probabilities into joint ones: P + P', with
+    sorted rows.
+*/
+TSNE_Sparse_Probs symmetrize(const TSNE_Sparse_Probs & probs)
+{
+    int n = probs.rows();
+
+    vector<int> counts(n + 1);
+    for (unsigned i = 0;  i < n;  ++i) {
+        for (unsigned e = probs.offsets[i];  e < probs.offsets[i + 1];  ++e) {
+            ++counts[i + 1];
+            ++counts[probs.indexes[e] + 1];
+        }
+    }
+    for (unsigned i = 0;  i < n;  ++i)
+        counts[i + 1] += counts[i];
+
+    vector<pair<int, float> > entries(counts[n]);
+    vector<int> pos(counts.begin(), counts.end() - 1);
+    for (unsigned i = 0;  i < n;  ++i) {
+        for (unsigned e = probs.offsets[i];  e < probs.offsets[i + 1];  ++e) {
+            int j = probs.indexes[e];
+            if (j == i) continue;
+            entries[pos[i]++] = make_pair(j, probs.values[e]);
+            entries[pos[j]++] = make_pair((int)i, probs.values[e]);
+        }
+    }
+
+    TSNE_Sparse_Probs result;
+    result.offsets.resize(n + 1);
+    result.indexes.reserve(entries.size());
+    result.values.reserve(entries.size());
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        result.offsets[i] = result.indexes.size();
+
+        auto first = entries.begin() + counts[i];
+        auto last = entries.begin() + pos[i];
+        std::sort(first, last);
+
+        for (auto it = first;  it != last;  ++it) {
+            if (result.indexes.size() > result.offsets[i]
+                && result.indexes.back() == it->first)
+                result.values.back() += it->second;
+            else {
+                result.indexes.push_back(it->first);
+                result.values.push_back(it->second);
+            }
+        }
+    }
+    result.offsets[n] = result.indexes.size();
+
+    return result;
+}
+
+} // file scope
+
+boost::multi_array<float, 2>
+tsne(const TSNE_Sparse_Probs & probs,
+     int num_dims,
+     const TSNE_Params & params,
+     const TSNE_Callback & callback)
+{
+    int n = probs.rows();
+    int d = num_dims;
+
+    if (probs.offsets.size() != n + 1
+        || probs.offsets[n] != probs.indexes.size()
+        || probs.indexes.size() != probs.values.size())
+        throw Exception("sparse probabilities are inconsistent");
+
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> Y(boost::extents[n][d]);
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned j = 0;  j < d;  ++j)
+            Y[i][j] = 0.01 * randn();
+
+    // Symmetrize and probabilize P
+    TSNE_Sparse_Probs P = symmetrize(probs);
+
+    double sumP = SIMD::vec_sum_dp(&P.values[0], P.values.size());
+
+    // As for the dense version, boosted by 4 in the early iterations
+    float pfactor = 4.0 / sumP;
+
+    Timer timer;
+
+    boost::multi_array<float, 2> dY(boost::extents[n][d]);
+    boost::multi_array<float, 2> iY(boost::extents[n][d]);
+    boost::multi_array<float, 2> gains(boost::extents[n][d]);
+    std::fill(gains.data(), gains.data() + gains.num_elements(), 1.0f);
+
+    // Attractive and repulsive parts of the gradient, and sums of q
+    boost::multi_array<float, 2> pos(boost::extents[n][d]);
+    boost::multi_array<float, 2> neg(boost::extents[n][d]);
+    distribution<double> sum_q(n);
+
+    Worker_Task & worker = Worker_Task::instance(num_threads() - 1);
+
+    if (callback
+        && !callback(-1, INFINITY, "init")) return Y;
+
+    for (int iter = 0;  iter < params.max_iter;  ++iter) {
+
+        boost::timer t;
+
+        /*********************************************************************/
+        // Gradient
+        // dC/dy_i = 4 * (sum_j p_ij q_ij Z (y_i - y_j)
+        //                - sum_j q_ij^2 Z^2 (y_i - y_j) / Z)
+        // where Z q_ij = 1 / (1 + ||y_i - y_j||^2)
+
+        BH_Tree tree(Y);
+
+        int group;
+        {
+            int parent = -1;  // no parent group
+            group = worker.get_group(NO_JOB, "", parent);
+            Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                         boost::ref(worker),
+                                         group));
+        
+            int chunk_size = 256;
+        
+            for (int i = 0;  i < n;  i += chunk_size) {
+                int i0 = i;
+                int i1 = min(n, i + chunk_size);
+            
+                worker.add(BH_Gradient_Job(tree, P, pfactor, Y, pos, neg,
+                                           &sum_q[0], params.theta,
+                                           i0, i1),
+                           "", group);
+            }
+        }
+
+        worker.run_until_finished(group);
+
+        double Z = sum_q.total();
+
+        for (unsigned i = 0;  i < n;  ++i)
+            for (unsigned k = 0;  k < d;  ++k)
+                dY[i][k] = 4.0 * (pos[i][k] - neg[i][k] / Z);
+
+        t_dY += t.elapsed();  t.restart();
+
+        if (callback
+            && !callback(iter, INFINITY, "gradient")) return Y;
+
+        // The cost is only over the non-zero P values, so cheap enough
+        bool calc_cost = (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
+        double cost = 0.0;
+        if (calc_cost) {
+            for (unsigned i = 0;  i < n;  ++i) {
+                for (unsigned e = P.offsets[i];  e < P.offsets[i + 1];  ++e) {
+                    int j = P.indexes[e];
+                    double dist_sqr = 0.0;
+                    for (unsigned k = 0;  k < d;  ++k)
+                        dist_sqr += (Y[i][k] - Y[j][k]) * (Y[i][k] - Y[j][k]);
+                    double p = pfactor * P.values[e];
+                    double q = std::max<double>(params.min_prob,
+                                                1.0 / ((1.0 + dist_sqr) * Z));
+                    cost += p * log(p / q);
+                }
+            }
+        }
+
+        t_cost += t.elapsed();  t.restart();
+
+
+        /*********************************************************************/
+        // Update
+
+        float momentum = (iter < 20
+                          ? params.initial_momentum
+                          : params.final_momentum);
+
+        tsne_update(Y, dY, iY, gains, iter == 0, momentum, params.eta,
+                    params.min_gain);
+
+        if (callback
+            && !callback(iter, INFINITY, "update")) return Y;
+
+        t_update += t.elapsed();  t.restart();
+
+
+        /*********************************************************************/
+        // Recenter about the origin
+
+        recenter_about_origin(Y);
+
+        if (callback
+            && !callback(iter, INFINITY, "recenter")) return Y;
+
+        t_recenter += t.elapsed();  t.restart();
+
+        if (calc_cost) {
+            cerr << format("iteration %4d cost %6.3f  ",
+                           iter + 1, cost)
+                 << timer.elapsed() << endl;
+            timer.restart();
+        }
+
+        // Stop lying about P values if we're finished
+        if (iter == 100)
+            pfactor *= 0.25f;
+    }
+
+    return Y;
+}
+
 } // namespace ML
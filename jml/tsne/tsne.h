@@ -18,6 +18,7 @@
 #include "jml/stats/distribution.h"
 #include <boost/multi_array.hpp>
 #include <boost/function.hpp>
+#include <vector>
 
 namespace ML {
 
@@ -83,6 +84,34 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
                            double tolerance = 1e-5,
                            double perplexity = 30.0);
 
+/** A sparse matrix of probabilities, in compressed row format.  The
+    entries of row i are in positions offsets[i] to offsets[i + 1] - 1 of
+    indexes (which gives their column) and values.
+*/
+struct TSNE_Sparse_Probs {
+    std::vector<int> offsets;
+    std::vector<int> indexes;
+    std::vector<float> values;
+
+    int rows() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    /** Dense version, for testing. */
+    boost::multi_array<float, 2> to_dense() const;
+};
+
+/** Sparse version of vectors_to_distances followed by
+    distances_to_probabilities, for when there are too many points to
+    build a (n x n) matrix.  Only the num_neighbours nearest neighbours of
+    each point (found with a vantage point tree over X) get a non-zero
+    probability, which is calibrated to the given perplexity over those
+    neighbours only.  If num_neighbours is -1, it's 3 * perplexity.
+*/
+TSNE_Sparse_Probs
+vectors_to_probabilities_sparse(const boost::multi_array<float, 2> & X,
+                                double perplexity = 30.0,
+                                int num_neighbours = -1,
+                                double tolerance = 1e-5);
+
 /** Perform a principal component analysis.  This routine will reduce a
     (n x d) matrix to a (n x e) matrix, where e < d (and is possibly far less).
     The num_dims parameter gives the preferred value of e; it is possible that
@@ -100,7 +129,8 @@ struct TSNE_Params {
           final_momentum(0.8),
           eta(500),
           min_gain(0.01),
-          min_prob(1e-12)
+          min_prob(1e-12),
+          theta(0.5)
     {
     }
 
@@ -110,6 +140,9 @@ struct TSNE_Params {
     double eta;
     double min_gain;
     double min_prob;
+
+    /// Barnes-Hut accuracy for the sparse version; 0 is exact and slow
+    double theta;
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -129,6 +162,21 @@ tsne(const boost::multi_array<float, 2> & probs,
      const TSNE_Params & params = TSNE_Params(),
      const TSNE_Callback & callback = TSNE_Callback());
 
+/** Barnes-Hut version of t-SNE over sparse probabilities, which takes
+    O(n log n) time and O(n) memory per iteration rather than O(n^2).  The
+    repulsive forces between points are approximated by those of the
+    cells of a space partitioning tree that are small enough when seen
+    from the point, as decided by params.theta.
+
+    L.J.P. van der Maaten.  Accelerating t-SNE using Tree-Based Algorithms.
+    Journal of Machine Learning Research 15(Oct):3221-3245, 2014.
+*/
+boost::multi_array<float, 2>
+tsne(const TSNE_Sparse_Probs & probs,
+     int num_dims = 2,
+     const TSNE_Params & params = TSNE_Params(),
+     const TSNE_Callback & callback = TSNE_Callback());
+
 
 } // namespace ML
 
@@ -0,0 +1,164 @@
+/* vantage_point_tree.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Vantage point tree, for nearest neighbour queries in a metric space.
+
+   Yianilos, P.  Data structures and algorithms for nearest neighbor search
+   in general metric spaces.  SODA 1993.
+*/
+
+#ifndef __jml__tsne__vantage_point_tree_h__
+#define __jml__tsne__vantage_point_tree_h__
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* VANTAGE_POINT_TREE                                                        */
+/*****************************************************************************/
+
+/** A vantage point tree over the items 0 to n - 1.  Distance is a function
+    object where distance(i, j) gives the distance between items i and j; it
+    must be a metric (in particular, it must obey the triangle inequality),
+    so for euclidean spaces it's the distance and not its square.
+
+    Each node has a vantage point, and splits the other items of its
+    subtree into those closer to it than the median distance and those
+    further away.  The nodes are kept in a single array.
+*/
+
+template<class Distance>
+struct Vantage_Point_Tree {
+
+    Vantage_Point_Tree(int n, const Distance & distance, int seed = 1)
+        : distance(distance)
+    {
+        std::vector<int> items(n);
+        for (int i = 0;  i < n;  ++i)
+            items[i] = i;
+
+        boost::mt19937 rng(seed);
+        nodes.reserve(n);
+        root = build(items, 0, n, rng);
+    }
+
+    /** Return the k nearest neighbours of item i, not counting i itself,
+        as (distance, item) pairs in order of increasing distance.
+    */
+    std::vector<std::pair<float, int> >
+    search(int i, int k) const
+    {
+        Heap heap;
+        float tau = INFINITY;
+        if (k > 0)
+            search(root, i, k, heap, tau);
+
+        std::vector<std::pair<float, int> > result(heap.size());
+        for (int j = heap.size() - 1;  j >= 0;  --j) {
+            result[j] = heap.top();
+            heap.pop();
+        }
+        return result;
+    }
+
+private:
+    struct Node {
+        int item;         ///< The vantage point
+        float threshold;  ///< Median distance of the others to the item
+        int inside;       ///< Subtree of items closer than threshold
+        int outside;      ///< Subtree of the others
+    };
+
+    // Max heap on the distance of the k best so far
+    typedef std::priority_queue<std::pair<float, int> > Heap;
+
+    Distance distance;
+    std::vector<Node> nodes;
+    int root;
+
+    int build(std::vector<int> & items, int begin, int end,
+              boost::mt19937 & rng)
+    {
+        if (begin == end) return -1;
+
+        // A random vantage point is as good as any, and cheaper
+        boost::random::uniform_int_distribution<int> pick(begin, end - 1);
+        std::swap(items[begin], items[pick(rng)]);
+
+        Node node;
+        node.item = items[begin];
+        node.threshold = 0.0;
+        node.inside = node.outside = -1;
+
+        int result = nodes.size();
+        nodes.push_back(node);
+
+        if (end - begin == 1) return result;
+
+        int median = (begin + 1 + end) / 2;
+
+        auto closer = [&] (int i1, int i2)
+            {
+                return distance(node.item, i1) < distance(node.item, i2);
+            };
+
+        std::nth_element(items.begin() + begin + 1, items.begin() + median,
+                         items.begin() + end, closer);
+
+        float threshold = distance(node.item, items[median]);
+
+        // The recursion moves the vector of nodes, so no references
+        int inside = build(items, begin + 1, median, rng);
+        int outside = build(items, median, end, rng);
+
+        nodes[result].threshold = threshold;
+        nodes[result].inside = inside;
+        nodes[result].outside = outside;
+
+        return result;
+    }
+
+    void search(int n, int i, int k, Heap & heap, float & tau) const
+    {
+        if (n == -1) return;
+
+        const Node & node = nodes[n];
+        float dist = distance(node.item, i);
+
+        if (node.item != i && dist < tau) {
+            if (heap.size() == k) heap.pop();
+            heap.push(std::make_pair(dist, node.item));
+            if (heap.size() == k) tau = heap.top().first;
+        }
+
+        if (node.inside == -1 && node.outside == -1) return;
+
+        // Look first on the side that i is on; the other side only needs
+        // looking at if a neighbour could be over there
+        if (dist < node.threshold) {
+            if (dist - tau <= node.threshold)
+                search(node.inside, i, k, heap, tau);
+            if (dist + tau >= node.threshold)
+                search(node.outside, i, k, heap, tau);
+        }
+        else {
+            if (dist + tau >= node.threshold)
+                search(node.outside, i, k, heap, tau);
+            if (dist - tau <= node.threshold)
+                search(node.inside, i, k, heap, tau);
+        }
+    }
+};
+
+} // namespace ML
+
+
+#endif /* __jml__tsne__vantage_point_tree_h__ */
@@ -17,6 +17,7 @@
 #include "jml/utils/exc_assert.h"
 
 #include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/operations.hpp>
 #include <ios>
 #include <vector>
 #include <cstring>
@@ -338,6 +339,7 @@ private:
         pos = 0;
 
         if (notCompressed) {
+            buffer.resize(compressedSize);
             std::memcpy(buffer.data(), compressed, compressedSize);
             toRead = compressedSize;
         }
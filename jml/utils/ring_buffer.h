@@ -3,15 +3,20 @@
    Copyright (c) 2012 Datacratic.  All rights reserved.
 
    Ring buffer for when there are one or more producers and one consumer
-   chasing each other.
+   chasing each other.  The multiple writer version is lock free.
 */
 
 #ifndef __jml_utils__ring_buffer_h__
 #define __jml_utils__ring_buffer_h__
 
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
 #include "jml/arch/futex.h"
 #include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
 #include <mutex>
 #include <thread>
 
@@ -227,17 +232,29 @@ struct RingBufferSWMR : public RingBufferBase<Request> {
 /* RING BUFFER SINGLE READER MULTIPLE WRITERS                                */
 /*****************************************************************************/
 
+/** Lock-free bounded ring buffer with multiple writers and a single reader.
+
+    This is Dmitry Vyukov's bounded queue: each slot carries a sequence
+    number that says whether it is free for the writer of a given lap or
+    holds a value that the reader can take.  Writers only contend on a
+    compare-and-swap of the write position; the reader never executes an
+    atomic read-modify-write at all.
+
+    The capacity is rounded up to a power of two.  The blocking operations
+    park on a futex, but each side announces that it is going to sleep
+    before doing so and the other side only makes the wake system call
+    when somebody is actually waiting.  This means that the non-blocking
+    fast paths never enter the kernel.
+
+    Only one thread may be reading at a time; the move constructor and
+    move assignment are not thread safe.
+*/
 template<typename Request>
-struct RingBufferSRMW : public RingBufferBase<Request> {
-    using RingBufferBase<Request>::init;
-    using RingBufferBase<Request>::ring;
-    using RingBufferBase<Request>::bufferSize;
-    using RingBufferBase<Request>::readPosition;
-    using RingBufferBase<Request>::writePosition;
+struct RingBufferSRMW {
 
     RingBufferSRMW(size_t size)
-        : RingBufferBase<Request>(size)
     {
+        init(size);
     }
 
     RingBufferSRMW(const RingBufferSRMW & other) = delete;
@@ -245,154 +262,245 @@ struct RingBufferSRMW : public RingBufferBase<Request> {
 
     RingBufferSRMW(RingBufferSRMW && other)
         noexcept
-        : RingBufferBase<Request>(std::move(other))
     {
+        *this = std::move(other);
     }
 
     RingBufferSRMW & operator = (RingBufferSRMW && other)
         noexcept
     {
-        Guard guard(other.mutex);
-
-        RingBufferBase<Request>::operator = (std::move(other));
+        cells = std::move(other.cells);
+        mask = other.mask;
+        other.mask = 0;
+        writePosition.store(other.writePosition.load());
+        other.writePosition.store(0);
+        readPosition.store(other.readPosition.load());
+        other.readPosition.store(0);
+        pushEpoch = pushWaiting = popEpoch = popWaiting = 0;
 
         return *this;
     }
 
-    typedef ML::Spinlock Mutex;
-    mutable Mutex mutex; // todo: get rid of...
-    typedef std::unique_lock<Mutex> Guard;
-    
+    void init(size_t numEntries)
+    {
+        size_t numCells = 2;
+        while (numCells < numEntries)
+            numCells *= 2;
+
+        cells.reset(new Cell[numCells]);
+        for (unsigned i = 0;  i < numCells;  ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        mask = numCells - 1;
+
+        writePosition.store(0);
+        readPosition.store(0);
+        pushEpoch = pushWaiting = popEpoch = popWaiting = 0;
+    }
+
+    /** Number of entries that the buffer can hold at once. */
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
     void push(const Request & request)
     {
-        Guard guard(mutex);
+        while (!tryPush(request))
+            waitUntilNotFull();
+    }
 
-        for (;;) {
-            // What position would the read position be in if the buffer was
-            // full?  
-            unsigned fullReadPosition = (writePosition + 1) % bufferSize;
-            if (readPosition == fullReadPosition)
-                ML::futex_wait(readPosition, fullReadPosition);
-            else break;
-        }
-                       
-        //ring[writePosition] = request;
-        ring[writePosition] = request;
-        writePosition = (writePosition + 1) % bufferSize;
-        ML::futex_wake(writePosition);
+    void push(Request && request)
+    {
+        while (!tryPush(std::move(request)))
+            waitUntilNotFull();
     }
 
     bool tryPush(const Request & request)
     {
-        Guard guard(mutex);
+        return tryPushImpl(request);
+    }
 
-        // What position would the read position be in if the buffer was
-        // full?  
-        unsigned fullReadPosition = (writePosition + 1) % bufferSize;
-        if (readPosition == fullReadPosition)
-            return false;
+    /** Note that the request is only moved from if the push succeeds. */
+    bool tryPush(Request && request)
+    {
+        return tryPushImpl(std::move(request));
+    }
 
-        //ring[writePosition] = request;
-        ring[writePosition] = request;
-        writePosition = (writePosition + 1) % bufferSize;
-        ML::futex_wake(writePosition);
+    Request pop()
+    {
+        Request result;
+        while (!tryPop(result, 1.0)) ;
+        return result;
+    }
 
+    bool tryPop(Request & result)
+    {
+        if (!tryPopOne(result))
+            return false;
+        wakeWriters();
         return true;
     }
 
-    bool tryPush(Request && request)
+    bool tryPop(Request & result, double maxWaitTime)
     {
-        Guard guard(mutex);
+        if (tryPop(result))
+            return true;
 
-        // What position would the read position be in if the buffer was
-        // full?
-        unsigned fullReadPosition = (writePosition + 1) % bufferSize;
-        if (readPosition == fullReadPosition)
-            return false;
+        auto deadline = std::chrono::steady_clock::now()
+            + std::chrono::microseconds(uint64_t(maxWaitTime * 1000000));
 
-        //ring[writePosition] = request;
-        ring[writePosition] = std::move(request);
-        writePosition = (writePosition + 1) % bufferSize;
-        ML::futex_wake(writePosition);
+        for (;;) {
+            int epoch = __atomic_load_n(&pushEpoch, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&popWaiting, 1, __ATOMIC_SEQ_CST);
+
+            // Check again now that the writers can see we're waiting, or
+            // we could miss the wakeup from a push that just finished
+            if (couldPop()) {
+                __atomic_store_n(&popWaiting, 0, __ATOMIC_SEQ_CST);
+                return tryPop(result);
+            }
 
-        return true;
+            double remaining
+                = std::chrono::duration<double>
+                (deadline - std::chrono::steady_clock::now()).count();
+            if (remaining > 0.0)
+                ML::futex_wait(pushEpoch, epoch, remaining);
+            __atomic_store_n(&popWaiting, 0, __ATOMIC_SEQ_CST);
+
+            if (tryPop(result))
+                return true;
+            if (remaining <= 0.0)
+                return false;
+        }
     }
 
-    Request pop()
+    /** Pop up to maxRequests entries into the given output iterator,
+        returning how many were popped.  The writers are woken at most
+        once for the whole batch.
+    */
+    template<typename OutputIterator>
+    size_t tryPopMany(OutputIterator out, size_t maxRequests)
     {
-        Request result;
+        size_t n = 0;
+        Request request;
+        for (;  n < maxRequests && tryPopOne(request);  ++n)
+            *out++ = std::move(request);
 
-        {
-            // Wait until write position != read position, ie not full
-            for (;;) {
-                if (writePosition == readPosition)
-                    ML::futex_wait(writePosition, readPosition);
-                else break;
-            }
+        if (n > 0)
+            wakeWriters();
 
-            result = ring[readPosition];
-            ring[readPosition] = Request();
-            readPosition = (readPosition + 1) % bufferSize;
-        }
-        ML::futex_wake(readPosition);
+        return n;
+    }
 
+    std::vector<Request> tryPopMulti(size_t nbrRequests)
+    {
+        std::vector<Request> result;
+        tryPopMany(std::back_inserter(result), nbrRequests);
         return result;
     }
 
-    bool tryPop(Request & result)
+    /** Is there an entry that could be popped?  This can only ever go from
+        true to false under the reader thread, so it's only exact when
+        called from the reader.
+    */
+    bool couldPop() const
     {
-        if (writePosition == readPosition)
-            return false;
+        unsigned pos = readPosition.load(std::memory_order_relaxed);
+        const Cell & cell = cells[pos & mask];
+        return cell.sequence.load(std::memory_order_seq_cst) == pos + 1;
+    }
 
-        result = ring[readPosition];
-        ring[readPosition] = Request();
-        readPosition = (readPosition + 1) % bufferSize;
-        ML::futex_wake(readPosition);
-        
-        return true;
+    /** Would a push at this instant succeed? */
+    bool couldPush() const
+    {
+        unsigned pos = writePosition.load(std::memory_order_relaxed);
+        const Cell & cell = cells[pos & mask];
+        return int(cell.sequence.load(std::memory_order_seq_cst) - pos) >= 0;
     }
 
-    bool tryPop(Request & result, double maxWaitTime)
+private:
+    struct Cell {
+        std::atomic<unsigned> sequence;
+        Request value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    unsigned mask;
+
+    // Each position gets its own cache line so that the writers hammering
+    // on writePosition don't evict the reader's state.
+    alignas(64) std::atomic<unsigned> writePosition;
+    alignas(64) std::atomic<unsigned> readPosition;
+
+    // Futex words (which must be plain ints) used to park the reader when
+    // the ring is empty and the writers when it's full.  The epoch is only
+    // bumped, and the wake only made, when the waiting flag is set.
+    alignas(64) int pushEpoch;
+    int popWaiting;
+    alignas(64) int popEpoch;
+    int pushWaiting;
+
+    template<typename R>
+    bool tryPushImpl(R && request)
     {
-        {
-            // Wait until write position != read position, ie not full
-            for (;;) {
-                if (writePosition == readPosition) {
-                    if (ML::futex_wait(writePosition, readPosition, maxWaitTime) == -1
-                        && errno == ETIMEDOUT)
-                        return false;
-                }
-                else break;
+        unsigned pos = writePosition.load(std::memory_order_relaxed);
+        Cell * cell;
+
+        for (;;) {
+            cell = &cells[pos & mask];
+            unsigned seq = cell->sequence.load(std::memory_order_acquire);
+            int diff = int(seq - pos);
+            if (diff == 0) {
+                if (writePosition.compare_exchange_weak
+                    (pos, pos + 1, std::memory_order_relaxed))
+                    break;
             }
-            
-            result = ring[readPosition];
-            ring[readPosition] = Request();
-            readPosition = (readPosition + 1) % bufferSize;
+            else if (diff < 0)
+                return false;  // full
+            else pos = writePosition.load(std::memory_order_relaxed);
+        }
+
+        cell->value = std::forward<R>(request);
+        cell->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+        if (JML_UNLIKELY(__atomic_load_n(&popWaiting, __ATOMIC_SEQ_CST))) {
+            __atomic_fetch_add(&pushEpoch, 1, __ATOMIC_SEQ_CST);
+            ML::futex_wake(pushEpoch);
         }
-        ML::futex_wake(readPosition);
 
         return true;
     }
 
-    std::vector<Request> tryPopMulti(size_t nbrRequests)
+    bool tryPopOne(Request & result)
     {
-        std::vector<Request> result;
+        unsigned pos = readPosition.load(std::memory_order_relaxed);
+        Cell & cell = cells[pos & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
 
-        for (size_t i = 0;
-             writePosition != readPosition && i < nbrRequests;
-             i++) {
-            result.emplace_back(std::move(ring[readPosition]));
-            ring[readPosition] = Request();
-            readPosition = (readPosition + 1) % bufferSize;
+        result = std::move(cell.value);
+        cell.value = Request();
+        cell.sequence.store(pos + mask + 1, std::memory_order_seq_cst);
+        readPosition.store(pos + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    void wakeWriters()
+    {
+        if (JML_UNLIKELY(__atomic_load_n(&pushWaiting, __ATOMIC_SEQ_CST))) {
+            __atomic_fetch_add(&popEpoch, 1, __ATOMIC_SEQ_CST);
+            ML::futex_wake(popEpoch);
         }
-        ML::futex_wake(readPosition);
-        
-        return result;
     }
 
-    bool couldPop() const
+    void waitUntilNotFull()
     {
-        return writePosition != readPosition;
+        int epoch = __atomic_load_n(&popEpoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&pushWaiting, 1, __ATOMIC_SEQ_CST);
+        if (!couldPush())
+            ML::futex_wait(popEpoch, epoch, 0.1);
+        __atomic_fetch_sub(&pushWaiting, 1, __ATOMIC_SEQ_CST);
     }
 };
 
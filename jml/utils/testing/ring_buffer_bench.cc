@@ -0,0 +1,72 @@
+/* ring_buffer_bench.cc
+   Copyright (c) 2012 Datacratic.  All rights reserved.
+
+   Contention benchmark for the multiple writer ring buffer.  Pushes from
+   1 to 32 writer threads into one reader, which drains with tryPopMany.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <iostream>
+
+#include "jml/utils/ring_buffer.h"
+#include "jml/arch/timers.h"
+
+using namespace ML;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE( bench_srmw_contention )
+{
+    const size_t totalMessages = 10000000;
+
+    for (int nthreads: { 1, 2, 4, 8, 16, 32 }) {
+        RingBufferSRMW<uint64_t> buf(65536);
+        size_t perThread = totalMessages / nthreads;
+
+        std::atomic<bool> go(false);
+        vector<thread> threads;
+        for (int t = 0;  t < nthreads;  ++t) {
+            auto runThread = [&] ()
+                {
+                    while (!go) ;
+                    for (uint64_t i = 0;  i < perThread;  ++i)
+                        buf.push(i);
+                };
+            threads.emplace_back(runThread);
+        }
+
+        Timer timer;
+        go = true;
+
+        size_t expected = perThread * nthreads, received = 0;
+        size_t batches = 0;
+        uint64_t batch[256];
+        while (received < expected) {
+            size_t n = buf.tryPopMany(batch, 256);
+            if (n == 0) {
+                uint64_t val;
+                if (buf.tryPop(val, 0.01))
+                    ++received;
+                continue;
+            }
+            received += n;
+            ++batches;
+        }
+
+        double elapsed = timer.elapsed_wall();
+
+        for (auto & t: threads)
+            t.join();
+
+        cerr << nthreads << " writers: " << received << " messages in "
+             << elapsed << "s = " << received / elapsed / 1000000.0
+             << " Mmsg/s, " << 1000000000.0 * elapsed / received
+             << " ns/msg, avg batch " << (1.0 * received / batches)
+             << endl;
+    }
+}
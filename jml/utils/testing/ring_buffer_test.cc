@@ -0,0 +1,113 @@
+/* ring_buffer_test.cc
+   Copyright (c) 2012 Datacratic.  All rights reserved.
+
+   Test for the ring buffers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <iostream>
+
+#include "jml/utils/ring_buffer.h"
+#include "jml/utils/vector_utils.h"
+
+using namespace ML;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE( test_srmw_single_thread )
+{
+    RingBufferSRMW<int> buf(5);
+    BOOST_CHECK_EQUAL(buf.capacity(), 8);
+    BOOST_CHECK(!buf.couldPop());
+
+    for (unsigned i = 0;  i < 8;  ++i)
+        BOOST_CHECK(buf.tryPush(i));
+    BOOST_CHECK(!buf.couldPush());
+    BOOST_CHECK(!buf.tryPush(8));
+
+    int val;
+    BOOST_CHECK(buf.tryPop(val));
+    BOOST_CHECK_EQUAL(val, 0);
+    BOOST_CHECK(buf.tryPush(8));
+
+    vector<int> popped;
+    BOOST_CHECK_EQUAL(buf.tryPopMany(back_inserter(popped), 3), 3);
+    BOOST_CHECK_EQUAL(popped, vector<int>({ 1, 2, 3 }));
+
+    popped = buf.tryPopMulti(100);
+    BOOST_CHECK_EQUAL(popped, vector<int>({ 4, 5, 6, 7, 8 }));
+    BOOST_CHECK(!buf.couldPop());
+    BOOST_CHECK(!buf.tryPop(val));
+    BOOST_CHECK(!buf.tryPop(val, 0.01));
+}
+
+BOOST_AUTO_TEST_CASE( test_srmw_move_only_on_success )
+{
+    RingBufferSRMW<string> buf(2);
+    BOOST_CHECK(buf.tryPush(string("a")));
+    BOOST_CHECK(buf.tryPush(string("b")));
+
+    string s = "c";
+    BOOST_CHECK(!buf.tryPush(std::move(s)));
+    BOOST_CHECK_EQUAL(s, "c");
+}
+
+BOOST_AUTO_TEST_CASE( test_srmw_multiple_writers )
+{
+    // Small ring so that both the reader and the writers have to block
+    RingBufferSRMW<uint64_t> buf(16);
+
+    const int nthreads = 8;
+    const int niter = 100000;
+
+    std::atomic<int> started(0);
+    vector<thread> threads;
+    for (unsigned t = 0;  t < nthreads;  ++t) {
+        auto runThread = [&, t] ()
+            {
+                ++started;
+                for (uint64_t i = 0;  i < niter;  ++i)
+                    buf.push((uint64_t(t) << 32) | i);
+            };
+        threads.emplace_back(runThread);
+    }
+
+    // Each writer's values must arrive in the order it pushed them
+    vector<uint64_t> next(nthreads, 0);
+    vector<uint64_t> batch;
+    size_t total = 0;
+    while (total < nthreads * niter) {
+        uint64_t val;
+        if (total % 3 == 0) {
+            batch.clear();
+            size_t n = buf.tryPopMany(back_inserter(batch), 5);
+            if (n == 0) continue;
+            for (auto v: batch) {
+                BOOST_REQUIRE_EQUAL(v & 0xffffffff, next[v >> 32]);
+                ++next[v >> 32];
+            }
+            total += n;
+        }
+        else {
+            if (total % 3 == 1) {
+                if (!buf.tryPop(val, 1.0)) continue;
+            }
+            else val = buf.pop();
+            BOOST_REQUIRE_EQUAL(val & 0xffffffff, next[val >> 32]);
+            ++next[val >> 32];
+            ++total;
+        }
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK(!buf.couldPop());
+    for (auto n: next)
+        BOOST_CHECK_EQUAL(n, niter);
+}
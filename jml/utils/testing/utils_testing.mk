@@ -12,4 +12,7 @@ filter_streams_test: lz4cli
 $(eval $(call test,csv_parsing_test,arch utils,boost))
 
 $(eval $(call test,worker_task_test,worker_task ACE arch boost_thread pthread,boost))
+$(eval $(call test,worker_task_bench,worker_task arch pthread,boost manual))
 $(eval $(call test,json_parsing_test,utils arch,boost))
+$(eval $(call test,ring_buffer_test,arch pthread,boost))
+$(eval $(call test,ring_buffer_bench,arch pthread,boost manual))
@@ -0,0 +1,85 @@
+/* worker_task_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Scaling benchmark for the worker task.  Runs run_in_parallel_blocked over
+   a range of small work items, and run_in_parallel over do-nothing jobs,
+   with from 1 to 64 threads (the calling one included).
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cmath>
+#include <iostream>
+
+#include "jml/utils/worker_task.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+
+using namespace ML;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE( bench_run_in_parallel_blocked )
+{
+    const int numItems = 4000000;
+    const int numNullJobs = 1000000;
+
+    vector<float> input(numItems), output(numItems);
+    for (unsigned i = 0;  i < numItems;  ++i)
+        input[i] = i * 0.0001;
+
+    // A few hundred nanoseconds of work per item
+    auto doItem = [&] (int i)
+        {
+            float x = input[i], result = 0.0;
+            for (unsigned j = 0;  j < 16;  ++j)
+                result += std::sin(x + j);
+            output[i] = result;
+        };
+
+    auto nullJob = [] (int i) {};
+
+    double blocked1 = 0.0, null1 = 0.0;
+
+    cerr << format("%8s %12s %12s %8s %14s %8s",
+                   "threads", "blocked", "items/s", "speedup",
+                   "null jobs/s", "speedup")
+         << endl;
+
+    for (int nthreads: { 1, 2, 4, 8, 16, 32, 64 }) {
+        Worker_Task worker(nthreads - 1);
+
+        std::fill(output.begin(), output.end(), 0.0);
+
+        Timer timer;
+        run_in_parallel_blocked(0, numItems, doItem, -1, "", "", worker);
+        double blocked = timer.elapsed_wall();
+
+        for (unsigned i = 0;  i < numItems;  i += numItems / 1000) {
+            float expected = 0.0;
+            for (unsigned j = 0;  j < 16;  ++j)
+                expected += std::sin(input[i] + j);
+            BOOST_REQUIRE_EQUAL(output[i], expected);
+        }
+
+        timer.restart();
+        run_in_parallel(0, numNullJobs, nullJob, -1, "", "", worker);
+        double null = timer.elapsed_wall();
+
+        if (nthreads == 1) {
+            blocked1 = blocked;
+            null1 = null;
+        }
+
+        cerr << format("%8d %11.3fs %12.0f %7.2fx %14.0f %7.2fx",
+                       nthreads, blocked, numItems / blocked,
+                       blocked1 / blocked, numNullJobs / null,
+                       null1 / null)
+             << endl;
+
+        BOOST_CHECK_EQUAL(worker.queued(), 0);
+        BOOST_CHECK_EQUAL(worker.running(), 0);
+    }
+}
@@ -160,3 +160,57 @@ BOOST_AUTO_TEST_CASE( test_exception )
                           std::exception);
     }
 }
+
+/* Each job of a group creates a subgroup of the group with jobs of its own,
+   down to the given depth, like a recursive algorithm would.  Jobs are
+   run by whichever thread steals them. */
+void nested_job(Worker_Task & worker, int parent, int depth,
+                int & jobs, int & groups)
+{
+    atomic_add(jobs, 1);
+    if (depth == 0) return;
+
+    int group = worker.get_group([&] () { atomic_add(groups, 1); },
+                                 "", parent);
+    {
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+        for (unsigned i = 0;  i < 4;  ++i)
+            worker.add(boost::bind(nested_job, boost::ref(worker), group,
+                                   depth - 1, boost::ref(jobs),
+                                   boost::ref(groups)),
+                       "", group);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_nested_groups )
+{
+    for (int nthreads: { 1, 2, 4, 8 }) {
+        Worker_Task worker(nthreads - 1);
+
+        for (unsigned i = 0;  i < 10;  ++i) {
+            int jobs = 0, groups = 0, finished = 0;
+
+            int group = worker.get_group([&] () { finished = groups; }, "");
+            {
+                Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                             boost::ref(worker),
+                                             group));
+                nested_job(worker, group, 6, jobs, groups);
+            }
+
+            worker.run_until_finished(group);
+
+            // 1 + 4 + ... + 4^6 jobs, and a group for each that isn't a leaf
+            BOOST_CHECK_EQUAL(jobs, 5461);
+            BOOST_CHECK_EQUAL(groups, 1365);
+
+            // The children were all finished before their parent
+            BOOST_CHECK_EQUAL(finished, 1365);
+        }
+
+        BOOST_CHECK_EQUAL(worker.queued(), 0);
+        BOOST_CHECK_EQUAL(worker.running(), 0);
+    }
+}
@@ -47,10 +47,205 @@ void log(const string & msg)
 const Job NO_JOB;
 
 
+namespace {
+
+/** The task and slot of the worker running on this thread, if any. */
+__thread Worker_Task * current_task = 0;
+__thread int current_task_slot = -1;
+
+/** Used to pick the worker to steal from first. */
+__thread unsigned steal_seed = 0;
+
+unsigned next_victim()
+{
+    if (steal_seed == 0)
+        steal_seed = (unsigned)((size_t)&steal_seed >> 4) | 1;
+    steal_seed ^= steal_seed << 13;
+    steal_seed ^= steal_seed >> 17;
+    steal_seed ^= steal_seed << 5;
+    return steal_seed;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* WORK_DEQUE                                                                */
+/*****************************************************************************/
+
+/** Chase-Lev work stealing deque, with the memory orderings from Le et al,
+    "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP
+    2013).  Its owner pushes and pops jobs at the bottom; other threads
+    steal them from the top.  An array that was replaced by a bigger one is
+    kept until the deque is destroyed, as a thief may still be reading it.
+*/
+
+struct Worker_Task::Work_Deque {
+    enum { INITIAL_SIZE = 1024 };
+
+    struct Array {
+        Array(int64_t size)
+            : size(size), jobs(new std::atomic<Job_Info *>[size])
+        {
+        }
+
+        int64_t size;
+        std::unique_ptr<std::atomic<Job_Info *>[]> jobs;
+
+        Job_Info * get(int64_t i) const
+        {
+            return jobs[i & (size - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, Job_Info * job)
+        {
+            jobs[i & (size - 1)].store(job, std::memory_order_relaxed);
+        }
+    };
+
+    Work_Deque()
+        : top(0), bottom(0)
+    {
+        arrays.emplace_back(new Array(INITIAL_SIZE));
+        array = arrays.back().get();
+    }
+
+    /** Owner only. */
+    void push(Job_Info * job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array * a = array.load(std::memory_order_relaxed);
+
+        if (b - t > a->size - 1) {
+            Array * bigger = new Array(a->size * 2);
+            arrays.emplace_back(bigger);
+            for (int64_t i = t;  i < b;  ++i)
+                bigger->put(i, a->get(i));
+            array.store(bigger, std::memory_order_release);
+            a = bigger;
+        }
+
+        a->put(b, job);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /** Owner only.  Returns the newest job, or null if there are none. */
+    Job_Info * pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array * a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        Job_Info * result = a->get(b);
+        if (t == b) {
+            // Last one; race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                result = 0;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    /** Any thread.  Returns the oldest job, or null if there are none or
+        another thread got it first, in which case lost is set.
+    */
+    Job_Info * steal(bool & lost)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) return 0;
+
+        Array * a = array.load(std::memory_order_acquire);
+        Job_Info * result = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            lost = true;
+            return 0;
+        }
+        return result;
+    }
+
+    int64_t size() const
+    {
+        return bottom.load(std::memory_order_relaxed)
+            - top.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> top;
+    char padding[64];   // thieves write top; the owner writes bottom
+    std::atomic<int64_t> bottom;
+    std::atomic<Array *> array;
+    std::vector<std::unique_ptr<Array> > arrays;
+};
+
+
 /*****************************************************************************/
 /* WORKER_TASK                                                               */
 /*****************************************************************************/
 
+struct Worker_Task::Job_Info {
+    Job_Info(const Job & job, const Job & error, Group_Info * group)
+        : job(job), error(error), group(group)
+    {
+    }
+
+    Job job;
+    Job error;
+    Group_Info * group;
+};
+
+struct Worker_Task::Group_Info {
+    Group_Info(Id id, const Job & finished, Group_Info * parent, bool locked)
+        : id(id), finished(finished), parent(parent),
+          outstanding(locked), locked(locked), finishing(false),
+          failed(false)
+    {
+    }
+
+    Id id;
+    Job finished;
+    Group_Info * parent;         ///< Group to notify when finished
+
+    /** Jobs and groups waiting for, plus one while the group is locked.
+        The group is finished when it gets to zero. */
+    std::atomic<int> outstanding;
+
+    bool locked;                 ///< Protected by the groups lock
+    bool finishing;              ///< Protected by the groups lock
+    std::atomic<bool> failed;    ///< A job threw; skip the others
+    std::exception_ptr exc;      ///< Exception to rethrow
+
+    void dump(std::ostream & stream, int indent = 0) const;
+};
+
+/** Per thread state, on its own cache lines. */
+struct Worker_Task::Worker_Slot {
+    Worker_Slot()
+        : added(0), taken(0), done(0)
+    {
+    }
+
+    char padding1[64];
+    Work_Deque deque;
+    std::atomic<long long> added;   ///< Jobs added by this thread
+    std::atomic<long long> taken;   ///< Jobs this thread started on
+    std::atomic<long long> done;    ///< Jobs this thread finished
+    char padding2[64];
+};
+
 Worker_Task &
 Worker_Task::
 instance(int thr)
@@ -61,9 +256,8 @@ instance(int thr)
 
 Worker_Task::
 Worker_Task(int threads)
-    : jobs_sem(0), finished_sem(1), state_change_sem(0), shutdown_sem(0),
-      next_group(0), next_job(0), num_queued(0),
-      num_running(0), force_finished(false)
+    : num_injected(0), next_group(0), epoch(0), num_sleepers(0),
+      force_finished(false)
 {
     if (threads == -1)
         threads = num_cpus();
@@ -72,38 +266,72 @@ Worker_Task(int threads)
 
     //cerr << "creating worker task with " << threads << " threads" << endl;
 
+    for (unsigned i = 0;  i <= threads;  ++i)
+        slots.emplace_back(new Worker_Slot());
+
     /* Create our threads */
-    for (unsigned i = 0;  i < threads;  ++i)
-        workerThreads_.emplace_back(new std::thread(std::bind(&Worker_Task::runWorkerThread, this)));
+    for (unsigned i = 0;  i < threads;  ++i) {
+        auto run = [=] ()
+            {
+                current_task = this;
+                current_task_slot = i;
+                this->runWorkerThread();
+            };
+        workerThreads_.emplace_back(new std::thread(run));
+    }
 }
 
 Worker_Task::
 ~Worker_Task()
 {
     log("~Worker_Task: stopping worker task\n");
-    force_finished = true;
 
-    // Wake up all tasks by providing jobs
-    for (unsigned i = 0;  i < threads_;  ++i)
-        jobs_sem.release();
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        force_finished = true;
+        ++epoch;
+    }
+    wakeup.notify_all();
+
+    // Join all worker threads
+    for (auto & t: workerThreads_)
+        t->join();
 
     /* TODO: finish all tasks */
-    if (jobs.size() || groups.size())
-        cerr << "at the end, there were " << jobs.size()
+    size_t jobs = injected.size();
+    for (Job_Info * info: injected)
+        delete info;
+    for (auto & slot: slots) {
+        while (Job_Info * info = slot->deque.pop()) {
+            delete info;
+            ++jobs;
+        }
+    }
+
+    if (jobs || groups.size())
+        cerr << "at the end, there were " << jobs
              << " jobs outstanding and "
              << groups.size() << " groups outstanding" << endl;
 
-    for (unsigned i = 0;  i < threads_;  ++i)
-        shutdown_sem.acquire();
+    log("~Worker_Task: stopped worker task\n");
+}
 
-    // Join all worker threads
-    for (auto & t: workerThreads_) {
-        while (!t->joinable())
-            ML::sleep(0.01);
-        t->join();
-    }
+int
+Worker_Task::
+current_slot() const
+{
+    return current_task == this ? current_task_slot : threads_;
+}
 
-    log("~Worker_Task: stopped worker task\n");
+Worker_Task::Group_Info &
+Worker_Task::
+get_group_ul(Id group, const char * where)
+{
+    auto it = groups.find(group);
+    if (it == groups.end() || it->second->finishing)
+        throw Exception("Worker_Task::%s(): group %lld doesn't exist",
+                        where, group);
+    return *it->second;
 }
 
 Worker_Task::Id
@@ -115,83 +343,58 @@ get_group(const Job & group_finish, const std::string & info_str,
 
     if (!locked) cerr << "warning: creating unlocked group" << endl;
 
-    Guard guard(lock);
-    Id id = next_group++;
-    groups[id].finished = group_finish;
-    groups[id].parent_group = parent_group;
-    groups[id].locked = locked;
-    groups[id].info = info_str;
-
-    /* Add a job for the group.  This allows us to keep track of where the child
-       jobs get inserted. */
-    Job_Info info(group_finish, Job(),
-                  format("job for group %lld: ", id) + info_str, -1, id);
-    
-    Jobs::iterator where = jobs.end();
+    std::lock_guard<Spinlock> guard(groups_lock);
 
-    /* Insert it at the end of its parent's jobs if it has one. */
+    Group_Info * parent = 0;
     if (parent_group != -1) {
-        groups[parent_group].groups_outstanding += 1;
-        where = groups[parent_group].group_job;
+        parent = &get_group_ul(parent_group, "get_group");
+        parent->outstanding += 1;
     }
-    
-    Jobs::iterator it = jobs.insert(where, info);
-    groups[id].group_job = it;
-    
-    notify_state_changed();
-    
+
+    Id id = next_group++;
+    groups[id].reset(new Group_Info(id, group_finish, parent, locked));
+
     return id;
 }
 
 void Worker_Task::unlock_group(int group)
 {
     //cerr << "unlocked group " << group << endl;
-    Guard guard(lock);
-    if (!groups.count(group))
-        throw Exception("Worker_Task::unlock_group(): group info has none");
-    groups[group].locked = false;
-    check_finished_ul(group);
+    Group_Info * info;
+    {
+        std::lock_guard<Spinlock> guard(groups_lock);
+        info = &get_group_ul(group, "unlock_group");
+        if (!info->locked) info = 0;
+        else info->locked = false;
+    }
 
-    notify_state_changed();
+    if (info) release_group(info);
+    else try_finish_group(group);
 }
 
 Worker_Task::Id
 Worker_Task::
 add(const Job & job, const Job & error, const std::string & job_info, Id group)
 {
-    /* Wait to manupulate */
-    Guard guard(lock);
-    Job_Info info(job, error, job_info, next_job++, group);
-
-    /* Find where to put it. */
+    Group_Info * group_info = 0;
 
     if (group != -1) {
-        if (!groups.count(group))
-            throw Exception("Worker_Task::add(): group info has none");
-
-        Group_Info & group_info = groups[group];
-        if (group_info.exc) {
+        std::lock_guard<Spinlock> guard(groups_lock);
+        group_info = &get_group_ul(group, "add");
+        if (group_info->failed) {
             log("ignoring job addition to an error group\n");
             return -1;
         }
-        ++group_info.jobs_outstanding;
-        
-        /* Jobs::iterator it = */ jobs.insert(group_info.group_job, info);
+        group_info->outstanding += 1;
     }
-    else jobs.push_back(info);
-    
-    ++num_queued;
-    
-    jobs_sem.release();  // release one to allow something to run the job
-    
-    /* If this is the first job running, then we are no longer finished so we
-       acquire the finished semaphore. */
-    if (num_queued + num_running == 1)
-        finished_sem.acquire();
 
-    notify_state_changed();
-    
-    return info.id;
+    int slot = current_slot();
+    Id id = slots[slot]->added.fetch_add(1, std::memory_order_relaxed)
+        * (threads_ + 1) + slot;
+
+    push_job(new Job_Info(job, error, group_info), slot);
+
+    return id;
 }
 
 Worker_Task::Id
@@ -201,733 +404,407 @@ add(const Job & job, const std::string & job_info, Id group)
     return add(job, Job(), job_info, group);
 }
 
-void Worker_Task::finish_all()
+void
+Worker_Task::
+push_job(Job_Info * info, int slot)
 {
-    /* Wait until we are finished */
-    finished_sem.acquire();
+    if (slot < threads_)
+        slots[slot]->deque.push(info);
+    else {
+        std::lock_guard<std::mutex> guard(injected_lock);
+        injected.push_back(info);
+        num_injected += 1;
+    }
 
-    /* Let something else finish */
-    finished_sem.release();
+    wake(false /* all */);
 }
 
-void Worker_Task::clear_all()
-{
-    throw Exception("Worker_Task::clear_all(): not implemented");
+Worker_Task::Job_Info *
+Worker_Task::
+get_job(int slot)
+{
+    Job_Info * result = 0;
+
+    if (slot < threads_)
+        result = slots[slot]->deque.pop();
+
+    if (!result && num_injected > 0) {
+        std::lock_guard<std::mutex> guard(injected_lock);
+        if (!injected.empty()) {
+            result = injected.front();
+            injected.pop_front();
+
+            /* A worker takes its share of what's left, so that it doesn't
+               need to come back here for each job.  The others can steal
+               them from it. */
+            size_t share = 0;
+            if (slot < threads_)
+                share = std::min<size_t>(injected.size() / threads_, 64);
+            for (size_t i = 0;  i < share;  ++i) {
+                slots[slot]->deque.push(injected.front());
+                injected.pop_front();
+            }
+
+            num_injected -= 1 + share;
+        }
+    }
+
+    for (bool lost = true;  !result && lost && threads_ > 0;) {
+        lost = false;
+        unsigned first = next_victim();
+        for (unsigned i = 0;  i < threads_ && !result;  ++i) {
+            int victim = (first + i) % threads_;
+            if (victim != slot)
+                result = slots[victim]->deque.steal(lost);
+        }
+    }
+
+    if (result)
+        slots[slot]->taken.fetch_add(1, std::memory_order_relaxed);
+
+    return result;
 }
 
-int Worker_Task::runWorkerThread()
+void
+Worker_Task::
+run_job(Job_Info * info, int slot)
 {
-    //cerr << "worker function" << endl;
-    
-    /* This is the worker function.  We grab work while there is any until it
-       is time to exit. */
-    
-    while (!force_finished) {
-        
-        log("runWorkerThread: getting job\n");
-        Job_Info info = get_job();
-        log("runWorkerThread: got job: " + to_string(info.id) + "\n");
-
-        if (force_finished) break;
+    Group_Info * group = info->group;
 
+    if (!group || !group->failed) {
         try {
-            log("runWorkerThread: running job\n");
-            //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-            //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
+            info->job();
         }
         catch (const std::exception & exc) {
-            log("runWorkerThread: job exception: " + string(exc.what())
-                + "\n");
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "): " << endl;
-            //cerr << "warning: job threw exception: "
-            //     << exc.what() << endl;
+            log("run_job: job exception: " + string(exc.what()) + "\n");
             try {
-                if (info.error) info.error();
+                if (info->error) info->error();
             }
             catch (const std::exception & exc) {
                 cerr << "warning: job error function throw exception: "
                      << exc.what() << endl;
             }
 
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    /* When a job fails in a group, all remaining jobs from
-                       this group are marked for skipping and the queue is
-                       cleaned up gradually via get_job/finish_job. This
-                       marking is performed by both the worker and control
-                       threads. When it is known that all jobs have been fully
-                       executed or skipped, the group is then removed and the
-                       exception rethrown from the control thread. */
-                    group_info.exc = current_exception();
-                    mark_group_jobs_invalid_ul(group_info, info.group);
-                }
-            }
+            /* When a job fails in a group, all remaining jobs from this
+               group are skipped, and once they have all been, the exception
+               is rethrown from run_until_finished(). */
+            if (group && !group->failed.exchange(true))
+                group->exc = current_exception();
         }
-        //cerr << "thread " << ACE_OS::thr_self() << " is finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
     }
+    else log("skipping job from invalid group\n");
 
-    shutdown_sem.release();
-    
-    return 0;
-}
+    delete info;
 
-void Worker_Task::notify_state_changed()
-{
-    // must be called with the lock held
-    for (set<Semaphore *>::const_iterator it = state_semaphores.begin();
-         it != state_semaphores.end();  ++it)
-        (*it)->release();
-}
+    slots[slot]->done.fetch_add(1, std::memory_order_relaxed);
 
-void Worker_Task::add_state_semaphore(Semaphore & sem)
-{
-    Guard guard(lock);
-    if (state_semaphores.count(&sem))
-        throw Exception("same state semaphore added twice");
-    state_semaphores.insert(&sem);
+    if (group) release_group(group);
 }
 
-void Worker_Task::remove_state_semaphore(Semaphore & sem)
+void
+Worker_Task::
+release_group(Group_Info * group)
 {
-    Guard guard(lock);
-    if (!state_semaphores.count(&sem))
-        throw Exception("state semaphore was lost");
-    state_semaphores.erase(&sem);
+    // Once the count is released, the group may disappear at any time
+    Id id = group->id;
+    int left = (group->outstanding -= 1);
+
+    // A thread may be waiting for the group, with only its lock left
+    if (left == 1) wake(true /* all */);
+
+    if (left == 0) try_finish_group(id);
 }
 
-void Worker_Task::run_until_released(Semaphore & sem, int group)
+bool Worker_Task::check_finished(Id group)
 {
-    /* We check at every change in state for either a) the semaphore
-       being free or b) a job being available. */
+    {
+        std::lock_guard<Spinlock> guard(groups_lock);
+        get_group_ul(group, "check_finished");
+    }
 
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
+    return try_finish_group(group);
+}
 
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                 this, boost::ref(state_semaphore)));
-    
-    while (sem.tryacquire() == -1) {
+bool
+Worker_Task::
+try_finish_group(Id group)
+{
+    Group_Info * info;
 
-        /* Run a job, if there is one old job to finish. */
-        
-        Job_Info info;
-        if (try_get_job(info, group)) {
-            // release lock here
+    {
+        std::lock_guard<Spinlock> guard(groups_lock);
 
-            try {
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-            }
-            catch (const std::exception & exc) {
-                // TODO: make this exception go to the calling process
-                cerr << "warning: job threw exception: "
-                     << exc.what() << endl;
-                try {
-                    if (info.error) info.error();
-                }
-                catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
-                }
-            }
+        /* Someone else may have finished it already, or may be doing so. */
+        auto it = groups.find(group);
+        if (it == groups.end() || it->second->finishing)
+            return false;
 
-            finish_job(info);
+        info = it->second.get();
 
-            continue;
-        }
+        /* If the group has an exception attached to it, it must stay in
+           memory until the control thread handles it. */
+        if (info->outstanding != 0 || info->locked || info->exc)
+            return false;
 
-        /* Wait for a state change. */
-        state_semaphore.acquire();
+        info->finishing = true;
     }
-    
-    sem.release();
-}
 
-void
-Worker_Task::
-cancel_group(Group_Info & group_info, int group)
-{
-    Guard guard(lock);
-    cancel_group_ul(group_info, group);
-}
+    //cerr << "finished group " << group << endl;
 
-void
-Worker_Task::
-cancel_group_ul(Group_Info & group_info, int group)
-{
-    log("cancel_group_ul\n");
-    //cerr << "thread " << ACE_OS::thr_self() << " cancel_group() "
-    //     << group_info.info << endl;
-    
-    /* We clean up the group by scanning through its list of tasks, removing
-       those that haven't run yet, and calling all of the handlers. */
-    Jobs::iterator it = jobs.begin();
-        
-    /* Iterate through this group's jobs. */
-        
-    while (it != group_info.group_job) {
-        while (it != group_info.group_job
-               && (it->id == -1 || !in_group(*it, group))) ++it;
-            
-        if (it == group_info.group_job) break;
-            
-        /* Remove this job. */
-        //cerr << "removing job " << it->id << " (" << it->info
-        //     << ")" << endl;
-
-            
-        Jobs::iterator next = it;
-        ++next;
-        remove_job_ul(it);
-        it = next;
+    try {
+        if (info->finished)
+            info->finished();
+    }
+    catch (const std::exception & exc) {
+        cerr << "Worker_Task::check_finished(): " << exc.what() << endl;
     }
-    
-    log("finished clearning jobs for group " + to_string(group) + "\n");
-}
 
-void
-Worker_Task::
-mark_group_jobs_invalid_ul(Group_Info & group_info, int group)
-{
-    log("mark_group_jobs_invalid_ul\n");
+    Group_Info * parent = info->parent;
 
-    if (group == -1) {
-        throw ML::Exception("cannot mark group -1 as invalid");
+    {
+        std::lock_guard<Spinlock> guard(groups_lock);
+        groups.erase(group);
     }
 
-    for (Jobs::iterator it = jobs.begin(); it != group_info.group_job; it++) {
-        if (it->group == group) {
-            it->invalidGroup = true;
-        }
-    }
+    if (parent) release_group(parent);
 
-    log("mark_group_jobs_invalid_ul done\n");
+    return true;
 }
 
-void
-Worker_Task::
-wait_group_finished(Group_Info & group_info, int group)
+void Worker_Task::finish_all()
 {
-    // cancel_group(group_info, group);
-    /* Wait until everything has stopped running in this group. */
-
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
+    /* Wait until we are finished */
+    int slot = current_slot();
 
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                 this, boost::ref(state_semaphore)));
-    
-    while (group_info.jobs_running > 0)
-        state_semaphore.acquire();
+    while (queued() + running() > 0) {
+        if (Job_Info * info = get_job(slot)) {
+            run_job(info, slot);
+            continue;
+        }
 
-    /* Group should be finished. */
-    log("group finished\n");
+        commit_wait(prepare_wait(), 0.001);
+    }
 }
 
-void
-Worker_Task::
-run_until_finished(int group, bool unlock)
+void Worker_Task::clear_all()
 {
-    /* We check at every change in state for either a) the group being
-       finished or b) an error from the group or c) a job being available.
-    */
+    throw Exception("Worker_Task::clear_all(): not implemented");
+}
 
-    map<Id, Group_Info>::iterator group_it;
+int Worker_Task::runWorkerThread()
+{
+    //cerr << "worker function" << endl;
     
-    /* Lock the group so that it doesn't get removed. */
-    {
-        Guard guard(lock);
-        group_it = groups.find(group);
-        if (group_it == groups.end()) {
-            if (!unlock) return;  // group must have finished
-            throw Exception("Worker_Task::run_until_finished(): "
-                            "group doesn't exist but should be locked");
-        }
-        if (group_it->second.locked && !unlock)
-            throw Exception("Worker_Task::run_until_finished(): "
-                            "group is locked; it won't ever finish");
-        group_it->second.locked = true;
-    }
+    /* This is the worker function.  We grab work while there is any until it
+       is time to exit. */
 
-    /* The group is locked for now; make sure it will be unlocked at the
-       end. */
-    Call_Guard unlock_guard(boost::bind(&Worker_Task::unlock_group,
-                                        this, group));
-    
-    /* Since the group is locked, this object must remain in memory here
-       and so we don't need to lock to access it.  (A map's iterators
-       aren't invalidated unless the actual object itself is removed).
-    */
-    Group_Info & group_info = group_it->second;
+    int slot = current_slot();
 
-    /* Create a semaphore so that we get notified of state changes. */
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
-    
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard state_guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                       this, boost::ref(state_semaphore)));
-    
-    for (;;) {
-        //cerr << "thread " << ACE_OS::thr_self() << " is waiting for group "
-        //     << group << " to finish" << endl;
+    while (!force_finished) {
+        Job_Info * info = get_job(slot);
 
-        /* Is the group finished?  If so, we can get out of here. */
-        {
-            if (group_info.jobs_outstanding
-                + group_info.jobs_running
-                + group_info.groups_outstanding == 0) {
-                /* We're finished */
-
-                /* If the group had an error, clean up the group structures,
-                 * then rethrow the exception that occurred. */
-                if (group_info.exc) {
-                    //cerr << "thread " << ACE_OS::thr_self()
-                    //     << " had a group error" << endl;
-
-                    /* Save and replace the exception ptr, as we're about to
-                       remove the group. */
-                    exception_ptr exc = group_info.exc;
-                    group_info.exc = exception_ptr();
-
-                    /* Unlock the group to allow everything to finish. */
-                    unlock_guard.clear();
-                    unlock_group(group);
-
-                    /* Done; throw the exception. */
-                    if (exc)
-                        rethrow_exception(exc);
-                }
-                else
-                    return;
-            }
+        /* More work often turns up soon after we run out, so we look for a
+           little while before going to sleep. */
+        for (unsigned i = 0;  i < 100 && !info && !force_finished;  ++i) {
+            sched_yield();
+            info = get_job(slot);
         }
 
-        /* Run a job if we can */
-        Job_Info info;
-        log("run_until_finished: try to get job\n");
-        if (try_get_job(info, group)) {
-            log("run_until_finished: got job: " + to_string(info.id) + "\n");
-            try {
-                //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-                //     << info.id << " (" << info.info << ")" << endl;
-                log("run_until_finished: running job\n");
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-
-                //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-                //     << info.id << " (" << info.info << ")" << endl;
-            }
-            catch (const std::exception & exc) {
-                log("run_until_finished: job exception\n");
-                // TODO: make this exception go to the calling process
-                //cerr << "thread " << ACE_OS::thr_self() << " running job "
-                //     << info.id << " (" << info.info << "):" << endl;
-                // cerr << "run_until_finished: warning: job threw exception: "
-                //      << exc.what() << endl;
-                try {
-                    if (info.error) info.error();
-                }
-                catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
-                }
-
-                /* Indicate that the job's group had an error. */
-                if (info.group != -1) {
-                    Guard guard(lock);
-                    Group_Info & group_info = groups[info.group];
-                    if (!group_info.exc) {
-                        group_info.exc = current_exception();
-                        mark_group_jobs_invalid_ul(group_info, info.group);
-                    }
-                }
-            }
-            finish_job(info);
-            
-            continue;  // no state change needed
+        if (!info && !force_finished) {
+            unsigned long long current = prepare_wait();
+            info = get_job(slot);
+            if (info) cancel_wait();
+            else commit_wait(current);
         }
-        
-        /* Wait for a state change. */
-        state_semaphore.acquire();
+
+        if (info) run_job(info, slot);
     }
+
+    return 0;
 }
 
-void
+unsigned long long
 Worker_Task::
-lend_thread(int group)
+prepare_wait()
 {
-    /* Run a job if we can */
-    Job_Info info;
-    if (try_get_job(info, group)) {
-        try {
-            //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-            //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
-        }
-        catch (const std::exception & exc) {
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "):" << endl;
-            cerr << "warning: job threw exception: "
-                 << exc.what() << endl;
-            try {
-                if (info.error) info.error();
-            }
-            catch (const std::exception & exc) {
-                cerr << "warning: job error function throw exception: "
-                     << exc.what() << endl;
-            }
-
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    group_info.exc = current_exception();
-                    cancel_group_ul(group_info, info.group);
-                }
-            }
-        }
-        //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
-    }
+    num_sleepers += 1;
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    return epoch;
 }
 
-bool Worker_Task::in_group(const Job_Info & info, int group)
+void
+Worker_Task::
+cancel_wait()
 {
-    if (group == -1) return true;
-    
-    /* Check all parents. */
-    if (info.group == group) return true;
-    else if (info.group == -1) return false;
-    else {
-        Group_Info * group_info = &groups[info.group];
-        
-        while (group_info) {
-            Id parent = group_info->parent_group;
-
-            if (parent == -1) group_info = 0;
-            else {
-                if (!groups.count(parent))
-                    throw Exception("Worker_Task::in_group(): invalid "
-                                    "group number");
-                group_info = &groups[parent];
-            }
-        }
-    }
-
-    return false;
+    num_sleepers -= 1;
 }
 
-Worker_Task::Job_Info
-Worker_Task::get_job(int group)
+void
+Worker_Task::
+commit_wait(unsigned long long current, double timeout)
 {
-    /* Block until we can acquire a semaphore to have jobs. */
-    for (unsigned i = 0;  i < 100;  ++i) {
-        if (jobs_sem.tryacquire() == 0) {
-            return get_job_impl(group);
+    {
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        if (timeout < 0.0) {
+            while (epoch == current && !force_finished)
+                wakeup.wait(guard);
         }
-        sched_yield();
+        else if (epoch == current && !force_finished)
+            wakeup.wait_for(guard, std::chrono::microseconds
+                                       ((long long)(timeout * 1000000)));
     }
-    jobs_sem.acquire();
 
-    return get_job_impl(group);
+    num_sleepers -= 1;
 }
 
-bool Worker_Task::try_get_job(Worker_Task::Job_Info & job, int group)
-{
-    if (jobs_sem.tryacquire() == -1) return false;
-    
-    job = get_job_impl(group);
-    return true;
-}
-
-Worker_Task::Job_Info Worker_Task::get_job_impl(int group)
+void
+Worker_Task::
+wake(bool all)
 {
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
+    /* Pairs with the increment of num_sleepers in prepare_wait(): either we
+       see the sleeper here, or it sees what we did before calling us when
+       it checks one last time before sleeping. */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_sleepers.load(std::memory_order_relaxed) == 0)
+        return;
 
-    for (unsigned i = 0;  i < 100;  ++i) {
-        Guard guard(lock, std::try_to_lock);
-        if (guard)
-            return get_job_impl_ul(group);
-        sched_yield();
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        ++epoch;
     }
 
-    Guard guard(lock);
-
-    //static int numJobs = 0;
-    //cerr << "getting job " << ++numJobs << endl;
-
-    return get_job_impl_ul(group);
+    if (all) wakeup.notify_all();
+    else wakeup.notify_one();
 }
 
-Worker_Task::Job_Info
-Worker_Task::
-get_job_impl_ul(int group)
+void Worker_Task::run_until_released(Semaphore & sem, int group)
 {
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
+    /* We check between jobs for the semaphore being free.  Whatever
+       releases it doesn't wake us up, so we don't sleep for long. */
 
-    Jobs::iterator it;
+    int slot = current_slot();
 
-    if (group == -1) {
-        it = jobs.begin();
+    while (sem.tryacquire() == -1) {
+        if (Job_Info * info = get_job(slot)) {
+            run_job(info, slot);
+            continue;
+        }
 
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != jobs.end() && it->id == -1) ++it;
-        
-        if (it == jobs.end())
-            throw Exception("get_job(): internal error: "
-                            "semaphore acquired with zero jobs");
-    }
-    else {
-        map<Id, Group_Info>::const_iterator group_it
-            = groups.find(group);
-        if (group_it == groups.end()) {
-            //throw Exception("iterator not found in group");
-            cerr << "couldn't find group " << group << " in  list"
-                 << endl;
-            return get_job_impl_ul(-1);
+        unsigned long long current = prepare_wait();
+        if (Job_Info * info = get_job(slot)) {
+            cancel_wait();
+            run_job(info, slot);
         }
-        else if (group_it->second.exc)
-            return get_job_impl_ul(-1);  // group has an error; we don't do it
-        else it = jobs.begin();
-        
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != group_it->second.group_job
-               && (it->id == -1 || !in_group(*it, group)))
-            ++it;
-        
-        /* If we didn't find one in our group, we select any job at all
-           so that we make some progress. */
-        if (it == group_it->second.group_job || !in_group(*it, group))
-            return get_job_impl_ul(-1);
+        else commit_wait(current, 0.001);
     }
     
-    Job_Info result = *it;
-    ++num_running;
-
-    if (result.group != -1) ++groups[result.group].jobs_running;
-    
-    --num_queued;
-    jobs.erase(it);
-
-    notify_state_changed();
-
-    return result;
+    sem.release();
 }
 
 void
 Worker_Task::
-finish_job(const Job_Info & info)
+run_until_finished(int group, bool unlock)
 {
-    Guard guard(lock, std::defer_lock);
+    /* We run jobs until the group is finished, and then rethrow the
+       exception from any of its jobs that failed. */
 
-    for (unsigned i = 0;  i < 100;  ++i) {
-        guard.try_lock();
-        if (guard) break;
-    }
+    Group_Info * info;
 
-    if (!guard)
-        guard.lock();
+    /* Lock the group so that it doesn't get removed. */
+    {
+        std::lock_guard<Spinlock> guard(groups_lock);
+        auto it = groups.find(group);
+        if (it == groups.end() || it->second->finishing) {
+            if (!unlock) return;  // group must have finished
+            throw Exception("Worker_Task::run_until_finished(): "
+                            "group doesn't exist but should be locked");
+        }
 
-    --num_running;
-    
-    /* Finish off the group if we need to. */
-    Id group = info.group;
-    if (group != -1) {
+        info = it->second.get();
+        if (info->locked && !unlock)
+            throw Exception("Worker_Task::run_until_finished(): "
+                            "group is locked; it won't ever finish");
+        if (!info->locked) {
+            info->locked = true;
+            info->outstanding += 1;
+        }
+    }
 
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
+    /* The group is locked for now; make sure it will be unlocked at the
+       end. */
+    Call_Guard unlock_guard(std::bind(&Worker_Task::unlock_group,
+                                      this, group));
 
-        Group_Info * group_info = &groups[group];
+    int slot = current_slot();
 
-        --group_info->jobs_outstanding;
-        --group_info->jobs_running;
+    for (;;) {
+        /* Is the group finished apart from our lock?  If so, we can get out
+           of here. */
+        if (info->outstanding == 1) {
+            /* If the group had an error, clean up the group structures,
+               then rethrow the exception that occurred. */
+            if (info->exc) {
+                /* Save and replace the exception ptr, as we're about to
+                   remove the group. */
+                exception_ptr exc = info->exc;
+                info->exc = exception_ptr();
+
+                /* Unlock the group to allow everything to finish. */
+                unlock_guard.clear();
+                unlock_group(group);
+
+                rethrow_exception(exc);
+            }
+            return;
+        }
 
-        if (group_info->jobs_outstanding < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative outstanding count");
+        /* Run a job if we can */
+        Job_Info * job = get_job(slot);
+
+        if (!job) {
+            /* Wait for a job or for the group to finish. */
+            unsigned long long current = prepare_wait();
+            if (info->outstanding == 1 || (job = get_job(slot)))
+                cancel_wait();
+            else commit_wait(current);
+        }
 
-        if (group_info->jobs_running < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative running count");
-        
-        check_finished_ul(group);
+        if (job) run_job(job, slot);
     }
-    
-    if (num_queued + num_running == 0) finished_sem.release();
-
-    notify_state_changed();
 }
 
 void
 Worker_Task::
-remove_job_ul(const Jobs::iterator & it)
-{
-    --num_queued;
-    
-    if (jobs_sem.tryacquire() == -1) {
-        log(string("remove_job_ul error:\n")
-            + "errno = " + to_string(errno) + "\n"
-            + "error = " + strerror(errno) + "\n"
-            + "Worker_Task::remove_job_ul(): couldn't acquire the job "
-            + "semaphore\n"
-            + "force_finished = " + to_string(force_finished) + "\n");
-        dump();
-        abort();
-    }
-
-    /* Finish off the group if we need to. */
-    Id group = it->group;
-    if (group != -1) {
-
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
-
-        Group_Info * group_info = &groups[group];
-
-        --group_info->jobs_outstanding;
-
-        if (group_info->jobs_outstanding < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative outstanding count");
-        
-        check_finished_ul(group);
-    }
-
-    jobs.erase(it);
-    
-    if (num_queued + num_running == 0) finished_sem.release();
-    
-    notify_state_changed();
-}
-
-bool Worker_Task::check_finished(Id group)
-{
-    Guard guard(lock);
-    return check_finished_ul(group);
-}
-
-bool Worker_Task::check_finished_ul(Id group)
+lend_thread(int group)
 {
-    if (!groups.count(group))
-        throw Exception("Worker_Task::finish_job(): invalid group number");
-    
-    Group_Info * group_info = &groups[group];
-
-    /* Go through the list of parents and notify everywhere of what is
-       finished. */
-    while (group_info && group_info->jobs_outstanding == 0
-           && group_info->groups_outstanding == 0) {
-        //cerr << "  *** yes, group " << group << " is finished" << endl;
-
-        /* If group has an exception attached to it, it must stay in memory
-           until the control thread handles it. */
-        if (group_info->exc || group_info->locked) return false;
-
-        //cerr << "finished group " << group << endl;
-
-        try {
-            if (group_info->finished && !group_info->exc)
-                group_info->finished();
-        }
-        catch (const std::exception & exc) {
-            cerr << "Worker_Task::check_finished(): " << exc.what() << endl;
-        }
-        
-        /* Get rid of the job for the group. */
-        jobs.erase(group_info->group_job);
-
-        Id parent = group_info->parent_group;
-
-        if (parent == -1) group_info = 0;
-        else {
-            if (!groups.count(parent))
-                throw Exception("Worker_Task::finish_job(): invalid "
-                                "group number");
-            group_info = &groups[parent];
-            --group_info->groups_outstanding;
-
-            if (group_info->groups_outstanding < 0) {
-                dump();
-                cerr << "check_finished(" << group << "): "
-                     << "groups_outstainding < 0" << endl;
-                cerr << "parent = " << parent << endl;
-            }
-        }
-        groups.erase(group);
-        group = parent;
-
-        notify_state_changed();
-    }
-    
-    return false;
+    /* Run a job if we can */
+    int slot = current_slot();
+    if (Job_Info * info = get_job(slot))
+        run_job(info, slot);
 }
 
 int Worker_Task::queued() const
 {
-    return num_queued;
+    long long result = 0;
+    for (auto & slot: slots)
+        result += slot->added - slot->taken;
+    return result;
 }
 
 int Worker_Task::running() const
 {
-    return num_running;
+    long long result = 0;
+    for (auto & slot: slots)
+        result += slot->taken - slot->done;
+    return result;
 }
 
 int Worker_Task::finished() const
 {
-    return next_job - num_running - num_queued;
-}
-
-void
-Worker_Task::Job_Info::
-dump(std::ostream & stream, int indent) const
-{
-    string i(indent, ' ');
-    stream << i << "Job_Info @ " << this << endl;
-    stream << i << "  id         = " << id << endl;
-    stream << i << "  group      = " << group << endl;
-    stream << i << "  info       = " << info << endl;
-    stream << i << "  job set    = " << (bool)job << endl;
-    stream << i << "  error set  = " << (bool)error << endl;
+    long long result = 0;
+    for (auto & slot: slots)
+        result += slot->done;
+    return result;
 }
 
 void
@@ -936,14 +813,14 @@ dump(std::ostream & stream, int indent) const
 {
     string i(indent, ' ');
     stream << i << "Group_Info @ " << this << endl;
-    stream << i << "  info               = " << info << endl;
-    stream << i << "  jobs outstanding   = " << jobs_outstanding << endl;
-    stream << i << "  jobs running       = " << jobs_running << endl;
-    stream << i << "  groups outstanding = " << groups_outstanding << endl;
-    stream << i << "  parent group       = " << parent_group << endl;
-    stream << i << "  group job          = " << &(*group_job) << endl;
+    stream << i << "  id                 = " << id << endl;
+    stream << i << "  outstanding        = " << outstanding << endl;
+    stream << i << "  parent group       = "
+           << (parent ? parent->id : -1) << endl;
     stream << i << "  locked             = " << locked << endl;
-    stream << i << "  exc              = "   << (bool)exc << endl;
+    stream << i << "  finishing          = " << finishing << endl;
+    stream << i << "  failed             = " << failed << endl;
+    stream << i << "  exc                = " << (bool)exc << endl;
     stream << i << "  finished set       = " << (bool)finished << endl;
 }
 
@@ -954,26 +831,24 @@ dump() const
     std::ostream & stream = cerr;
 
     stream << "Worker_Task @ " << this << endl;
-    stream << "  number of jobs   = " << jobs.size() << endl;
+    stream << "  threads          = " << threads_ << endl;
     stream << "  next group       = " << next_group << endl;
-    stream << "  next job         = " << next_job << endl;
-    stream << "  num queued       = " << num_queued << endl;
-    stream << "  num running      = " << num_running << endl;
+    stream << "  num queued       = " << queued() << endl;
+    stream << "  num running      = " << running() << endl;
+    stream << "  num finished     = " << finished() << endl;
+    stream << "  num injected     = " << num_injected << endl;
+    stream << "  num sleepers     = " << num_sleepers << endl;
     stream << "  number of groups = " << groups.size() << endl;
-    stream << "  state semaphores = " << state_semaphores.size() << endl;
-    stream << "  force finishned  = " << force_finished << endl;
+    stream << "  force finished   = " << force_finished << endl;
     stream << endl;
-    stream << "  jobs:" << endl;
-    int i = 0;
-    for (Jobs::const_iterator it = jobs.begin();  it != jobs.end();  ++it, ++i) {
-        stream << "   " << i << ":" << endl;
-        it->dump(cerr, 4);
-    }
+    stream << "  deques:" << endl;
+    for (unsigned i = 0;  i < threads_;  ++i)
+        stream << "   " << i << ": " << slots[i]->deque.size() << " jobs"
+               << endl;
     stream << "  groups:" << endl;
-    for (map<Id, Group_Info>::const_iterator it = groups.begin();
-         it != groups.end();  ++it) {
-        stream << "   group with ID " << it->first << ":" << endl;
-        it->second.dump(cerr, 4);
+    for (auto & group: groups) {
+        stream << "   group with ID " << group.first << ":" << endl;
+        group.second->dump(cerr, 4);
     }
     stream << endl;
 }
@@ -12,12 +12,17 @@
 #include "jml/arch/format.h"
 #include "jml/arch/spinlock.h"
 #include "jml/arch/semaphore.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 
 namespace ML {
@@ -46,12 +51,19 @@ int num_threads();
    The jobs can be arranged in groups, with a job that gets run once the
    group is finished, and the groups can be arranged in a hierarchy.
 
-   The jobs are scheduled such that with any group, jobs belonging to an
-   earlier subgroup are all scheduled before any belonging to a later
-   subgroup, regardless of the order in which they are scheduled.  (This
-   corresponds to a depth first search through the group tree).  The effect
-   is to guarantee that the average number of groups outstanding will be
-   as small as possible.
+   Each worker thread has its own deque of jobs.  The jobs that a worker
+   adds (typically those of a subgroup created by the job it is running)
+   go onto its own deque and it takes the newest one first; when it runs
+   out it steals the oldest job from another worker.  This runs the group
+   tree depth first on each thread, which keeps the number of groups
+   outstanding small, while the threads only touch each other's data when
+   they steal.  Jobs added by threads that aren't workers (the one calling
+   run_until_finished() for example) go onto a shared queue that the
+   workers take from in batches.
+
+   The counts that tell when a group is finished are atomic, so running a
+   job doesn't take a lock; the lock on the group table is only taken to
+   create, lock, unlock, add to and finish a group.
 
    It works multithreaded, and deals with all locking and unlocking.
 */
@@ -75,9 +87,7 @@ public:
         is finished.  Note that if nothing is ever added to the group, it won't
         be finished automatically unless check_finished() is called.
 
-        It will be inserted into the jobs list just after the last job with
-        the same parent group, so that the children of parent groups will be
-        completed in preference to their sisters.
+        The parent group won't finish until this group has.
 
         If lock is set to true, then it will not ever be automatically removed
         until it is unlocked.  This stops a newly-created group from being
@@ -104,10 +114,8 @@ public:
                                          this,
                                          group));
             
-            for (int i = 0; first != last;  ++first, ++i)
-                add(std::bind<void>(doWork, first),
-                    jobName + ML::format("%d", i),
-                    group);
+            for (; first != last;  ++first)
+                add(std::bind<void>(doWork, first), jobName, group);
         }
 
         run_until_finished(group);
@@ -123,7 +131,9 @@ private:
 public:
 
     /** Add a job that belongs to the given group.  Jobs which are scheduled into
-        the same group will be scheduled together. */
+        the same group will be scheduled together.  The info is only there
+        for debugging; it isn't kept.
+    */
     Id add(const Job & job, const std::string & info, Id group = -1);
 
     /** Check if a group is finished, and if so call its finish job. */
@@ -143,11 +153,9 @@ public:
     int finished() const;
 
     /** This function lends the calling thread to the worker task until the
-        given semaphore is released.  The semaphore will be checked on each
-        state change.  If the group argument is given, then this thread
-        will only schedule jobs from the given group (or its children), which
-        can be used to avoid the thread being used for other work in the
-        task.
+        given semaphore is released.  The semaphore will be checked between
+        jobs, and every millisecond when there is nothing to do.  The group
+        argument is ignored: the thread runs whatever job it can get.
 
         If any of the jobs throw an exception, then another exception will
         be thrown from the given job.
@@ -178,110 +186,70 @@ private:
     std::vector<std::unique_ptr<std::thread> > workerThreads_;
     
     struct Job_Info;
+    struct Group_Info;
+    struct Work_Deque;
+    struct Worker_Slot;
+
+    /** One per worker thread, plus a last one that counts the jobs added
+        and run by other threads. */
+    std::vector<std::unique_ptr<Worker_Slot> > slots;
+
+    /** Jobs added by threads that aren't our workers. */
+    std::mutex injected_lock;
+    std::deque<Job_Info *> injected;
+    std::atomic<int> num_injected;
+
+    /** Groups that are currently running, with the next group id. */
+    Spinlock groups_lock;
+    std::map<Id, std::unique_ptr<Group_Info> > groups;
+    Id next_group;
 
-    typedef std::list<Job_Info> Jobs;
-    
-    struct Job_Info {
-        Job_Info() : id(-1), group(-1) {}
-        Job_Info(const Job & job, const Job & error,
-                 const std::string & info, Id id, Id group = -1)
-            : job(job), error(error), id(id), group(group),
-              invalidGroup(false), info(info) {}
-        Job job;
-        Job error;
-        Id id;    // if -1, this is a group end marker
-        Id group;
-        bool invalidGroup; // true is group has error set
-        std::string info;
-        void dump(std::ostream & stream, int indent = 0) const;
-    };
-
-    struct Group_Info {
-        Group_Info()
-            : jobs_outstanding(0), jobs_running(0),
-              groups_outstanding(0), parent_group(0),
-              locked(false)
-        {
-        }
-
-        Job finished;
-        int jobs_outstanding;      ///< Number of jobs waiting for
-        int jobs_running;          ///< Number of jobs that are running
-        int groups_outstanding;    ///< Number of groups waiting for
-        Id parent_group;           ///< Group to notify when finished
-        Jobs::iterator group_job;  ///< Job for the group; always last
-        bool locked;
-        std::exception_ptr exc;    ///< Exception to rethrow
-        std::string info;
-
-        void dump(std::ostream & stream, int indent = 0) const;
-    };
-
-    /** Get a job. */
-    Job_Info get_job(int group = -1);
-
-    /** Tries to get a job, but doesn't fail if there isn't one. */
-    bool try_get_job(Job_Info & info, int group = -1);
-
-    /** Implementation of the get_job methods.  Requires that the jobs_sem
-        be acquired. */
-    Job_Info get_job_impl(int group);
-    
-    /** Unlocked implementation of the get_job methods.  Requires that the
-        jobs_sem be acquired and that the lock already be held. */
-    Job_Info get_job_impl_ul(int group);
-    
-    void finish_job(const Job_Info & info);
-
-    void remove_job_ul(const Jobs::iterator & it);
-
-    void add_state_semaphore(Semaphore & sem);
-
-    void remove_state_semaphore(Semaphore & sem);
-
-    void notify_state_changed();
-
-    // Check_finished, bit without the lock held
-    bool check_finished_ul(Id group);
-
-    /** Is the given job in the group?  Searches up the parent hierarchy. */
-    bool in_group(const Job_Info & info, int group);
+    /** Threads with nothing to do sleep here until a job is added, a group
+        is finished or we shut down.  The epoch is incremented (under the
+        lock) each time they are woken up.
+    */
+    std::mutex sleep_lock;
+    std::condition_variable wakeup;
+    unsigned long long epoch;
+    std::atomic<int> num_sleepers;
 
-    /** Removes all queued jobs in the group.  Running jobs are left alone. */
-    void cancel_group(Group_Info & group_info, int group);
+    std::atomic<bool> force_finished;
 
-    /** Removes all queued jobs in the group.  Running jobs are left alone. 
-        Lock must already be held. */
-    void cancel_group_ul(Group_Info & group_info, int group);
+    /** Slot of the calling thread; the last one if it's not one of our
+        workers. */
+    int current_slot() const;
 
-    /** Marks invalid all the jobs belonging to a group, so that the worker threads can
-     * skip those jobs easily and in a lockless manner */
-    void mark_group_jobs_invalid_ul(Group_Info & group_info, int group);
+    /** Push a job onto the deque of the given slot, or the shared queue. */
+    void push_job(Job_Info * info, int slot);
 
-    /** Waits for running jobs to finish. */
-    void wait_group_finished(Group_Info & group_info, int group);
+    /** Get a job to run from the given slot, the shared queue or another
+        worker.  Returns null if there are none. */
+    Job_Info * get_job(int slot);
 
-    typedef std::mutex Lock;
-    //typedef Spinlock Lock;
-    typedef std::unique_lock<Lock> Guard;
+    /** Run the job, record any exception in its group, and finish it. */
+    void run_job(Job_Info * info, int slot);
 
-    Semaphore jobs_sem, finished_sem, state_change_sem, shutdown_sem;
+    /** Release one of the counts that stops a group from finishing, and
+        finish it (and maybe its parents) if it was the last one. */
+    void release_group(Group_Info * group);
 
-    /** Jobs we are running. */
-    Jobs jobs;
-    Id next_group;
-    Id next_job;
-    int num_queued;
-    int num_running;
-    Lock lock;
+    /** Finish the group if nothing stops it from finishing any more, and
+        release its parent.  Returns false if it's not finished or was
+        already finished by another thread. */
+    bool try_finish_group(Id group);
 
-    /** Groups that are currently running. */
-    std::map<Id, Group_Info> groups;
+    /** Look up the group; the groups lock must be held. */
+    Group_Info & get_group_ul(Id group, const char * where);
 
-    /** Semaphores that get released on each state change. */
-    std::set<Semaphore *> state_semaphores;
+    /** Sleep until woken up.  prepare_wait() must be called before
+        checking one last time for something to do, and then either
+        cancel_wait() or commit_wait() with what it returned. */
+    unsigned long long prepare_wait();
+    void cancel_wait();
+    void commit_wait(unsigned long long epoch, double timeout = -1.0);
 
-    volatile bool force_finished;
+    /** Wake up one or all of the sleeping threads. */
+    void wake(bool all);
 
     /* Dump everything to cerr; for debugging */
     void dump() const;
@@ -310,14 +278,15 @@ void run_in_parallel_blocked(RAIt first, RAIt2 last,
                                  = Worker_Task::instance(num_threads() - 1))
 {
     int numJobs = last - first;
-    if (numJobs < 16 * num_threads()) {
+    int numThreads = worker.threads() + 1;  // the caller's thread helps out
+    if (numJobs < 16 * numThreads) {
         // less than 16 jobs per thread... do it directly
         worker.do_group(first, last, doWork, parent, groupName, jobName);
     }
     else {
         // Split into sub-groups such that we have roughly 16 jobs per
         // thread
-        int numPerGroup = numJobs / num_threads() / 16;
+        int numPerGroup = numJobs / numThreads / 16;
         int numGroups
             = (numJobs / numPerGroup)
             + (numJobs % numPerGroup != 0); // extra if there is a remainder
@@ -18,6 +18,7 @@ LIBRECOSET_LEVELDB_SOURCES := \
 	./port/port_posix.cc \
 	./table/block.cc \
 	./table/block_builder.cc \
+	./table/filter_block.cc \
 	./table/format.cc \
 	./table/iterator.cc \
 	./table/merger.cc \
@@ -25,6 +26,7 @@ LIBRECOSET_LEVELDB_SOURCES := \
 	./table/table_builder.cc \
 	./table/two_level_iterator.cc \
 	./util/arena.cc \
+	./util/bloom.cc \
 	./util/cache.cc \
 	./util/coding.cc \
 	./util/comparator.cc \
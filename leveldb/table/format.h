@@ -91,6 +91,17 @@ extern Status ReadBlock(RandomAccessFile* file,
                         const BlockHandle& handle,
                         Block** block);
 
+// Read the uncompressed contents of the block identified by "handle"
+// from "file", for blocks such as filters that are not made of
+// key/value entries.  On success, store a pointer to a heap-allocated
+// array that the caller must delete[] in *buf, its length in *size and
+// return OK.  On failure store NULL in *buf and return non-OK.
+extern Status ReadBlockContents(RandomAccessFile* file,
+                                const ReadOptions& options,
+                                const BlockHandle& handle,
+                                char** buf,
+                                size_t* size);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -16,6 +16,16 @@ namespace crc32c {
 // crc32c of a stream of data.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// The implementations that Extend() chooses between: a table-driven
+// one that works everywhere, and one that uses the SSE4.2 crc32
+// instruction.  Exposed for testing and benchmarking.
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+extern uint32_t ExtendHardware(uint32_t init_crc, const char* data, size_t n);
+
+// Return true if ExtendHardware() can run on this processor.  On other
+// processors it must not be called.
+extern bool IsHardwareAccelerated();
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
@@ -64,6 +64,29 @@ TEST(CRC, Mask) {
   ASSERT_EQ(crc, Unmask(Unmask(Mask(Mask(crc)))));
 }
 
+TEST(CRC, HardwareMatchesPortable) {
+  if (!IsHardwareAccelerated()) {
+    fprintf(stderr, "skipping: no SSE4.2 on this processor\n");
+    return;
+  }
+
+  char buf[1024 + 8];
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    buf[i] = static_cast<char>(i * 7 + (i >> 3));
+  }
+
+  // Every alignment and length, so that all of the head, body and
+  // tail loops get exercised
+  for (int offset = 0; offset < 8; offset++) {
+    for (size_t n = 0; n <= 1024; n += (n < 80 ? 1 : 61)) {
+      ASSERT_EQ(ExtendPortable(0, buf + offset, n),
+                ExtendHardware(0, buf + offset, n));
+      ASSERT_EQ(ExtendPortable(0x12345678, buf + offset, n),
+                ExtendHardware(0x12345678, buf + offset, n));
+    }
+  }
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
 
@@ -0,0 +1,346 @@
+/* admission_controller.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Decides which bid requests get into the router when it can't take them
+   all.
+*/
+
+#include "admission_controller.h"
+#include "rtbkit/common/auction.h"
+#include <dlfcn.h>
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROLLER                                                      */
+/*****************************************************************************/
+
+namespace {
+typedef std::lock_guard<ML::Spinlock> Guard;
+
+static ML::Spinlock lock;
+static std::unordered_map<std::string, AdmissionController::Factory> factories;
+
+AdmissionController::Factory
+getFactory(std::string const & name) {
+    // see if it's already existing
+    {
+        Guard guard(lock);
+        auto i = factories.find(name);
+        if (i != factories.end()) return i->second;
+    }
+
+    // else, try to load the admission controller library
+    std::string path = "lib" + name + "_admission.so";
+    void * handle = dlopen(path.c_str(), RTLD_NOW);
+    if (!handle) {
+        std::cerr << dlerror() << std::endl;
+        throw ML::Exception("couldn't find admission controller library "
+                            + path);
+    }
+
+    // if it went well, it should be registered now
+    Guard guard(lock);
+    auto i = factories.find(name);
+    if (i != factories.end()) return i->second;
+
+    throw ML::Exception("couldn't find admission controller named " + name);
+}
+
+/** Uniform random number in [0, 1). */
+double uniform()
+{
+    return (random() % 1000000) / 1000000.0;
+}
+
+} // file scope
+
+void
+AdmissionController::
+registerFactory(const std::string & name, Factory factory)
+{
+    Guard guard(lock);
+    if (!factories.insert(make_pair(name, factory)).second)
+        throw ML::Exception("already had an admission controller factory "
+                            "registered for " + name);
+}
+
+std::shared_ptr<AdmissionController>
+AdmissionController::
+create(const Json::Value & config)
+{
+    auto factory = getFactory(config.get("type", "value").asString());
+    return std::shared_ptr<AdmissionController>(factory(config));
+}
+
+
+/*****************************************************************************/
+/* RANDOM ADMISSION CONTROLLER                                               */
+/*****************************************************************************/
+
+bool
+RandomAdmissionController::
+admit(const BidRequest & request, double keepFraction)
+{
+    return keepFraction >= 1.0 || uniform() < keepFraction;
+}
+
+
+/*****************************************************************************/
+/* VALUE ADMISSION CONTROLLER                                                */
+/*****************************************************************************/
+
+void
+ValueAdmissionController::Stats::
+add(int potential, bool bid, double value)
+{
+    requests += 1;
+    bids += bid;
+    this->value += value;
+    potentialBidders += potential;
+}
+
+void
+ValueAdmissionController::Stats::
+halve()
+{
+    requests *= 0.5;
+    bids *= 0.5;
+    value *= 0.5;
+    potentialBidders *= 0.5;
+}
+
+ValueAdmissionController::Stats
+ValueAdmissionController::Table::
+get(uint64_t key) const
+{
+    Guard guard(lock);
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return Stats();
+    return it->second;
+}
+
+void
+ValueAdmissionController::Table::
+add(uint64_t key, int potential, bool bid, double value,
+    uint64_t decayInterval)
+{
+    Guard guard(lock);
+    entries[key].add(potential, bid, value);
+
+    if (++updates % decayInterval != 0)
+        return;
+
+    // Halve everything; what is left of a site we haven't seen for a while
+    // isn't worth keeping
+    for (auto it = entries.begin();  it != entries.end();) {
+        it->second.halve();
+        if (it->second.requests < 0.5)
+            it = entries.erase(it);
+        else ++it;
+    }
+}
+
+ValueAdmissionController::
+ValueAdmissionController(const Json::Value & config)
+    : priorWeight(config.get("priorWeight", 20.0).asDouble()),
+      exploreProbability(config.get("exploreProbability", 0.02).asDouble()),
+      halfLife(config.get("halfLife", 1000000).asUInt()),
+      numScored(0)
+{
+    if (exploreProbability < 0 || exploreProbability > 1)
+        throw ML::Exception("invalid exploreProbability %f",
+                            exploreProbability);
+    if (halfLife < NumShards)
+        throw ML::Exception("halfLife must be at least %d", NumShards);
+
+    for (auto & count: histogram)
+        count = 0;
+    for (auto & fraction: atLeast)
+        fraction = 0.0;
+}
+
+uint64_t
+ValueAdmissionController::
+exchangeKey(const BidRequest & request)
+{
+    return std::hash<std::string>()(request.exchange);
+}
+
+uint64_t
+ValueAdmissionController::
+siteKey(const BidRequest & request, uint64_t exchange)
+{
+    auto contextKey = [] (const OpenRTB::Context & context)
+        {
+            uint64_t key = context.id.hash();
+            if (!key && context.publisher)
+                key = context.publisher->id.hash();
+            return key;
+        };
+
+    uint64_t key = 0;
+    if (request.site)
+        key = contextKey(*request.site);
+    else if (request.app)
+        key = contextKey(*request.app) + 1;
+
+    return exchange * 0x9e3779b97f4a7c15ULL + key;
+}
+
+int
+ValueAdmissionController::
+bucketFor(double score)
+{
+    if (!(score > 0.0))
+        return 0;
+    int bucket = (std::log2(score) + 32.0) * 4.0;
+    return std::max(0, std::min<int>(NumBuckets - 1, bucket));
+}
+
+double
+ValueAdmissionController::
+score(const BidRequest & request) const
+{
+    uint64_t exchange = exchangeKey(request);
+    uint64_t site = siteKey(request, exchange);
+
+    Stats ex = exchanges.get(exchange);
+    Stats st = sites[site >> 58].get(site);
+
+    // What we expect of a site of this exchange that we know nothing about
+    double exBidRate = (ex.bids + 1.0) / (ex.requests + 2.0);
+    double exValue = ex.bids > 0 ? ex.value / ex.bids : 1.0;
+    double exPotential
+        = ex.requests > 0 ? ex.potentialBidders / ex.requests : 0.0;
+
+    // Sites that fewer of our agents want are less likely to get bids
+    double sitePotential
+        = st.requests > 0 ? st.potentialBidders / st.requests : exPotential;
+    double prior = std::min(1.0, exBidRate * (sitePotential + 0.1)
+                                           / (exPotential + 0.1));
+
+    double bidRate = (st.bids + priorWeight * prior)
+                   / (st.requests + priorWeight);
+    double value = (st.value + exValue) / (st.bids + 1.0);
+
+    return bidRate * value;
+}
+
+bool
+ValueAdmissionController::
+admit(const BidRequest & request, double keepFraction)
+{
+    // Keep scoring when we're not shedding so that the thresholds are
+    // ready when we need them
+    int bucket = bucketFor(score(request));
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (numScored.fetch_add(1, std::memory_order_relaxed) % RefreshInterval
+        == RefreshInterval - 1)
+        refreshThresholds();
+
+    if (keepFraction >= 1.0)
+        return true;
+
+    if (uniform() < keepFraction * exploreProbability)
+        return true;
+
+    double keep = keepFraction * (1.0 - exploreProbability);
+    double here = atLeast[bucket].load(std::memory_order_relaxed);
+    double above = atLeast[bucket + 1].load(std::memory_order_relaxed);
+
+    if (here <= keep)
+        return true;
+    if (above >= keep)
+        return false;
+
+    // Boundary bucket: take as many as we need to make up the fraction
+    return uniform() < (keep - above) / (here - above);
+}
+
+void
+ValueAdmissionController::
+refreshThresholds()
+{
+    uint32_t counts[NumBuckets];
+    double total = 0;
+    for (unsigned i = 0;  i < NumBuckets;  ++i) {
+        counts[i] = histogram[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return;
+
+    double sum = 0;
+    for (int i = NumBuckets - 1;  i >= 0;  --i) {
+        sum += counts[i];
+        atLeast[i].store(sum / total, std::memory_order_relaxed);
+    }
+
+    // Decay, so that the thresholds follow the traffic
+    for (unsigned i = 0;  i < NumBuckets;  ++i)
+        histogram[i].fetch_sub(counts[i] / 2, std::memory_order_relaxed);
+}
+
+void
+ValueAdmissionController::
+record(const BidRequest & request, int potentialBidders, bool bid,
+       double value)
+{
+    uint64_t exchange = exchangeKey(request);
+    uint64_t site = siteKey(request, exchange);
+
+    exchanges.add(exchange, potentialBidders, bid, value, halfLife);
+    sites[site >> 58].add(site, potentialBidders, bid, value,
+                          halfLife / NumShards);
+}
+
+void
+ValueAdmissionController::
+auctionDone(const Auction & auction)
+{
+    if (!auction.request)
+        return;
+
+    const Auction::Data * data = auction.getCurrentData();
+
+    bool bid = false;
+    double value = 0.0;
+    for (unsigned spot = 0;  spot < data->responses.size();  ++spot) {
+        if (!data->hasValidResponse(spot))
+            continue;
+        bid = true;
+        value += data->winningResponse(spot).price.maxPrice.value;
+    }
+
+    record(*auction.request, auction.numPotentialBidders, bid, value);
+}
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        AdmissionController::registerFactory("random",
+        [] (const Json::Value & config)
+        {
+            return new RandomAdmissionController();
+        });
+
+        AdmissionController::registerFactory("value",
+        [] (const Json::Value & config)
+        {
+            return new ValueAdmissionController(config);
+        });
+    }
+} atInit;
+
+} // file scope
+
+} // namespace RTBKIT
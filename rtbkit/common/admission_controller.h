@@ -0,0 +1,196 @@
+/* admission_controller.h                                          -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Decides which bid requests get into the router when it can't take them
+   all.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include "jml/arch/spinlock.h"
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+namespace RTBKIT {
+
+struct Auction;
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROLLER                                                      */
+/*****************************************************************************/
+
+/** Called by the exchange connectors for each bid request that they parsed,
+    to decide whether it goes to the router or gets dropped.
+
+    The router decides how much it can take (the keep fraction, which comes
+    from the load stabilizer); the admission controller decides which of
+    the requests make up that fraction.
+
+    Both methods are called concurrently from all of the exchange
+    connector threads.
+*/
+
+struct AdmissionController {
+
+    virtual ~AdmissionController()
+    {
+    }
+
+    /** Return true if the request should be let through.  keepFraction is
+        the proportion of requests that the router can currently handle,
+        between 0 and 1.
+    */
+    virtual bool admit(const BidRequest & request, double keepFraction) = 0;
+
+    /** Called once an admitted auction is over, so that the controller can
+        learn from how it went.
+    */
+    virtual void auctionDone(const Auction & auction)
+    {
+    }
+
+    /*************************************************************************/
+    /* FACTORY INTERFACE                                                     */
+    /*************************************************************************/
+
+    /** Type of a callback which is registered as an admission controller
+        factory.  It is passed the configuration of the controller.
+    */
+    typedef std::function<AdmissionController * (const Json::Value & config)>
+        Factory;
+
+    /** Register the given admission controller factory. */
+    static void registerFactory(const std::string & name, Factory factory);
+
+    /** Create an admission controller from its configuration.  The "type"
+        field gives the factory to use; it defaults to "value".
+    */
+    static std::shared_ptr<AdmissionController>
+    create(const Json::Value & config);
+};
+
+
+/*****************************************************************************/
+/* RANDOM ADMISSION CONTROLLER                                               */
+/*****************************************************************************/
+
+/** Lets each request through with a probability of keepFraction.  This is
+    what the exchange connectors do when no controller is configured.
+*/
+
+struct RandomAdmissionController : public AdmissionController {
+
+    virtual bool admit(const BidRequest & request, double keepFraction);
+};
+
+
+/*****************************************************************************/
+/* VALUE ADMISSION CONTROLLER                                                */
+/*****************************************************************************/
+
+/** Admits the requests that are the most likely to be worth something.
+
+    Each request is given a score from its exchange and its site (or app,
+    or publisher): the probability that one of our agents bids on it times
+    the value of those bids.  Both are learnt online from the auctions that
+    went through, along with the number of agents that got past the static
+    filters for that site.  Sites we know little about get the bid rate of
+    their exchange, scaled by how many agents were interested in them.
+
+    A histogram of recent scores gives the score above which keepFraction
+    of the requests lie; those are admitted, and the requests in the bucket
+    at the boundary are admitted at random to make up the fraction.  A
+    small proportion of the rest is let through anyway so that sites that
+    were cut off get a chance to show they have become valuable.
+
+    Configuration:
+    - "halfLife": number of auctions over which the statistics lose half of
+      their weight (default 1000000);
+    - "priorWeight": number of requests the prior from the exchange is
+      worth (default 20);
+    - "exploreProbability": proportion of the budget used to admit
+      requests regardless of their score (default 0.02).
+*/
+
+struct ValueAdmissionController : public AdmissionController {
+
+    ValueAdmissionController(const Json::Value & config = Json::Value());
+
+    virtual bool admit(const BidRequest & request, double keepFraction);
+
+    virtual void auctionDone(const Auction & auction);
+
+    /** Expected value of the request, in the units of the bid prices. */
+    double score(const BidRequest & request) const;
+
+    /** Learn from the outcome of a request: how many agents were
+        interested, whether any of them bid and the sum of their bids.
+    */
+    void record(const BidRequest & request,
+                int potentialBidders, bool bid, double value);
+
+    double priorWeight;
+    double exploreProbability;
+
+private:
+    enum {
+        NumShards = 64,
+        NumBuckets = 256,     ///< Quarter octaves from 2^-32 to 2^32
+        RefreshInterval = 4096
+    };
+
+    /** Decayed statistics for a site or an exchange. */
+    struct Stats {
+        Stats()
+            : requests(0), bids(0), value(0), potentialBidders(0)
+        {
+        }
+
+        double requests;
+        double bids;
+        double value;
+        double potentialBidders;
+
+        void add(int potential, bool bid, double value);
+        void halve();
+    };
+
+    struct Table {
+        Table()
+            : updates(0)
+        {
+        }
+
+        mutable ML::Spinlock lock;
+        std::unordered_map<uint64_t, Stats> entries;
+        uint64_t updates;
+
+        Stats get(uint64_t key) const;
+        void add(uint64_t key, int potential, bool bid, double value,
+                 uint64_t decayInterval);
+    };
+
+    Table sites[NumShards];
+    Table exchanges;
+    uint64_t halfLife;
+
+    static uint64_t exchangeKey(const BidRequest & request);
+    static uint64_t siteKey(const BidRequest & request, uint64_t exchange);
+    static int bucketFor(double score);
+
+    /** Scores of the recent requests, and for each bucket the proportion of
+        the requests that scored in that bucket or higher the last time it
+        was computed.
+    */
+    std::atomic<uint32_t> histogram[NumBuckets];
+    std::atomic<float> atLeast[NumBuckets + 1];
+    std::atomic<uint64_t> numScored;
+
+    void refreshThresholds();
+};
+
+} // namespace RTBKIT
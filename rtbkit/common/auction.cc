@@ -212,7 +212,8 @@ createDescription(AuctionResponseDescription & d) {
 
 Auction::
 Auction()
-    : isZombie(false), exchangeConnector(nullptr), data(new Data())
+    : isZombie(false), exchangeConnector(nullptr), numPotentialBidders(0),
+      data(new Data())
 {
 }
 
@@ -229,6 +230,7 @@ Auction(ExchangeConnector * exchangeConnector,
       requestStr(requestStr),
       requestStrFormat(requestStrFormat),
       exchangeConnector(exchangeConnector),
+      numPotentialBidders(0),
       handleAuction(handleAuction),
       data(new Data(numSpots()))
 {
@@ -246,6 +246,7 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     const std::vector<std::vector<Response> > & getResponses() const;
 
     ExchangeConnector * exchangeConnector; ///< Exchange connector for auction
+    int numPotentialBidders;  ///< Agents that got past the static filters
     HandleAuction handleAuction;   ///< Callback for when auction is finished
 
     struct Data {
@@ -1255,10 +1255,10 @@ std::string
 BidRequest::
 serializeToString() const
 {
-    ostringstream stream;
-    DB::Store_Writer store(stream);
+    DB::Store_Writer store;
+    store.open_buffer(4096);
     serialize(store);
-    return stream.str();
+    return store.release_buffer();
 }
 
 BidRequest
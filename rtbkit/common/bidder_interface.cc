@@ -46,6 +46,10 @@ void BidderInterface::shutdown()
 {
 }
 
+void BidderInterface::processAgentMessages()
+{
+}
+
 namespace {
     typedef std::lock_guard<ML::Spinlock> Guard;
     static ML::Spinlock lock;
@@ -36,6 +36,12 @@ struct BidderInterface : public ServiceBase
 
     virtual void start();
 
+    /** Called from the router's loop each time it wakes up.  Interfaces
+        that receive agent messages by another route than the agent bridge
+        hand them to the router from here, on the router's own thread.
+    */
+    virtual void processAgentMessages();
+
     virtual
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
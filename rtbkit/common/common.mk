@@ -20,7 +20,9 @@ LIBRTB_SOURCES := \
 	auction_events.cc \
 	exchange_connector.cc \
 	bidder_interface.cc \
-	win_cost_model.cc
+	win_cost_model.cc \
+	shm_channel.cc \
+	admission_controller.cc
 
 LIBRTB_LINK := \
 	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request
@@ -87,6 +87,10 @@ configure(const Json::Value & parameters)
 
         hasCurrencyConfigured_ = true;
     }
+
+    const auto & admission = parameters["admission"];
+    if (admission != Json::Value::null)
+        admissionController = AdmissionController::create(admission);
 }
 
 void
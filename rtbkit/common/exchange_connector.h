@@ -10,6 +10,7 @@
 #include "soa/service/service_base.h"
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/win_cost_model.h"
+#include "rtbkit/common/admission_controller.h"
 #include "jml/utils/unnamed_bool.h"
 
 namespace RTBKIT {
@@ -59,6 +60,12 @@ struct ExchangeConnector: public ServiceBase {
     /** Probability that we will accept a given auction. */
     double acceptAuctionProbability;
 
+    /** Picks which auctions make up acceptAuctionProbability.  When it's
+        null, they are picked at random before the request is even parsed.
+        Set up from the "admission" field of the configuration.
+    */
+    std::shared_ptr<AdmissionController> admissionController;
+
     /*************************************************************************/
     /* METHODS CALLED BY THE ROUTER TO CONTROL THE EXCHANGE CONNECTOR        */
     /*************************************************************************/
@@ -10,6 +10,7 @@
 
 #include "soa/types/value_description.h"
 #include "soa/service/zmq.hpp"
+#include "soa/service/zmq_utils.h"
 #include "rtbkit/common/json_holder.h"
 
 namespace Datacratic {
@@ -28,6 +29,30 @@ inline zmq::message_t encodeMessage(const JsonHolder & j)
     return j.toString();
 }
 
+/** Append the given fields to message, encoded as they would be in a zmq
+    message.  A vector of strings given as the last field is flattened.
+*/
+inline void appendMessageFields(std::vector<std::string> & message)
+{
+}
+
+inline void appendMessageFields(std::vector<std::string> & message,
+                                const std::vector<std::string> & last)
+{
+    message.insert(message.end(), last.begin(), last.end());
+}
+
+template<typename Arg, typename... Args>
+void appendMessageFields(std::vector<std::string> & message,
+                         const Arg & arg, const Args &... args)
+{
+    using Datacratic::encodeMessage;
+    zmq::message_t field = encodeMessage(arg);
+    message.emplace_back(static_cast<const char *>(field.data()),
+                         field.size());
+    appendMessageFields(message, args...);
+}
+
 inline int toInt(const std::string & str)
 {
     char * end;
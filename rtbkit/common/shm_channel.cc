@@ -0,0 +1,526 @@
+/* shm_channel.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Shared memory channel between a router and a bidding agent.
+*/
+
+#include "rtbkit/common/shm_channel.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+namespace {
+
+const uint64_t ShmMagic = 0x52544253484d4348ULL;  // "RTBSHMCH"
+const uint32_t ShmVersion = 1;
+
+/** Header at the start of the segment; the two rings follow. */
+struct ShmHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t ringCapacity;
+    char pad[48];
+};
+
+static_assert(sizeof(ShmHeader) == 64, "ShmHeader must keep rings aligned");
+
+size_t segmentSize(uint32_t ringCapacity)
+{
+    return sizeof(ShmHeader) + 2 * (sizeof(ShmRing) + ringCapacity);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHM RING                                                                  */
+/*****************************************************************************/
+
+void
+ShmRing::
+init(uint32_t capacity)
+{
+    if (!validCapacity(capacity))
+        throw ML::Exception("shared memory ring capacity must be a power "
+                            "of two of at least 4096");
+    this->capacity = capacity;
+    head = 0;
+    tail = 0;
+}
+
+
+/*****************************************************************************/
+/* SHM RING WRITER                                                           */
+/*****************************************************************************/
+
+void
+ShmRingWriter::
+init(ShmRing * ring, uint32_t capacity)
+{
+    if (ring->capacity != capacity)
+        throw ML::Exception("shared memory ring has the wrong capacity");
+    ring_ = ring;
+    capacity_ = capacity;
+    head_ = start_ = ring->head.load();
+    tail_ = ring->tail.load();
+    reserved_ = 0;
+}
+
+char *
+ShmRingWriter::
+reserve(uint32_t type, size_t size)
+{
+    if (size > maxRecordSize())
+        return nullptr;
+
+    uint32_t capacity = capacity_;
+    uint32_t total = ShmRecord::totalSize(size);
+
+    uint32_t pos = head_ & (capacity - 1);
+    uint32_t toEnd = capacity - pos;
+    uint32_t needed = total + (toEnd < total ? toEnd : 0);
+
+    if (head_ + needed - tail_ > capacity) {
+        tail_ = ring_->tail.load(std::memory_order_acquire);
+        if (head_ + needed - tail_ > capacity)
+            return nullptr;
+    }
+
+    start_ = head_;
+
+    if (toEnd < total) {
+        auto pad = reinterpret_cast<ShmRecord *>(ring_->data() + pos);
+        pad->size = toEnd - sizeof(ShmRecord);
+        pad->type = SHM_PADDING;
+        head_ += toEnd;
+        pos = 0;
+    }
+
+    auto record = reinterpret_cast<ShmRecord *>(ring_->data() + pos);
+    record->size = size;
+    record->type = type;
+    reserved_ = total;
+
+    return reinterpret_cast<char *>(record + 1);
+}
+
+bool
+ShmRingWriter::
+commit()
+{
+    head_ += reserved_;
+    reserved_ = 0;
+
+    // Both this store and the consumer's store of tail are followed by a
+    // load of the other; with sequential consistency at least one of us
+    // sees the other's store, so either the consumer finds the new record
+    // or we find that it had drained the ring and wake it up.
+    ring_->head.store(head_, std::memory_order_seq_cst);
+    return ring_->tail.load(std::memory_order_seq_cst) == start_;
+}
+
+
+/*****************************************************************************/
+/* SHM RING READER                                                           */
+/*****************************************************************************/
+
+void
+ShmRingReader::
+init(ShmRing * ring, uint32_t capacity)
+{
+    if (ring->capacity != capacity)
+        throw ML::Exception("shared memory ring has the wrong capacity");
+    ring_ = ring;
+    capacity_ = capacity;
+    tail_ = head_ = ring->tail.load();
+    current_ = 0;
+}
+
+const char *
+ShmRingReader::
+read(uint32_t & type, uint32_t & size)
+{
+    uint32_t capacity = capacity_;
+
+    for (;;) {
+        if (tail_ == head_) {
+            head_ = ring_->head.load(std::memory_order_seq_cst);
+            if (tail_ == head_)
+                return nullptr;
+        }
+
+        uint32_t pos = tail_ & (capacity - 1);
+        auto record
+            = reinterpret_cast<const ShmRecord *>(ring_->data() + pos);
+
+        // The other end could be buggy; never read outside of the ring.
+        // pos is 8 byte aligned, so there is always room for the header.
+        // The size is checked before it is rounded up so that it can't
+        // wrap around.
+        size = record->size;
+        if (size > capacity - pos - sizeof(ShmRecord))
+            throw ML::Exception("corrupt shared memory ring");
+        uint32_t total = ShmRecord::totalSize(size);
+        if (total == 0 || total > capacity - pos || total > head_ - tail_)
+            throw ML::Exception("corrupt shared memory ring");
+
+        if (record->type == SHM_PADDING) {
+            tail_ += total;
+            ring_->tail.store(tail_, std::memory_order_release);
+            continue;
+        }
+
+        type = record->type;
+        current_ = total;
+        return reinterpret_cast<const char *>(record + 1);
+    }
+}
+
+void
+ShmRingReader::
+consume()
+{
+    tail_ += current_;
+    current_ = 0;
+    ring_->tail.store(tail_, std::memory_order_seq_cst);
+}
+
+
+/*****************************************************************************/
+/* SHM CHANNEL                                                               */
+/*****************************************************************************/
+
+ShmChannel::
+ShmChannel(int fd, void * mem, size_t size, uint32_t capacity)
+    : fd_(fd), mem_(mem), size_(size), capacity_(capacity)
+{
+    auto header = reinterpret_cast<ShmHeader *>(mem);
+    char * rings = reinterpret_cast<char *>(header + 1);
+    toAgent = reinterpret_cast<ShmRing *>(rings);
+    toRouter = reinterpret_cast<ShmRing *>(
+            rings + sizeof(ShmRing) + capacity);
+}
+
+ShmChannel::
+~ShmChannel()
+{
+    ::munmap(mem_, size_);
+    ::close(fd_);
+}
+
+std::shared_ptr<ShmChannel>
+ShmChannel::
+create(uint32_t ringCapacity)
+{
+    uint32_t capacity = 4096;
+    while (capacity < ringCapacity)
+        capacity *= 2;
+
+    // The file is unlinked straight away; the segment lives as long as one
+    // of the two processes has it open.
+    char path[] = "/dev/shm/rtbkit-shm-XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd == -1)
+        throw ML::Exception(errno, "mkstemp", path);
+    ::unlink(path);
+
+    size_t size = segmentSize(capacity);
+    if (::ftruncate(fd, size) == -1) {
+        ::close(fd);
+        throw ML::Exception(errno, "ftruncate");
+    }
+
+    void * mem = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        ::close(fd);
+        throw ML::Exception(errno, "mmap");
+    }
+
+    auto header = reinterpret_cast<ShmHeader *>(mem);
+    header->magic = ShmMagic;
+    header->version = ShmVersion;
+    header->ringCapacity = capacity;
+
+    std::shared_ptr<ShmChannel> result
+        (new ShmChannel(fd, mem, size, capacity));
+    result->toAgent->init(capacity);
+    result->toRouter->init(capacity);
+    return result;
+}
+
+std::shared_ptr<ShmChannel>
+ShmChannel::
+attach(int fd)
+{
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        ::close(fd);
+        throw ML::Exception(errno, "fstat");
+    }
+
+    size_t size = st.st_size;
+    if (size < sizeof(ShmHeader)) {
+        ::close(fd);
+        throw ML::Exception("shared memory segment is too small");
+    }
+
+    void * mem = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        ::close(fd);
+        throw ML::Exception(errno, "mmap");
+    }
+
+    // Everything in the segment can be written by the agent, so the
+    // capacity is checked once here and then never read from it again.
+    auto header = reinterpret_cast<const ShmHeader *>(mem);
+    uint32_t capacity = header->ringCapacity;
+    if (header->magic != ShmMagic || header->version != ShmVersion
+        || !ShmRing::validCapacity(capacity)
+        || size != segmentSize(capacity)) {
+        ::munmap(mem, size);
+        ::close(fd);
+        throw ML::Exception("invalid shared memory segment");
+    }
+
+    std::shared_ptr<ShmChannel> result
+        (new ShmChannel(fd, mem, size, capacity));
+    if (result->toAgent->capacity != capacity
+        || result->toRouter->capacity != capacity)
+        throw ML::Exception("invalid shared memory ring capacity");
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SHM ENDPOINT                                                              */
+/*****************************************************************************/
+
+ShmEndpoint::
+ShmEndpoint(std::shared_ptr<ShmChannel> channel, bool isRouter,
+            int peerWakeupFd)
+    : channel(channel), peerWakeupFd(peerWakeupFd)
+{
+    uint32_t capacity = channel->ringCapacity();
+    writer.init(isRouter ? channel->toAgent : channel->toRouter, capacity);
+    reader.init(isRouter ? channel->toRouter : channel->toAgent, capacity);
+}
+
+ShmEndpoint::
+~ShmEndpoint()
+{
+    ::close(peerWakeupFd);
+}
+
+void
+ShmEndpoint::
+endRecord()
+{
+    if (writer.commit()) {
+        eventfd_t val = 1;
+        ::eventfd_write(peerWakeupFd, val);
+    }
+}
+
+size_t
+ShmEndpoint::
+messageSize(const std::vector<std::string> & message)
+{
+    size_t size = sizeof(uint32_t);
+    for (auto & field: message)
+        size += ShmMessageWriter::stringSize(field);
+    return size;
+}
+
+bool
+ShmEndpoint::
+sendMessage(const std::vector<std::string> & message)
+{
+    char * data = beginRecord(SHM_MESSAGE, messageSize(message));
+    if (!data)
+        return false;
+
+    ShmMessageWriter writer(data);
+    writer.write<uint32_t>(message.size());
+    for (auto & field: message)
+        writer.writeString(field);
+
+    endRecord();
+    return true;
+}
+
+void
+ShmEndpoint::
+decodeMessage(ShmMessageReader & reader, std::vector<std::string> & message)
+{
+    uint32_t n = reader.read<uint32_t>();
+
+    message.reserve(message.size() + n);
+    for (unsigned i = 0;  i < n;  ++i) {
+        size_t length;
+        const char * data = reader.readString(length);
+        message.emplace_back(data, length);
+    }
+}
+
+
+/*****************************************************************************/
+/* SHM SOCKETS                                                               */
+/*****************************************************************************/
+
+namespace {
+
+socklen_t shmSocketAddress(const std::string & routerName,
+                           sockaddr_un & addr)
+{
+    std::string name = "rtbkit-shm/" + routerName;
+    if (name.size() + 1 > sizeof(addr.sun_path))
+        throw ML::Exception("router name too long for a unix socket: "
+                            + routerName);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // A leading nul puts the socket in the abstract namespace, which goes
+    // away with the router.
+    memcpy(addr.sun_path + 1, name.data(), name.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+} // file scope
+
+int bindShmSocket(const std::string & routerName)
+{
+    sockaddr_un addr;
+    socklen_t len = shmSocketAddress(routerName, addr);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        throw ML::Exception(errno, "socket");
+
+    if (::bind(fd, (sockaddr *)&addr, len) == -1) {
+        int error = errno;
+        ::close(fd);
+        throw ML::Exception(error, "bind shared memory socket of "
+                            + routerName);
+    }
+
+    if (::listen(fd, 128) == -1) {
+        int error = errno;
+        ::close(fd);
+        throw ML::Exception(error, "listen");
+    }
+
+    return fd;
+}
+
+int connectShmSocket(const std::string & routerName)
+{
+    sockaddr_un addr;
+    socklen_t len = shmSocketAddress(routerName, addr);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        throw ML::Exception(errno, "socket");
+
+    if (::connect(fd, (sockaddr *)&addr, len) == -1) {
+        int error = errno;
+        ::close(fd);
+        if (error == ECONNREFUSED || error == ENOENT)
+            return -1;
+        throw ML::Exception(error, "connect shared memory socket of "
+                            + routerName);
+    }
+
+    return fd;
+}
+
+void sendWithFds(int sock, const std::string & message,
+                 const std::vector<int> & fds)
+{
+    enum { MaxFds = 4 };
+    if (fds.size() > MaxFds)
+        throw ML::Exception("too many file descriptors to send");
+    if (message.empty())
+        throw ML::Exception("can't send an empty message");
+
+    iovec iov;
+    iov.iov_base = const_cast<char *>(message.data());
+    iov.iov_len = message.size();
+
+    char control[CMSG_SPACE(sizeof(int) * MaxFds)];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (!fds.empty()) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    ssize_t res;
+    do {
+        res = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (res == -1 && errno == EINTR);
+
+    if (res == -1)
+        throw ML::Exception(errno, "sendmsg");
+    if (res != message.size())
+        throw ML::Exception("short write on shared memory socket");
+}
+
+std::string recvWithFds(int sock, std::vector<int> & fds)
+{
+    enum { MaxFds = 4 };
+
+    char buffer[1024];
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    char control[CMSG_SPACE(sizeof(int) * MaxFds)];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t res;
+    do {
+        res = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (res == -1 && errno == EINTR);
+
+    if (res == -1)
+        throw ML::Exception(errno, "recvmsg");
+
+    for (cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);  cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int * received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), received, received + n);
+    }
+
+    return std::string(buffer, res);
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,401 @@
+/* shm_channel.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Shared memory channel between a router and a bidding agent that run on
+   the same host.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+#include "jml/arch/exception.h"
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* SHM RING                                                                  */
+/*****************************************************************************/
+
+/** Single producer, single consumer ring of variable sized records that
+    lives in a shared memory segment.
+
+    head and tail are free running byte counts; only the producer writes
+    head and only the consumer writes tail.  Records are 8 byte aligned and
+    never wrap around the end of the buffer: a record that doesn't fit is
+    preceded by a padding record that sends the reader back to the start.
+*/
+struct ShmRing {
+    void init(uint32_t capacity);
+
+    /** Whether capacity is usable: a power of two of at least 4096. */
+    static bool validCapacity(uint32_t capacity)
+    {
+        return capacity >= 4096 && !(capacity & (capacity - 1));
+    }
+
+    char * data() { return reinterpret_cast<char *>(this + 1); }
+    const char * data() const
+    {
+        return reinterpret_cast<const char *>(this + 1);
+    }
+
+    uint32_t capacity;  ///< Size of the data that follows; a power of two
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+};
+
+static_assert(sizeof(ShmRing) % 64 == 0, "ShmRing must keep data aligned");
+
+/** Types of records.
+
+    SHM_MESSAGE is a uint32 count followed by that many strings.
+
+    SHM_AUCTION is the router's AUCTION message:
+        double start (seconds since the epoch), double timeLeftMs,
+        string id, string bid request format, string bid request,
+        uint32 number of spots, and for each of them int32 spot index,
+        uint32 number of creatives and a uint16 per creative index,
+        string augmentations, string win cost model (JSON).
+*/
+enum ShmRecordType {
+    SHM_PADDING = 0,  ///< Skip to the start of the ring
+    SHM_MESSAGE = 1,  ///< List of strings, as they would be sent over zmq
+    SHM_AUCTION = 2   ///< AUCTION message in binary form
+};
+
+struct ShmRecord {
+    uint32_t size;   ///< Size of the payload that follows
+    uint32_t type;   ///< One of ShmRecordType
+
+    static uint32_t totalSize(size_t payloadSize)
+    {
+        return (sizeof(ShmRecord) + payloadSize + 7) & ~7;
+    }
+};
+
+
+/*****************************************************************************/
+/* SHM RING WRITER                                                           */
+/*****************************************************************************/
+
+/** Producer side of a ShmRing.
+
+    commit() returns true when the consumer had read everything that was
+    in the ring before the new record, in which case it may be about to
+    sleep and the caller needs to wake it up.  A consumer that is busy
+    draining the ring will see the new record when it re-reads head after
+    releasing the previous one, so it doesn't need any system call.
+*/
+struct ShmRingWriter {
+    ShmRingWriter()
+        : ring_(0), capacity_(0), head_(0), tail_(0), start_(0), reserved_(0)
+    {
+    }
+
+    /** Write to the given ring, which must have the given capacity.  The
+        capacity is kept here rather than read from the shared segment,
+        which the other side could overwrite. */
+    void init(ShmRing * ring, uint32_t capacity);
+
+    /** Largest payload that reserve() accepts: half of the ring. */
+    size_t maxRecordSize() const
+    {
+        return capacity_ / 2 - sizeof(ShmRecord);
+    }
+
+    /** Reserve room for a record with the given type and payload size.
+        Returns a pointer to the payload, or null if the ring is full or
+        the payload is larger than maxRecordSize().
+    */
+    char * reserve(uint32_t type, size_t size);
+
+    /** Publish the record obtained from reserve().  Returns true if the
+        consumer needs to be woken up.
+    */
+    bool commit();
+
+private:
+    ShmRing * ring_;
+    uint32_t capacity_;
+    uint64_t head_;      ///< Our copy of head, including reserved records
+    uint64_t tail_;      ///< Last value of tail we read
+    uint64_t start_;     ///< Value of head before the reserved record
+    uint32_t reserved_;  ///< Total size of the reserved record
+};
+
+
+/*****************************************************************************/
+/* SHM RING READER                                                           */
+/*****************************************************************************/
+
+/** Consumer side of a ShmRing.  Each record returned by read() must be
+    released with consume() before the next one is read.
+*/
+struct ShmRingReader {
+    ShmRingReader()
+        : ring_(0), capacity_(0), tail_(0), head_(0), current_(0)
+    {
+    }
+
+    /** Read from the given ring, which must have the given capacity. */
+    void init(ShmRing * ring, uint32_t capacity);
+
+    /** Returns the payload of the next record, or null if there is none.
+        Throws if the record doesn't fit in what the writer published. */
+    const char * read(uint32_t & type, uint32_t & size);
+
+    /** Release the record returned by the last call to read(). */
+    void consume();
+
+private:
+    ShmRing * ring_;
+    uint32_t capacity_;
+    uint64_t tail_;
+    uint64_t head_;      ///< Last value of head we read
+    uint32_t current_;   ///< Total size of the record being read
+};
+
+
+/*****************************************************************************/
+/* SHM MESSAGE WRITER / READER                                               */
+/*****************************************************************************/
+
+/** Encoding of the fields of a record: strings are a 32 bit length
+    followed by the bytes, numbers are in native byte order.  Both ends of
+    a channel are on the same host so nothing needs to be portable.
+*/
+struct ShmMessageWriter {
+    ShmMessageWriter(char * data)
+        : p(data)
+    {
+    }
+
+    static size_t stringSize(size_t length)
+    {
+        return sizeof(uint32_t) + length;
+    }
+
+    static size_t stringSize(const std::string & str)
+    {
+        return stringSize(str.size());
+    }
+
+    template<typename T>
+    void write(T val)
+    {
+        std::memcpy(p, &val, sizeof(val));
+        p += sizeof(val);
+    }
+
+    void writeString(const char * data, size_t length)
+    {
+        write<uint32_t>(length);
+        std::memcpy(p, data, length);
+        p += length;
+    }
+
+    void writeString(const std::string & str)
+    {
+        writeString(str.data(), str.size());
+    }
+
+    char * p;
+};
+
+struct ShmMessageReader {
+    ShmMessageReader(const char * data, size_t size)
+        : p(data), end(data + size)
+    {
+    }
+
+    template<typename T>
+    T read()
+    {
+        check(sizeof(T));
+        T result;
+        std::memcpy(&result, p, sizeof(T));
+        p += sizeof(T);
+        return result;
+    }
+
+    /** Return a pointer to the next string and its length, without
+        copying it. */
+    const char * readString(size_t & length)
+    {
+        length = read<uint32_t>();
+        check(length);
+        const char * result = p;
+        p += length;
+        return result;
+    }
+
+    std::string readString()
+    {
+        size_t length;
+        const char * data = readString(length);
+        return std::string(data, length);
+    }
+
+    bool done() const { return p == end; }
+
+    const char * p;
+    const char * end;
+
+private:
+    void check(size_t size) const
+    {
+        if (size > size_t(end - p))
+            throw ML::Exception("truncated shared memory message");
+    }
+};
+
+
+/*****************************************************************************/
+/* SHM CHANNEL                                                               */
+/*****************************************************************************/
+
+/** Shared memory segment holding a ring in each direction between a
+    router and one bidding agent.
+
+    The agent creates the segment and passes its file descriptor to the
+    router over a unix socket (see connectShmSocket), along with an
+    eventfd that the router signals when it writes to toAgent; the router
+    answers with the eventfd it wants to be signalled on.
+*/
+struct ShmChannel {
+    ~ShmChannel();
+
+    /** Create a new, anonymous segment with rings of the given capacity,
+        which is rounded up to a power of two. */
+    static std::shared_ptr<ShmChannel> create(uint32_t ringCapacity);
+
+    /** Map the segment behind the given file descriptor, as created by
+        create() in another process.  Takes ownership of the descriptor.
+        Throws if the header or the rings' capacities are invalid. */
+    static std::shared_ptr<ShmChannel> attach(int fd);
+
+    int fd() const { return fd_; }
+
+    /** Capacity of each ring, as validated when the segment was mapped. */
+    uint32_t ringCapacity() const { return capacity_; }
+
+    ShmRing * toAgent;
+    ShmRing * toRouter;
+
+private:
+    ShmChannel(int fd, void * mem, size_t size, uint32_t capacity);
+
+    int fd_;
+    void * mem_;
+    size_t size_;
+    uint32_t capacity_;
+};
+
+
+/*****************************************************************************/
+/* SHM ENDPOINT                                                              */
+/*****************************************************************************/
+
+/** One end of a ShmChannel: writes on one of the rings and reads from the
+    other, and signals the peer's eventfd when it needs waking up.
+
+    Writes must be serialized by the caller, and so must reads.
+*/
+struct ShmEndpoint {
+    /** Create the router's or the agent's end of the given channel.  Takes
+        ownership of peerWakeupFd. */
+    ShmEndpoint(std::shared_ptr<ShmChannel> channel, bool isRouter,
+                int peerWakeupFd);
+
+    ~ShmEndpoint();
+
+    ShmEndpoint(const ShmEndpoint & other) = delete;
+    ShmEndpoint & operator = (const ShmEndpoint & other) = delete;
+
+    /** Start a record of the given type and payload size.  Returns null if
+        the ring is full or the record is larger than maxRecordSize(). */
+    char * beginRecord(uint32_t type, size_t size)
+    {
+        return writer.reserve(type, size);
+    }
+
+    /** Largest payload that can be sent. */
+    size_t maxRecordSize() const { return writer.maxRecordSize(); }
+
+    /** Publish the record started by beginRecord(). */
+    void endRecord();
+
+    /** Size of the payload of the SHM_MESSAGE for the given strings. */
+    static size_t messageSize(const std::vector<std::string> & message);
+
+    /** Send a list of strings as a SHM_MESSAGE.  Returns false if the ring
+        is full or the message is too large for it. */
+    bool sendMessage(const std::vector<std::string> & message);
+
+    /** Decode a SHM_MESSAGE record, appending its fields to message. */
+    static void decodeMessage(ShmMessageReader & reader,
+                              std::vector<std::string> & message);
+
+    /** Call onRecord(type, reader) for up to maxRecords records waiting to
+        be read.  Returns the number of records read. */
+    template<typename OnRecord>
+    size_t processRecords(const OnRecord & onRecord,
+                          size_t maxRecords = -1)
+    {
+        size_t n = 0;
+        uint32_t type, size;
+        const char * data;
+        while (n < maxRecords && (data = reader.read(type, size))) {
+            ++n;
+            ShmMessageReader message(data, size);
+            try {
+                onRecord(type, message);
+            } catch (...) {
+                reader.consume();
+                throw;
+            }
+            reader.consume();
+        }
+        return n;
+    }
+
+    std::shared_ptr<ShmChannel> channel;
+
+private:
+    ShmRingWriter writer;
+    ShmRingReader reader;
+    int peerWakeupFd;
+};
+
+
+/*****************************************************************************/
+/* SHM SOCKETS                                                               */
+/*****************************************************************************/
+
+/** Listen on the unix socket, in the abstract namespace, on which agents
+    attach to the shared memory transport of the given router.  Returns
+    the listening socket. */
+int bindShmSocket(const std::string & routerName);
+
+/** Connect to the socket of the given router.  Returns -1 if the router
+    doesn't accept shared memory connections. */
+int connectShmSocket(const std::string & routerName);
+
+/** Send a short message along with the given file descriptors. */
+void sendWithFds(int sock, const std::string & message,
+                 const std::vector<int> & fds);
+
+/** Receive a message sent with sendWithFds().  Received descriptors are
+    appended to fds.  Returns an empty string if the peer closed the
+    connection. */
+std::string recvWithFds(int sock, std::vector<int> & fds);
+
+} // namespace RTBKIT
@@ -0,0 +1,192 @@
+/* admission_controller_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Simulates a router that can only handle part of its bid requests, and
+   compares the revenue per CPU-second that it gets out of them when it
+   sheds load at random and when it sheds it by value.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/admission_controller.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+enum {
+    NumExchanges = 4,
+    NumSites = 20000,
+    NumRequests = 2000000
+};
+
+/** CPU that the router spends on a request that is parsed and then
+    dropped, and on one that goes through a whole auction.
+*/
+const double ParseCost = 15e-6;
+const double AuctionCost = 150e-6;
+
+/** Proportion of the requests that the router has the CPU for. */
+const double KeepFraction = 0.3;
+
+struct Site {
+    BidRequest request;
+    int potentialBidders;   ///< Agents that pass the static filters
+    double bidRate;         ///< Probability that one of them bids
+    double price;           ///< What they bid
+};
+
+/** The sites, with an inventory that follows a Zipf distribution.  Most of
+    them are of no interest to our agents; of those that are, some are a
+    lot more valuable than others.
+*/
+struct Inventory {
+    Inventory()
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<double> uniform;
+        std::lognormal_distribution<double> prices(std::log(1000.0), 1.0);
+
+        double total = 0;
+        for (int i = 0;  i < NumSites;  ++i) {
+            Site site;
+            site.request.exchange
+                = ML::format("exchange%d", i % NumExchanges);
+            site.request.site.reset(new OpenRTB::Site());
+            site.request.site->id = Id(i + 1);
+
+            // Exchanges differ in how interesting their inventory is
+            bool interesting = uniform(rng) < 0.2 + 0.1 * (i % NumExchanges);
+            site.potentialBidders = interesting ? 1 + rng() % 5 : 0;
+            site.bidRate = interesting
+                ? uniform(rng) * 0.6 * site.potentialBidders / 5 : 0.0;
+            site.price = prices(rng);
+            sites.push_back(std::move(site));
+
+            total += 1.0 / (i + 1);
+            cdf.push_back(total);
+        }
+
+        for (auto & c: cdf)
+            c /= total;
+    }
+
+    Site & sample(double u)
+    {
+        return sites[std::lower_bound(cdf.begin(), cdf.end(), u)
+                     - cdf.begin()];
+    }
+
+    vector<Site> sites;
+    vector<double> cdf;
+};
+
+struct Result {
+    Result()
+        : admitted(0), bids(0), revenue(0), cpu(0)
+    {
+    }
+
+    size_t admitted;
+    size_t bids;
+    double revenue;
+    double cpu;
+};
+
+/** Run the same sequence of requests through the controller.  Learning
+    happens as the requests go, the same way as auctionDone() would do
+    it.
+*/
+Result simulate(AdmissionController & controller, Inventory & inventory)
+{
+    auto value = dynamic_cast<ValueAdmissionController *>(&controller);
+
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> uniform;
+
+    vector<Site *> requests;
+    Result result;
+
+    for (int i = 0;  i < NumRequests;  ++i) {
+        Site & site = inventory.sample(uniform(rng));
+        requests.push_back(&site);
+
+        bool bid = uniform(rng) < site.bidRate;
+        if (!controller.admit(site.request, KeepFraction))
+            continue;
+
+        ++result.admitted;
+        if (bid) {
+            ++result.bids;
+            result.revenue += site.price;
+        }
+        if (value)
+            value->record(site.request, site.potentialBidders, bid,
+                          bid ? site.price : 0.0);
+    }
+
+    // What admit() costs once it has learnt, timed on its own
+    Timer timer;
+    for (auto site: requests)
+        controller.admit(site->request, KeepFraction);
+    double admitCost = timer.elapsed_cpu() / requests.size();
+
+    result.cpu = NumRequests * (ParseCost + admitCost)
+        + result.admitted * AuctionCost;
+
+    cerr << ML::format("admit() takes %.3fus", admitCost * 1e6) << endl;
+
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_admission_control )
+{
+    Inventory inventory;
+
+    RandomAdmissionController random;
+    ValueAdmissionController value;
+
+    Result byRandom = simulate(random, inventory);
+    Result byValue = simulate(value, inventory);
+
+    auto report = [&] (const string & name, const Result & result)
+        {
+            cerr << ML::format("%-8s admitted %5.1f%%  bids %7zd  "
+                               "revenue %12.0f  cpu %6.2fs  "
+                               "revenue/cpu-s %10.0f",
+                               name.c_str(),
+                               100.0 * result.admitted / NumRequests,
+                               result.bids, result.revenue, result.cpu,
+                               result.revenue / result.cpu)
+                 << endl;
+        };
+
+    report("random", byRandom);
+    report("value", byValue);
+
+    cerr << ML::format("value shedding gets %.2fx the revenue per "
+                       "CPU-second of random shedding",
+                       (byValue.revenue / byValue.cpu)
+                       / (byRandom.revenue / byRandom.cpu))
+         << endl;
+
+    // Both keep to the budget, and picking helps
+    BOOST_CHECK_CLOSE(byRandom.admitted / double(NumRequests),
+                      KeepFraction, 2.0);
+    BOOST_CHECK_CLOSE(byValue.admitted / double(NumRequests),
+                      KeepFraction, 5.0);
+    BOOST_CHECK_GT(byValue.revenue, byRandom.revenue);
+}
@@ -0,0 +1,136 @@
+/* admission_controller_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the admission controllers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/admission_controller.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+BidRequest makeRequest(const std::string & exchange, int site)
+{
+    BidRequest result;
+    result.exchange = exchange;
+    result.site.reset(new OpenRTB::Site());
+    result.site->id = Id(site);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_create )
+{
+    Json::Value config;
+    config["type"] = "random";
+    auto controller = AdmissionController::create(config);
+    BOOST_CHECK(dynamic_cast<RandomAdmissionController *>(controller.get()));
+
+    config = Json::Value();
+    config["exploreProbability"] = 0.1;
+    controller = AdmissionController::create(config);
+    auto value = dynamic_cast<ValueAdmissionController *>(controller.get());
+    BOOST_REQUIRE(value);
+    BOOST_CHECK_EQUAL(value->exploreProbability, 0.1);
+
+    config["exploreProbability"] = 2.0;
+    BOOST_CHECK_THROW(AdmissionController::create(config), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_random_admission )
+{
+    RandomAdmissionController controller;
+    BidRequest request = makeRequest("ex", 1);
+
+    int admitted = 0;
+    for (int i = 0;  i < 100000;  ++i)
+        admitted += controller.admit(request, 0.3);
+
+    BOOST_CHECK_CLOSE(admitted / 100000.0, 0.3, 3.0);
+    BOOST_CHECK(controller.admit(request, 1.0));
+}
+
+BOOST_AUTO_TEST_CASE( test_prior_from_exchange )
+{
+    ValueAdmissionController controller;
+
+    // Exchange "good" gets bids on half of its requests from sites where
+    // two agents are interested; "bad" never does.
+    for (int site = 0;  site < 100;  ++site) {
+        for (int i = 0;  i < 10;  ++i) {
+            controller.record(makeRequest("good", site), 2, i % 2, 1000);
+            controller.record(makeRequest("bad", site), 2, false, 0);
+        }
+    }
+
+    // Sites we have never seen take after their exchange
+    BOOST_CHECK_GT(controller.score(makeRequest("good", 1000)),
+                   10 * controller.score(makeRequest("bad", 1000)));
+
+    // A site no agent is interested in is worth less than an unknown one,
+    // even before it has had many requests
+    for (int i = 0;  i < 5;  ++i)
+        controller.record(makeRequest("good", 2000), 0, false, 0);
+    BOOST_CHECK_LT(controller.score(makeRequest("good", 2000)),
+                   controller.score(makeRequest("good", 1000)) / 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_admits_the_most_valuable )
+{
+    Json::Value config;
+    config["exploreProbability"] = 0.0;
+    ValueAdmissionController controller(config);
+
+    // One site in ten gets bids
+    enum { NumSites = 100 };
+    auto isValuable = [] (int site) { return site % 10 == 0; };
+
+    for (int site = 0;  site < NumSites;  ++site)
+        for (int i = 0;  i < 50;  ++i)
+            controller.record(makeRequest("ex", site), 1,
+                              isValuable(site), isValuable(site) ? 1000 : 0);
+
+    vector<BidRequest> requests;
+    for (int site = 0;  site < NumSites;  ++site)
+        requests.push_back(makeRequest("ex", site));
+
+    // Warm up the thresholds
+    for (int i = 0;  i < 10000;  ++i)
+        controller.admit(requests[i % NumSites], 1.0);
+
+    // We can take a quarter of the requests: all of the valuable ones get
+    // in and the rest is made up with the others.
+    int valuable = 0, valuableAdmitted = 0, admitted = 0;
+    enum { NumRequests = 100000 };
+    for (int i = 0;  i < NumRequests;  ++i) {
+        int site = (i * 7) % NumSites;
+        bool ok = controller.admit(requests[site], 0.25);
+        admitted += ok;
+        valuable += isValuable(site);
+        valuableAdmitted += ok && isValuable(site);
+    }
+
+    BOOST_CHECK_EQUAL(valuableAdmitted, valuable);
+    BOOST_CHECK_CLOSE(admitted / double(NumRequests), 0.25, 5.0);
+
+    // When we can't even take those, it's only them that get in
+    valuableAdmitted = admitted = 0;
+    for (int i = 0;  i < NumRequests;  ++i) {
+        int site = (i * 7) % NumSites;
+        bool ok = controller.admit(requests[site], 0.05);
+        admitted += ok;
+        valuableAdmitted += ok && isValuable(site);
+    }
+
+    BOOST_CHECK_EQUAL(valuableAdmitted, admitted);
+    BOOST_CHECK_CLOSE(admitted / double(NumRequests), 0.05, 5.0);
+}
@@ -4,3 +4,8 @@ $(eval $(call library,bid_request_synth,bid_request_synth.cc,arch utils jsoncpp)
 $(eval $(call test,bid_request_synth_test,bid_request_synth,boost))
 $(eval $(call test,currency_test,bid_request,boost))
 $(eval $(call test,filter_test,filter_registry,boost))
+$(eval $(call test,serialization_bench,bid_request rtb,boost manual))
+$(eval $(call test,shm_channel_test,rtb,boost))
+$(eval $(call test,shm_channel_bench,rtb,boost manual))
+$(eval $(call test,admission_controller_test,rtb,boost))
+$(eval $(call test,admission_controller_bench,rtb,boost manual))
@@ -0,0 +1,175 @@
+/* serialization_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compares binary serialization through an iostream with the memory
+   buffer mode of the archives for the messages that go across the
+   router and the post auction loop.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/bid_request.h"
+#include "rtbkit/common/auction.h"
+#include "rtbkit/common/auction_events.h"
+#include "jml/db/persistent.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <sstream>
+#include <iostream>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+BidRequest makeBidRequest(int i)
+{
+    BidRequest result;
+
+    FormatSet formats;
+    formats.push_back(Format(160,600));
+    AdSpot spot;
+    spot.id = Id(1);
+    spot.formats = formats;
+    result.imp.push_back(spot);
+
+    formats[0] = Format(300,250);
+    spot.id = Id(2);
+    result.imp.push_back(spot);
+
+    result.location.countryCode = "CA";
+    result.location.regionCode = "QC";
+    result.location.cityName = "Montreal";
+    result.auctionId = Id(i + 1);
+    result.exchange = "mock";
+    result.language = "en";
+    result.url = Url("http://datacratic.com/some/page?i=" + to_string(i));
+    result.userAgent = "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36";
+    result.userIds.add(Id(i * 7 + 1), ID_EXCHANGE);
+    result.userIds.add(Id(i * 13 + 1), ID_PROVIDER);
+    result.timestamp = Date::now();
+    result.segments.addInts("iab", { 1, 3, 7, 12 });
+
+    return result;
+}
+
+Auction::Response makeResponse(int i)
+{
+    Auction::Response result(USD_CPM(2), 1, AccountKey("a.b.c"));
+    result.agent = "agent" + to_string(i % 10);
+    result.bidData = "{\"bids\":[{\"spotIndex\":0}]}";
+    result.meta = "{\"campaign\":" + to_string(i) + "}";
+    result.creativeName = "creative";
+    return result;
+}
+
+PostAuctionEvent makeEvent(int i)
+{
+    PostAuctionEvent result;
+    result.type = PAE_WIN;
+    result.auctionId = Id(i + 1);
+    result.adSpotId = Id(1);
+    result.winPrice = USD_CPM(1);
+    result.timestamp = Date::now();
+    result.account = AccountKey("a.b.c");
+    result.bidTimestamp = Date::now();
+    return result;
+}
+
+template<typename T>
+std::string serializeWithStream(const T & t)
+{
+    std::ostringstream stream;
+    ML::DB::Store_Writer writer(stream);
+    t.serialize(writer);
+    return stream.str();
+}
+
+template<typename T>
+T reconstituteWithStream(const std::string & str)
+{
+    std::istringstream stream(str);
+    ML::DB::Store_Reader store(stream);
+    T result;
+    result.reconstitute(store);
+    return result;
+}
+
+template<typename T>
+void bench(const std::string & name, const std::vector<T> & objects,
+           int iterations)
+{
+    size_t bytes = 0;
+    size_t n = objects.size() * iterations;
+
+    // Check first that both give exactly the same bytes
+    for (auto & o: objects)
+        BOOST_REQUIRE_EQUAL(serializeWithStream(o),
+                            ML::DB::serializeToString(o));
+
+    auto run = [&] (const std::string & mode, bool useBuffer)
+        {
+            double serializeTime = 0.0, reconstituteTime = 0.0;
+
+            for (int it = 0;  it < iterations;  ++it) {
+                std::vector<std::string> serialized;
+                serialized.reserve(objects.size());
+
+                Timer timer;
+                for (auto & o: objects) {
+                    if (useBuffer)
+                        serialized.push_back(ML::DB::serializeToString(o));
+                    else serialized.push_back(serializeWithStream(o));
+                }
+                serializeTime += timer.elapsed_wall();
+
+                bytes = 0;
+                timer.restart();
+                for (auto & s: serialized) {
+                    bytes += s.size();
+                    if (useBuffer)
+                        ML::DB::reconstituteFromString<T>(s);
+                    else reconstituteWithStream<T>(s);
+                }
+                reconstituteTime += timer.elapsed_wall();
+            }
+
+            cerr << ML::format("%-20s %-8s %8.3fus serialize %8.3fus "
+                               "reconstitute (%zd bytes avg)",
+                               name.c_str(), mode.c_str(),
+                               serializeTime * 1e6 / n,
+                               reconstituteTime * 1e6 / n,
+                               bytes / objects.size())
+                 << endl;
+        };
+
+    run("stream", false);
+    run("buffer", true);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_serialization )
+{
+    int n = 10000;
+    int iterations = 10;
+
+    std::vector<BidRequest> bidRequests;
+    std::vector<Auction::Response> responses;
+    std::vector<PostAuctionEvent> events;
+
+    for (int i = 0;  i < n;  ++i) {
+        bidRequests.push_back(makeBidRequest(i));
+        responses.push_back(makeResponse(i));
+        events.push_back(makeEvent(i));
+    }
+
+    bench("BidRequest", bidRequests, iterations);
+    bench("Auction::Response", responses, iterations);
+    bench("PostAuctionEvent", events, iterations);
+}
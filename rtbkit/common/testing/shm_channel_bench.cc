@@ -0,0 +1,198 @@
+/* shm_channel_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Round trip latency of an AUCTION / BID exchange between the router and
+   an agent over a shared memory channel, compared with zmq over ipc.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/shm_channel.h"
+#include "soa/service/zmq_utils.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+enum { NumRoundTrips = 100000 };
+
+/** Fields of an AUCTION message of about the size the router sends. */
+vector<string> makeAuction()
+{
+    return {
+        "AUCTION", "1400000000.12345", "a1b2c3d4-e5f6-1234-5678-9abcdef01234",
+        "datacratic", string(1200, 'x'), "[[0,[0,1,2]]]", "95.000000",
+        "{\"seg\":{\"tags\":[\"a\",\"b\"]}}", "{\"type\":\"none\"}"
+    };
+}
+
+/** Fields of the BID the agent sends back. */
+vector<string> makeBid()
+{
+    return {
+        "BID", "a1b2c3d4-e5f6-1234-5678-9abcdef01234",
+        "{\"bids\":[{\"spotIndex\":0,\"creatives\":[0],"
+        "\"price\":\"100USD/1M\",\"priority\":0}]}",
+        "null", "{}"
+    };
+}
+
+void report(const string & name, vector<double> & latencies, double elapsed)
+{
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+
+    cerr << ML::format("%-6s median %8.2fus  p99 %8.2fus  max %8.2fus  "
+                       "%9.0f round trips/s",
+                       name.c_str(),
+                       latencies[n / 2] * 1e6,
+                       latencies[n * 99 / 100] * 1e6,
+                       latencies.back() * 1e6,
+                       n / elapsed)
+         << endl;
+}
+
+/** Block until the eventfd is signalled, the same way the agent and the
+    router do when their ring is empty. */
+void waitFor(int fd)
+{
+    pollfd pfd = { fd, POLLIN, 0 };
+    ::poll(&pfd, 1, -1);
+    eventfd_t val;
+    ::eventfd_read(fd, &val);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_shm_ping_pong )
+{
+    auto channel = ShmChannel::create(4 * 1024 * 1024);
+
+    int routerFd = ::eventfd(0, EFD_NONBLOCK);
+    int agentFd = ::eventfd(0, EFD_NONBLOCK);
+
+    ShmEndpoint router(channel, true, ::dup(agentFd));
+    ShmEndpoint agent(channel, false, ::dup(routerFd));
+
+    auto auction = makeAuction();
+    auto bid = makeBid();
+
+    auto doAgent = [&] ()
+        {
+            vector<string> message;
+            for (int i = 0;  i < NumRoundTrips;) {
+                size_t n = agent.processRecords(
+                        [&] (uint32_t type, ShmMessageReader & reader)
+                        {
+                            message.clear();
+                            ShmEndpoint::decodeMessage(reader, message);
+                            agent.sendMessage(bid);
+                        });
+                if (n) i += n;
+                else waitFor(agentFd);
+            }
+        };
+
+    std::thread agentThread(doAgent);
+
+    vector<double> latencies;
+    latencies.reserve(NumRoundTrips);
+    vector<string> message;
+
+    Timer total;
+    for (int i = 0;  i < NumRoundTrips;  ++i) {
+        Timer timer;
+        BOOST_REQUIRE(router.sendMessage(auction));
+
+        size_t n = 0;
+        while (!n) {
+            n = router.processRecords(
+                    [&] (uint32_t type, ShmMessageReader & reader)
+                    {
+                        message.clear();
+                        ShmEndpoint::decodeMessage(reader, message);
+                    });
+            if (!n) waitFor(routerFd);
+        }
+        latencies.push_back(timer.elapsed_wall());
+    }
+    double elapsed = total.elapsed_wall();
+
+    agentThread.join();
+    BOOST_CHECK_EQUAL(message.size(), bid.size());
+
+    report("shm", latencies, elapsed);
+
+    ::close(routerFd);
+    ::close(agentFd);
+}
+
+BOOST_AUTO_TEST_CASE( bench_zmq_ping_pong )
+{
+    zmq::context_t context(1);
+
+    string uri = ML::format("ipc:///tmp/shm_channel_bench-%d", getpid());
+
+    zmq::socket_t routerSock(context, ZMQ_ROUTER);
+    setIdentity(routerSock, "router");
+    routerSock.bind(uri.c_str());
+
+    auto auction = makeAuction();
+    auto bid = makeBid();
+
+    auto doAgent = [&] ()
+        {
+            zmq::socket_t agentSock(context, ZMQ_DEALER);
+            setIdentity(agentSock, "agent");
+            agentSock.connect(uri.c_str());
+
+            // Let the router know we're there
+            sendAll(agentSock, { "HELLO" });
+
+            for (int i = 0;  i < NumRoundTrips;  ++i) {
+                recvAll(agentSock);
+                sendAll(agentSock, bid);
+            }
+        };
+
+    std::thread agentThread(doAgent);
+
+    recvAll(routerSock);
+
+    vector<string> routed = auction;
+    routed.insert(routed.begin(), "agent");
+
+    vector<double> latencies;
+    latencies.reserve(NumRoundTrips);
+    vector<string> message;
+
+    Timer total;
+    for (int i = 0;  i < NumRoundTrips;  ++i) {
+        Timer timer;
+        sendAll(routerSock, routed);
+        message = recvAll(routerSock);
+        latencies.push_back(timer.elapsed_wall());
+    }
+    double elapsed = total.elapsed_wall();
+
+    agentThread.join();
+    BOOST_CHECK_EQUAL(message.size(), bid.size() + 1);
+
+    report("zmq", latencies, elapsed);
+
+    ::unlink(uri.c_str() + 6);
+}
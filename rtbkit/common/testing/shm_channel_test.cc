@@ -0,0 +1,292 @@
+/* shm_channel_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the shared memory channel between the router and the agents.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/shm_channel.h"
+#include "jml/arch/format.h"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace std;
+using namespace RTBKIT;
+
+
+namespace {
+
+/** Fill a payload of the given size from the given sequence number so that
+    it can be checked on the other side. */
+void fill(char * data, size_t size, uint64_t seq)
+{
+    for (size_t i = 0;  i < size;  ++i)
+        data[i] = char(seq * 31 + i);
+}
+
+bool check(const char * data, size_t size, uint64_t seq)
+{
+    for (size_t i = 0;  i < size;  ++i)
+        if (data[i] != char(seq * 31 + i))
+            return false;
+    return true;
+}
+
+size_t sizeFor(uint64_t seq)
+{
+    return (seq * 7919) % 1500;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_ring_wraps_around )
+{
+    auto channel = ShmChannel::create(4096);
+
+    ShmRingWriter writer;
+    ShmRingReader reader;
+    writer.init(channel->toAgent, channel->ringCapacity());
+    reader.init(channel->toAgent, channel->ringCapacity());
+
+    uint64_t written = 0, read = 0;
+
+    // Fill the ring up, then drain it; the record sizes are chosen so that
+    // the records land at every possible offset and need padding.
+    for (unsigned round = 0;  round < 1000;  ++round) {
+        for (;;) {
+            size_t size = sizeFor(written);
+            char * data = writer.reserve(SHM_MESSAGE, size);
+            if (!data) break;
+            fill(data, size, written++);
+            writer.commit();
+        }
+
+        BOOST_REQUIRE_GT(written, read);
+
+        uint32_t type, size;
+        while (const char * data = reader.read(type, size)) {
+            BOOST_REQUIRE_EQUAL(type, SHM_MESSAGE);
+            BOOST_REQUIRE_EQUAL(size, sizeFor(read));
+            BOOST_REQUIRE(check(data, size, read));
+            reader.consume();
+            ++read;
+        }
+
+        BOOST_REQUIRE_EQUAL(read, written);
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE( test_oversized_records )
+{
+    auto channel = ShmChannel::create(4096);
+
+    int wakeupFd = ::eventfd(0, EFD_NONBLOCK);
+    ShmEndpoint router(channel, true, ::dup(wakeupFd));
+    ShmEndpoint agent(channel, false, ::dup(wakeupFd));
+
+    BOOST_CHECK_EQUAL(router.maxRecordSize(), 2048 - sizeof(ShmRecord));
+
+    // An auction of more than half of the ring is refused rather than
+    // throwing, so that the caller can send it some other way
+    BOOST_CHECK(!router.beginRecord(SHM_AUCTION, 3000));
+    BOOST_CHECK(!router.beginRecord(SHM_AUCTION, router.maxRecordSize() + 1));
+    BOOST_CHECK(!router.beginRecord(SHM_AUCTION, size_t(-1)));
+    BOOST_CHECK(!router.sendMessage({ "AUCTION", string(3000, 'x') }));
+
+    // and the ring is still usable
+    char * data = router.beginRecord(SHM_AUCTION, router.maxRecordSize());
+    BOOST_REQUIRE(data);
+    fill(data, router.maxRecordSize(), 1);
+    router.endRecord();
+
+    size_t n = agent.processRecords(
+            [&] (uint32_t type, ShmMessageReader & reader)
+            {
+                BOOST_CHECK_EQUAL(type, SHM_AUCTION);
+                BOOST_CHECK_EQUAL(reader.end - reader.p,
+                                  router.maxRecordSize());
+                BOOST_CHECK(check(reader.p, reader.end - reader.p, 1));
+            });
+    BOOST_CHECK_EQUAL(n, 1);
+
+    ::close(wakeupFd);
+}
+
+BOOST_AUTO_TEST_CASE( test_corrupt_ring )
+{
+    auto channel = ShmChannel::create(4096);
+    ShmRing * ring = channel->toRouter;
+
+    ShmRingReader reader;
+    reader.init(ring, channel->ringCapacity());
+
+    auto publish = [&] (uint32_t size, uint32_t type, uint64_t length = 8)
+        {
+            auto record = reinterpret_cast<ShmRecord *>(ring->data());
+            record->size = size;
+            record->type = type;
+            ring->head = ring->tail + length;
+        };
+
+    uint32_t type, size;
+
+    // Sizes that round up to 8 or to 0 once truncated to 32 bits
+    publish(0xfffffff9, SHM_MESSAGE);
+    BOOST_CHECK_THROW(reader.read(type, size), ML::Exception);
+    publish(0xfffffff8, SHM_PADDING);
+    BOOST_CHECK_THROW(reader.read(type, size), ML::Exception);
+
+    // A record that goes past the end of the ring or of what was published
+    publish(4096, SHM_MESSAGE);
+    BOOST_CHECK_THROW(reader.read(type, size), ML::Exception);
+    publish(8, SHM_MESSAGE);
+    BOOST_CHECK_THROW(reader.read(type, size), ML::Exception);
+
+    // Changing the capacity in the segment doesn't change what we use
+    ring->capacity = 1 << 30;
+    publish(6000, SHM_MESSAGE, 8192);
+    BOOST_CHECK_THROW(reader.read(type, size), ML::Exception);
+
+    // and a segment whose rings don't have the advertised capacity is
+    // refused
+    BOOST_CHECK_THROW(ShmChannel::attach(::dup(channel->fd())),
+                      ML::Exception);
+    ring->capacity = 4096;
+    BOOST_CHECK(ShmChannel::attach(::dup(channel->fd())));
+
+    // as is one whose capacity isn't a power of two, whatever its size
+    uint32_t capacity = 6000;
+    BOOST_REQUIRE_EQUAL(::pwrite(channel->fd(), &capacity, sizeof(capacity),
+                                 12),
+                        sizeof(capacity));
+    BOOST_REQUIRE_EQUAL(::ftruncate(channel->fd(),
+                                    64 + 2 * (sizeof(ShmRing) + capacity)),
+                        0);
+    BOOST_CHECK_THROW(ShmChannel::attach(::dup(channel->fd())),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_wakeups_are_not_lost )
+{
+    auto channel = ShmChannel::create(65536);
+
+    int routerFd = ::eventfd(0, EFD_NONBLOCK);
+    int agentFd = ::eventfd(0, EFD_NONBLOCK);
+
+    ShmEndpoint router(channel, true, ::dup(agentFd));
+    ShmEndpoint agent(channel, false, ::dup(routerFd));
+
+    enum { NumMessages = 1000000 };
+
+    // The agent only ever blocks on its eventfd; if a wakeup is lost it
+    // times out instead of reading the rest.
+    std::atomic<bool> timedOut(false);
+
+    auto doAgent = [&] ()
+        {
+            uint64_t expected = 0;
+            while (expected < NumMessages) {
+                size_t n = agent.processRecords(
+                        [&] (uint32_t type, ShmMessageReader & reader)
+                        {
+                            size_t size = sizeFor(expected);
+                            BOOST_REQUIRE_EQUAL(reader.read<uint64_t>(),
+                                                expected);
+                            size_t length;
+                            const char * data = reader.readString(length);
+                            BOOST_REQUIRE_EQUAL(length, size);
+                            BOOST_REQUIRE(check(data, size, expected));
+                            ++expected;
+                        });
+                if (n) continue;
+
+                pollfd fd = { agentFd, POLLIN, 0 };
+                if (::poll(&fd, 1, 5000) == 0) {
+                    timedOut = true;
+                    return;
+                }
+                eventfd_t val;
+                ::eventfd_read(agentFd, &val);
+            }
+        };
+
+    std::thread agentThread(doAgent);
+
+    for (uint64_t seq = 0;  seq < NumMessages && !timedOut;) {
+        size_t size = sizeFor(seq);
+        char * data = router.beginRecord(SHM_AUCTION,
+                                         sizeof(uint64_t)
+                                         + ShmMessageWriter::stringSize(size));
+        if (!data) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        ShmMessageWriter writer(data);
+        writer.write<uint64_t>(seq);
+        writer.write<uint32_t>(size);
+        fill(writer.p, size, seq);
+        router.endRecord();
+        ++seq;
+    }
+
+    agentThread.join();
+    BOOST_CHECK(!timedOut);
+
+    ::close(routerFd);
+    ::close(agentFd);
+}
+
+BOOST_AUTO_TEST_CASE( test_handshake )
+{
+    int socks[2];
+    BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, socks), 0);
+
+    auto channel = ShmChannel::create(8192);
+    int wakeupFd = ::eventfd(0, EFD_NONBLOCK);
+
+    sendWithFds(socks[0], "agent", { channel->fd(), wakeupFd });
+
+    vector<int> fds;
+    BOOST_CHECK_EQUAL(recvWithFds(socks[1], fds), "agent");
+    BOOST_REQUIRE_EQUAL(fds.size(), 2);
+
+    auto attached = ShmChannel::attach(fds[0]);
+    ShmEndpoint router(attached, true, fds[1]);
+    ShmEndpoint agent(channel, false, ::dup(wakeupFd));
+
+    // A message from the router wakes up the agent
+    BOOST_CHECK(router.sendMessage({ "PING0", "12345.6", "null" }));
+
+    eventfd_t val = 0;
+    BOOST_CHECK_EQUAL(::eventfd_read(wakeupFd, &val), 0);
+    BOOST_CHECK_EQUAL(val, 1);
+
+    vector<string> received;
+    agent.processRecords([&] (uint32_t type, ShmMessageReader & reader)
+                         {
+                             BOOST_CHECK_EQUAL(type, SHM_MESSAGE);
+                             ShmEndpoint::decodeMessage(reader, received);
+                         });
+    BOOST_CHECK_EQUAL(received.size(), 3);
+    BOOST_CHECK_EQUAL(received.at(0), "PING0");
+    BOOST_CHECK_EQUAL(received.at(2), "null");
+
+    // Closing the socket is how the other side finds out
+    ::close(socks[0]);
+    fds.clear();
+    BOOST_CHECK_EQUAL(recvWithFds(socks[1], fds), "");
+
+    // Something that isn't a segment is refused
+    BOOST_CHECK_THROW(ShmChannel::attach(::dup(wakeupFd)), ML::Exception);
+
+    ::close(socks[1]);
+    ::close(wakeupFd);
+}
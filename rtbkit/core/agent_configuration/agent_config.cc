@@ -405,6 +405,16 @@ fromJson(const Json::Value & json)
 AgentConfig
 AgentConfig::
 createFromJson(const Json::Value & json)
+{
+    static const AgentConfig noPrevious;
+    return createFromJson(json, noPrevious, {});
+}
+
+AgentConfig
+AgentConfig::
+createFromJson(const Json::Value & json,
+               const AgentConfig & previous,
+               const std::vector<unsigned> & changedCreatives)
 {
     AgentConfig newConfig;
     newConfig.augmentations.clear();
@@ -448,8 +458,20 @@ createFromJson(const Json::Value & json)
 
             newConfig.creatives.resize(it->size());
 
+            std::vector<bool> reparse(it->size(), true);
+            for (unsigned i = 0;
+                 i < reparse.size() && i < previous.creatives.size();  ++i)
+                reparse[i] = false;
+            for (unsigned i: changedCreatives)
+                if (i < reparse.size())
+                    reparse[i] = true;
+
             for (unsigned i = 0;
                  i < newConfig.creatives.size();  ++i) {
+                if (!reparse[i]) {
+                    newConfig.creatives[i] = previous.creatives[i];
+                    continue;
+                }
                 try {
                     newConfig.creatives[i].fromJson((*it)[i]);
                 } catch (const std::exception & exc) {
@@ -235,6 +235,15 @@ struct AgentConfig {
 
     static AgentConfig createFromJson(const Json::Value & json);
 
+    /** Same as createFromJson(json) for json that is a new version of the
+        configuration that previous was created from.  Only the creatives
+        whose index is in changedCreatives, or that previous didn't have,
+        are parsed; the others are copied from previous.
+    */
+    static AgentConfig createFromJson(const Json::Value & json,
+                                      const AgentConfig & previous,
+                                      const std::vector<unsigned> & changedCreatives);
+
     void parse(const std::string & jsonStr);
     void fromJson(const Json::Value & json);
 
@@ -0,0 +1,181 @@
+/* agent_config_diff.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Difference between two versions of the configuration of an agent.
+*/
+
+#include "agent_config_diff.h"
+#include "agent_config.h"
+#include "jml/db/persistent.h"
+#include "jml/db/compact_size_types.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AGENT CONFIG DIFF                                                         */
+/*****************************************************************************/
+
+AgentConfigDiff
+AgentConfigDiff::
+compute(const Json::Value & from, const Json::Value & to,
+        uint64_t baseVersion, uint64_t version)
+{
+    AgentConfigDiff result;
+    result.baseVersion = baseVersion;
+    result.version = version;
+
+    for (auto it = to.begin(), end = to.end();  it != end;  ++it) {
+        const std::string & name = it.memberName();
+        const Json::Value & oldValue = from[name];
+
+        // Creatives are compared one by one, as long as both are arrays;
+        // anything else is a change of the whole field
+        if (name == "creatives" && it->isArray()
+            && (oldValue.isNull() || oldValue.isArray())) {
+            bool changed = oldValue.size() != it->size();
+            for (unsigned i = 0;  i < it->size();  ++i) {
+                if (i < oldValue.size() && oldValue[i] == (*it)[i])
+                    continue;
+                result.creatives.emplace_back(i, (*it)[i]);
+                changed = true;
+            }
+            if (changed)
+                result.numCreatives = it->size();
+        }
+        else if (!from.isMember(name) || oldValue != *it)
+            result.fields.emplace_back(name, *it);
+    }
+
+    for (auto it = from.begin(), end = from.end();  it != end;  ++it) {
+        if (!to.isMember(it.memberName()))
+            result.removedFields.push_back(it.memberName());
+    }
+
+    return result;
+}
+
+void
+AgentConfigDiff::
+apply(Json::Value & json) const
+{
+    for (auto & field: fields)
+        json[field.first] = field.second;
+    for (auto & name: removedFields)
+        json.removeMember(name);
+
+    if (numCreatives >= 0) {
+        Json::Value & current = json["creatives"];
+        if (!current.isArray())
+            current = Json::Value(Json::arrayValue);
+        current.resize(numCreatives);
+        for (auto & creative: creatives) {
+            if (creative.first >= unsigned(numCreatives))
+                throw ML::Exception("creative %d out of %d",
+                                    creative.first, numCreatives);
+            current[creative.first] = creative.second;
+        }
+    }
+}
+
+std::shared_ptr<AgentConfig>
+AgentConfigDiff::
+apply(Json::Value & json, const AgentConfig & config) const
+{
+    apply(json);
+
+    // If the creatives were replaced as a whole, there's nothing to reuse
+    bool allCreatives = false;
+    for (auto & field: fields)
+        allCreatives = allCreatives || field.first == "creatives";
+    for (auto & name: removedFields)
+        allCreatives = allCreatives || name == "creatives";
+
+    if (allCreatives)
+        return std::make_shared<AgentConfig>(AgentConfig::createFromJson(json));
+
+    return std::make_shared<AgentConfig>(
+            AgentConfig::createFromJson(json, config, changedCreatives()));
+}
+
+std::vector<unsigned>
+AgentConfigDiff::
+changedCreatives() const
+{
+    std::vector<unsigned> result;
+    result.reserve(creatives.size());
+    for (auto & creative: creatives)
+        result.push_back(creative.first);
+    return result;
+}
+
+std::string
+AgentConfigDiff::
+serializeToString() const
+{
+    using namespace ML::DB;
+
+    Store_Writer store;
+    store.open_buffer(1024);
+
+    unsigned char serializationVersion = 1;
+    store << serializationVersion << baseVersion << version;
+
+    store << compact_size_t(fields.size());
+    for (auto & field: fields)
+        store << field.first << field.second.toStringNoNewLine();
+
+    store << removedFields << numCreatives;
+
+    store << compact_size_t(creatives.size());
+    for (auto & creative: creatives)
+        store << compact_size_t(creative.first)
+              << creative.second.toStringNoNewLine();
+
+    return store.release_buffer();
+}
+
+AgentConfigDiff
+AgentConfigDiff::
+createFromString(const std::string & str)
+{
+    using namespace ML::DB;
+
+    Store_Reader store(str.data(), str.size());
+
+    unsigned char serializationVersion;
+    store >> serializationVersion;
+    if (serializationVersion != 1)
+        throw ML::Exception("unknown agent config diff version %d",
+                            serializationVersion);
+
+    AgentConfigDiff result;
+    store >> result.baseVersion >> result.version;
+
+    compact_size_t numFields(store);
+    result.fields.reserve(numFields);
+    for (unsigned i = 0;  i < numFields;  ++i) {
+        string name, value;
+        store >> name >> value;
+        result.fields.emplace_back(name, Json::parse(value));
+    }
+
+    store >> result.removedFields >> result.numCreatives;
+
+    compact_size_t numChanged(store);
+    result.creatives.reserve(numChanged);
+    for (unsigned i = 0;  i < numChanged;  ++i) {
+        compact_size_t index(store);
+        string value;
+        store >> value;
+        result.creatives.emplace_back(index, Json::parse(value));
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,83 @@
+/* agent_config_diff.h                                             -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Difference between two versions of the configuration of an agent.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/json.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+struct AgentConfig;
+
+
+/*****************************************************************************/
+/* AGENT CONFIG DIFF                                                         */
+/*****************************************************************************/
+
+/** What changed in the JSON configuration of an agent from one version to
+    the next.
+
+    Top-level fields are compared as a whole, except for the creatives
+    which are compared one by one: an agent that changes its targeting or
+    a few of its many creatives only has those sent to the listeners, who
+    only parse those again.
+*/
+
+struct AgentConfigDiff {
+    AgentConfigDiff()
+        : baseVersion(0), version(0), numCreatives(-1)
+    {
+    }
+
+    uint64_t baseVersion;   ///< Version of the config the diff applies to
+    uint64_t version;       ///< Version of the config once it's applied
+
+    /// Top-level fields, other than the creatives, that are new or changed
+    std::vector<std::pair<std::string, Json::Value> > fields;
+
+    /// Top-level fields that are gone
+    std::vector<std::string> removedFields;
+
+    /// Number of creatives of the new version, or -1 if unchanged
+    int numCreatives;
+
+    /// Creatives that are new or changed, by index
+    std::vector<std::pair<unsigned, Json::Value> > creatives;
+
+    bool empty() const
+    {
+        return fields.empty() && removedFields.empty() && numCreatives == -1;
+    }
+
+    /** Compute the diff that takes the config from to the config to. */
+    static AgentConfigDiff compute(const Json::Value & from,
+                                   const Json::Value & to,
+                                   uint64_t baseVersion,
+                                   uint64_t version);
+
+    /** Apply the diff to the given JSON config, in place. */
+    void apply(Json::Value & json) const;
+
+    /** Apply the diff to both the JSON config and the config that was
+        parsed from it, returning the new parsed config.  Only the
+        creatives that changed are parsed again; the others are copied.
+    */
+    std::shared_ptr<AgentConfig>
+    apply(Json::Value & json, const AgentConfig & config) const;
+
+    /** Indexes of the creatives that need to be parsed again once the diff
+        has been applied.
+    */
+    std::vector<unsigned> changedCreatives() const;
+
+    std::string serializeToString() const;
+    static AgentConfigDiff createFromString(const std::string & str);
+};
+
+} // namespace RTBKIT
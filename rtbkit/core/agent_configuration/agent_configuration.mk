@@ -2,6 +2,7 @@
 
 LIBAGENT_CONFIGURATION_SOURCES := \
 	agent_config.cc \
+	agent_config_diff.cc \
 	blacklist.cc \
 	include_exclude.cc \
 	agent_configuration_listener.cc \
@@ -7,6 +7,7 @@
 
 #include "agent_configuration_listener.h"
 #include "agent_config.h"
+#include "agent_config_diff.h"
 
 namespace RTBKIT {
 
@@ -66,21 +67,70 @@ onMessage(const std::vector<std::string> & message)
     using namespace std;
 
     const std::string & topic = message.at(0);
-    if (topic != "CONFIG") {
+    const std::string & agent = message.at(1);
+
+    std::shared_ptr<AgentConfig> config;
+
+    if (topic == "CONFIG") {
+        const std::string & configStr = message.at(2);
+
+        if (configStr.empty()) {
+            agentStates.erase(agent);
+        }
+        else {
+            AgentState & state = agentStates[agent];
+            state.json = Json::parse(configStr);
+            state.version = message.size() > 3 ? stoull(message[3]) : 0;
+            try {
+                config = std::make_shared<AgentConfig>(
+                        AgentConfig::createFromJson(state.json));
+            } catch (...) {
+                agentStates.erase(agent);
+                throw;
+            }
+            state.config = config;
+        }
+    }
+    else if (topic == "CONFIGDIFF") {
+        AgentConfigDiff diff = AgentConfigDiff::createFromString(message.at(2));
+
+        auto it = agentStates.find(agent);
+        if (it == agentStates.end() || it->second.version == 0
+            || it->second.version != diff.baseVersion) {
+            cerr << "agent " << agent << " configuration version "
+                 << diff.baseVersion << " missed; resynchronizing" << endl;
+            configEndpoint.sendMessage("RESYNC", agent);
+            return;
+        }
+
+        AgentState & state = it->second;
+        try {
+            config = diff.apply(state.json, *state.config);
+        } catch (...) {
+            // The JSON was already changed; start over on the next change
+            agentStates.erase(it);
+            throw;
+        }
+        state.version = diff.version;
+        state.config = config;
+    }
+    else {
         cerr << "unknown message for agent configuration listener" << endl;
         cerr << message;
         return;
     }
-    const std::string & agent = message.at(1);
-    const std::string & configStr = message.at(2);
 
-    std::shared_ptr<AgentConfig> config;
+    setAgentConfig(agent, config);
 
-    if (!configStr.empty()) {
-        Json::Value j = Json::parse(configStr);
-        config.reset(new AgentConfig(AgentConfig::createFromJson(j)));
-    }
+    if (onConfigChange)
+        onConfigChange(agent, config);
+}
 
+void
+AgentConfigurationListener::
+setAgentConfig(const std::string & agent,
+               std::shared_ptr<AgentConfig> config)
+{
     /* Now, update the current configuration list */
 
     GcLock::SharedGuard guard(allAgentsGc);
@@ -125,9 +175,6 @@ onMessage(const std::vector<std::string> & message)
     else {
         throw ML::Exception("cmp_exch failed for AgentConfigurationListener");
     }
-
-    if (onConfigChange)
-        onConfigChange(agent, config);
 }
 
 
@@ -116,9 +116,26 @@ struct AgentConfigurationListener: public MessageLoop {
 private:
     void onMessage(const std::vector<std::string> & message);
 
+    /** Publish the new configuration of the given agent, or its removal
+        if config is null.
+    */
+    void setAgentConfig(const std::string & agent,
+                        std::shared_ptr<AgentConfig> config);
+
     AllAgentConfig * allAgents;
     mutable GcLock allAgentsGc;
 
+    /** What we need to apply the next change to an agent's configuration.
+        Only used from the message loop.
+    */
+    struct AgentState {
+        uint64_t version;
+        Json::Value json;
+        std::shared_ptr<const AgentConfig> config;
+    };
+
+    std::unordered_map<std::string, AgentState> agentStates;
+
     ZmqNamedClientBusProxy configEndpoint;
 };
 
@@ -7,6 +7,7 @@
 
 #include "jml/utils/string_functions.h"
 #include "agent_configuration_service.h"
+#include "agent_config_diff.h"
 #include "soa/service/rest_request_binding.h"
 
 using namespace std;
@@ -67,8 +68,7 @@ init()
             // we got a new listener...
             for (auto & a: agentInfo) {
                 if (!a.second.config.isNull())
-                    listeners.sendMessage(listener, "CONFIG", a.first,
-                                          a.second.config.toString());
+                    sendAgentConfig(listener, a.first);
             }
         };
 
@@ -81,12 +81,17 @@ init()
 
     listeners.clientMessageHandler = [=] (const std::vector<std::string> & message)
         {
+            const std::string & listener = message.at(0);
+            const std::string & topic = message.at(1);
+
+            // The listener missed a change; start it over with the agent
+            if (topic == "RESYNC") {
+                sendAgentConfig(listener, message.at(2));
+                return;
+            }
+
             cerr << "listeners got client message " << message << endl;
             throw ML::Exception("unexpected listener message");
-            //const std::string & agent = message.at(2);
-            //Json::Value j = Json::parse(message.at(3));
-
-            //handleAgentConfig(agent, j);
         };
 
     agents.clientMessageHandler = [=] (const std::vector<std::string> & message)
@@ -233,11 +238,42 @@ handleAgentConfig(const std::string & agent,
     if (info.config == config)
         return;
 
+    // Listeners that already have a version of the configuration only need
+    // to know what changed
+    if (info.version != 0) {
+        auto diff = AgentConfigDiff::compute(info.config, config,
+                                             info.version, info.version + 1);
+        std::string diffStr = diff.serializeToString();
+
+        info.config = config;
+        info.version = diff.version;
+
+        for (auto & l: listenerInfo)
+            listeners.sendMessage(l.first, "CONFIGDIFF", agent, diffStr);
+        return;
+    }
+
     info.config = config;
+    info.version = 1;
 
     // Broadcast the configuration to all listeners
     for (auto & l: listenerInfo)
-        listeners.sendMessage(l.first, "CONFIG", agent, config.toString());
+        sendAgentConfig(l.first, agent);
+}
+
+void
+AgentConfigurationService::
+sendAgentConfig(const std::string & listener, const std::string & agent)
+{
+    auto it = agentInfo.find(agent);
+    if (it == agentInfo.end() || it->second.config.isNull()) {
+        listeners.sendMessage(listener, "CONFIG", agent, "");
+        return;
+    }
+
+    listeners.sendMessage(listener, "CONFIG", agent,
+                          it->second.config.toString(),
+                          std::to_string(it->second.version));
 }
 
 void
@@ -28,8 +28,10 @@ using namespace Datacratic;
 
     SERVICES (router, post auction loop, and anything that needs to know
     how the agents are configured) connect via zeromq.  They will be
-    sent all configurations on connection, and will be sent any changed
-    configurations once they are changed.
+    sent all configurations on connection, and will be sent what changed
+    in a configuration (see AgentConfigDiff) once it changes.  Each
+    configuration has a version number so that a service that missed a
+    change can ask for the whole configuration again.
 */
 
 struct AgentConfigurationService : public RestServiceEndpoint,
@@ -77,6 +79,12 @@ struct AgentConfigurationService : public RestServiceEndpoint,
 
     void handleDeleteConfig(const std::string & agent);
 
+    /** Send the whole configuration of the given agent to the given
+        listener.
+    */
+    void sendAgentConfig(const std::string & listener,
+                         const std::string & agent);
+
     /// Handler for GET /v1/agents/<name>/
     Json::Value handleGetAgent(const std::string & agent) const;
 
@@ -104,9 +112,15 @@ struct AgentConfigurationService : public RestServiceEndpoint,
     std::unordered_map<std::string, ListenerInfo> listenerInfo;
 
     struct AgentInfo {
+        AgentInfo()
+            : version(0)
+        {
+        }
+
         Json::Value config;
         std::string configStr;
         Date lastHeartbeat;
+        uint64_t version;     ///< Incremented on each change of config
     };
 
     std::unordered_map<std::string, AgentInfo> agentInfo;
@@ -104,8 +104,8 @@ std::string
 FinishedInfo::
 serializeToString() const
 {
-    ostringstream stream;
-    ML::DB::Store_Writer writer(stream);
+    ML::DB::Store_Writer writer;
+    writer.open_buffer(4096);
     int version = 6;
     writer << version
            << auctionTime << auctionId << adSpotId
@@ -118,15 +118,14 @@ serializeToString() const
            << augmentations.toString();
     writer << visitChannels << uids << visits;
 
-    return stream.str();
+    return writer.release_buffer();
 }
 
 void
 FinishedInfo::
 reconstituteFromString(const std::string & str)
 {
-    istringstream stream(str);
-    ML::DB::Store_Reader store(stream);
+    ML::DB::Store_Reader store(str.data(), str.size());
     int version, istatus;
     store >> version;
     if (version > 6)
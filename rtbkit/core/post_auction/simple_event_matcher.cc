@@ -613,8 +613,7 @@ namespace {
 std::pair<Id, Id>
 unstringifyPair(const std::string & str)
 {
-    istringstream stream(str);
-    DB::Store_Reader store(stream);
+    DB::Store_Reader store(str.data(), str.size());
     pair<Id, Id> result;
     store >> result.first >> result.second;
     return result;
@@ -625,13 +624,10 @@ std::string stringifyPair(const std::pair<Id, Id> & vals)
     if (!vals.second || vals.second.type == Id::NULLID)
         throw ML::Exception("attempt to store null ID");
 
-    ostringstream stream;
-    {
-        DB::Store_Writer store(stream);
-        store << vals.first << vals.second;
-    }
-
-    return stream.str();
+    DB::Store_Writer store;
+    store.open_buffer(64);
+    store << vals.first << vals.second;
+    return store.release_buffer();
 }
 
 } // file scope
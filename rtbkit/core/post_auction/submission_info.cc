@@ -21,8 +21,8 @@ std::string
 SubmissionInfo::
 serializeToString() const
 {
-    ostringstream stream;
-    ML::DB::Store_Writer writer(stream);
+    ML::DB::Store_Writer writer;
+    writer.open_buffer(4096);
     int version = 5;
     writer << version
            << bidRequestStr
@@ -31,15 +31,14 @@ serializeToString() const
            << earlyWinEvents
            << earlyCampaignEvents;
     bid.serialize(writer);
-    return stream.str();
+    return writer.release_buffer();
 }
 
 void
 SubmissionInfo::
 reconstituteFromString(const std::string & str)
 {
-    istringstream stream(str);
-    ML::DB::Store_Reader store(stream);
+    ML::DB::Store_Reader store(str.data(), str.size());
     int version;
     store >> version;
     if (version < 1 || version > 5)
@@ -39,6 +39,13 @@ AugmentationLoop(ServiceBase & parent,
       disconnections(1024),
       toAugmentors(getZmqContext())
 {
+    bidReserve = 0.010;
+    maxAugmentationWindow = 0.050;
+    minAugmentationWindow = 0.001;
+    minResponseProbability = 0.5;
+    minLatencySamples = 100;
+    probeInterval = 100;
+
     updateAllAugmentors();
 }
 
@@ -52,6 +59,13 @@ AugmentationLoop(std::shared_ptr<ServiceProxies> proxies,
       disconnections(1024),
       toAugmentors(getZmqContext())
 {
+    bidReserve = 0.010;
+    maxAugmentationWindow = 0.050;
+    minAugmentationWindow = 0.001;
+    minResponseProbability = 0.5;
+    minLatencySamples = 100;
+    probeInterval = 100;
+
     updateAllAugmentors();
 }
 
@@ -184,6 +198,14 @@ recordStats()
             inFlights += instance.numInFlight;
 
         recordLevel(inFlights, "augmentor.%s.numInFlight", it->first);
+
+        const LatencyHistogram & latency = it->second->latency;
+        if (latency.numSamples() > 0) {
+            recordLevel(latency.quantile(0.5), "augmentor.%s.latencyP50Ms",
+                        it->first);
+            recordLevel(latency.quantile(0.9), "augmentor.%s.latencyP90Ms",
+                        it->first);
+        }
     }
 }
 
@@ -197,11 +219,19 @@ checkExpiries()
     auto onExpired = [&] (const Id & id,
                           const std::shared_ptr<Entry> & entry) -> Date
         {
+            double elapsedMs = now.secondsSince(entry->sent) * 1000.0;
+
             for (auto it = entry->outstanding.begin(),
                      end = entry->outstanding.end();
                  it != end; ++it)
             {
                 recordHit("augmentor.%s.expiredTooLate", *it);
+
+                // We don't know how long it would have taken, but it was
+                // at least this long.
+                auto augIt = augmentors.find(*it);
+                if (augIt != augmentors.end())
+                    augIt->second->latency.record(elapsedMs);
             }
                 
             this->augmentationExpired(id, *entry);
@@ -342,6 +372,70 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
     }
 }
 
+void
+AugmentationLoop::
+augment(const std::shared_ptr<AugmentationInfo> & info,
+        const OnFinished & onFinished)
+{
+    Date now = Date::now();
+    Date deadline = augmentationDeadline(*info, now);
+
+    if (!deadline.isADate()) {
+        recordHit("augmentation.noTimeToAugment");
+        onFinished(info);
+        return;
+    }
+
+    recordOutcome(deadline.secondsSince(now) * 1000.0,
+                  "augmentation.windowMs");
+    augment(info, deadline, onFinished);
+}
+
+Date
+AugmentationLoop::
+augmentationDeadline(const AugmentationInfo & info, Date now) const
+{
+    // The agents need to have their minTimeAvailableMs left once the
+    // augmentation is done, or they will be filtered out of the auction.
+    double reserve = bidReserve;
+    for (const GroupPotentialBidders & group: info.potentialGroups) {
+        for (const PotentialBidder & bidder: group) {
+            if (bidder.config)
+                reserve = std::max<double>(reserve,
+                        bidder.config->minTimeAvailableMs / 1000.0);
+        }
+    }
+
+    double window = info.auction->timeAvailable(now) - reserve;
+    window = std::min(window, maxAugmentationWindow);
+    if (window < minAugmentationWindow)
+        return Date::notADate();
+
+    return now.plusSeconds(window);
+}
+
+bool
+AugmentationLoop::
+shouldSend(AugmentorInfo & aug, double windowMs)
+{
+    if (aug.latency.numSamples() < (uint64_t)minLatencySamples)
+        return true;
+
+    if (aug.latency.fractionUnder(windowMs) >= minResponseProbability) {
+        aug.numSkippedTooSlow = 0;
+        return true;
+    }
+
+    // Let the odd request through so that the histogram keeps up with
+    // the augmentor if it gets faster.
+    if (++aug.numSkippedTooSlow >= probeInterval) {
+        aug.numSkippedTooSlow = 0;
+        return true;
+    }
+
+    return false;
+}
+
 AugmentorInstanceInfo*
 AugmentationLoop::
 pickInstance(AugmentorInfo& aug)
@@ -382,15 +476,25 @@ doAugmentation(const std::shared_ptr<Entry> & entry)
     }
 
     bool sentToAugmentor = false;
+    double windowMs = entry->timeout.secondsSince(now) * 1000.0;
+    entry->sent = now;
 
-    for (auto it = entry->outstanding.begin(), end = entry->outstanding.end();
-         it != end;  ++it)
+    for (auto it = entry->outstanding.begin();
+         it != entry->outstanding.end();)
     {
         auto & aug = *augmentors[*it];
 
+        // Augmentors that we don't send to shouldn't hold up the auction
+        if (!shouldSend(aug, windowMs)) {
+            recordHit("augmentor.%s.skippedTooSlow", *it);
+            it = entry->outstanding.erase(it);
+            continue;
+        }
+
         const AugmentorInstanceInfo* instance = pickInstance(aug);
         if (!instance) {
             recordHit("augmentor.%s.skippedTooManyInFlight", *it);
+            it = entry->outstanding.erase(it);
             continue;
         }
         recordHit("augmentor.%s.instances.%s.request", *it, instance->addr);
@@ -408,8 +512,8 @@ doAugmentation(const std::shared_ptr<Entry> & entry)
             }
         }
 
-        std::ostringstream availableAgentsStr;
-        ML::DB::Store_Writer writer(availableAgentsStr);
+        ML::DB::Store_Writer writer;
+        writer.open_buffer();
         writer.save(agents);
 
         // Send the message to the augmentor
@@ -419,10 +523,11 @@ doAugmentation(const std::shared_ptr<Entry> & entry)
                 entry->info->auction->id.toString(),
                 entry->info->auction->requestStrFormat,
                 entry->info->auction->requestStr,
-                availableAgentsStr.str(),
+                writer.release_buffer(),
                 Date::now());
 
         sentToAugmentor = true;
+        ++it;
     }
 
     if (sentToAugmentor)
@@ -554,8 +659,8 @@ doResponse(const std::vector<std::string> & message)
 
     recordLevel(timer.elapsed_wall(), "responseParseTimeMs");
 
+    double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
     {
-        double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
         string eventName = "augmentor." + augmentor + ".timeTakenMs";
         recordEvent(eventName.c_str(), ET_OUTCOME, timeTakenMs);
     }
@@ -580,6 +685,11 @@ doResponse(const std::vector<std::string> & message)
         return;
     }
 
+    // Responses that arrive after the auction expired were already
+    // accounted for in checkExpiries().
+    if (augmentorIt != augmentors.end())
+        augmentorIt->second->latency.record(timeTakenMs);
+
     auto& entry = *augmentingIt;
 
     const char* eventType =
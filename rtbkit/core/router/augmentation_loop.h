@@ -13,6 +13,7 @@
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
 #include "router_types.h"
+#include "latency_histogram.h"
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include "soa/service/zmq.hpp"
@@ -44,11 +45,20 @@ struct AugmentorInstanceInfo {
 
 /** Information about a given class of augmentor. */
 struct AugmentorInfo {
-    AugmentorInfo(const std::string& name = "") : name(name) {}
+    AugmentorInfo(const std::string& name = "")
+        : name(name), numSkippedTooSlow(0)
+    {}
 
     std::string name;                   ///< What the augmentation is called
     std::vector<AugmentorInstanceInfo> instances;
 
+    /** Response times of all instances, including the requests that were
+        never answered in time.  Only touched from the loop thread. */
+    LatencyHistogram latency;
+
+    /** Requests skipped in a row because the augmentor was too slow. */
+    int numSkippedTooSlow;
+
     AugmentorInstanceInfo* findInstance(const std::string& addr)
     {
         for (auto it = instances.begin(), end = instances.end();
@@ -108,6 +118,55 @@ struct AugmentationLoop : public ServiceBase, public MessageLoop {
                  Date timeout,
                  const OnFinished & onFinished);
 
+    /** Push an auction into the augmentor with a deadline computed by
+        augmentationDeadline().  If there is no time left to augment,
+        onFinished is called straight away.  Can be called from any thread.
+    */
+    void augment(const std::shared_ptr<AugmentationInfo> & info,
+                 const OnFinished & onFinished);
+
+    /** Time until which the given auction can wait for its augmentations.
+        This is the expiry of the auction, less the time needed by the
+        slowest of its potential bidders (as given by their
+        minTimeAvailableMs or bidReserve, whichever is larger), clamped to
+        maxAugmentationWindow.  Returns an invalid Date if that leaves
+        less than minAugmentationWindow.  Thread safe.
+    */
+    Date augmentationDeadline(const AugmentationInfo & info,
+                              Date now = Date::now()) const;
+
+    /** Time that is kept for the agents to bid and for the router to
+        respond when the agents don't ask for more.  Default 10ms.
+    */
+    double bidReserve;
+
+    /** Longest that an auction will wait for its augmentations.
+        Default 50ms.
+    */
+    double maxAugmentationWindow;
+
+    /** Auctions with less time than this to augment skip augmentation.
+        Default 1ms.
+    */
+    double minAugmentationWindow;
+
+    /** An augmentor is skipped for an auction when less than this
+        fraction of its recent requests would have come back within the
+        auction's augmentation window.  Default 0.5.
+    */
+    double minResponseProbability;
+
+    /** Number of responses an augmentor needs before it can be skipped.
+        Default 100.
+    */
+    int minLatencySamples;
+
+    /** One request in this many is still sent to an augmentor that is
+        being skipped, so that we notice when it speeds up again.
+        Default 100.
+    */
+    int probeInterval;
+
 private:
 
     struct Entry {
@@ -115,6 +174,7 @@ private:
         std::set<std::string> outstanding;
         OnFinished onFinished;
         Date timeout;
+        Date sent;      ///< When requests went out to the augmentors
     };
 
     /** List of auctions we're currently augmenting.  Once the augmentation
@@ -159,6 +219,10 @@ private:
     void handleAugmentorMessage(const std::vector<std::string> & message);
 
     AugmentorInstanceInfo* pickInstance(AugmentorInfo& aug);
+
+    /** Should the given augmentor be sent a request that must come back
+        within windowMs milliseconds? */
+    bool shouldSend(AugmentorInfo & aug, double windowMs);
     void doAugmentation(const std::shared_ptr<Entry> & entry);
 
     void recordStats();
@@ -220,6 +220,29 @@ addConfig(const string& name, const AgentInfo& info)
 }
 
 
+vector<unsigned>
+FilterPool::
+addConfigs(const ConfigBatch& batch)
+{
+    GcLockBase::SharedGuard guard(gc);
+
+    unique_ptr<Data> newData;
+    Data* oldData = data.load();
+    vector<unsigned> indexes;
+
+    do {
+        newData.reset(new Data(*oldData));
+        indexes.clear();
+        for (const auto& entry : batch)
+            indexes.push_back(newData->addConfig(entry.first, *entry.second));
+    } while (!setData(oldData, newData));
+
+    if (events) events->recordCount(batch.size(), "filters.addConfig");
+
+    return indexes;
+}
+
+
 void
 FilterPool::
 removeConfig(const string& name)
@@ -245,7 +268,9 @@ removeConfig(const string& name)
 FilterPool::Data::
 Data(const Data& other) :
     configs(other.configs),
-    activeConfigs(other.activeConfigs)
+    activeConfigs(other.activeConfigs),
+    configIndex(other.configIndex),
+    freeConfigs(other.freeConfigs)
 {
     filters.reserve(other.filters.size());
     for (FilterBase* filter : other.filters)
@@ -263,10 +288,8 @@ ssize_t
 FilterPool::Data::
 findConfig(const string& name) const
 {
-    for (size_t i = 0; i < configs.size(); ++i) {
-        if (configs[i].name == name) return i;
-    }
-    return -1;
+    auto it = configIndex.find(name);
+    return it == configIndex.end() ? -1 : it->second;
 }
 
 unsigned
@@ -277,13 +300,17 @@ addConfig(const string& name, const AgentInfo& info)
     // before we can add the new config.
     removeConfig(name);
 
-    ssize_t index = findConfig("");
-    if (index >= 0)
+    ssize_t index;
+    if (!freeConfigs.empty()) {
+        index = freeConfigs.back();
+        freeConfigs.pop_back();
         configs[index] = ConfigEntry(name, info);
+    }
     else {
         index = configs.size();
         configs.emplace_back(name, info);
     }
+    configIndex[name] = index;
 
     activeConfigs.setConfig(index, info.config->creatives.size());
 
@@ -306,6 +333,8 @@ removeConfig(const string& name)
         filter->removeConfig(index, configs[index].config);
 
     configs[index].reset();
+    configIndex.erase(name);
+    freeConfigs.push_back(index);
 }
 
 
@@ -15,6 +15,7 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 
 namespace Datacratic {
@@ -82,10 +83,16 @@ struct FilterPool
     void initWithDefaultFilters();
 
 
-    // \todo Need batch interfaces to alleviate overhead.
     unsigned addConfig(const std::string& name, const AgentInfo& info);
     void removeConfig(const std::string& name);
 
+    /** Add or replace the configs of several agents at once so that the
+        filters only get copied once for all of them.  Returns the index of
+        each config.
+    */
+    typedef std::vector< std::pair<std::string, const AgentInfo*> > ConfigBatch;
+    std::vector<unsigned> addConfigs(const ConfigBatch& batch);
+
 private:
 
     struct Data
@@ -107,6 +114,9 @@ private:
 
         std::vector<ConfigEntry> configs;
         CreativeMatrix activeConfigs;
+
+        std::unordered_map<std::string, unsigned> configIndex;
+        std::vector<unsigned> freeConfigs;
     };
 
     bool setData(Data*&, std::unique_ptr<Data>&);
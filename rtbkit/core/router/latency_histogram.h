@@ -0,0 +1,129 @@
+/* latency_histogram.h                                             -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Small decaying histogram of response latencies.
+*/
+
+#ifndef __rtb_router__latency_histogram_h__
+#define __rtb_router__latency_histogram_h__
+
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Histogram of latencies in milliseconds with logarithmic buckets, from
+    0.1ms up to about 10s with a resolution of 20%.
+
+    Every decayInterval samples, all of the counts are halved so that the
+    histogram follows changes in the latency profile of whatever is being
+    measured within a few thousand samples.
+
+    Not thread safe.
+*/
+
+struct LatencyHistogram {
+
+    enum {
+        NUM_BUCKETS = 64
+    };
+
+    LatencyHistogram(uint32_t decayInterval = 1024)
+        : decayInterval(decayInterval)
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::fill(counts, counts + NUM_BUCKETS, 0.0);
+        total = 0.0;
+        samples = 0;
+        sinceDecay = 0;
+    }
+
+    /** Record a sample of the given latency in milliseconds. */
+    void record(double latencyMs)
+    {
+        counts[bucketFor(latencyMs)] += 1.0;
+        total += 1.0;
+        ++samples;
+
+        if (decayInterval && ++sinceDecay >= decayInterval) {
+            for (unsigned i = 0;  i < NUM_BUCKETS;  ++i)
+                counts[i] *= 0.5;
+            total *= 0.5;
+            sinceDecay = 0;
+        }
+    }
+
+    /** Return the latency under which the given fraction of the samples
+        fall, rounded up to the bucket boundary.  Returns 0 when there are
+        no samples.
+    */
+    double quantile(double q) const
+    {
+        if (total <= 0.0)
+            return 0.0;
+
+        double target = q * total;
+        double sum = 0.0;
+        for (unsigned i = 0;  i < NUM_BUCKETS;  ++i) {
+            sum += counts[i];
+            if (sum >= target)
+                return upperBound(i);
+        }
+        return upperBound(NUM_BUCKETS - 1);
+    }
+
+    /** Fraction of the samples that were under the given latency. */
+    double fractionUnder(double latencyMs) const
+    {
+        if (total <= 0.0)
+            return 1.0;
+
+        unsigned bucket = bucketFor(latencyMs);
+        double sum = 0.0;
+        for (unsigned i = 0;  i < bucket;  ++i)
+            sum += counts[i];
+        return sum / total;
+    }
+
+    /** Number of samples ever recorded. */
+    uint64_t numSamples() const { return samples; }
+
+    static unsigned bucketFor(double latencyMs)
+    {
+        if (!(latencyMs > MIN_LATENCY_MS))
+            return 0;
+        double bucket = std::ceil(std::log(latencyMs / MIN_LATENCY_MS)
+                                  / std::log(GROWTH));
+        return std::min<double>(bucket, NUM_BUCKETS - 1);
+    }
+
+    static double upperBound(unsigned bucket)
+    {
+        return MIN_LATENCY_MS * std::pow(GROWTH, bucket);
+    }
+
+private:
+    static constexpr double MIN_LATENCY_MS = 0.1;
+    static constexpr double GROWTH = 1.2;
+
+    double counts[NUM_BUCKETS];
+    double total;
+    uint64_t samples;
+    uint32_t sinceDecay;
+    uint32_t decayInterval;
+};
+
+} // namespace RTBKIT
+
+#endif /* __rtb_router__latency_histogram_h__ */
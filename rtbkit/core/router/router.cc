@@ -6,6 +6,7 @@
 */
 
 #include <set>
+#include <unordered_set>
 #include "router.h"
 #include "soa/service/zmq_utils.h"
 #include "jml/arch/backtrace.h"
@@ -119,9 +120,8 @@ Router(ServiceBase & parent,
       shutdown_(false),
       configBuffer(1024),
       exchangeBuffer(64),
-      startBiddingBuffer(65536),
-      submittedBuffer(65536),
       auctionGraveyard(65536),
+      numShards(1),
       augmentationLoop(*this),
       loopMonitor(*this),
       loadStabilizer(loopMonitor),
@@ -133,7 +133,6 @@ Router(ServiceBase & parent,
       allAgents(new AllAgentInfo()),
       configListener(getZmqContext()),
       initialized(false),
-      bridge(getZmqContext()),
       logAuctions(logAuctions),
       logBids(logBids),
       logger(getZmqContext()),
@@ -147,6 +146,7 @@ Router(ServiceBase & parent,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount)
 {
+    shards.emplace_back(new RouterShard(getZmqContext(), 0));
     monitorProviderClient.addProvider(this);
 }
 
@@ -164,9 +164,8 @@ Router(std::shared_ptr<ServiceProxies> services,
       postAuctionEndpoint(getZmqContext()),
       configBuffer(1024),
       exchangeBuffer(64),
-      startBiddingBuffer(65536),
-      submittedBuffer(65536),
       auctionGraveyard(65536),
+      numShards(1),
       augmentationLoop(*this),
       loopMonitor(*this),
       loadStabilizer(loopMonitor),
@@ -178,7 +177,6 @@ Router(std::shared_ptr<ServiceProxies> services,
       allAgents(new AllAgentInfo()),
       configListener(getZmqContext()),
       initialized(false),
-      bridge(getZmqContext()),
       logAuctions(logAuctions),
       logBids(logBids),
       logger(getZmqContext()),
@@ -192,15 +190,31 @@ Router(std::shared_ptr<ServiceProxies> services,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount)
 {
+    shards.emplace_back(new RouterShard(getZmqContext(), 0));
     monitorProviderClient.addProvider(this);
 }
 
+void
+Router::
+setNumShards(unsigned newValue)
+{
+    if (initialized)
+        throw ML::Exception("the number of shards must be set before init()");
+    if (newValue < 1)
+        throw ML::Exception("invalid number of router shards");
+    numShards = newValue;
+}
+
 void
 Router::
 initBidderInterface(Json::Value const & json)
 {
-    bidder = BidderInterface::create(serviceName() + ".bidder", getServices(), json);
-    bidder->init(&bridge, this);
+    bidderConfig = json;
+
+    RouterShard & shard = *shards[0];
+    shard.bidder = BidderInterface::create(serviceName() + ".bidder",
+                                           getServices(), json);
+    shard.bidder->init(&shard.bridge, this);
 }
 
 void
@@ -216,28 +230,51 @@ init()
 
     banker.reset(new NullBanker());
 
-    if(!bidder) {
+    if(!shards[0]->bidder) {
         Json::Value json;
         json["type"] = "agents";
         initBidderInterface(json);
     }
 
+    // The other shards only have an endpoint for the agents, under a
+    // separate service class so that nothing else tries to connect to them.
+    for (unsigned i = 1;  i < numShards;  ++i) {
+        shards.emplace_back(new RouterShard(getZmqContext(), i));
+        RouterShard & shard = *shards.back();
+
+        registerServiceProvider(shardServiceName(i),
+                                { "rtbRequestRouterShard" });
+
+        shard.bidder = BidderInterface::create(
+                shardServiceName(i) + ".bidder", getServices(), bidderConfig);
+        shard.bidder->init(&shard.bridge, this);
+    }
+
     augmentationLoop.init();
 
     logger.init(getServices()->config, serviceName() + "/logger");
 
-    bridge.agents.init(getServices()->config, serviceName() + "/agents");
-    bridge.agents.clientMessageHandler
-        = std::bind(&Router::handleAgentMessage, this, std::placeholders::_1);
-    bridge.agents.onConnection = [=] (const std::string & agent)
-        {
-            cerr << "agent " << agent << " connected to router" << endl;
-        };
+    for (auto & s: shards) {
+        RouterShard & shard = *s;
+        std::string name = shardServiceName(shard.index);
 
-    bridge.agents.onDisconnection = [=] (const std::string & agent)
-        {
-            cerr << "agent " << agent << " disconnected from router" << endl;
-        };
+        shard.bridge.agents.init(getServices()->config, name + "/agents");
+        shard.bridge.agents.clientMessageHandler
+            = [=, &shard] (const std::vector<std::string> & message)
+            {
+                this->handleAgentMessage(shard, message);
+            };
+        shard.bridge.agents.onConnection = [=] (const std::string & agent)
+            {
+                cerr << "agent " << agent << " connected to " << name << endl;
+            };
+
+        shard.bridge.agents.onDisconnection = [=] (const std::string & agent)
+            {
+                cerr << "agent " << agent << " disconnected from " << name
+                     << endl;
+            };
+    }
 
     postAuctionEndpoint.init(getServices()->config, ZMQ_XREQ);
 
@@ -306,7 +343,8 @@ Router::
 bindTcp()
 {
     logger.bindTcp(getServices()->ports->getRange("logs"));
-    bridge.agents.bindTcp(getServices()->ports->getRange("router"));
+    for (auto & shard: shards)
+        shard->bridge.agents.bindTcp(getServices()->ports->getRange("router"));
 }
 
 void
@@ -314,11 +352,15 @@ Router::
 bindAgents(std::string agentUri)
 {
     try {
-        bridge.agents.bind(agentUri.c_str());
+        shards[0]->bridge.agents.bind(agentUri.c_str());
     } catch (const std::exception & exc) {
         throw Exception("error while binding agent URI %s: %s",
                             agentUri.c_str(), exc.what());
     }
+
+    for (unsigned i = 1;  i < shards.size();  ++i)
+        shards[i]->bridge.agents.bindTcp(
+                getServices()->ports->getRange("router"));
 }
 
 void
@@ -368,9 +410,18 @@ start(boost::function<void ()> onStop)
             if (onStop) onStop();
         };
 
-    bidder->start();
+    for (auto & shard: shards)
+        shard->bidder->start();
     logger.start();
     augmentationLoop.start();
+
+    for (unsigned i = 1;  i < shards.size();  ++i) {
+        RouterShard * shard = shards[i].get();
+        shard->runThread.reset(new boost::thread([=] ()
+            {
+                this->runShard(*shard);
+            }));
+    }
     runThread.reset(new boost::thread(runfn));
 
     if (connectPostAuctionLoop) {
@@ -413,7 +464,7 @@ numNonIdle() const
     size_t numInFlight, numAwaitingAugmentation;
     {
         Guard guard(lock);
-        numInFlight = inFlight.size();
+        numInFlight = this->numInFlight();
         numAwaitingAugmentation = augmentationLoop.numAugmenting();
     }
 
@@ -451,12 +502,21 @@ issueTimestamp()
 void
 Router::
 run()
+{
+    runShard(*shards[0]);
+}
+
+void
+Router::
+runShard(RouterShard & shard)
 {
     using namespace std;
 
+    bool isMain = shard.index == 0;
+
     zmq_pollitem_t items [] = {
-        { bridge.agents.getSocketUnsafe(), 0, ZMQ_POLLIN, 0 },
-        { 0, wakeupMainLoop.fd(), ZMQ_POLLIN, 0 }
+        { shard.bridge.agents.getSocketUnsafe(), 0, ZMQ_POLLIN, 0 },
+        { 0, shard.wakeup.fd(), ZMQ_POLLIN, 0 }
     };
 
     double last_check = ML::wall_time(), last_check_pace = last_check,
@@ -471,16 +531,21 @@ run()
     int totalSleeps = 0;
     double lastTimestamp = 0;
 
+    string loopName = isMain
+        ? string("routerLoop")
+        : ML::format("routerLoop.shard%d", shard.index);
+
     double totalActive = 0;
     double lastTotalActive = 0; // member variable for the lambda.
-    loopMonitor.addCallback("routerLoop",
+    loopMonitor.addCallback(loopName,
             [&, lastTotalActive] (double elapsed) mutable {
                 double delta = totalActive - lastTotalActive;
                 lastTotalActive = totalActive;
                 return delta / elapsed;
             });
 
-    recordHit("routerUp");
+    if (isMain)
+        recordHit("routerUp");
 
     //double lastDump = ML::wall_time();
 
@@ -511,7 +576,7 @@ run()
         beforeSleep = getTime();
 
         totalActive += beforeSleep - afterSleep;
-        dutyCycleCurrent.nsProcessing
+        shard.dutyCycleCurrent.nsProcessing
             += microsecondsBetween(beforeSleep, afterSleep);
 
         int rc = 0;
@@ -520,7 +585,7 @@ run()
             rc = zmq_poll(items, 2, 0);
         if (rc == 0) {
             ++numTimesCouldSleep;
-            checkExpiredAuctions();
+            checkExpiredAuctions(shard);
 
 #if 1
             // Try to sleep only once per 1/2 a millisecond to avoid too many
@@ -542,9 +607,9 @@ run()
 
         afterSleep = getTime();
 
-        dutyCycleCurrent.nsSleeping
+        shard.dutyCycleCurrent.nsSleeping
             += microsecondsBetween(afterSleep, beforeSleep);
-        dutyCycleCurrent.nEvents += 1;
+        shard.dutyCycleCurrent.nEvents += 1;
 
         times["asleep"].add(microsecondsBetween(afterSleep, beforeSleep));
 
@@ -552,21 +617,27 @@ run()
             cerr << "zeromq error: " << zmq_strerror(zmq_errno()) << endl;
         }
 
+        if (!isMain) {
+            RouterShard::AgentUpdate update;
+            while (shard.agentBuffer.tryPop(update))
+                doAgentUpdate(shard, update);
+        }
+
         {
             double atStart = getTime();
             std::shared_ptr<AugmentationInfo> info;
-            while (startBiddingBuffer.tryPop(info)) {
-                doStartBidding(info);
+            while (shard.startBiddingBuffer.tryPop(info)) {
+                doStartBidding(shard, info);
             }
 
             double atEnd = getTime();
             times["doStartBidding"].add(microsecondsBetween(atEnd, atStart));
         }
 
-        {
+        if (isMain) {
             std::shared_ptr<ExchangeConnector> exchange;
             while (exchangeBuffer.tryPop(exchange)) {
-                for (auto & agent : agents) {
+                for (auto & agent : shard.agents) {
                     configureAgentOnExchange(exchange,
                                              agent.first,
                                              *agent.second.config);
@@ -574,9 +645,11 @@ run()
             }
         }
 
-        {
+        if (isMain) {
             double atStart = getTime();
 
+            std::vector<std::pair<std::string,
+                                  std::shared_ptr<const AgentConfig> > > configs;
             std::pair<std::string, std::shared_ptr<const AgentConfig> > config;
             while (configBuffer.tryPop(config)) {
                 if (!config.second) {
@@ -586,10 +659,13 @@ run()
                          << endl;
                 }
                 else {
-                    doConfig(config.first, config.second);
+                    configs.push_back(config);
                 }
             }
 
+            if (!configs.empty())
+                doConfigs(configs);
+
             double atEnd = getTime();
             times["doConfig"].add(microsecondsBetween(atEnd, atStart));
         }
@@ -597,8 +673,8 @@ run()
         {
             double atStart = getTime();
             std::shared_ptr<Auction> auction;
-            while (submittedBuffer.tryPop(auction))
-                doSubmitted(auction);
+            while (shard.submittedBuffer.tryPop(auction))
+                doSubmitted(shard, auction);
 
             double atEnd = getTime();
             times["doSubmitted"].add(microsecondsBetween(atEnd, atStart));
@@ -609,8 +685,8 @@ run()
             // Agent message
             vector<string> message;
             try {
-                message = recvAll(bridge.agents.getSocketUnsafe());
-                bridge.agents.handleMessage(std::move(message));
+                message = recvAll(shard.bridge.agents.getSocketUnsafe());
+                shard.bridge.agents.handleMessage(std::move(message));
                 double atEnd = getTime();
                 times[message.at(1)].add(microsecondsBetween(atEnd, beforeMessage));
             } catch (const std::exception & exc) {
@@ -622,9 +698,11 @@ run()
         }
 
         if (items[1].revents & ZMQ_POLLIN) {
-            wakeupMainLoop.read();
+            shard.wakeup.read();
         }
 
+        shard.bidder->processAgentMessages();
+
         //checkExpiredAuctions();
 
         double now = ML::wall_time();
@@ -633,14 +711,15 @@ run()
         if (now - lastPings > 1.0) {
             // Send out pings and interpret the results of the last lot of
             // pinging.
-            sendPings();
+            sendPings(shard);
 
             lastPings = now;
         }
 
         if (now - last_check_pace > 10.0) {
-            recordEvent("numTimesCouldSleep", ET_LEVEL,
-                        numTimesCouldSleep);
+            if (isMain)
+                recordEvent("numTimesCouldSleep", ET_LEVEL,
+                            numTimesCouldSleep);
 
             totalSleeps += numTimesCouldSleep;
 
@@ -649,31 +728,33 @@ run()
         }
 
         if (now - last_check > 10.0) {
-            logUsageMetrics(10.0);
-
-            logMessage("MARK",
-                       Date::fromSecondsSinceEpoch(last_check).print(),
-                       format("active: %zd augmenting, %zd inFlight, "
-                              "%zd agents",
-                              augmentationLoop.numAugmenting(),
-                              inFlight.size(),
-                              agents.size()));
-
-            dutyCycleCurrent.ending = Date::now();
-            dutyCycleHistory.push_back(dutyCycleCurrent);
-            dutyCycleCurrent.clear();
-
-            if (dutyCycleHistory.size() > 200)
-                dutyCycleHistory.erase(dutyCycleHistory.begin(),
-                                       dutyCycleHistory.end() - 100);
+            if (isMain) {
+                logUsageMetrics(10.0);
+
+                logMessage("MARK",
+                           Date::fromSecondsSinceEpoch(last_check).print(),
+                           format("active: %zd augmenting, %zd inFlight, "
+                                  "%zd agents",
+                                  augmentationLoop.numAugmenting(),
+                                  numInFlight(),
+                                  shard.agents.size()));
+
+                shard.dutyCycleCurrent.ending = Date::now();
+                dutyCycleHistory.push_back(shard.dutyCycleCurrent);
+
+                if (dutyCycleHistory.size() > 200)
+                    dutyCycleHistory.erase(dutyCycleHistory.begin(),
+                                           dutyCycleHistory.end() - 100);
+            }
+            shard.dutyCycleCurrent.clear();
 
-            checkDeadAgents();
+            checkDeadAgents(shard);
 
             double total = 0.0;
             for (auto it = times.begin(); it != times.end();  ++it)
                 total += it->second.time;
 
-            cerr << "total of " << total << " microseconds and "
+            cerr << loopName << ": total of " << total << " microseconds and "
                  << totalSleeps << " sleeps" << endl;
 
             for (auto it = times.begin(); it != times.end();  ++it) {
@@ -684,7 +765,7 @@ run()
                                    100.0 * it->second.time / total,
                                    it->second.time / it->second.count);
 
-                recordEvent(("routerLoop." + it->first).c_str(), ET_LEVEL,
+                recordEvent((loopName + "." + it->first).c_str(), ET_LEVEL,
                         1.0 * it->second.time / (now - last_check) / 1000000.0);
 
             }
@@ -697,7 +778,9 @@ run()
 
         times["checks"].add(microsecondsBetween(getTime(), beforeChecks));
 
-        if (now - lastTimestamp >= 1.0) {
+        shard.numInFlight = shard.inFlight.size();
+
+        if (isMain && now - lastTimestamp >= 1.0) {
             banker->logBidEvents(*this);
             //issueTimestamp();
             lastTimestamp = now;
@@ -706,7 +789,8 @@ run()
 
     //cerr << "finished run loop" << endl;
 
-    recordHit("routerDown");
+    if (isMain)
+        recordHit("routerDown");
 
     //cerr << "server shutdown" << endl;
 }
@@ -721,13 +805,19 @@ shutdown()
 
     shutdown_ = true;
     futex_wake(shutdown_);
-    wakeupMainLoop.signal();
+    for (auto & shard: shards)
+        shard->wakeup.signal();
 
     augmentationLoop.shutdown();
 
     if (runThread)
         runThread->join();
     runThread.reset();
+    for (auto & shard: shards) {
+        if (shard->runThread)
+            shard->runThread->join();
+        shard->runThread.reset();
+    }
     if (cleanupThread)
         cleanupThread->join();
     cleanupThread.reset();
@@ -808,14 +898,15 @@ numAuctionsInProgress() const
 
 void
 Router::
-handleAgentMessage(const std::vector<std::string> & message)
+handleAgentMessage(RouterShard & shard,
+                   const std::vector<std::string> & message)
 {
     try {
         using namespace std;
         //cerr << "got agent message " << message << endl;
 
         if (message.size() < 2) {
-            returnErrorResponse(message, "not enough message parts");
+            returnErrorResponse(shard, message, "not enough message parts");
             return;
         }
 
@@ -823,25 +914,27 @@ handleAgentMessage(const std::vector<std::string> & message)
         const string & request = message[1];
 
         if (request.empty())
-            returnErrorResponse(message, "null request field");
+            returnErrorResponse(shard, message, "null request field");
 
         if (request == "CONFIG") {
             string configName = message.at(2);
-            if (!agents.count(configName)) {
-                // We don't yet know about its configuration
-                bidder->sendMessage(address, "NEEDCONFIG");
+            if (!shard.agents.count(configName)) {
+                // We don't yet know about its configuration.  Only the main
+                // shard asks for it; the others get it from the main shard.
+                if (shard.index == 0)
+                    shard.bidder->sendMessage(address, "NEEDCONFIG");
                 return;
             }
-            agents[configName].address = address;
+            shard.agents[configName].address = address;
             return;
         }
 
-        if (!agents.count(address)) {
+        if (!shard.agents.count(address)) {
             cerr << "doing NEEDCONFIG for " << address << endl;
             return;
         }
 
-        AgentInfo & info = agents[address];
+        AgentInfo & info = shard.agents[address];
         info.gotHeartbeat(Date::now());
 
         if (!info.configured) {
@@ -849,24 +942,24 @@ handleAgentMessage(const std::vector<std::string> & message)
         }
 
         if (request[0] == 'B' && request == "BID") {
-            doBid(message);
+            doBid(shard, message);
             return;
         }
 
         //cerr << "router got message " << message << endl;
 
         if (request[0] == 'P' && request == "PONG0") {
-            doPong(0, message);
+            doPong(shard, 0, message);
             return;
         }
         else if (request[0] == 'P' && request == "PONG1") {
-            doPong(1, message);
+            doPong(shard, 1, message);
             return;
         }
 
-        returnErrorResponse(message, "unknown agent request");
+        returnErrorResponse(shard, message, "unknown agent request");
     } catch (const std::exception & exc) {
-        returnErrorResponse(message,
+        returnErrorResponse(shard, message,
                             "threw exception: " + string(exc.what()));
     }
 }
@@ -876,6 +969,7 @@ Router::
 logUsageMetrics(double period)
 {
     std::string p = std::to_string(period);
+    const Agents & agents = shards[0]->agents;
 
     for (auto it = lastAgentUsageMetrics.begin();
          it != lastAgentUsageMetrics.end();) {
@@ -947,7 +1041,7 @@ logUsageMetrics(double period)
 
 void
 Router::
-checkDeadAgents()
+checkDeadAgents(RouterShard & shard)
 {
     //Date start = Date::now();
 
@@ -956,7 +1050,7 @@ checkDeadAgents()
 
     std::vector<Agents::iterator> deadAgents;
 
-    for (auto it = agents.begin(), end = agents.end();  it != end;
+    for (auto it = shard.agents.begin(), end = shard.agents.end();  it != end;
          ++it) {
         auto & info = it->second;
 
@@ -981,7 +1075,8 @@ checkDeadAgents()
 
                     this->recordHit("accounts.%s.lostBids", account);
 
-                    bidder->sendBidLostMessage(it->first, inFlight[id].auction);
+                    shard.bidder->sendBidLostMessage(it->first,
+                                                     shard.inFlight[id].auction);
 
                     toExpire.push_back(id);
                 }
@@ -989,7 +1084,7 @@ checkDeadAgents()
 
         info.forEachInFlight(onInFlight);
 
-        this->recordLevel(info.numBidsInFlight(),
+        this->recordLevel(info.status->numBidsInFlight,
                           "accounts.%s.inFlight.numInFlight", account);
         this->recordLevel(oldest,
                           "accounts.%s.inFlight.oldestAgeSeconds", account);
@@ -1031,7 +1126,7 @@ checkDeadAgents()
                 // agent is dead
                 cerr << "agent " << it->first << " appears to be dead"
                      << endl;
-                bidder->sendMessage(it->first, "BYEBYE");
+                shard.bidder->sendMessage(it->first, "BYEBYE");
                 deadAgents.push_back(it);
             }
         }
@@ -1042,11 +1137,15 @@ checkDeadAgents()
         cerr << "WARNING: dead agent doesn't clean up its state properly"
              << endl;
         // TODO: undo all bids in progress
-        filters.removeConfig((*it)->first);
-        agents.erase(*it);
+
+        // Each shard notices by itself that the agent is dead, but only the
+        // main shard owns the filters and the list of all agents.
+        if (shard.index == 0)
+            filters.removeConfig((*it)->first);
+        shard.agents.erase(*it);
     }
 
-    if (!deadAgents.empty())
+    if (shard.index == 0 && !deadAgents.empty())
         // Broadcast that we have different agents
         updateAllAgents();
 
@@ -1056,14 +1155,14 @@ checkDeadAgents()
 
 void
 Router::
-checkExpiredAuctions()
+checkExpiredAuctions(RouterShard & shard)
 {
     //recentlySubmitted.clear();
 
     Date start = Date::now();
 
     {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireInFlight);
+        RouterProfiler profiler(shard.dutyCycleCurrent.nsExpireInFlight);
 
         // Look for in flight timeout expiries
         auto onExpiredInFlight = [&] (const Id & auctionId,
@@ -1076,16 +1175,16 @@ checkExpiredAuctions()
                          end = auctionInfo.bidders.end();
                      it != end;  ++it) {
                     string agent = it->first;
-                    if (!agents.count(agent)) continue;
+                    if (!shard.agents.count(agent)) continue;
 
-                    if (agents[agent].expireBidInFlight(auctionId)) {
-                        AgentInfo & info = this->agents[agent];
-                        ++info.stats->tooLate;
+                    if (shard.agents[agent].expireBidInFlight(auctionId)) {
+                        AgentInfo & info = shard.agents[agent];
+                        ML::atomic_inc(info.stats->tooLate);
 
                         this->recordHit("accounts.%s.droppedBids",
                                         info.config->account.toString('.'));
 
-                        bidder->sendBidDroppedMessage(agent, auctionInfo.auction);
+                        shard.bidder->sendBidDroppedMessage(agent, auctionInfo.auction);
                     }
                 }
 
@@ -1116,29 +1215,35 @@ checkExpiredAuctions()
                 return Date();
             };
 
-        inFlight.expire(onExpiredInFlight, start);
+        shard.inFlight.expire(onExpiredInFlight, start);
     }
 
+    // The structures shared between the shards are expired by the main one
+    if (shard.index != 0)
+        return;
+
     {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireBlacklist);
+        RouterProfiler profiler(shard.dutyCycleCurrent.nsExpireBlacklist);
+        std::lock_guard<ML::Spinlock> guard(blacklistLock);
         blacklist.doExpiries();
     }
 
     if (doDebug) {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireDebug);
+        RouterProfiler profiler(shard.dutyCycleCurrent.nsExpireDebug);
         expireDebugInfo();
     }
 }
 
 void
 Router::
-returnErrorResponse(const std::vector<std::string> & message,
+returnErrorResponse(RouterShard & shard,
+                    const std::vector<std::string> & message,
                     const std::string & error)
 {
     using namespace std;
     if (message.empty()) return;
     logMessage("ERROR", error, message);
-    bidder->sendErrorMessage(message[0], error, message);
+    shard.bidder->sendErrorMessage(message[0], error, message);
 }
 
 void
@@ -1146,9 +1251,11 @@ Router::
 doStats(const std::vector<std::string> & message)
 {
     Json::Value result(Json::objectValue);
+    const RouterShard & shard = *shards[0];
+    const Agents & agents = shard.agents;
 
     result["numAugmenting"] = augmentationLoop.numAugmenting();
-    result["numInFlight"] = inFlight.size();
+    result["numInFlight"] = numInFlight();
     result["blacklistUsers"] = blacklist.size();
 
     result["numAgents"] = agents.size();
@@ -1169,7 +1276,7 @@ doStats(const std::vector<std::string> & message)
     result["totalAgentInFlight"] = totalAgentInFlight;
 
     if (dutyCycleHistory.empty())
-        result["dutyCycle"] = dutyCycleCurrent.toJson();
+        result["dutyCycle"] = shard.dutyCycleCurrent.toJson();
     else result["dutyCycle"] = dutyCycleHistory.back().toJson();
 
     result["fileDescriptorCount"] = ML::num_open_files();
@@ -1206,8 +1313,6 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
         return;
     }
 
-    double augmentationWindow = 0.005; // 5ms available to augment
-
     auto onDoneAugmenting = [=] (const std::shared_ptr<AugmentationInfo> & info)
         {
             info->auction->doneAugmenting = Date::now();
@@ -1217,13 +1322,16 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
                 return;
             }
 
-            // Send it off to be farmed out to the bidders
-            startBiddingBuffer.push(info);
-            wakeupMainLoop.signal();
+            // Send it off to be farmed out to the bidders by the shard
+            // that owns the auction
+            RouterShard & shard = this->shardFor(info->auction->id);
+            shard.startBiddingBuffer.push(info);
+            shard.wakeup.signal();
         };
 
-    augmentationLoop.augment(info, Date::now().plusSeconds(augmentationWindow),
-                             onDoneAugmenting);
+    // The augmentation loop works out how long we can wait from the time
+    // left in the auction and the augmentors' recent response times.
+    augmentationLoop.augment(info, onDoneAugmenting);
 }
 
 std::shared_ptr<AugmentationInfo>
@@ -1313,12 +1421,15 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
             return true;
         };
 
+    int numPotentialBidders = 0;
+
     for (const auto& entry : biddableConfigs) {
         if (entry.biddableSpots.empty()) continue;
         if (!checkAgent(*entry.config, *entry.status, *entry.stats)) continue;
 
         ML::atomic_inc(entry.stats->passedStaticFilters);
         doFilterStat(*entry.config, "passedStaticFilters");
+        ++numPotentialBidders;
 
         string rrGroup = entry.config->roundRobinGroup;
         if (rrGroup == "") rrGroup = entry.name;
@@ -1333,6 +1444,10 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
         groupAgents[rrGroup].totalBidProbability += entry.config->bidProbability;
     }
 
+    // Lets the exchange's admission controller learn which sites our agents
+    // are interested in
+    auction->numPotentialBidders = numPotentialBidders;
+
 
     std::vector<GroupPotentialBidders> validGroups;
 
@@ -1386,19 +1501,22 @@ doStartBidding(const std::vector<std::string> & message)
 {
     std::shared_ptr<AugmentationInfo> augInfo
         = sharedPtrFromMessage<AugmentationInfo>(message.at(2));
-    doStartBidding(augInfo);
+    doStartBidding(shardFor(augInfo->auction->id), augInfo);
 }
 
 void
 Router::
-doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
+doStartBidding(RouterShard & shard,
+               const std::shared_ptr<AugmentationInfo> & augInfo)
 {
     //static const char *fName = "Router::doStartBidding:";
-    RouterProfiler profiler(dutyCycleCurrent.nsStartBidding);
+    RouterProfiler profiler(shard.dutyCycleCurrent.nsStartBidding);
+
+    Agents & agents = shard.agents;
 
     try {
         Id auctionId = augInfo->auction->id;
-        if (inFlight.count(auctionId)) {
+        if (shard.inFlight.count(auctionId)) {
             throwException("doStartBidding.alreadyInFlight",
                            "auction with ID %s already in progress",
                            auctionId.toString().c_str());
@@ -1415,7 +1533,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
         auto groupAgents = augInfo->potentialGroups;
 
-        AuctionInfo & auctionInfo = addAuction(augInfo->auction,
+        AuctionInfo & auctionInfo = addAuction(shard, augInfo->auction,
                                                augInfo->lossTimeout);
         auto auction = augInfo->auction;
 
@@ -1464,9 +1582,10 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
                 doFilterStat("intoDynamicFilters");
 
-                /* Check if we have too many in flight. */
-                if (info.numBidsInFlight() >= info.config->maxInFlight) {
-                    ++info.stats->tooManyInFlight;
+                /* Check if we have too many in flight (over all of the
+                   shards). */
+                if (info.status->numBidsInFlight >= info.config->maxInFlight) {
+                    ML::atomic_inc(info.stats->tooManyInFlight);
                     bidder.inFlightProp = PotentialBidder::NULL_PROP;
                     doFilterStat("dynamic.tooManyInFlight");
                     continue;
@@ -1554,16 +1673,19 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
 
                 /* Check that there is no blacklist hit on the user. */
-                if (config.hasBlacklist()
-                    && blacklist.matches(*auction->request, bidder.agent,
-                                         config)) {
-                    ML::atomic_inc(info.stats->userBlacklisted);
-                    doFilterStat("dynamic.userBlacklisted");
-                    continue;
+                if (config.hasBlacklist()) {
+                    std::lock_guard<ML::Spinlock> guard(blacklistLock);
+                    if (blacklist.matches(*auction->request, bidder.agent,
+                                          config)) {
+                        ML::atomic_inc(info.stats->userBlacklisted);
+                        doFilterStat("dynamic.userBlacklisted");
+                        continue;
+                    }
                 }
 
                 bidder.inFlightProp
-                    = info.numBidsInFlight() / max(info.config->maxInFlight, 1);
+                    = info.status->numBidsInFlight
+                    / max(info.config->maxInFlight, 1);
 
                 ML::atomic_inc(info.stats->passedDynamicFilters);
                 doFilterStat("passedDynamicFilters");
@@ -1600,7 +1722,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
             }
             AgentInfo & info = agents[agent];
 
-            ++info.stats->auctions;
+            ML::atomic_inc(info.stats->auctions);
 
             Json::Value aggregatedAug;
             for (const auto& aug : augList) {
@@ -1635,13 +1757,13 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
         }
 
         if (!auctionInfo.bidders.empty()) {
-            bidder->sendAuctionMessage(
+            shard.bidder->sendAuctionMessage(
                     auctionInfo.auction, timeLeftMs, auctionInfo.bidders);
         }
         else {
             /* No bidders; don't bother with the bid */
             ML::atomic_inc(numNoBidders);
-            inFlight.erase(auctionId);
+            shard.inFlight.erase(auctionId);
             //cerr << fName << "About to call finish " << endl;
             if (!auction->finish()) {
                 recordHit("tooLateToFinish");
@@ -1659,7 +1781,8 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
 AuctionInfo &
 Router::
-addAuction(std::shared_ptr<Auction> auction, Date lossTimeout)
+addAuction(RouterShard & shard,
+           std::shared_ptr<Auction> auction, Date lossTimeout)
 {
     const Id & id = auction->id;
 
@@ -1667,7 +1790,7 @@ addAuction(std::shared_ptr<Auction> auction, Date lossTimeout)
 
     try {
         AuctionInfo & result
-            = inFlight.insert(id, AuctionInfo(auction, lossTimeout),
+            = shard.inFlight.insert(id, AuctionInfo(auction, lossTimeout),
                               getCurrentTime().plusSeconds(bidMemoryWindow));
         return result;
     } catch (const std::exception & exc) {
@@ -1690,62 +1813,27 @@ static bool failBid(double proportion)
 
 void
 Router::
-doBid(const std::vector<std::string> & message)
+doBid(RouterShard & shard, const std::vector<std::string> & message)
 {
     //static const char *fName = "Router::doBid:";
     if (failBid(bidsErrorRate)) {
-        returnErrorResponse(message, "Intentional error response (--bids-error-rate)");
+        returnErrorResponse(shard, message, "Intentional error response (--bids-error-rate)");
         return;
     }
 
     Date dateGotBid = Date::now();
 
-    RouterProfiler profiler(dutyCycleCurrent.nsBid);
+    RouterProfiler profiler(shard.dutyCycleCurrent.nsBid);
 
     ML::atomic_inc(numBids);
 
     if (message.size() < 5 || message.size() > 6) {
-        returnErrorResponse(message, "BID message has 4-5 parts");
+        returnErrorResponse(shard, message, "BID message has 4-5 parts");
         return;
     }
 
-    static std::map<const char *, unsigned long long> times;
-
-    static Date lastPrinted = Date::now();
-
-    if (lastPrinted.secondsUntil(dateGotBid) > 10.0) {
-#if 0
-        unsigned long long total = 0;
-        for (auto it = times.begin(), end = times.end(); it != end;  ++it)
-            total += it->second;
-
-        cerr << "doBid of " << total << " microseconds" << endl;
-        cerr << "id = " << message[2] << endl;
-        for (auto it = times.begin(), end = times.end();
-             it != end;  ++it) {
-            cerr << ML::format("%-30s %8lld %6.2f%%\n",
-                               it->first,
-                               it->second,
-                               100.0 * it->second / total);
-        }
-#endif
-        lastPrinted = dateGotBid;
-        times.clear();
-    }
-
-    double current = getProfilingTime();
-
-    auto doProfileEvent = [&] (int i, const char * what)
-        {
-            return;
-            double after = getProfilingTime();
-            times[what] += microsecondsBetween(after, current);
-            current = after;
-        };
-
     recordHit("bid");
 
-    doProfileEvent(0, "start");
 
     Id auctionId(message[2]);
 
@@ -1758,43 +1846,39 @@ doBid(const std::vector<std::string> & message)
     static const string nullStr("null");
     const string & meta = (message.size() >= 6 ? message[5] : nullStr);
 
-    doProfileEvent(1, "params");
 
     debugAuction(auctionId, "BID", message);
 
-    if (!agents.count(agent)) {
-        returnErrorResponse(message, "unknown agent");
+    if (!shard.agents.count(agent)) {
+        returnErrorResponse(shard, message, "unknown agent");
         return;
     }
 
-    doProfileEvent(2, "agents");
 
-    AgentInfo & info = agents[agent];
+    AgentInfo & info = shard.agents[agent];
 
     /* One less in flight. */
     if (!info.expireBidInFlight(auctionId)) {
         recordHit("bidError.agentNotBidding");
-        returnErrorResponse(message, "agent wasn't bidding on this auction");
+        returnErrorResponse(shard, message, "agent wasn't bidding on this auction");
         return;
     }
 
-    doProfileEvent(3, "inFlight");
 
-    auto it = inFlight.find(auctionId);
-    if (it == inFlight.end()) {
+    auto it = shard.inFlight.find(auctionId);
+    if (it == shard.inFlight.end()) {
         recordHit("bidError.unknownAuction");
-        returnErrorResponse(message, "unknown auction");
+        returnErrorResponse(shard, message, "unknown auction");
         return;
     }
 
-    doProfileEvent(4, "account");
 
     AuctionInfo & auctionInfo = it->second;
 
     auto biddersIt = auctionInfo.bidders.find(agent);
     if (biddersIt == auctionInfo.bidders.end()) {
         recordHit("bidError.agentSkippedAuction");
-        returnErrorResponse(message,
+        returnErrorResponse(shard, message,
                             "agent shouldn't bid on this auction");
         return;
     }
@@ -1803,7 +1887,6 @@ doBid(const std::vector<std::string> & message)
 
     recordHit("accounts.%s.bids", config.account.toString('.'));
 
-    doProfileEvent(5, "auctionInfo");
 
     //cerr << "info.inFlight = " << info.inFlight << endl;
 
@@ -1821,7 +1904,7 @@ doBid(const std::vector<std::string> & message)
                             config.account.toString('.'),
                             reason);
 
-            ++info.stats->invalid;
+            ML::atomic_inc(info.stats->invalid);
 
             va_list ap;
             va_start(ap, message);
@@ -1838,13 +1921,12 @@ doBid(const std::vector<std::string> & message)
                  << formatted << endl;
             cerr << biddata << endl;
 
-            bidder->sendBidInvalidMessage(agent, formatted, auctionInfo.auction);
+            shard.bidder->sendBidInvalidMessage(agent, formatted, auctionInfo.auction);
         };
 
     BidInfo bidInfo(std::move(biddersIt->second));
     auctionInfo.bidders.erase(biddersIt);
 
-    doProfileEvent(6, "bidInfo");
 
     int numPassedBids = 0;
 
@@ -1858,7 +1940,6 @@ doBid(const std::vector<std::string> & message)
         return;
     }
 
-    doProfileEvent(6, "parsing");
 
     ExcCheckEqual(bids.size(), bidInfo.imp.size(),
             "invalid shape for bids array");
@@ -1932,7 +2013,6 @@ doBid(const std::vector<std::string> & message)
             continue;
         }
 
-        doProfileEvent(6, "creativeCompatibility");
 
         string auctionKey
             = auctionId.toString() + "-"
@@ -1945,9 +2025,9 @@ doBid(const std::vector<std::string> & message)
         if (!banker->authorizeBid(config.account, auctionKey, price)
                 || failBid(budgetErrorRate))
         {
-            ++info.stats->noBudget;
+            ML::atomic_inc(info.stats->noBudget);
 
-            bidder->sendNoBudgetMessage(agent, auctionInfo.auction);
+            shard.bidder->sendNoBudgetMessage(agent, auctionInfo.auction);
 
             this->logMessage("NOBUDGET", agent, auctionId,
                     biddata, meta);
@@ -1957,7 +2037,6 @@ doBid(const std::vector<std::string> & message)
 	recordCount(bid.price.value, "cummulatedBidPrice");
 	recordCount(price.value, "cummulatedAuthorizedPrice");
 
-        doProfileEvent(6, "banker");
 
         if (doDebug)
             this->debugSpot(auctionId, imp[spotIndex].id,
@@ -1985,7 +2064,6 @@ doBid(const std::vector<std::string> & message)
         Auction::WinLoss localResult
             = auctionInfo.auction->setResponse(spotIndex, response);
 
-        doProfileEvent(6, "bidSubmission");
         ++numValidBids;
 
         // Possible results:
@@ -2004,20 +2082,20 @@ doBid(const std::vector<std::string> & message)
 
         switch (localResult.val) {
         case Auction::WinLoss::PENDING: {
-            ++info.stats->bids;
-            info.stats->totalBid += bid.price;
+            ML::atomic_inc(info.stats->bids);
+            info.stats->addBid(bid.price);
             break; // response will be sent later once local winning bid known
         }
         case Auction::WinLoss::LOSS:
-            ++info.stats->bids;
-            info.stats->totalBid += bid.price;
+            ML::atomic_inc(info.stats->bids);
+            info.stats->addBid(bid.price);
             // fall through
         case Auction::WinLoss::TOOLATE:
         case Auction::WinLoss::INVALID: {
             if (localResult.val == Auction::WinLoss::TOOLATE)
-                ++info.stats->tooLate;
+                ML::atomic_inc(info.stats->tooLate);
             else if (localResult.val == Auction::WinLoss::INVALID)
-                ++info.stats->invalid;
+                ML::atomic_inc(info.stats->invalid);
 
             banker->cancelBid(config.account, auctionKey);
 
@@ -2025,15 +2103,15 @@ doBid(const std::vector<std::string> & message)
             switch (localResult.val) {
             case Auction::WinLoss::LOSS:
                 status = BS_LOSS;
-                bidder->sendLossMessage(agent, auctionId.toString());
+                shard.bidder->sendLossMessage(agent, auctionId.toString());
                 break;
             case Auction::WinLoss::TOOLATE:
                 status = BS_TOOLATE;
-                bidder->sendTooLateMessage(agent, auctionInfo.auction);
+                shard.bidder->sendTooLateMessage(agent, auctionInfo.auction);
                 break;
             case Auction::WinLoss::INVALID:
                 status = BS_INVALID;
-                bidder->sendBidInvalidMessage(agent, msg, auctionInfo.auction);
+                shard.bidder->sendBidInvalidMessage(agent, msg, auctionInfo.auction);
                 break;
             default:
                 throw ML::Exception("logic error");
@@ -2051,7 +2129,6 @@ doBid(const std::vector<std::string> & message)
                     "unknown bid result returned by auction");
         }
 
-        doProfileEvent(6, "bidResponse");
     }
 
     if (numValidBids > 0) {
@@ -2064,12 +2141,11 @@ doBid(const std::vector<std::string> & message)
         // Passed on the ... add to the blacklist
         if (config.hasBlacklist()) {
             const BidRequest & bidRequest = *auctionInfo.auction->request;
+            std::lock_guard<ML::Spinlock> guard(blacklistLock);
             blacklist.add(bidRequest, agent, *info.config);
         }
-        doProfileEvent(8, "blacklist");
     }
 
-    doProfileEvent(8, "postParsing");
 
     double bidTime = dateGotBid.secondsSince(bidInfo.bidTime);
 
@@ -2082,25 +2158,23 @@ doBid(const std::vector<std::string> & message)
                   "accounts.%s.bidResponseTimeMs",
                   config.account.toString('.'));
 
-    doProfileEvent(9, "postTiming");
 
     if (auctionInfo.bidders.empty()) {
         debugAuction(auctionId, "FINISH", message);
         if (!auctionInfo.auction->finish()) {
             debugAuction(auctionId, "FINISH TOO LATE", message);
         }
-        inFlight.erase(auctionId);
+        shard.inFlight.erase(auctionId);
         //cerr << "couldn't finish auction " << auctionInfo.auction->id
         //<< " after bid " << message << endl;
     }
 
-    doProfileEvent(10, "finishAuction");
 
     // TODO: clean up if no bids were made?
 #if 0
     // Bids must be the same shape as the bid info or empty
     if (bidInfo.imp.size() != bids.size() && bids.size() != 0) {
-        ++info.stats->bidErrors;
+        ML::atomic_inc(info.stats->bidErrors);
         returnInvalidBid(-1, "wrongBidResponseShape",
                          "number of imp in bid request doesn't match "
                          "those in bid: %d vs %d",
@@ -2110,7 +2184,7 @@ doBid(const std::vector<std::string> & message)
 
         if (auctionInfo.bidders.empty()) {
             auctionInfo.auction->finish();
-            inFlight.erase(auctionId);
+            shard.inFlight.erase(auctionId);
         }
     }
 #endif
@@ -2118,14 +2192,14 @@ doBid(const std::vector<std::string> & message)
 
 void
 Router::
-doSubmitted(std::shared_ptr<Auction> auction)
+doSubmitted(RouterShard & shard, std::shared_ptr<Auction> auction)
 {
     // Auction was submitted
 
     // Either a) move it across to the win queue, or b) drop it if we
     // didn't bid anything
 
-    RouterProfiler profiler(dutyCycleCurrent.nsSubmitted);
+    RouterProfiler profiler(shard.dutyCycleCurrent.nsSubmitted);
 
     const Id & auctionId = auction->id;
 
@@ -2181,9 +2255,9 @@ doSubmitted(std::shared_ptr<Auction> auction)
 
             //cerr << "doing response " << i << endl;
 
-            if (!agents.count(response.agent)) continue;
+            if (!shard.agents.count(response.agent)) continue;
 
-            AgentInfo & info = agents[response.agent];
+            AgentInfo & info = shard.agents[response.agent];
 
             Amount bid_price = response.price.maxPrice;
 
@@ -2221,15 +2295,15 @@ doSubmitted(std::shared_ptr<Auction> auction)
                                "auction should not be invalid");
             case Auction::WinLoss::LOSS:
                 bidStatus = BS_LOSS;
-                ++info.stats->losses;
+                ML::atomic_inc(info.stats->losses);
                 msg = "LOSS";
-                bidder->sendLossMessage(response.agent, auctionId.toString());
+                shard.bidder->sendLossMessage(response.agent, auctionId.toString());
                 break;
             case Auction::WinLoss::TOOLATE:
                 bidStatus = BS_TOOLATE;
-                ++info.stats->tooLate;
+                ML::atomic_inc(info.stats->tooLate);
                 msg = "TOOLATE";
-                bidder->sendTooLateMessage(response.agent, auction);
+                shard.bidder->sendTooLateMessage(response.agent, auction);
                 break;
             default:
                 throwException("doSubmitted.unknownStatus",
@@ -2354,7 +2428,7 @@ onAuctionDone(std::shared_ptr<Auction> auction)
 #endif
 
     debugAuction(auction->id, "SENT SUBMITTED");
-    submittedBuffer.push(auction);
+    shardFor(auction->id).submittedBuffer.push(auction);
 }
 
 void
@@ -2367,6 +2441,7 @@ updateAllAgents()
 
         AllAgentInfo * current = allAgents;
 
+        const Agents & agents = shards[0]->agents;
         for (auto it = agents.begin(), end = agents.end();  it != end;  ++it) {
             if (!it->second.configured) continue;
             if (!it->second.config) continue;
@@ -2399,40 +2474,102 @@ updateAllAgents()
 
 void
 Router::
-doConfig(const std::string & agent,
-         std::shared_ptr<const AgentConfig> config)
+doConfigs(const std::vector<std::pair<std::string,
+                                      std::shared_ptr<const AgentConfig> > > & configs)
 {
-    RouterProfiler profiler(dutyCycleCurrent.nsConfig);
+    RouterShard & shard = *shards[0];
+    RouterProfiler profiler(shard.dutyCycleCurrent.nsConfig);
     //const string fName = "Router::doConfig:";
-    logMessage("CONFIG", agent, boost::trim_copy(config->toJson().toString()));
 
-    // TODO: no need for this...
-    auto newConfig = std::make_shared<AgentConfig>(*config);
-    if (newConfig->roundRobinGroup == "")
-        newConfig->roundRobinGroup = agent;
+    std::vector<std::string> agents;
+    std::unordered_set<std::string> seen;
 
-    AgentInfo & info = agents[agent];
+    for (auto & c: configs) {
+        const std::string & agent = c.first;
+        const std::shared_ptr<const AgentConfig> & config = c.second;
 
-    if (info.configured) {
-        unconfigure(agent, *info.config);
-        info.configured = false;
-    }
+        logMessage("CONFIG", agent,
+                   boost::trim_copy(config->toJson().toString()));
 
-    info.config = newConfig;
-    //cerr << "configured " << agent << " strategy : " << info.config->strategy << " campaign "
-    //     <<  info.config->campaign << endl;
+        // TODO: no need for this...
+        auto newConfig = std::make_shared<AgentConfig>(*config);
+        if (newConfig->roundRobinGroup == "")
+            newConfig->roundRobinGroup = agent;
 
-    string bidRequestFormat = "jsonRaw";
-    info.setBidRequestFormat(bidRequestFormat);
+        AgentInfo & info = shard.agents[agent];
 
-    configure(agent, *newConfig);
-    info.configured = true;
-    bidder->sendMessage(agent, "GOTCONFIG");
+        if (info.configured) {
+            unconfigure(agent, *info.config);
+            info.configured = false;
+        }
 
-    info.filterIndex = filters.addConfig(agent, info);
+        info.config = newConfig;
+        //cerr << "configured " << agent << " strategy : " << info.config->strategy << " campaign "
+        //     <<  info.config->campaign << endl;
 
-    // Broadcast that we have a new agent or it has a new configuration
+        string bidRequestFormat = "jsonRaw";
+        info.setBidRequestFormat(bidRequestFormat);
+
+        configure(agent, *newConfig);
+        info.configured = true;
+        shard.bidder->sendMessage(agent, "GOTCONFIG");
+
+        if (seen.insert(agent).second)
+            agents.push_back(agent);
+    }
+
+    // One copy of the filters for the whole batch
+    FilterPool::ConfigBatch batch;
+    for (auto & agent: agents)
+        batch.emplace_back(agent, &shard.agents[agent]);
+
+    std::vector<unsigned> indexes = filters.addConfigs(batch);
+    for (unsigned i = 0;  i < agents.size();  ++i)
+        shard.agents[agents[i]].filterIndex = indexes[i];
+
+    // Broadcast that we have new agents or new configurations
     updateAllAgents();
+
+    // Let the other shards know; they share everything but the bids in
+    // flight with us.
+    for (unsigned i = 1;  i < shards.size();  ++i) {
+        for (auto & agent: agents) {
+            const AgentInfo & info = shard.agents[agent];
+
+            RouterShard::AgentUpdate update;
+            update.agent = agent;
+            update.config = info.config;
+            update.status = info.status;
+            update.stats = info.stats;
+            update.filterIndex = info.filterIndex;
+
+            shards[i]->agentBuffer.push(update);
+            shards[i]->wakeup.signal();
+        }
+    }
+}
+
+void
+Router::
+doAgentUpdate(RouterShard & shard, const RouterShard::AgentUpdate & update)
+{
+    AgentInfo & info = shard.agents[update.agent];
+
+    if (info.status != update.status) {
+        // New agent for the main shard; our own bids in flight still need
+        // to be counted in its total.
+        ML::atomic_add(update.status->numBidsInFlight,
+                       info.numBidsInFlight());
+        info.status = update.status;
+    }
+
+    info.config = update.config;
+    info.stats = update.stats;
+    info.filterIndex = update.filterIndex;
+    info.setBidRequestFormat("jsonRaw");
+    info.configured = true;
+
+    shard.bidder->sendMessage(update.agent, "GOTCONFIG");
 }
 
 void
@@ -2544,9 +2681,9 @@ getAllAgentInfo() const
 
 void
 Router::
-sendPings()
+sendPings(RouterShard & shard)
 {
-    for (auto it = agents.begin(), end = agents.end();
+    for (auto it = shard.agents.begin(), end = shard.agents.end();
          it != end;  ++it) {
         const string & agent = it->first;
         AgentInfo & info = it->second;
@@ -2554,9 +2691,9 @@ sendPings()
         // 1.  Send out new pings
         Date now = Date::now();
         if (info.sendPing(0, now))
-            bidder->sendPingMessage(agent, 0);
+            shard.bidder->sendPingMessage(agent, 0);
         if (info.sendPing(1, now))
-            bidder->sendPingMessage(agent, 1);
+            shard.bidder->sendPingMessage(agent, 1);
 
         // 2.  Look at the trend
         //double mean, max;
@@ -2565,7 +2702,8 @@ sendPings()
 
 void
 Router::
-doPong(int level, const std::vector<std::string> & message)
+doPong(RouterShard & shard,
+       int level, const std::vector<std::string> & message)
 {
     //cerr << "dopong (router)" << message << endl;
 
@@ -2578,8 +2716,8 @@ doPong(int level, const std::vector<std::string> & message)
     double outgoingTime = receivedTime.secondsSince(sentTime);
     double incomingTime = now.secondsSince(receivedTime);
 
-    auto it = agents.find(agent);
-    if (it == agents.end()) {
+    auto it = shard.agents.find(agent);
+    if (it == shard.agents.end()) {
         cerr << "warning: dead agent sent a pong: " << agent << endl;
         return;
     }
@@ -2642,6 +2780,36 @@ getAgentEntry(const std::string & agent) const
     return ac->at(it->second);
 }
 
+RouterShard &
+Router::
+shardFor(const AgentBridge * bridge)
+{
+    for (auto & shard: shards)
+        if (&shard->bridge == bridge)
+            return *shard;
+
+    throw ML::Exception("bridge doesn't belong to any of the router's shards");
+}
+
+std::string
+Router::
+shardServiceName(unsigned index) const
+{
+    if (index == 0)
+        return serviceName();
+    return serviceName() + ".shard" + std::to_string(index);
+}
+
+size_t
+Router::
+numInFlight() const
+{
+    size_t result = 0;
+    for (auto & shard: shards)
+        result += shard->numInFlight;
+    return result;
+}
+
 void
 Router::
 submitToPostAuctionService(std::shared_ptr<Auction> auction,
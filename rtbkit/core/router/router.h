@@ -27,6 +27,7 @@
 #include "jml/utils/smart_ptr_utils.h"
 #include <unordered_set>
 #include <thread>
+#include <atomic>
 #include "rtbkit/common/exchange_connector.h"
 #include "rtbkit/core/agent_configuration/blacklist.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
@@ -69,6 +70,87 @@ struct AllAgentInfo : public std::vector<AgentInfoEntry> {
     std::unordered_map<AccountKey, std::vector<int> > accountIndex;
 };
 
+/*****************************************************************************/
+/* ROUTER SHARD                                                              */
+/*****************************************************************************/
+
+/** State of one of the router's bidding loops.
+
+    Auctions are assigned to a shard by the hash of their id.  Everything
+    that happens to an auction between the end of its augmentation and its
+    submission (sending it to the agents, keeping track of the bids in flight
+    and recording the bids) is done by the shard's own thread, using only the
+    shard's structures, so that the shards scale independently.
+
+    Each shard has its own endpoint for the agents; the agents connect to all
+    of them and answer a bid request to the shard that sent it.  Shard 0 is
+    the main shard: it also owns the agent configuration and the router's
+    housekeeping, and forwards the configuration of the agents to the other
+    shards.
+*/
+struct RouterShard {
+    RouterShard(std::shared_ptr<zmq::context_t> context, unsigned index)
+        : index(index),
+          bridge(context),
+          startBiddingBuffer(65536),
+          submittedBuffer(65536),
+          agentBuffer(1024),
+          numInFlight(0)
+    {
+    }
+
+    unsigned index;
+
+    /** Connection to the agents and the interface that talks over it. */
+    AgentBridge bridge;
+    std::shared_ptr<BidderInterface> bidder;
+
+    /** Agents known to this shard.  The configuration, stats and status
+        objects are shared with the main shard; the bids in flight are
+        tracked per shard.
+    */
+    typedef std::map<std::string, AgentInfo> Agents;
+    Agents agents;
+
+    /** Auctions of this shard that are currently active. */
+    typedef TimeoutMap<Id, AuctionInfo> InFlight;
+    InFlight inFlight;
+
+    /** Size of inFlight, published by the shard's thread once per loop
+        iteration so that other threads can read it without touching the
+        map.
+    */
+    std::atomic<size_t> numInFlight;
+
+    /** Agent configuration forwarded by the main shard. */
+    struct AgentUpdate {
+        AgentUpdate()
+            : filterIndex(0)
+        {
+        }
+
+        std::string agent;
+        std::shared_ptr<AgentConfig> config;
+        std::shared_ptr<AgentStatus> status;
+        std::shared_ptr<AgentStats> stats;
+        unsigned filterIndex;
+    };
+
+    ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
+    ML::RingBufferSRMW<std::shared_ptr<Auction> > submittedBuffer;
+    ML::RingBufferSRMW<AgentUpdate> agentBuffer;
+
+    ML::Wakeup_Fd wakeup;
+
+    DutyCycleEntry dutyCycleCurrent;
+
+    /** Thread running the shard's loop (not used by the main shard, which
+        runs in the router's thread).
+    */
+    boost::scoped_ptr<boost::thread> runThread;
+};
+
+
 /*****************************************************************************/
 /* DEBUG INFO                                                                */
 /*****************************************************************************/
@@ -132,6 +214,13 @@ struct Router : public ServiceBase,
     std::shared_ptr<Banker> getBanker() const;
     void setBanker(const std::shared_ptr<Banker> & newBanker);
 
+    /** Set the number of shards over which the auctions are spread.  Must
+        be called before init().
+    */
+    void setNumShards(unsigned newValue);
+
+    unsigned getNumShards() const { return numShards; }
+
     /** Initialize the bidder interface. */
     void initBidderInterface(Json::Value const & json);
 
@@ -141,7 +230,9 @@ struct Router : public ServiceBase,
     /** Bind to TCP/IP ports and publish where to connect to. */
     void bindTcp();
 
-    /** Bind a zeroMQ URI for the agent to listen on. */
+    /** Bind a zeroMQ URI for the agent to listen on.  This is the
+        endpoint of the main shard; the others are bound to TCP ports.
+    */
     void bindAgents(std::string agentUri);
 
     /** Bind a zeroMQ URI to listen for augmentation messages on. */
@@ -391,45 +482,71 @@ public:
     void updateAllAgents();
 
     /** Map from the configured name of the agent to the agent info. */
-    typedef std::map<std::string, AgentInfo> Agents;
-    Agents agents;
+    typedef RouterShard::Agents Agents;
 
     ML::RingBufferSRMW<std::pair<std::string, std::shared_ptr<const AgentConfig> > > configBuffer;
     ML::RingBufferSRMW<std::shared_ptr<ExchangeConnector> > exchangeBuffer;
-    ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
-    ML::RingBufferSRMW<std::shared_ptr<Auction> > submittedBuffer;
-    ML::RingBufferSWMR<std::shared_ptr<Auction> > auctionGraveyard;
+    ML::RingBufferSRMW<std::shared_ptr<Auction> > auctionGraveyard;
+
+    /** Shards of the router; shards[0] is the main shard.  The vector is
+        fixed once init() has been called.
+    */
+    unsigned numShards;
+    std::vector<std::unique_ptr<RouterShard> > shards;
+
+    /** Return the shard that handles the given auction. */
+    RouterShard & shardFor(const Id & auctionId)
+    {
+        return *shards[auctionId.hash() % shards.size()];
+    }
+
+    /** Return the shard that talks to the agents over the given bridge.
+        This is how the bidder interfaces find their shard.
+    */
+    RouterShard & shardFor(const AgentBridge * bridge);
+
+    /** Name under which the given shard registers its agent endpoint. */
+    std::string shardServiceName(unsigned index) const;
 
-    ML::Wakeup_Fd wakeupMainLoop;
+    /** Total number of auctions in flight over all of the shards. */
+    size_t numInFlight() const;
 
     FilterPool filters;
 
     AugmentationLoop augmentationLoop;
+
+    /** Shared by all of the shards; protected by blacklistLock. */
     Blacklist blacklist;
+    ML::Spinlock blacklistLock;
 
     LoopMonitor loopMonitor;
     LoadStabilizer loadStabilizer;
 
-    /** List of auctions we're currently tracking as active. */
-    typedef TimeoutMap<Id, AuctionInfo> InFlight;
-    InFlight inFlight;
+    typedef RouterShard::InFlight InFlight;
 
     /** Add the given auction to our data structures. */
     AuctionInfo &
-    addAuction(std::shared_ptr<Auction> auction, Date timeout);
+    addAuction(RouterShard & shard,
+               std::shared_ptr<Auction> auction, Date timeout);
 
-    DutyCycleEntry dutyCycleCurrent;
+    /** Duty cycle history of the main shard. */
     std::vector<DutyCycleEntry> dutyCycleHistory;
 
+    /** Run the main shard's loop. */
     void run();
 
-    void handleAgentMessage(const std::vector<std::string> & message);
+    /** Run the loop of the given shard. */
+    void runShard(RouterShard & shard);
 
-    void checkDeadAgents();
+    void handleAgentMessage(RouterShard & shard,
+                            const std::vector<std::string> & message);
 
-    void checkExpiredAuctions();
+    void checkDeadAgents(RouterShard & shard);
 
-    void returnErrorResponse(const std::vector<std::string> & message,
+    void checkExpiredAuctions(RouterShard & shard);
+
+    void returnErrorResponse(RouterShard & shard,
+                             const std::vector<std::string> & message,
                              const std::string & error);
 
     void doShutdown();
@@ -452,26 +569,34 @@ public:
     */
     void doStartBidding(const std::vector<std::string> & message);
 
-    /** Ditto but taking the augmented auction directly. */
-    void doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo);
+    /** Ditto but taking the augmented auction directly.  Must be called
+        from the thread of the auction's shard.
+    */
+    void doStartBidding(RouterShard & shard,
+                        const std::shared_ptr<AugmentationInfo> & augInfo);
 
     /** Auction has been submitted.  Do the final cleanup here and send
         it off to the post auction loop. */
-    void doSubmitted(std::shared_ptr<Auction> auction);
+    void doSubmitted(RouterShard & shard, std::shared_ptr<Auction> auction);
 
     //std::unordered_set<Id> recentlySubmitted;  // DEBUG
 
     /** An agent bid on an auction.  Arrange for this bid to be recorded. */
-    void doBid(const std::vector<std::string> & message);
+    void doBid(RouterShard & shard, const std::vector<std::string> & message);
 
     /** An agent responded to a ping message.  Arrange for the ping time
         to be recorded. */
-    void doPong(int level, const std::vector<std::string> & message);
+    void doPong(RouterShard & shard,
+                int level, const std::vector<std::string> & message);
 
     /** Send out a "ping" message to each agent, and interpret the results
         of the previous set of pings (do we need to throttle down?)
     */
-    void sendPings();
+    void sendPings(RouterShard & shard);
+
+    /** The main shard forwarded the configuration of an agent. */
+    void doAgentUpdate(RouterShard & shard,
+                       const RouterShard::AgentUpdate & update);
 
     /** Someone wants stats. */
     void doStats(const std::vector<std::string> & message);
@@ -482,9 +607,12 @@ public:
     /** An auction finished. */
     void onAuctionDone(std::shared_ptr<Auction> auction);
 
-    /** Got a configuration message; update our internal data structures */
-    void doConfig(const std::string & agent,
-                  std::shared_ptr<const AgentConfig> config);
+    /** Got configuration messages; update our internal data structures.
+        The filters and the list of agents are only rebuilt once for all of
+        them.
+    */
+    void doConfigs(const std::vector<std::pair<std::string,
+                                               std::shared_ptr<const AgentConfig> > > & configs);
 
     /* Add a given agent (with the given configuration) to the exchange */
     void configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
@@ -549,9 +677,10 @@ public:
     /** List of exchanges that are active. */
     std::vector<std::shared_ptr<ExchangeConnector> > exchanges;
 
-    /** Bid price calculator */
-    std::shared_ptr<BidderInterface> bidder;
-    AgentBridge bridge;
+    /** Configuration from which the bidder interface of each shard is
+        created.
+    */
+    Json::Value bidderConfig;
 
     /*************************************************************************/
     /* EXCEPTIONS                                                            */
@@ -48,7 +48,8 @@ RouterRunner() :
     logBids(false),
     maxBidPrice(200),
     slowModeTimeout(MonitorClient::DefaultCheckTimeout),
-    useHttpBanker(false)
+    useHttpBanker(false),
+    numShards(1)
 {
 }
 
@@ -81,6 +82,8 @@ doOptions(int argc, char ** argv,
          "log bid responses")
         ("max-bid-price", value(&maxBidPrice),
          "maximum bid price accepted by router")
+        ("shards", value<unsigned>(&numShards),
+         "number of threads over which the router spreads its auctions")
         ("spend-rate", value<string>(&spendRate)->default_value("100000USD/1M"),
          "Amount of budget in USD to be periodically re-authorized (default 100000USD/1M)");
 
@@ -121,6 +124,7 @@ init()
                                       logAuctions, logBids,
                                       USD_CPM(maxBidPrice),
                                       slowModeTimeout);
+    router->setNumShards(numShards);
     router->initBidderInterface(bidderConfig);
     router->init();
 
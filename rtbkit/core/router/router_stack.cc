@@ -134,7 +134,7 @@ numNonIdle() const
 {
     size_t numInFlight, numAwaitingAugmentation;
     {
-        numInFlight = router.inFlight.size();
+        numInFlight = router.numInFlight();
         numAwaitingAugmentation = router.augmentationLoop.numAugmenting();
     }
 
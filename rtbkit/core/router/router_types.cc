@@ -8,6 +8,7 @@
 #include "router_types.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "jml/db/persistent.h"
+#include <mutex>
 
 using namespace std;
 using namespace ML;
@@ -166,6 +167,14 @@ AgentStats()
 {
 }
 
+void
+AgentStats::
+addBid(const Amount & price)
+{
+    std::lock_guard<ML::Spinlock> guard(poolsLock);
+    totalBid += price;
+}
+
 Json::Value
 AgentStats::
 toJson() const
@@ -178,9 +187,12 @@ toJson() const
     result["tooLate"] = tooLate;
     result["invalid"] = invalid;
     result["noBudget"] = noBudget;
-    result["totalBid"] = totalBid.toJson();
-    result["totalBidOnWins"] = totalBidOnWins.toJson();
-    result["totalSpent"] = totalSpent.toJson();
+    {
+        std::lock_guard<ML::Spinlock> guard(poolsLock);
+        result["totalBid"] = totalBid.toJson();
+        result["totalBidOnWins"] = totalBidOnWins.toJson();
+        result["totalSpent"] = totalSpent.toJson();
+    }
     result["tooManyInFlight"] = tooManyInFlight;
     result["requiredIdMissing"] = requiredIdMissing;
     result["notEnoughTime"] = notEnoughTime;
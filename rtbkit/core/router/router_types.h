@@ -14,6 +14,8 @@
 #include <set>
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/bids.h"
+#include "jml/arch/atomic_ops.h"
+#include "jml/arch/spinlock.h"
 
 
 namespace RTBKIT {
@@ -43,6 +45,12 @@ struct AgentStats {
 
     Json::Value toJson() const;
 
+    /** Add to totalBid.  The stats are shared by all of the router's
+        shards, so the counters are updated with atomic increments and the
+        currency pools under poolsLock.
+    */
+    void addBid(const Amount & price);
+
     uint64_t auctions;
     uint64_t bids;
     uint64_t wins;
@@ -54,6 +62,7 @@ struct AgentStats {
     CurrencyPool totalBid;
     CurrencyPool totalBidOnWins;
     CurrencyPool totalSpent;
+    mutable ML::Spinlock poolsLock;
 
     uint64_t tooManyInFlight;
     uint64_t noSpots;
@@ -101,7 +110,7 @@ struct AgentStatus {
 
     bool dead;
     Date lastHeartbeat;
-    size_t numBidsInFlight;
+    size_t numBidsInFlight;  ///< Total over all of the router's shards
 };
 
 /// Information about a agent
@@ -204,18 +213,20 @@ struct AgentInfo {
         }
     }
 
+    /** Number of bids in flight that are tracked by this object.  When the
+        router runs several shards, each one has its own AgentInfo for the
+        agent and status->numBidsInFlight holds the total.
+    */
     size_t numBidsInFlight() const
     {
-        // DEBUG
-        if (status->numBidsInFlight != bidsInFlight.size())
-            throw ML::Exception("numBidsInFlight is wrong");
-        return status->numBidsInFlight;
+        return bidsInFlight.size();
     }
     
     bool expireBidInFlight(const Id & id)
     {
         bool result = bidsInFlight.erase(id);
-        status->numBidsInFlight = bidsInFlight.size();
+        if (result)
+            ML::atomic_dec(status->numBidsInFlight);
         return result;
     }
 
@@ -223,7 +234,8 @@ struct AgentInfo {
     bool trackBidInFlight(const Id & id, Date date = Date::now())
     {
         bool result = bidsInFlight.insert(std::make_pair(id, date)).second;
-        status->numBidsInFlight = bidsInFlight.size();
+        if (result)
+            ML::atomic_inc(status->numBidsInFlight);
         return result;
     }
 
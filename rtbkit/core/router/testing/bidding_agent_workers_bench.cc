@@ -0,0 +1,270 @@
+/* bidding_agent_workers_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Throughput of an agent whose pricing takes 200us per bid request, for
+   different numbers of worker threads.  The auctions of the 20000 auction
+   sample are replayed through a router as fast as it accepts them.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/router/router.h"
+#include "rtbkit/core/agent_configuration/agent_configuration_service.h"
+#include "rtbkit/plugins/bidding_agent/bidding_agent.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <boost/test/unit_test.hpp>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+/** Time spent by the pricing model on each bid request. */
+const double PricingTime = 200e-6;
+
+struct BenchExchange : public ExchangeConnector {
+    BenchExchange(std::shared_ptr<ServiceProxies> proxies)
+        : ExchangeConnector("bench", proxies)
+    {
+    }
+
+    virtual void enableUntil(Date date)
+    {
+    }
+
+    virtual std::string exchangeName() const
+    {
+        return "bench";
+    }
+};
+
+struct Sample {
+    std::string requestStr;
+    std::shared_ptr<BidRequest> request;
+};
+
+vector<Sample> loadSample()
+{
+    filter_istream stream("rtbkit/core/router/testing/20000-datacratic-auctions.xz");
+
+    vector<Sample> result;
+    while (stream) {
+        Sample sample;
+        getline(stream, sample.requestStr);
+        if (sample.requestStr.empty()) continue;
+        sample.request.reset(BidRequest::parse("datacratic", sample.requestStr));
+        result.push_back(sample);
+    }
+
+    return result;
+}
+
+struct Result {
+    double auctionsPerSecond;
+    double bidsPerSecond;
+    uint64_t outOfOrder;
+};
+
+/** Run a router and one agent with the given number of worker threads, and
+    have numFeeders threads inject the sample auctions for the given amount
+    of time, keeping up to maxInFlight of them in progress each.
+*/
+Result runBench(const vector<Sample> & sample,
+                int numWorkers,
+                int numFeeders,
+                int maxInFlight,
+                double duration)
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+
+    AgentConfigurationService agentConfig(proxies, "config");
+    agentConfig.unsafeDisableMonitor();
+    agentConfig.init();
+    agentConfig.bindTcp();
+    agentConfig.start();
+
+    Router router(proxies, "router", 2.0, false /* post auction loop */);
+    router.unsafeDisableMonitor();
+    router.unsafeDisableAuctionProbability();
+    router.init();
+
+    BenchExchange exchange(proxies);
+    router.addExchange(exchange);
+
+    router.bindTcp();
+    router.start();
+
+    BiddingAgent agent(proxies, "bench-agent");
+    agent.useWorkerThreads(numWorkers);
+
+    /* Auctions whose bid callback is still running; a result for one of
+       them would mean that the messages of an auction were reordered. */
+    std::mutex pricingLock;
+    std::unordered_set<Id> pricing;
+    std::atomic<uint64_t> outOfOrder(0);
+
+    agent.onBidRequest = [&] (double timestamp,
+                              Id id,
+                              std::shared_ptr<BidRequest> br,
+                              const Bids & requested,
+                              double timeLeftMs,
+                              Json::Value augmentations,
+                              const WinCostModel & wcm)
+        {
+            {
+                std::lock_guard<std::mutex> guard(pricingLock);
+                pricing.insert(id);
+            }
+
+            Timer timer;
+            while (timer.elapsed_wall() < PricingTime) ;
+
+            Bids bids = requested;
+            Bid & bid = bids[0];
+            if (!bid.availableCreatives.empty())
+                bid.bid(bid.availableCreatives[0], USD_CPM(1));
+            agent.doBid(id, bids, Json::Value(), wcm);
+
+            std::lock_guard<std::mutex> guard(pricingLock);
+            pricing.erase(id);
+        };
+
+    auto onResult = [&] (const BidResult & result)
+        {
+            std::lock_guard<std::mutex> guard(pricingLock);
+            if (pricing.count(result.auctionId))
+                ++outOfOrder;
+        };
+
+    agent.onWin = agent.onLoss = agent.onNoBudget = agent.onTooLate
+        = agent.onInvalidBid = agent.onDroppedBid = onResult;
+    agent.onError = [] (double, const std::string & error,
+                        const std::vector<std::string> &)
+        {
+            cerr << "agent error: " << error << endl;
+        };
+
+    AgentConfig config;
+    config.account = { "benchCampaign", "strategy" };
+    config.maxInFlight = 100000;
+    config.creatives.push_back(Creative::sampleLB);
+    config.creatives.push_back(Creative::sampleWS);
+    config.creatives.push_back(Creative::sampleBB);
+
+    agent.init();
+    agent.start();
+    agent.doConfig(config);
+
+    for (auto & shard: router.shards)
+        while (shard->agents.empty())
+            ML::sleep(0.1);
+    ML::sleep(2.0);
+
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numDone(0), numWithBid(0);
+
+    auto doFeeder = [&] (int feeder)
+        {
+            std::atomic<int> inFlight(0);
+            uint64_t n = 0;
+
+            auto onDone = [&] (std::shared_ptr<Auction> auction)
+                {
+                    ++numDone;
+                    if (auction->getCurrentData()->hasValidResponse(0))
+                        ++numWithBid;
+                    --inFlight;
+                    router.onAuctionDone(auction);
+                };
+
+            while (!finished) {
+                if (inFlight >= maxInFlight) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                const Sample & s = sample[n++ % sample.size()];
+
+                auto request = std::make_shared<BidRequest>(*s.request);
+                request->auctionId = Id(ML::format("%d-%lld-",
+                                                   feeder, (long long)n)
+                                        + s.request->auctionId.toString());
+
+                Date start = Date::now();
+                auto auction = std::make_shared<Auction>(
+                        &exchange, onDone, request,
+                        s.requestStr, "datacratic",
+                        start, start.plusSeconds(0.1));
+
+                ++inFlight;
+                router.injectAuction(auction);
+            }
+
+            while (inFlight > 0)
+                std::this_thread::yield();
+        };
+
+    Timer timer;
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < numFeeders;  ++i)
+        threads.emplace_back(doFeeder, i);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(int(duration * 1000)));
+    finished = true;
+
+    for (auto & t: threads)
+        t.join();
+
+    double elapsed = timer.elapsed_wall();
+
+    agent.shutdown();
+    router.shutdown();
+    agentConfig.shutdown();
+
+    return { numDone / elapsed, numWithBid / elapsed, outOfOrder };
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_bidding_agent_workers )
+{
+    vector<Sample> sample = loadSample();
+    cerr << "loaded " << sample.size() << " auctions" << endl;
+
+    double duration = 10.0;
+    int numFeeders = 2;
+    int maxInFlight = 500;
+
+    vector<pair<int, Result> > results;
+
+    for (int workers: { 0, 1, 2, 4, 8 }) {
+        Result result = runBench(sample, workers, numFeeders, maxInFlight,
+                                 duration);
+        BOOST_CHECK_EQUAL(result.outOfOrder, 0);
+        results.emplace_back(workers, result);
+    }
+
+    cerr << ML::format("%7s %12s %10s %8s",
+                       "workers", "auctions/s", "bids/s", "speedup")
+         << endl;
+    for (auto & r: results)
+        cerr << ML::format("%7d %12.0f %10.0f %8.2f",
+                           r.first, r.second.auctionsPerSecond,
+                           r.second.bidsPerSecond,
+                           r.second.bidsPerSecond
+                           / results[0].second.bidsPerSecond)
+             << endl;
+
+    // With the pricing on the message loop we can't do better than this
+    BOOST_CHECK_LT(results[0].second.bidsPerSecond, 1.0 / PricingTime);
+}
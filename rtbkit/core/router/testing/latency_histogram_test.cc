@@ -0,0 +1,83 @@
+/* latency_histogram_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the latency histogram used to pace augmentors.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/latency_histogram.h"
+
+
+using namespace std;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_empty_histogram )
+{
+    LatencyHistogram hist;
+    BOOST_CHECK_EQUAL(hist.numSamples(), 0);
+    BOOST_CHECK_EQUAL(hist.quantile(0.9), 0.0);
+    BOOST_CHECK_EQUAL(hist.fractionUnder(1.0), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_quantiles )
+{
+    LatencyHistogram hist(0 /* no decay */);
+
+    // Up to 10ms, uniformly
+    for (unsigned i = 1;  i <= 1000;  ++i)
+        hist.record(i / 100.0);
+
+    BOOST_CHECK_EQUAL(hist.numSamples(), 1000);
+
+    // Quantiles are rounded up to the bucket boundary, so they can be
+    // up to 20% over
+    double p50 = hist.quantile(0.5);
+    BOOST_CHECK_GE(p50, 5.0);
+    BOOST_CHECK_LE(p50, 5.0 * 1.2);
+
+    double p90 = hist.quantile(0.9);
+    BOOST_CHECK_GE(p90, 9.0);
+    BOOST_CHECK_LE(p90, 9.0 * 1.2);
+
+    // fractionUnder errs on the low side
+    double under = hist.fractionUnder(5.0);
+    BOOST_CHECK_LE(under, 0.5);
+    BOOST_CHECK_GE(under, 0.4);
+
+    BOOST_CHECK_EQUAL(hist.fractionUnder(0.05), 0.0);
+    BOOST_CHECK_EQUAL(hist.fractionUnder(100.0), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_extremes )
+{
+    LatencyHistogram hist;
+    hist.record(0.0);
+    hist.record(-1.0);
+    hist.record(1e9);
+    BOOST_CHECK_EQUAL(hist.numSamples(), 3);
+    BOOST_CHECK_EQUAL(hist.quantile(0.5),
+                      LatencyHistogram::upperBound(0));
+    BOOST_CHECK_EQUAL(hist.quantile(1.0),
+                      LatencyHistogram::upperBound(
+                              LatencyHistogram::NUM_BUCKETS - 1));
+}
+
+BOOST_AUTO_TEST_CASE( test_decay_follows_changes )
+{
+    LatencyHistogram hist(1024);
+
+    for (unsigned i = 0;  i < 10000;  ++i)
+        hist.record(2.0);
+    BOOST_CHECK_LE(hist.quantile(0.9), 2.0 * 1.2);
+
+    // The augmentor gets slow; after a few decay intervals the histogram
+    // should reflect the new latency
+    for (unsigned i = 0;  i < 5000;  ++i)
+        hist.record(20.0);
+    BOOST_CHECK_GE(hist.quantile(0.5), 20.0);
+    BOOST_CHECK_LE(hist.fractionUnder(10.0), 0.1);
+}
@@ -0,0 +1,88 @@
+/* pending_list_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Throughput of the persistent pending list backends for the access
+   pattern of the post auction loop: each submitted bid is put, and is
+   popped again once its win or loss comes in a while later.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/service/pending_list.h"
+#include "jml/utils/environment.h"
+#include "jml/arch/format.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+Env_Option<int> numBids("PENDING_BENCH_BIDS", 200000);
+Env_Option<int> numInFlight("PENDING_BENCH_IN_FLIGHT", 10000);
+Env_Option<int> valueSize("PENDING_BENCH_VALUE_SIZE", 500);
+
+/** Put numBids entries, popping each one numInFlight puts later, and
+    return the number of operations per second including the final flush.
+*/
+template<typename Store>
+double runBench(Store & store)
+{
+    string value(valueSize, 'v');
+
+    Date start = Date::now();
+
+    for (int i = 0;  i < numBids;  ++i) {
+        store.put(ML::format("auction%08d:spot", i), value);
+        if (i >= numInFlight)
+            store.pop(ML::format("auction%08d:spot", i - numInFlight));
+    }
+    store.flush();
+
+    return 2.0 * numBids / Date::now().secondsSince(start);
+}
+
+struct DirectStore : public LeveldbPendingPersistence {
+    void flush()
+    {
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_pending_persistence )
+{
+    vector<pair<string, double> > results;
+
+    {
+        string filename = "tmp/pending_list_bench_direct";
+        leveldb::DestroyDB(filename, leveldb::Options());
+        DirectStore store;
+        store.open(filename);
+        results.emplace_back("direct", runBench(store));
+    }
+
+    for (bool sync: { false, true }) {
+        string filename = "tmp/pending_list_bench_batched";
+        leveldb::DestroyDB(filename, leveldb::Options());
+        BatchedLeveldbPendingPersistence store;
+        store.syncCommits = sync;
+        store.open(filename);
+        results.emplace_back(sync ? "batched sync" : "batched",
+                             runBench(store));
+    }
+
+    cerr << ML::format("%d bids of %d bytes, %d in flight",
+                       (int)numBids, (int)valueSize, (int)numInFlight)
+         << endl;
+    cerr << ML::format("%-14s %12s %8s", "backend", "ops/s", "speedup")
+         << endl;
+    for (auto & r: results)
+        cerr << ML::format("%-14s %12.0f %8.2f",
+                           r.first.c_str(), r.second,
+                           r.second / results[0].second)
+             << endl;
+}
@@ -116,3 +116,94 @@ BOOST_AUTO_TEST_CASE( test_router_init_persistence )
     BOOST_CHECK_EQUAL(pending.completePrefix(o, isPrefix), none);
 }
 
+BOOST_AUTO_TEST_CASE( test_batched_persistence_overlay )
+{
+    string filename = "tmp/pending_list_test_overlay";
+    leveldb::DestroyDB(filename, leveldb::Options());
+
+    {
+        // Never commit on our own, so that only flush() gets things to disk
+        BatchedLeveldbPendingPersistence store(1000.0, 1 << 30);
+        store.open(filename);
+
+        auto inDb = [&] (const string & key)
+            {
+                string value;
+                return store.db->Get(leveldb::ReadOptions(), key, &value).ok();
+            };
+
+        store.put("a", "1");
+        store.put("b", "2");
+        store.put("c", "3");
+        store.erase("a");
+        store.put("c", "4");
+
+        BOOST_CHECK_THROW(store.get("a"), ML::Exception);
+        BOOST_CHECK_EQUAL(store.get("b"), "2");
+        BOOST_CHECK_EQUAL(store.get("c"), "4");
+        BOOST_CHECK(!inDb("b"));
+        BOOST_CHECK_GT(store.backlogBytes(), 0);
+
+        store.flush();
+        BOOST_CHECK_EQUAL(store.backlogBytes(), 0);
+        BOOST_CHECK(!inDb("a"));
+        BOOST_CHECK(inDb("b"));
+        BOOST_CHECK_EQUAL(store.get("c"), "4");
+
+        // pop() sees the overlay and only queues the delete
+        store.put("d", "5");
+        BOOST_CHECK_EQUAL(store.pop("d"), "5");
+        BOOST_CHECK_EQUAL(store.pop("b"), "2");
+        BOOST_CHECK_THROW(store.get("b"), ML::Exception);
+        BOOST_CHECK(inDb("b"));
+
+        store.put("e", "6");
+
+        // Destruction commits what is left
+    }
+
+    LeveldbPendingPersistence store;
+    store.open(filename);
+
+    map<string, string> contents;
+    store.scan([&] (string key, string value) { contents[key] = value; },
+               PendingPersistence::OnError());
+
+    map<string, string> expected = { { "c", "4" }, { "e", "6" } };
+    BOOST_CHECK(contents == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_batched_persistence_background_commit )
+{
+    string filename = "tmp/pending_list_test_background";
+    leveldb::DestroyDB(filename, leveldb::Options());
+
+    BatchedLeveldbPendingPersistence store(0.001, 1000);
+    store.maxPendingBytes = 4000;
+    store.open(filename);
+
+    string value(100, 'x');
+    size_t maxBacklog = 0;
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        store.put(ML::format("%08d", i), value);
+        maxBacklog = std::max(maxBacklog, store.backlogBytes());
+        if (i % 2)
+            store.erase(ML::format("%08d", i - 1));
+    }
+
+    // Writers can't get further ahead than maxPendingBytes
+    BOOST_CHECK_LT(maxBacklog, store.maxPendingBytes + 200);
+
+    // The commit interval empties the backlog without a flush
+    for (unsigned i = 0;  i < 1000 && store.backlogBytes();  ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_CHECK_EQUAL(store.backlogBytes(), 0);
+
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        string result;
+        leveldb::Status status
+            = store.db->Get(leveldb::ReadOptions(), ML::format("%08d", i),
+                            &result);
+        BOOST_CHECK_EQUAL(status.ok(), i % 2 == 1);
+    }
+}
@@ -0,0 +1,252 @@
+/* router_shard_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Throughput of the router for different numbers of shards.  The auctions
+   of the 20000 auction sample are replayed as fast as the router accepts
+   them to a set of agents in the same round robin group.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/router/router.h"
+#include "rtbkit/core/agent_configuration/agent_configuration_service.h"
+#include "rtbkit/plugins/bidding_agent/bidding_agent.h"
+#include "rtbkit/common/creative_configuration.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+/** Exchange connector that the auctions are attached to, so that the
+    router and the agents can get a win cost model for them.
+*/
+struct BenchExchange : public ExchangeConnector {
+    BenchExchange(std::shared_ptr<ServiceProxies> proxies)
+        : ExchangeConnector("bench", proxies)
+    {
+    }
+
+    virtual void enableUntil(Date date)
+    {
+    }
+
+    virtual std::string exchangeName() const
+    {
+        return "bench";
+    }
+};
+
+struct Sample {
+    std::string requestStr;
+    std::shared_ptr<BidRequest> request;
+};
+
+vector<Sample> loadSample()
+{
+    filter_istream stream("rtbkit/core/router/testing/20000-datacratic-auctions.xz");
+
+    vector<Sample> result;
+    while (stream) {
+        Sample sample;
+        getline(stream, sample.requestStr);
+        if (sample.requestStr.empty()) continue;
+        sample.request.reset(BidRequest::parse("datacratic", sample.requestStr));
+        result.push_back(sample);
+    }
+
+    return result;
+}
+
+/** Run a router with the given number of shards, and have numFeeders
+    threads inject the sample auctions into it for the given amount of
+    time, keeping up to maxInFlight of them in progress each.  Returns the
+    number of auctions finished per second.
+*/
+double runBench(const vector<Sample> & sample,
+                int numShards,
+                int numAgents,
+                int numFeeders,
+                int maxInFlight,
+                double duration)
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+
+    AgentConfigurationService agentConfig(proxies, "config");
+    agentConfig.unsafeDisableMonitor();
+    agentConfig.init();
+    agentConfig.bindTcp();
+    agentConfig.start();
+
+    Router router(proxies, "router", 2.0, false /* post auction loop */);
+    router.setNumShards(numShards);
+    router.unsafeDisableMonitor();
+    router.unsafeDisableAuctionProbability();
+    router.init();
+
+    BenchExchange exchange(proxies);
+    router.addExchange(exchange);
+
+    router.bindTcp();
+    router.start();
+
+    vector<std::shared_ptr<BiddingAgent> > agents;
+    for (unsigned i = 0;  i < numAgents;  ++i) {
+        auto agent = std::make_shared<BiddingAgent>(
+                proxies, ML::format("bench-agent-%d", i));
+        BiddingAgent * agentPtr = agent.get();
+
+        agent->onBidRequest = [=] (double timestamp,
+                                   Id id,
+                                   std::shared_ptr<BidRequest> br,
+                                   const Bids & requested,
+                                   double timeLeftMs,
+                                   Json::Value augmentations,
+                                   const WinCostModel & wcm)
+            {
+                Bids bids = requested;
+                Bid & bid = bids[0];
+                if (!bid.availableCreatives.empty())
+                    bid.bid(bid.availableCreatives[0], USD_CPM(1));
+                agentPtr->doBid(id, bids, Json::Value(), wcm);
+            };
+        agent->onWin = agent->onLoss = agent->onNoBudget
+            = agent->onTooLate = agent->onInvalidBid
+            = [] (const BidResult &) {};
+        agent->onDroppedBid = [] (const BidResult &) {};
+        agent->onError = [] (double, const std::string & error,
+                             const std::vector<std::string> &)
+            {
+                cerr << "agent error: " << error << endl;
+            };
+
+        AgentConfig config;
+        config.account = { "benchCampaign", ML::format("strategy%d", i) };
+        config.roundRobinGroup = "bench";
+        config.maxInFlight = 100000;
+        config.creatives.push_back(Creative::sampleLB);
+        config.creatives.push_back(Creative::sampleWS);
+        config.creatives.push_back(Creative::sampleBB);
+
+        agent->init();
+        agent->start();
+        agent->doConfig(config);
+
+        agents.push_back(agent);
+    }
+
+    // Wait for every shard to know about every agent
+    for (auto & shard: router.shards)
+        while (shard->agents.size() < numAgents)
+            ML::sleep(0.1);
+    ML::sleep(2.0);
+
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numDone(0), numWithBid(0);
+
+    auto doFeeder = [&] (int feeder)
+        {
+            std::atomic<int> inFlight(0);
+            uint64_t n = 0;
+
+            auto onDone = [&] (std::shared_ptr<Auction> auction)
+                {
+                    ++numDone;
+                    if (auction->getCurrentData()->hasValidResponse(0))
+                        ++numWithBid;
+                    --inFlight;
+                    router.onAuctionDone(auction);
+                };
+
+            while (!finished) {
+                if (inFlight >= maxInFlight) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                const Sample & s = sample[n++ % sample.size()];
+
+                // Each replayed auction needs its own id
+                auto request = std::make_shared<BidRequest>(*s.request);
+                request->auctionId = Id(ML::format("%d-%lld-",
+                                                   feeder, (long long)n)
+                                        + s.request->auctionId.toString());
+
+                Date start = Date::now();
+                auto auction = std::make_shared<Auction>(
+                        &exchange, onDone, request,
+                        s.requestStr, "datacratic",
+                        start, start.plusSeconds(0.1));
+
+                ++inFlight;
+                router.injectAuction(auction);
+            }
+
+            while (inFlight > 0)
+                std::this_thread::yield();
+        };
+
+    Timer timer;
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < numFeeders;  ++i)
+        threads.emplace_back(doFeeder, i);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(int(duration * 1000)));
+    finished = true;
+
+    for (auto & t: threads)
+        t.join();
+
+    double elapsed = timer.elapsed_wall();
+
+    cerr << ML::format("%zd of %zd auctions had a bid",
+                       (size_t)numWithBid, (size_t)numDone)
+         << endl;
+    BOOST_CHECK_GT(numWithBid, 0);
+
+    for (auto & agent: agents)
+        agent->shutdown();
+    router.shutdown();
+    agentConfig.shutdown();
+
+    return numDone / elapsed;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_router_shards )
+{
+    vector<Sample> sample = loadSample();
+    cerr << "loaded " << sample.size() << " auctions" << endl;
+
+    double duration = 10.0;
+    int numAgents = 8;
+    int numFeeders = 4;
+    int maxInFlight = 1000;
+
+    vector<pair<int, double> > results;
+
+    for (int shards: { 1, 2, 4, 8 }) {
+        double rate = runBench(sample, shards, numAgents, numFeeders,
+                               maxInFlight, duration);
+        results.emplace_back(shards, rate);
+    }
+
+    cerr << ML::format("%6s %12s %8s", "shards", "auctions/s", "speedup")
+         << endl;
+    for (auto & r: results)
+        cerr << ML::format("%6d %12.0f %8.2f",
+                           r.first, r.second, r.second / results[0].second)
+             << endl;
+}
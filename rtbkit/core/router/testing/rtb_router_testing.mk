@@ -6,6 +6,10 @@
 $(eval $(call nodejs_test,rtb_router_unit_test,rtb sync))
 $(eval $(call nodejs_test,rtb_new_format_test,bid_request sync_utils))
 #$(eval $(call test,rtb_router_leak_test,rtb_router rtbsim,boost valgrind))
-$(eval $(call test,pending_list_test,types,boost))
+$(eval $(call test,pending_list_test,types leveldb,boost))
+$(eval $(call test,pending_list_bench,types leveldb,boost manual))
+$(eval $(call test,latency_histogram_test,,boost))
 #$(eval $(call test,router_banker_test,rtb_router dataflow bidding_agent,boost))
 #$(eval $(call test,augmentation_test,rtb_router bid_request augmentor_base,boost))
+$(eval $(call test,router_shard_bench,rtb_router bidding_agent agent_configuration agents_bidder,boost manual))
+$(eval $(call test,bidding_agent_workers_bench,rtb_router bidding_agent agent_configuration agents_bidder,boost manual))
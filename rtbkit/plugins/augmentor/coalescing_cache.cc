@@ -0,0 +1,220 @@
+/* coalescing_cache.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Implementation of the coalescing cache.
+*/
+
+#include "coalescing_cache.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_assert.h"
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* COALESCING CACHE                                                          */
+/*****************************************************************************/
+
+struct CoalescingCache::Shard {
+    Shard(size_t maxEntries)
+        : maxEntries(maxEntries)
+    {
+    }
+
+    struct Entry {
+        std::string value;
+        Date expiry;
+        std::list<std::string>::iterator lru;
+    };
+
+    size_t maxEntries;
+
+    mutable std::mutex lock;
+
+    std::unordered_map<std::string, Entry> entries;
+
+    /// Most recently used at the front
+    std::list<std::string> lru;
+
+    /// Keys being fetched, with whoever is waiting on them
+    std::unordered_map<std::string, std::vector<OnDone> > inFlight;
+
+    Stats stats;
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it)
+    {
+        lru.erase(it->second.lru);
+        entries.erase(it);
+    }
+
+    void insert(const std::string & key, const std::string & value,
+                Date expiry)
+    {
+        if (maxEntries == 0)
+            return;
+
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            it->second.value = value;
+            it->second.expiry = expiry;
+            lru.splice(lru.begin(), lru, it->second.lru);
+            return;
+        }
+
+        while (entries.size() >= maxEntries) {
+            entries.erase(lru.back());
+            lru.pop_back();
+            ++stats.evicted;
+        }
+
+        lru.push_front(key);
+        Entry & entry = entries[key];
+        entry.value = value;
+        entry.expiry = expiry;
+        entry.lru = lru.begin();
+    }
+};
+
+CoalescingCache::
+CoalescingCache(size_t maxEntries, double ttl, int numShards)
+    : maxEntries(maxEntries), ttl(ttl)
+{
+    ExcAssertGreater(numShards, 0);
+
+    // Round up so that the total capacity is at least maxEntries
+    size_t perShard = (maxEntries + numShards - 1) / numShards;
+    for (int i = 0;  i < numShards;  ++i)
+        shards.emplace_back(new Shard(perShard));
+}
+
+CoalescingCache::
+~CoalescingCache()
+{
+}
+
+CoalescingCache::Shard &
+CoalescingCache::
+shardFor(const std::string & key)
+{
+    return *shards[std::hash<std::string>()(key) % shards.size()];
+}
+
+CoalescingCache::LookupResult
+CoalescingCache::
+lookup(const std::string & key,
+       std::string & value,
+       const OnDone & onDone,
+       Date now)
+{
+    Shard & shard = shardFor(key);
+    std::unique_lock<std::mutex> guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        if (it->second.expiry > now) {
+            value = it->second.value;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+            ++shard.stats.hits;
+            return HIT;
+        }
+        shard.erase(it);
+        ++shard.stats.expired;
+    }
+
+    auto jt = shard.inFlight.find(key);
+    if (jt != shard.inFlight.end()) {
+        jt->second.push_back(onDone);
+        ++shard.stats.coalesced;
+        return PENDING;
+    }
+
+    shard.inFlight[key].push_back(onDone);
+    ++shard.stats.misses;
+    return MISS;
+}
+
+void
+CoalescingCache::
+complete(const std::string & key, const std::string & value, Date now)
+{
+    finish(key, value, true /* ok */, true /* store */, now);
+}
+
+void
+CoalescingCache::
+fail(const std::string & key)
+{
+    finish(key, "", false /* ok */, false /* store */, Date());
+}
+
+void
+CoalescingCache::
+finish(const std::string & key, const std::string & value,
+       bool ok, bool store, Date now)
+{
+    std::vector<OnDone> waiting;
+
+    {
+        Shard & shard = shardFor(key);
+        std::unique_lock<std::mutex> guard(shard.lock);
+
+        auto it = shard.inFlight.find(key);
+        if (it == shard.inFlight.end())
+            throw ML::Exception("CoalescingCache: finished fetch of key '%s' "
+                                "that was not in flight", key.c_str());
+        waiting.swap(it->second);
+        shard.inFlight.erase(it);
+
+        if (store)
+            shard.insert(key, value, now.plusSeconds(ttl));
+    }
+
+    for (auto & onDone: waiting)
+        onDone(value, ok);
+}
+
+size_t
+CoalescingCache::
+size() const
+{
+    size_t result = 0;
+    for (auto & shard: shards) {
+        std::unique_lock<std::mutex> guard(shard->lock);
+        result += shard->entries.size();
+    }
+    return result;
+}
+
+void
+CoalescingCache::
+clear()
+{
+    for (auto & shard: shards) {
+        std::unique_lock<std::mutex> guard(shard->lock);
+        shard->entries.clear();
+        shard->lru.clear();
+    }
+}
+
+CoalescingCache::Stats
+CoalescingCache::
+resetStats()
+{
+    Stats result;
+    for (auto & shard: shards) {
+        std::unique_lock<std::mutex> guard(shard->lock);
+        result.hits += shard->stats.hits;
+        result.misses += shard->stats.misses;
+        result.coalesced += shard->stats.coalesced;
+        result.expired += shard->stats.expired;
+        result.evicted += shard->stats.evicted;
+        shard->stats = Stats();
+    }
+    return result;
+}
+
+} // namespace RTBKIT
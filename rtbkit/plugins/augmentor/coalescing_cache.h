@@ -0,0 +1,117 @@
+/* coalescing_cache.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Small in-process cache for remote lookups, with coalescing of the
+   lookups that are in flight.
+*/
+
+#ifndef __rtbkit__coalescing_cache_h__
+#define __rtbkit__coalescing_cache_h__
+
+#include "soa/types/date.h"
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <list>
+
+
+namespace RTBKIT {
+
+using Datacratic::Date;
+
+
+/*****************************************************************************/
+/* COALESCING CACHE                                                          */
+/*****************************************************************************/
+
+/** String to string cache with a time to live and a least recently used
+    eviction policy, for the results of remote lookups (eg, Redis GETs).
+
+    Lookups of a key that is already being fetched don't cause another
+    fetch; the caller is instead told when the fetch in flight finishes.
+
+    The usage is:
+    - call lookup() for the key.  On HIT the value is returned straight
+      away.  On PENDING, onDone will be called once somebody else's fetch
+      finishes.  On MISS, onDone is also registered and the caller is now
+      responsible for fetching the key;
+    - once the fetch is done, call complete() (or fail() on error), which
+      calls all of the onDone callbacks registered for the key.
+
+    Values that are empty (not found) are cached as well, since keys that
+    are not found tend to be asked for as often as those that are.
+
+    The cache is split into shards by key hash, each with its own lock.
+    Callbacks are always called without any lock held.  Thread safe.
+*/
+
+struct CoalescingCache {
+
+    /** Called once a fetch finishes.  ok is false if the fetch failed. */
+    typedef std::function<void (const std::string & value, bool ok)> OnDone;
+
+    enum LookupResult {
+        HIT,       ///< value was filled in from the cache
+        PENDING,   ///< key is being fetched; onDone will be called
+        MISS       ///< caller must fetch the key then call complete()
+    };
+
+    /** Create a cache with up to maxEntries entries that are kept for up
+        to ttl seconds.  A maxEntries of zero disables caching but keeps
+        the coalescing of lookups in flight.
+    */
+    CoalescingCache(size_t maxEntries = 65536, double ttl = 1.0,
+                    int numShards = 16);
+
+    ~CoalescingCache();
+
+    LookupResult lookup(const std::string & key,
+                        std::string & value,
+                        const OnDone & onDone,
+                        Date now = Date::now());
+
+    /** Record the result of a fetch started by a MISS and tell everyone
+        waiting for it. */
+    void complete(const std::string & key, const std::string & value,
+                  Date now = Date::now());
+
+    /** Record that a fetch started by a MISS failed.  Nothing is cached. */
+    void fail(const std::string & key);
+
+    /** Number of values currently cached. */
+    size_t size() const;
+
+    /** Drop everything that is cached.  Lookups in flight are unaffected. */
+    void clear();
+
+    struct Stats {
+        Stats()
+            : hits(0), misses(0), coalesced(0), expired(0), evicted(0)
+        {
+        }
+
+        uint64_t hits, misses, coalesced, expired, evicted;
+    };
+
+    /** Return the statistics accumulated since the last call, and reset
+        them. */
+    Stats resetStats();
+
+    const size_t maxEntries;
+    const double ttl;
+
+private:
+    struct Shard;
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    Shard & shardFor(const std::string & key);
+    void finish(const std::string & key, const std::string & value,
+                bool ok, bool store, Date now);
+};
+
+} // namespace RTBKIT
+
+#endif /* __rtbkit__coalescing_cache_h__ */
@@ -8,17 +8,144 @@
 
 #include <iterator> // std::back_inserter
 #include <algorithm>// std::copy_if
-#include <boost/range/irange.hpp>
+#include <atomic>
 #include "redis_augmentor.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
 #include "jml/utils/exc_assert.h"
+#include "jml/arch/atomic_ops.h"
 using namespace std;
 
 namespace RTBKIT {
 
 
+/******************************************************************************/
+/* REDIS AUGMENTATION KEY                                                     */
+/******************************************************************************/
+
+RedisAugmentationKey::
+RedisAugmentationKey(const std::string & key, const std::string & prefix)
+    : key(key), field(JSON_PATH), redisPrefix(prefix + ":" + key + ":")
+{
+    ExcAssert(!key.empty());
+
+    // prefix root path (.) if absent.
+    auto root_key = key[0] == '.' ? key : "."+key;
+
+    static const std::map<std::string, Field> typedFields = {
+        { ".id", ID },
+        { ".url", URL },
+        { ".ipAddress", IP_ADDRESS },
+        { ".userAgent", USER_AGENT },
+        { ".language", LANGUAGE },
+        { ".protocolVersion", PROTOCOL_VERSION },
+        { ".exchange", EXCHANGE },
+        { ".provider", PROVIDER },
+        { ".location.countryCode", COUNTRY_CODE },
+        { ".location.regionCode", REGION_CODE },
+        { ".location.cityName", CITY_NAME },
+        { ".location.postalCode", POSTAL_CODE },
+        { ".location.dma", DMA },
+        { ".location.metro", METRO },
+        { ".location.timezoneOffsetMinutes", TIMEZONE_OFFSET_MINUTES }
+    };
+
+    auto it = typedFields.find(root_key);
+    if (it != typedFields.end())
+        field = it->second;
+    else path = std::make_shared<Json::Path>(root_key);
+}
+
+namespace {
+
+/** The fields below follow what BidRequest::toJson() does with them so
+    that the keys are the same as those computed from the JSON.
+*/
+bool notEmpty(const std::string & val, Json::Value & v)
+{
+    if (val.empty()) return false;
+    v = val;
+    return true;
+}
+
+bool notEmpty(int val, Json::Value & v)
+{
+    if (val == -1) return false;
+    v = val;
+    return true;
+}
+
+} // file scope
+
+bool
+RedisAugmentationKey::
+extract(const BidRequest & br, const Json::Value & json,
+        std::string & redisKey) const
+{
+    Json::Value v;
+    bool found = false;
+
+    switch (field) {
+    case ID:
+        v = br.auctionId.toString();
+        found = true;
+        break;
+    case URL:
+        if (!br.url.empty()) {
+            v = br.url.toString();
+            found = true;
+        }
+        break;
+    case IP_ADDRESS:
+        found = notEmpty(br.ipAddress, v);  break;
+    case USER_AGENT:
+        found = notEmpty(br.userAgent.utf8String(), v);  break;
+    case LANGUAGE:
+        found = notEmpty(br.language.utf8String(), v);  break;
+    case PROTOCOL_VERSION:
+        found = notEmpty(br.protocolVersion, v);  break;
+    case EXCHANGE:
+        found = notEmpty(br.exchange, v);  break;
+    case PROVIDER:
+        found = notEmpty(br.provider, v);  break;
+    case COUNTRY_CODE:
+        found = notEmpty(br.location.countryCode, v);  break;
+    case REGION_CODE:
+        found = notEmpty(br.location.regionCode, v);  break;
+    case CITY_NAME:
+        found = notEmpty(br.location.cityName.utf8String(), v);  break;
+    case POSTAL_CODE:
+        found = notEmpty(br.location.postalCode.utf8String(), v);  break;
+    case DMA:
+        found = notEmpty(br.location.dma, v);  break;
+    case METRO:
+        found = notEmpty(br.location.metro, v);  break;
+    case TIMEZONE_OFFSET_MINUTES:
+        found = notEmpty(br.location.timezoneOffsetMinutes, v);  break;
+    case JSON_PATH:
+        v = path->resolve(json, Json::Value());
+        found = !v.isNull();
+        break;
+    }
+
+    if (!found) return false;
+
+    auto v_str = v.toString();
+    redisKey = redisPrefix;
+    copy_if(v_str.begin(), v_str.end(),  back_inserter(redisKey), [](const char& c) {
+        return c!='\n'&&c!='"';
+    });
+    return true;
+}
+
+
+/******************************************************************************/
+/* REDIS AUGMENTOR                                                            */
+/******************************************************************************/
+
 RedisAugmentor::
 ~RedisAugmentor()
 {
+    delete plans_;
 }
 
 /** Sets up the internal components of the augmentor.
@@ -32,63 +159,182 @@ RedisAugmentor::
 init(int nthreads)
 {
     AsyncAugmentor::init(nthreads);
+
+    cache_.reset(new CoalescingCache(cacheMaxEntries, cacheTtl));
+
     /* Manages all the communications with the AgentConfigurationService. */
+    agent_config_.onConfigChange =
+        [=] (std::string agent, std::shared_ptr<const AgentConfig> config)
+        {
+            this->onConfigChange(agent, config);
+        };
     agent_config_.init(getServices()->config);
     addSource("RedisAugmentor::agentConfig", agent_config_);
+
+    addPeriodic("RedisAugmentor::cacheStats", 1.0,
+                [=] (uint64_t) { this->recordCacheStats(); });
 }
 
+/** Called on the configuration thread each time an agent's configuration
+    changes.  The aug-lists of all of the agents are compiled from scratch
+    into a new set of plans, which is then published for the worker
+    threads; configuration changes are rare enough for this to not matter.
+*/
+void
+RedisAugmentor::
+onConfigChange(const std::string & agent,
+               std::shared_ptr<const AgentConfig> config)
+{
+    if (!config)
+        augLists_.erase(agent);
+    else {
+        auto & entry = augLists_[agent];
+        entry.first = config->account;
+        entry.second.clear();
+
+        for (const auto & aug: config->augmentations) {
+            if (aug.name != "redis") continue;
+            const auto& aug_l = aug.config.atStr("aug-list");
+            if (!aug_l || aug_l.type() != Json::arrayValue) continue;
+            for (unsigned i = 0;  i < aug_l.size();  ++i) {
+                auto key = aug_l.atIndex(i).asString();
+                if (!key.empty())
+                    entry.second.push_back(key);
+            }
+        }
+    }
+
+    std::unique_ptr<Plans> newPlans(new Plans());
+    std::unordered_map<std::string, unsigned> keyIndex;
+
+    for (const auto & entry: augLists_) {
+        Plans::Agent & plan = newPlans->agents[entry.first];
+        plan.account = entry.second.first;
+
+        for (const auto & key: entry.second.second) {
+            auto res = keyIndex.insert(make_pair(key, newPlans->keys.size()));
+            if (res.second)
+                newPlans->keys.emplace_back(key);
+            plan.keys.push_back(res.first->second);
+        }
+    }
+
+    recordLevel(newPlans->keys.size(), "compiledKeys");
+
+    // Make sure our struct is fully written before we make it visible.
+    ML::memory_barrier();
+
+    Plans * current = plans_;
+    plans_ = newPlans.release();
+    plansGc_.defer([=] () { delete current; });
+}
 
 void
 RedisAugmentor::
-onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
+recordCacheStats()
 {
-    ML::Timer tm;
+    auto stats = cache_->resetStats();
+    recordCount(stats.hits, "cache.hits");
+    recordCount(stats.misses, "cache.misses");
+    recordCount(stats.coalesced, "cache.coalesced");
+    recordCount(stats.expired, "cache.expired");
+    recordCount(stats.evicted, "cache.evicted");
+    recordLevel(cache_->size(), "cache.size");
+}
 
-    recordHit("requests");
+namespace {
+
+/** State of a request while we wait for its values to come back from
+    Redis (or from other requests that are fetching the same keys).
+*/
+struct PendingRequest {
+    PendingRequest()
+        : outstanding(1), failed(false)
+    {
+    }
+
+    ML::Timer timer;
 
     // we build an *ordered* map indexed by Redis keys, pointing
-    // at set of account keys. It will be captured by copy by the
-    // Redis lambda call back, and used in order to build the
+    // at set of account keys. It is used in order to build the
     // augmentation list.
     map<string,set<RTBKIT::AccountKey>> jobs;
-    auto br = request.bidRequest->toJson();
-    for (const string& agent : request.agents)
+
+    /// One per job; each one is only written by the job's callback
+    vector<string> values;
+
+    /// Number of jobs that we're still waiting for, plus one while the
+    /// request is being set up
+    std::atomic<int> outstanding;
+    std::atomic<bool> failed;
+
+    std::function<void ()> onFinished;
+
+    void done()
     {
-        RTBKIT::AgentConfigEntry c  = agent_config_.getAgentEntry(agent);
+        if (outstanding.fetch_sub(1) == 1)
+            onFinished();
+    }
+};
 
-        /* When a new agent comes online there's a race condition where the
-           router may send us a bid request for that agent before we receive
-           its configuration. This check keeps us safe in that scenario. */
-        if (!c.valid())
-        {
-            recordHit("unknownConfig");
-            continue;
-        }
+} // file scope
 
-        // FIXME avoid converting the thing in Json::Value
-        const auto& aug_c = c.config->toJson(false);
-        const auto& aug_l = aug_c.atStr("augmentations").atStr("redis").atStr("config").atStr("aug-list");
-        if (!aug_l || aug_l.type() != Json::arrayValue || !aug_l.size())
-        {
-            recordHit ("noRedisAugAgentConfig");
-            continue ;
-        }
-        int n = aug_l.size();
-        static const string prefix = "RTBkit:aug" ;
-        for (auto i: boost::irange (0,n))
+void
+RedisAugmentor::
+onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
+{
+    recordHit("requests");
+
+    auto pending = std::make_shared<PendingRequest>();
+    auto & jobs = pending->jobs;
+
+    {
+        GcLock::SharedGuard guard(plansGc_);
+        const Plans & plans = *plans_;
+
+        // Each key is extracted once per request, however many agents use
+        // it.  The JSON is only built if one of the keys needs it.
+        vector<int> extracted(plans.keys.size(), -1);
+        vector<string> redisKeys(plans.keys.size());
+        Json::Value br;
+        bool haveJson = false;
+
+        for (const string& agent : request.agents)
         {
-            auto key = aug_l.atIndex(i).asString();
-            if (key.empty()) continue;
-            // prefix root path (.) if absent.
-            auto root_key = key[0] == '.' ? key : "."+key;
-            Json::Value v = Json::Path(root_key).make(br);
-            if (!v) continue;
-            auto v_str = v.toString();
-            string vv_str ;
-            copy_if(v_str.begin(), v_str.end(),  back_inserter(vv_str), [](const char& c) {
-                return c!='\n'&&c!='"';
-            });
-            jobs[prefix+":"+key+":"+vv_str].insert (c.config->account);
+            auto it = plans.agents.find(agent);
+
+            /* When a new agent comes online there's a race condition where the
+               router may send us a bid request for that agent before we receive
+               its configuration. This check keeps us safe in that scenario. */
+            if (it == plans.agents.end())
+            {
+                recordHit("unknownConfig");
+                continue;
+            }
+
+            const Plans::Agent & plan = it->second;
+            if (plan.keys.empty())
+            {
+                recordHit ("noRedisAugAgentConfig");
+                continue ;
+            }
+
+            for (unsigned k: plan.keys)
+            {
+                if (extracted[k] == -1) {
+                    const RedisAugmentationKey & key = plans.keys[k];
+                    if (key.needsJson() && !haveJson) {
+                        br = request.bidRequest->toJson();
+                        haveJson = true;
+                        recordHit("jsonKeys");
+                    }
+                    extracted[k]
+                        = key.extract(*request.bidRequest, br, redisKeys[k]);
+                }
+
+                if (extracted[k])
+                    jobs[redisKeys[k]].insert(plan.account);
+            }
         }
     }
 
@@ -99,37 +345,89 @@ onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
         return;
     }
 
-    auto doResponse = [=](const Redis::Results& results) {
-        ExcAssertEqual (results.size(), jobs.size());
+    pending->values.resize(jobs.size());
+
+    // Raw pointer so that the request doesn't own itself; it's only called
+    // from done(), by someone who holds a reference.
+    PendingRequest * p = pending.get();
+    p->onFinished = [=] () {
+        if (p->failed)
+            recordHit("failedKeys");
+
         AugmentationList auglret;
-        if (results)
+        auto i=0;
+        for (const auto& ii: p->jobs)
         {
-            auto i=0;
-            for (const auto& ii: jobs)
-            {
-                const auto& res = results.at(i).reply().asString();
-                if (!res.empty())
-                    for (const auto& jj: ii.second)
-                        auglret[jj].data.atStr(ii.first) = res;
-                ++i;
-            }
-        }
-        else
-        {
-            cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << results.error() << endl ;
-            recordHit("redisError."+results.error());
+            const auto& res = p->values[i];
+            if (!res.empty())
+                for (const auto& jj: ii.second)
+                    auglret[jj].data.atStr(ii.first) = res;
+            ++i;
         }
-        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
+        recordOutcome(p->timer.elapsed_wall() * 1000.0, "redisResponseMs");
         sendResponse(auglret);
     };
 
-    // build a vector of commands
-    vector<Redis::Command> cmds;
-    for (auto& ii: jobs)
-        cmds.emplace_back (Redis::GET(ii.first));
+    // Look everything up in the cache; what is neither there nor already
+    // being fetched by another request is fetched by us.
+    vector<string> toFetch;
+
+    auto i=0;
+    for (const auto& ii: jobs)
+    {
+        auto onDone = [=] (const std::string & value, bool ok)
+            {
+                if (ok)
+                    pending->values[i] = value;
+                else pending->failed = true;
+                pending->done();
+            };
+
+        ++pending->outstanding;
+
+        string value;
+        switch (cache_->lookup(ii.first, value, onDone)) {
+        case CoalescingCache::HIT:
+            pending->values[i] = value;
+            --pending->outstanding;
+            break;
+        case CoalescingCache::PENDING:
+            break;
+        case CoalescingCache::MISS:
+            toFetch.push_back(ii.first);
+            break;
+        }
+        ++i;
+    }
 
-    // and post it
-    redis_->queueMulti(cmds, doResponse, 0.004);
+    if (!toFetch.empty())
+    {
+        auto doResponse = [=](const Redis::Results& results) {
+            if (!results)
+            {
+                cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << results.error() << endl ;
+                recordHit("redisError."+results.error());
+            }
+
+            for (unsigned j = 0;  j < toFetch.size();  ++j)
+            {
+                if (j < results.size() && results[j])
+                    cache_->complete(toFetch[j], results[j].reply().asString());
+                else cache_->fail(toFetch[j]);
+            }
+        };
+
+        // build a vector of commands
+        vector<Redis::Command> cmds;
+        for (auto& key: toFetch)
+            cmds.emplace_back (Redis::GET(key));
+
+        // and post it
+        redis_->queueMulti(cmds, doResponse, 0.004);
+    }
 
+    // Drop the reference held while setting up; this sends the response if
+    // everything came from the cache.
+    pending->done();
 }
 } /* namespace RTBKIT */
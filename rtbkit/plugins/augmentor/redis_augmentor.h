@@ -9,12 +9,66 @@
 #define REDIS_AUGMENTOR_H_
 
 #include <string>
+#include <map>
+#include <unordered_map>
 #include "augmentor_base.h"
 #include "soa/service/redis.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
+#include "coalescing_cache.h"
 
 namespace RTBKIT {
 
+/**
+ *     One entry of an agent's redis aug-list, compiled into an extractor
+ *     over the bid request.
+ *
+ *     The Redis key is "<prefix>:<key>:<value>", where value is the JSON
+ *     representation of the field at path key in the bid request, without
+ *     any quotes or newlines.  The common top-level and location fields are
+ *     read straight from the BidRequest; anything else is looked up in the
+ *     bid request's JSON.
+ */
+struct RedisAugmentationKey {
+    RedisAugmentationKey(const std::string & key,
+                         const std::string & prefix = "RTBkit:aug");
+
+    std::string key;
+
+    /** Does extract() need the JSON version of the bid request? */
+    bool needsJson() const { return field == JSON_PATH; }
+
+    /** Fill in the Redis key for the given bid request.  json is only
+        used if needsJson() is true.  Returns false if the field is not in
+        the bid request.
+    */
+    bool extract(const BidRequest & br, const Json::Value & json,
+                 std::string & redisKey) const;
+
+private:
+    enum Field {
+        ID,
+        URL,
+        IP_ADDRESS,
+        USER_AGENT,
+        LANGUAGE,
+        PROTOCOL_VERSION,
+        EXCHANGE,
+        PROVIDER,
+        COUNTRY_CODE,
+        REGION_CODE,
+        CITY_NAME,
+        POSTAL_CODE,
+        DMA,
+        METRO,
+        TIMEZONE_OFFSET_MINUTES,
+        JSON_PATH
+    };
+
+    Field field;
+    std::shared_ptr<Json::Path> path;
+    std::string redisPrefix;
+};
+
 /**
  *     Redis Augmentor.
  */
@@ -27,6 +81,9 @@ public:
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,proxies)
         , agent_config_ (proxies->zmqContext)
         , redis_(std::make_shared<Redis::AsyncConnection>(redis))
+        , cacheMaxEntries(65536)
+        , cacheTtl(1.0)
+        , plans_(new Plans())
     {
     }
 
@@ -37,6 +94,9 @@ public:
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,proxies)
         , agent_config_ (proxies->zmqContext)
         , redis_(redis)
+        , cacheMaxEntries(65536)
+        , cacheTtl(1.0)
+        , plans_(new Plans())
     {
     }
 
@@ -47,6 +107,9 @@ public:
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,parent)
         , agent_config_ (parent.getZmqContext())
         , redis_(std::make_shared<Redis::AsyncConnection>(redis))
+        , cacheMaxEntries(65536)
+        , cacheTtl(1.0)
+        , plans_(new Plans())
     {
     }
 
@@ -57,15 +120,57 @@ public:
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,parent)
         , agent_config_ (parent.getZmqContext())
         , redis_ (redis)
+        , cacheMaxEntries(65536)
+        , cacheTtl(1.0)
+        , plans_(new Plans())
     {
     }
 
     void init(int nthreads);
     virtual ~RedisAugmentor() ;
+
+    /** Maximum number of Redis values kept in the local cache; 0 disables
+        the cache.  Must be set before init().
+    */
+    size_t cacheMaxEntries;
+
+    /** Number of seconds that a Redis value is kept in the local cache.
+        Must be set before init().
+    */
+    double cacheTtl;
+
 private:
     void onRequest(const AugmentationRequest & request, SendResponseCB sendResponse);
     RTBKIT::AgentConfigurationListener agent_config_;
     std::shared_ptr<Redis::AsyncConnection> redis_ ;
+
+    /** Compiled aug-lists of all of the agents, with the keys shared
+        between agents only compiled once.  Protected by RCU.
+    */
+    struct Plans {
+        struct Agent {
+            AccountKey account;
+            std::vector<unsigned> keys;   ///< indexes into keys
+        };
+
+        std::vector<RedisAugmentationKey> keys;
+        std::unordered_map<std::string, Agent> agents;
+    };
+
+    Plans * plans_;
+    mutable GcLock plansGc_;
+
+    /** Raw aug-lists, only touched from the configuration thread. */
+    std::map<std::string, std::pair<AccountKey, std::vector<std::string> > >
+        augLists_;
+
+    std::unique_ptr<CoalescingCache> cache_;
+
+    /** Recompile the plans after a configuration change. */
+    void onConfigChange(const std::string & agent,
+                        std::shared_ptr<const AgentConfig> config);
+
+    void recordCacheStats();
 };
 
 } /* namespace RTBKIT */
@@ -8,5 +8,5 @@
 
 $(eval $(call test,augmentor_stress_test,augmentor_base bid_request,boost manual))
 $(eval $(call test,redis_augmentor_test,augmentor_base bid_request bidding_agent,boost))
-
-
+$(eval $(call test,redis_augmentor_stress_test,augmentor_base bid_request bidding_agent,boost manual))
+$(eval $(call test,coalescing_cache_test,augmentor_base,boost))
@@ -0,0 +1,177 @@
+/* coalescing_cache_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the coalescing cache used by the redis augmentor.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/augmentor/coalescing_cache.h"
+#include "jml/arch/exception.h"
+#include <thread>
+#include <atomic>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_hit_miss_coalesce )
+{
+    CoalescingCache cache(100, 1.0, 4);
+    Date now = Date::fromSecondsSinceEpoch(1000);
+
+    vector<pair<string, bool> > results;
+    auto onDone = [&] (const std::string & value, bool ok)
+        {
+            results.push_back(make_pair(value, ok));
+        };
+
+    string value;
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now),
+                      CoalescingCache::MISS);
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now),
+                      CoalescingCache::PENDING);
+    BOOST_CHECK_EQUAL(results.size(), 0);
+
+    cache.complete("a", "hello", now);
+    BOOST_REQUIRE_EQUAL(results.size(), 2);
+    BOOST_CHECK_EQUAL(results[0].first, "hello");
+    BOOST_CHECK(results[0].second);
+    BOOST_CHECK_EQUAL(results[1].first, "hello");
+
+    results.clear();
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now.plusSeconds(0.5)),
+                      CoalescingCache::HIT);
+    BOOST_CHECK_EQUAL(value, "hello");
+    BOOST_CHECK_EQUAL(results.size(), 0);
+
+    // Expired
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now.plusSeconds(1.5)),
+                      CoalescingCache::MISS);
+    cache.fail("a");
+    BOOST_REQUIRE_EQUAL(results.size(), 1);
+    BOOST_CHECK(!results[0].second);
+
+    // Failures aren't cached
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now.plusSeconds(1.5)),
+                      CoalescingCache::MISS);
+    cache.complete("a", "", now.plusSeconds(1.5));
+
+    // But empty values are
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now.plusSeconds(1.6)),
+                      CoalescingCache::HIT);
+    BOOST_CHECK_EQUAL(value, "");
+
+    auto stats = cache.resetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 2);
+    BOOST_CHECK_EQUAL(stats.misses, 3);
+    BOOST_CHECK_EQUAL(stats.coalesced, 1);
+    BOOST_CHECK_EQUAL(stats.expired, 1);
+
+    stats = cache.resetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 0);
+
+    BOOST_CHECK_THROW(cache.complete("b", "x", now), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_lru_eviction )
+{
+    // One shard so that the capacity is exact
+    CoalescingCache cache(3, 10.0, 1);
+    Date now = Date::fromSecondsSinceEpoch(1000);
+    auto onDone = [] (const std::string &, bool) {};
+
+    string value;
+    for (string key: { "a", "b", "c" }) {
+        BOOST_CHECK_EQUAL(cache.lookup(key, value, onDone, now),
+                          CoalescingCache::MISS);
+        cache.complete(key, key + "!", now);
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // Touch a so that b is the least recently used
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now),
+                      CoalescingCache::HIT);
+
+    BOOST_CHECK_EQUAL(cache.lookup("d", value, onDone, now),
+                      CoalescingCache::MISS);
+    cache.complete("d", "d!", now);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone, now),
+                      CoalescingCache::HIT);
+    BOOST_CHECK_EQUAL(cache.lookup("c", value, onDone, now),
+                      CoalescingCache::HIT);
+    BOOST_CHECK_EQUAL(cache.lookup("b", value, onDone, now),
+                      CoalescingCache::MISS);
+    cache.fail("b");
+
+    BOOST_CHECK_EQUAL(cache.resetStats().evicted, 1);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_no_caching )
+{
+    CoalescingCache cache(0, 1.0);
+    auto onDone = [] (const std::string &, bool) {};
+
+    string value;
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone), CoalescingCache::MISS);
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone),
+                      CoalescingCache::PENDING);
+    cache.complete("a", "x");
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    BOOST_CHECK_EQUAL(cache.lookup("a", value, onDone), CoalescingCache::MISS);
+    cache.complete("a", "x");
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_lookups )
+{
+    enum { NumThreads = 4, NumKeys = 100, Iterations = 10000 };
+
+    CoalescingCache cache(NumKeys / 2, 1000.0);
+    std::atomic<int> fetches(0), done(0), lookups(0);
+
+    auto doThread = [&] (int thread)
+        {
+            for (int i = 0;  i < Iterations;  ++i) {
+                string key = to_string((i * 7 + thread) % NumKeys);
+                string value;
+                ++lookups;
+                auto res = cache.lookup(key, value,
+                                        [&] (const std::string & v, bool ok)
+                                        {
+                                            if (!ok || v != "v")
+                                                throw ML::Exception("bad value");
+                                            ++done;
+                                        });
+                if (res == CoalescingCache::HIT) {
+                    if (value != "v")
+                        throw ML::Exception("bad hit");
+                    ++done;
+                }
+                else if (res == CoalescingCache::MISS) {
+                    ++fetches;
+                    cache.complete(key, "v");
+                }
+            }
+        };
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < NumThreads;  ++i)
+        threads.emplace_back(doThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(done, lookups);
+    BOOST_CHECK_LE(cache.size(), NumKeys / 2 + 16);
+
+    auto stats = cache.resetStats();
+    BOOST_CHECK_EQUAL(stats.misses, fetches);
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses + stats.coalesced, lookups);
+}
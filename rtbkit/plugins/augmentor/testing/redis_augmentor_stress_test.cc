@@ -0,0 +1,197 @@
+/* redis_augmentor_stress_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Stress test for the redis augmentor.  Feeds it requests drawn from a
+   small working set of auction ids so that the effect of the local cache
+   and of the coalescing of lookups in flight shows up in the events.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/testing/test_agent.h"
+#include "rtbkit/plugins/augmentor/redis_augmentor.h"
+#include "rtbkit/core/agent_configuration/agent_configuration_service.h"
+#include "soa/service/testing/redis_temporary_server.h"
+#include "jml/db/persistent.h"
+#include "soa/service/redis.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <atomic>
+#include <set>
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+static const string sampleBrHead = "{\"id\":\"";
+static const string sampleBrTail =
+    "\",\"timestamp\":1368153863.008756,\"isTest\":false,\"url\":\"http://myonlinearcade.com/\",\"ipAddress\":\"166.13.20.21\",\"userAgent\":\"Mozilla/5.0 (Windows NT 6.1; WOW64; rv:19.0) Gecko/20100101 Firefox/20.0\",\"language\":\"fr\",\"protocolVersion\":\"0.3\",\"exchange\":\"appnexus\",\"provider\":\"appnexus\",\"winSurcharges\":{\"surcharge\":{\"USD/1M\":50}},\"location\":{\"countryCode\":\"CA\",\"regionCode\":\"QC\",\"cityName\":\"Laval\",\"postalCode\":\"0\",\"dma\":0,\"timezoneOffsetMinutes\":-1},\"segments\":{\"appnexus\":[\"memberId1357\"]},\"userIds\":{\"an\":\"5273283952213481305\",\"xchg\":\"5273283952213481305\"},\"imp\":[{\"id\":\"156331815539876686\",\"banner\":{\"w\":728,\"h\":90},\"formats\":[\"728x90\"]}]}";
+
+enum {
+    WorkingSet = 1000
+};
+
+static std::atomic<size_t> instances(0);
+std::string instancedName(const std::string& prefix)
+{
+    return prefix + to_string(instances.fetch_add(1));
+}
+
+struct MockAugmentationLoop : public ServiceBase, public MessageLoop
+{
+    MockAugmentationLoop(const std::shared_ptr<ServiceProxies>& proxies,
+                         const set<string> & agentNames) :
+        ServiceBase(instancedName("mock-aug-loop-"), proxies),
+        toAug(proxies->zmqContext),
+        sent(0), recv(0)
+    {
+        std::ostringstream agentStr;
+        ML::DB::Store_Writer writer(agentStr);
+        writer.save(agentNames);
+        agents = agentStr.str();
+    }
+
+    void start()
+    {
+        registerServiceProvider(serviceName(), { "rtbRouterAugmentation" });
+
+        toAug.init(getServices()->config, serviceName() + "/augmentors");
+        toAug.bindTcp(getServices()->ports->getRange("augmentors"));
+
+        toAug.clientMessageHandler = [&] (const vector<string> & message) {
+            recordHit("recv");
+            recv++;
+        };
+
+        addSource("MockAugLoop::toAug", toAug);
+
+        addPeriodic("MockAugLoop::send", 0.0001, [=] (uint64_t) {
+                    string br = sampleBrHead
+                        + "auction-" + to_string(random() % WorkingSet)
+                        + sampleBrTail;
+
+                    toAug.sendMessage(
+                            "redis-augmentation", "AUGMENT", "1.0",
+                            "redis-augmentation", to_string(random()),
+                            "datacratic", br, agents, Date::now());
+
+                    sent++;
+                });
+
+        MessageLoop::start();
+    }
+
+    ZmqNamedClientBus toAug;
+    string agents;
+    std::atomic<size_t> sent, recv;
+};
+
+BOOST_AUTO_TEST_CASE( redisAugmentorStressTest )
+{
+    enum {
+        FeederThreads = 4,
+        TestLength = 30,
+        RedisThreads = 2,
+        NumAgents = 10
+    };
+
+    Redis::RedisTemporaryServer redis;
+    {
+        using namespace Redis;
+        AsyncConnection async_redis(redis);
+
+        // Only half of the working set has a value so that the caching of
+        // the keys that aren't found gets exercised as well.
+        Command mset(MSET);
+        for (unsigned i = 0;  i < WorkingSet;  i += 2) {
+            mset.addArg("RTBkit:aug:id:auction-" + to_string(i));
+            mset.addArg(i);
+        }
+        Result result = async_redis.exec(mset);
+        BOOST_CHECK_EQUAL(result.ok(), true);
+    }
+
+    auto proxies = make_shared<ServiceProxies>();
+
+    AgentConfigurationService agentConfig(proxies, "config");
+    agentConfig.unsafeDisableMonitor();
+    agentConfig.init();
+    agentConfig.bindTcp();
+    agentConfig.start();
+
+    // All of the agents share the id key; each also has one of its own
+    // that needs the JSON of the bid request.
+    vector<std::shared_ptr<TestAgent> > agents;
+    set<string> agentNames;
+    for (unsigned i = 0;  i < NumAgents;  ++i) {
+        auto agent = std::make_shared<TestAgent>(
+                proxies, "agent-" + to_string(i));
+        agent->config.account = { "campaign" + to_string(i), "strategy" };
+
+        AugmentationConfig aug_conf;
+        aug_conf.name = "redis";
+        aug_conf.required = true;
+        Json::Value av(Json::arrayValue);
+        av.append("id");
+        av.append("exchange");
+        if (i % 2)
+            av.append("winSurcharges.surcharge.USD/1M");
+        aug_conf.config["aug-list"] = av;
+        agent->config.addAugmentation(aug_conf);
+
+        agent->init();
+        agent->start();
+        agent->doConfig(agent->config);
+
+        agentNames.insert(agent->agentName);
+        agents.push_back(agent);
+    }
+
+    RedisAugmentor aug("redis-augmentation", "redis-augmentation",
+                       proxies, redis);
+    aug.init(RedisThreads);
+    aug.start();
+
+    cerr << "init feeders\n";
+
+    vector< std::shared_ptr<MockAugmentationLoop> > feederThreads;
+    for (size_t i = 0; i < FeederThreads; ++i) {
+        feederThreads.emplace_back(new MockAugmentationLoop(proxies, agentNames));
+        feederThreads.back()->start();
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    size_t lastRecv = 0;
+    for (size_t i = 0; i < TestLength; ++i) {
+        this_thread::sleep_for(chrono::seconds(1));
+
+        size_t recv = 0;
+        for (auto& th : feederThreads)
+            recv += th->recv;
+
+        cerr << "[ " << i << " / " << TestLength << " ]: "
+            << "recv/s=" << (recv - lastRecv)
+            << ", load=" << aug.sampleLoad()
+            << ", prob=" << aug.shedProbability()
+            << endl;
+        lastRecv = recv;
+    }
+
+    size_t sent = 0, recv = 0;
+    for (auto& th : feederThreads) {
+        th->shutdown();
+        sent += th->sent;
+        recv += th->recv;
+    }
+    aug.shutdown();
+
+    cerr << "sent: " << sent << endl
+        << "recv: " << recv << endl;
+
+    // The cache.* events give the hit rate of the local cache
+    proxies->events->dump(cerr);
+}
@@ -13,7 +13,8 @@ using namespace RTBKIT;
 AgentsBidderInterface::AgentsBidderInterface(std::string const &serviceName,
                                              std::shared_ptr<ServiceProxies> proxies,
                                              Json::Value const & config)
-    : BidderInterface(proxies, serviceName) {
+    : BidderInterface(proxies, serviceName),
+      hasLocalAgents(false) {
 }
 
 AgentsBidderInterface::~AgentsBidderInterface() {
@@ -24,22 +25,24 @@ void AgentsBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const &
                                                double timeLeftMs,
                                                std::map<std::string, BidInfo> const & bidders) {
 
+    auto & agents = router->shardFor(bridge).agents;
+
     for(auto & item : bidders) {
         auto & agent = item.first;
         auto & spots = item.second.imp;
-        auto & info = router->agents[agent];
+        auto & info = agents[agent];
         WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
 
-        bridge->sendAgentMessage(agent,
-                                 "AUCTION",
-                                 auction->start,
-                                 auction->id,
-                                 info.getBidRequestEncoding(*auction),
-                                 info.encodeBidRequest(*auction),
-                                 spots.toJsonStr(),
-                                 std::to_string(timeLeftMs),
-                                 auction->agentAugmentations[agent],
-                                 wcm.toJson());
+        sendAgentMessage(agent,
+                         "AUCTION",
+                         auction->start,
+                         auction->id,
+                         info.getBidRequestEncoding(*auction),
+                         info.encodeBidRequest(*auction),
+                         spots.toJsonStr(),
+                         std::to_string(timeLeftMs),
+                         auction->agentAugmentations[agent],
+                         wcm.toJson());
     }
 }
 
@@ -48,65 +51,65 @@ void AgentsBidderInterface::sendWinLossMessage(MatchedWinLoss const & event) {
     std::string channel =
         event.type == MatchedWinLoss::LateWin ? "LATEWIN" : event.typeString();
 
-    bridge->sendAgentMessage(event.response.agent,
-                              channel,
-                              event.timestamp,
-                              event.confidenceString(),
+    sendAgentMessage(event.response.agent,
+                      channel,
+                      event.timestamp,
+                      event.confidenceString(),
 
-                              event.auctionId.toString(),
-                              std::to_string(event.impIndex()),
-                              event.winPrice.toString(),
+                      event.auctionId.toString(),
+                      std::to_string(event.impIndex()),
+                      event.winPrice.toString(),
 
-                              event.requestStrFormat,
-                              event.requestStr,
-                              event.response.bidData,
-                              event.response.meta,
-                              event.augmentations.toJson());
+                      event.requestStrFormat,
+                      event.requestStr,
+                      event.response.bidData,
+                      event.response.meta,
+                      event.augmentations.toJson());
 
 }
 
 void AgentsBidderInterface::sendLossMessage(std::string const & agent,
                                             std::string const & id) {
-    bridge->sendAgentMessage(agent,
-                             "LOSS",
-                             Date::now(),
-                             "guaranteed",
-                             id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "LOSS",
+                     Date::now(),
+                     "guaranteed",
+                     id,
+                     0,
+                     Amount().toString());
 }
 
 void AgentsBidderInterface::sendCampaignEventMessage(std::string const & agent,
                                                      MatchedCampaignEvent const & event) {
-    bridge->sendAgentMessage(agent,
-                             "CAMPAIGN_EVENT",
-                             event.label,
-                             Date::now(),
+    sendAgentMessage(agent,
+                     "CAMPAIGN_EVENT",
+                     event.label,
+                     Date::now(),
 
-                             event.auctionId.toString(),
-                             event.impId.toString(),
-                             std::to_string(event.impIndex()),
+                     event.auctionId.toString(),
+                     event.impId.toString(),
+                     std::to_string(event.impIndex()),
 
-                             event.requestStrFormat,
-                             event.requestStr,
-                             event.augmentations.toJson(),
+                     event.requestStrFormat,
+                     event.requestStr,
+                     event.augmentations.toJson(),
 
-                             event.bid,
-                             event.win,
-                             event.campaignEvents,
-                             event.visits);
+                     event.bid,
+                     event.win,
+                     event.campaignEvents,
+                     event.visits);
 
 }
 
 void AgentsBidderInterface::sendBidLostMessage(std::string const & agent,
                                                std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "LOST",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "LOST",
+                     Date::now(),
+                     "guaranteed",
+                     auction->id,
+                     0,
+                     Amount().toString());
 /*
 -                    this->sendBidResponse(it->first,
 -                                          info,
@@ -120,13 +123,13 @@ void AgentsBidderInterface::sendBidLostMessage(std::string const & agent,
 
 void AgentsBidderInterface::sendBidDroppedMessage(std::string const & agent,
                                                   std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "DROPPEDBID",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "DROPPEDBID",
+                     Date::now(),
+                     "guaranteed",
+                     auction->id,
+                     0,
+                     Amount().toString());
 /*
 -                        this->sendBidResponse(agent,
 -                                              info,
@@ -143,13 +146,13 @@ void AgentsBidderInterface::sendBidDroppedMessage(std::string const & agent,
 void AgentsBidderInterface::sendBidInvalidMessage(std::string const & agent,
                                                   std::string const & reason,
                                                   std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "INVALID",
-                             Date::now(),
-                             reason,
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "INVALID",
+                     Date::now(),
+                     reason,
+                     auction->id,
+                     0,
+                     Amount().toString());
 /*
 -            this->sendBidResponse
 -                (agent, info, BS_INVALID, this->getCurrentTime(),
@@ -164,13 +167,13 @@ void AgentsBidderInterface::sendBidInvalidMessage(std::string const & agent,
 
 void AgentsBidderInterface::sendNoBudgetMessage(std::string const & agent,
                                                 std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "NOBUDGET",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "NOBUDGET",
+                     Date::now(),
+                     "guaranteed",
+                     auction->id,
+                     0,
+                     Amount().toString());
 /*
 -            this->sendBidResponse(agent, info, BS_NOBUDGET,
 -                    this->getCurrentTime(),
@@ -183,13 +186,13 @@ void AgentsBidderInterface::sendNoBudgetMessage(std::string const & agent,
 
 void AgentsBidderInterface::sendTooLateMessage(std::string const & agent,
                                                std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "TOOLATE",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendAgentMessage(agent,
+                     "TOOLATE",
+                     Date::now(),
+                     "guaranteed",
+                     auction->id,
+                     0,
+                     Amount().toString());
 
 /*
 -            case Auction::WinLoss::LOSS:    status = BS_LOSS;     break;
@@ -223,37 +226,46 @@ void AgentsBidderInterface::sendTooLateMessage(std::string const & agent,
 
 void AgentsBidderInterface::sendMessage(std::string const & agent,
                                         std::string const & message) {
-    bridge->sendAgentMessage(agent,
-                             message,
-                             Date::now());
+    sendAgentMessage(agent,
+                     message,
+                     Date::now());
 }
 
 void AgentsBidderInterface::sendErrorMessage(std::string const & agent,
                                              std::string const & error,
                                              std::vector<std::string> const & payload) {
-    bridge->sendAgentMessage(agent,
-                             "ERROR",
-                             Date::now(),
-                             error,
-                             payload);
+    sendAgentMessage(agent,
+                     "ERROR",
+                     Date::now(),
+                     error,
+                     payload);
 }
 
 void AgentsBidderInterface::sendPingMessage(std::string const & agent,
                                             int ping) {
     if(ping == 0) {
-        bridge->sendAgentMessage(agent,
-                                 "PING0",
-                                 Date::now(),
-                                 "null");
+        sendAgentMessage(agent,
+                         "PING0",
+                         Date::now(),
+                         "null");
     }
     else {
-        bridge->sendAgentMessage(agent,
-                                 "PING1",
-                                 Date::now(),
-                                 "null");
+        sendAgentMessage(agent,
+                         "PING1",
+                         Date::now(),
+                         "null");
     }
 }
 
+bool AgentsBidderInterface::isLocalAgent(std::string const & agent) const {
+    return false;
+}
+
+bool AgentsBidderInterface::sendLocalMessage(std::string const & agent,
+                                             std::vector<std::string> const & message) {
+    return false;
+}
+
 //
 // factory
 //
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "rtbkit/common/bidder_interface.h"
+#include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
+#include "rtbkit/common/messages.h"
 #include "soa/jsoncpp/json.h"
 #include <iostream>
 
@@ -57,6 +59,39 @@ struct AgentsBidderInterface : public BidderInterface
     void sendPingMessage(std::string const & agent,
                          int ping);
 
+protected:
+    /** Set by subclasses that can reach some of the agents by another
+        route than the agent bridge; see sendLocalMessage().
+    */
+    bool hasLocalAgents;
+
+    /** Returns true if the given agent is reached through
+        sendLocalMessage() rather than through the agent bridge.
+    */
+    virtual bool isLocalAgent(std::string const & agent) const;
+
+    /** Send the given message, as it would have been sent on the agent
+        bridge, to a local agent.  Returns false if it couldn't be sent,
+        in which case it goes through the bridge.
+    */
+    virtual bool sendLocalMessage(std::string const & agent,
+                                  std::vector<std::string> const & message);
+
+    /** Send a message to the given agent, through sendLocalMessage() if
+        it's a local agent or else through the agent bridge.
+    */
+    template<typename... Args>
+    void sendAgentMessage(std::string const & agent, Args const &... args)
+    {
+        if (hasLocalAgents && isLocalAgent(agent)) {
+            std::vector<std::string> message;
+            message.reserve(sizeof...(Args));
+            appendMessageFields(message, args...);
+            if (sendLocalMessage(agent, message))
+                return;
+        }
+        bridge->sendAgentMessage(agent, args...);
+    }
 };
 
 }
@@ -1,9 +1,12 @@
 $(eval $(call library,agents_bidder,agents_bidder_interface.cc,rtb_router))
+$(eval $(call library,shm_bidder,shm_bidder_interface.cc,agents_bidder rtb_router))
 $(eval $(call library,http_bidder,http_bidder_interface.cc,openrtb_bid_request))
 $(eval $(call library,multi_bidder,multi_bidder_interface.cc,))
 
+$(eval $(call include_sub_make,bidder_interface_testing,testing,bidder_interface_testing.mk))
 
-bidder_interface_plugins: $(LIB)/libagents_bidder.so $(LIB)/libhttp_bidder.so
+
+bidder_interface_plugins: $(LIB)/libagents_bidder.so $(LIB)/libhttp_bidder.so $(LIB)/libshm_bidder.so
 
 
 .PHONY: bidder_interface_plugins
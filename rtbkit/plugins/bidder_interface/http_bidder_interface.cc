@@ -11,6 +11,8 @@
 #include "rtbkit/plugins/bid_request/openrtb_bid_request.h"
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "rtbkit/core/router/router.h"
+#include "soa/types/json_printing.h"
+#include <unordered_map>
 
 using namespace Datacratic;
 using namespace RTBKIT;
@@ -95,45 +97,32 @@ void HttpBidderInterface::shutdown() {
 }
 
 
+/** What we need to keep from the auction until the bidder answers. */
+struct HttpBidderInterface::PendingAuction {
+    struct Agent {
+        std::string name;
+        std::shared_ptr<const AgentConfig> config;
+    };
+
+    std::shared_ptr<Auction> auction;
+    std::unordered_map<uint64_t, Agent> agents;  ///< Keyed on externalId
+};
+
 void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                              double timeLeftMs,
                                              std::map<std::string, BidInfo> const & bidders) {
-    using namespace std;
-
-    auto findAgent = [=](uint64_t externalId)
-        -> pair<string, shared_ptr<const AgentConfig>> {
-
-        auto it =
-        find_if(begin(bidders), end(bidders),
-                [&](const pair<string, BidInfo> &bidder)
-        {
-            std::string agent = bidder.first;
-            const auto &info = router->agents[agent];
-            return info.config->externalId == externalId;
-        });
-
-        if (it == end(bidders)) {
-            return make_pair("", nullptr);
-        }
-
-        return make_pair(it->first, it->second.agentConfig);
-
-    };
-
-    BidRequest originalRequest = *auction->request;
-    OpenRTB::BidRequest openRtbRequest = toOpenRtb(originalRequest);
-    bool ok = prepareRequest(openRtbRequest, originalRequest, bidders);
     /* If we took too much time processing the request, then we don't send it.  */
-    if (!ok) {
+    if (!printRequest(requestBuffer, *auction->request, bidders))
         return;
+
+    auto pending = std::make_shared<PendingAuction>();
+    pending->auction = auction;
+    pending->agents.reserve(bidders.size());
+    for (const auto & bidder: bidders) {
+        const auto & config = bidder.second.agentConfig;
+        pending->agents[config->externalId] = { bidder.first, config };
     }
-    StructuredJsonPrintingContext context;
-    desc.printJson(&openRtbRequest, context);
-    auto requestStr = context.output.toString();
 
-    /* We need to capture by copy inside the lambda otherwise we might get
-       a dangling reference if we go out of scope before receiving the http response
-    */
     auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(
             [=](const HttpRequest &, HttpClientError errorCode,
                 int statusCode, const std::string &, std::string &&body)
@@ -142,98 +131,76 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                     router->throwException("http", "Error requesting %s: %s",
                                            routerHost.c_str(),
                                            httpErrorString(errorCode).c_str());
-                  }
-                  // If we receive a 204 No-bid, we still need to "re-inject" it to the
-                  // router otherwise we won't expire the inFlights
-                  else if (statusCode == 204) {
-                     Bids bids;
-                     bids.resize(openRtbRequest.imp.size());
-                     fill(begin(bids), end(bids), Bid());
-                     for (const auto &bidder: bidders) {
-                         submitBids(bidder.first, auction->id, bids, WinCostModel());
-                     }
-                  }
-
-                  else if (statusCode == 200) {
-                    // cerr << "Response: " << body << endl;
-                     OpenRTB::BidResponse response;
-                     ML::Parse_Context context("payload",
-                           body.c_str(), body.size());
-                     StreamingJsonParsingContext jsonContext(context);
-                     static DefaultDescription<OpenRTB::BidResponse> respDesc;
-                     respDesc.parseJson(&response, jsonContext);
-
-                     for (const auto &seatbid: response.seatbid) {
-
-                         for (const auto &bid: seatbid.bid) {
-                             if (!bid.ext.isMember("external-id")) {
-                                 router->throwException("http.response",
-                                    "Missing external-id ext field in BidResponse");
-                             }
-
-                             if (!bid.ext.isMember("priority")) {
-                                 router->throwException("http.response",
-                                    "Missing priority ext field in BidResponse");
-                             }
-
-                             uint64_t externalId = bid.ext["external-id"].asUInt();
-
-                             string agent;
-                             shared_ptr<const AgentConfig> config;
-                             tie(agent, config) = findAgent(externalId);
-                             if (config == nullptr) {
-                                 router->throwException("http.response",
-                                    "Couldn't find config for externalId: %lu",
-                                    externalId);
-                             }
-
-                             Bids bids;
-                             Bid theBid;
-
-                             int crid = bid.crid.toInt();
-                             int creativeIndex = indexOf(config->creatives,
-                                 &Creative::id, crid);
-
-                             if (creativeIndex == -1) {
-                                 router->throwException("http.response",
-                                    "Unknown creative id: %d", crid);
-                             }
-
-                             theBid.creativeIndex = creativeIndex;
-                             theBid.price = USD_CPM(bid.price.val);
-                             theBid.priority = bid.ext["priority"].asDouble();
-
-                             int spotIndex = indexOf(openRtbRequest.imp,
-                                                    &OpenRTB::Impression::id, bid.impid);
-                             if (spotIndex == -1) {
-                                  router->throwException("http.response",
-                                     "Unknown impression id: %s",
-                                     bid.impid.toString().c_str());
-                             }
-
-                             theBid.spotIndex = spotIndex;
-
-                             bids.push_back(std::move(theBid));
-
-                             WinCostModel wcm =
-                                 auction->exchangeConnector->getWinCostModel(*auction, *config);
-
-                             submitBids(agent, auction->id, bids, wcm);
-                         }
-                     }
-                 }
+                }
+                // If we receive a 204 No-bid, we still need to "re-inject" it to the
+                // router otherwise we won't expire the inFlights
+                else if (statusCode == 204) {
+                    Bids bids;
+                    bids.resize(pending->auction->request->imp.size());
+                    for (const auto & agent: pending->agents) {
+                        submitBids(agent.second.name, pending->auction->id,
+                                   bids, WinCostModel());
+                    }
+                }
+                else if (statusCode == 200) {
+                    handleResponse(*pending, body);
+                }
             }
     );
 
-    HttpRequest::Content reqContent { requestStr, "application/json" };
+    HttpRequest::Content reqContent { requestBuffer, "application/json" };
     RestParams headers { { "x-openrtb-version", "2.1" } };
-   // std::cerr << "Sending HTTP POST to: " << host << " " << path << std::endl;
-   // std::cerr << "Content " << reqContent.str << std::endl;
 
     httpClientRouter->post(routerPath, callbacks, reqContent,
                      { } /* queryParams */, headers);
 }
 
+void HttpBidderInterface::handleResponse(PendingAuction & pending,
+                                         const std::string & body) {
+    const Auction & auction = *pending.auction;
+
+    std::vector<ResponseBid> responseBids;
+    try {
+        parseResponse(body.c_str(), body.size(), *auction.request,
+                      responseBids);
+    } catch (const std::exception & exc) {
+        router->throwException("http.response", "%s", exc.what());
+    }
+
+    for (const auto & bid: responseBids) {
+        auto it = pending.agents.find(bid.externalId);
+        if (it == pending.agents.end()) {
+            router->throwException("http.response",
+               "Couldn't find config for externalId: %lu",
+               bid.externalId);
+        }
+
+        const auto & agent = it->second;
+
+        int crid = bid.crid.toInt();
+        int creativeIndex = indexOf(agent.config->creatives,
+                                    &Creative::id, crid);
+        if (creativeIndex == -1) {
+            router->throwException("http.response",
+               "Unknown creative id: %d", crid);
+        }
+
+        Bid theBid;
+        theBid.creativeIndex = creativeIndex;
+        theBid.price = USD_CPM(bid.price);
+        theBid.priority = bid.priority;
+        theBid.spotIndex = bid.spotIndex;
+
+        Bids bids;
+        bids.push_back(std::move(theBid));
+
+        WinCostModel wcm =
+            auction.exchangeConnector->getWinCostModel(auction, *agent.config);
+
+        submitBids(agent.name, auction.id, bids, wcm);
+    }
+}
+
 void HttpBidderInterface::sendLossMessage(std::string const & agent,
                                           std::string const & id) {
 
@@ -341,52 +308,357 @@ void HttpBidderInterface::sendPingMessage(std::string const & agent,
     const std::string receivedTime = sentTime;
     const std::string pong = (ping == 0 ? "PONG0" : "PONG1");
     std::vector<std::string> message { agent, pong, sentTime, receivedTime };
-    router->handleAgentMessage(message);
+    router->handleAgentMessage(router->shardFor(bridge), message);
 }
 
-void HttpBidderInterface::tagRequest(OpenRTB::BidRequest &request,
-                                     const std::map<std::string, BidInfo> &bidders) const
-{
+namespace {
 
-    for (const auto &bidder: bidders) {
-        const auto &agentConfig = bidder.second.agentConfig;
-        const auto &spots = bidder.second.imp;
+/** Prints the OpenRTB bid request straight from our BidRequest, member by
+    member, in the order of the OpenRTB description.  The members that have
+    the same type in both are printed with the OpenRTB description; the
+    others are converted on the fly, as toOpenRtb() would.
+*/
+struct OpenRtbRequestPrinter {
 
-        for (const auto &spot: spots) {
-            const int adSpotIndex = spot.first;
-            ExcCheck(adSpotIndex >= 0 && adSpotIndex < request.imp.size(),
-                     "adSpotIndex out of range");
-            auto &imp = request.imp[adSpotIndex];
-            auto &ext = imp.ext;
+    typedef ValueDescription::FieldDescription FieldDescription;
+
+    typedef std::function<void (const BidRequest & request,
+                                JsonPrintingContext & context)> Member;
+
+    OpenRtbRequestPrinter()
+    {
+        DefaultDescription<OpenRTB::Impression> impDesc;
+        impDesc.forEachField(nullptr, [&] (const FieldDescription & fd) {
+                impFields.push_back(fd);
+            });
+
+        desc.forEachField(nullptr, [&] (const FieldDescription & fd) {
+                const std::string & name = fd.fieldName;
+                if (name == "id")
+                    members.push_back(same(fd, &BidRequest::auctionId));
+                else if (name == "site")
+                    members.push_back(same(fd, &BidRequest::site));
+                else if (name == "app")
+                    members.push_back(same(fd, &BidRequest::app));
+                else if (name == "device")
+                    members.push_back(same(fd, &BidRequest::device));
+                else if (name == "user")
+                    members.push_back(same(fd, &BidRequest::user));
+                else if (name == "at")
+                    members.push_back(same(fd, &BidRequest::auctionType));
+                else if (name == "bcat")
+                    members.push_back(same(fd, &BidRequest::blockedCategories));
+                else if (name == "badv")
+                    members.push_back(same(fd, &BidRequest::badv));
+                else if (name == "ext")
+                    members.push_back(same(fd, &BidRequest::ext));
+                else if (name == "unparseable")
+                    members.push_back(same(fd, &BidRequest::unparseable));
+                else if (name == "imp" || name == "tmax")
+                    members.push_back(nullptr);  // printed by print()
+                else if (name == "cur")
+                    members.push_back(printCurrencies);
+                else if (name == "wseat")
+                    members.push_back(printSeats);
+                else if (name == "allimps")
+                    ;  // never set by toOpenRtb()
+                else throw ML::Exception("don't know how to print OpenRTB "
+                                         "bid request member " + name);
+                names.push_back(name);
+            });
+    }
 
-            ext["external-ids"].append(agentConfig->externalId);
+    /* Member with the same type in our BidRequest and the OpenRTB one */
+    template<typename T>
+    static Member same(const FieldDescription & fd, T BidRequest::* field)
+    {
+        ExcAssert(*fd.description->type == typeid(T));
+        auto description = fd.description;
+        std::string name = fd.fieldName;
+
+        return [=] (const BidRequest & request, JsonPrintingContext & context)
+            {
+                const T * val = &(request.*field);
+                if (description->isDefault(val))
+                    return;
+                context.startMember(name);
+                description->printJson(val, context);
+            };
+    }
+
+    static void printCurrencies(const BidRequest & request,
+                                JsonPrintingContext & context)
+    {
+        if (request.bidCurrency.empty())
+            return;
+        context.startMember("cur");
+        context.startArray(request.bidCurrency.size());
+        for (auto currency: request.bidCurrency) {
+            context.newArrayElement();
+            context.writeString(toString(currency));
         }
+        context.endArray();
+    }
 
+    static void printSeats(const BidRequest & request,
+                           JsonPrintingContext & context)
+    {
+        const auto & seats = request.segments.get("openrtb-wseat");
+        if (seats.ints.empty() && seats.strings.empty())
+            return;
+        context.startMember("wseat");
+        context.startArray();
+        seats.forEach([&] (int, const std::string & str, float) {
+                context.newArrayElement();
+                context.writeString(str);
+            });
+        context.endArray();
+    }
+
+    void print(StringJsonPrintingContext & context,
+               const BidRequest & request,
+               const std::map<std::string, BidInfo> & bidders,
+               int tmax,
+               const HttpBidderInterface & tagger) const
+    {
+        context.startObject();
+        for (unsigned i = 0;  i < members.size();  ++i) {
+            if (members[i])
+                members[i](request, context);
+            else if (names[i] == "tmax") {
+                context.startMember("tmax");
+                context.writeInt(tmax);
+            }
+            else printImpressions(context, request, bidders, tagger);
+        }
+        tagger.tagRequest(context, request, bidders);
+        context.endObject();
     }
 
+    void printImpressions(StringJsonPrintingContext & context,
+                          const BidRequest & request,
+                          const std::map<std::string, BidInfo> & bidders,
+                          const HttpBidderInterface & tagger) const
+    {
+        context.startMember("imp");
+        context.startArray(request.imp.size());
+
+        for (unsigned spotIndex = 0;  spotIndex < request.imp.size();
+             ++spotIndex) {
+            const OpenRTB::Impression & imp = request.imp[spotIndex];
+
+            context.newArrayElement();
+            context.startObject();
+            for (auto & fd: impFields) {
+                const void * val = addOffset(&imp, fd.offset);
+                if (fd.fieldName == "ext")
+                    printImpressionExt(context, request, spotIndex, bidders,
+                                       tagger);
+                else if (!fd.description->isDefault(val)) {
+                    context.startMember(fd.fieldName);
+                    fd.description->printJson(val, context);
+                }
+            }
+            context.endObject();
+        }
+
+        context.endArray();
+    }
+
+    template<typename Fn>
+    static void forEachExternalId(const std::map<std::string, BidInfo> & bidders,
+                                  int spotIndex, const Fn & fn)
+    {
+        for (const auto & bidder: bidders)
+            for (const auto & spot: bidder.second.imp)
+                if (spot.first == spotIndex)
+                    fn(bidder.second.agentConfig->externalId);
+    }
+
+    /* Splice the external ids of the agents that can bid on the spot,
+       and the tagger's members, into the impression's ext. */
+    static void printImpressionExt(StringJsonPrintingContext & context,
+                                   const BidRequest & request,
+                                   int spotIndex,
+                                   const std::map<std::string, BidInfo> & bidders,
+                                   const HttpBidderInterface & tagger)
+    {
+        const Json::Value & ext = request.imp[spotIndex].ext;
+
+        bool tagged = false;
+        forEachExternalId(bidders, spotIndex, [&] (uint64_t) { tagged = true; });
+
+        if (!tagged) {
+            if (!ext.isNull()) {
+                context.startMember("ext");
+                context.writeJson(ext);
+            }
+            return;
+        }
+
+        ExcCheck(ext.isNull() || ext.isObject(),
+                 "impression ext must be an object");
+
+        static const char ExternalIds[] = "external-ids";
+
+        context.startMember("ext");
+        context.startObject();
+        for (auto it = ext.begin(), end = ext.end();  it != end;  ++it) {
+            const char * name = it.memberNameC();
+            if (strcmp(name, ExternalIds) == 0)
+                continue;
+            context.startMember(name, strlen(name));
+            context.writeJson(*it);
+        }
+
+        context.startMember(ExternalIds, sizeof(ExternalIds) - 1);
+        context.startArray();
+        const Json::Value & existing = ext[ExternalIds];
+        for (unsigned i = 0;  i < existing.size();  ++i) {
+            context.newArrayElement();
+            context.writeJson(existing[i]);
+        }
+        forEachExternalId(bidders, spotIndex, [&] (uint64_t externalId) {
+                context.newArrayElement();
+                context.writeUnsignedLongLong(externalId);
+            });
+        context.endArray();
+
+        tagger.tagImpression(context, request, spotIndex, bidders);
+
+        context.endObject();
+    }
+
+    std::vector<Member> members;
+    std::vector<std::string> names;
+    std::vector<FieldDescription> impFields;
+};
+
+const OpenRtbRequestPrinter & requestPrinter()
+{
+    static const OpenRtbRequestPrinter printer;
+    return printer;
 }
 
-bool HttpBidderInterface::prepareRequest(OpenRTB::BidRequest &request,
-                                         const RTBKIT::BidRequest &originalRequest,
-                                         const std::map<std::string, BidInfo> &bidders) const {
-    tagRequest(request, bidders);
+} // file scope
+
+bool HttpBidderInterface::printRequest(std::string & output,
+                                       const BidRequest & request,
+                                       const std::map<std::string, BidInfo> & bidders,
+                                       Date now) const {
+    for (const auto & bidder: bidders) {
+        for (const auto & spot: bidder.second.imp) {
+            ExcCheck(spot.first >= 0 && spot.first < request.imp.size(),
+                     "adSpotIndex out of range");
+        }
+    }
 
     // We update the tmax value before sending the BidRequest to substract our processing time
-    double processingTimeMs = originalRequest.timestamp.secondsUntil(Date::now()) * 1000;
-    int oldTmax = request.tmax.value();
+    double processingTimeMs = request.timestamp.secondsUntil(now) * 1000;
+    int oldTmax = request.timeAvailableMs;
     int newTmax = oldTmax - static_cast<int>(std::round(processingTimeMs));
     if (newTmax <= 0) {
         return false;
     }
-#if 0
-        std::cerr << "old tmax = " << oldTmax << std::std::endl
-                  << "new tmax = " << newTmax << std::std::endl;
-#endif
     ExcCheck(newTmax <= oldTmax, "Wrong tmax calculation");
-    request.tmax.val = newTmax;
+
+    output.clear();
+    StringJsonPrintingContext context(output);
+    requestPrinter().print(context, request, bidders, newTmax, *this);
     return true;
 }
 
+void HttpBidderInterface::tagRequest(JsonPrintingContext & context,
+                                     const BidRequest & request,
+                                     const std::map<std::string, BidInfo> & bidders) const {
+}
+
+void HttpBidderInterface::tagImpression(JsonPrintingContext & context,
+                                        const BidRequest & request,
+                                        int spotIndex,
+                                        const std::map<std::string, BidInfo> & bidders) const {
+}
+
+void HttpBidderInterface::parseResponse(const char * data, size_t size,
+                                        const BidRequest & request,
+                                        std::vector<ResponseBid> & bids) {
+    static const StringIdDescription idDesc;
+
+    ML::Parse_Context context("payload", data, data + size);
+    StreamingJsonParsingContext json(context);
+
+    auto isField = [&] (const char * name) {
+        return strcmp(json.fieldNamePtr(), name) == 0;
+    };
+
+    auto parseBid = [&] () {
+        ResponseBid bid;
+        bid.spotIndex = -1;
+        bid.price = 0.0;
+        bool hasImpid = false, hasExternalId = false, hasPriority = false;
+        Id impid;
+
+        json.forEachMember([&] () {
+                if (isField("impid")) {
+                    idDesc.parseJson(&impid, json);
+                    hasImpid = true;
+                }
+                else if (isField("crid"))
+                    idDesc.parseJson(&bid.crid, json);
+                else if (isField("price"))
+                    bid.price = json.expectDouble();
+                else if (isField("ext")) {
+                    json.forEachMember([&] () {
+                            if (isField("external-id")) {
+                                bid.externalId = json.expectUnsignedLongLong();
+                                hasExternalId = true;
+                            }
+                            else if (isField("priority")) {
+                                bid.priority = json.expectDouble();
+                                hasPriority = true;
+                            }
+                            else json.skip();
+                        });
+                }
+                else json.skip();
+            });
+
+        if (!hasExternalId)
+            throw ML::Exception("Missing external-id ext field in BidResponse");
+        if (!hasPriority)
+            throw ML::Exception("Missing priority ext field in BidResponse");
+
+        if (hasImpid) {
+            for (unsigned i = 0;  i < request.imp.size();  ++i) {
+                if (request.imp[i].id == impid) {
+                    bid.spotIndex = i;
+                    break;
+                }
+            }
+        }
+        if (bid.spotIndex == -1)
+            throw ML::Exception("Unknown impression id: %s",
+                                impid.toString().c_str());
+
+        bids.push_back(std::move(bid));
+    };
+
+    json.forEachMember([&] () {
+            if (!isField("seatbid")) {
+                json.skip();
+                return;
+            }
+
+            json.forEachElement([&] () {
+                    json.forEachMember([&] () {
+                            if (isField("bid"))
+                                json.forEachElement(parseBid);
+                            else json.skip();
+                        });
+                });
+        });
+}
+
 void HttpBidderInterface::submitBids(const std::string &agent, Id auctionId,
                                      const Bids &bids, WinCostModel wcm)
 {
@@ -403,7 +675,7 @@ void HttpBidderInterface::submitBids(const std::string &agent, Id auctionId,
      message.push_back(std::move(bidsStr));
      message.push_back(std::move(wcmStr));
 
-     router->doBid(message);
+     router->doBid(router->shardFor(bridge), message);
 }
 
 //
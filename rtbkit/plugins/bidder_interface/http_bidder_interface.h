@@ -8,6 +8,7 @@
 #include "rtbkit/common/bidder_interface.h"
 #include "soa/service/http_client.h"
 #include "soa/service/logs.h"
+#include "soa/types/json_printing.h"
 
 namespace RTBKIT {
 
@@ -60,19 +61,74 @@ struct HttpBidderInterface : public BidderInterface
     void sendPingMessage(std::string const & agent,
                          int ping);
 
-    virtual void tagRequest(OpenRTB::BidRequest &request,
-                            const std::map<std::string, BidInfo> &bidders) const;
+    /** Print the OpenRTB bid request sent to the bidder for the given
+        bidders into output, which is cleared first.  The request is
+        printed straight from the auction's BidRequest; the ext of each
+        impression gets the "external-ids" of the agents that can bid on
+        it, then whatever tagImpression() adds.  Returns false if the time
+        left to the auction at the given time is too short to send it.
+    */
+    bool printRequest(std::string & output,
+                      const BidRequest & request,
+                      const std::map<std::string, BidInfo> & bidders,
+                      Date now = Date::now()) const;
+
+    /** Hooks to add to the OpenRTB request sent to the bidder.  They take
+        the place of the old tagRequest(OpenRTB::BidRequest &), as the
+        request is no longer built as an OpenRTB::BidRequest but printed
+        as it goes; members are added with context.startMember() followed
+        by the value.  The default implementations add nothing.
+
+        tagRequest() is called with the request object open, after all of
+        its other members.
+    */
+    virtual void tagRequest(JsonPrintingContext & context,
+                            const BidRequest & request,
+                            const std::map<std::string, BidInfo> & bidders) const;
+
+    /** Called with the ext object of the impression at spotIndex open,
+        after its "external-ids".  Only impressions that at least one of
+        the bidders can bid on are tagged.
+    */
+    virtual void tagImpression(JsonPrintingContext & context,
+                               const BidRequest & request,
+                               int spotIndex,
+                               const std::map<std::string, BidInfo> & bidders) const;
+
+    /** Bid as found in the bidder's response. */
+    struct ResponseBid {
+        uint64_t externalId;  ///< Agent that made the bid
+        int spotIndex;        ///< Index of the impression in the request
+        Id crid;              ///< Id of the creative
+        double price;         ///< CPM in USD
+        double priority;
+    };
+
+    /** Parse the bidder's OpenRTB response to the given request, appending
+        the bids to bids.  Only the members we need are extracted; the rest
+        is skipped without being decoded.
+    */
+    static void parseResponse(const char * data, size_t size,
+                              const BidRequest & request,
+                              std::vector<ResponseBid> & bids);
 
     static Logging::Category print;
     static Logging::Category error;
     static Logging::Category trace;
     
 private:
-    bool prepareRequest(OpenRTB::BidRequest &request,
-                        const RTBKIT::BidRequest &originalRequest,
-                        const std::map<std::string, BidInfo> &bidders) const;
+    struct PendingAuction;
+
+    void handleResponse(PendingAuction & pending,
+                        const std::string & body);
+
     void submitBids(const std::string &agent, Id auctionId,
                          const Bids &bids, WinCostModel wcm);
+
+    /* Buffer the requests are printed into, kept from one auction to the
+       next so that it doesn't need to grow again. */
+    std::string requestBuffer;
+
     MessageLoop loop;
     std::shared_ptr<HttpClient> httpClientRouter;
     std::shared_ptr<HttpClient> httpClientAdserverWins;
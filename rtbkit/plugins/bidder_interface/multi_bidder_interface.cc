@@ -63,6 +63,12 @@ void MultiBidderInterface::shutdown() {
     }
 }
 
+void MultiBidderInterface::processAgentMessages() {
+    for (const auto &iface: bidderInterfaces) {
+        iface.second->processAgentMessages();
+    }
+}
+
 void MultiBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                              double timeLeftMs,
                                              std::map<std::string, BidInfo> const & bidders) {
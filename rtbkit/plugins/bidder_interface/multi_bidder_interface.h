@@ -98,6 +98,7 @@ struct MultiBidderInterface : public BidderInterface {
     void init(AgentBridge *value, Router * router = nullptr);
     void start();
     void shutdown();
+    void processAgentMessages();
 
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
@@ -170,7 +171,7 @@ private:
             Func func,
             Args&& ...args)
     {
-        const auto &agentInfo = router->agents[agent];
+        const auto &agentInfo = router->shardFor(bridge).agents[agent];
         const auto &agentConfig = agentInfo.config;
         ExcAssert(agentConfig);
 
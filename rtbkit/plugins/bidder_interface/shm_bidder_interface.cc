@@ -0,0 +1,392 @@
+/* shm_bidder_interface.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Bidder interface that talks to co-located agents through shared memory.
+*/
+
+#include "rtbkit/common/messages.h"
+#include "rtbkit/core/router/router.h"
+#include "shm_bidder_interface.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/*****************************************************************************/
+/* SHM BIDDER INTERFACE                                                      */
+/*****************************************************************************/
+
+/** Unix socket over which an agent attached itself.  The agent keeps it
+    open for as long as it uses the channel, so that we find out when it
+    goes away.
+*/
+struct ShmBidderInterface::Connection {
+    Connection(int fd)
+        : fd(fd)
+    {
+    }
+
+    int fd;
+    std::string agent;
+    std::shared_ptr<ShmEndpoint> endpoint;  ///< Null until the handshake
+};
+
+ShmBidderInterface::ShmBidderInterface(std::string const & serviceName,
+                                       std::shared_ptr<ServiceProxies> proxies,
+                                       Json::Value const & config)
+    : AgentsBidderInterface(serviceName, proxies, config),
+      maxRecords(config.get("maxRecords", 1000).asUInt()),
+      listenFd(-1),
+      routerWakeupFd(-1),
+      hasChanges(false) {
+    hasLocalAgents = true;
+}
+
+ShmBidderInterface::~ShmBidderInterface() {
+    shutdown();
+}
+
+void ShmBidderInterface::init(AgentBridge * bridge, Router * r) {
+    AgentsBidderInterface::init(bridge, r);
+
+    // The post auction loop uses the interface without a router; its
+    // messages to the agents keep going through the bridge.
+    if (!router)
+        return;
+
+    RouterShard & shard = router->shardFor(bridge);
+    routerWakeupFd = shard.wakeup.fd();
+    listenFd = bindShmSocket(router->shardServiceName(shard.index));
+
+    events.init(1024);
+    events.handleEvent = [=] (epoll_event & event) {
+        this->handleEvent(event);
+        return Epoller::DONE;
+    };
+    events.addFd(listenFd);
+
+    loop.addSource("ShmBidderInterface::events", events);
+}
+
+void ShmBidderInterface::start() {
+    if (listenFd != -1)
+        loop.start();
+}
+
+void ShmBidderInterface::shutdown() {
+    loop.shutdown();
+
+    for (auto & connection: connections)
+        ::close(connection.first);
+    connections.clear();
+
+    if (listenFd != -1) {
+        ::close(listenFd);
+        listenFd = -1;
+    }
+
+    endpoints.clear();
+}
+
+void ShmBidderInterface::handleEvent(epoll_event & event) {
+    if (!event.data.ptr) {
+        acceptConnections();
+        return;
+    }
+
+    Connection * connection = static_cast<Connection *>(event.data.ptr);
+    if ((event.events & EPOLLIN) && !connection->endpoint)
+        handleHandshake(connection);
+    else
+        // Nothing else is ever sent on the socket: this is the agent going
+        // away.
+        closeConnection(connection);
+}
+
+void ShmBidderInterface::acceptConnections() {
+    for (;;) {
+        int fd = ::accept4(listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                cerr << "ShmBidderInterface: accept: " << strerror(errno)
+                     << endl;
+            return;
+        }
+
+        std::unique_ptr<Connection> connection(new Connection(fd));
+        events.addFd(fd, connection.get());
+        connections[fd] = std::move(connection);
+    }
+}
+
+void ShmBidderInterface::handleHandshake(Connection * connection) {
+    std::vector<int> fds;
+    std::string agent;
+
+    try {
+        agent = recvWithFds(connection->fd, fds);
+        if (agent.empty()) {
+            closeConnection(connection);
+            return;
+        }
+        if (fds.size() != 2)
+            throw ML::Exception("expected a segment and an eventfd");
+
+        int segmentFd = fds[0], wakeupFd = fds[1];
+        fds.clear();
+
+        std::shared_ptr<ShmChannel> channel;
+        try {
+            channel = ShmChannel::attach(segmentFd);
+        } catch (...) {
+            ::close(wakeupFd);
+            throw;
+        }
+
+        connection->endpoint
+            = std::make_shared<ShmEndpoint>(channel, true, wakeupFd);
+        connection->agent = agent;
+
+        sendWithFds(connection->fd, "OK", { routerWakeupFd });
+    } catch (const std::exception & exc) {
+        for (int fd: fds)
+            ::close(fd);
+        cerr << "ShmBidderInterface: couldn't attach agent " << agent
+             << ": " << exc.what() << endl;
+        recordHit("shm.attachError");
+        connection->endpoint.reset();
+        closeConnection(connection);
+        return;
+    }
+
+    recordHit("shm.attached");
+    pushChange({ agent, connection->endpoint, true });
+}
+
+void ShmBidderInterface::closeConnection(Connection * connection) {
+    int fd = connection->fd;
+    events.removeFd(fd);
+    ::close(fd);
+
+    if (connection->endpoint) {
+        recordHit("shm.detached");
+        pushChange({ connection->agent, connection->endpoint, false });
+    }
+
+    connections.erase(fd);
+}
+
+void ShmBidderInterface::pushChange(Change change) {
+    {
+        std::lock_guard<std::mutex> guard(changesLock);
+        changes.push_back(std::move(change));
+        hasChanges = true;
+    }
+
+    eventfd_t val = 1;
+    ::eventfd_write(routerWakeupFd, val);
+}
+
+void ShmBidderInterface::processAgentMessages() {
+    if (hasChanges) {
+        std::vector<Change> newChanges;
+        {
+            std::lock_guard<std::mutex> guard(changesLock);
+            newChanges.swap(changes);
+            hasChanges = false;
+        }
+
+        for (auto & change: newChanges) {
+            auto it = endpoints.find(change.agent);
+            if (change.attached)
+                endpoints[change.agent] = change.endpoint;
+            // An agent that reattached may go away after its new channel is
+            // up; only forget about the channel that went away.
+            else if (it != endpoints.end() && it->second == change.endpoint)
+                endpoints.erase(it);
+        }
+    }
+
+    if (endpoints.empty())
+        return;
+
+    RouterShard & shard = router->shardFor(bridge);
+
+    bool more = false;
+    std::vector<std::string> broken;
+
+    for (auto & entry: endpoints) {
+        const std::string & agent = entry.first;
+
+        auto onRecord = [&] (uint32_t type, ShmMessageReader & reader) {
+            if (type != SHM_MESSAGE)
+                throw ML::Exception("unexpected record of type %d", type);
+
+            std::vector<std::string> message(1, agent);
+            ShmEndpoint::decodeMessage(reader, message);
+            router->handleAgentMessage(shard, message);
+        };
+
+        try {
+            if (entry.second->processRecords(onRecord, maxRecords)
+                == maxRecords)
+                more = true;
+        } catch (const std::exception & exc) {
+            cerr << "ShmBidderInterface: dropping channel of agent " << agent
+                 << ": " << exc.what() << endl;
+            recordHit("shm.readError");
+            broken.push_back(agent);
+        }
+    }
+
+    // Agents whose channel is broken go back to the bridge
+    for (auto & agent: broken)
+        endpoints.erase(agent);
+
+    if (more)
+        shard.wakeup.signal();
+}
+
+bool ShmBidderInterface::isLocalAgent(std::string const & agent) const {
+    return endpoints.count(agent);
+}
+
+bool ShmBidderInterface::sendLocalMessage(std::string const & agent,
+                                          std::vector<std::string> const & message) {
+    auto it = endpoints.find(agent);
+    if (it == endpoints.end())
+        return false;
+
+    if (ShmEndpoint::messageSize(message) > it->second->maxRecordSize()) {
+        recordHit("shm.tooLarge");
+        return false;
+    }
+
+    if (!it->second->sendMessage(message)) {
+        recordHit("shm.full");
+        return false;
+    }
+
+    return true;
+}
+
+void ShmBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                                            double timeLeftMs,
+                                            std::map<std::string, BidInfo> const & bidders) {
+    if (endpoints.empty()) {
+        AgentsBidderInterface::sendAuctionMessage(auction, timeLeftMs, bidders);
+        return;
+    }
+
+    auto & agents = router->shardFor(bridge).agents;
+
+    for(auto & item : bidders) {
+        auto & agent = item.first;
+        auto & spots = item.second.imp;
+        auto & info = agents[agent];
+        WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
+
+        auto it = endpoints.find(agent);
+        if (it != endpoints.end()
+            && sendAuction(*it->second, *auction, timeLeftMs,
+                           info.getBidRequestEncoding(*auction),
+                           info.encodeBidRequest(*auction),
+                           spots,
+                           auction->agentAugmentations[agent],
+                           chomp(wcm.toJson().toString())))
+            continue;
+
+        bridge->sendAgentMessage(agent,
+                                 "AUCTION",
+                                 auction->start,
+                                 auction->id,
+                                 info.getBidRequestEncoding(*auction),
+                                 info.encodeBidRequest(*auction),
+                                 spots.toJsonStr(),
+                                 std::to_string(timeLeftMs),
+                                 auction->agentAugmentations[agent],
+                                 wcm.toJson());
+    }
+}
+
+bool ShmBidderInterface::sendAuction(ShmEndpoint & endpoint,
+                                     Auction const & auction,
+                                     double timeLeftMs,
+                                     std::string const & format,
+                                     std::string const & request,
+                                     BiddableSpots const & spots,
+                                     std::string const & augmentations,
+                                     std::string const & wcm) {
+    std::string id = auction.id.toString();
+
+    size_t size = 2 * sizeof(double)
+        + ShmMessageWriter::stringSize(id)
+        + ShmMessageWriter::stringSize(format)
+        + ShmMessageWriter::stringSize(request)
+        + sizeof(uint32_t)
+        + ShmMessageWriter::stringSize(augmentations)
+        + ShmMessageWriter::stringSize(wcm);
+    for (auto & spot: spots)
+        size += sizeof(int32_t) + sizeof(uint32_t)
+            + spot.second.size() * sizeof(uint16_t);
+
+    // Goes through the bridge like when the ring is full
+    if (size > endpoint.maxRecordSize()) {
+        recordHit("shm.tooLarge");
+        return false;
+    }
+
+    char * data = endpoint.beginRecord(SHM_AUCTION, size);
+    if (!data) {
+        recordHit("shm.full");
+        return false;
+    }
+
+    ShmMessageWriter writer(data);
+    writer.write<double>(auction.start.secondsSinceEpoch());
+    writer.write<double>(timeLeftMs);
+    writer.writeString(id);
+    writer.writeString(format);
+    writer.writeString(request);
+    writer.write<uint32_t>(spots.size());
+    for (auto & spot: spots) {
+        writer.write<int32_t>(spot.first);
+        writer.write<uint32_t>(spot.second.size());
+        for (auto creative: spot.second)
+            writer.write<uint16_t>(creative);
+    }
+    writer.writeString(augmentations);
+    writer.writeString(wcm);
+
+    endpoint.endRecord();
+    return true;
+}
+
+//
+// factory
+//
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        BidderInterface::registerFactory("shm",
+        [](std::string const &serviceName,
+           std::shared_ptr<ServiceProxies> const &proxies,
+           Json::Value const &json)
+        {
+            return new ShmBidderInterface(serviceName, proxies, json);
+        });
+    }
+} atInit;
+
+}
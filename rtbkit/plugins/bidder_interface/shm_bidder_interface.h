@@ -0,0 +1,103 @@
+/* shm_bidder_interface.h                                          -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Bidder interface that talks to the bidding agents running on the same
+   host through shared memory.
+*/
+
+#pragma once
+
+#include "agents_bidder_interface.h"
+#include "rtbkit/common/shm_channel.h"
+#include "soa/service/epoller.h"
+#include "soa/service/message_loop.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace RTBKIT {
+
+/** Same as the "agents" interface, except that the agents that attach to
+    the router's shared memory socket (see BiddingAgent::useSharedMemory)
+    exchange their messages with it through a pair of rings in a segment
+    they share with the router, instead of through the agent bridge.
+
+    AUCTION messages are written in binary form; the others keep the
+    fields of their zmq message.  Agents that aren't attached, or whose
+    ring is full or too small for the message, keep going through the
+    bridge.
+
+    Everything but the acceptance of new agents happens on the thread of
+    the router (or router shard) that owns the interface: agents wake that
+    thread up through its wakeup fd and the router calls
+    processAgentMessages() to read what they sent.
+*/
+struct ShmBidderInterface : public AgentsBidderInterface
+{
+    ShmBidderInterface(std::string const & serviceName = "bidderService",
+                       std::shared_ptr<ServiceProxies> proxies = std::make_shared<ServiceProxies>(),
+                       Json::Value const & config = Json::Value());
+
+    ~ShmBidderInterface();
+
+    void init(AgentBridge * bridge, Router * r = nullptr);
+    void start();
+    void shutdown();
+
+    void processAgentMessages();
+
+    void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                            double timeLeftMs,
+                            std::map<std::string, BidInfo> const & bidders);
+
+protected:
+    bool isLocalAgent(std::string const & agent) const;
+
+    bool sendLocalMessage(std::string const & agent,
+                          std::vector<std::string> const & message);
+
+private:
+    struct Connection;
+
+    void handleEvent(epoll_event & event);
+    void acceptConnections();
+    void handleHandshake(Connection * connection);
+    void closeConnection(Connection * connection);
+
+    bool sendAuction(ShmEndpoint & endpoint,
+                     Auction const & auction,
+                     double timeLeftMs,
+                     std::string const & format,
+                     std::string const & request,
+                     BiddableSpots const & spots,
+                     std::string const & augmentations,
+                     std::string const & wcm);
+
+    /** Maximum number of records read from an agent each time the router
+        wakes up, so that one agent can't hold up the router. */
+    size_t maxRecords;
+
+    int listenFd;
+    int routerWakeupFd;
+    Datacratic::Epoller events;
+    Datacratic::MessageLoop loop;
+    std::unordered_map<int, std::unique_ptr<Connection> > connections;
+
+    /* Agents that attached or detached and that the router's thread hasn't
+       picked up yet. */
+    struct Change {
+        std::string agent;
+        std::shared_ptr<ShmEndpoint> endpoint;
+        bool attached;
+    };
+    void pushChange(Change change);
+
+    std::mutex changesLock;
+    std::vector<Change> changes;
+    std::atomic<bool> hasChanges;
+
+    /* Only touched from the router's thread */
+    std::unordered_map<std::string, std::shared_ptr<ShmEndpoint> > endpoints;
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,3 @@
+# bidder_interface_testing.mk
+
+$(eval $(call test,http_bidder_interface_bench,http_bidder openrtb_bid_request agent_configuration rtb_router,boost manual))
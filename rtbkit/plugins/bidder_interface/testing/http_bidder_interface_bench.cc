@@ -0,0 +1,275 @@
+/* http_bidder_interface_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   CPU spent per auction by the HTTP bidder interface to print the request
+   sent to the external bidder and to parse its response, compared with
+   going through OpenRTB::BidRequest and a Json::Value.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/bidder_interface/http_bidder_interface.h"
+#include "rtbkit/plugins/bid_request/openrtb_bid_request.h"
+#include "rtbkit/openrtb/openrtb_parsing.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/core/router/router_types.h"
+#include "soa/types/json_printing.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+vector<string> samples = {
+    "rtbkit/plugins/bid_request/testing/openrtb1_req.json",
+    "rtbkit/plugins/bid_request/testing/openrtb_banner.json",
+    "rtbkit/plugins/bid_request/testing/openrtb_mobile.json",
+    "rtbkit/plugins/bid_request/testing/rubicon_desktop.json",
+    "rtbkit/plugins/bid_request/testing/rubicon_mobile_app.json"
+};
+
+enum { NumAgents = 8, Iterations = 20000 };
+
+std::string loadFile(const std::string & filename)
+{
+    ML::filter_istream stream(filename);
+    return string(std::istreambuf_iterator<char>(stream),
+                  std::istreambuf_iterator<char>());
+}
+
+std::map<std::string, BidInfo>
+makeBidders(const BidRequest & request)
+{
+    std::map<std::string, BidInfo> result;
+
+    for (int i = 0;  i < NumAgents;  ++i) {
+        auto config = std::make_shared<AgentConfig>();
+        config->externalId = 1000 + i;
+        config->creatives.push_back(Creative(300, 250, "creative", 10 + i));
+
+        BidInfo info;
+        info.agentConfig = config;
+        for (unsigned spot = 0;  spot < request.imp.size();  ++spot)
+            if ((spot + i) % 2 == 0 || request.imp.size() == 1)
+                info.imp.push_back(make_pair(spot, SmallIntVector({ 0 })));
+
+        result["agent" + to_string(i)] = std::move(info);
+    }
+
+    return result;
+}
+
+std::string makeResponse(const BidRequest & request)
+{
+    std::string result = "{\"id\":\"" + request.auctionId.toString()
+        + "\",\"cur\":\"USD\",\"seatbid\":[{\"seat\":\"rtbkit\",\"bid\":[";
+
+    for (int i = 0;  i < NumAgents;  ++i) {
+        if (i != 0) result += ",";
+        result += ML::format(
+                "{\"id\":\"b%d\",\"impid\":\"%s\",\"price\":%d.5,"
+                "\"crid\":\"%d\",\"adm\":\"<a href=\\\"http://x.com\\\">"
+                "ad</a>\",\"adomain\":[\"x.com\"],"
+                "\"ext\":{\"external-id\":%d,\"priority\":1.0}}",
+                i, request.imp[0].id.toString().c_str(), i + 1,
+                10 + i, 1000 + i);
+    }
+
+    return result + "]}]}";
+}
+
+/* What the interface used to do: copy the request, convert it, tag the
+   impressions and print through a Json::Value. */
+std::string printThroughJson(const BidRequest & request,
+                             const std::map<std::string, BidInfo> & bidders,
+                             Date now)
+{
+    static DefaultDescription<OpenRTB::BidRequest> desc;
+
+    BidRequest originalRequest = request;
+    OpenRTB::BidRequest openRtbRequest = toOpenRtb(originalRequest);
+
+    for (const auto & bidder: bidders) {
+        for (const auto & spot: bidder.second.imp) {
+            auto & ext = openRtbRequest.imp[spot.first].ext;
+            ext["external-ids"].append(bidder.second.agentConfig->externalId);
+        }
+    }
+
+    double processingTimeMs = request.timestamp.secondsUntil(now) * 1000;
+    openRtbRequest.tmax.val = openRtbRequest.tmax.value()
+        - static_cast<int>(std::round(processingTimeMs));
+
+    StructuredJsonPrintingContext context;
+    desc.printJson(&openRtbRequest, context);
+    return context.output.toString();
+}
+
+size_t parseThroughBidResponse(const std::string & body,
+                               const std::map<std::string, BidInfo> & bidders)
+{
+    static DefaultDescription<OpenRTB::BidResponse> respDesc;
+
+    OpenRTB::BidResponse response;
+    ML::Parse_Context context("payload", body.c_str(), body.size());
+    StreamingJsonParsingContext jsonContext(context);
+    respDesc.parseJson(&response, jsonContext);
+
+    size_t found = 0;
+    for (const auto & seatbid: response.seatbid) {
+        for (const auto & bid: seatbid.bid) {
+            uint64_t externalId = bid.ext["external-id"].asUInt();
+            auto it = find_if(bidders.begin(), bidders.end(),
+                              [&] (const pair<const string, BidInfo> & bidder)
+                              {
+                                  return bidder.second.agentConfig->externalId
+                                      == externalId;
+                              });
+            found += it != bidders.end();
+        }
+    }
+
+    return found;
+}
+
+Json::Value interfaceConfig()
+{
+    Json::Value config;
+    config["router"]["host"] = "http://localhost:9950";
+    config["router"]["path"] = "/auctions";
+    config["adserver"]["host"] = "http://localhost";
+    config["adserver"]["winPort"] = 9951;
+    config["adserver"]["eventPort"] = 9952;
+    return config;
+}
+
+/* Adds a member to the request and to the ext of each tagged impression. */
+struct TaggingBidderInterface : public HttpBidderInterface {
+    TaggingBidderInterface()
+        : HttpBidderInterface("bidderService",
+                              std::make_shared<ServiceProxies>(),
+                              interfaceConfig())
+    {
+    }
+
+    virtual void tagRequest(JsonPrintingContext & context,
+                            const BidRequest & request,
+                            const std::map<std::string, BidInfo> & bidders) const
+    {
+        context.startMember("numBidders");
+        context.writeInt(bidders.size());
+    }
+
+    virtual void tagImpression(JsonPrintingContext & context,
+                               const BidRequest & request,
+                               int spotIndex,
+                               const std::map<std::string, BidInfo> & bidders) const
+    {
+        context.startMember("spot");
+        context.writeInt(spotIndex);
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_http_bidder_interface_tags )
+{
+    std::unique_ptr<BidRequest> request
+        (OpenRtbBidRequestParser::parseBidRequest(loadFile(samples[0]),
+                                                  "openrtb", "openrtb"));
+    request->timestamp = Date::now();
+    request->timeAvailableMs = 100;
+
+    auto bidders = makeBidders(*request);
+
+    TaggingBidderInterface bidder;
+    std::string printed;
+    BOOST_REQUIRE(bidder.printRequest(printed, *request, bidders,
+                                      request->timestamp));
+
+    Json::Value json = Json::parse(printed);
+    BOOST_CHECK_EQUAL(json["numBidders"].asInt(), NumAgents);
+    BOOST_REQUIRE_EQUAL(json["imp"].size(), request->imp.size());
+    for (unsigned i = 0;  i < request->imp.size();  ++i) {
+        const Json::Value & ext = json["imp"][i]["ext"];
+        BOOST_CHECK_EQUAL(ext["spot"].asInt(), i);
+        BOOST_CHECK(ext["external-ids"].size() > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( bench_http_bidder_interface )
+{
+    HttpBidderInterface bidder("bidderService",
+                               std::make_shared<ServiceProxies>(),
+                               interfaceConfig());
+
+    for (auto & filename: samples) {
+        std::unique_ptr<BidRequest> request
+            (OpenRtbBidRequestParser::parseBidRequest(loadFile(filename),
+                                                      "openrtb", "openrtb"));
+        request->timestamp = Date::now();
+        request->timeAvailableMs = 100;
+
+        auto bidders = makeBidders(*request);
+        std::string body = makeResponse(*request);
+        Date now = request->timestamp.plusSeconds(0.002);
+
+        // Both give the same request and the same bids
+        std::string printed;
+        BOOST_REQUIRE(bidder.printRequest(printed, *request, bidders, now));
+        BOOST_CHECK_EQUAL(Json::parse(printed),
+                          Json::parse(printThroughJson(*request, bidders,
+                                                       now)));
+
+        std::vector<HttpBidderInterface::ResponseBid> bids;
+        HttpBidderInterface::parseResponse(body.c_str(), body.size(),
+                                           *request, bids);
+        BOOST_REQUIRE_EQUAL(bids.size(), NumAgents);
+        BOOST_CHECK_EQUAL(bids[3].externalId, 1003);
+        BOOST_CHECK_EQUAL(bids[3].crid.toInt(), 13);
+        BOOST_CHECK_EQUAL(bids[3].price, 4.5);
+        BOOST_CHECK_EQUAL(bids[3].spotIndex, 0);
+        BOOST_CHECK_EQUAL(parseThroughBidResponse(body, bidders), NumAgents);
+
+        Timer timer;
+        for (int i = 0;  i < Iterations;  ++i)
+            printThroughJson(*request, bidders, now);
+        double oldPrint = timer.elapsed_cpu();
+
+        timer.restart();
+        for (int i = 0;  i < Iterations;  ++i)
+            bidder.printRequest(printed, *request, bidders, now);
+        double newPrint = timer.elapsed_cpu();
+
+        timer.restart();
+        for (int i = 0;  i < Iterations;  ++i)
+            parseThroughBidResponse(body, bidders);
+        double oldParse = timer.elapsed_cpu();
+
+        timer.restart();
+        for (int i = 0;  i < Iterations;  ++i) {
+            bids.clear();
+            HttpBidderInterface::parseResponse(body.c_str(), body.size(),
+                                               *request, bids);
+        }
+        double newParse = timer.elapsed_cpu();
+
+        cerr << ML::format("%-40s request %7.2fus -> %7.2fus  "
+                           "response %7.2fus -> %7.2fus  (%zd bytes)",
+                           filename.substr(filename.rfind('/') + 1).c_str(),
+                           oldPrint * 1e6 / Iterations,
+                           newPrint * 1e6 / Iterations,
+                           oldParse * 1e6 / Iterations,
+                           newParse * 1e6 / Iterations,
+                           printed.size())
+             << endl;
+    }
+}
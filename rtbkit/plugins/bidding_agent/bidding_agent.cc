@@ -17,6 +17,8 @@
 #include "soa/service/zmq_utils.h"
 #include "soa/service/process_stats.h"
 
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <iostream>
@@ -93,10 +95,15 @@ BiddingAgent(std::shared_ptr<ServiceProxies> proxies,
       MessageLoop(1 /* threads */, maxAddedLatency),
       agentName(name + "_" + to_string(getpid())),
       toRouters(getZmqContext()),
+      toRouterShards(getZmqContext()),
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      shmRingSize(0),
+      shmRequests(1024),
+      numWorkers(0),
+      stopWorkers(false)
 {
 }
 
@@ -108,10 +115,15 @@ BiddingAgent(ServiceBase& parent,
       MessageLoop(1 /* threads */, maxAddedLatency),
       agentName(name + "_" + to_string(getpid())),
       toRouters(getZmqContext()),
+      toRouterShards(getZmqContext()),
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      shmRingSize(0),
+      shmRequests(1024),
+      numWorkers(0),
+      stopWorkers(false)
 {
 }
 
@@ -141,6 +153,7 @@ init()
         };
 
     toRouters.messageHandler = messageHandler;
+    toRouterShards.messageHandler = messageHandler;
 
     toPostAuctionServices.messageHandler = messageHandler;
     toConfigurationAgent.init(getServices()->config, agentName);
@@ -160,11 +173,43 @@ init()
                  << connectedTo << endl;
             cerr << ss.str() ;
             toRouters.sendMessage(connectedTo, "CONFIG", agentName);
+            if (shmRingSize)
+                shmRequests.push(make_pair(connectedTo, true));
+        };
+    toRouters.disconnectHandler = [=] (const std::string & disconnectedFrom)
+        {
+            if (shmRingSize)
+                shmRequests.push(make_pair(disconnectedFrom, false));
         };
     toRouters.connectAllServiceProviders("rtbRequestRouter", "agents");
+
+    // Routers running more than one shard have an extra endpoint per shard
+    toRouterShards.init(getServices()->config, agentName);
+    toRouterShards.connectHandler = [=] (const std::string & connectedTo)
+        {
+            {
+                std::lock_guard<std::mutex> guard(routerShardsLock);
+                routerShards.insert(connectedTo);
+            }
+            toRouterShards.sendMessage(connectedTo, "CONFIG", agentName);
+            if (shmRingSize)
+                shmRequests.push(make_pair(connectedTo, true));
+        };
+    toRouterShards.disconnectHandler = [=] (const std::string & disconnectedFrom)
+        {
+            {
+                std::lock_guard<std::mutex> guard(routerShardsLock);
+                routerShards.erase(disconnectedFrom);
+            }
+            if (shmRingSize)
+                shmRequests.push(make_pair(disconnectedFrom, false));
+        };
+    toRouterShards.connectAllServiceProviders("rtbRequestRouterShard",
+                                              "agents");
+
     toRouterChannel.onEvent = [=] (const RouterMessage & msg)
         {
-            toRouters.sendMessage(msg.toRouter, msg.type, msg.payload);
+            sendToRouter(msg.toRouter, msg.type, msg.payload);
         };
     toPostAuctionServices.init(getServices()->config, agentName);
     toPostAuctionServices.connectHandler = [=] (const std::string & connectedTo)
@@ -177,10 +222,48 @@ init()
                                                      "agents");
 
     addSource("BiddingAgent::toRouters", toRouters);
+    addSource("BiddingAgent::toRouterShards", toRouterShards);
     addSource("BiddingAgent::toPostAuctionServices", toPostAuctionServices);
     addSource("BiddingAgent::toConfigurationAgent", toConfigurationAgent);
     addSource("BiddingAgent::toRouterChannel", toRouterChannel);
 
+    if (shmRingSize) {
+        shmRequests.onEvent = [=] (const std::pair<std::string, bool> & req)
+            {
+                if (req.second)
+                    attachSharedMemory(req.first);
+                else detachSharedMemory(req.first);
+            };
+
+        shmEvents.init(64);
+        shmEvents.handleEvent = [=] (epoll_event & event)
+            {
+                auto shm = static_cast<ShmRouter *>(event.data.ptr);
+                shm->wakeup.tryRead();
+
+                try {
+                    shm->endpoint.processRecords(
+                            [&] (uint32_t type, ShmMessageReader & reader)
+                            {
+                                handleShmRecord(shm->router, type, reader);
+                            });
+                } catch (const std::exception & exc) {
+                    recordHit("shm.readError");
+                    cerr << "dropping shared memory channel to "
+                         << shm->router << ": " << exc.what() << endl;
+                    detachSharedMemory(shm->router);
+                }
+
+                return Epoller::DONE;
+            };
+
+        addSource("BiddingAgent::shmRequests", shmRequests);
+        addSource("BiddingAgent::shmEvents", shmEvents);
+    }
+
+    if (numWorkers)
+        startWorkers();
+
     // No need to init() message loop; it was done in the constructor
 }
 
@@ -189,10 +272,15 @@ BiddingAgent::
 shutdown()
 {
     MessageLoop::shutdown();
+    stopWorkerThreads();
 
     toConfigurationAgent.shutdown();
     toRouters.shutdown();
+    toRouterShards.shutdown();
     //toPostAuctionService.shutdown();
+
+    std::lock_guard<std::mutex> guard(shmRoutersLock);
+    shmRouters.clear();
 }
 
 void
@@ -212,6 +300,17 @@ handleRouterMessage(const std::string & fromRouter,
         return;
     }
 
+    if (!workers.empty() && dispatchToWorker(fromRouter, message))
+        return;
+
+    processRouterMessage(fromRouter, message);
+}
+
+void
+BiddingAgent::
+processRouterMessage(const std::string & fromRouter,
+                     const std::vector<std::string> & message)
+{
 
     auto newMessage = [&] {
         auto msg(message);
@@ -279,7 +378,7 @@ handleRouterMessage(const std::string & fromRouter,
             auto message_ = message;
             string received = message.at(1);
             message_.erase(message_.begin(), message_.begin() + 2);
-            toRouters.sendMessage(fromRouter, "PONG0", received, Date::now(), message_);
+            sendToRouter(fromRouter, "PONG0", received, Date::now(), message_);
             break;
         } 
         case hash_compile_time("PING1") : {
@@ -397,12 +496,68 @@ handleBidRequest(const std::string & fromRouter,
         bids.push_back(bid);
     }
 
+    dispatchBidRequest(fromRouter, timestamp, id, br, bids, timeLeftMs,
+                       augmentations, wcm, callback);
+}
+
+void
+BiddingAgent::
+handleShmAuction(const std::string & fromRouter,
+                 ShmMessageReader & reader, BidRequestCbFn& callback)
+{
+    ExcCheck(!requiresAllCB || callback, "Null callback for AUCTION");
+    if (!callback) return;
+
+    double timestamp = reader.read<double>();
+    double timeLeftMs = reader.read<double>();
+
+    size_t idLength;
+    const char * idStr = reader.readString(idLength);
+    Id id(idStr, idLength);
+
+    string bidRequestSource = reader.readString();
+    std::shared_ptr<BidRequest> br(
+            BidRequest::parse(bidRequestSource, reader.readString()));
+
+    uint32_t numSpots = reader.read<uint32_t>();
+
+    Bids bids;
+    bids.reserve(numSpots);
+
+    for (size_t i = 0; i < numSpots; ++i) {
+        Bid bid;
+
+        bid.spotIndex = reader.read<int32_t>();
+        uint32_t numCreatives = reader.read<uint32_t>();
+        for (size_t j = 0; j < numCreatives; ++j)
+            bid.availableCreatives.push_back(reader.read<uint16_t>());
+
+        bids.push_back(bid);
+    }
+
+    Json::Value augmentations = jsonParse(reader.readString());
+    WinCostModel wcm = WinCostModel::fromJson(jsonParse(reader.readString()));
+
+    dispatchBidRequest(fromRouter, timestamp, id, br, bids, timeLeftMs,
+                       augmentations, wcm, callback);
+}
+
+void
+BiddingAgent::
+dispatchBidRequest(const std::string & fromRouter,
+                   double timestamp, const Id & id,
+                   std::shared_ptr<BidRequest> br,
+                   const Bids & bids, double timeLeftMs,
+                   const Json::Value & augmentations,
+                   const WinCostModel & wcm,
+                   BidRequestCbFn& callback)
+{
     recordHit("requests");
 
-    ExcCheck(!requests.count(id), "seen multiple requests with same ID");
     {
         lock_guard<mutex> guard (requestsLock);
 
+        ExcCheck(!requests.count(id), "seen multiple requests with same ID");
         requests[id].timestamp = Date::now();
         requests[id].fromRouter = fromRouter;
     }
@@ -410,6 +565,47 @@ handleBidRequest(const std::string & fromRouter,
     callback(timestamp, id, br, bids, timeLeftMs, augmentations, wcm);
 }
 
+void
+BiddingAgent::
+handleShmRecord(const std::string & fromRouter,
+                uint32_t type, ShmMessageReader & reader)
+{
+    try {
+        if (type == SHM_AUCTION && !workers.empty()) {
+            recordHit("AUCTION");
+
+            // The record only lives until we return; the worker gets a copy
+            WorkItem item;
+            item.fromRouter = fromRouter;
+            item.shmAuction.assign(reader.p, reader.end);
+
+            ShmMessageReader peek(item.shmAuction.data(),
+                                  item.shmAuction.size());
+            peek.read<double>();
+            peek.read<double>();
+            size_t idLength;
+            const char * id = peek.readString(idLength);
+
+            pushWork(workerFor(id, idLength), std::move(item));
+        }
+        else if (type == SHM_AUCTION) {
+            recordHit("AUCTION");
+            handleShmAuction(fromRouter, reader, onBidRequest);
+        }
+        else if (type == SHM_MESSAGE) {
+            vector<string> message;
+            ShmEndpoint::decodeMessage(reader, message);
+            handleRouterMessage(fromRouter, message);
+        }
+        else throw ML::Exception("unknown shared memory record type %d", type);
+    }
+    catch (const std::exception& ex) {
+        recordHit("error");
+        cerr << "Error handling shared memory message from " << fromRouter
+             << ": " << ex.what() << endl;
+    }
+}
+
 void
 BiddingAgent::
 handleResult(const std::vector<std::string>& msg, ResultCbFn& callback)
@@ -507,8 +703,17 @@ doBid(Id id, const Bids & bids, const Json::Value & jsonMeta, const WinCostModel
 
     recordLevel((afterSend - beforeSend) * 1000.0, "timeTakenMs");
 
-    toRouterChannel.push(RouterMessage(
-                    fromRouter, "BID", { id.toString(), response, model, meta }));
+    // Bids to a router we share memory with don't need to go through the
+    // message loop
+    bool sent = false;
+    if (shmRingSize) {
+        if (auto shm = findShmRouter(fromRouter))
+            sent = shm->send({ "BID", id.toString(), response, model, meta });
+    }
+
+    if (!sent)
+        toRouterChannel.push(RouterMessage(
+                        fromRouter, "BID", { id.toString(), response, model, meta }));
 
     /** Gather some stats */
     for (const Bid& bid : bids) {
@@ -573,6 +778,280 @@ doConfigJson(Json::Value jsonConfig)
     sendConfig(newConfig);
 }
 
+
+
+/******************************************************************************/
+/* WORKER THREADS                                                             */
+/******************************************************************************/
+
+namespace {
+
+/** Field of the message that holds the id of the auction it's about, or -1
+    for messages that aren't about a given auction.
+*/
+int auctionIdField(const std::string & type)
+{
+    switch (hash(type)) {
+    case hash_compile_time("AUCTION"):
+        return 2;
+
+    case hash_compile_time("WIN"):
+    case hash_compile_time("LOSS"):
+    case hash_compile_time("LATEWIN"):
+    case hash_compile_time("NOBUDGET"):
+    case hash_compile_time("TOOLATE"):
+    case hash_compile_time("INVALID"):
+    case hash_compile_time("DROPPEDBID"):
+    case hash_compile_time("CAMPAIGN_EVENT"):
+        return 3;
+
+    // Old style delivery events; see processRouterMessage()
+    case hash_compile_time("VISIT"):
+    case hash_compile_time("IMPRESSION"):
+    case hash_compile_time("CLICK"):
+        return 2;
+
+    default:
+        return -1;
+    }
+}
+
+} // file scope
+
+void
+BiddingAgent::
+startWorkers()
+{
+    stopWorkers = false;
+
+    for (unsigned i = 0;  i < numWorkers;  ++i)
+        workers.emplace_back(new Worker());
+
+    for (auto & worker: workers) {
+        Worker * w = worker.get();
+        w->thread = std::thread([=] () { this->runWorker(*w); });
+    }
+}
+
+void
+BiddingAgent::
+stopWorkerThreads()
+{
+    if (workers.empty())
+        return;
+
+    stopWorkers = true;
+    for (auto & worker: workers) {
+        // Taking the lock makes sure the worker is either waiting or will
+        // see the flag before it waits
+        std::lock_guard<std::mutex> guard(worker->lock);
+        worker->cond.notify_one();
+    }
+
+    for (auto & worker: workers)
+        worker->thread.join();
+
+    workers.clear();
+}
+
+BiddingAgent::Worker &
+BiddingAgent::
+workerFor(const char * auctionId, size_t length)
+{
+    hash_t h = basis;
+    for (size_t i = 0;  i < length;  ++i) {
+        h ^= (unsigned char)auctionId[i];
+        h *= prime;
+    }
+    return *workers[h % workers.size()];
+}
+
+void
+BiddingAgent::
+pushWork(Worker & worker, WorkItem && item)
+{
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        wasEmpty = worker.queue.empty();
+        worker.queue.push_back(std::move(item));
+    }
+
+    // A worker with a non-empty queue doesn't wait
+    if (wasEmpty)
+        worker.cond.notify_one();
+}
+
+bool
+BiddingAgent::
+dispatchToWorker(const std::string & fromRouter,
+                 const std::vector<std::string> & message)
+{
+    int field = auctionIdField(message[0]);
+    if (field < 0 || message.size() <= size_t(field))
+        return false;
+
+    const std::string & id = message[field];
+
+    WorkItem item;
+    item.fromRouter = fromRouter;
+    item.message = message;
+    pushWork(workerFor(id.data(), id.size()), std::move(item));
+    return true;
+}
+
+void
+BiddingAgent::
+runWorker(Worker & worker)
+{
+    std::deque<WorkItem> batch;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(worker.lock);
+            worker.cond.wait(guard, [&] ()
+                             {
+                                 return stopWorkers || !worker.queue.empty();
+                             });
+            if (stopWorkers)
+                return;
+            batch.swap(worker.queue);
+        }
+
+        for (; !batch.empty();  batch.pop_front()) {
+            WorkItem & item = batch.front();
+
+            try {
+                if (!item.shmAuction.empty()) {
+                    ShmMessageReader reader(item.shmAuction.data(),
+                                            item.shmAuction.size());
+                    handleShmAuction(item.fromRouter, reader, onBidRequest);
+                }
+                else processRouterMessage(item.fromRouter, item.message);
+            }
+            catch (const std::exception& ex) {
+                recordHit("error");
+                cerr << "Error handling auction message " << ex.what()
+                     << endl;
+                for (size_t i = 0; i < item.message.size(); ++i)
+                    cerr << "\t" << i << ": " << item.message[i] << endl;
+                cerr << endl;
+            }
+        }
+    }
+}
+
+
+/******************************************************************************/
+/* SHARED MEMORY                                                              */
+/******************************************************************************/
+
+BiddingAgent::ShmRouter::
+ShmRouter(const std::string & router, int sock,
+          std::shared_ptr<ShmChannel> channel,
+          ML::Wakeup_Fd && wakeup, int routerWakeupFd)
+    : router(router),
+      sock(sock),
+      wakeup(std::move(wakeup)),
+      endpoint(channel, false /* isRouter */, routerWakeupFd)
+{
+}
+
+BiddingAgent::ShmRouter::
+~ShmRouter()
+{
+    ::close(sock);
+}
+
+bool
+BiddingAgent::ShmRouter::
+send(const std::vector<std::string> & message)
+{
+    std::lock_guard<ML::Spinlock> guard(writeLock);
+    return endpoint.sendMessage(message);
+}
+
+void
+BiddingAgent::
+attachSharedMemory(const std::string & router)
+{
+    detachSharedMemory(router);
+
+    int sock = connectShmSocket(router);
+    if (sock == -1)
+        return;  // router doesn't use the shm bidder interface
+
+    try {
+        // Don't hang the message loop on a router that doesn't answer
+        timeval timeout = { 2, 0 };
+        ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        auto channel = ShmChannel::create(shmRingSize);
+        ML::Wakeup_Fd wakeup(EFD_NONBLOCK | EFD_CLOEXEC);
+
+        sendWithFds(sock, agentName, { channel->fd(), wakeup.fd() });
+
+        vector<int> fds;
+        string reply = recvWithFds(sock, fds);
+        if (reply != "OK" || fds.size() != 1) {
+            for (int fd: fds)
+                ::close(fd);
+            throw ML::Exception("router refused the channel: " + reply);
+        }
+
+        auto shm = std::make_shared<ShmRouter>(router, sock, channel,
+                                               std::move(wakeup), fds[0]);
+        sock = -1;
+
+        shmEvents.addFd(shm->wakeup.fd(), shm.get());
+        {
+            std::lock_guard<std::mutex> guard(shmRoutersLock);
+            shmRouters[router] = shm;
+        }
+    } catch (const std::exception & exc) {
+        if (sock != -1)
+            ::close(sock);
+        recordHit("shm.attachError");
+        cerr << "BiddingAgent couldn't share memory with router " << router
+             << ": " << exc.what() << endl;
+        return;
+    }
+
+    recordHit("shm.attached");
+    cerr << "BiddingAgent is using shared memory with router " << router
+         << endl;
+}
+
+void
+BiddingAgent::
+detachSharedMemory(const std::string & router)
+{
+    std::shared_ptr<ShmRouter> shm;
+    {
+        std::lock_guard<std::mutex> guard(shmRoutersLock);
+        auto it = shmRouters.find(router);
+        if (it == shmRouters.end())
+            return;
+        shm = it->second;
+        shmRouters.erase(it);
+    }
+
+    // Bids being written from other threads may still hold on to it
+    shmEvents.removeFd(shm->wakeup.fd());
+    recordHit("shm.detached");
+}
+
+std::shared_ptr<BiddingAgent::ShmRouter>
+BiddingAgent::
+findShmRouter(const std::string & router) const
+{
+    std::lock_guard<std::mutex> guard(shmRoutersLock);
+    auto it = shmRouters.find(router);
+    if (it == shmRouters.end())
+        return nullptr;
+    return it->second;
+}
+
 void
 BiddingAgent::
 sendConfig(const std::string& newConfig)
@@ -14,6 +14,7 @@
 #include "rtbkit/common/bids.h"
 #include "rtbkit/common/auction_events.h"
 #include "rtbkit/common/win_cost_model.h"
+#include "rtbkit/common/messages.h"
 #include "soa/service/zmq.hpp"
 #include "soa/service/carbon_connector.h"
 #include "soa/jsoncpp/json.h"
@@ -21,6 +22,10 @@
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
+#include "soa/service/epoller.h"
+#include "rtbkit/common/shm_channel.h"
+#include "jml/arch/wakeup_fd.h"
+#include "jml/arch/spinlock.h"
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -29,8 +34,13 @@
 #include <boost/make_shared.hpp>
 #include <string>
 #include <vector>
+#include <deque>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <map>
+#include <set>
 
 
 namespace RTBKIT {
@@ -72,6 +82,32 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     */
     void strictMode(bool strict) { requiresAllCB = strict; }
 
+    /** Exchange messages with the routers running on the same host through
+        shared memory instead of zmq, for those that use the "shm" bidder
+        interface.  ringSize is the size of each of the two rings shared
+        with each router.  Must be called before init().
+    */
+    void useSharedMemory(uint32_t ringSize = 4 * 1024 * 1024)
+    {
+        shmRingSize = ringSize;
+    }
+
+    /** Handle bid requests, bid results and delivery events on a pool of
+        numThreads worker threads instead of the message loop, so that the
+        time spent pricing one auction doesn't hold up all of the others.
+        The messages are parsed on the workers too.
+
+        All of the messages about an auction go to the same worker, so they
+        are seen in the order in which they were received; messages about
+        different auctions are seen concurrently, so the callbacks must be
+        thread-safe.  doBid can be called from any thread.  Must be called
+        before init().
+    */
+    void useWorkerThreads(unsigned numThreads)
+    {
+        numWorkers = numThreads;
+    }
+
     void init();
     void shutdown();
 
@@ -264,6 +300,7 @@ private:
     };
 
     ZmqMultipleNamedClientBusProxy toRouters;
+    ZmqMultipleNamedClientBusProxy toRouterShards;
     ZmqMultipleNamedClientBusProxy toPostAuctionServices;
     ZmqNamedClientBusProxy toConfigurationAgent;
     TypedMessageSink<RouterMessage> toRouterChannel;
@@ -287,6 +324,106 @@ private:
     std::mutex configLock;
     std::string config; // The agent's configuration.
 
+    /** Names of the router shards we're connected to.  A bid request needs
+        to be answered on the connection it arrived from, which is either
+        toRouters or toRouterShards.
+    */
+    std::set<std::string> routerShards;
+    mutable std::mutex routerShardsLock;
+
+    bool isRouterShard(const std::string & router) const
+    {
+        std::lock_guard<std::mutex> guard(routerShardsLock);
+        return routerShards.count(router);
+    }
+
+    /** Send a message to the given router or router shard. */
+    template<typename... Args>
+    void sendToRouter(const std::string & router,
+                      const std::string & type,
+                      Args&&... args)
+    {
+        if (shmRingSize) {
+            if (auto shm = findShmRouter(router)) {
+                std::vector<std::string> message(1, type);
+                appendMessageFields(message, args...);
+                if (shm->send(message))
+                    return;
+            }
+        }
+
+        if (isRouterShard(router))
+            toRouterShards.sendMessage(router, type,
+                                       std::forward<Args>(args)...);
+        else toRouters.sendMessage(router, type, std::forward<Args>(args)...);
+    }
+
+    /** Shared memory channel to a router on the same host.  Reads happen
+        on the message loop; writes can come from any thread and are
+        serialized by writeLock.
+    */
+    struct ShmRouter {
+        ShmRouter(const std::string & router, int sock,
+                  std::shared_ptr<ShmChannel> channel,
+                  ML::Wakeup_Fd && wakeup, int routerWakeupFd);
+        ~ShmRouter();
+
+        bool send(const std::vector<std::string> & message);
+
+        std::string router;
+        int sock;   ///< Kept open so that the router knows when we go away
+        ML::Wakeup_Fd wakeup;
+        ShmEndpoint endpoint;
+        ML::Spinlock writeLock;
+    };
+
+    uint32_t shmRingSize;  ///< 0 if shared memory isn't used
+    Datacratic::Epoller shmEvents;
+    std::map<std::string, std::shared_ptr<ShmRouter> > shmRouters;
+    mutable std::mutex shmRoutersLock;
+
+    /** Routers to attach to (true) or detach from (false), handled on the
+        message loop since connection handlers run on other threads. */
+    TypedMessageSink<std::pair<std::string, bool> > shmRequests;
+
+    /** Message waiting to be handled by a worker thread.  Auctions that
+        came through shared memory are kept as the raw record.
+    */
+    struct WorkItem {
+        std::string fromRouter;
+        std::vector<std::string> message;
+        std::string shmAuction;
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::condition_variable cond;
+        std::deque<WorkItem> queue;
+        std::thread thread;
+    };
+
+    unsigned numWorkers;  ///< 0 if everything is handled on the loop
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::atomic<bool> stopWorkers;
+
+    void startWorkers();
+    void stopWorkerThreads();
+    void runWorker(Worker & worker);
+    Worker & workerFor(const char * auctionId, size_t length);
+    void pushWork(Worker & worker, WorkItem && item);
+
+    /** Hand the message over to a worker if it's about an auction.
+        Returns false if it needs to be handled on the message loop.
+    */
+    bool dispatchToWorker(const std::string & fromRouter,
+                          const std::vector<std::string> & message);
+
+    void attachSharedMemory(const std::string & router);
+    void detachSharedMemory(const std::string & router);
+    std::shared_ptr<ShmRouter> findShmRouter(const std::string & router) const;
+    void handleShmRecord(const std::string & fromRouter,
+                         uint32_t type, ShmMessageReader & reader);
+
     void sendConfig(const std::string& newConfig = "");
 
     void checkMessageSize(const std::vector<std::string>& msg, int expectedSize);
@@ -295,9 +432,18 @@ private:
 
     void handleRouterMessage(const std::string & fromRouter,
                              const std::vector<std::string>& msg);
+    void processRouterMessage(const std::string & fromRouter,
+                              const std::vector<std::string>& msg);
     void handleError(const std::vector<std::string>& msg, ErrorCbFn& callback);
     void handleBidRequest(const std::string & fromRouter,
             const std::vector<std::string>& msg, BidRequestCbFn& callback);
+    void handleShmAuction(const std::string & fromRouter,
+            ShmMessageReader & reader, BidRequestCbFn& callback);
+    void dispatchBidRequest(const std::string & fromRouter,
+            double timestamp, const Id & id, std::shared_ptr<BidRequest> br,
+            const Bids & bids, double timeLeftMs,
+            const Json::Value & augmentations, const WinCostModel & wcm,
+            BidRequestCbFn& callback);
     void handleWin(
             const std::vector<std::string>& msg, ResultCbFn& callback);
     void handleResult(
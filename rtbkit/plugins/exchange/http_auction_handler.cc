@@ -319,8 +319,12 @@ handleHttpPayload(const HttpHeader & header,
     }
     
     double acceptProbability = endpoint->acceptAuctionProbability;
+    auto admissionController = endpoint->admissionController;
 
-    if (acceptProbability < 1.0
+    // Without an admission controller, we drop at random before spending
+    // anything on the request
+    if (!admissionController
+        && acceptProbability < 1.0
         && random() % 1000000 > 1000000 * acceptProbability) {
         // early drop...
         doEvent("auctionEarlyDrop.randomEarlyDrop");
@@ -394,6 +398,13 @@ handleHttpPayload(const HttpHeader & header,
             return;
         }
 
+        if (admissionController
+            && !admissionController->admit(*bidRequest, acceptProbability)) {
+            doEvent("auctionEarlyDrop.admission");
+            dropAuction("not admitted");
+            return;
+        }
+
         auction.reset(new Auction(endpoint,
                                   handleAuction, bidRequest,
                                   bidRequest->toJsonStr(),
@@ -501,6 +512,8 @@ sendResponse()
     cancelTimer();
 
     endpoint->onAuctionDone(auction);
+    if (endpoint->admissionController)
+        endpoint->admissionController->auctionDone(*auction);
 
     //cerr << "sendResponse " << this << ": disconnected "
     //     << disconnected << endl;
@@ -0,0 +1,214 @@
+/* agent_config_diff_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cost of propagating a change to the configuration of 2000 agents with 50
+   creatives each, where each agent changes its targeting and two of its
+   creatives: sending the whole configuration and parsing it again, against
+   sending a diff and applying it.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/core/agent_configuration/agent_config_diff.h"
+#include "rtbkit/core/router/router_types.h"
+#include "rtbkit/core/router/filter_pool.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+namespace {
+
+enum {
+    NumAgents = 2000,
+    NumCreatives = 50,
+    NumChangedCreatives = 2
+};
+
+Json::Value makeCreative(int agent, int index, int version)
+{
+    Json::Value result;
+    result["format"] = index % 2 ? "300x250" : "728x90";
+    result["name"] = ML::format("creative-%d-%d-v%d", agent, index, version);
+    result["id"] = index;
+    result["languageFilter"]["include"].append("en");
+    result["languageFilter"]["include"].append("fr");
+    result["locationFilter"]["include"].append("CA:.*");
+    result["locationFilter"]["include"].append("US:NY:.*");
+    result["exchangeFilter"]["include"].append("openrtb");
+
+    Json::Value & openrtb = result["providerConfig"]["openrtb"];
+    openrtb["adomain"].append("example.com");
+    openrtb["adm"] = ML::format("<a href=\"http://example.com/click/%d/%d\">"
+                                "<img src=\"http://example.com/%d/%d.png\"/>"
+                                "</a>", agent, index, agent, version);
+    return result;
+}
+
+/** Configuration of the given agent.  Going from one version to the next
+    changes its targeting and the first NumChangedCreatives creatives.
+*/
+Json::Value makeAgent(int agent, int version)
+{
+    Json::Value result;
+    result["account"].append(ML::format("campaign%d", agent));
+    result["account"].append("strategy");
+    result["bidProbability"] = 0.5;
+    result["maxInFlight"] = 100;
+    result["hostFilter"]["include"].append(ML::format("site%d.com", version));
+    result["hostFilter"]["exclude"].append("example.org");
+    result["languageFilter"]["include"].append("en");
+
+    for (int i = 0;  i < NumCreatives;  ++i)
+        result["creatives"][i]
+            = makeCreative(agent, i, i < NumChangedCreatives ? version : 0);
+
+    return result;
+}
+
+std::string agentName(int agent)
+{
+    return ML::format("agent%d", agent);
+}
+
+struct Result {
+    Result()
+        : bytes(0), encode(0), decode(0), filters(0)
+    {
+    }
+
+    size_t bytes;    ///< Sent to each listener
+    double encode;   ///< Configuration service, once for all listeners
+    double decode;   ///< Each listener: getting to the new AgentConfig
+    double filters;  ///< Router: updating the filter pool
+
+    double total() const { return encode + decode + filters; }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_agent_config_diff )
+{
+    vector<Json::Value> oldJson, newJson;
+    vector<std::shared_ptr<AgentConfig> > oldConfigs;
+    for (int i = 0;  i < NumAgents;  ++i) {
+        oldJson.push_back(makeAgent(i, 1));
+        newJson.push_back(makeAgent(i, 2));
+        oldConfigs.push_back(std::make_shared<AgentConfig>(
+                                     AgentConfig::createFromJson(oldJson[i])));
+    }
+
+    // Both routers start out with the old configurations
+    auto makePool = [&] (FilterPool & pool, vector<AgentInfo> & infos)
+        {
+            pool.initWithDefaultFilters();
+            infos.resize(NumAgents);
+            FilterPool::ConfigBatch batch;
+            for (int i = 0;  i < NumAgents;  ++i) {
+                infos[i].config = oldConfigs[i];
+                batch.emplace_back(agentName(i), &infos[i]);
+            }
+            pool.addConfigs(batch);
+        };
+
+    FilterPool fullPool, diffPool;
+    vector<AgentInfo> fullInfos, diffInfos;
+    makePool(fullPool, fullInfos);
+    makePool(diffPool, diffInfos);
+
+    // Whole configurations, one filter pool update per agent
+    Result full;
+    {
+        Timer timer;
+        vector<string> messages;
+        for (int i = 0;  i < NumAgents;  ++i) {
+            messages.push_back(newJson[i].toString());
+            full.bytes += messages.back().size();
+        }
+        full.encode = timer.elapsed_wall();
+
+        timer.restart();
+        for (int i = 0;  i < NumAgents;  ++i) {
+            Json::Value json = Json::parse(messages[i]);
+            fullInfos[i].config = std::make_shared<AgentConfig>(
+                    AgentConfig::createFromJson(json));
+        }
+        full.decode = timer.elapsed_wall();
+
+        timer.restart();
+        for (int i = 0;  i < NumAgents;  ++i)
+            fullPool.addConfig(agentName(i), fullInfos[i]);
+        full.filters = timer.elapsed_wall();
+    }
+
+    // Diffs, one filter pool update for the batch
+    Result diff;
+    {
+        vector<Json::Value> listenerJson = oldJson;
+
+        Timer timer;
+        vector<string> messages;
+        for (int i = 0;  i < NumAgents;  ++i) {
+            auto d = AgentConfigDiff::compute(oldJson[i], newJson[i], 1, 2);
+            messages.push_back(d.serializeToString());
+            diff.bytes += messages.back().size();
+        }
+        diff.encode = timer.elapsed_wall();
+
+        timer.restart();
+        for (int i = 0;  i < NumAgents;  ++i) {
+            auto d = AgentConfigDiff::createFromString(messages[i]);
+            diffInfos[i].config = d.apply(listenerJson[i], *oldConfigs[i]);
+        }
+        diff.decode = timer.elapsed_wall();
+
+        timer.restart();
+        FilterPool::ConfigBatch batch;
+        for (int i = 0;  i < NumAgents;  ++i)
+            batch.emplace_back(agentName(i), &diffInfos[i]);
+        diffPool.addConfigs(batch);
+        diff.filters = timer.elapsed_wall();
+
+        for (int i = 0;  i < NumAgents;  ++i)
+            BOOST_REQUIRE_EQUAL(listenerJson[i], newJson[i]);
+    }
+
+    // Both end up with the same configurations
+    for (int i = 0;  i < NumAgents;  ++i)
+        BOOST_REQUIRE_EQUAL(diffInfos[i].config->toJson(),
+                            fullInfos[i].config->toJson());
+
+    cerr << ML::format("%d agents with %d creatives, %d creatives changed",
+                       NumAgents, NumCreatives, NumChangedCreatives)
+         << endl;
+    cerr << ML::format("%-6s %12s %10s %10s %10s %10s",
+                       "", "bytes", "encode", "decode", "filters", "total")
+         << endl;
+
+    auto report = [] (const char * name, const Result & result)
+        {
+            cerr << ML::format("%-6s %12zd %9.1fms %9.1fms %9.1fms %9.1fms",
+                               name, result.bytes, result.encode * 1000,
+                               result.decode * 1000, result.filters * 1000,
+                               result.total() * 1000)
+                 << endl;
+        };
+
+    report("full", full);
+    report("diff", diff);
+
+    cerr << ML::format("diffs are %.1fx smaller and %.1fx faster to "
+                       "propagate",
+                       (double)full.bytes / diff.bytes,
+                       full.total() / diff.total())
+         << endl;
+
+    BOOST_CHECK_LT(diff.bytes, full.bytes);
+    BOOST_CHECK_LT(diff.total(), full.total());
+}
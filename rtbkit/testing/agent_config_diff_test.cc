@@ -0,0 +1,98 @@
+/* agent_config_diff_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the diffs between versions of an agent configuration.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/core/agent_configuration/agent_config_diff.h"
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+namespace {
+
+Json::Value makeConfig()
+{
+    AgentConfig config;
+    config.account = { "campaign", "strategy" };
+    config.bidProbability = 0.5;
+    config.creatives.push_back(Creative::sampleLB);
+    config.creatives.push_back(Creative::sampleWS);
+    config.creatives.push_back(Creative::sampleBB);
+    config.creatives[1].languageFilter.include.push_back("en");
+    return config.toJson();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_no_change )
+{
+    Json::Value config = makeConfig();
+    auto diff = AgentConfigDiff::compute(config, config, 1, 2);
+    BOOST_CHECK(diff.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_diff_round_trip )
+{
+    Json::Value from = makeConfig();
+    Json::Value to = from;
+    to["bidProbability"] = 0.25;
+    to["creatives"][1]["languageFilter"]["include"][0] = "fr";
+    to["creatives"][3] = Creative(468, 60, "Banner", 3).toJson();
+    to.removeMember("test");
+
+    auto diff = AgentConfigDiff::compute(from, to, 4, 5);
+
+    // Only what changed is in there
+    BOOST_REQUIRE_EQUAL(diff.fields.size(), 1);
+    BOOST_CHECK_EQUAL(diff.fields[0].first, "bidProbability");
+    BOOST_CHECK(diff.removedFields == vector<string>({ "test" }));
+    BOOST_CHECK_EQUAL(diff.numCreatives, 4);
+    BOOST_CHECK(diff.changedCreatives() == vector<unsigned>({ 1, 3 }));
+
+    auto diff2 = AgentConfigDiff::createFromString(diff.serializeToString());
+    BOOST_CHECK_EQUAL(diff2.baseVersion, 4);
+    BOOST_CHECK_EQUAL(diff2.version, 5);
+
+    Json::Value json = from;
+    AgentConfig config = AgentConfig::createFromJson(from);
+    auto newConfig = diff2.apply(json, config);
+
+    BOOST_CHECK_EQUAL(json, to);
+    BOOST_CHECK_EQUAL(newConfig->toJson(),
+                      AgentConfig::createFromJson(to).toJson());
+    BOOST_CHECK_EQUAL(newConfig->creatives[1].languageFilter.include[0], "fr");
+
+    // And back, with fewer creatives
+    diff = AgentConfigDiff::compute(to, from, 5, 6);
+    BOOST_CHECK_EQUAL(diff.numCreatives, 3);
+    BOOST_CHECK(diff.changedCreatives() == vector<unsigned>({ 1 }));
+
+    newConfig = diff.apply(json, *newConfig);
+    BOOST_CHECK_EQUAL(json, from);
+    BOOST_CHECK_EQUAL(newConfig->toJson(), config.toJson());
+}
+
+BOOST_AUTO_TEST_CASE( test_creatives_replaced )
+{
+    Json::Value from = makeConfig();
+    Json::Value to = from;
+    to["creatives"] = Creative::sampleBB.toJson();
+
+    // Not an array any more: sent as a whole
+    auto diff = AgentConfigDiff::compute(from, to, 1, 2);
+    BOOST_CHECK_EQUAL(diff.numCreatives, -1);
+    BOOST_REQUIRE_EQUAL(diff.fields.size(), 1);
+    BOOST_CHECK_EQUAL(diff.fields[0].first, "creatives");
+
+    Json::Value json = from;
+    diff.apply(json);
+    BOOST_CHECK_EQUAL(json, to);
+}
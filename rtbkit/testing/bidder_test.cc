@@ -266,7 +266,7 @@ BOOST_AUTO_TEST_CASE( multi_bidder_test )
         });
 
         auto bidder = std::static_pointer_cast<MultiBidderInterface>(
-                upstreamStack.services.router->bidder);
+                upstreamStack.services.router->shards[0]->bidder);
 
         std::cerr << std::endl;
         bidder->stats().dump(std::cerr);
@@ -0,0 +1,538 @@
+/* block_output.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Log output that batches records into large blocks and compresses the
+   blocks in parallel.
+*/
+
+#include "block_output.h"
+#include "compressor.h"
+#include "jml/utils/lz4_filter.h"
+#include "jml/arch/exception.h"
+#include <zlib.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <chrono>
+#include <iostream>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* BLOCK COMPRESSING OUTPUT                                                  */
+/*****************************************************************************/
+
+struct BlockCompressingOutput::Block {
+    Block(size_t capacity)
+        : data(new char[capacity]), size(0), outSize(0), number(0)
+    {
+    }
+
+    std::unique_ptr<char[]> data;
+    size_t size;
+
+    /// Compressed version, ready to be written to the file
+    std::vector<char> out;
+    size_t outSize;
+
+    uint64_t number;
+    std::chrono::steady_clock::time_point started;
+};
+
+namespace {
+
+bool ends_with(const std::string & str, const std::string & what)
+{
+    string::size_type result = str.rfind(what);
+    return result != string::npos
+        && result == str.size() - what.size();
+}
+
+int lz4BlockId(size_t blockSize)
+{
+    switch (blockSize) {
+    case 64 * 1024:        return 4;
+    case 256 * 1024:       return 5;
+    case 1024 * 1024:      return 6;
+    case 4 * 1024 * 1024:  return 7;
+    default:
+        throw ML::Exception("block size %zd is not an lz4 block size",
+                            blockSize);
+    }
+}
+
+} // file scope
+
+BlockCompressingOutput::
+BlockCompressingOutput(int numCompressionThreads,
+                       size_t blockSize,
+                       int maxBlocksInFlight)
+    : maxBlockAge(1.0),
+      numCompressionThreads(numCompressionThreads),
+      blockSize(blockSize),
+      maxBlocksInFlight(maxBlocksInFlight),
+      level(-1), fd(-1),
+      shutdown_(false),
+      blocksInFlight(0), nextBlockNumber(0), nextBlockToWrite(0),
+      writing(false),
+      bytesIn(0), bytesOut(0), blocksWritten(0), numWrites(0), numStalls(0),
+      numStored(0)
+{
+    if (numCompressionThreads < 1)
+        throw ML::Exception("need at least one compression thread");
+    if (maxBlocksInFlight < 1)
+        throw ML::Exception("need at least one block in flight");
+    lz4BlockId(blockSize);
+}
+
+BlockCompressingOutput::
+~BlockCompressingOutput()
+{
+    close();
+}
+
+std::string
+BlockCompressingOutput::
+filenameToCompression(const std::string & filename)
+{
+    if (ends_with(filename, ".lz4") || ends_with(filename, ".lz4~"))
+        return "lz4";
+    return Compressor::filenameToCompression(filename);
+}
+
+void
+BlockCompressingOutput::
+open(const std::string & filename,
+     const std::string & compression,
+     int level)
+{
+    close();
+
+    string fn = filename;
+    bool append = false;
+    if (!fn.empty() && fn[fn.length() - 1] == '+') {
+        fn = string(fn, 0, fn.length() - 1);
+        append = true;
+    }
+
+    this->compression = compression;
+    if (this->compression == "")
+        this->compression = filenameToCompression(fn);
+    if (this->compression == "gz")
+        this->compression = "gzip";
+    if (this->compression != "lz4" && this->compression != "gzip"
+        && this->compression != "none")
+        throw ML::Exception("block output doesn't support compression "
+                            + this->compression);
+    this->level = level;
+
+    int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+    fd = ::open(fn.c_str(), flags, 0664);
+    if (fd == -1)
+        throw ML::Exception(errno, "couldn't open log file " + fn, "open");
+
+    if (this->compression == "lz4") {
+        lz4::Header head(lz4BlockId(blockSize), true /* independent */,
+                         true /* block checksum */, false);
+        writeAll((const char *)&head, sizeof(head));
+    }
+
+    shutdown_ = false;
+    for (int i = 0;  i < numCompressionThreads;  ++i)
+        threads.emplace_back([=] () { this->runCompressionThread(); });
+}
+
+void
+BlockCompressingOutput::
+close()
+{
+    if (fd == -1)
+        return;
+
+    flush();
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        shutdown_ = true;
+        blockAvailable.notify_all();
+    }
+
+    for (auto & t: threads)
+        t.join();
+    threads.clear();
+
+    if (compression == "lz4") {
+        const uint32_t eos = 0;
+        writeAll((const char *)&eos, sizeof(eos));
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+void
+BlockCompressingOutput::
+logMessage(const std::string & channel,
+           const std::string & message)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (fd == -1)
+        throw ML::Exception("logMessage on closed block output");
+
+    // Apply backpressure once the compression can't keep up.  This needs
+    // to happen before we start appending, as waiting releases the lock
+    // and another thread's record could end up in the middle of ours.
+    if (blocksInFlight >= maxBlocksInFlight) {
+        ++numStalls;
+        while (blocksInFlight >= maxBlocksInFlight)
+            blockFinished.wait(guard);
+    }
+
+    append(channel.c_str(), channel.size(), guard);
+    append("\t", 1, guard);
+    append(message.c_str(), message.size(), guard);
+    append("\n", 1, guard);
+
+    bytesIn += channel.size() + message.size() + 2;
+}
+
+void
+BlockCompressingOutput::
+flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (current && current->size > 0)
+        submitCurrent(guard);
+
+    while (blocksInFlight > 0)
+        blockFinished.wait(guard);
+}
+
+Json::Value
+BlockCompressingOutput::
+stats() const
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    Json::Value result;
+    result["bytesIn"] = (Json::UInt)bytesIn;
+    result["bytesOut"] = (Json::UInt)bytesOut;
+    result["blocksWritten"] = (Json::UInt)blocksWritten;
+    result["writes"] = (Json::UInt)numWrites;
+    result["stalls"] = (Json::UInt)numStalls;
+    result["blocksStored"] = (Json::UInt)numStored;
+    result["blocksInFlight"] = blocksInFlight;
+    return result;
+}
+
+void
+BlockCompressingOutput::
+clearStats()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    bytesIn = bytesOut = blocksWritten = numWrites = numStalls = 0;
+    numStored = 0;
+}
+
+std::unique_ptr<BlockCompressingOutput::Block>
+BlockCompressingOutput::
+getBlock()
+{
+    std::unique_ptr<Block> result;
+    if (!freeBlocks.empty()) {
+        result = std::move(freeBlocks.back());
+        freeBlocks.pop_back();
+    }
+    else result.reset(new Block(blockSize));
+
+    result->size = 0;
+    result->outSize = 0;
+    result->started = std::chrono::steady_clock::now();
+    return result;
+}
+
+void
+BlockCompressingOutput::
+append(const char * data, size_t size,
+       std::unique_lock<std::mutex> & guard)
+{
+    while (size > 0) {
+        if (!current)
+            current = getBlock();
+
+        size_t toCopy = std::min(size, blockSize - current->size);
+        memcpy(current->data.get() + current->size, data, toCopy);
+        current->size += toCopy;
+        data += toCopy;
+        size -= toCopy;
+
+        if (current->size == blockSize)
+            submitCurrent(guard);
+    }
+}
+
+void
+BlockCompressingOutput::
+submitCurrent(std::unique_lock<std::mutex> & guard)
+{
+    current->number = nextBlockNumber++;
+    ++blocksInFlight;
+    toCompress.emplace_back(std::move(current));
+    blockAvailable.notify_one();
+}
+
+void
+BlockCompressingOutput::
+runCompressionThread()
+{
+    auto maxAge = std::chrono::microseconds(int64_t(maxBlockAge * 1000000));
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (!shutdown_) {
+        if (toCompress.empty()) {
+            blockAvailable.wait_for(guard, maxAge);
+
+            // Don't let a quiet channel sit in memory forever
+            if (toCompress.empty() && current && current->size > 0
+                && std::chrono::steady_clock::now() - current->started
+                   >= maxAge)
+                submitCurrent(guard);
+            continue;
+        }
+
+        std::unique_ptr<Block> block = std::move(toCompress.front());
+        toCompress.pop_front();
+
+        guard.unlock();
+        bool stored = false;
+        try {
+            compressBlock(*block);
+        } catch (const std::exception & exc) {
+            cerr << "warning: block output couldn't compress block "
+                 << block->number << "; writing it uncompressed: "
+                 << exc.what() << endl;
+            storeBlock(*block);
+            stored = true;
+        }
+        guard.lock();
+
+        numStored += stored;
+
+        uint64_t number = block->number;
+        toWrite[number] = std::move(block);
+        writeCompleted(guard);
+    }
+}
+
+void
+BlockCompressingOutput::
+compressBlock(Block & block)
+{
+    if (compression == "lz4") {
+        // One block of an lz4 frame: size, data and checksum
+        size_t bound = LZ4_compressBound(block.size);
+        block.out.resize(bound + 2 * sizeof(uint32_t));
+        char * dest = &block.out[sizeof(uint32_t)];
+
+        int compressedSize
+            = level < 3
+            ? LZ4_compress(block.data.get(), dest, block.size)
+            : LZ4_compressHC(block.data.get(), dest, block.size);
+
+        uint32_t head = compressedSize;
+        if (compressedSize <= 0 || compressedSize >= block.size) {
+            memcpy(dest, block.data.get(), block.size);
+            compressedSize = block.size;
+            head = compressedSize | lz4::NotCompressedMask;
+        }
+
+        uint32_t checksum = XXH32(dest, compressedSize, lz4::ChecksumSeed);
+        memcpy(&block.out[0], &head, sizeof(head));
+        memcpy(dest + compressedSize, &checksum, sizeof(checksum));
+        block.outSize = compressedSize + 2 * sizeof(uint32_t);
+    }
+    else if (compression == "gzip") {
+        // Each block is a full gzip member; concatenated members are a
+        // valid gzip stream
+        block.outSize = 0;
+        auto onData = [&] (const char * data, size_t len) -> size_t
+            {
+                if (block.out.size() < block.outSize + len)
+                    block.out.resize(std::max(block.out.size() * 2,
+                                              block.outSize + len));
+                memcpy(&block.out[block.outSize], data, len);
+                block.outSize += len;
+                return len;
+            };
+
+        std::unique_ptr<Compressor> compressor
+            (Compressor::create(compression, level));
+        compressor->compress(block.data.get(), block.size, onData);
+        compressor->finish(onData);
+    }
+    else {
+        block.out.resize(block.size);
+        memcpy(&block.out[0], block.data.get(), block.size);
+        block.outSize = block.size;
+    }
+}
+
+void
+BlockCompressingOutput::
+storeBlock(Block & block)
+{
+    if (compression == "lz4") {
+        // An lz4 frame block with the not compressed flag set
+        block.out.resize(block.size + 2 * sizeof(uint32_t));
+        char * dest = &block.out[sizeof(uint32_t)];
+        memcpy(dest, block.data.get(), block.size);
+
+        uint32_t head = block.size | lz4::NotCompressedMask;
+        uint32_t checksum = XXH32(dest, block.size, lz4::ChecksumSeed);
+        memcpy(&block.out[0], &head, sizeof(head));
+        memcpy(dest + block.size, &checksum, sizeof(checksum));
+        block.outSize = block.size + 2 * sizeof(uint32_t);
+    }
+    else if (compression == "gzip") {
+        // A gzip member made of stored deflate blocks of at most 64k each
+        static const unsigned char header[10] = {
+            0x1f, 0x8b, 8 /* deflate */, 0, 0, 0, 0, 0, 0, 0xff
+        };
+        size_t numStoredBlocks
+            = std::max<size_t>(1, (block.size + 65534) / 65535);
+        block.out.resize(sizeof(header) + numStoredBlocks * 5
+                         + block.size + 8);
+
+        char * p = &block.out[0];
+        auto write32 = [&] (uint32_t val)
+            {
+                for (unsigned i = 0;  i < 4;  ++i, val >>= 8)
+                    *p++ = val & 0xff;
+            };
+
+        p = std::copy(header, header + sizeof(header), p);
+        size_t done = 0;
+        for (size_t i = 0;  i < numStoredBlocks;  ++i) {
+            uint16_t len = std::min<size_t>(65535, block.size - done);
+            *p++ = i == numStoredBlocks - 1;  // final block, stored
+            *p++ = len & 0xff;
+            *p++ = len >> 8;
+            *p++ = ~len & 0xff;
+            *p++ = (uint16_t)~len >> 8;
+            memcpy(p, block.data.get() + done, len);
+            p += len;
+            done += len;
+        }
+
+        write32(crc32(crc32(0, Z_NULL, 0),
+                      (const Bytef *)block.data.get(), block.size));
+        write32(block.size);
+        block.outSize = p - &block.out[0];
+    }
+    else {
+        block.out.resize(block.size);
+        memcpy(&block.out[0], block.data.get(), block.size);
+        block.outSize = block.size;
+    }
+}
+
+void
+BlockCompressingOutput::
+writeCompleted(std::unique_lock<std::mutex> & guard)
+{
+    // Only one thread writes at a time; the others just leave their
+    // blocks for it to pick up
+    if (writing)
+        return;
+    writing = true;
+
+    while (!toWrite.empty() && toWrite.begin()->first == nextBlockToWrite) {
+        std::vector<std::unique_ptr<Block> > batch;
+        for (auto it = toWrite.begin();
+             it != toWrite.end() && it->first == nextBlockToWrite
+                 && batch.size() < IOV_MAX;
+             it = toWrite.erase(it), ++nextBlockToWrite)
+            batch.emplace_back(std::move(it->second));
+
+        guard.unlock();
+
+        iovec iov[batch.size()];
+        size_t numIov = 0, total = 0;
+        for (auto & b: batch) {
+            if (b->outSize == 0) continue;
+            iov[numIov].iov_base = &b->out[0];
+            iov[numIov].iov_len = b->outSize;
+            total += b->outSize;
+            ++numIov;
+        }
+
+        size_t writes = 0;
+        try {
+            iovec * toDo = iov;
+            while (numIov > 0) {
+                ssize_t res = ::writev(fd, toDo, numIov);
+                if (res == -1 && errno == EINTR)
+                    continue;
+                if (res == -1)
+                    throw ML::Exception(errno, "writev");
+                ++writes;
+
+                // Skip over what was written
+                while (numIov > 0 && res >= (ssize_t)toDo->iov_len) {
+                    res -= toDo->iov_len;
+                    ++toDo;
+                    --numIov;
+                }
+                if (numIov > 0) {
+                    toDo->iov_base = (char *)toDo->iov_base + res;
+                    toDo->iov_len -= res;
+                }
+            }
+
+            if (onFileWrite)
+                onFileWrite(total);
+        } catch (const std::exception & exc) {
+            cerr << "warning: block output lost " << batch.size()
+                 << " blocks: " << exc.what() << endl;
+        }
+
+        guard.lock();
+
+        bytesOut += total;
+        blocksWritten += batch.size();
+        numWrites += writes;
+        blocksInFlight -= batch.size();
+        for (auto & b: batch)
+            freeBlocks.emplace_back(std::move(b));
+
+        blockFinished.notify_all();
+    }
+
+    writing = false;
+}
+
+void
+BlockCompressingOutput::
+writeAll(const char * data, size_t size)
+{
+    while (size > 0) {
+        ssize_t res = ::write(fd, data, size);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw ML::Exception(errno, "write");
+        data += res;
+        size -= res;
+    }
+}
+
+} // namespace Datacratic
@@ -0,0 +1,148 @@
+/* block_output.h                                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Log output that batches records into large blocks and compresses the
+   blocks in parallel.
+*/
+
+#ifndef __logger__block_output_h__
+#define __logger__block_output_h__
+
+#include "logger.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <map>
+#include <atomic>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* BLOCK COMPRESSING OUTPUT                                                  */
+/*****************************************************************************/
+
+/** LogOutput that appends records into large preallocated blocks.  Full
+    blocks are compressed independently on a small pool of threads and
+    then written to the file, in order, with a single writev() per batch
+    of completed blocks.
+
+    Because each block is compressed on its own, the compression keeps up
+    with the number of threads in the pool rather than with one core.  The
+    price is a slightly worse ratio than a single stream.
+
+    Supported compressions:
+    - "lz4": a standard lz4 frame with independent blocks, readable with
+      filter_istream.  Levels below 3 use the fast compressor, and 3 and
+      above the high compression one;
+    - "gzip": each block is a complete gzip member, which gunzip and
+      filter_istream read as one stream;
+    - "none": blocks are written as-is.
+
+    The block size must be one of the lz4 frame block sizes (64k, 256k,
+    1M or 4M).
+
+    logMessage() can be called from any thread; it only blocks when
+    maxBlocksInFlight blocks are waiting to be compressed or written.
+*/
+
+struct BlockCompressingOutput : public LogOutput {
+
+    BlockCompressingOutput(int numCompressionThreads = 4,
+                           size_t blockSize = 4 * 1024 * 1024,
+                           int maxBlocksInFlight = 16);
+
+    virtual ~BlockCompressingOutput();
+
+    /** Open the given file.  If compression is empty then it's deduced
+        from the extension.  As with FileOutput, a filename that ends in
+        a "+" is appended to.
+    */
+    void open(const std::string & filename,
+              const std::string & compression = "",
+              int level = -1);
+
+    virtual void logMessage(const std::string & channel,
+                            const std::string & message);
+
+    /** Send the partially filled block off for compression, and wait
+        until everything logged so far has made it to the OS.
+    */
+    void flush();
+
+    virtual void close();
+
+    virtual Json::Value stats() const;
+
+    virtual void clearStats();
+
+    /** Maximum time that a partially filled block will wait before it's
+        compressed and written anyway.
+    */
+    double maxBlockAge;
+
+    /** Called with the number of bytes written each time a batch of
+        blocks is written to the file.
+    */
+    std::function<void (size_t)> onFileWrite;
+
+    /** Compression name for the given filename; "lz4" is recognised on
+        top of those known by Compressor.
+    */
+    static std::string filenameToCompression(const std::string & filename);
+
+private:
+    struct Block;
+
+    int numCompressionThreads;
+    size_t blockSize;
+    int maxBlocksInFlight;
+
+    std::string compression;
+    int level;
+    int fd;
+
+    /// Protects everything below
+    mutable std::mutex lock;
+    std::condition_variable blockAvailable;   ///< compression threads
+    std::condition_variable blockFinished;    ///< log and flush callers
+
+    std::vector<std::thread> threads;
+    bool shutdown_;
+
+    std::unique_ptr<Block> current;           ///< block being appended to
+    std::vector<std::unique_ptr<Block> > freeBlocks;
+    std::deque<std::unique_ptr<Block> > toCompress;
+    std::map<uint64_t, std::unique_ptr<Block> > toWrite;
+    int blocksInFlight;
+    uint64_t nextBlockNumber;     ///< number of the next block submitted
+    uint64_t nextBlockToWrite;    ///< number of the next block for the file
+    bool writing;                 ///< a thread is currently writing
+
+    // Stats
+    uint64_t bytesIn, bytesOut, blocksWritten, numWrites, numStalls;
+    uint64_t numStored;           ///< blocks written uncompressed
+
+    void runCompressionThread();
+    void submitCurrent(std::unique_lock<std::mutex> & guard);
+    void compressBlock(Block & block);
+
+    /** Fallback for when compressBlock() fails: frame the block
+        uncompressed in a way that still reads back as part of the
+        compressed stream, so that no log data is lost.
+    */
+    void storeBlock(Block & block);
+    void writeCompleted(std::unique_lock<std::mutex> & guard);
+    void writeAll(const char * data, size_t size);
+    std::unique_ptr<Block> getBlock();
+    void append(const char * data, size_t size,
+                std::unique_lock<std::mutex> & guard);
+};
+
+
+} // namespace Datacratic
+
+
+#endif /* __logger__block_output_h__ */
@@ -42,15 +42,96 @@ clearStats()
 }
 
 
+/*****************************************************************************/
+/* LOG CHANNEL TABLE                                                         */
+/*****************************************************************************/
+
+LogChannelTable::
+LogChannelTable()
+    : current(new Map())
+{
+    versions.emplace_back(current.load());
+}
+
+LogChannelTable::
+~LogChannelTable()
+{
+}
+
+int
+LogChannelTable::
+intern(const std::string & channel)
+{
+    const Map * map = current.load(std::memory_order_acquire);
+    auto it = map->find(channel);
+    if (JML_LIKELY(it != map->end()))
+        return it->second;
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    // Someone else may have added it in the meantime
+    map = current.load(std::memory_order_acquire);
+    it = map->find(channel);
+    if (it != map->end())
+        return it->second;
+
+    if (map->size() >= MAX_CHANNELS)
+        return -1;
+
+    std::unique_ptr<Map> newMap(new Map(*map));
+    int id = map->size();
+    (*newMap)[channel] = id;
+
+    current.store(newMap.get(), std::memory_order_release);
+    versions.emplace_back(std::move(newMap));
+
+    return id;
+}
+
+size_t
+LogChannelTable::
+size() const
+{
+    return current.load()->size();
+}
+
+
 /*****************************************************************************/
 /* LOGGER                                                                    */
 /*****************************************************************************/
 
+namespace {
+
+/** Per-thread xorshift generator used to sample messages for outputs with
+    a logProbability below one.  Unlike random() it takes no lock.
+*/
+__thread uint64_t samplingState = 0;
+
+double sampleUniform()
+{
+    uint64_t x = samplingState;
+    if (JML_UNLIKELY(x == 0))
+        x = ((uint64_t)pthread_self() ^ (uint64_t)&samplingState)
+            * 0x9E3779B97F4A7C15ULL | 1;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    samplingState = x;
+
+    return ((x * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // file scope
+
 Logger::
 Logger(size_t bufferSize)
     : context(std::make_shared<zmq::context_t>(1)),
       messages(bufferSize),
       outputs(0),
+      channelStates(new std::atomic<uint32_t>
+                    [LogChannelTable::MAX_CHANNELS]()),
+      outputsGeneration(0),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -61,6 +142,9 @@ Logger(zmq::context_t & contextRef, size_t bufferSize)
     : context(ML::make_unowned_std_sp(contextRef)),
       messages(bufferSize),
       outputs(0),
+      channelStates(new std::atomic<uint32_t>
+                    [LogChannelTable::MAX_CHANNELS]()),
+      outputsGeneration(0),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -71,6 +155,9 @@ Logger(std::shared_ptr<zmq::context_t> & context, size_t bufferSize)
     : context(context),
       messages(bufferSize),
       outputs(0),
+      channelStates(new std::atomic<uint32_t>
+                    [LogChannelTable::MAX_CHANNELS]()),
+      outputsGeneration(0),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -88,8 +175,8 @@ init()
 {
     messageLoop.init();
 
-    messages.onEvent = [=](std::vector<std::string> && message) {
-        handleListenerMessage(message);
+    messages.onEvent = [=](Entry && entry) {
+        handleListenerMessage(entry.fields, entry.timestamp, entry.channelId);
     };
 
     messageLoop.addSource("Logger::messages", messages);
@@ -162,13 +249,13 @@ struct Logger::Output {
 /// List of entries to output to
 struct Logger::Outputs : public std::vector<Output> {
     Outputs()
-        : old(0)
+        : old(0), generation(0)
     {
     }
     
     Outputs(Outputs * old,
             const Output & toAdd)
-        : old(old)
+        : old(old), generation(0)
     {
         if (old) {
             reserve(old->size() + 1);
@@ -182,40 +269,98 @@ struct Logger::Outputs : public std::vector<Output> {
     {
         if (old) delete old;
     }
-    
-    void logMessage(const std::string & channel,
+
+    bool accepts(const Output & output, const std::string & channel) const
+    {
+        try {
+            return (output.allowChannels.empty()
+                    || boost::regex_match(channel, output.allowChannels))
+                && (output.denyChannels.empty()
+                    || !boost::regex_match(channel, output.denyChannels));
+        } catch (const std::exception & exc) {
+            cerr << "error: matching channel " << channel
+                 << " for output " << ML::type_name(*output.output)
+                 << ": " << exc.what() << endl;
+            return false;
+        }
+    }
+
+    /** Return the indexes of the outputs that accept the given channel.
+        The regexes are only evaluated the first time that a channel is
+        seen; after that it's a table lookup.  Only the logging thread
+        may call this.
+    */
+    const std::vector<uint16_t> &
+    route(int channelId, const std::string & channel)
+    {
+        if (channelId >= (int)routes.size()) {
+            routes.resize(channelId + 1);
+            resolved.resize(channelId + 1);
+        }
+
+        if (!resolved[channelId]) {
+            for (unsigned i = 0;  i < size();  ++i)
+                if (accepts(at(i), channel))
+                    routes[channelId].push_back(i);
+            resolved[channelId] = true;
+        }
+
+        return routes[channelId];
+    }
+
+    bool isResolved(int channelId) const
+    {
+        return channelId < (int)resolved.size() && resolved[channelId];
+    }
+
+    void write(Output & output,
+               const std::string & channel,
+               const std::string & message)
+    {
+        if (output.logProbability < 1.0
+            && sampleUniform() >= output.logProbability)
+            return;
+
+        try {
+            output.output->logMessage(channel, message);
+        } catch (const std::exception & exc) {
+            cerr << "error: writing message to channel " << channel
+                 << " with output " << ML::type_name(*output.output)
+                 << ": " << exc.what() << "; message = "
+                 << message << endl;
+        }
+    }
+
+    void logMessage(int channelId,
+                    const std::string & channel,
                     const std::string & message)
     {
-        for (auto it = begin(); it != end();  ++it) {
-            try {
-                //cerr << "channel = " << channel << endl;
-                //cerr << "output = " << ML::type_name(*it->output) << endl;
-                //cerr << "it->allowChannels = " << it->allowChannels.str() << endl;
-                //cerr << "it->denyChannels = " << it->denyChannels.str() << endl;
-                if (it->allowChannels.empty()
-                    || boost::regex_match(channel, it->allowChannels)) {
-                    //cerr << "   allow" << endl;
-                    if (it->denyChannels.empty()
-                        || !boost::regex_match(channel, it->denyChannels)) {
-
-                        if (it->logProbability == 1.0
-                            || ((random() % 100000)
-                                < (it->logProbability * 100000))) {
-                            it->output->logMessage(channel, message);
-                        }
-                        //cerr << "  *** log" << endl;
-                    }
-                }
-            } catch (const std::exception & exc) {
-                cerr << "error: writing message to channel " << channel
-                     << " with output " << ML::type_name(*it->output)
-                     << ": " << exc.what() << "; message = "
-                     << message << endl;
-            }
+        if (channelId == -1) {
+            // Channel table is full; fall back to matching each time
+            for (auto it = begin(); it != end();  ++it)
+                if (accepts(*it, channel))
+                    write(*it, channel, message);
+            return;
         }
+
+        for (auto i: route(channelId, channel))
+            write(at(i), channel, message);
+    }
+
+    void logMessage(const std::string & channel,
+                    const std::string & message)
+    {
+        logMessage(-1, channel, message);
     }
     
     Outputs * old;   // to allow cleanup
+
+    /// Value of the logger's outputsGeneration for this set of outputs
+    uint32_t generation;
+
+    /// For each channel id, the outputs that accept it
+    std::vector<std::vector<uint16_t> > routes;
+    std::vector<bool> resolved;
 };
 
 bool startsWith(std::string & s,
@@ -260,11 +405,15 @@ addOutput(std::shared_ptr<LogOutput> output,
         auto_ptr<Outputs> newOutputs
             (new Outputs(current, Output(allowChannels, denyChannels, output,
                                          logProbability)));
+        newOutputs->generation = outputsGeneration + 1;
         if (ML::cmp_xchg(outputs, current, newOutputs.get())) {
             newOutputs.release();
             break;
         }
     }
+
+    // Cached per-channel decisions are now stale
+    ++outputsGeneration;
 }
 
 void
@@ -283,6 +432,7 @@ Logger::
 clearOutputs()
 {
     auto_ptr<Outputs> newOutputs(new Outputs());
+    newOutputs->generation = outputsGeneration + 1;
 
     Outputs * current = outputs;
 
@@ -293,6 +443,28 @@ clearOutputs()
     }
 
     newOutputs.release();
+
+    ++outputsGeneration;
+}
+
+bool
+Logger::
+resolveChannel(Outputs * current, int channelId, const std::string & channel)
+{
+    if (channelId == -1)
+        return true;
+
+    bool known = current->isResolved(channelId);
+    bool wanted = !current->route(channelId, channel).empty();
+
+    if (!known) {
+        // Let the logging threads know so they can skip the work next time
+        uint32_t state = (current->generation << 2)
+            | (wanted ? CHANNEL_WANTED : CHANNEL_DENIED);
+        channelStates[channelId] = state;
+    }
+
+    return wanted;
 }
 
 void
@@ -356,7 +528,7 @@ replay(const std::string & filename, ssize_t maxEvents)
         string line;
         getline(stream, line);
         atomic_add(messagesSent, 1);
-        messages.push({ line });
+        messages.push(Entry(-1, Date::notADate(), { line }));
     }
 
     cerr << "replay: sent " << messagesSent << " done: "
@@ -403,6 +575,15 @@ replayDirect(const std::string & filename, ssize_t maxEvents) const
 void
 Logger::
 handleListenerMessage(std::vector<std::string> const & message)
+{
+    handleListenerMessage(message, Date::notADate());
+}
+
+void
+Logger::
+handleListenerMessage(std::vector<std::string> const & message,
+                      Date timestamp,
+                      int channelId)
 {
     Outputs * current = outputs;
         
@@ -425,9 +606,22 @@ handleListenerMessage(std::vector<std::string> const & message)
 
     string const & channel = message[0];
 
+    if (channelId == -1)
+        channelId = channels.intern(channel);
+
+    // Don't bother formatting anything if nobody wants it
+    if (!resolveChannel(current, channelId, channel))
+        return;
+
     string toLog;
     toLog.reserve(1024);
 
+    if (timestamp.isADate()) {
+        char buffer[64];
+        toLog.append(buffer, timestamp.print(buffer, sizeof(buffer), 5));
+        if (message.size() > 1) toLog += '\t';
+    }
+
     for (unsigned i = 1;  i < message.size();  ++i) {
         string const & strMessage = message[i];
         if (strMessage.find_first_of("\n\t\0\r") != string::npos) {
@@ -439,7 +633,7 @@ handleListenerMessage(std::vector<std::string> const & message)
         toLog += strMessage;
     }
 
-    current->logMessage(channel, toLog);
+    current->logMessage(channelId, channel, toLog);
 }
 
 void
@@ -479,7 +673,9 @@ handleRawListenerMessage(std::vector<std::string> const & message)
         content = string(rawMessage, pos + 1);
     }
 
-    current->logMessage(channel, content);
+    int channelId = channels.intern(channel);
+    if (resolveChannel(current, channelId, channel))
+        current->logMessage(channelId, channel, content);
 }
 
 void
@@ -515,7 +711,10 @@ handleMessage(std::vector<zmq::message_t> && message)
 
     //cerr << "logging subscription message " << message << endl;
 
-    current->logMessage(message[0].toString(), message[1].toString());
+    string channel = message[0].toString();
+    int channelId = channels.intern(channel);
+    if (resolveChannel(current, channelId, channel))
+        current->logMessage(channelId, channel, message[1].toString());
 }
 
 #if 0
@@ -20,6 +20,9 @@
 #include <boost/regex.hpp>
 #include <boost/shared_ptr.hpp>
 #include "soa/jsoncpp/json.h"
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 
 
 namespace Datacratic {
@@ -65,6 +68,41 @@ struct LogOutput {
 };
 
 
+/*****************************************************************************/
+/* LOG CHANNEL TABLE                                                         */
+/*****************************************************************************/
+
+/** Interns log channel names into small integer ids, so that per-channel
+    routing decisions can be cached in tables.
+
+    Lookups are lock free.  Adding a channel takes a lock and publishes a
+    new copy of the map; as the set of channels is small and stable this
+    only happens a handful of times.  Old copies are kept until the table
+    is destroyed so that readers never see freed memory.
+*/
+
+struct LogChannelTable {
+    enum { MAX_CHANNELS = 1024 };
+
+    LogChannelTable();
+    ~LogChannelTable();
+
+    /** Return the id of the given channel, allocating one on first sight.
+        Returns -1 once MAX_CHANNELS channels have been seen.
+    */
+    int intern(const std::string & channel);
+
+    /** Number of channels interned so far. */
+    size_t size() const;
+
+private:
+    typedef std::unordered_map<std::string, int> Map;
+    std::atomic<const Map *> current;
+    std::mutex lock;
+    std::vector<std::unique_ptr<const Map> > versions;
+};
+
+
 /*****************************************************************************/
 /* LOGGER                                                                    */
 /*****************************************************************************/
@@ -139,6 +177,16 @@ struct Logger {
     /** Clear all outputs. */
     void clearOutputs();
 
+    /** Return false if it is known that no output accepts messages on the
+        given channel, in which case there is no need to format anything
+        to log to it.  Unknown channels return true until the logging
+        thread has seen a message for them.
+    */
+    bool wantsChannel(const std::string & channel)
+    {
+        return outputs && wantsChannel(channels.intern(channel));
+    }
+
     /** Log a given message to the given channel.  Each of the arguments will
         be converted to a string and logged like that.
     */
@@ -152,16 +200,21 @@ struct Logger {
     void logMessage(const std::string & channel, Args... args)
     {
         if (!outputs) return;
+        int channelId = channels.intern(channel);
+        if (!wantsChannel(channelId)) return;
         ML::atomic_add(messagesSent, 1);
-        messages.push({ channel, Date::now().print(5), args... });
+        messages.push(Entry(channelId, Date::now(), { channel, args... }));
     }
 
     template<typename... Args>
     void logMessageNoTimestamp(const std::string & channel, Args... args)
     {
         if (!outputs) return;
+        int channelId = channels.intern(channel);
+        if (!wantsChannel(channelId)) return;
         ML::atomic_add(messagesSent, 1);
-        messages.push({ channel, args... });
+        messages.push(Entry(channelId, Date::notADate(),
+                            { channel, args... }));
     }
 
     void logMessageNoTimestamp(const std::vector<std::string> & message)
@@ -171,8 +224,10 @@ struct Logger {
         if (message.empty())
             throw ML::Exception("can't log empty message");
 
+        int channelId = channels.intern(message[0]);
+        if (!wantsChannel(channelId)) return;
         ML::atomic_add(messagesSent, 1);
-        messages.push(message);
+        messages.push(Entry(channelId, Date::notADate(), message));
     }
 
     template<typename GetEl>
@@ -181,16 +236,18 @@ struct Logger {
                     GetEl getElement)
     {
         if (!outputs) return;
+        int channelId = channels.intern(channel);
+        if (!wantsChannel(channelId)) return;
 
         std::vector<std::string> message;
+        message.reserve(numElements + 1);
         message.push_back(channel);
-        message.push_back(Date::now().print(5));
 
         for (unsigned i = 0;  i < numElements;  ++i) {
             message.push_back(getElement(i));
         }
 
-        messages.push(message);
+        messages.push(Entry(channelId, Date::now(), std::move(message)));
     }
 
     void start(std::function<void ()> onStop = 0);
@@ -215,6 +272,9 @@ struct Logger {
     uint64_t numMessagesDone() const { return messagesDone; }
 
     void handleListenerMessage(std::vector<std::string> const & message);
+    void handleListenerMessage(std::vector<std::string> const & message,
+                               Date timestamp,
+                               int channelId = -1);
     void handleRawListenerMessage(std::vector<std::string> const & message);
     void handleMessage(std::vector<zmq::message_t> && message);
 
@@ -226,8 +286,30 @@ private:
 
     std::map<std::string, size_t> stats;
 
-protected:    /// Log entried to add
-    TypedMessageSink<std::vector<std::string>> messages;
+protected:
+    /** Message waiting to be logged.  The timestamp is kept in binary form
+        and only printed on the logging thread, so that the threads doing
+        the logging don't pay for the formatting.
+    */
+    struct Entry {
+        Entry()
+            : channelId(-1)
+        {
+        }
+
+        Entry(int channelId, Date timestamp, std::vector<std::string> fields)
+            : channelId(channelId), timestamp(timestamp),
+              fields(std::move(fields))
+        {
+        }
+
+        int channelId;   ///< id in channels, or -1 if not interned
+        Date timestamp;  ///< notADate() if no timestamp to be logged
+        std::vector<std::string> fields;  ///< channel, then message parts
+    };
+
+    /// Log entries to add
+    TypedMessageSink<Entry> messages;
 
 private:
 #if 0
@@ -244,6 +326,36 @@ private:
     /// Current list of outputs.  Must be swapped atomically.
     Outputs * outputs;
 
+    /// Interned names of the channels we've seen
+    LogChannelTable channels;
+
+    /** Per channel id, whether any output accepts the channel.  Each entry
+        is (generation << 2) | ChannelState, and is only valid if its
+        generation matches outputsGeneration.
+    */
+    enum ChannelState {
+        CHANNEL_UNKNOWN = 0,
+        CHANNEL_DENIED = 1,
+        CHANNEL_WANTED = 2
+    };
+    std::unique_ptr<std::atomic<uint32_t>[]> channelStates;
+
+    /// Incremented each time the set of outputs changes
+    std::atomic<uint32_t> outputsGeneration;
+
+    bool wantsChannel(int channelId) const
+    {
+        if (channelId == -1)
+            return true;
+        uint32_t state = channelStates[channelId].load();
+        return (state & 3) != CHANNEL_DENIED
+            || (state >> 2) != outputsGeneration.load();
+    }
+
+    /// Find out (and publish) whether anything wants the channel
+    bool resolveChannel(Outputs * current, int channelId,
+                        const std::string & channel);
+
     /// Thing we get subscription messages from
     std::vector<std::shared_ptr<zmq::socket_t> > subscriptions;
 
@@ -0,0 +1,90 @@
+/* block_output_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compares the single threaded compressing FileOutput with the parallel
+   BlockCompressingOutput on auction-like log records.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/block_output.h"
+#include "soa/logger/file_output.h"
+#include "jml/utils/guard.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <sys/stat.h>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+namespace {
+
+const int numMessages = 1000000;
+
+vector<string> makeMessages()
+{
+    vector<string> result;
+    for (int i = 0;  i < 1000;  ++i) {
+        result.push_back(ML::format("2014-Jan-01 00:00:%02d.%05d\t"
+                                    "auction-%d\t{\"id\":\"%d\",\"imp\":"
+                                    "[{\"id\":\"1\",\"banner\":{\"w\":300,"
+                                    "\"h\":250}}],\"site\":{\"id\":\"%d\"}}",
+                                    i % 60, i, i * 7919, i, i % 37));
+    }
+    return result;
+}
+
+void report(const string & what, double elapsed, const string & filename)
+{
+    struct stat st;
+    stat(filename.c_str(), &st);
+    cerr << ML::format("%-30s %8.3fs %10.0f msg/s %8.1f MB/s %10zd bytes",
+                       what.c_str(), elapsed, numMessages / elapsed,
+                       numMessages * 200.0 / elapsed / 1000000.0,
+                       (size_t)st.st_size)
+         << endl;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_file_output )
+{
+    vector<string> messages = makeMessages();
+
+    for (string ext: { "gz", "txt" }) {
+        string filename = "tmp/block_output_bench_file." + ext;
+        ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+        Timer timer;
+        FileOutput output(filename);
+        for (int i = 0;  i < numMessages;  ++i)
+            output.logMessage("AUCTION", messages[i % messages.size()]);
+        output.close();
+        report("FileOutput " + ext, timer.elapsed_wall(), filename);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( bench_block_output )
+{
+    vector<string> messages = makeMessages();
+
+    for (string ext: { "lz4", "gz", "txt" }) {
+        for (int threads: { 1, 2, 4, 8 }) {
+            string filename = "tmp/block_output_bench_block." + ext;
+            ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+            Timer timer;
+            BlockCompressingOutput output(threads);
+            output.open(filename);
+            for (int i = 0;  i < numMessages;  ++i)
+                output.logMessage("AUCTION", messages[i % messages.size()]);
+            output.close();
+            report(ML::format("BlockOutput %s %d threads",
+                              ext.c_str(), threads),
+                   timer.elapsed_wall(), filename);
+        }
+    }
+}
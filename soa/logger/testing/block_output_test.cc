@@ -0,0 +1,132 @@
+/* block_output_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the block compressing log output.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/block_output.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/utils/guard.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+void testRoundTrip(const string & filename, size_t blockSize, int numThreads)
+{
+    ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+    int numMessages = 100000;
+
+    {
+        BlockCompressingOutput output(numThreads, blockSize, 4);
+        output.open(filename);
+
+        // Several threads at once; each one's messages keep their order
+        auto runThread = [&] (int thread)
+            {
+                for (int i = 0;  i < numMessages;  ++i)
+                    output.logMessage("CHANNEL" + to_string(thread),
+                                      ML::format("message\t%d", i));
+            };
+
+        std::thread t1(runThread, 1), t2(runThread, 2);
+        t1.join();
+        t2.join();
+
+        output.close();
+
+        Json::Value stats = output.stats();
+        BOOST_CHECK_GT(stats["blocksWritten"].asInt(), 1);
+    }
+
+    filter_istream stream(filename);
+    int next[3] = { 0, 0, 0 };
+    int numLines = 0;
+    while (stream) {
+        string line;
+        getline(stream, line);
+        if (line.empty()) continue;
+
+        ++numLines;
+        int thread, i;
+        BOOST_REQUIRE_EQUAL(sscanf(line.c_str(), "CHANNEL%d\tmessage\t%d",
+                                   &thread, &i), 2);
+        BOOST_REQUIRE_EQUAL(i, next[thread]);
+        ++next[thread];
+    }
+
+    BOOST_CHECK_EQUAL(numLines, 2 * numMessages);
+}
+
+BOOST_AUTO_TEST_CASE( test_block_output_lz4 )
+{
+    testRoundTrip("tmp/block_output_test.lz4", 64 * 1024, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_block_output_gzip )
+{
+    testRoundTrip("tmp/block_output_test.gz", 256 * 1024, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_block_output_none )
+{
+    testRoundTrip("tmp/block_output_test.txt", 64 * 1024, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_block_output_flush_on_age )
+{
+    string filename = "tmp/block_output_age_test.txt";
+    ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+    BlockCompressingOutput output(1, 64 * 1024);
+    output.maxBlockAge = 0.05;
+    output.open(filename);
+    output.logMessage("HELLO", "world");
+
+    ML::sleep(0.5);
+
+    filter_istream stream(filename);
+    string line;
+    getline(stream, line);
+    BOOST_CHECK_EQUAL(line, "HELLO\tworld");
+}
+
+BOOST_AUTO_TEST_CASE( test_block_output_lz4_incompressible )
+{
+    // Random data doesn't compress, so the blocks are stored as they are
+    // with the not compressed flag set
+    string filename = "tmp/block_output_random_test.lz4";
+    ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+    vector<string> messages;
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        string message;
+        for (unsigned j = 0;  j < 200;  ++j)
+            message += char(32 + random() % 224);
+        messages.push_back(message);
+    }
+
+    {
+        BlockCompressingOutput output(2, 64 * 1024);
+        output.open(filename);
+        for (auto & message: messages)
+            output.logMessage("RANDOM", message);
+        output.close();
+    }
+
+    filter_istream stream(filename);
+    for (auto & message: messages) {
+        string line;
+        getline(stream, line);
+        BOOST_REQUIRE_EQUAL(line, "RANDOM\t" + message);
+    }
+}
@@ -0,0 +1,109 @@
+/* logger_channel_routing_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test that the logger's cached channel routing gives the same answers
+   as matching the regexes for every message.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/logger.h"
+#include "jml/arch/timers.h"
+#include <mutex>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_channel_table )
+{
+    LogChannelTable table;
+    BOOST_CHECK_EQUAL(table.intern("AUCTION"), 0);
+    BOOST_CHECK_EQUAL(table.intern("BID"), 1);
+    BOOST_CHECK_EQUAL(table.intern("AUCTION"), 0);
+    BOOST_CHECK_EQUAL(table.size(), 2);
+
+    for (unsigned i = 2;  i < LogChannelTable::MAX_CHANNELS;  ++i)
+        BOOST_CHECK_EQUAL(table.intern("CHANNEL" + to_string(i)), i);
+    BOOST_CHECK_EQUAL(table.intern("ONE_TOO_MANY"), -1);
+    BOOST_CHECK_EQUAL(table.intern("BID"), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_channel_routing )
+{
+    Logger logger;
+    logger.init();
+
+    std::mutex lock;
+    map<string, int> auctions, everything, sampled;
+
+    auto record = [&] (map<string, int> & counts)
+        {
+            return [&] (string channel, string message)
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                counts[channel] += 1;
+            };
+        };
+
+    logger.addCallback(record(auctions), boost::regex("AUCTION.*"),
+                       boost::regex("AUCTION_DENIED"));
+    logger.addCallback(record(everything));
+    logger.addCallback(record(sampled), boost::regex("BID"),
+                       boost::regex(), 0.5);
+
+    logger.start();
+
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        logger.logMessage("AUCTION", "a", "b");
+        logger.logMessage("AUCTION_DENIED", "a");
+        logger.logMessage("BID", "c");
+    }
+
+    logger.waitUntilFinished();
+
+    BOOST_CHECK_EQUAL(auctions.size(), 1);
+    BOOST_CHECK_EQUAL(auctions["AUCTION"], 10000);
+    BOOST_CHECK_EQUAL(everything["AUCTION"], 10000);
+    BOOST_CHECK_EQUAL(everything["AUCTION_DENIED"], 10000);
+    BOOST_CHECK_EQUAL(everything["BID"], 10000);
+    BOOST_CHECK_EQUAL(sampled.size(), 1);
+    BOOST_CHECK_GT(sampled["BID"], 4500);
+    BOOST_CHECK_LT(sampled["BID"], 5500);
+
+    logger.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_denied_channel_skipped )
+{
+    Logger logger;
+    logger.init();
+
+    int numLogged = 0;
+    logger.addCallback([&] (string, string) { ++numLogged; },
+                       boost::regex("WANTED"));
+    logger.start();
+
+    // The logging thread needs to see the channel once before it's known
+    BOOST_CHECK(logger.wantsChannel("UNWANTED"));
+    logger.logMessage("UNWANTED", "x");
+    logger.waitUntilFinished();
+    BOOST_CHECK(!logger.wantsChannel("UNWANTED"));
+    BOOST_CHECK(logger.wantsChannel("WANTED"));
+
+    uint64_t sentBefore = logger.numMessagesSent();
+    logger.logMessage("UNWANTED", "x");
+    BOOST_CHECK_EQUAL(logger.numMessagesSent(), sentBefore);
+
+    // Adding an output makes the cached decisions stale
+    logger.addCallback([&] (string, string) { ++numLogged; });
+    BOOST_CHECK(logger.wantsChannel("UNWANTED"));
+    logger.logMessage("UNWANTED", "x");
+    logger.waitUntilFinished();
+    BOOST_CHECK_EQUAL(numLogged, 1);
+
+    logger.shutdown();
+}
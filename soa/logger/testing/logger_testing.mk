@@ -11,3 +11,7 @@ $(eval $(call test,multi_output_logger_test,logger,boost))
 $(eval $(call test,rotating_file_logger_test,logger,manual boost))
 
 $(eval $(call vowscoffee_test,logger_metrics_interface_js_test,iloggermetricscpp))
+
+$(eval $(call test,block_output_test,logger,boost))
+$(eval $(call test,block_output_bench,logger,boost manual))
+$(eval $(call test,logger_channel_routing_test,logger,boost))
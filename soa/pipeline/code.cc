@@ -14,6 +14,7 @@ using namespace Datacratic;
 
 // source files
 #include "block.cc"
+#include "concurrent_pipeline.cc"
 #include "default_pipeline.cc"
 #include "file_reader_block.cc"
 #include "file_writer_block.cc"
@@ -0,0 +1,355 @@
+/* concurrent_pipeline.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+*/
+
+ConcurrentPipeline::ConcurrentPipeline() :
+    batchSize(256),
+    queueCapacity(16),
+    ordered(true),
+    busy(0),
+    stopping(false) {
+}
+
+ConcurrentPipeline::Counters::Counters() :
+    items(0),
+    batches(0),
+    busySeconds(0.0),
+    blockedSeconds(0.0),
+    queueDepth(0),
+    maxQueueDepth(0) {
+}
+
+void ConcurrentPipeline::run() {
+    states.clear();
+    groups.clear();
+    channels.clear();
+    busy = 0;
+    stopping = false;
+    exception = nullptr;
+
+    for(auto item : getBlocks()) {
+        auto block = item.get();
+        auto i = groupNames.find(block);
+        auto name = groupNames.end() != i ? i->second : block->getPath();
+
+        auto & group = groups[name];
+        if(!group) {
+            group.reset(new Group);
+            group->name = name;
+            group->next = 0;
+        }
+
+        State & state = states[block];
+        state.pipeline = this;
+        state.block = block;
+        state.group = group.get();
+        state.count = 0;
+        state.active = false;
+        state.counters = Counters();
+        for(auto pin : block->getIncomingPins()) {
+            if(pin->isConnected()) {
+                state.count++;
+            }
+        }
+    }
+
+    for(auto & item : connectors) {
+        item->state = getState(item->getIncomingPin()->getBlock());
+        item->channel.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(auto item : getBlocks()) {
+            auto state = getState(item.get());
+            if(state->count == 0) {
+                LOG(debug) << "block ready to run name='" << state->block->getPath() << "'" << std::endl;
+                schedule(state);
+            }
+        }
+    }
+
+    for(auto & item : groups) {
+        auto group = item.second.get();
+        LOG(debug) << "starting group='" << group->name << "'" << std::endl;
+        group->thread = std::thread([=]() { this->runGroup(group); });
+    }
+
+    for(auto & item : groups) {
+        item.second->thread.join();
+    }
+
+    if(exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+Connector * ConcurrentPipeline::createConnector(IncomingPin * incoming, OutgoingPin * outgoing) {
+    auto item = std::make_shared<ConcurrentConnector>(incoming, outgoing);
+    connectors.insert(item);
+    return item.get();
+}
+
+void ConcurrentPipeline::setGroup(Block * block, std::string name) {
+    groupNames[block] = std::move(name);
+}
+
+void ConcurrentPipeline::setOrdered(Connector * connector, bool value) {
+    static_cast<ConcurrentConnector *>(connector)->ordered = value;
+}
+
+ConcurrentPipeline::Counters ConcurrentPipeline::getCounters(Block * block) const {
+    std::lock_guard<std::mutex> guard(lock);
+    auto i = states.find(block);
+    return states.end() != i ? i->second.counters : Counters();
+}
+
+void ConcurrentPipeline::logCounters() const {
+    for(auto item : getBlocks()) {
+        auto counters = getCounters(item.get());
+        LOG(print) << "block='" << item->getPath()
+                   << "' items=" << counters.items
+                   << " batches=" << counters.batches
+                   << " busy=" << counters.busySeconds
+                   << "s rate=" << (counters.busySeconds > 0.0 ? counters.items / counters.busySeconds : 0.0)
+                   << " items/s blocked=" << counters.blockedSeconds
+                   << "s queue=" << counters.queueDepth
+                   << " max-queue=" << counters.maxQueueDepth
+                   << std::endl;
+    }
+}
+
+ConcurrentPipeline::State * ConcurrentPipeline::getState(Block * block) {
+    auto i = states.find(block);
+    return states.end() != i ? &i->second : nullptr;
+}
+
+void ConcurrentPipeline::schedule(State * state) {
+    state->group->ready.push_back(state->block);
+    ++busy;
+    state->group->wake.notify_one();
+}
+
+void ConcurrentPipeline::runGroup(Group * group) {
+    std::unique_lock<std::mutex> guard(lock);
+
+    for(;;) {
+        if(stopping) {
+            return;
+        }
+
+        try {
+            if(!group->ready.empty()) {
+                auto state = getState(group->ready.front());
+                group->ready.pop_front();
+                state->active = true;
+                guard.unlock();
+
+                LOG(debug) << "running block='" << state->block->getPath() << "'" << std::endl;
+                Date start = Date::now();
+                state->block->run();
+                double elapsed = Date::now().secondsSince(start);
+
+                guard.lock();
+                state->active = false;
+                state->counters.busySeconds += elapsed;
+                if(--busy == 0) {
+                    wakeAll();
+                }
+
+                continue;
+            }
+
+            auto channel = nextDeliverable(group);
+            if(channel) {
+                deliver(guard, channel);
+                continue;
+            }
+        }
+        catch(...) {
+            if(!guard.owns_lock()) {
+                guard.lock();
+            }
+
+            fail(std::current_exception());
+            return;
+        }
+
+        if(busy == 0) {
+            return;
+        }
+
+        group->wake.wait(guard);
+    }
+}
+
+ConcurrentPipeline::Channel * ConcurrentPipeline::nextDeliverable(Group * group) {
+    auto n = group->inbound.size();
+    for(size_t i = 0; i != n; ++i) {
+        auto j = (group->next + i) % n;
+        auto channel = group->inbound[j];
+        if(channel->queue.empty()) {
+            continue;
+        }
+
+        // a producer waiting in send() must not call back into a block that
+        // is further up its own stack, or the block would see items out of
+        // order
+        if(channel->consumer->active) {
+            continue;
+        }
+
+        if(channel->ordered) {
+            auto done = [](Channel * item) { return item->ended; };
+            if(!std::all_of(channel->previous.begin(), channel->previous.end(), done)) {
+                continue;
+            }
+        }
+
+        group->next = (j + 1) % n;
+        return channel;
+    }
+
+    return nullptr;
+}
+
+void ConcurrentPipeline::deliver(std::unique_lock<std::mutex> & guard, Channel * channel) {
+    auto item = std::move(channel->queue.front());
+    channel->queue.pop_front();
+
+    auto consumer = channel->consumer;
+    consumer->counters.queueDepth--;
+    consumer->active = true;
+
+    // there is now room in the queue for the producer
+    channel->producer->group->wake.notify_one();
+
+    guard.unlock();
+    Date start = Date::now();
+    item.call();
+    double elapsed = Date::now().secondsSince(start);
+    guard.lock();
+
+    consumer->active = false;
+    consumer->counters.busySeconds += elapsed;
+    if(item.items) {
+        consumer->counters.items += item.items;
+        consumer->counters.batches += 1;
+    }
+    else {
+        channel->ended = true;
+    }
+
+    if(--busy == 0) {
+        wakeAll();
+    }
+}
+
+void ConcurrentPipeline::wakeAll() {
+    for(auto & item : groups) {
+        item.second->wake.notify_all();
+    }
+}
+
+void ConcurrentPipeline::fail(std::exception_ptr exception) {
+    if(!this->exception) {
+        this->exception = exception;
+    }
+
+    stopping = true;
+    wakeAll();
+}
+
+ConcurrentPipeline::
+ConcurrentConnector::ConcurrentConnector(IncomingPin * incoming, OutgoingPin * outgoing) :
+    Connector(incoming, outgoing),
+    state(nullptr),
+    ordered(-1) {
+}
+
+void ConcurrentPipeline::ConcurrentConnector::push() {
+    auto pipeline = state->pipeline;
+    auto incoming = getIncomingPin();
+    auto outgoing = getOutgoingPin();
+    LOG(pipeline->debug) << "push from '" << outgoing->getPath() << "'" << std::endl;
+
+    std::lock_guard<std::mutex> guard(pipeline->lock);
+
+    bool channelled = false;
+    auto other = pipeline->getState(outgoing->getBlock());
+    if(other && other->group != state->group) {
+        channel = std::make_shared<Channel>();
+        channel->pipeline = pipeline;
+        channel->producer = state;
+        channel->consumer = other;
+        channel->ordered = ordered == -1 ? pipeline->ordered : ordered;
+        channel->ended = false;
+
+        channelled = outgoing->connectThrough(this, channel.get());
+        if(channelled) {
+            auto & items = pipeline->channels[outgoing];
+            channel->previous = items;
+            items.push_back(channel.get());
+            other->group->inbound.push_back(channel.get());
+        }
+        else {
+            channel.reset();
+        }
+    }
+
+    if(!channelled) {
+        incoming->readFrom(outgoing);
+    }
+
+    --state->count;
+    if(state->count == 0) {
+        LOG(pipeline->debug) << "block ready to run name='" << state->block->getPath() << "'" << std::endl;
+        pipeline->schedule(state);
+    }
+}
+
+size_t ConcurrentPipeline::Channel::getBatchSize() const {
+    return pipeline->batchSize;
+}
+
+void ConcurrentPipeline::Channel::send(std::function<void()> work, size_t items) {
+    std::unique_lock<std::mutex> guard(pipeline->lock);
+
+    Date start;
+    bool blocked = false;
+    while(queue.size() >= pipeline->queueCapacity && !pipeline->stopping) {
+        // deliver what is waiting for our own group rather than wait on it
+        auto channel = pipeline->nextDeliverable(producer->group);
+        if(channel) {
+            pipeline->deliver(guard, channel);
+            continue;
+        }
+
+        if(!blocked) {
+            blocked = true;
+            start = Date::now();
+        }
+
+        producer->group->wake.wait(guard);
+    }
+
+    if(blocked) {
+        producer->counters.blockedSeconds += Date::now().secondsSince(start);
+    }
+
+    if(pipeline->stopping) {
+        THROW(pipeline->error) << "pipeline stopped while sending to '" << consumer->block->getPath() << "'" << std::endl;
+    }
+
+    Work item;
+    item.call = std::move(work);
+    item.items = items;
+    queue.push_back(std::move(item));
+    ++pipeline->busy;
+
+    auto & counters = consumer->counters;
+    counters.queueDepth++;
+    counters.maxQueueDepth = std::max(counters.maxQueueDepth, counters.queueDepth);
+    consumer->group->wake.notify_one();
+}
@@ -0,0 +1,131 @@
+/* concurrent_pipeline.h
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Pipeline that runs each group of blocks on its own thread.
+*/
+
+namespace Datacratic
+{
+    /* Blocks are scheduled like in the default pipeline, but each group of
+       blocks runs on a dedicated thread.  Every block is in its own group
+       unless setGroup() says otherwise.
+
+       Streams between blocks of the same group are synchronous calls. Streams
+       between groups are cut into batches of batchSize items that go through
+       a queue of at most queueCapacity batches; a producer that finds the
+       queue full blocks (or delivers batches queued for its own group while
+       it waits) until the consumer catches up.
+
+       A consumer connected to many producers receives their batches as they
+       come, unless the connector is ordered, in which case it only receives
+       them once the producers connected before it are done.  With every
+       connector ordered, the consumer sees each stream in full, one after the
+       other, in the order that they were connected.
+    */
+    struct ConcurrentPipeline :
+        public Pipeline
+    {
+        ConcurrentPipeline();
+
+        void run();
+
+        Connector * createConnector(IncomingPin * incoming, OutgoingPin * outgoing);
+
+        void setGroup(Block * block, std::string name);
+        void setOrdered(Connector * connector, bool value);
+
+        size_t batchSize;       // items per batch sent to another group
+        size_t queueCapacity;   // batches queued before a producer blocks
+        bool ordered;           // for connectors without setOrdered()
+
+        // statistics about the data delivered to a block
+        struct Counters {
+            Counters();
+
+            uint64_t items;
+            uint64_t batches;
+            double busySeconds;
+            double blockedSeconds;
+            size_t queueDepth;
+            size_t maxQueueDepth;
+        };
+
+        Counters getCounters(Block * block) const;
+        void logCounters() const;
+
+    private:
+        struct Group;
+        struct Channel;
+
+        struct State {
+            ConcurrentPipeline * pipeline;
+            int count;
+            Block * block;
+            Group * group;
+            bool active;
+            Counters counters;
+        };
+
+        struct Group {
+            std::string name;
+            std::deque<Block *> ready;
+            std::vector<Channel *> inbound;
+            size_t next;
+            std::condition_variable wake;
+            std::thread thread;
+        };
+
+        struct ConcurrentConnector :
+            public Connector
+        {
+            ConcurrentConnector(IncomingPin * incoming, OutgoingPin * outgoing);
+
+            void push();
+
+            State * state;
+            int ordered;
+            std::shared_ptr<Channel> channel;
+        };
+
+        struct Channel :
+            public StreamChannel
+        {
+            size_t getBatchSize() const;
+            void send(std::function<void()> work, size_t items);
+
+            struct Work {
+                std::function<void()> call;
+                size_t items;
+            };
+
+            ConcurrentPipeline * pipeline;
+            State * producer;
+            State * consumer;
+            std::vector<Channel *> previous;
+            std::deque<Work> queue;
+            bool ordered;
+            bool ended;
+        };
+
+        State * getState(Block * block);
+        void schedule(State * state);
+        void runGroup(Group * group);
+        Channel * nextDeliverable(Group * group);
+        void deliver(std::unique_lock<std::mutex> & guard, Channel * channel);
+        void wakeAll();
+        void fail(std::exception_ptr exception);
+
+        std::set<std::shared_ptr<ConcurrentConnector>> connectors;
+        std::map<Block *, State> states;
+        std::map<std::string, std::unique_ptr<Group>> groups;
+        std::map<Block *, std::string> groupNames;
+        std::map<OutgoingPin *, std::vector<Channel *>> channels;
+
+        mutable std::mutex lock;
+        size_t busy;
+        bool stopping;
+        std::exception_ptr exception;
+
+        friend struct ConcurrentConnector;
+    };
+}
@@ -9,6 +9,12 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 namespace Datacratic
 {
@@ -25,6 +31,7 @@ namespace Datacratic
 #include "soa/pipeline/block.h"
 #include "soa/pipeline/pipeline.h"
 #include "soa/pipeline/default_pipeline.h"
+#include "soa/pipeline/concurrent_pipeline.h"
 #include "soa/pipeline/file_reader_block.h"
 #include "soa/pipeline/file_writer_block.h"
 #include "soa/pipeline/importer_block.h"
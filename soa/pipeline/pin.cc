@@ -211,6 +211,10 @@ std::vector<Connector *> const & OutgoingPin::getConnectors() const {
     return connectors;
 }
 
+bool OutgoingPin::connectThrough(Connector * connector, StreamChannel * channel) {
+    return false;
+}
+
 OutgoingPin * OutgoingPin::getAsOutgoingPin() {
     return this;
 }
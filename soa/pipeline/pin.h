@@ -108,6 +108,19 @@ namespace Datacratic
         std::vector<std::shared_ptr<IncomingPin>> pins;
     };
 
+    // base abstraction for carrying streamed data to a block on another thread
+    struct StreamChannel {
+        virtual ~StreamChannel() {
+        }
+
+        // number of items to accumulate before calling send
+        virtual size_t getBatchSize() const = 0;
+
+        // queues work that delivers items to the consumer on its own thread,
+        // where 0 items means that the work ends the stream
+        virtual void send(std::function<void()> work, size_t items) = 0;
+    };
+
     // base abstraction for pin that produces data
     struct OutgoingPin :
         public Pin
@@ -117,6 +130,10 @@ namespace Datacratic
         bool isConnected() const;
         std::vector<Connector *> const & getConnectors() const;
 
+        // gives the other end of the connector a stream that goes through the
+        // channel, and returns false if this pin isn't carrying a stream
+        virtual bool connectThrough(Connector * connector, StreamChannel * channel);
+
     private:
         OutgoingPin * getAsOutgoingPin();
         void onCreateConnector(Connector * handle);
@@ -304,6 +321,49 @@ namespace Datacratic
             auto stream = std::make_shared<Stream<T>>();
             this->set(stream);
         }
+
+        bool connectThrough(Connector * connector, StreamChannel * channel) {
+            auto target = this->get();
+            auto size = channel->getBatchSize();
+            auto batch = std::make_shared<std::vector<T>>();
+            batch->reserve(size);
+
+            auto deliver = [=](std::vector<T> const & items) {
+                for(auto & item : items) {
+                    target->pushHandler(item);
+                }
+            };
+
+            // the batch moves into the work so that only the consumer owns it
+            auto flush = [=]() {
+                auto count = batch->size();
+                channel->send(std::bind(deliver, std::move(*batch)), count);
+                batch->clear();
+                batch->reserve(size);
+            };
+
+            auto stream = std::make_shared<Stream<T>>();
+            stream->pushHandler = [=](T const & value) {
+                batch->push_back(value);
+                if(batch->size() >= size) {
+                    flush();
+                }
+            };
+
+            stream->doneHandler = [=]() {
+                if(!batch->empty()) {
+                    flush();
+                }
+
+                channel->send([=]() {
+                    target->doneHandler();
+                }, 0);
+            };
+
+            auto incoming = static_cast<ReadingPin<Stream<T>> *>(connector->getIncomingPin());
+            incoming->set(stream);
+            return true;
+        }
     };
 }
 
@@ -0,0 +1,130 @@
+/* pipeline_bench.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Throughput of the default and concurrent pipelines when reprocessing a
+   compressed auction log: read and decompress, parse every auction, write
+   a compressed summary.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "soa/pipeline/headers.h"
+#include "soa/jsoncpp/json.h"
+#include "jml/utils/environment.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/format.h"
+
+using namespace Datacratic;
+
+namespace {
+
+ML::Env_Option<std::string> inputFile("PIPELINE_BENCH_INPUT", "rtbkit/core/router/testing/20000-datacratic-auctions.xz");
+ML::Env_Option<int> numCopies("PIPELINE_BENCH_COPIES", 5);
+
+struct AuctionSummaryBlock :
+    public Block
+{
+    AuctionSummaryBlock() :
+        lines(this, "lines"), summaries(this, "summaries"), count(0) {
+    }
+
+    void run() {
+        lines->pushHandler = [&](TextLine const & line) {
+            Json::Value auction = Json::parse(line.text);
+            Json::Value summary;
+            summary["id"] = auction["id"];
+            summary["exchange"] = auction["exchange"];
+            summary["location"] = auction["location"];
+            summary["spots"] = auction["spots"].size();
+            summaries.push(summary.toStringNoNewLine());
+            count += 1;
+        };
+
+        lines->doneHandler = [&]() {
+            summaries.done();
+        };
+
+        lines.push();
+    }
+
+    PullingPin<TextLine> lines;
+    PushingPin<std::string> summaries;
+    int count;
+};
+
+/** Run reader -> summary -> writer over the prepared input and return the
+    number of auctions processed per second.
+*/
+template<typename PipelineType>
+double runBench(PipelineType & pipeline, std::string const & name)
+{
+    auto environment = std::make_shared<Environment>();
+    environment->set("input-path", "tmp");
+    environment->set("output-path", "tmp");
+    pipeline.environment.set(environment);
+
+    auto r = pipeline.template create<FileReaderBlock>("reader");
+    r->filename = "pipeline_bench-input.gz";
+
+    auto s = pipeline.template create<AuctionSummaryBlock>("summary");
+    s->lines.connectWith(r->lines);
+
+    auto w = pipeline.template create<FileWriterBlock>("writer");
+    w->filename = "pipeline_bench-" + name + ".gz";
+    w->lines.connectWith(s->summaries);
+
+    Date start = Date::now();
+    pipeline.run();
+    double elapsed = Date::now().secondsSince(start);
+
+    BOOST_CHECK_GT(s->count, 0);
+    return s->count / elapsed;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_pipeline_auction_log )
+{
+    boost::filesystem::create_directories("tmp");
+
+    // the sample log is small so it is replicated to get meaningful timings
+    {
+        ML::filter_istream input(inputFile.get());
+        std::string text((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+        BOOST_REQUIRE(!text.empty());
+
+        ML::filter_ostream output("tmp/pipeline_bench-input.gz");
+        for(int i = 0; i != numCopies; ++i) {
+            output << text;
+        }
+    }
+
+    std::vector<std::pair<std::string, double>> results;
+
+    {
+        DefaultPipeline pipeline;
+        results.emplace_back("default", runBench(pipeline, "default"));
+    }
+
+    for(size_t batchSize : { 64, 256, 1024 }) {
+        ConcurrentPipeline pipeline;
+        pipeline.batchSize = batchSize;
+        auto name = ML::format("concurrent/%d", (int) batchSize);
+        results.emplace_back(name, runBench(pipeline, "concurrent"));
+        pipeline.logCounters();
+    }
+
+    std::cerr << ML::format("%d copies of '%s'", (int) numCopies, inputFile.get().c_str()) << std::endl;
+    std::cerr << ML::format("%-16s %12s %8s", "pipeline", "auctions/s", "speedup") << std::endl;
+    for(auto & item : results) {
+        std::cerr << ML::format("%-16s %12.0f %8.2f",
+                                item.first.c_str(), item.second,
+                                item.second / results[0].second)
+                  << std::endl;
+    }
+}
@@ -10,6 +10,7 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 
 #include "soa/pipeline/headers.h"
 
@@ -105,43 +106,44 @@ struct MyBlockThatSplitsString :
     PushingPin<std::string> lines;
 };
 
-BOOST_AUTO_TEST_CASE( test_blocks )
+template<typename PipelineType>
+void testBlocks(std::string name)
 {
-    DefaultPipeline pipeline;
+    PipelineType pipeline;
 
     std::string path("./build/x86_64/tmp");
     boost::filesystem::create_directories(path);
 
     auto environment = std::make_shared<Environment>();
-    environment->set("name", "lorem");
+    environment->set("name", name);
     environment->set("input-path", path);
     pipeline.environment.set(environment);
 
     {
-        std::ofstream file(path + "/lorem-1.txt");
+        std::ofstream file(path + "/" + name + "-1.txt");
         file << "Lorem" << std::endl;
         file << "ipsum" << std::endl;
         file << "dolor" << std::endl;
     }
 
-    auto r = pipeline.create<FileReaderBlock>("r");
+    auto r = pipeline.template create<FileReaderBlock>("r");
     r->filename = "%{name}-1.txt";
 
-    auto a = pipeline.create<MyBlockThatMergesLines>("a");
+    auto a = pipeline.template create<MyBlockThatMergesLines>("a");
     a->lines.connectWith(r->lines);
 
-    auto b = pipeline.create<MyBlock>("b");
+    auto b = pipeline.template create<MyBlock>("b");
     b->text = "sit";
     b->readingPin.connectWith(a->text);
 
-    auto c = pipeline.create<MyBlock>("c");
+    auto c = pipeline.template create<MyBlock>("c");
     c->text = "amet.";
     c->readingPin.connectWith(b->writingPin);
 
-    auto d = pipeline.create<MyBlockThatSplitsString>("d");
+    auto d = pipeline.template create<MyBlockThatSplitsString>("d");
     d->text.connectWith(c->writingPin);
 
-    auto w = pipeline.create<FileWriterBlock>("w");
+    auto w = pipeline.template create<FileWriterBlock>("w");
     w->filename = "%{name}-2.txt";
     w->folder = "%{input-path}";
     w->lines.connectWith(d->lines);
@@ -149,7 +151,7 @@ BOOST_AUTO_TEST_CASE( test_blocks )
     pipeline.run();
 
     {
-        std::ifstream file(path + "/lorem-2.txt");
+        std::ifstream file(path + "/" + name + "-2.txt");
         std::string line;
         std::getline(file, line);
         BOOST_CHECK_EQUAL(line, "Lorem");
@@ -164,3 +166,203 @@ BOOST_AUTO_TEST_CASE( test_blocks )
     }
 }
 
+
+BOOST_AUTO_TEST_CASE( test_blocks )
+{
+    testBlocks<DefaultPipeline>("lorem");
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_blocks )
+{
+    testBlocks<ConcurrentPipeline>("lorem-concurrent");
+}
+
+struct MyBlockThatCounts :
+    public Block
+{
+    MyBlockThatCounts() :
+        numbers(this, "numbers"), first(0), count(0) {
+    }
+
+    void run() {
+        for(int i = 0; i != count; ++i) {
+            numbers.push(first + i);
+        }
+
+        numbers.done();
+    }
+
+    PushingPin<int> numbers;
+    int first;
+    int count;
+};
+
+struct MyBlockThatDoubles :
+    public Block
+{
+    MyBlockThatDoubles() :
+        input(this, "input"), output(this, "output") {
+    }
+
+    void run() {
+        input->pushHandler = [&](int const & value) {
+            output.push(2 * value);
+        };
+
+        input->doneHandler = [&]() {
+            output.done();
+        };
+
+        input.push();
+    }
+
+    PullingPin<int> input;
+    PushingPin<int> output;
+};
+
+struct MyBlockThatCollects :
+    public Block
+{
+    MyBlockThatCollects() :
+        numbers(this, "numbers"), done(0), limit(-1) {
+    }
+
+    void run() {
+        numbers->pushHandler = [&](int const & value) {
+            if(items.size() == limit) {
+                throw ML::Exception("too many numbers");
+            }
+
+            items.push_back(value);
+        };
+
+        numbers->doneHandler = [&]() {
+            ++done;
+        };
+
+        numbers.push();
+    }
+
+    PullingPin<int> numbers;
+    std::vector<int> items;
+    int done;
+    int limit;
+};
+
+template<typename PipelineType>
+std::vector<int> collectTwoStreams(PipelineType & pipeline, int count)
+{
+    auto a = pipeline.template create<MyBlockThatCounts>("a");
+    a->first = 0;
+    a->count = count;
+
+    auto b = pipeline.template create<MyBlockThatCounts>("b");
+    b->first = 1000000;
+    b->count = count;
+
+    auto c = pipeline.template create<MyBlockThatCollects>("c");
+    c->numbers.connectWith(a->numbers);
+    c->numbers.connectWith(b->numbers);
+
+    pipeline.run();
+
+    BOOST_CHECK_EQUAL(c->done, 2);
+    return c->items;
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_ordering )
+{
+    int count = 10000;
+
+    std::vector<int> expected;
+    for(int i = 0; i != count; ++i) {
+        expected.push_back(i);
+    }
+
+    for(int i = 0; i != count; ++i) {
+        expected.push_back(1000000 + i);
+    }
+
+    DefaultPipeline reference;
+    auto items = collectTwoStreams(reference, count);
+    std::sort(items.begin(), items.end());
+    BOOST_CHECK(items == expected);
+
+    // ordered connectors deliver one stream after the other
+    {
+        ConcurrentPipeline pipeline;
+        pipeline.batchSize = 10;
+        pipeline.queueCapacity = 2;
+        auto items = collectTwoStreams(pipeline, count);
+        BOOST_CHECK(items == expected);
+
+        auto counters = pipeline.getCounters(pipeline.getBlocks().back().get());
+        BOOST_CHECK_EQUAL(counters.items, 2 * count);
+        BOOST_CHECK_EQUAL(counters.batches, 2 * count / 10);
+        BOOST_CHECK_EQUAL(counters.queueDepth, 0);
+        BOOST_CHECK_LE(counters.maxQueueDepth, 2 * 2);
+    }
+
+    // unordered connectors interleave but keep each stream in order
+    {
+        ConcurrentPipeline pipeline;
+        pipeline.batchSize = 10;
+        pipeline.queueCapacity = 2;
+        pipeline.ordered = false;
+        auto items = collectTwoStreams(pipeline, count);
+        BOOST_CHECK_EQUAL(items.size(), 2 * count);
+
+        std::vector<int> fromA, fromB;
+        for(auto item : items) {
+            (item < 1000000 ? fromA : fromB).push_back(item);
+        }
+
+        BOOST_CHECK(fromA == std::vector<int>(expected.begin(), expected.begin() + count));
+        BOOST_CHECK(fromB == std::vector<int>(expected.begin() + count, expected.end()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_groups )
+{
+    // the source and the sink share a thread, so the source must deliver to
+    // the sink while it waits for room in the queue to the other thread
+    ConcurrentPipeline pipeline;
+    pipeline.batchSize = 4;
+    pipeline.queueCapacity = 1;
+
+    auto a = pipeline.create<MyBlockThatCounts>("a");
+    a->count = 10000;
+
+    auto b = pipeline.create<MyBlockThatDoubles>("b");
+    b->input.connectWith(a->numbers);
+
+    auto c = pipeline.create<MyBlockThatCollects>("c");
+    c->numbers.connectWith(b->output);
+
+    pipeline.setGroup(a, "io");
+    pipeline.setGroup(c, "io");
+    pipeline.run();
+
+    BOOST_CHECK_EQUAL(c->items.size(), 10000);
+    BOOST_CHECK_EQUAL(c->items.back(), 2 * 9999);
+    BOOST_CHECK_EQUAL(c->done, 1);
+    BOOST_CHECK_EQUAL(pipeline.getCounters(b).items, 10000);
+    BOOST_CHECK_EQUAL(pipeline.getCounters(c).items, 10000);
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_error )
+{
+    ConcurrentPipeline pipeline;
+    pipeline.batchSize = 10;
+    pipeline.queueCapacity = 2;
+
+    auto a = pipeline.create<MyBlockThatCounts>("a");
+    a->count = 100000;
+
+    auto c = pipeline.create<MyBlockThatCollects>("c");
+    c->limit = 1000;
+    c->numbers.connectWith(a->numbers);
+
+    BOOST_CHECK_THROW(pipeline.run(), ML::Exception);
+    BOOST_CHECK_EQUAL(c->items.size(), 1000);
+}
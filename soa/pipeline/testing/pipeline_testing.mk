@@ -1 +1,2 @@
 $(eval $(call test,pipeline_test,pipeline boost_filesystem,boost))
+$(eval $(call test,pipeline_bench,pipeline jsoncpp boost_filesystem,boost manual))
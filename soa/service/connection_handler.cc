@@ -9,7 +9,9 @@
 #include "jml/arch/demangle.h"
 #include "jml/arch/backtrace.h"
 #include "jml/utils/guard.h"
+#include "jml/arch/thread_specific.h"
 #include "soa/service//endpoint.h"
+#include <vector>
 
 
 using namespace std;
@@ -152,6 +154,60 @@ checkMagic() const
 /* PASSIVE CONNECTION HANDLER                                                */
 /*****************************************************************************/
 
+namespace {
+
+/** Buffers that handleInput() reads into.  Each endpoint thread has its own
+    pool, so once the buffers have grown to the size of the reads, reading
+    doesn't allocate any more; a buffer is always given back to the pool of
+    the thread that took it, so there is no locking and no memory goes from
+    one thread to another.
+*/
+struct ReadBufferPool {
+    enum {
+        MaxBuffers = 16,              ///< More than that are freed
+        MaxCapacity = 1024 * 1024     ///< Bigger buffers are freed
+    };
+
+    ReadBufferPool()
+    {
+        buffers.reserve(MaxBuffers);
+    }
+
+    std::vector<std::string> buffers;
+
+    std::string take()
+    {
+        if (buffers.empty())
+            return std::string();
+        std::string result = std::move(buffers.back());
+        buffers.pop_back();
+        return result;
+    }
+
+    void giveBack(std::string & buf)
+    {
+        if (buffers.size() >= MaxBuffers || buf.capacity() > MaxCapacity)
+            return;
+        buf.clear();
+        buffers.push_back(std::move(buf));
+    }
+};
+
+ML::Thread_Specific<ReadBufferPool> readBuffers;
+
+/** Number of queued writes that are gathered into a single send. */
+enum { MaxGatheredWrites = 64 };
+
+/** Entries kept per connection for reuse, and the largest data they keep
+    the capacity of.
+*/
+enum {
+    MaxFreeWrites = 16,
+    MaxFreeWriteCapacity = 64 * 1024
+};
+
+} // file scope
+
 void
 PassiveConnectionHandler::
 doError(const std::string & error)
@@ -171,7 +227,11 @@ handleInput()
 
     size_t chunk_size = 8192;
 
-    string buf;
+    // Handlers can be re-entered from handleData(), so each call takes its
+    // own buffer from the pool
+    ReadBufferPool & pool = *readBuffers;
+    string buf = pool.take();
+    Call_Guard giveBackBuf([&] () { pool.giveBack(buf); });
     size_t done = 0;
 
     ssize_t bytes_read = 0;
@@ -261,19 +321,36 @@ handleOutput()
     //cerr << "output: elapsed = " << format("%.1fms", elapsed * 1000)
     //     << endl;
 
-    const string & str = toWrite.front().data;
-
-    //cerr << "writing " << str << endl;
+    /* Gather as many of the queued writes as possible into one send.  One
+       that closes or recycles the connection is necessarily the last. */
+    struct iovec iov[MaxGatheredWrites];
+    int niov = 0;
+
+    for (auto it = toWrite.begin();
+         it != toWrite.end() && niov < MaxGatheredWrites;
+         ++it) {
+        const string & str = it->data;
+        int offset = 0;
+
+        if (niov == 0) {
+            int len = str.length();
+            if (done < 0 || (done >= len && len != 0))
+                throw Exception("invalid done");
+            offset = done;
+        }
 
-    int len = str.length();
+        iov[niov].iov_base = (void *)(str.c_str() + offset);
+        iov[niov].iov_len = str.length() - offset;
+        ++niov;
 
-    if (done < 0 || (done >= len && len != 0))
-        throw Exception("invalid done");
+        if (it->next != NEXT_CONTINUE)
+            break;
+    }
 
     /* Send data */
     ssize_t written
         = ConnectionHandler::
-        send(str.c_str() + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+        sendv(iov, niov, MSG_NOSIGNAL | MSG_DONTWAIT);
 
     if (written == -1 && errno == EWOULDBLOCK) {
         cerr << "write would block" << endl;
@@ -284,35 +361,62 @@ handleOutput()
         doError("writing: " + string(strerror(errno)));
         return;
     }
-            
-    done += written;
-        
-    if (done == len) {
-        //cerr << "SEND FINISHED " << str << endl;
 
-        WriteEntry entry = toWrite.front();
+    /* Finish off the entries that were completely written.  The callbacks
+       may queue more data, which must not be written from in here as the
+       entries are still being retired. */
+    bool wasInSend = inSend;
+    inSend = true;
+    Call_Guard restoreInSend([&] () { inSend = wasInSend; });
+
+    size_t left = written;
+
+    for (int i = 0;  i < niov;  ++i) {
+        size_t len = iov[i].iov_len;
+
+        if (left < len) {
+            done += left;
+            return;
+        }
+
+        left -= len;
+
+        //cerr << "SEND FINISHED " << toWrite.front().data << endl;
+
+        WriteEntry & entry = toWrite.front();
         if (entry.onWriteFinished)
             entry.onWriteFinished();
 
-        toWrite.pop_front();
+        NextAction next = entry.next;
+
+        // Keep the entry and the capacity of its data for the next send
+        entry.onWriteFinished = OnWriteFinished();
+        if (freeWrites.size() < MaxFreeWrites) {
+            if (entry.data.capacity() > MaxFreeWriteCapacity)
+                string().swap(entry.data);
+            freeWrites.splice(freeWrites.end(), toWrite, toWrite.begin());
+        }
+        else toWrite.pop_front();
         done = 0;
         
         if (toWrite.empty())
             stopWriting();
 
-        if (entry.next == NEXT_CONTINUE)
-            return;
+        if (next == NEXT_CONTINUE)
+            continue;
 
         if (!toWrite.empty())
             throw Exception("CLOSE or RECYCLE with data to write");
 
-        if (entry.next == NEXT_CLOSE) {
+        if (next == NEXT_CLOSE) {
             closeWhenHandlerFinished();
         }
-        else if (entry.next == NEXT_RECYCLE) {
+        else if (next == NEXT_RECYCLE) {
             recycleWhenHandlerFinished();
         }
         else throw Exception("invalid next action");
+
+        return;
     }
 }
 
@@ -333,17 +437,21 @@ send(const std::string & str,
     //cerr << "message being sent<" << str << "> on handle" << transport().getHandle() <<  endl;
     transport().assertLockedByThisThread();
 
-    WriteEntry entry;
+    // Reuse an entry that was already written if there is one; assigning
+    // the data then only copies it
+    if (freeWrites.empty())
+        toWrite.push_back(WriteEntry());
+    else toWrite.splice(toWrite.end(), freeWrites, freeWrites.begin());
+
+    WriteEntry & entry = toWrite.back();
     entry.date = Date::now();
-    entry.data = str;
+    entry.data.assign(str);
     entry.next = next;
     entry.onWriteFinished = onWriteFinished;
 
     //if (str.find("POST") != 0)
     //    cerr << "SEND " << str << endl;
 
-    toWrite.push_back(entry);
-
     if (toWrite.size() == 1) {
         done = 0;
 
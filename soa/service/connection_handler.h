@@ -99,6 +99,12 @@ struct ConnectionHandler {
         return transport().send(buf, len, flags);
     }
 
+    /** Pass on a gathered send request to the transport. */
+    ssize_t sendv(const struct iovec * iov, int iovcnt, int flags)
+    {
+        return transport().sendv(iov, iovcnt, flags);
+    }
+
     /** Pass on a recv request to the transport. */
     ssize_t recv(char * buf, size_t buf_size, int flags)
     {
@@ -235,7 +241,7 @@ private:
 struct PassiveConnectionHandler: public ConnectionHandler {
 
     PassiveConnectionHandler()
-        : inSend(false)
+        : done(0), inSend(false)
     {
     }
 
@@ -261,6 +267,13 @@ struct PassiveConnectionHandler: public ConnectionHandler {
     };
 
     std::list<WriteEntry> toWrite;
+
+    /** Entries that have been written, kept along with the capacity of
+        their data so that the next sends on this connection reuse them
+        instead of allocating.  Like toWrite, only touched with the
+        transport locked.
+    */
+    std::list<WriteEntry> freeWrites;
     
     /** Send some data, with the given set of actions to be done once it's
         finished.
@@ -14,28 +14,20 @@
    generic class, it does not make assumptions on the transferred contents.
    Finally, it is based on the interface of HttpRestProxy.
 
+   The actual work is done by one of the implementations in
+   http_client_curl.h and http_client_native.h.
+
    Caveat:
-   - no support for EPOLLONESHOT yet
-   - has not been tweaked for performance yet
    - since those require header interpretation, there is not support for
      cookies per se
 */
 
 #pragma once
 
-#include "sys/epoll.h"
-
-#include <mutex>
-#include <queue>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include <curlpp/Easy.hpp>
-#include <curlpp/Multi.hpp>
-#include <curlpp/Types.hpp>
-
-#include "jml/arch/wakeup_fd.h"
-
 #include "soa/jsoncpp/value.h"
 #include "soa/service/async_event_source.h"
 #include "soa/service/http_header.h"
@@ -85,7 +77,7 @@ struct HttpRequest {
     HttpRequest(const std::string & verb, const std::string & url,
                 const std::shared_ptr<HttpClientCallbacks> & callbacks,
                 const Content & content, const RestParams & headers,
-                int timeout = -1)
+                double timeout = -1)
         noexcept
         : verb_(verb), url_(url), callbacks_(callbacks),
           content_(content), headers_(headers),
@@ -108,35 +100,50 @@ struct HttpRequest {
     std::shared_ptr<HttpClientCallbacks> callbacks_;
     Content content_;
     RestParams headers_;
-    int timeout_;
+    double timeout_;   /* in seconds, -1 for none */
 };
 
 
 /* HTTPCLIENT */
 
+struct HttpClientImpl;
+
 struct HttpClient : public AsyncEventSource {
 
+    /* Available implementations:
+       - CURL: based on libcurl's multi interface;
+       - NATIVE: written directly on epoll, with a keep-alive connection
+         pool, optional pipelining and deadlines enforced with a
+         microsecond resolution. Only supports plain http. */
+    enum Implementation {
+        CURL,
+        NATIVE
+    };
+
     /* "baseUrl": scheme, hostname and port (scheme://hostname[:port]) that
        will be used as base for all requests
        "numParallels": number of requests that can be handled simultaneously
-       "queueSize": size of the backlog of pending requests, after which
-       operations will be refused */
+       "implementation": which of the implementations above to use */
     HttpClient(const std::string & baseUrl,
-               int numParallel = 4);
+               int numParallel = 4,
+               Implementation implementation = CURL);
     HttpClient(HttpClient && other) noexcept;
     HttpClient(const HttpClient & other) = delete;
 
     ~HttpClient();
 
-    /** SSL checks */
-    bool noSSLChecks;
+    /** Disable the verification of the peer and host of https requests.
+        Must be called before the first request is enqueued.
+    */
+    void setNoSSLChecks(bool value);
 
     /** Use with servers that support HTTP pipelining */
     void enablePipelining();
 
     /** Performs a POST request, with "resource" as the location of the
      *  resource on the server indicated in "baseUrl". Query parameters
-     *  should preferably be passed via "queryParams".
+     *  should preferably be passed via "queryParams". "timeout" is
+     *  expressed in seconds and may be fractional; -1 means no timeout.
      *
      *  Returns "true" when the request could successfully be enqueued.
      */
@@ -144,7 +151,7 @@ struct HttpClient : public AsyncEventSource {
              const std::shared_ptr<HttpClientCallbacks> & callbacks,
              const RestParams & queryParams = RestParams(),
              const RestParams & headers = RestParams(),
-             int timeout = -1)
+             double timeout = -1)
     {
         return enqueueRequest("GET", resource, callbacks,
                               HttpRequest::Content(),
@@ -161,7 +168,7 @@ struct HttpClient : public AsyncEventSource {
               const HttpRequest::Content & content = HttpRequest::Content(),
               const RestParams & queryParams = RestParams(),
               const RestParams & headers = RestParams(),
-              int timeout = -1)
+              double timeout = -1)
     {
         return enqueueRequest("POST", resource, callbacks, content,
                               queryParams, headers, timeout);
@@ -176,7 +183,7 @@ struct HttpClient : public AsyncEventSource {
              const HttpRequest::Content & content = HttpRequest::Content(),
              const RestParams & queryParams = RestParams(),
              const RestParams & headers = RestParams(),
-             int timeout = -1)
+             double timeout = -1)
     {
         return enqueueRequest("PUT", resource, callbacks, content,
                               queryParams, headers, timeout);
@@ -184,93 +191,21 @@ struct HttpClient : public AsyncEventSource {
 
     HttpClient & operator = (HttpClient && other) noexcept;
 
-private:
     /* AsyncEventSource */
     virtual int selectFd() const;
     virtual bool processOne();
+    virtual void debug(bool debugOn);
 
-    /* Local */
+private:
     bool enqueueRequest(const std::string & verb,
                         const std::string & resource,
                         const std::shared_ptr<HttpClientCallbacks> & callbacks,
                         const HttpRequest::Content & content,
                         const RestParams & queryParams,
                         const RestParams & headers,
-                        int timeout = -1);
-    std::vector<HttpRequest> popRequests(size_t number);
-
-    void handleEvents();
-    void handleEvent(const ::epoll_event & event);
-    void handleWakeupEvent();
-    void handleTimerEvent();
-    void handleMultiEvent(const ::epoll_event & event);
-
-    void checkMultiInfos();
-
-    static int socketCallback(CURL *e, curl_socket_t s, int what,
-                              void *clientP, void *sockp);
-    int onCurlSocketEvent(CURL *e, curl_socket_t s, int what, void *sockp);
-
-    static int timerCallback(CURLM *multi, long timeoutMs, void *clientP);
-    int onCurlTimerEvent(long timeout_ms);
-
-    void addFd(int fd, bool isMod, int flags) const;
-    void removeFd(int fd) const;
-
-    struct HttpConnection {
-        HttpConnection();
-
-        HttpConnection(const HttpConnection & other) = delete;
-
-        void clear()
-        {
-            easy_.reset();
-            request_.clear();
-            afterContinue_ = false;
-            uploadOffset_ = 0;
-        }
-        void perform(bool noSSLChecks, bool debug);
-
-        /* header and body write callbacks */
-        curlpp::types::WriteFunctionFunctor onHeader_;
-        curlpp::types::WriteFunctionFunctor onWrite_;
-        size_t onCurlHeader(const char * data, size_t size) noexcept;
-        size_t onCurlWrite(const char * data, size_t size) noexcept;
-
-        /* body read callback */
-        curlpp::types::ReadFunctionFunctor onRead_;
-        size_t onCurlRead(char * buffer, size_t bufferSize) noexcept;
-
-        HttpRequest request_;
-
-        curlpp::Easy easy_;
-        // HttpClientResponse response_;
-        bool afterContinue_;
-        size_t uploadOffset_;
-
-        struct HttpConnection *next;
-    };
-
-    HttpConnection * getConnection();
-    void releaseConnection(HttpConnection * connection);
-
-    std::string baseUrl_;
-
-    int fd_;
-    ML::Wakeup_Fd wakeup_;
-    int timerFd_;
-
-    curlpp::Multi multi_;
-    ::CURLM * handle_;
-
-    std::vector<HttpConnection> connectionStash_;
-    std::vector<HttpConnection *> avlConnections_;
-    size_t nextAvail_;
+                        double timeout = -1);
 
-    typedef std::mutex Mutex;
-    typedef std::unique_lock<Mutex> Guard;
-    Mutex queueLock_;
-    std::queue<HttpRequest> queue_; /* queued requests */
+    std::unique_ptr<HttpClientImpl> impl_;
 };
 
 
@@ -0,0 +1,130 @@
+/* http_client_curl.h                                              -*- C++ -*-
+   Wolfgang Sourdeau, January 2014
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Implementation of HttpClient based on the multi interface of libcurl.
+
+   Caveat:
+   - no support for EPOLLONESHOT yet
+   - has not been tweaked for performance yet
+*/
+
+#pragma once
+
+#include "sys/epoll.h"
+
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <curlpp/Easy.hpp>
+#include <curlpp/Multi.hpp>
+#include <curlpp/Types.hpp>
+
+#include "jml/arch/wakeup_fd.h"
+
+#include "soa/service/http_client_impl.h"
+
+
+namespace Datacratic {
+
+/* CURLHTTPCLIENT */
+
+struct CurlHttpClient : public HttpClientImpl {
+    CurlHttpClient(const std::string & baseUrl, int numParallel);
+    CurlHttpClient(const CurlHttpClient & other) = delete;
+
+    ~CurlHttpClient();
+
+    /* HttpClientImpl */
+    virtual void enablePipelining();
+    virtual bool enqueueRequest(const std::string & verb,
+                                const std::string & resource,
+                                const std::shared_ptr<HttpClientCallbacks>
+                                & callbacks,
+                                const HttpRequest::Content & content,
+                                const RestParams & queryParams,
+                                const RestParams & headers,
+                                double timeout);
+
+    /* AsyncEventSource */
+    virtual int selectFd() const;
+    virtual bool processOne();
+
+private:
+    std::vector<HttpRequest> popRequests(size_t number);
+
+    void handleEvents();
+    void handleEvent(const ::epoll_event & event);
+    void handleWakeupEvent();
+    void handleTimerEvent();
+    void handleMultiEvent(const ::epoll_event & event);
+
+    void checkMultiInfos();
+
+    static int socketCallback(CURL *e, curl_socket_t s, int what,
+                              void *clientP, void *sockp);
+    int onCurlSocketEvent(CURL *e, curl_socket_t s, int what, void *sockp);
+
+    static int timerCallback(CURLM *multi, long timeoutMs, void *clientP);
+    int onCurlTimerEvent(long timeout_ms);
+
+    void addFd(int fd, bool isMod, int flags) const;
+    void removeFd(int fd) const;
+
+    struct HttpConnection {
+        HttpConnection();
+
+        HttpConnection(const HttpConnection & other) = delete;
+
+        void clear()
+        {
+            easy_.reset();
+            request_.clear();
+            afterContinue_ = false;
+            uploadOffset_ = 0;
+        }
+        void perform(bool noSSLChecks, bool debug);
+
+        /* header and body write callbacks */
+        curlpp::types::WriteFunctionFunctor onHeader_;
+        curlpp::types::WriteFunctionFunctor onWrite_;
+        size_t onCurlHeader(const char * data, size_t size) noexcept;
+        size_t onCurlWrite(const char * data, size_t size) noexcept;
+
+        /* body read callback */
+        curlpp::types::ReadFunctionFunctor onRead_;
+        size_t onCurlRead(char * buffer, size_t bufferSize) noexcept;
+
+        HttpRequest request_;
+
+        curlpp::Easy easy_;
+        // HttpClientResponse response_;
+        bool afterContinue_;
+        size_t uploadOffset_;
+
+        struct HttpConnection *next;
+    };
+
+    HttpConnection * getConnection();
+    void releaseConnection(HttpConnection * connection);
+
+    int fd_;
+    ML::Wakeup_Fd wakeup_;
+    int timerFd_;
+
+    curlpp::Multi multi_;
+    ::CURLM * handle_;
+
+    std::vector<HttpConnection> connectionStash_;
+    std::vector<HttpConnection *> avlConnections_;
+    size_t nextAvail_;
+
+    typedef std::mutex Mutex;
+    typedef std::unique_lock<Mutex> Guard;
+    Mutex queueLock_;
+    std::queue<HttpRequest> queue_; /* queued requests */
+};
+
+} // namespace Datacratic
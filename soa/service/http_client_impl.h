@@ -0,0 +1,57 @@
+/* http_client_impl.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Interface of the implementations of HttpClient.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "soa/service/async_event_source.h"
+#include "soa/service/http_client.h"
+
+
+namespace Datacratic {
+
+/* HTTPCLIENTIMPL */
+
+/* Base class of the implementations behind HttpClient. The HttpClient is
+   the event source that is registered with the message loop; it forwards
+   its selectFd and processOne calls to its implementation. */
+struct HttpClientImpl : public AsyncEventSource {
+    HttpClientImpl(const std::string & baseUrl, int numParallel)
+        : noSSLChecks(false), baseUrl_(baseUrl), numParallel_(numParallel)
+    {
+    }
+
+    virtual ~HttpClientImpl()
+    {
+    }
+
+    /** SSL checks; only set by HttpClient::setNoSSLChecks() before any
+        request is enqueued, so the loop thread can read it freely. */
+    bool noSSLChecks;
+
+    /** Use with servers that support HTTP pipelining */
+    virtual void enablePipelining() = 0;
+
+    /** Enqueue a request, from any thread. The url is built by
+        concatenating the base url, the resource and the query
+        parameters. */
+    virtual bool enqueueRequest(const std::string & verb,
+                                const std::string & resource,
+                                const std::shared_ptr<HttpClientCallbacks>
+                                & callbacks,
+                                const HttpRequest::Content & content,
+                                const RestParams & queryParams,
+                                const RestParams & headers,
+                                double timeout) = 0;
+
+protected:
+    std::string baseUrl_;
+    int numParallel_;
+};
+
+} // namespace Datacratic
@@ -0,0 +1,1055 @@
+/* http_client_native.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Implementation of HttpClient written directly on epoll.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/* netdb.h defines HOST_NOT_FOUND, a value of HttpClientError */
+#undef HOST_NOT_FOUND
+
+#include <algorithm>
+
+#include "jml/arch/exception.h"
+
+#include "http_client_native.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/* Longest status, header or chunk size line that we accept */
+enum { MaxLineLength = 65536 };
+
+bool
+iequals(const char * data, size_t size, const char * str)
+{
+    return size == ::strlen(str) && ::strncasecmp(data, str, size) == 0;
+}
+
+bool
+isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void
+callDone(const HttpRequest & rq, HttpClientError error)
+{
+    if (rq.callbacks_)
+        rq.callbacks_->onDone(rq, error);
+}
+
+}
+
+
+/* REQUEST */
+
+struct NativeHttpClient::Request {
+    Request(const string & verb, const string & url,
+            const shared_ptr<HttpClientCallbacks> & callbacks,
+            const HttpRequest::Content & content,
+            const RestParams & headers,
+            double timeout, Date deadline)
+        : request(verb, url, callbacks, content, headers, timeout),
+          deadline(deadline), hasDeadline(false), done(false),
+          inFlight(false), responseStarted(false), retries(0),
+          connection(nullptr)
+    {
+    }
+
+    HttpRequest request;
+
+    Date deadline;
+    multimap<Date, Request *>::iterator deadlineIt;
+    bool hasDeadline;
+
+    /* "onDone" was already invoked (the request timed out), but the
+       request is still referenced from "pending_" or a connection */
+    bool done;
+
+    bool inFlight;
+    bool responseStarted;
+    int retries;
+    Connection * connection;
+};
+
+
+/* CONNECTION */
+
+struct NativeHttpClient::Connection {
+    enum ParseState {
+        STATUS_LINE,
+        HEADERS,
+        BODY,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILERS,
+        BODY_UNTIL_CLOSE
+    };
+
+    Connection()
+        : fd(-1), connected(false), events(0), sendOffset(0),
+          numResponses(0), state(STATUS_LINE), code(0),
+          informational(false), keepAlive(true), chunked(false),
+          contentLength(-1), remaining(0)
+    {
+    }
+
+    int fd;
+    bool connected;
+    uint32_t events;
+
+    string sendBuffer;
+    size_t sendOffset;
+
+    deque<Request *> inFlight;
+    int numResponses;
+
+    /* state of the response being parsed, which belongs to the request at
+       the front of "inFlight" */
+    ParseState state;
+    string line;
+    int code;
+    bool informational;
+    bool keepAlive;
+    bool chunked;
+    int64_t contentLength;
+    uint64_t remaining;
+};
+
+
+/* NATIVEHTTPCLIENT */
+
+NativeHttpClient::
+NativeHttpClient(const string & baseUrl, int numParallel)
+    : HttpClientImpl(baseUrl, numParallel),
+      maxPipelined(16),
+      port_(80),
+      originLen_(0),
+      resolved_(false),
+      addressLen_(0),
+      pipelining_(false),
+      fd_(-1),
+      wakeup_(EFD_NONBLOCK | EFD_CLOEXEC),
+      timerFd_(-1),
+      timerSetFor_(Date::positiveInfinity()),
+      readBuffer_(65536)
+{
+    /* Urls without a scheme are accepted, as they are by curl */
+    size_t start(0);
+    size_t schemeEnd = baseUrl.find("://");
+    if (schemeEnd != string::npos) {
+        string scheme = baseUrl.substr(0, schemeEnd);
+        if (scheme != "http") {
+            throw ML::Exception("NativeHttpClient: unsupported scheme '"
+                                + scheme + "'");
+        }
+        start = schemeEnd + 3;
+    }
+    originLen_ = baseUrl.find('/', start);
+    if (originLen_ == string::npos) {
+        originLen_ = baseUrl.size();
+    }
+    host_ = baseUrl.substr(start, originLen_ - start);
+    if (host_.empty()) {
+        throw ML::Exception("NativeHttpClient: no host in '" + baseUrl + "'");
+    }
+
+    size_t portStart = host_.rfind(':');
+    if (portStart != string::npos && host_.find(']', portStart) == string::npos) {
+        port_ = stoi(host_.substr(portStart + 1));
+        hostname_ = host_.substr(0, portStart);
+    }
+    else {
+        hostname_ = host_;
+    }
+    if (hostname_.size() > 1 && hostname_[0] == '[') {
+        hostname_ = hostname_.substr(1, hostname_.size() - 2);
+    }
+
+    fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (fd_ == -1) {
+        throw ML::Exception(errno, "epoll_create");
+    }
+
+    ::epoll_event event;
+    ::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &wakeup_;
+    if (::epoll_ctl(fd_, EPOLL_CTL_ADD, wakeup_.fd(), &event) == -1) {
+        throw ML::Exception(errno, "epoll_ctl");
+    }
+
+    /* Deadlines are absolute dates, hence the realtime clock */
+    timerFd_ = ::timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd_ == -1) {
+        throw ML::Exception(errno, "timerfd_create");
+    }
+    event.data.ptr = &timerFd_;
+    if (::epoll_ctl(fd_, EPOLL_CTL_ADD, timerFd_, &event) == -1) {
+        throw ML::Exception(errno, "epoll_ctl");
+    }
+
+    /* A failure here is retried when the first connection is opened */
+    resolve();
+}
+
+NativeHttpClient::
+~NativeHttpClient()
+{
+    for (Connection * conn: connections_) {
+        for (Request * request: conn->inFlight) {
+            delete request;
+        }
+        ::close(conn->fd);
+        delete conn;
+    }
+    for (Connection * conn: closed_) {
+        delete conn;
+    }
+    for (Request * request: pending_) {
+        delete request;
+    }
+    for (Request * request: queue_) {
+        delete request;
+    }
+
+    ::close(timerFd_);
+    ::close(fd_);
+}
+
+void
+NativeHttpClient::
+enablePipelining()
+{
+    pipelining_ = true;
+}
+
+bool
+NativeHttpClient::
+enqueueRequest(const string & verb, const string & resource,
+               const shared_ptr<HttpClientCallbacks> & callbacks,
+               const HttpRequest::Content & content,
+               const RestParams & queryParams, const RestParams & headers,
+               double timeout)
+{
+    string url = baseUrl_ + resource + queryParams.uriEscaped();
+    Date deadline = (timeout >= 0
+                     ? Date::now().plusSeconds(timeout)
+                     : Date::positiveInfinity());
+    Request * request = new Request(verb, url, callbacks, content, headers,
+                                    timeout, deadline);
+
+    bool wasEmpty;
+    {
+        Guard guard(queueLock_);
+        wasEmpty = queue_.empty();
+        queue_.push_back(request);
+    }
+
+    /* The loop drains the whole queue each time it is woken up */
+    if (wasEmpty) {
+        wakeup_.signal();
+    }
+
+    return true;
+}
+
+int
+NativeHttpClient::
+selectFd()
+    const
+{
+    return fd_;
+}
+
+bool
+NativeHttpClient::
+processOne()
+{
+    static const int nEvents(256);
+    ::epoll_event events[nEvents];
+
+    while (true) {
+        int res = ::epoll_wait(fd_, events, nEvents, 0);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ML::Exception(errno, "epoll_wait");
+        }
+        if (res == 0) {
+            break;
+        }
+
+        for (int i = 0; i < res; i++) {
+            void * ptr = events[i].data.ptr;
+            if (ptr == &wakeup_) {
+                handleWakeupEvent();
+            }
+            else if (ptr == &timerFd_) {
+                handleTimerEvent();
+            }
+            else {
+                handleConnectionEvent(static_cast<Connection *>(ptr),
+                                      events[i].events);
+            }
+        }
+
+        dispatch();
+
+        /* Connections closed while handling this batch may still have had
+           events in it, hence their deferred deletion */
+        for (Connection * conn: closed_) {
+            delete conn;
+        }
+        closed_.clear();
+
+        if (res < nEvents) {
+            break;
+        }
+    }
+
+    updateTimer();
+
+    return false;
+}
+
+void
+NativeHttpClient::
+handleWakeupEvent()
+{
+    while (wakeup_.tryRead());
+
+    vector<Request *> requests;
+    {
+        Guard guard(queueLock_);
+        requests.swap(queue_);
+    }
+
+    for (Request * request: requests) {
+        if (request->deadline.isADate()) {
+            request->deadlineIt = deadlines_.insert({request->deadline,
+                                                     request});
+            request->hasDeadline = true;
+        }
+        pending_.push_back(request);
+    }
+
+    /* Requests that expired while waiting in the queue */
+    expireDeadlines(Date::now());
+}
+
+void
+NativeHttpClient::
+handleTimerEvent()
+{
+    uint64_t numWakeups;
+    while (::read(timerFd_, &numWakeups, sizeof(numWakeups)) > 0);
+    timerSetFor_ = Date::positiveInfinity();
+
+    expireDeadlines(Date::now());
+}
+
+void
+NativeHttpClient::
+handleConnectionEvent(Connection * conn, uint32_t events)
+{
+    if (conn->fd == -1) {
+        return;
+    }
+
+    if (!conn->connected) {
+        int error(0);
+        ::socklen_t len(sizeof(error));
+        if (::getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1
+            || error != 0) {
+            closeConnection(conn, HttpClientError::COULD_NOT_CONNECT);
+            return;
+        }
+        conn->connected = true;
+        if (!flush(conn)) {
+            return;
+        }
+    }
+
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !onReadable(conn)) {
+        return;
+    }
+    if (events & EPOLLOUT) {
+        flush(conn);
+    }
+}
+
+
+/* requests */
+
+void
+NativeHttpClient::
+dispatch()
+{
+    vector<Connection *> written;
+
+    while (!pending_.empty()) {
+        Request * request = pending_.front();
+        if (request->done) {
+            pending_.pop_front();
+            delete request;
+            continue;
+        }
+
+        Connection * conn(nullptr);
+        if (!idle_.empty()) {
+            conn = idle_.back();
+            idle_.pop_back();
+        }
+        else if (connections_.size() < (size_t) numParallel_) {
+            HttpClientError error;
+            conn = newConnection(error);
+            if (!conn) {
+                pending_.pop_front();
+                finishRequest(request, error);
+                continue;
+            }
+        }
+        else if (pipelining_) {
+            for (Connection * candidate: connections_) {
+                if (candidate->inFlight.size() < (size_t) maxPipelined
+                    && (!conn
+                        || candidate->inFlight.size() < conn->inFlight.size())) {
+                    conn = candidate;
+                }
+            }
+        }
+        if (!conn) {
+            break;
+        }
+
+        pending_.pop_front();
+        writeRequest(conn, request);
+        if (conn->connected
+            && find(written.begin(), written.end(), conn) == written.end()) {
+            written.push_back(conn);
+        }
+    }
+
+    /* Requests pipelined on the same connection are written together */
+    for (Connection * conn: written) {
+        if (conn->fd != -1) {
+            flush(conn);
+        }
+    }
+}
+
+void
+NativeHttpClient::
+finishRequest(Request * request, HttpClientError error)
+{
+    removeDeadline(request);
+    if (!request->done) {
+        callDone(request->request, error);
+    }
+    delete request;
+}
+
+/* Invoked exactly when the deadline of a request expires */
+void
+NativeHttpClient::
+timeoutRequest(Request * request)
+{
+    Connection * conn = request->connection;
+    if (request->inFlight && conn->inFlight.front() == request) {
+        /* The server is working on this request, and the ones behind it
+           are stuck until it answers: give up on the connection and send
+           those again elsewhere. */
+        conn->inFlight.pop_front();
+        finishRequest(request, HttpClientError::TIMEOUT);
+        closeConnection(conn);
+    }
+    else {
+        /* Either still waiting for a connection, or pipelined behind
+           another request; its response will be discarded. */
+        request->done = true;
+        callDone(request->request, HttpClientError::TIMEOUT);
+    }
+}
+
+void
+NativeHttpClient::
+expireDeadlines(Date now)
+{
+    while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+        Request * request = deadlines_.begin()->second;
+        deadlines_.erase(deadlines_.begin());
+        request->hasDeadline = false;
+        timeoutRequest(request);
+    }
+}
+
+void
+NativeHttpClient::
+removeDeadline(Request * request)
+{
+    if (request->hasDeadline) {
+        deadlines_.erase(request->deadlineIt);
+        request->hasDeadline = false;
+    }
+}
+
+void
+NativeHttpClient::
+updateTimer()
+{
+    Date next = (deadlines_.empty()
+                 ? Date::positiveInfinity()
+                 : deadlines_.begin()->first);
+    if (next == timerSetFor_) {
+        return;
+    }
+    timerSetFor_ = next;
+
+    ::itimerspec spec;
+    ::memset(&spec, 0, sizeof(spec));
+    if (next.isADate()) {
+        double seconds = next.secondsSinceEpoch();
+        double whole = ::floor(seconds);
+        spec.it_value.tv_sec = whole;
+        spec.it_value.tv_nsec = (seconds - whole) * 1000000000.0;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+    if (::timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr)
+        == -1) {
+        throw ML::Exception(errno, "timerfd_settime");
+    }
+}
+
+
+/* connections */
+
+bool
+NativeHttpClient::
+resolve()
+{
+    /* Don't hammer the resolver when the host can't be found */
+    Date now = Date::now();
+    if (lastResolve_.isADate() && now.secondsSince(lastResolve_) < 1.0) {
+        return false;
+    }
+    lastResolve_ = now;
+
+    ::addrinfo hints;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ::addrinfo * result(nullptr);
+    int res = ::getaddrinfo(hostname_.c_str(), to_string(port_).c_str(),
+                            &hints, &result);
+    if (res != 0 || !result) {
+        return false;
+    }
+
+    ::memcpy(&address_, result->ai_addr, result->ai_addrlen);
+    addressLen_ = result->ai_addrlen;
+    ::freeaddrinfo(result);
+    resolved_ = true;
+
+    return true;
+}
+
+NativeHttpClient::Connection *
+NativeHttpClient::
+newConnection(HttpClientError & error)
+{
+    if (!resolved_ && !resolve()) {
+        error = HttpClientError::HOST_NOT_FOUND;
+        return nullptr;
+    }
+
+    int fd = ::socket(address_.ss_family,
+                      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        error = HttpClientError::UNKNOWN;
+        return nullptr;
+    }
+
+    int flag(1);
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    int res = ::connect(fd, (::sockaddr *) &address_, addressLen_);
+    if (res == -1 && errno != EINPROGRESS) {
+        ::close(fd);
+        error = HttpClientError::COULD_NOT_CONNECT;
+        return nullptr;
+    }
+
+    Connection * conn = new Connection();
+    conn->fd = fd;
+
+    /* The completion of the connection is signalled by EPOLLOUT */
+    ::epoll_event event;
+    ::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = conn;
+    if (::epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+        ::close(fd);
+        delete conn;
+        throw ML::Exception(errno, "epoll_ctl");
+    }
+    conn->events = event.events;
+    connections_.push_back(conn);
+
+    return conn;
+}
+
+/* Closes the connection and takes care of the requests in flight on it:
+   with "connectError", all of them fail with that error; otherwise, the one
+   whose response had started fails and the others are sent again, once. */
+void
+NativeHttpClient::
+closeConnection(Connection * conn, HttpClientError connectError)
+{
+    ::epoll_ctl(fd_, EPOLL_CTL_DEL, conn->fd, nullptr);
+    ::close(conn->fd);
+    conn->fd = -1;
+
+    connections_.erase(find(connections_.begin(), connections_.end(), conn));
+    auto idleIt = find(idle_.begin(), idle_.end(), conn);
+    if (idleIt != idle_.end()) {
+        idle_.erase(idleIt);
+    }
+    closed_.push_back(conn);
+
+    deque<Request *> inFlight;
+    inFlight.swap(conn->inFlight);
+
+    vector<Request *> retried;
+    for (Request * request: inFlight) {
+        if (request->done) {
+            delete request;
+        }
+        else if (connectError != HttpClientError::NONE) {
+            finishRequest(request, connectError);
+        }
+        else if (request->responseStarted || request->retries > 0) {
+            finishRequest(request, HttpClientError::UNKNOWN);
+        }
+        else {
+            request->retries++;
+            request->inFlight = false;
+            request->connection = nullptr;
+            retried.push_back(request);
+        }
+    }
+    pending_.insert(pending_.begin(), retried.begin(), retried.end());
+}
+
+void
+NativeHttpClient::
+setEvents(Connection * conn, uint32_t events)
+{
+    if (events == conn->events) {
+        return;
+    }
+
+    ::epoll_event event;
+    ::memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = conn;
+    if (::epoll_ctl(fd_, EPOLL_CTL_MOD, conn->fd, &event) == -1) {
+        throw ML::Exception(errno, "epoll_ctl");
+    }
+    conn->events = events;
+}
+
+void
+NativeHttpClient::
+writeRequest(Connection * conn, Request * request)
+{
+    request->inFlight = true;
+    request->connection = conn;
+    conn->inFlight.push_back(request);
+
+    const HttpRequest & rq = request->request;
+    string & buffer = conn->sendBuffer;
+
+    buffer.append(rq.verb_);
+    buffer.push_back(' ');
+    if (rq.url_.size() > originLen_) {
+        buffer.append(rq.url_, originLen_, string::npos);
+    }
+    else {
+        buffer.push_back('/');
+    }
+    buffer.append(" HTTP/1.1\r\nHost: ");
+    buffer.append(host_);
+    buffer.append("\r\n");
+
+    bool hasAccept(false);
+    for (const auto & header: rq.headers_) {
+        if (iequals(header.first.c_str(), header.first.size(), "accept")) {
+            hasAccept = true;
+        }
+        buffer.append(header.first);
+        buffer.append(": ");
+        buffer.append(header.second);
+        buffer.append("\r\n");
+    }
+    if (!hasAccept) {
+        buffer.append("Accept: */*\r\n");
+    }
+
+    if (rq.verb_ != "GET") {
+        const HttpRequest::Content & content = rq.content_;
+        buffer.append("Content-Length: ");
+        buffer.append(to_string(content.str.size()));
+        buffer.append("\r\n");
+        if (!content.contentType.empty()) {
+            buffer.append("Content-Type: ");
+            buffer.append(content.contentType);
+            buffer.append("\r\n");
+        }
+        buffer.append("\r\n");
+        buffer.append(content.str);
+    }
+    else {
+        buffer.append("\r\n");
+    }
+}
+
+/* Returns false if the connection was closed */
+bool
+NativeHttpClient::
+flush(Connection * conn)
+{
+    string & buffer = conn->sendBuffer;
+    while (conn->sendOffset < buffer.size()) {
+        ssize_t res = ::send(conn->fd, buffer.data() + conn->sendOffset,
+                             buffer.size() - conn->sendOffset, MSG_NOSIGNAL);
+        if (res > 0) {
+            conn->sendOffset += res;
+        }
+        else if (res == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (res == -1 && errno == EAGAIN) {
+            break;
+        }
+        else {
+            closeConnection(conn);
+            return false;
+        }
+    }
+
+    if (conn->sendOffset == buffer.size()) {
+        /* keeps the capacity for the next requests */
+        buffer.clear();
+        conn->sendOffset = 0;
+        setEvents(conn, EPOLLIN);
+    }
+    else {
+        setEvents(conn, EPOLLIN | EPOLLOUT);
+    }
+
+    return true;
+}
+
+/* Returns false if the connection was closed */
+bool
+NativeHttpClient::
+onReadable(Connection * conn)
+{
+    while (true) {
+        ssize_t res = ::recv(conn->fd, readBuffer_.data(), readBuffer_.size(),
+                             0);
+        if (res > 0) {
+            if (!parse(conn, readBuffer_.data(), res)) {
+                return false;
+            }
+            if ((size_t) res < readBuffer_.size()) {
+                return true;
+            }
+        }
+        else if (res == 0) {
+            /* The end of a response without a length is marked by the
+               closing of the connection */
+            if (conn->state == Connection::BODY_UNTIL_CLOSE
+                && !conn->inFlight.empty()) {
+                finishResponse(conn);
+            }
+            else {
+                closeConnection(conn);
+            }
+            return false;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno == EAGAIN) {
+            return true;
+        }
+        else {
+            closeConnection(conn);
+            return false;
+        }
+    }
+}
+
+
+/* response parsing */
+
+/* Returns false if the connection was closed */
+bool
+NativeHttpClient::
+parse(Connection * conn, const char * data, size_t size)
+{
+    size_t pos(0);
+
+    while (pos < size) {
+        if (conn->inFlight.empty()) {
+            /* unsolicited data */
+            closeConnection(conn);
+            return false;
+        }
+
+        Request * request = conn->inFlight.front();
+        request->responseStarted = true;
+        const HttpRequest & rq = request->request;
+
+        switch (conn->state) {
+        case Connection::BODY:
+        case Connection::CHUNK_DATA: {
+            size_t len = min<uint64_t>(conn->remaining, size - pos);
+            if (!request->done) {
+                rq.callbacks_->onData(rq, data + pos, len);
+            }
+            pos += len;
+            conn->remaining -= len;
+            if (conn->remaining == 0) {
+                if (conn->state == Connection::CHUNK_DATA) {
+                    conn->state = Connection::CHUNK_END;
+                }
+                else if (!finishResponse(conn)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case Connection::BODY_UNTIL_CLOSE:
+            if (!request->done) {
+                rq.callbacks_->onData(rq, data + pos, size - pos);
+            }
+            pos = size;
+            break;
+        default: {
+            const char * start = data + pos;
+            const char * eol = (const char *) ::memchr(start, '\n', size - pos);
+            size_t len = eol ? eol - start + 1 : size - pos;
+            conn->line.append(start, len);
+            pos += len;
+            if (!eol) {
+                if (conn->line.size() > MaxLineLength) {
+                    closeConnection(conn);
+                    return false;
+                }
+                break;
+            }
+            if (!handleLine(conn)) {
+                return false;
+            }
+            conn->line.clear();
+        }
+        }
+    }
+
+    return true;
+}
+
+/* Handles the complete line in "conn->line", including its line
+   terminator. Returns false if the connection was closed. */
+bool
+NativeHttpClient::
+handleLine(Connection * conn)
+{
+    Request * request = conn->inFlight.front();
+    const HttpRequest & rq = request->request;
+    const string & line = conn->line;
+
+    size_t len = line.size();
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+
+    switch (conn->state) {
+    case Connection::STATUS_LINE: {
+        if (len == 0) {
+            return true;
+        }
+        size_t space = line.find(' ');
+        if (line.compare(0, 5, "HTTP/") != 0 || space == string::npos) {
+            closeConnection(conn);
+            return false;
+        }
+        string version = line.substr(0, space);
+        int code = ::atoi(line.c_str() + space + 1);
+        if (code < 100 || code > 999) {
+            closeConnection(conn);
+            return false;
+        }
+
+        conn->code = code;
+        conn->informational = (code < 200);
+        conn->keepAlive = (version != "HTTP/1.0");
+        conn->chunked = false;
+        conn->contentLength = -1;
+        conn->state = Connection::HEADERS;
+        if (!conn->informational && !request->done) {
+            rq.callbacks_->onResponseStart(rq, version, code);
+        }
+        return true;
+    }
+
+    case Connection::HEADERS: {
+        if (len == 0) {
+            if (conn->informational) {
+                conn->state = Connection::STATUS_LINE;
+                return true;
+            }
+            if (!request->done) {
+                rq.callbacks_->onHeader(rq, line.data(), line.size());
+            }
+            if (rq.verb_ == "HEAD" || conn->code == 204 || conn->code == 304) {
+                return finishResponse(conn);
+            }
+            if (conn->chunked) {
+                conn->state = Connection::CHUNK_SIZE;
+                return true;
+            }
+            if (conn->contentLength >= 0) {
+                if (conn->contentLength == 0) {
+                    return finishResponse(conn);
+                }
+                conn->remaining = conn->contentLength;
+                conn->state = Connection::BODY;
+                return true;
+            }
+            conn->keepAlive = false;
+            conn->state = Connection::BODY_UNTIL_CLOSE;
+            return true;
+        }
+
+        if (conn->informational) {
+            return true;
+        }
+        if (!request->done) {
+            rq.callbacks_->onHeader(rq, line.data(), line.size());
+        }
+
+        size_t colon = line.find(':');
+        if (colon == string::npos || colon > len) {
+            return true;
+        }
+        size_t valueStart = colon + 1;
+        while (valueStart < len && isSpace(line[valueStart])) {
+            valueStart++;
+        }
+        size_t valueEnd = len;
+        while (valueEnd > valueStart && isSpace(line[valueEnd - 1])) {
+            valueEnd--;
+        }
+        const char * value = line.data() + valueStart;
+        size_t valueLen = valueEnd - valueStart;
+
+        if (iequals(line.data(), colon, "content-length")) {
+            conn->contentLength = ::strtoll(value, nullptr, 10);
+        }
+        else if (iequals(line.data(), colon, "transfer-encoding")) {
+            conn->chunked = !iequals(value, valueLen, "identity");
+        }
+        else if (iequals(line.data(), colon, "connection")) {
+            if (iequals(value, valueLen, "close")) {
+                conn->keepAlive = false;
+            }
+            else if (iequals(value, valueLen, "keep-alive")) {
+                conn->keepAlive = true;
+            }
+        }
+        return true;
+    }
+
+    case Connection::CHUNK_SIZE: {
+        char * end;
+        uint64_t chunkSize = ::strtoull(line.c_str(), &end, 16);
+        if (end == line.c_str()) {
+            closeConnection(conn);
+            return false;
+        }
+        if (chunkSize == 0) {
+            conn->state = Connection::TRAILERS;
+        }
+        else {
+            conn->remaining = chunkSize;
+            conn->state = Connection::CHUNK_DATA;
+        }
+        return true;
+    }
+
+    case Connection::CHUNK_END:
+        if (len != 0) {
+            closeConnection(conn);
+            return false;
+        }
+        conn->state = Connection::CHUNK_SIZE;
+        return true;
+
+    case Connection::TRAILERS:
+        if (len == 0) {
+            return finishResponse(conn);
+        }
+        return true;
+
+    default:
+        throw ML::Exception("unexpected parser state");
+    }
+}
+
+/* Returns false if the connection was closed */
+bool
+NativeHttpClient::
+finishResponse(Connection * conn)
+{
+    Request * request = conn->inFlight.front();
+    conn->inFlight.pop_front();
+    conn->numResponses++;
+    conn->state = Connection::STATUS_LINE;
+
+    bool keepAlive = conn->keepAlive;
+    finishRequest(request, HttpClientError::NONE);
+
+    if (!keepAlive) {
+        closeConnection(conn);
+        return false;
+    }
+    if (conn->inFlight.empty()) {
+        idle_.push_back(conn);
+    }
+
+    return true;
+}
@@ -0,0 +1,133 @@
+/* http_client_native.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Implementation of HttpClient written directly on epoll.
+*/
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jml/arch/wakeup_fd.h"
+
+#include "soa/types/date.h"
+#include "soa/service/http_client_impl.h"
+
+
+namespace Datacratic {
+
+/* NATIVEHTTPCLIENT */
+
+/* HttpClient implementation that speaks HTTP/1.1 directly over non-blocking
+   sockets, without the per-request setup costs of curl:
+   - up to "numParallel" keep-alive connections to the host are kept open
+     and reused from one request to the next;
+   - once "enablePipelining" has been called, up to "maxPipelined" requests
+     are written on a connection without waiting for the previous responses;
+   - requests with a timeout get an absolute deadline when they are
+     enqueued, enforced with a realtime timerfd: the callback is invoked
+     with HttpClientError::TIMEOUT as soon as the deadline passes, whether
+     the request is still queued, being sent or waiting for its response.
+
+   Requests that did not receive any part of their response when their
+   connection was lost (eg, a keep-alive connection closed by the server, or
+   requests pipelined behind one that timed out) are retried once on
+   another connection.
+
+   Only the "http" scheme is supported.
+*/
+struct NativeHttpClient : public HttpClientImpl {
+    NativeHttpClient(const std::string & baseUrl, int numParallel);
+    NativeHttpClient(const NativeHttpClient & other) = delete;
+
+    ~NativeHttpClient();
+
+    /** Maximum number of requests in flight on one connection, once
+        pipelining has been enabled */
+    int maxPipelined;
+
+    /* HttpClientImpl */
+    virtual void enablePipelining();
+    virtual bool enqueueRequest(const std::string & verb,
+                                const std::string & resource,
+                                const std::shared_ptr<HttpClientCallbacks>
+                                & callbacks,
+                                const HttpRequest::Content & content,
+                                const RestParams & queryParams,
+                                const RestParams & headers,
+                                double timeout);
+
+    /* AsyncEventSource */
+    virtual int selectFd() const;
+    virtual bool processOne();
+
+private:
+    struct Request;
+    struct Connection;
+
+    void handleWakeupEvent();
+    void handleTimerEvent();
+    void handleConnectionEvent(Connection * conn, uint32_t events);
+
+    /* requests */
+    void dispatch();
+    void finishRequest(Request * request, HttpClientError error);
+    void timeoutRequest(Request * request);
+    void expireDeadlines(Date now);
+    void removeDeadline(Request * request);
+    void updateTimer();
+
+    /* connections */
+    bool resolve();
+    Connection * newConnection(HttpClientError & error);
+    void closeConnection(Connection * conn,
+                         HttpClientError connectError
+                         = HttpClientError::NONE);
+    void setEvents(Connection * conn, uint32_t events);
+    void writeRequest(Connection * conn, Request * request);
+    bool flush(Connection * conn);
+    bool onReadable(Connection * conn);
+
+    /* response parsing */
+    bool parse(Connection * conn, const char * data, size_t size);
+    bool handleLine(Connection * conn);
+    bool finishResponse(Connection * conn);
+
+    std::string host_;       /* "hostname[:port]", for the Host header */
+    std::string hostname_;
+    int port_;
+    size_t originLen_;       /* length of "scheme://host[:port]" in urls */
+
+    bool resolved_;
+    Date lastResolve_;
+    ::sockaddr_storage address_;
+    ::socklen_t addressLen_;
+
+    bool pipelining_;
+
+    int fd_;
+    ML::Wakeup_Fd wakeup_;
+    int timerFd_;
+    Date timerSetFor_;
+
+    typedef std::mutex Mutex;
+    typedef std::unique_lock<Mutex> Guard;
+    Mutex queueLock_;
+    std::vector<Request *> queue_; /* enqueued from other threads */
+
+    /* everything below is only touched from the message loop */
+    std::deque<Request *> pending_;             /* waiting for a connection */
+    std::multimap<Date, Request *> deadlines_;
+    std::vector<Connection *> connections_;
+    std::vector<Connection *> idle_;            /* open, nothing in flight */
+    std::vector<Connection *> closed_;          /* deleted after processOne */
+    std::vector<char> readBuffer_;
+};
+
+} // namespace Datacratic
@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <mutex>
+#include <boost/thread/tss.hpp>
 #include <unordered_map>
 #include <vector>
 
@@ -62,8 +63,30 @@ namespace {
 struct Registry {
     std::mutex lock;
     std::unordered_map<std::string, std::unique_ptr<Logging::CategoryData> > categories;
+
+    // writers keep state between head() and body()
+    std::mutex writeLock;
+};
+
+struct Message {
+    std::stringstream text;
+    char timestamp[64];
+    char const * function;
+    char const * file;
+    int line;
 };
 
+// message being written by the calling thread to the given category
+Message & getMessage(Logging::CategoryData const * category) {
+    typedef std::unordered_map<Logging::CategoryData const *, Message> Messages;
+    static boost::thread_specific_ptr<Messages> messages;
+    if(!messages.get()) {
+        messages.reset(new Messages);
+    }
+
+    return (*messages)[category];
+}
+
 Registry& getRegistry() {
     // Will leak but that's on program exit so who cares.
     static Registry* registry = new Registry;
@@ -78,7 +101,6 @@ struct Logging::CategoryData {
     bool enabled;
     char const * name;
     std::shared_ptr<Writer> writer;
-    std::stringstream stream;
 
     CategoryData * parent;
     std::vector<CategoryData *> children;
@@ -269,18 +291,32 @@ void Logging::Category::writeTo(std::shared_ptr<Writer> output, bool recurse) {
 std::ostream & Logging::Category::beginWrite(char const * fct, char const * file, int line) {
     timeval now;
     gettimeofday(&now, 0);
-    char text[64];
-    auto count = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&now.tv_sec));
+    tm parts;
+    localtime_r(&now.tv_sec, &parts);
+
+    auto & message = getMessage(data);
+    char * text = message.timestamp;
+    auto count = strftime(text, sizeof(message.timestamp), "%Y-%m-%d %H:%M:%S", &parts);
     int ms = now.tv_usec / 1000;
     sprintf(text + count, ".%03d", ms);
-    data->writer->head(text, data->name, fct, file, line);
-    return data->stream;
+    message.function = fct;
+    message.file = file;
+    message.line = line;
+    return message.text;
+}
+
+void Logging::Category::endWrite(std::ostream & stream) {
+    auto & message = getMessage(data);
+    std::string text = message.text.str();
+    message.text.str("");
+
+    std::lock_guard<std::mutex> guard(getRegistry().writeLock);
+    data->writer->head(message.timestamp, data->name, message.function, message.file, message.line);
+    data->writer->body(text);
 }
 
 void Logging::Printer::operator&(std::ostream & stream) {
-    std::stringstream & text = (std::stringstream &) stream;
-    category.getWriter()->body(text.str());
-    text.str("");
+    category.endWrite(stream);
 }
 
 void Logging::Thrower::operator&(std::ostream & stream) {
@@ -105,6 +105,12 @@ struct Logging
 
         std::ostream & beginWrite(char const * function, char const * file, int line);
 
+        /** Hands the message that this thread started with beginWrite() to
+            the writer.  Messages are built per thread, so categories can be
+            written to from many threads at once.
+        */
+        void endWrite(std::ostream & stream);
+
         static Category& root();
 
     private:
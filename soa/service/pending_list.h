@@ -10,7 +10,13 @@
 
 #include "timeout_map.h"
 #include "leveldb/db.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/write_batch.h"
 #include "jml/utils/guard.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 
 namespace Datacratic {
 
@@ -36,13 +42,21 @@ struct PendingPersistence {
 };
 
 struct LeveldbPendingPersistence : public PendingPersistence {
+    /* Most lookups are for things that were never stored (or already
+       erased), so a bloom filter per table saves reading a data block
+       from disk for nearly all of them.  It must outlive the db. */
+    std::shared_ptr<const leveldb::FilterPolicy> filterPolicy;
     std::shared_ptr<leveldb::DB> db;
 
     void open(const std::string & filename)
     {
+        if (!filterPolicy)
+            filterPolicy.reset(leveldb::NewBloomFilterPolicy(10));
+
         leveldb::DB* db;
         leveldb::Options options;
         options.create_if_missing = true;
+        options.filter_policy = filterPolicy.get();
         leveldb::Status status
             = leveldb::DB::Open(options, filename, &db);
         this->db.reset(db);
@@ -178,6 +192,291 @@ struct LeveldbPendingPersistence : public PendingPersistence {
     }
 };
 
+
+/*****************************************************************************/
+/* BATCHED LEVELDB PENDING PERSISTENCE                                       */
+/*****************************************************************************/
+
+/** Leveldb persistence that takes the disk writes off the caller's thread.
+
+    Mutations are appended to a leveldb::WriteBatch which a background
+    thread commits as a single write once commitBytes worth have built up
+    or commitInterval seconds after the first one went in, whichever comes
+    first.  Until its batch has been committed, a mutation lives in an
+    in-memory overlay that get() and pop() look at before the database, so
+    that readers always see their own writes.
+
+    Durability is bounded by the commit interval: anything that has not
+    been committed is lost if the process dies.  Call flush() to wait for
+    everything written so far to reach leveldb, and set syncCommits to
+    also have each batch synced to disk before it counts as committed.
+
+    If the writers get more than maxPendingBytes ahead of the commit
+    thread, put() and erase() block until it catches up.  An error
+    committing a batch is thrown from the next put(), erase() or flush().
+*/
+
+struct BatchedLeveldbPendingPersistence : public LeveldbPendingPersistence {
+
+    BatchedLeveldbPendingPersistence(double commitInterval = 0.01,
+                                     size_t commitBytes = 1024 * 1024,
+                                     bool syncCommits = false)
+        : commitInterval(commitInterval),
+          commitBytes(commitBytes),
+          maxPendingBytes(8 * commitBytes),
+          syncCommits(syncCommits),
+          pendingBytes(0), committingBytes(0),
+          numWritten(0), numCommitted(0),
+          numWaiters(0), shutdown_(false)
+    {
+    }
+
+    ~BatchedLeveldbPendingPersistence()
+    {
+        shutdown();
+    }
+
+    /** Parameters; these must be set before open() is called. */
+    double commitInterval;   ///< Max seconds a mutation waits for commit
+    size_t commitBytes;      ///< Commit once a batch is this big
+    size_t maxPendingBytes;  ///< Writers block beyond this much backlog
+    bool syncCommits;        ///< Sync each batch to disk when committing
+
+    void open(const std::string & filename)
+    {
+        if (committer)
+            throw ML::Exception("BatchedLeveldbPendingPersistence: "
+                                "already open");
+
+        LeveldbPendingPersistence::open(filename);
+        shutdown_ = false;
+        committer.reset(new std::thread([=] () { this->runCommitter(); }));
+    }
+
+    /** Commit everything that is pending and stop the commit thread.  Any
+        error committing the final batch is lost, since this is called from
+        the destructor; call flush() first to see it.
+    */
+    void shutdown()
+    {
+        if (!committer)
+            return;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            shutdown_ = true;
+        }
+        wakeCommitter.notify_one();
+        committer->join();
+        committer.reset();
+    }
+
+    /** Block until everything written before the call has been committed
+        to leveldb (and synced to disk if syncCommits is set).
+    */
+    void flush()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t target = numWritten;
+        ++numWaiters;
+        wakeCommitter.notify_one();
+        while (numCommitted < target && commitError.empty())
+            committed.wait(guard);
+        --numWaiters;
+        checkCommitError();
+    }
+
+    /** Number of bytes of mutations waiting for their batch to commit,
+        including those of the batch being written to leveldb. */
+    size_t backlogBytes() const
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return pendingBytes + committingBytes;
+    }
+
+    virtual void put(const std::string & key, const std::string & value)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        waitForRoom(guard);
+        pending.Put(key, value);
+        record(guard, key, false, value);
+    }
+
+    virtual void erase(const std::string & key)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        waitForRoom(guard);
+        pending.Delete(key);
+        record(guard, key, true, std::string());
+    }
+
+    /** Reads the value from the overlay if it has not been committed yet,
+        and queues the erase rather than performing it synchronously.
+    */
+    virtual std::string pop(const std::string & key)
+    {
+        std::string result = get(key);
+        erase(key);
+        return result;
+    }
+
+    virtual std::string
+    get(const std::string & key) const
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            auto it = overlay.find(key);
+            if (it != overlay.end()) {
+                if (it->second.erased)
+                    throw ML::Exception("Writing to leveldb: NotFound: ");
+                return it->second.value;
+            }
+        }
+
+        // Not in the overlay, so the database has the latest value: the
+        // committer only removes an entry once its batch has been written.
+        return LeveldbPendingPersistence::get(key);
+    }
+
+    /** Scanning is only done at startup, so we simply make sure that the
+        database is up to date rather than merging in the overlay.
+    */
+    virtual void scan(const OnEntry & fn,
+                      const OnError & onError) const
+    {
+        const_cast<BatchedLeveldbPendingPersistence *>(this)->flush();
+        LeveldbPendingPersistence::scan(fn, onError);
+    }
+
+private:
+    /** Latest uncommitted mutation of a key. */
+    struct OverlayEntry {
+        bool erased;
+        std::string value;
+        uint64_t written;   ///< Value of numWritten that recorded it
+    };
+
+    std::unordered_map<std::string, OverlayEntry> overlay;
+
+    leveldb::WriteBatch pending;         ///< Mutations not yet committed
+    std::vector<std::string> pendingKeys;
+    size_t pendingBytes;
+    size_t committingBytes;              ///< Of the batch being written
+    Date firstPending;                   ///< When the batch was started
+
+    uint64_t numWritten;                 ///< Mutations ever recorded
+    uint64_t numCommitted;               ///< Mutations ever committed
+    std::string commitError;
+
+    mutable std::mutex lock;
+    std::condition_variable wakeCommitter;
+    std::condition_variable committed;   ///< Signalled after each commit
+    int numWaiters;                      ///< Threads blocked on a commit
+    bool shutdown_;
+    std::unique_ptr<std::thread> committer;
+
+    void checkCommitError() const
+    {
+        if (!commitError.empty())
+            throw ML::Exception("Writing to leveldb: " + commitError);
+    }
+
+    void waitForRoom(std::unique_lock<std::mutex> & guard)
+    {
+        if (!committer)
+            throw ML::Exception("BatchedLeveldbPendingPersistence: not open");
+        checkCommitError();
+        if (pendingBytes + committingBytes < maxPendingBytes)
+            return;
+        ++numWaiters;
+        wakeCommitter.notify_one();
+        while (pendingBytes + committingBytes >= maxPendingBytes
+               && commitError.empty())
+            committed.wait(guard);
+        --numWaiters;
+        checkCommitError();
+    }
+
+    void record(std::unique_lock<std::mutex> & guard,
+                const std::string & key, bool erased,
+                const std::string & value)
+    {
+        bool startsBatch = pendingKeys.empty();
+        if (startsBatch)
+            firstPending = Date::now();
+
+        OverlayEntry & entry = overlay[key];
+        entry.erased = erased;
+        entry.value = value;
+        entry.written = ++numWritten;
+
+        pendingKeys.push_back(key);
+        pendingBytes += key.size() + value.size();
+
+        // The committer needs to start the clock on a new batch
+        if (startsBatch || pendingBytes >= commitBytes)
+            wakeCommitter.notify_one();
+    }
+
+    void runCommitter()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        for (;;) {
+            if (pendingKeys.empty()) {
+                if (shutdown_)
+                    return;
+                wakeCommitter.wait(guard);
+                continue;
+            }
+
+            // Wait until the batch is big or old enough, unless someone
+            // is waiting on it in flush() or for room in put().
+            Date deadline = firstPending.plusSeconds(commitInterval);
+            double toWait = deadline.secondsSince(Date::now());
+            if (toWait > 0 && pendingBytes < commitBytes
+                && !shutdown_ && numWaiters == 0) {
+                wakeCommitter.wait_for
+                    (guard, std::chrono::microseconds(int64_t(toWait * 1e6)));
+                continue;
+            }
+
+            leveldb::WriteBatch batch;
+            std::swap(batch, pending);
+            std::vector<std::string> keys;
+            keys.swap(pendingKeys);
+            committingBytes = pendingBytes;
+            pendingBytes = 0;
+            uint64_t batchEnd = numWritten;
+
+            guard.unlock();
+
+            leveldb::WriteOptions options;
+            options.sync = syncCommits;
+            leveldb::Status status = db->Write(options, &batch);
+
+            guard.lock();
+
+            if (!status.ok()) {
+                commitError = status.ToString();
+                committed.notify_all();
+                return;
+            }
+
+            // Entries that weren't overwritten since are now in the db
+            for (const std::string & key: keys) {
+                auto it = overlay.find(key);
+                if (it != overlay.end() && it->second.written <= batchEnd)
+                    overlay.erase(it);
+            }
+
+            numCommitted = batchEnd;
+            committingBytes = 0;
+            committed.notify_all();
+        }
+    }
+};
+
+
 template<typename Key, typename Value>
 struct PendingPersistenceT {
     typedef boost::function<std::string(const Key &)> StringifyKey;
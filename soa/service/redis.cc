@@ -15,6 +15,12 @@
 #include "jml/arch/backtrace.h"
 #include "jml/arch/futex.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/arch/wakeup_fd.h"
+#include <strings.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <cmath>
 
 
 using namespace std;
@@ -383,9 +389,11 @@ enum {
 size_t requestDataCreated = 0;
 size_t requestDataDestroyed = 0;
 
-struct AsyncConnection::RequestData
-    : std::enable_shared_from_this<AsyncConnection::RequestData> {
-    RequestData()
+struct AsyncConnection::RequestData {
+    RequestData(const Command & command, const OnResult & onResult,
+                Date timeout, Link * link)
+        : command(command), onResult(onResult), timeout(timeout),
+          link(link), state(WAITING), hasTimeout(false)
     {
         ML::atomic_inc(requestDataCreated);
     }
@@ -395,190 +403,331 @@ struct AsyncConnection::RequestData
         ML::atomic_inc(requestDataDestroyed);
     }
 
+    Command command;
     OnResult onResult;
-    std::string command;
     Date timeout;
-    AsyncConnection * connection;
-    int64_t id;
-    Requests::iterator requestIterator;
-    Timeouts::iterator timeoutIterator;
+    Link * link;
     int state;
+    bool hasTimeout;
+    std::multimap<Date, RequestData *>::iterator timeoutIterator;
 };
 
 size_t eventLoopsCreated = 0;
 size_t eventLoopsDestroyed = 0;
 
-struct AsyncConnection::EventLoop {
+namespace {
 
-    int wakeupfd[2];
-    volatile bool finished;
-    AsyncConnection * connection;
-    std::shared_ptr<boost::thread> thread;
-    pollfd fds[2];
-    volatile int disconnected;
+/// Connection whose thread we are running on, if any
+__thread void * currentLink = 0;
+
+/// Used to give each thread its own connection to each address
+std::atomic<unsigned> numThreadsSeen(0);
+__thread unsigned threadIndex = 0;
+
+} // file scope
+
+
+/** A single connection to Redis, with its own thread that does all of the
+    talking to hiredis.
+
+    Other threads only ever touch the list of submitted commands (under a
+    lock that is held just long enough to append to it) and the wakeup fd,
+    which is only signalled when the list goes from empty to non empty.
+    Everything else, including the timeouts, belongs to the thread.
+*/
+struct AsyncConnection::Link {
 
-    EventLoop(AsyncConnection * connection)
-        : finished(false), connection(connection), disconnected(1)
+    typedef std::multimap<Date, RequestData *> Timeouts;
+
+    Link(const Address & address, double batchWindow)
+        : address(address), batchWindow(batchWindow), context(0),
+          earliestSubmitted(Date::positiveInfinity()),
+          wakeup(EFD_NONBLOCK), finished(false),
+          numPending(0), numTimeouts(0)
     {
         ML::atomic_inc(eventLoopsCreated);
-        
-        int res = pipe2(wakeupfd, O_NONBLOCK);
-        if (res == -1)
-            throw ML::Exception(errno, "pipe2");
 
-        //cerr << "connection on fd " << connection->context_->c.fd << endl;
+        if (address.isTcp()) {
+            context = redisAsyncConnect(address.tcpHost().c_str(),
+                                        address.tcpPort());
+        }
+        else if (address.isUnix()) {
+            context = redisAsyncConnectUnix(address.unixPath().c_str());
+        }
+        else throw ML::Exception("cannot connect to address that is neither "
+                                 "tcp or unix");
 
+        if (!context)
+            throw ML::Exception("no connection to Redis");
 
-        fds[0].fd = wakeupfd[0];
+        if (context->err) {
+            string error = context->errstr;
+            redisAsyncFree(context);
+            throw ML::Exception("Redis command connect returned error %s",
+                                error.c_str());
+        }
+
+        fds[0].fd = wakeup.fd();
         fds[0].events = POLLIN;
-        fds[1].fd = connection->context_->c.fd;
+        fds[1].fd = context->c.fd;
         fds[1].events = 0;
 
-        registerMe(connection->context_);
-
-        thread.reset(new boost::thread(boost::bind(&EventLoop::run, this)));
+        registerMe();
 
-#if 0
-        char buf[1];
-        res = read(wakeupfd[0], buf, 1);
-        if (res == -1)
-            throw ML::Exception(errno, "read");
-#endif
+        thread.reset(new std::thread(std::bind(&Link::run, this)));
     }
 
-    ~EventLoop()
+    ~Link()
     {
-        //cerr << "DESTROYING EVENT LOOP" << endl;
-        ML::atomic_inc(eventLoopsDestroyed);
         shutdown();
+        ML::atomic_inc(eventLoopsDestroyed);
     }
 
+    Address address;
+    double batchWindow;
+
+    /// Null once hiredis has freed it (on disconnection)
+    redisAsyncContext * context;
+
+    std::mutex submitLock;
+    std::vector<RequestData *> submitted;
+    Date firstSubmitted;
+    Date earliestSubmitted;  ///< Earliest timeout of what was submitted
+    ML::Wakeup_Fd wakeup;
+
+    std::vector<RequestData *> sending;
+    Timeouts timeouts;
+    std::vector<std::function<void ()> > replies;
+    pollfd fds[2];
+    volatile bool finished;
+    std::unique_ptr<std::thread> thread;
+
+    std::atomic<size_t> numPending;
+    std::atomic<size_t> numTimeouts;
+
     void shutdown()
     {
         if (!thread) return;
 
         finished = true;
-        wakeup();
+        wakeup.signal();
         thread->join();
         thread.reset();
-        ::close(wakeupfd[0]);
-        ::close(wakeupfd[1]);
     }
 
-    void wakeup()
-    {
-        int res = write(wakeupfd[1], "x", 1);
-        if (res == -1)
-            throw ML::Exception("error waking up fd %d: %s", wakeupfd[1],
-                                strerror(errno));
-    }
-    
-    void registerMe(redisAsyncContext * context)
+    /** Hand over commands to be sent.  They are sent together and in
+        order. */
+    void submit(RequestData * const * requests, size_t n)
     {
-        //cerr << "called registerMe" << endl;
-        redisAsyncSetConnectCallback(context, onConnect);
-        redisAsyncSetDisconnectCallback(context, onDisconnect);
+        numPending += n;
 
-        context->ev.data = context->data = this;
-        context->ev.addRead = startReading;
-        context->ev.delRead = stopReading;
-        context->ev.addWrite = startWriting;
-        context->ev.delWrite = stopWriting;
-        context->ev.cleanup = cleanup;
+        bool wasEmpty;
+        {
+            std::unique_lock<std::mutex> guard(submitLock);
+            wasEmpty = submitted.empty();
+            if (wasEmpty && batchWindow > 0)
+                firstSubmitted = Date::now();
+            for (size_t i = 0;  i < n;  ++i)
+                if (requests[i]->timeout < earliestSubmitted)
+                    earliestSubmitted = requests[i]->timeout;
+            submitted.insert(submitted.end(), requests, requests + n);
+        }
+
+        // Our own thread will look at the list before it goes back to sleep
+        if (wasEmpty && currentLink != this)
+            wakeup.signal();
     }
 
     void run()
     {
-        //wakeup();
-
-        //cerr << this << " starting run loop" << endl;
+        currentLink = this;
 
         while (!finished) {
-            //sleep(1);
             Date now = Date::now();
 
-            if (connection->earliestTimeout < now)
-                connection->expireTimeouts(now);
-
-            double timeLeft = now.secondsUntil(connection->earliestTimeout);
-
-            //cerr << "timeLeft = " << timeLeft << endl;
-            //cerr << "fds[0].events = " << fds[0].events << endl;
-            //cerr << "fds[1].events = " << fds[1].events << endl;
+            expireTimeouts(now);
+            runReplies();
 
-            int timeout = std::min(1000.0,
-                                   std::max<double>(0, 1000 * timeLeft));
+            double timeLeft = std::min(1.0, flushSubmitted(now));
+            if (!timeouts.empty())
+                timeLeft = std::min(timeLeft,
+                                    now.secondsUntil(timeouts.begin()->first));
+            timeLeft = std::max(0.0, timeLeft);
 
-            if (connection->earliestTimeout == Date::positiveInfinity())
-                timeout = 1000000;
+            timespec timeout;
+            timeout.tv_sec = timeLeft;
+            timeout.tv_nsec = (timeLeft - timeout.tv_sec) * 1000000000;
 
-            //cerr << "looping; fd0 = " << fds[1].fd << " timeout = "
-            //     << timeout << endl;
-
-            int res = poll(fds, 2, timeout);
+            int res = ppoll(fds, 2, &timeout, 0);
             if (res == -1 && errno != EINTR) {
                 cerr << "poll() error: " << strerror(errno) << endl;
             }
-            if (res == 0) continue;  // just a timeout; loop around again
+            if (res <= 0) continue;  // just a timeout; loop around again
 
-            //cerr << "poll() returned " << res << endl;
+            if (fds[0].revents & POLLIN)
+                wakeup.tryRead();
 
-            if (fds[0].revents & POLLIN) {
-                //cerr << "got wakeup" << endl;
-                char buf[128];
-                int res = read(fds[0].fd, buf, 128);
-                if (res == -1)
-                    throw ML::Exception(errno, "read from wakeup pipe");
-                //cerr << "woken up with " << res << " messages" << endl;
-            }
-            if ((fds[1].revents & POLLOUT)
+            if (context
+                && (fds[1].revents & POLLOUT)
                 && (fds[1].events & POLLOUT)) {
-                //cerr << "got write on " << fds[1].fd << endl;
-                boost::unique_lock<Lock> guard(connection->lock);
-                redisAsyncHandleWrite(connection->context_);
+                redisAsyncHandleWrite(context);
             }
-            if ((fds[1].revents & POLLIN)
+            if (context
+                && (fds[1].revents & (POLLIN | POLLERR | POLLHUP))
                 && (fds[1].events & POLLIN)) {
-                //cerr << "got read on " << fds[1].fd << endl;
-                boost::unique_lock<Lock> guard(connection->lock);
-                redisAsyncHandleRead(connection->context_);
+                redisAsyncHandleRead(context);
             }
+        }
 
-            // Now we don't have the lock anymore, do our callbacks
-            while (!connection->replyQueue.empty()) {
-                try {
-                    connection->replyQueue.front()();
-                } catch (...) {
-                    cerr << "warning: redis callback threw" << endl;
-                    //abort();
-                }
-                connection->replyQueue.pop_front();
+        // Fail whatever was never sent, then let hiredis fail whatever
+        // is still waiting for a reply.
+        {
+            std::unique_lock<std::mutex> guard(submitLock);
+            sending.swap(submitted);
+        }
+        for (RequestData * data: sending)
+            fail(data, "connection closed");
+        sending.clear();
+
+        if (context)
+            redisAsyncFree(context);
+        context = 0;
+
+        runReplies();
+
+        currentLink = 0;
+    }
+
+    /** Give the submitted commands to hiredis, unless we're still waiting
+        for more of them to batch up.  Returns the number of seconds until
+        they should be sent.
+    */
+    double flushSubmitted(Date now)
+    {
+        {
+            std::unique_lock<std::mutex> guard(submitLock);
+            if (submitted.empty())
+                return INFINITY;
+
+            if (batchWindow > 0) {
+                double timeLeft
+                    = std::min(batchWindow - firstSubmitted.secondsUntil(now),
+                               now.secondsUntil(earliestSubmitted));
+                if (timeLeft > 0)
+                    return timeLeft;
+            }
+
+            sending.swap(submitted);
+            earliestSubmitted = Date::positiveInfinity();
+        }
+
+        for (RequestData * data: sending) {
+            if (data->timeout <= now) {
+                fail(data, Result::timeoutError);
+                continue;
+            }
+
+            if (!context) {
+                fail(data, "no connection to Redis");
+                continue;
+            }
+
+            vector<const char *> argv = data->command.argv();
+            vector<size_t> argl = data->command.argl();
+
+            int res = redisAsyncCommandArgv(context, resultCallback, data,
+                                            data->command.argc(),
+                                            &argv[0], &argl[0]);
+            if (res != REDIS_OK) {
+                fail(data, context && context->err
+                     ? context->errstr : "couldn't queue Redis command");
+                continue;
+            }
+
+            if (data->timeout.isADate()) {
+                data->timeoutIterator
+                    = timeouts.insert(make_pair(data->timeout, data));
+                data->hasTimeout = true;
+                ++numTimeouts;
             }
         }
 
-        if (!disconnected) {
-            // Disconnect
-            //cerr << this << " calling redisAsyncDisconnect" << endl;
-            redisAsyncDisconnect(connection->context_);
-            //redisAsyncFree(connection->context_);
-            //cerr << this << " done redisAsyncDisconnect" << endl;
+        sending.clear();
+
+        // Write the whole batch now rather than on the next loop around
+        if (context && (fds[1].events & POLLOUT))
+            redisAsyncHandleWrite(context);
+
+        return INFINITY;
+    }
+
+    /** Fail a request that hiredis doesn't know about. */
+    void fail(RequestData * data, const std::string & error)
+    {
+        --numPending;
+        if (data->onResult)
+            replies.push_back(std::bind(data->onResult, Result(error)));
+        delete data;
+    }
+
+    /** Called when something knows that at least one timeout is expired;
+        expire them.  The requests stay around until hiredis gives us their
+        reply.
+    */
+    void expireTimeouts(Date now)
+    {
+        auto it = timeouts.begin(), end = timeouts.end();
+        for (;  it != end;  ++it) {
+            if (it->first > now) break;
+
+            RequestData * data = it->second;
+            data->state = TIMEDOUT;
+            data->hasTimeout = false;
+            --numTimeouts;
+
+            if (data->onResult)
+                replies.push_back(std::bind(data->onResult,
+                                            Result(Result::timeoutError)));
         }
-        
-        // Wait until we get the callback
-        while (!disconnected) {
-            futex_wait(disconnected, 0);
+
+        timeouts.erase(timeouts.begin(), it);
+    }
+
+    /** Call the callbacks for everything that finished.  They are called
+        outside of hiredis so that they can do what they like.
+    */
+    void runReplies()
+    {
+        for (unsigned i = 0;  i < replies.size();  ++i) {
+            try {
+                replies[i]();
+            } catch (...) {
+                cerr << "warning: redis callback threw" << endl;
+            }
         }
+        replies.clear();
+    }
 
-        //cerr << this << " now disconnected" << endl;
+    void registerMe()
+    {
+        // Needs to be done before the callbacks are set, as setting the
+        // connect callback asks for a write event
+        context->ev.data = context->data = this;
+        context->ev.addRead = startReading;
+        context->ev.delRead = stopReading;
+        context->ev.addWrite = startWriting;
+        context->ev.delWrite = stopWriting;
+        context->ev.cleanup = cleanup;
+
+        redisAsyncSetConnectCallback(context, onConnect);
+        redisAsyncSetDisconnectCallback(context, onDisconnect);
     }
 
     static void onConnect(const redisAsyncContext * context, int status)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(context->data);
+        Link * link = reinterpret_cast<Link *>(context->data);
 
-        if (status == REDIS_OK)
-            eventLoop->onConnect(status);
-        else {
+        if (status != REDIS_OK) {
             /* This function will be called with an error status if the
                connection failed.  For us it's like a disconnection, so
                we call into the disconnect code.
@@ -586,120 +735,134 @@ struct AsyncConnection::EventLoop {
             cerr << "onConnect: code = " << status << " err = " << context->err
                  << " errstr = " << context->errstr << " errno = "
                  << strerror(errno) << endl;
-            eventLoop->onDisconnect(status);
+            link->onDisconnect(status);
         }
     }
 
-    void onConnect(int status)
-    {
-        //cerr << "connection on fd " << connection->context_->c.fd << endl;
-        //cerr << "status = " << status << endl;
-        fds[1].fd = connection->context_->c.fd;
-        wakeup();
-        disconnected = 0;
-        futex_wake(disconnected);
-    }
-
     static void onDisconnect(const redisAsyncContext * context, int status)
     {
-        //cerr << "onDisconnect" << endl;
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(context->data);
-        eventLoop->onDisconnect(status);
-    }
-
-    void onDisconnect(int status)
-    {
+        Link * link = reinterpret_cast<Link *>(context->data);
         if (status != REDIS_OK) {
-            cerr << "disconnection with status " << status << endl;
-            cerr << "onConnect: code = " << status << " err = "
-                 << connection->context_->err
-                 << " errstr = "
-                 << connection->context_->errstr << " errno = "
-                 << strerror(errno) << endl;
+            cerr << "disconnection from " << link->address.uri()
+                 << " with status " << status << " err = " << context->err
+                 << " errstr = " << context->errstr << endl;
         }
-        disconnected = 1;
-        futex_wake(disconnected);
+        link->onDisconnect(status);
     }
 
-    static void startReading(void * privData)
+    void onDisconnect(int status)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(privData);
-        eventLoop->startReading();
+        // hiredis frees the context once we return
+        context = 0;
+        fds[1].fd = -1;
+        fds[1].events = 0;
     }
 
-    void startReading()
+    static void startReading(void * privData)
     {
-        //cerr << "start reading" << endl;
-        //if (fds[1].events & POLLIN) return;  // already reading
-        fds[1].events |= POLLIN;
-        wakeup();
+        reinterpret_cast<Link *>(privData)->fds[1].events |= POLLIN;
     }
 
     static void stopReading(void * privData)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(privData);
-        eventLoop->stopReading();
-    }
-
-    void stopReading()
-    {
-        //cerr << "stop reading" << endl;
-        fds[1].events &= ~POLLIN;
+        reinterpret_cast<Link *>(privData)->fds[1].events &= ~POLLIN;
     }
 
     static void startWriting(void * privData)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(privData);
-        eventLoop->startWriting();
-    }
-
-    void startWriting()
-    {
-        //cerr << "start writing" << endl;
-        //if (fds[1].events & POLLOUT) return;  // already reading
-        fds[1].events |= POLLOUT;
-        wakeup();
+        reinterpret_cast<Link *>(privData)->fds[1].events |= POLLOUT;
     }
 
     static void stopWriting(void * privData)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(privData);
-        eventLoop->stopWriting();
-    }
-
-    void stopWriting()
-    {
-        //cerr << "stop writing" << endl;
-        fds[1].events &= ~POLLOUT;
+        reinterpret_cast<Link *>(privData)->fds[1].events &= ~POLLOUT;
     }
 
     static void cleanup(void * privData)
     {
-        EventLoop * eventLoop = reinterpret_cast<EventLoop *>(privData);
-        eventLoop->cleanup();
     }
+};
 
-    void cleanup()
-    {
-        //cerr << this << " doing cleanup" << endl;
-        //backtrace();
+
+namespace {
+
+/** Hash used for the consistent hashing of keys.  It needs to give the
+    same result in every process, which std::hash doesn't promise.
+*/
+uint64_t hashBytes(const char * p, size_t n)
+{
+    // FNV-1a with a final mix so that similar strings are spread out
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0;  i < n;  ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
     }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool isOneOf(const std::string & command,
+             const char * const * names, size_t numNames)
+{
+    for (unsigned i = 0;  i < numNames;  ++i)
+        if (strcasecmp(command.c_str(), names[i]) == 0)
+            return true;
+    return false;
+}
+
+/** Commands whose first argument is not a key. */
+bool hasKey(const Command & command)
+{
+    static const char * const noKey[] = {
+        "KEYS", "PING", "MULTI", "EXEC", "DISCARD", "UNWATCH", "RANDOMKEY",
+        "SELECT", "INFO", "DBSIZE", "FLUSHDB", "FLUSHALL", "EVAL",
+        "EVALSHA", "SCRIPT", "CONFIG"
+    };
+    return !command.args.empty()
+        && !isOneOf(command.formatStr, noKey, sizeof(noKey) / sizeof(noKey[0]));
+}
+
+bool isTransaction(const Command & command)
+{
+    static const char * const transaction[] = {
+        "MULTI", "EXEC", "WATCH", "UNWATCH", "DISCARD"
+    };
+    return isOneOf(command.formatStr, transaction,
+                   sizeof(transaction) / sizeof(transaction[0]));
+}
+
+enum {
+    VIRTUAL_NODES_PER_ADDRESS = 160
 };
 
+} // file scope
+
 
 AsyncConnection::
 AsyncConnection()
-    : context_(0), idNum(0)
+    : batchWindow(0.0), connectionsPerAddress(1), idNum(0)
 {
 }
 
 AsyncConnection::
 AsyncConnection(const Address & address)
-    : context_(0), idNum(0)
+    : batchWindow(0.0), connectionsPerAddress(1), idNum(0)
 {
     connect(address);
 }
 
+AsyncConnection::
+AsyncConnection(const std::vector<Address> & addresses,
+                int connectionsPerAddress)
+    : batchWindow(0.0), connectionsPerAddress(1), idNum(0)
+{
+    connect(addresses, connectionsPerAddress);
+}
+
 AsyncConnection::
 ~AsyncConnection()
 {
@@ -710,45 +873,67 @@ void
 AsyncConnection::
 connect(const Address & address)
 {
-    //cerr << "connecting to redis " << address.uri() << endl;
+    connect(vector<Address>({ address }), 1);
+}
 
+void
+AsyncConnection::
+connect(const std::vector<Address> & addresses, int connectionsPerAddress)
+{
     close();
 
-    this->address = address;
+    if (addresses.empty())
+        throw ML::Exception("no Redis address to connect to");
+    ExcAssertGreater(connectionsPerAddress, 0);
 
-    if (address.isTcp()) {
-        context_ = redisAsyncConnect(address.tcpHost().c_str(),
-                                     address.tcpPort());
-    }
-    else if (address.isUnix()) {
-        context_ = redisAsyncConnectUnix(address.unixPath().c_str());
+    this->addresses = addresses;
+    this->connectionsPerAddress = connectionsPerAddress;
+
+    if (addresses.size() > 1) {
+        for (unsigned i = 0;  i < addresses.size();  ++i) {
+            for (unsigned j = 0;  j < VIRTUAL_NODES_PER_ADDRESS;  ++j) {
+                string node = addresses[i].uri() + "#" + to_string(j);
+                ring.push_back(make_pair(hashBytes(node.c_str(), node.size()),
+                                         i));
+            }
+        }
+        std::sort(ring.begin(), ring.end());
     }
-    else throw ML::Exception("cannot connect to address that is neither tcp "
-                             "or unix");
-    checkError("connect");
 
-    eventLoop.reset(new EventLoop(this));
+    for (auto & address: addresses)
+        for (unsigned i = 0;  i < connectionsPerAddress;  ++i)
+            links.emplace_back(new Link(address, batchWindow));
 }
 
 void
 AsyncConnection::
 test()
 {
+    // Ping every connection, not just the one for this thread
+    std::atomic<int> numLeft(links.size());
     int done = 0;
 
     string error;
+    std::mutex errorLock;
     
     auto onResponse = [&] (const Redis::Result & result)
         {
-            if (result) {
-                //cerr << "got reply " << result.reply() << endl;
+            if (!result) {
+                std::unique_lock<std::mutex> guard(errorLock);
+                error = result.error();
+            }
+            if (--numLeft == 0) {
+                done = 1;
+                futex_wake(done);
             }
-            else error = result.error();
-            done = 1;
-            futex_wake(done);
         };
 
-    queue(PING, onResponse, 2.0);
+    Date timeout = Date::now().plusSeconds(2.0);
+    for (auto & link: links) {
+        RequestData * data
+            = new RequestData(PING, onResponse, timeout, link.get());
+        link->submit(&data, 1);
+    }
 
     while (!done)
         futex_wait(done, 0);
@@ -757,72 +942,113 @@ test()
         throw ML::Exception("couldn't connect to Redis: " + error);
 }
 
-
-
 void
 AsyncConnection::
 close()
 {
-    if (!context_) return;
+    links.clear();
+    ring.clear();
+    addresses.clear();
+}
 
-    if (eventLoop) {
-        eventLoop->shutdown();
-        eventLoop.reset();
+int
+AsyncConnection::
+shardForKey(const std::string & key) const
+{
+    if (ring.empty())
+        return 0;
+
+    // Only hash what is within {braces}, if there is something there
+    const char * p = key.c_str();
+    size_t n = key.size();
+
+    auto open = key.find('{');
+    if (open != string::npos) {
+        auto close = key.find('}', open + 1);
+        if (close != string::npos && close != open + 1) {
+            p += open + 1;
+            n = close - open - 1;
+        }
     }
-    
-    context_ = 0;
+
+    uint64_t hash = hashBytes(p, n);
+    auto it = std::lower_bound(ring.begin(), ring.end(), make_pair(hash, -1));
+    if (it == ring.end())
+        it = ring.begin();
+    return it->second;
 }
 
-void
+int
 AsyncConnection::
-resultCallback(redisAsyncContext * context, void * reply, void * privData)
+shardForCommand(const Command & command) const
 {
-    //cerr << "resultCallback with reply " << reply << " privData "
-    //     << privData << endl;
-    //cerr << "context->err = " << context->err << endl;
-    //cerr << "context->errstr = " << context->errstr << endl;
-    //cerr << "context->c.errstr = " << context->c.errstr << endl;
+    if (ring.empty() || !hasKey(command))
+        return 0;
+    return shardForKey(command.args[0]);
+}
 
-    ExcAssert(privData);
+AsyncConnection::Link &
+AsyncConnection::
+linkFor(int shard) const
+{
+    if (links.empty())
+        throw ML::Exception("no connection to Redis");
 
-    // Get a shared pointer to our data so it doesn't go away
-    RequestData * dataRawPtr
-        = reinterpret_cast<RequestData *>(privData);
-    std::shared_ptr<RequestData> data
-        = dataRawPtr->shared_from_this();
+    if (connectionsPerAddress == 1)
+        return *links[shard];
 
-    //cerr << "command " << data->command << endl;
-    //cerr << "reply " << reply << endl;
+    if (!threadIndex)
+        threadIndex = ++numThreadsSeen;
 
-    // Remove from data structures
-    AsyncConnection * c = data->connection;
+    return *links[shard * connectionsPerAddress
+                  + threadIndex % connectionsPerAddress];
+}
 
-    {
-        boost::unique_lock<Lock> guard(c->lock);
-        
-        if (data->requestIterator != c->requests.end()) {
-            c->requests.erase(data->requestIterator);
-            data->requestIterator = c->requests.end();
-        }
-        
-        if (data->timeoutIterator != c->timeouts.end()) {
-            c->timeouts.erase(data->timeoutIterator);
-            data->timeoutIterator = c->timeouts.end();
-            if (c->timeouts.empty())
-                c->earliestTimeout = Date::positiveInfinity();
-            else c->earliestTimeout = c->timeouts.begin()->first;
-        }
+size_t
+AsyncConnection::
+numRequestsPending() const
+{
+    size_t result = 0;
+    for (auto & link: links)
+        result += link->numPending;
+    return result;
+}
 
-        if (data->state != WAITING) return;  // raced; timeout happened
-        data->state = REPLIED;
+size_t
+AsyncConnection::
+numTimeoutsPending() const
+{
+    size_t result = 0;
+    for (auto & link: links)
+        result += link->numTimeouts;
+    return result;
+}
+
+void
+AsyncConnection::
+resultCallback(redisAsyncContext * context, void * reply, void * privData)
+{
+    ExcAssert(privData);
+
+    std::unique_ptr<RequestData> data(reinterpret_cast<RequestData *>(privData));
+    Link * link = data->link;
+
+    --link->numPending;
+
+    if (data->hasTimeout) {
+        link->timeouts.erase(data->timeoutIterator);
+        --link->numTimeouts;
     }
 
+    if (data->state != WAITING) return;  // timeout happened
+    data->state = REPLIED;
+
+    if (!data->onResult) return;
 
     Result result;
 
     if (reply) {
         Reply replyObj((redisReply *)reply, false /* take ownership */);
-        //cerr << "reply = " << replyObj << endl;
         if (replyObj.type() == ERROR) {
             // Command error, return it
             result = Result(replyObj.asString());
@@ -835,14 +1061,13 @@ resultCallback(redisAsyncContext * context, void * reply, void * privData)
         }
     }
     else {
-        // Context encountered an error; return it
-        result = Result(data->connection->context_->errstr);
+        // Context encountered an error or was closed; return it
+        result = Result(context->err ? context->errstr : "connection closed");
     }
 
-    // Queue up a reply object so it can be called without the lock held.  If
-    // we call directly from here, then the lock has to be held and so deadlock
-    // is possible.
-    c->replyQueue.push_back(std::bind(data->onResult, result));
+    // Queue up a reply object so that it is called once hiredis is done
+    // with us.
+    link->replies.push_back(std::bind(data->onResult, result));
 }
 
 int64_t
@@ -851,11 +1076,8 @@ queue(const Command & command,
       const OnResult & onResult,
       Timeout timeout)
 {
-    boost::unique_lock<Lock> guard(lock);
+    Link & link = linkFor(shardForCommand(command));
 
-    ExcAssert(context_);
-    ExcAssert(!context_->err);
-    
     // Check basics
     if (timeout.expiry.isADate() && Date::now() >= timeout.expiry) {
         onResult(Result(Result::timeoutError));
@@ -864,52 +1086,10 @@ queue(const Command & command,
 
     int64_t id = idNum++;
     
-    // Create data structure to be passed around
-    std::shared_ptr<RequestData> data(new RequestData);
-    data->onResult = onResult;
-    data->timeout = timeout.expiry;
-    data->command = command.formatStr;
-    //data->timeout = Date::notADate();
-    data->connection = this;
-    data->id = id;
-    data->requestIterator = requests.end();
-    data->timeoutIterator = timeouts.end();
-    data->state = WAITING;
-
-    ExcAssertEqual(requests.count(id), 0);
-
-    //cerr << "data = " << data << endl;
-
-    auto it = requests.insert(make_pair(id, data)).first;
-    data->requestIterator = it;
-
-    // Does the servicing thread possibly need to be woken up?
-    bool needWakeup = false;
-    
-    if (timeout.expiry.isADate()) {
-        needWakeup = !timeouts.empty()
-            && timeout.expiry < timeouts.begin()->first;
-        data->timeoutIterator = timeouts.insert(make_pair(timeout.expiry, it));
-        earliestTimeout = timeouts.begin()->first;
-    }
-    
-    vector<const char *> argv = command.argv();
-    vector<size_t> argl = command.argl();
+    RequestData * data
+        = new RequestData(command, onResult, timeout.expiry, &link);
+    link.submit(&data, 1);
 
-    int result = redisAsyncCommandArgv(context_, resultCallback, data.get(),
-                                       command.argc(),
-                                       &argv[0],
-                                       &argl[0]);
-    
-    if (result != REDIS_OK) {
-        //cerr << "result not OK" << endl;
-        resultCallback(context_, 0, data.get());
-        return -1;
-    }
-    
-    if (needWakeup)
-        eventLoop->wakeup();
-    
     return id;
 }
 
@@ -975,17 +1155,51 @@ queueMulti(const std::vector<Command> & commands,
     
     auto results
         = std::make_shared<MultiAggregator>(commands.size(), onResults);
-    
-    // Make sure they all get executed as a block
-    boost::unique_lock<Lock> guard(lock);
-    
-    // Now queue them one at a time
+
+    if (timeout.expiry.isADate() && Date::now() >= timeout.expiry) {
+        for (unsigned i = 0;  i < commands.size();  ++i)
+            results->result(i, Result(Result::timeoutError));
+        return;
+    }
+
+    // A transaction has to go entirely over one connection; otherwise each
+    // command goes where its key lives.
+    int transactionShard = -1;
+    if (ring.size()) {
+        for (auto & command: commands) {
+            if (isTransaction(command)) {
+                transactionShard = 0;
+                break;
+            }
+        }
+        if (transactionShard != -1) {
+            for (auto & command: commands) {
+                if (hasKey(command) && !isTransaction(command)) {
+                    transactionShard = shardForKey(command.args[0]);
+                    break;
+                }
+            }
+        }
+    }
+    else transactionShard = 0;
+
+    // Commands going to the same connection are submitted together, in
+    // order, so that they are executed as a block
+    vector<vector<RequestData *> > byShard(numShards());
+
     for (unsigned i = 0;  i < commands.size();  ++i) {
-        queue(commands[i],
-              std::bind(&MultiAggregator::result, results, i,
-                        std::placeholders::_1),
-              timeout);
+        int shard = transactionShard == -1
+            ? shardForCommand(commands[i]) : transactionShard;
+        byShard[shard].push_back(
+                new RequestData(commands[i],
+                                std::bind(&MultiAggregator::result, results, i,
+                                          std::placeholders::_1),
+                                timeout.expiry, &linkFor(shard)));
     }
+
+    for (auto & requests: byShard)
+        if (!requests.empty())
+            requests[0]->link->submit(&requests[0], requests.size());
 }
 
 Results
@@ -1017,31 +1231,4 @@ cancel(int handle)
     throw ML::Exception("AsyncConnection::cancel(): not done");
 }
 
-void
-AsyncConnection::
-expireTimeouts(Date now)
-{
-    boost::unique_lock<Lock> guard(lock);
-    
-    auto it = timeouts.begin(), end = timeouts.end();
-    for (;  it != end;  ++it) {
-        if (it->first > now) break;
-
-        auto resultIt = it->second;
-        auto data = resultIt->second;
-
-        data->state = TIMEDOUT;
-        data->onResult(Result(Result::timeoutError));
-        data->timeoutIterator = end;
-
-        // Let it be cleaned up from hiredis once it's finished
-    }
-
-    timeouts.erase(timeouts.begin(), it);
-
-    if (timeouts.empty())
-        earliestTimeout = Date::positiveInfinity();
-    else earliestTimeout = timeouts.begin()->first;
-}
-
 } // namespace Redis
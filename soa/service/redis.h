@@ -23,6 +23,9 @@
 #include <boost/thread/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
 
 
 namespace Redis {
@@ -357,7 +360,29 @@ struct Address {
 /* ASYNC CONNECTION                                                          */
 /*****************************************************************************/
 
-/** Asynchronous connection to Redis. */
+/** Asynchronous connection to Redis.
+
+    Commands are sent over a pool of connectionsPerAddress connections to
+    each address, each of which has its own thread.  Commands are
+    pipelined: all of the commands queued on a connection while its
+    thread is busy (or within batchWindow seconds of the first one) are
+    written to the socket in one go.
+
+    When several addresses are given, keys are spread over them by
+    consistent hashing of the first argument of each command.  As with
+    Redis Cluster, only the part of a key within {braces} is hashed when
+    present, so that related keys can be kept together.  Commands without
+    a key (PING, MULTI, EXEC, KEYS, ...) go to the first address;
+    transactions must thus be sent with queueMulti(), which keeps them on
+    the connection of the first key that they touch.
+
+    Commands queued from one thread on one address are always sent over
+    the same connection, so they are executed in the order in which they
+    were queued.
+
+    Timeouts are handled by the thread of the connection that the command
+    was sent on.  Callbacks are called from those threads.
+*/
 
 struct AsyncConnection {
     
@@ -365,10 +390,19 @@ struct AsyncConnection {
     
     AsyncConnection(const Address & address);
 
+    AsyncConnection(const std::vector<Address> & addresses,
+                    int connectionsPerAddress = 1);
+
     ~AsyncConnection();
 
     void connect(const Address & address);
 
+    /** Connect to the given set of addresses, over which the keys will be
+        sharded, with the given number of connections to each.
+    */
+    void connect(const std::vector<Address> & addresses,
+                 int connectionsPerAddress = 1);
+
     /** Test the connection by sending a ping and waiting for the response.
         This is synchronous.  Once this method returns, it is sure that
         the connection works.
@@ -377,6 +411,14 @@ struct AsyncConnection {
 
     void close();
 
+    /** Maximum number of seconds that a connection will wait, after a
+        command is queued on it, for more commands to write along with it.
+        With the default of zero, commands are written as soon as the
+        connection's thread gets to them, which already batches everything
+        queued while it was busy.  Must be set before connect().
+    */
+    double batchWindow;
+
     // Struct to specify a timeout, either absolute or relative
     struct Timeout {
         Timeout() // no timeout
@@ -410,7 +452,11 @@ struct AsyncConnection {
     /** Execute synchronously. */
     Result exec(const Command & command, Timeout timeout = Timeout());
 
-    /** Queue a list of asynchronous commands atomically with a timeout. */
+    /** Queue a list of asynchronous commands with a timeout.  The commands
+        that go to the same address are sent together, in order; a list
+        containing a transaction (MULTI, EXEC, WATCH or DISCARD) is sent
+        entirely to the address of its first key.
+    */
     void queueMulti(const std::vector<Command> & commands,
                     const OnResults & onResults = OnResults(),
                     Timeout timeout = Timeout());
@@ -422,58 +468,40 @@ struct AsyncConnection {
     /** Cancel the given command. */
     void cancel(int handle);
     
-    size_t numRequestsPending() const
-    {
-        return requests.size();
-    }
+    size_t numRequestsPending() const;
 
-    size_t numTimeoutsPending() const
-    {
-        return timeouts.size();
-    }
-    
-private:
-    std::deque<std::function<void ()> > replyQueue;
-    
-    static void resultCallback(redisAsyncContext * context, void *, void *);
+    size_t numTimeoutsPending() const;
 
-    struct RequestData;
+    /** Number of addresses that the keys are sharded over. */
+    size_t numShards() const { return addresses.size(); }
 
-    typedef boost::recursive_mutex Lock;
-    Lock lock;
+    /** Index of the address that the given key is stored on. */
+    int shardForKey(const std::string & key) const;
 
-    typedef std::map<uint64_t, std::shared_ptr<RequestData> > Requests;
-    Requests requests;
-    
-    typedef std::multimap<Datacratic::Date, Requests::iterator> Timeouts;
-    Timeouts timeouts;
+    /** Index of the address that the given command will be sent to. */
+    int shardForCommand(const Command & command) const;
 
-    /** Called when something knows that at least one timeout is expired;
-        expire them.
-    */
-    void expireTimeouts(Datacratic::Date now);
+private:
+    struct RequestData;
+    struct Link;
+    struct MultiAggregator;
 
-    Datacratic::Date earliestTimeout;
+    std::vector<Address> addresses;
+    int connectionsPerAddress;
 
-    void checkError(const char * command)
-    {
-        if (!context_)
-            throw ML::Exception("no connection to Redis");
+    /// addresses.size() * connectionsPerAddress connections, grouped by
+    /// address
+    std::vector<std::unique_ptr<Link> > links;
 
-        if (context_->err) {
-            throw ML::Exception("Redis command %s returned error %s",
-                                command, context_->errstr);
-        }
-    }
+    /// Consistent hash ring of (hash, address index), sorted by hash
+    std::vector<std::pair<uint64_t, int> > ring;
 
-    Address address;
-    redisAsyncContext * context_;
-    int64_t idNum;
+    std::atomic<int64_t> idNum;
 
-    struct EventLoop;
-    std::shared_ptr<EventLoop> eventLoop;
+    /** Connection to use for the given shard from the current thread. */
+    Link & linkFor(int shard) const;
 
-    struct MultiAggregator;
+    static void resultCallback(redisAsyncContext * context, void *, void *);
 };
 
 } // namespace Datacratic
@@ -37,6 +37,8 @@
 #include <boost/iostreams/stream_buffer.hpp>
 #include <exception>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <unordered_map>
 
 #include <boost/filesystem.hpp>
@@ -157,6 +159,9 @@ defaultBandwidthToServiceMbps = 20.0;
 
 S3Api::
 S3Api()
+    : pathStyleRequests(false),
+      streamingDownloadThreads(-1),
+      streamingDownloadChunkSize(0)
 {
     bandwidthToServiceMbps = defaultBandwidthToServiceMbps;
 }
@@ -171,7 +176,10 @@ S3Api(const std::string & accessKeyId,
       accessKey(accessKey),
       defaultProtocol(defaultProtocol),
       serviceUri(serviceUri),
-      bandwidthToServiceMbps(bandwidthToServiceMbps)
+      bandwidthToServiceMbps(bandwidthToServiceMbps),
+      pathStyleRequests(false),
+      streamingDownloadThreads(-1),
+      streamingDownloadChunkSize(0)
 {
 }
 
@@ -501,6 +509,11 @@ prepare(const RequestParams & request) const
             + request.resource
             + (request.subResource != "" ? "?" + request.subResource : "");
     }
+    else if (pathStyleRequests) {
+        result.uri = protocol + "://" + serviceUri + "/" + request.bucket
+            + request.resource
+            + (request.subResource != "" ? "?" + request.subResource : "");
+    }
     else {
         result.uri = protocol + "://" + request.bucket + "." + serviceUri
             + request.resource
@@ -1142,8 +1155,7 @@ S3Api::ObjectInfo::
 ObjectInfo(const S3Api::Response & response)
 {
     exists = true;
-    lastModified = Date::parse(response.getHeader("last-modified"),
-            "%a, %e %b %Y %H:%M:%S %Z");
+    lastModified = Date::parseRfc2616(response.getHeader("last-modified"));
     size = response.header_.contentLength;
     etag = response.getHeader("etag");
     storageClass = ""; // Not available in headers
@@ -1648,15 +1660,18 @@ struct StreamingDownloadSource {
         impl->info = owner->getObjectInfo(bucket, object);
         impl->baseChunkSize = 1024 * 1024;  // start with 1MB and ramp up
 
-        int numThreads = 1;
-        if (impl->info.size > 1024 * 1024)
-            numThreads = 2;
-        if (impl->info.size > 16 * 1024 * 1024)
-            numThreads = 3;
-        if (impl->info.size > 256 * 1024 * 1024)
-            numThreads = 5;
-        
-        impl->start(numThreads);
+        int numThreads = owner->streamingDownloadThreads;
+        if (numThreads <= 0) {
+            numThreads = 1;
+            if (impl->info.size > 1024 * 1024)
+                numThreads = 2;
+            if (impl->info.size > 16 * 1024 * 1024)
+                numThreads = 3;
+            if (impl->info.size > 256 * 1024 * 1024)
+                numThreads = 5;
+        }
+
+        impl->start(numThreads, owner->streamingDownloadChunkSize);
     }
 
     typedef char char_type;
@@ -1688,8 +1703,14 @@ struct StreamingDownloadSource {
 
         /* variables set during or after "start" has been called */
         size_t maxChunkSize;
+        unsigned int maxBufferedChunks; /* chunks being downloaded or
+                                         * waiting for the reader */
+
+        /* everything below is protected by "lock" */
+        std::mutex lock;
+        std::condition_variable changed;
 
-        atomic<bool> shutdown;
+        bool shutdown;
         exception_ptr lastExc;
 
         /* read thread */
@@ -1698,67 +1719,73 @@ struct StreamingDownloadSource {
 
         string readPart; /* data buffer for the part of the stream being
                           * transferred to the caller */
-        ssize_t readPartOffset; /* number of bytes from "readPart" that have
-                                 * been returned to the caller, or -1 when
-                                 * awaiting a new part */
-        int readPartDone; /* the number of the chunk representing "readPart" */
+        size_t readPartOffset; /* number of bytes from "readPart" that have
+                                * been returned to the caller */
+        unsigned int readPartDone; /* the number of the chunk following
+                                    * "readPart" */
 
         /* http threads */
-        typedef RingBufferSRMW<string> ThreadData;
+        unsigned int nextChunk; /* the next chunk to request */
+        uint64_t nextOffset; /* the offset of that chunk */
+        std::map<unsigned int, string> chunks; /* reorder buffer of chunks
+                                                * received ahead of the
+                                                * reader */
 
-        int numThreads; /* number of http threads */
         vector<thread> threads; /* thread pool */
-        vector<ThreadData> threadQueues; /* per-thread queue of chunk data */
 
         /* cleanup all the variables that are used during reading, the
            "static" ones are left untouched */
         void reset()
         {
             shutdown = false;
+            lastExc = nullptr;
 
             readOffset = 0;
 
             readPart = "";
-            readPartOffset = -1;
+            readPartOffset = 0;
             readPartDone = 0;
 
-            threadQueues.clear();
+            nextChunk = 0;
+            nextOffset = 0;
+            chunks.clear();
+
             threads.clear();
-            numThreads = 0;
         }
 
-        void start(int nThreads)
+        void start(int numThreads, size_t chunkSize)
         {
-            // Maximum chunk size is what we can do in 3 seconds
-            maxChunkSize = (owner->bandwidthToServiceMbps
-                            * 3.0 * 1000000);
-            size_t sysMemory = getTotalSystemMemory();
-
-            //cerr << "sysMemory = " << sysMemory << endl;
-            // Limit each chunk to 1% of system memory
-            maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
-            //cerr << "maxChunkSize = " << maxChunkSize << endl;
-            numThreads = nThreads;
-
-            for (int i = 0; i < numThreads; i++) {
-                threadQueues.emplace_back(2);
+            if (chunkSize) {
+                baseChunkSize = maxChunkSize = chunkSize;
             }
-            
-            /* ensure that the queues are ready before the threads are
-               launched */
-            ML::memory_barrier();
+            else {
+                // Maximum chunk size is what we can do in 3 seconds
+                maxChunkSize = (owner->bandwidthToServiceMbps
+                                * 3.0 * 1000000);
+                size_t sysMemory = getTotalSystemMemory();
+
+                //cerr << "sysMemory = " << sysMemory << endl;
+                // Limit each chunk to 1% of system memory
+                maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
+                maxChunkSize = std::max(maxChunkSize, baseChunkSize);
+                //cerr << "maxChunkSize = " << maxChunkSize << endl;
+            }
+
+            maxBufferedChunks = 2 * numThreads;
 
             for (int i = 0; i < numThreads; i++) {
-                auto threadFn = [&] (int threadNum) {
-                    this->runThread(threadNum);
-                };
-                threads.emplace_back(threadFn, i);
+                threads.emplace_back(&Impl::runThread, this);
             }
         }
 
         void stop()
         {
-            shutdown = true;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                shutdown = true;
+            }
+            changed.notify_all();
+
             for (thread & th: threads) {
                 th.join();
             }
@@ -1769,31 +1796,19 @@ struct StreamingDownloadSource {
         /* reader thread */
         std::streamsize read(char_type* s, std::streamsize n)
         {
-            if (lastExc) {
-                rethrow_exception(lastExc);
-            }
-
-            if (readOffset == info.size)
-                return -1;
+            if (readPartOffset == readPart.size()) {
+                if (readOffset == info.size)
+                    return -1;
 
-            if (readPartOffset == -1) {
                 waitNextPart();
             }
 
-            if (lastExc) {
-                rethrow_exception(lastExc);
-            }
-
             size_t toDo = min<size_t>(readPart.size() - readPartOffset,
                                       n);
             const char_type * start = readPart.c_str() + readPartOffset;
             std::copy(start, start + toDo, s);
 
             readPartOffset += toDo;
-            if (readPartOffset == readPart.size()) {
-                readPartOffset = -1;
-            }
-
             readOffset += toDo;
 
             return toDo;
@@ -1801,54 +1816,52 @@ struct StreamingDownloadSource {
 
         void waitNextPart()
         {
-            int partThread = readPartDone % numThreads;
-            ThreadData & threadQueue = threadQueues[partThread];
+            std::unique_lock<std::mutex> guard(lock);
 
-            /* We set a timeout to avoid dead locking when http threads have
-             * exited after an exception. */
-            while (!lastExc) {
-                if (threadQueue.tryPop(readPart, 1.0)) {
-                    break;
-                }
+            auto it = chunks.end();
+            changed.wait(guard, [&] () {
+                    it = chunks.find(readPartDone);
+                    return lastExc || it != chunks.end();
+                });
+
+            if (lastExc) {
+                rethrow_exception(lastExc);
             }
 
+            readPart = std::move(it->second);
             readPartOffset = 0;
+            chunks.erase(it);
             readPartDone++;
+
+            /* there is now room for one more chunk in the window */
+            changed.notify_all();
         }
 
         /* download threads */
-        void runThread(int threadNum)
+        void runThread()
         {
-            ThreadData & threadQueue = threadQueues[threadNum];
-
-            uint64_t start = 0;
-            unsigned int prevChunkNbr = 0;
+            std::unique_lock<std::mutex> guard(lock);
 
             try {
-                for (int loop = 0;; loop++) {
-                    /* number of the chunk that we need to process */
-                    unsigned int chunkNbr = loop * numThreads + threadNum;
-
-                    /* we adjust the offset by adding the chunk sizes of all
-                       the chunks downloaded between our previous loop until
-                       now */
-                    for (unsigned int i = prevChunkNbr; i < chunkNbr; i++) {
-                        start += getChunkSize(i);
-                    }
-
-                    if (start >= info.size) {
+                for (;;) {
+                    changed.wait(guard, [&] () {
+                            return shutdown || lastExc
+                                || nextOffset >= info.size
+                                || nextChunk < readPartDone + maxBufferedChunks;
+                        });
+
+                    if (shutdown || lastExc || nextOffset >= info.size) {
                         /* we are done */
                         return;
                     }
-                    prevChunkNbr = chunkNbr;
 
-                    size_t chunkSize = getChunkSize(chunkNbr);
-                    uint64_t end = start + chunkSize;
-                    if (end > info.size) {
-                        end = info.size;
-                        chunkSize = end - start;
-                    }
+                    unsigned int chunkNbr = nextChunk++;
+                    uint64_t start = nextOffset;
+                    size_t chunkSize = std::min<uint64_t>(getChunkSize(chunkNbr),
+                                                          info.size - start);
+                    nextOffset += chunkSize;
 
+                    guard.unlock();
                     auto partResult
                         = owner->get(bucket, "/" + object,
                                      S3Api::Range(start, chunkSize));
@@ -1858,29 +1871,27 @@ struct StreamingDownloadSource {
                                             + " while getting part "
                                             + partResult.bodyXmlStr());
                     }
+                    guard.lock();
 
-                    while (true) {
-                        if (shutdown || lastExc) {
-                            return;
-                        }
-                        if (threadQueue.tryPush(partResult.body())) {
-                            break;
-                        }
-                        else {
-                            ML::sleep(0.1);
-                        }
-                    }
+                    chunks[chunkNbr] = partResult.body();
+                    changed.notify_all();
                 }
             }
             catch (...) {
+                if (!guard.owns_lock()) {
+                    guard.lock();
+                }
                 lastExc = current_exception();
+                changed.notify_all();
             }
         }
 
         size_t getChunkSize(unsigned int chunkNbr)
             const
         {
-            size_t chunkSize = std::min(baseChunkSize * (1 << (chunkNbr / 2)),
+            // double every two chunks, without overflowing the shift
+            unsigned int doublings = std::min(chunkNbr / 2, 32u);
+            size_t chunkSize = std::min(baseChunkSize << doublings,
                                         maxChunkSize);
             return chunkSize;
         }
@@ -1932,7 +1943,9 @@ struct StreamingUploadSource {
         impl->bucket = bucket;
         impl->object = object;
         impl->metadata = metadata;
-        impl->chunkSize = 8 * 1024 * 1024;  // start with 8MB and ramp up
+        if (metadata.partSize)
+            impl->chunkSize = metadata.partSize;
+        else impl->chunkSize = 8 * 1024 * 1024;  // start with 8MB and ramp up
 
         impl->start();
     }
@@ -1947,8 +1960,7 @@ struct StreamingUploadSource {
 
     struct Impl {
         Impl()
-            : owner(0), offset(0), chunkIndex(0), shutdown(false),
-              chunks(16)
+            : owner(0), offset(0), chunkIndex(0), shutdown(false)
         {
         }
 
@@ -2038,8 +2050,10 @@ struct StreamingUploadSource {
         };
 
         Chunk current;
-        
-        RingBufferSWMR<Chunk> chunks;
+
+        /* parts waiting for an upload thread; bounded so that a fast writer
+           blocks rather than buffering the whole object */
+        std::unique_ptr<RingBufferSWMR<Chunk> > chunks;
 
         std::mutex etagsLock;
         std::vector<std::string> etags;
@@ -2055,6 +2069,7 @@ struct StreamingUploadSource {
             //<< "threads!!! " << endl;
 
             startDate = Date::now();
+            chunks.reset(new RingBufferSWMR<Chunk>(metadata.numThreads + 1));
             for (unsigned i = 0;  i < metadata.numThreads;  ++i)
                 tg.create_thread(boost::bind<void>(&Impl::runThread, this));
             current.init(0, chunkSize, 0);
@@ -2090,11 +2105,12 @@ struct StreamingUploadSource {
         void flush()
         {
             if (current.size == 0) return;
-            chunks.push(std::move(current));
+            chunks->push(std::move(current));
             ++chunkIndex;
 
             // Get bigger for bigger files
-            if (chunkIndex % 5 == 0 && chunkSize < 64 * 1024 * 1024)
+            if (!metadata.partSize
+                && chunkIndex % 5 == 0 && chunkSize < 64 * 1024 * 1024)
                 chunkSize *= 2;
 
             current.init(offset, chunkSize, chunkIndex);
@@ -2108,12 +2124,12 @@ struct StreamingUploadSource {
             flush();
 
             if (!chunkIndex) {
-                chunks.push(std::move(current));
+                chunks->push(std::move(current));
                 ++chunkIndex;
             }
 
             //cerr << "waiting for everything to stop" << endl;
-            chunks.waitUntilEmpty();
+            chunks->waitUntilEmpty();
             //cerr << "empty" << endl;
             stop();
             //cerr << "stopped" << endl;
@@ -2143,9 +2159,11 @@ struct StreamingUploadSource {
         {
             while (!shutdown) {
                 Chunk chunk;
-                if (chunks.tryPop(chunk, 0.01)) {
+                if (chunks->tryPop(chunk, 0.01)) {
+                    // keep draining after a failure so that the writer
+                    // never blocks on a full queue
                     if (exc)
-                        return;
+                        continue;
                     try {
                         //cerr << "got chunk " << chunk.index
                         //     << " with " << chunk.size << " bytes at index "
@@ -2521,6 +2539,10 @@ struct RegisterS3Handler {
                 {
                     md.numThreads = std::stoi(value);
                 }
+                else if(name == "part-size")
+                {
+                    md.partSize = std::stoull(value);
+                }
                 else {
                     cerr << "warning: skipping unknown S3 option "
                          << name << "=" << value << endl;
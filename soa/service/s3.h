@@ -81,6 +81,22 @@ struct S3Api : public AwsApi {
     std::string serviceUri;
     double bandwidthToServiceMbps;
 
+    /** Address buckets as http://serviceUri/bucket/object rather than as
+        http://bucket.serviceUri/object.  Needed for S3 compatible services
+        that are reached through a plain host:port.
+    */
+    bool pathStyleRequests;
+
+    /** Number of ranged GETs that a streaming download keeps in flight, or
+        -1 to choose it from the size of the object.
+    */
+    int streamingDownloadThreads;
+
+    /** Size of the ranged GETs of a streaming download, or 0 to start at
+        1MB and grow with the bandwidth to the service.
+    */
+    size_t streamingDownloadChunkSize;
+
     typedef std::vector<std::pair<std::string, std::string> > StrPairVector;
 
     struct Content {
@@ -227,14 +243,16 @@ struct S3Api : public AwsApi {
         ObjectMetadata()
             : redundancy(REDUNDANCY_DEFAULT),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8),
+              partSize(0)
         {
         }
 
         ObjectMetadata(const Redundancy & redundancy)
             : redundancy(redundancy),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8),
+              partSize(0)
         {
         }
 
@@ -247,7 +265,13 @@ struct S3Api : public AwsApi {
         std::string contentEncoding;
         std::map<std::string, std::string> metadata;
         std::string acl;
+
+        /// Parts uploaded concurrently by a streaming upload
         unsigned int numThreads;
+
+        /// Size of the parts of a streaming upload, or 0 to start at 8MB
+        /// and grow with the size of the object
+        size_t partSize;
     };
 
     /** Signed request that can be executed. */
@@ -401,6 +425,11 @@ struct S3Api : public AwsApi {
     /** Get a streambuf that will allow a bucket to be streamed through.  If
         an onChunk is provided, downloaded chunks will also be provided
         to that method.
+
+        The object is fetched by streamingDownloadThreads concurrent ranged
+        GETs.  Chunks that arrive ahead of the reader wait in a reorder
+        buffer of at most twice that many chunks, after which the
+        downloads pause until the reader catches up.
     */
     std::auto_ptr<std::streambuf>
     streamingDownload(const std::string & bucket,
@@ -419,7 +448,12 @@ struct S3Api : public AwsApi {
                       ssize_t endOffset = -1,
                       const OnChunk & onChunk = OnChunk()) const;
 
-    /** Get a streambuf that will write to s3 when written to. */
+    /** Get a streambuf that will write to s3 when written to.
+
+        Parts are uploaded by md.numThreads concurrent requests.  Writes
+        block once as many parts again are waiting for them, so that memory
+        stays bounded to about twice md.numThreads parts.
+    */
     std::auto_ptr<std::streambuf>
     streamingUpload(const std::string & uri,
                     const ObjectMetadata & md = ObjectMetadata()) const;
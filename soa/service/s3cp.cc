@@ -31,6 +31,8 @@ int main(int argc, char* argv[])
     string s3Key;
     
     string compression = "none";
+    int numThreads = -1;
+    size_t chunkSize = 0;
     
     po::options_description desc("Main options");
     desc.add_options()
@@ -41,6 +43,8 @@ int main(int argc, char* argv[])
         ("s3-key-id,I", po::value<string>(&s3KeyId), "S3 access id")
         ("s3-key,K", po::value<string>(&s3Key), "S3 access id key")
         ("compression,c", po::value<string>(&compression), "Compression to apply (default: none, valid: auto,gz,bz2,xz")
+        ("threads,t", po::value<int>(&numThreads), "Concurrent requests per S3 transfer (default: from the object size for downloads, 8 for uploads)")
+        ("chunk-size", po::value<size_t>(&chunkSize), "Size in bytes of S3 ranged downloads and upload parts (default: grows with the object)")
         ("help,h", "Produce help message");
     
     po::positional_options_description pos;
@@ -76,13 +80,27 @@ int main(int argc, char* argv[])
     if (s3KeyId != "")
         registerS3Buckets(s3KeyId, s3Key);
 
+    if (inputUri.find("s3://") == 0) {
+        auto api = getS3ApiForUri(inputUri);
+        api->streamingDownloadThreads = numThreads;
+        api->streamingDownloadChunkSize = chunkSize;
+    }
+
     ML::filter_istream in(inputUri, ios::in, compression);
 
+    std::map<std::string, std::string> outputOptions = { { "mode", "out" } };
+    if (!compression.empty())
+        outputOptions["compression"] = compression;
+    if (numThreads > 0)
+        outputOptions["num-threads"] = to_string(numThreads);
+    if (chunkSize)
+        outputOptions["part-size"] = to_string(chunkSize);
+
     std::vector<filter_ostream> streams;
     streams.reserve(outputFiles.size() + 1);
 
     for (auto f: outputFiles)
-        streams.emplace_back(f, ios::out, compression);
+        streams.emplace_back(f, outputOptions);
 
     Date start = Date::now();
     size_t bytesDone = 0;
@@ -49,6 +49,8 @@ LIBSERVICES_SOURCES := \
 	sink.cc \
 	zookeeper.cc \
 	http_client.cc \
+	http_client_curl.cc \
+	http_client_native.cc \
 	http_rest_proxy.cc \
 	xml_helpers.cc \
 	nprobe.cc \
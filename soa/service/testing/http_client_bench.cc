@@ -29,18 +29,25 @@ using namespace Datacratic;
 
 void
 AsyncModelBench(const string & baseUrl, int maxReqs, int concurrency,
-                Date & start, Date & end)
+                HttpClient::Implementation impl, bool pipelining,
+                double timeout, Date & start, Date & end)
 {
-    int numReqs, numResponses(0), numMissed(0);
+    int numReqs, numResponses(0), numMissed(0), numErrors(0);
     MessageLoop loop(1, 0, -1);
 
     loop.start();
 
-    auto client = make_shared<HttpClient>(baseUrl, concurrency);
+    auto client = make_shared<HttpClient>(baseUrl, concurrency, impl);
+    if (pipelining) {
+        client->enablePipelining();
+    }
     loop.addSource("httpClient", client);
 
     auto onResponse = [&] (const HttpRequest & rq, HttpClientError errorCode_,
                            int status, string && headers, string && body) {
+        if (errorCode_ != HttpClientError::NONE) {
+            numErrors++;
+        }
         numResponses++;
         // if (numResponses % 1000) {
             // cerr << "resps: "  + to_string(numResponses) + "\n";
@@ -56,7 +63,7 @@ AsyncModelBench(const string & baseUrl, int maxReqs, int concurrency,
     string url("/");
     start = Date::now();
     for (numReqs = 0; numReqs < maxReqs;) {
-        if (clientRef.get(url, cbs)) {
+        if (clientRef.get(url, cbs, RestParams(), RestParams(), timeout)) {
             numReqs++;
             // if (numReqs % 1000) {
             //     cerr << "reqs: "  + to_string(numReqs) + "\n";
@@ -80,6 +87,7 @@ AsyncModelBench(const string & baseUrl, int maxReqs, int concurrency,
     client->waitConnectionState(AsyncEventSource::DISCONNECTED);
 
     cerr << "num misses: "  + to_string(numMissed) + "\n";
+    cerr << "num errors: "  + to_string(numErrors) + "\n";
 }
 
 void
@@ -114,6 +122,8 @@ int main(int argc, char *argv[])
 
     size_t concurrency(0);
     int model(0);
+    bool pipelining(false);
+    double timeout(-1);
     size_t maxReqs(0);
     size_t payloadSize(0);
 
@@ -127,7 +137,12 @@ int main(int argc, char *argv[])
         ("concurrency,c", value(&concurrency),
          "Number of concurrent requests")
         ("model,m", value(&model),
-         "Type of concurrency model (1 for async, 2 for threaded))")
+         "Type of concurrency model (1 for async, 2 for threaded,"
+         " 3 for async with the native client)")
+        ("pipelining,p", bool_switch(&pipelining),
+         "enable pipelining in the async models")
+        ("timeout,t", value(&timeout),
+         "timeout of the requests of the async models, in seconds")
         ("requests,r", value(&maxReqs),
          "total of number of requests to perform")
         ("payload-size,s", value(&payloadSize),
@@ -197,7 +212,12 @@ int main(int argc, char *argv[])
 
         Date start, end;
         if (model == 1) {
-            AsyncModelBench(baseUrl, maxReqs, concurrency, start, end);
+            AsyncModelBench(baseUrl, maxReqs, concurrency, HttpClient::CURL,
+                            pipelining, timeout, start, end);
+        }
+        else if (model == 3) {
+            AsyncModelBench(baseUrl, maxReqs, concurrency, HttpClient::NATIVE,
+                            pipelining, timeout, start, end);
         }
         else if (model == 2) {
             ThreadedModelBench(baseUrl, maxReqs, concurrency, start, end);
@@ -28,7 +28,8 @@ ClientResponse
 doGetRequest(MessageLoop & loop,
              const string & baseUrl, const string & resource,
              const RestParams & headers = RestParams(),
-             int timeout = -1)
+             double timeout = -1,
+             HttpClient::Implementation impl = HttpClient::CURL)
 {
     ClientResponse response;
 
@@ -48,7 +49,7 @@ doGetRequest(MessageLoop & loop,
         ML::futex_wake(done);
     };
     auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    auto client = make_shared<HttpClient>(baseUrl);
+    auto client = make_shared<HttpClient>(baseUrl, 4, impl);
     loop.addSource("httpClient", client);
     client->waitConnectionState(AsyncEventSource::CONNECTED);
     if (timeout == -1) {
@@ -74,7 +75,8 @@ ClientResponse
 doUploadRequest(MessageLoop & loop,
                 bool isPut,
                 const string & baseUrl, const string & resource,
-                const string & body, const string & type)
+                const string & body, const string & type,
+                HttpClient::Implementation impl = HttpClient::CURL)
 {
     ClientResponse response;
     int done(false);
@@ -94,7 +96,7 @@ doUploadRequest(MessageLoop & loop,
         ML::futex_wake(done);
     };
 
-    auto client = make_shared<HttpClient>(baseUrl);
+    auto client = make_shared<HttpClient>(baseUrl, 4, impl);
     loop.addSource("httpClient", client);
     client->waitConnectionState(AsyncEventSource::CONNECTED);
     auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
@@ -447,3 +449,171 @@ BOOST_AUTO_TEST_CASE( test_http_client_unlimited_queue )
     client->waitConnectionState(AsyncEventSource::DISCONNECTED);
 }
 #endif
+
+#if 1
+BOOST_AUTO_TEST_CASE( test_http_client_native_get )
+{
+    cerr << "native_client_get\n";
+    ML::Watchdog watchdog(10);
+    auto proxies = make_shared<ServiceProxies>();
+    HttpGetService service(proxies);
+
+    service.addResponse("GET", "/coucou", 200, "coucou");
+    service.start();
+
+    MessageLoop loop;
+    loop.start();
+
+    service.waitListening();
+
+    string baseUrl("http://127.0.0.1:" + to_string(service.port()));
+
+    /* request to /nothing -> 404 */
+    {
+        auto resp = doGetRequest(loop, baseUrl, "/nothing", {}, -1,
+                                 HttpClient::NATIVE);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::NONE);
+        BOOST_CHECK_EQUAL(get<1>(resp), 404);
+    }
+
+    /* request to /coucou -> 200 + "coucou" */
+    {
+        auto resp = doGetRequest(loop, baseUrl, "/coucou", {}, -1,
+                                 HttpClient::NATIVE);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::NONE);
+        BOOST_CHECK_EQUAL(get<1>(resp), 200);
+        BOOST_CHECK_EQUAL(get<2>(resp), "coucou");
+    }
+
+    /* the same headers are sent as with curl */
+    {
+        auto resp = doGetRequest(loop, baseUrl, "/headers",
+                                 {{"someheader", "somevalue"}}, -1,
+                                 HttpClient::NATIVE);
+        Json::Value expBody;
+        expBody["accept"] = "*/*";
+        expBody["host"] = baseUrl.substr(7);
+        expBody["someheader"] = "somevalue";
+        Json::Value jsonBody = Json::parse(get<2>(resp));
+        BOOST_CHECK_EQUAL(jsonBody, expBody);
+    }
+
+    /* sub-second timeouts fire on time */
+    {
+        Date start = Date::now();
+        auto resp = doGetRequest(loop, baseUrl, "/timeout", {}, 0.1,
+                                 HttpClient::NATIVE);
+        double elapsed = Date::now().secondsSince(start);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::TIMEOUT);
+        BOOST_CHECK_EQUAL(get<1>(resp), 0);
+        BOOST_CHECK_GE(elapsed, 0.1);
+        BOOST_CHECK_LT(elapsed, 0.5);
+    }
+
+    /* connection refused */
+    {
+        auto resp = doGetRequest(loop, "http://127.0.0.1:1", "/", {}, -1,
+                                 HttpClient::NATIVE);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::COULD_NOT_CONNECT);
+    }
+
+    /* only plain http is supported */
+    BOOST_CHECK_THROW(HttpClient("https://127.0.0.1", 1, HttpClient::NATIVE),
+                      ML::Exception);
+}
+#endif
+
+#if 1
+BOOST_AUTO_TEST_CASE( test_http_client_native_upload )
+{
+    cerr << "native_client_upload\n";
+    ML::Watchdog watchdog(10);
+    auto proxies = make_shared<ServiceProxies>();
+    HttpUploadService service(proxies);
+    service.start();
+
+    MessageLoop loop;
+    loop.start();
+
+    string baseUrl("http://127.0.0.1:"
+                   + to_string(service.port()));
+
+    {
+        auto resp = doUploadRequest(loop, false, baseUrl, "/post-test",
+                                    "post body", "application/x-nothing",
+                                    HttpClient::NATIVE);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::NONE);
+        BOOST_CHECK_EQUAL(get<1>(resp), 200);
+        Json::Value jsonBody = Json::parse(get<2>(resp));
+        BOOST_CHECK_EQUAL(jsonBody["verb"], "POST");
+        BOOST_CHECK_EQUAL(jsonBody["payload"], "post body");
+        BOOST_CHECK_EQUAL(jsonBody["type"], "application/x-nothing");
+    }
+
+    {
+        string bigBody;
+        for (int i = 0; i < 65535; i++) {
+            bigBody += "this is one big body,";
+        }
+        auto resp = doUploadRequest(loop, true, baseUrl, "/put-test",
+                                    bigBody, "application/x-nothing",
+                                    HttpClient::NATIVE);
+        BOOST_CHECK_EQUAL(get<0>(resp), HttpClientError::NONE);
+        BOOST_CHECK_EQUAL(get<1>(resp), 200);
+        Json::Value jsonBody = Json::parse(get<2>(resp));
+        BOOST_CHECK_EQUAL(jsonBody["verb"], "PUT");
+        BOOST_CHECK_EQUAL(jsonBody["payload"], bigBody);
+    }
+}
+#endif
+
+#if 1
+/* All requests complete when they are spread over a few keep-alive
+   connections. The test services don't support pipelining. */
+BOOST_AUTO_TEST_CASE( test_http_client_native_keep_alive )
+{
+    cerr << "native_keep_alive\n";
+    ML::Watchdog watchdog(60);
+    auto proxies = make_shared<ServiceProxies>();
+    HttpGetService service(proxies);
+
+    service.addResponse("GET", "/", 200, "coucou");
+    service.start();
+    service.waitListening();
+
+    MessageLoop loop;
+    loop.start();
+
+    string baseUrl("http://127.0.0.1:"
+                   + to_string(service.port()));
+
+    auto client = make_shared<HttpClient>(baseUrl, 2, HttpClient::NATIVE);
+    loop.addSource("httpClient", client);
+    client->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    int maxReqs(10000);
+    atomic<int> numResponses(0), numErrors(0);
+
+    auto onDone = [&] (const HttpRequest & rq,
+                       HttpClientError errorCode, int status,
+                       string && headers, string && body) {
+        if (errorCode != HttpClientError::NONE || body != "coucou") {
+            numErrors++;
+        }
+        numResponses++;
+    };
+    auto cbs = make_shared<HttpClientSimpleCallbacks>(onDone);
+
+    for (int i = 0; i < maxReqs; i++) {
+        client->get("/", cbs);
+    }
+
+    while (numResponses < maxReqs) {
+        ML::sleep(0.1);
+    }
+    BOOST_CHECK_EQUAL(numErrors, 0);
+
+    loop.removeSource(client.get());
+    client->waitConnectionState(AsyncEventSource::DISCONNECTED);
+}
+#endif
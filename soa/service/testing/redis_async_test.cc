@@ -351,3 +351,86 @@ BOOST_AUTO_TEST_CASE( test_redis_timeout )
 
     redis.shutdown();
 }
+
+BOOST_AUTO_TEST_CASE( test_redis_sharded_pool )
+{
+    RedisTemporaryServer redis1, redis2;
+
+    Redis::AsyncConnection connection({ redis1.address(), redis2.address() },
+                                      2 /* connections per address */);
+    connection.test();
+
+    BOOST_CHECK_EQUAL(connection.numShards(), 2);
+
+    // Keys with the same hash tag live together
+    BOOST_CHECK_EQUAL(connection.shardForKey("{user1}.name"),
+                      connection.shardForKey("{user1}.age"));
+    BOOST_CHECK_EQUAL(connection.shardForKey("{user1}.name"),
+                      connection.shardForKey("user1"));
+    BOOST_CHECK_EQUAL(connection.shardForCommand(PING), 0);
+
+    int numKeys = 1000;
+    vector<Command> sets, gets;
+    for (unsigned i = 0;  i < numKeys;  ++i) {
+        sets.push_back(SET("key" + to_string(i), i));
+        gets.push_back(GET("key" + to_string(i)));
+    }
+
+    Results results = connection.execMulti(sets, 5.0);
+    BOOST_REQUIRE(results.ok());
+
+    results = connection.execMulti(gets, 5.0);
+    BOOST_REQUIRE(results.ok());
+    BOOST_REQUIRE_EQUAL(results.size(), numKeys);
+    for (unsigned i = 0;  i < numKeys;  ++i)
+        BOOST_CHECK_EQUAL(results.reply(i).asString(), to_string(i));
+
+    // Check with each server on its own that the keys were spread out as
+    // advertised
+    int numOnShard[2] = { 0, 0 };
+    for (unsigned i = 0;  i < numKeys;  ++i)
+        ++numOnShard[connection.shardForKey("key" + to_string(i))];
+
+    Redis::AsyncConnection direct1(redis1), direct2(redis2);
+    BOOST_CHECK_EQUAL(direct1.exec(Command("DBSIZE")).reply().asInt(),
+                      numOnShard[0]);
+    BOOST_CHECK_EQUAL(direct2.exec(Command("DBSIZE")).reply().asInt(),
+                      numOnShard[1]);
+    BOOST_CHECK_GT(numOnShard[0], numKeys / 4);
+    BOOST_CHECK_GT(numOnShard[1], numKeys / 4);
+
+    // Transactions stay on the shard of their first key
+    vector<Command> transaction = {
+        MULTI,
+        SET("{tx}.a", "1"),
+        SET("{tx}.b", "2"),
+        EXEC
+    };
+    results = connection.execMulti(transaction, 5.0);
+    BOOST_CHECK(results.ok());
+
+    auto & txShard = connection.shardForKey("tx") == 0 ? direct1 : direct2;
+    BOOST_CHECK_EQUAL(txShard.exec(GET("{tx}.b")).reply().asString(), "2");
+
+    // Commands from several threads
+    std::atomic<int> numErrors(0);
+    auto doThread = [&] (int thread)
+        {
+            for (unsigned i = 0;  i < 1000;  ++i) {
+                string key = ML::format("thread%d.%d", thread, i);
+                if (!connection.exec(SET(key, i), 5.0)
+                    || connection.exec(GET(key), 5.0).reply().asString()
+                       != to_string(i))
+                    ++numErrors;
+            }
+        };
+
+    boost::thread_group tg;
+    for (unsigned i = 0;  i < 4;  ++i)
+        tg.create_thread(boost::bind<void>(doThread, i));
+    tg.join_all();
+
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(connection.numRequestsPending(), 0);
+    BOOST_CHECK_EQUAL(connection.numTimeoutsPending(), 0);
+}
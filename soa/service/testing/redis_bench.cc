@@ -0,0 +1,125 @@
+/* redis_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Throughput of the Redis async connection against temporary servers,
+   for different numbers of connections, shards and batch windows.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/service/redis.h"
+#include "soa/service/testing/redis_temporary_server.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+using namespace ML;
+using namespace Redis;
+
+
+namespace {
+
+/** Have numThreads threads each keep up to maxInFlight SET or GET
+    commands in flight for the given amount of time.  Returns the number
+    of commands per second.
+*/
+double runBench(const vector<Address> & addresses,
+                int connectionsPerAddress,
+                double batchWindow,
+                int numThreads,
+                int maxInFlight,
+                double duration)
+{
+    AsyncConnection connection;
+    connection.batchWindow = batchWindow;
+    connection.connect(addresses, connectionsPerAddress);
+    connection.test();
+
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numDone(0), numErrors(0);
+
+    auto doThread = [&] (int thread)
+        {
+            std::atomic<int> inFlight(0);
+            unsigned i = 0;
+
+            auto onResult = [&] (const Result & result)
+                {
+                    if (!result)
+                        ++numErrors;
+                    ++numDone;
+                    --inFlight;
+                };
+
+            while (!finished) {
+                if (inFlight >= maxInFlight) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                ++inFlight;
+                string key = ML::format("key%d.%d", thread, i % 10000);
+                if (i++ % 2)
+                    connection.queue(GET(key), onResult, 1.0);
+                else connection.queue(SET(key, i), onResult, 1.0);
+            }
+
+            while (inFlight > 0)
+                std::this_thread::yield();
+        };
+
+    Timer timer;
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < numThreads;  ++i)
+        threads.emplace_back(doThread, i);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(int(duration * 1000)));
+    finished = true;
+
+    for (auto & t: threads)
+        t.join();
+
+    double elapsed = timer.elapsed_wall();
+
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(connection.numRequestsPending(), 0);
+
+    return numDone / elapsed;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_redis_async_connection )
+{
+    RedisTemporaryServer redis1, redis2;
+
+    vector<Address> one = { redis1.address() };
+    vector<Address> two = { redis1.address(), redis2.address() };
+
+    double duration = 2.0;
+    int maxInFlight = 1000;
+
+    cerr << ML::format("%6s %6s %6s %8s %12s",
+                       "shards", "conns", "thrds", "window", "cmds/s")
+         << endl;
+
+    for (auto addresses: { one, two }) {
+        for (int conns: { 1, 2, 4 }) {
+            for (int threads: { 1, 4 }) {
+                for (double window: { 0.0, 0.0001 }) {
+                    double rate = runBench(addresses, conns, window, threads,
+                                           maxInFlight, duration);
+                    cerr << ML::format("%6zd %6d %6d %8.4f %12.0f",
+                                       addresses.size(), conns, threads,
+                                       window, rate)
+                         << endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,149 @@
+/* s3_mock_service.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Local stand-in for the part of the S3 protocol used by the streaming
+   transfers of S3Api.
+*/
+
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include "soa/types/date.h"
+
+#include "s3_mock_service.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+S3MockService::
+S3MockService(const shared_ptr<ServiceProxies> & proxies)
+    : HttpService(proxies), latency(0.0), numRequests(0), numUploads(0)
+{
+}
+
+void
+S3MockService::
+handleHttpPayload(HttpTestConnHandler & handler,
+                  const HttpHeader & header,
+                  const string & payload)
+{
+    numRequests++;
+    if (latency > 0.0)
+        ML::sleep(latency);
+
+    typedef vector<pair<string, string> > Headers;
+
+    auto send = [&] (int code, const string & body,
+                     const Headers & headers = Headers()) {
+        handler.putResponseOnWire(HttpResponse(code, "application/xml",
+                                               body, headers));
+    };
+
+    auto notFound = [&] () {
+        send(404, "<Error><Code>NoSuchKey</Code>"
+             "<Message>The specified key does not exist.</Message></Error>");
+    };
+
+    // path style addressing: /bucket/object
+    string key(header.resource, 1);
+    const RestParams & params = header.queryParams;
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (header.verb == "HEAD") {
+        auto it = objects.find(key);
+        if (it == objects.end()) {
+            handler.putResponseOnWire(HttpResponse(404, string()));
+            return;
+        }
+
+        Headers headers = {
+            { "Content-Length", to_string(it->second.size()) },
+            { "ETag", "\"" + key + "\"" },
+            { "Last-Modified", Date::now().printRfc2616() }
+        };
+        string type("binary/octet-stream");
+        handler.putResponseOnWire(HttpResponse(200, type, headers));
+    }
+    else if (header.verb == "GET") {
+        if (params.hasValue("uploads")) {
+            // nothing is ever left in progress
+            send(200, "<ListMultipartUploadsResult></ListMultipartUploadsResult>");
+            return;
+        }
+
+        auto it = objects.find(key);
+        if (it == objects.end()) {
+            notFound();
+            return;
+        }
+
+        const string & object = it->second;
+        unsigned long long first, last;
+        string range = header.tryGetHeader("range");
+        if (sscanf(range.c_str(), "bytes=%llu-%llu", &first, &last) != 2) {
+            send(200, object);
+            return;
+        }
+
+        if (first >= object.size())
+            first = last = object.size();
+        else last = std::min<unsigned long long>(last + 1, object.size());
+
+        Headers headers = {
+            { "Content-Range", ML::format("bytes %llu-%llu/%zd",
+                                          first, last - 1, object.size()) }
+        };
+        send(206, object.substr(first, last - first), headers);
+    }
+    else if (header.verb == "PUT") {
+        if (params.hasValue("partNumber")) {
+            auto it = uploads.find(params.getValue("uploadId"));
+            if (it == uploads.end()) {
+                notFound();
+                return;
+            }
+
+            string partNumber = params.getValue("partNumber");
+            it->second[stoi(partNumber)] = payload;
+            send(200, "", { { "ETag", "\"part-" + partNumber + "\"" } });
+        }
+        else {
+            objects[key] = payload;
+            send(200, "", { { "ETag", "\"" + key + "\"" } });
+        }
+    }
+    else if (header.verb == "POST") {
+        if (params.hasValue("uploads")) {
+            string id = ML::format("upload-%d", ++numUploads);
+            uploads[id];
+            send(200, "<InitiateMultipartUploadResult><UploadId>" + id
+                 + "</UploadId></InitiateMultipartUploadResult>");
+            return;
+        }
+
+        auto it = uploads.find(params.getValue("uploadId"));
+        if (it == uploads.end()) {
+            notFound();
+            return;
+        }
+
+        string & object = objects[key];
+        object.clear();
+        for (auto & part: it->second)
+            object += part.second;
+        uploads.erase(it);
+
+        send(200, "<CompleteMultipartUploadResult><ETag>\"" + key
+             + "\"</ETag></CompleteMultipartUploadResult>");
+    }
+    else if (header.verb == "DELETE") {
+        if (params.hasValue("uploadId"))
+            uploads.erase(params.getValue("uploadId"));
+        else objects.erase(key);
+        handler.putResponseOnWire(HttpResponse(204, string()));
+    }
+    else {
+        send(405, "<Error><Code>MethodNotAllowed</Code></Error>");
+    }
+}
@@ -0,0 +1,45 @@
+/* s3_mock_service.h                                               -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Local stand-in for the part of the S3 protocol used by the streaming
+   transfers of S3Api.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "test_http_services.h"
+
+
+namespace Datacratic {
+
+/** Keeps objects in memory and serves them with path style addressing
+    (http://host:port/bucket/object), so that an S3Api with
+    pathStyleRequests set can be pointed at it.  Supports HEAD, ranged GET,
+    PUT and multipart uploads.  Requests are not authenticated.
+*/
+struct S3MockService : public HttpService
+{
+    S3MockService(const std::shared_ptr<ServiceProxies> & proxies);
+
+    void handleHttpPayload(HttpTestConnHandler & handler,
+                           const HttpHeader & header,
+                           const std::string & payload);
+
+    /** Seconds to wait before answering each request, to emulate the round
+        trip to S3. */
+    double latency;
+
+    std::atomic<int> numRequests;
+
+    std::mutex lock;
+    std::map<std::string, std::string> objects;  // by "bucket/object"
+    std::map<std::string, std::map<int, std::string> > uploads;  // by id
+    int numUploads;
+};
+
+} // namespace Datacratic
@@ -0,0 +1,103 @@
+/* s3_streaming_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Throughput of the streaming uploads and downloads of S3Api against chunk
+   size and concurrency.  Runs against a local stand-in for S3 that delays
+   every request to emulate the round trip to the service.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+#include "jml/arch/format.h"
+#include "jml/utils/environment.h"
+#include "soa/service/s3.h"
+#include "soa/service/service_base.h"
+#include "soa/types/date.h"
+
+#include "s3_mock_service.h"
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+Env_Option<int> objectSizeMb("S3_BENCH_SIZE_MB", 64);
+Env_Option<double> latency("S3_BENCH_LATENCY", 0.02);
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_s3_streaming )
+{
+    auto proxies = make_shared<ServiceProxies>();
+    S3MockService service(proxies);
+    service.latency = latency;
+    service.start("127.0.0.1", 32);
+
+    S3Api api("id", "key", S3Api::defaultBandwidthToServiceMbps, "http",
+              "127.0.0.1:" + to_string(service.port()));
+    api.pathStyleRequests = true;
+
+    size_t size = objectSizeMb * 1024 * 1024;
+    string data(size, 'x');
+    double mb = size / 1000000.0;
+
+    cerr << ML::format("%d MB objects, %.0f ms per request",
+                       (int)objectSizeMb, latency * 1000.0)
+         << endl;
+    cerr << ML::format("%8s %10s %12s %12s",
+                       "threads", "chunk KB", "upload MB/s", "download MB/s")
+         << endl;
+
+    for (unsigned numThreads: { 1, 2, 4, 8, 16 }) {
+        for (size_t chunkSize: { 256 * 1024, 1024 * 1024, 4096 * 1024 }) {
+            string object = ML::format("bench-%d-%zd", numThreads, chunkSize);
+
+            S3Api::ObjectMetadata md;
+            md.numThreads = numThreads;
+            md.partSize = chunkSize;
+
+            Date start = Date::now();
+            {
+                auto buf = api.streamingUpload("bucket", object, md);
+                ostream stream(buf.get());
+                stream.write(data.c_str(), data.size());
+            }
+            double uploadSeconds = Date::now().secondsSince(start);
+
+            api.streamingDownloadThreads = numThreads;
+            api.streamingDownloadChunkSize = chunkSize;
+
+            start = Date::now();
+            size_t received = 0;
+            {
+                auto buf = api.streamingDownload("bucket", object);
+                istream stream(buf.get());
+                char block[65536];
+                while (stream.read(block, sizeof(block)) || stream.gcount())
+                    received += stream.gcount();
+            }
+            double downloadSeconds = Date::now().secondsSince(start);
+
+            BOOST_CHECK_EQUAL(received, size);
+
+            {
+                std::unique_lock<std::mutex> guard(service.lock);
+                service.objects.erase("bucket/" + object);
+            }
+
+            cerr << ML::format("%8d %10zd %12.1f %12.1f",
+                               numThreads, chunkSize / 1024,
+                               mb / uploadSeconds, mb / downloadSeconds)
+                 << endl;
+        }
+    }
+}
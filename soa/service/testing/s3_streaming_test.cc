@@ -0,0 +1,123 @@
+/* s3_streaming_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Concurrent streaming uploads and downloads of S3Api, against a local
+   stand-in for S3.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/s3.h"
+#include "soa/service/service_base.h"
+
+#include "s3_mock_service.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+string makeData(size_t size)
+{
+    string result(size, 0);
+    for (size_t i = 0;  i < size;  ++i)
+        result[i] = (i * 2654435761U) >> 13;
+    return result;
+}
+
+void upload(const S3Api & api, const string & object, const string & data,
+            unsigned numThreads, size_t partSize)
+{
+    S3Api::ObjectMetadata md;
+    md.numThreads = numThreads;
+    md.partSize = partSize;
+
+    auto buf = api.streamingUpload("bucket", object, md);
+    ostream stream(buf.get());
+    for (size_t i = 0;  i < data.size();  i += 100000)
+        stream.write(data.c_str() + i, min<size_t>(100000, data.size() - i));
+    BOOST_REQUIRE(stream);
+
+    // closing the buffer completes the upload
+    buf.reset();
+}
+
+string download(const S3Api & api, const string & object)
+{
+    auto buf = api.streamingDownload("bucket", object);
+    istream stream(buf.get());
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_s3_streaming_round_trip )
+{
+    auto proxies = make_shared<ServiceProxies>();
+    S3MockService service(proxies);
+    service.start("127.0.0.1", 8);
+
+    S3Api api("id", "key", S3Api::defaultBandwidthToServiceMbps, "http",
+              "127.0.0.1:" + to_string(service.port()));
+    api.pathStyleRequests = true;
+
+    string data = makeData(3 * 1024 * 1024 + 12345);
+
+    for (unsigned numThreads: { 1, 3, 8 }) {
+        for (size_t chunkSize: { 100000, 1024 * 1024 }) {
+            string object = ML::format("object-%d-%zd", numThreads, chunkSize);
+            cerr << "round trip of " << object << endl;
+
+            int before = service.numRequests;
+            upload(api, object, data, numThreads, chunkSize);
+
+            // initiate, list in progress, parts, complete
+            int numParts = (data.size() + chunkSize - 1) / chunkSize;
+            BOOST_CHECK_EQUAL(service.numRequests - before, numParts + 3);
+            BOOST_CHECK(service.objects["bucket/" + object] == data);
+
+            api.streamingDownloadThreads = numThreads;
+            api.streamingDownloadChunkSize = chunkSize;
+            string result = download(api, object);
+            BOOST_CHECK_EQUAL(result.size(), data.size());
+            BOOST_CHECK(result == data);
+        }
+    }
+
+    // default settings pick the concurrency and chunk sizes
+    api.streamingDownloadThreads = -1;
+    api.streamingDownloadChunkSize = 0;
+    upload(api, "object-default", data, 8, 0);
+    BOOST_CHECK(download(api, "object-default") == data);
+}
+
+BOOST_AUTO_TEST_CASE( test_s3_streaming_small_objects )
+{
+    auto proxies = make_shared<ServiceProxies>();
+    S3MockService service(proxies);
+    service.start("127.0.0.1", 4);
+
+    S3Api api("id", "key", S3Api::defaultBandwidthToServiceMbps, "http",
+              "127.0.0.1:" + to_string(service.port()));
+    api.pathStyleRequests = true;
+    api.streamingDownloadThreads = 4;
+    api.streamingDownloadChunkSize = 1000;
+
+    upload(api, "empty", "", 4, 1000);
+    BOOST_CHECK_EQUAL(download(api, "empty"), "");
+
+    upload(api, "short", "hello", 4, 1000);
+    BOOST_CHECK_EQUAL(download(api, "short"), "hello");
+
+    BOOST_CHECK_THROW(download(api, "missing"), std::exception);
+}
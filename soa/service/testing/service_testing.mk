@@ -10,6 +10,7 @@ $(eval $(call test,aws_test,cloud,boost))
 
 $(eval $(call test,redis_async_test,redis,boost))
 $(eval $(call test,redis_commands_test,redis,boost))
+$(eval $(call test,redis_bench,redis,boost manual))
 
 $(eval $(call nodejs_test,opstats_js_test,opstats,,,manual))
 
@@ -40,7 +41,7 @@ $(eval $(call library,tcpsockets,tcpsockets.cc,services))
 $(eval $(call test,zmq_tcp_bench,tcpsockets services,boost manual timed))
 $(eval $(call test,nprobe_test,services,boost manual))
 
-$(eval $(call library,test_services,test_http_services.cc,services))
+$(eval $(call library,test_services,test_http_services.cc s3_mock_service.cc,services))
 
 $(eval $(call test,http_client_test,services test_services,boost))
 $(eval $(call test,http_client_bench,boost_program_options services test_services,boost manual))
@@ -48,4 +49,6 @@ $(eval $(call test,http_client_bench,boost_program_options services test_service
 $(eval $(call test,logs_test,services,boost))
 
 $(eval $(call test,sns_mock_test,cloud services,boost))
+$(eval $(call test,s3_streaming_test,cloud services test_services,boost))
+$(eval $(call test,s3_streaming_bench,cloud services test_services,boost manual))
 $(eval $(call test,zmq_message_loop_test,services,boost))
@@ -2,7 +2,9 @@
    Jeremy Barnes, 31 January 2011
    Copyright (c) 2011 Datacratic.  All rights reserved.
 
-   Tests for the endpoints.
+   Tests for the endpoints, and a benchmark of the request/response
+   throughput of a passive endpoint and of the allocations it makes for
+   each request.
 */
 
 #define BOOST_TEST_MAIN
@@ -19,11 +21,39 @@
 #include "jml/utils/testing/fd_exhauster.h"
 #include "test_connection_error.h"
 #include "ping_pong.h"
+#include "jml/arch/timers.h"
+#include "jml/utils/exc_assert.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <thread>
+#include <atomic>
+#include <new>
 
 using namespace std;
 using namespace ML;
 using namespace Datacratic;
 
+
+/* Count all of the allocations of the process */
+
+namespace {
+std::atomic<uint64_t> numAllocations(0);
+} // file scope
+
+void * operator new (size_t size)
+{
+    ++numAllocations;
+    void * result = malloc(size);
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+void operator delete (void * ptr) noexcept
+{
+    free(ptr);
+}
+
 BOOST_AUTO_TEST_CASE( test_ping_pong )
 {
     BOOST_REQUIRE_EQUAL(TransportBase::created, TransportBase::destroyed);
@@ -103,3 +133,137 @@ BOOST_AUTO_TEST_CASE( test_ping_pong )
     BOOST_CHECK_EQUAL(ConnectionHandler::created,
                       ConnectionHandler::destroyed);
 }
+
+
+namespace {
+
+/** Sends back whatever it receives. */
+struct EchoConnectionHandler : public PassiveConnectionHandler {
+
+    virtual void onGotTransport()
+    {
+        startReading();
+    }
+
+    virtual void handleData(const std::string & data)
+    {
+        send(data);
+    }
+
+    virtual void handleError(const std::string & message)
+    {
+        cerr << "echo error: " << message << endl;
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_ping_pong_throughput )
+{
+    enum {
+        MessageSize = 256,
+        NumWarmup = 1000
+    };
+
+    double duration = 5.0;
+
+    Watchdog watchdog(60.0);
+
+    cerr << ML::format("%11s %12s %12s",
+                       "connections", "requests/s", "allocs/req")
+         << endl;
+
+    for (int numConnections: { 1, 4, 16 }) {
+        PassiveEndpointT<SocketTransport> acceptor("acceptor");
+        acceptor.onMakeNewHandler = [&] ()
+            {
+                return ML::make_std_sp(new EchoConnectionHandler());
+            };
+
+        int port = acceptor.init(PortRange(), "localhost", 4);
+
+        std::atomic<int> numWarm(0);
+        std::atomic<bool> finished(false);
+        std::atomic<uint64_t> numRequests(0);
+
+        /* Each connection sends a request and waits for all of it to come
+           back before sending the next one. */
+        auto doConnection = [&] ()
+            {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                ExcAssertNotEqual(fd, -1);
+                Call_Guard closeFd([&] () { close(fd); });
+
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+                struct sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                int res = connect(fd, (sockaddr *)&addr, sizeof(addr));
+                ExcAssertEqual(res, 0);
+
+                char request[MessageSize], response[MessageSize];
+                memset(request, 'x', MessageSize);
+
+                for (uint64_t n = 0;  !finished;  ++n) {
+                    if (n == NumWarmup)
+                        ++numWarm;
+
+                    if (::send(fd, request, MessageSize, MSG_NOSIGNAL)
+                        != MessageSize)
+                        break;
+
+                    size_t received = 0;
+                    while (received < MessageSize) {
+                        ssize_t res = ::recv(fd, response + received,
+                                             MessageSize - received, 0);
+                        if (res <= 0) return;
+                        received += res;
+                    }
+
+                    if (n >= NumWarmup)
+                        ++numRequests;
+                }
+            };
+
+        vector<std::thread> threads;
+        for (int i = 0;  i < numConnections;  ++i)
+            threads.emplace_back(doConnection);
+
+        while (numWarm < numConnections)
+            ML::sleep(0.01);
+
+        numRequests = 0;
+        uint64_t allocationsBefore = numAllocations;
+        Timer timer;
+
+        ML::sleep(duration);
+
+        uint64_t allocations = numAllocations - allocationsBefore;
+        uint64_t requests = numRequests;
+        double elapsed = timer.elapsed_wall();
+
+        finished = true;
+        for (auto & t: threads)
+            t.join();
+
+        acceptor.closePeer();
+        acceptor.sleepUntilIdle();
+        acceptor.shutdown();
+
+        double allocsPerRequest = (double)allocations / requests;
+
+        cerr << ML::format("%11d %12.0f %12.3f",
+                           numConnections, requests / elapsed,
+                           allocsPerRequest)
+             << endl;
+
+        BOOST_CHECK_GT(requests, 0);
+
+        // Reading and writing are done with pooled buffers
+        BOOST_CHECK_LT(allocsPerRequest, 1.0);
+    }
+}
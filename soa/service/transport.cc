@@ -20,6 +20,7 @@
 #include <sys/timerfd.h>
 #include <sys/eventfd.h>
 #include <poll.h>
+#include <sys/socket.h>
 
 
 using namespace std;
@@ -302,6 +303,25 @@ handleAsync(const boost::function<void ()> & callback, const char * name,
     return endEventHandler(name, guard);
 }
 
+ssize_t
+TransportBase::
+sendv(const struct iovec * iov, int iovcnt, int flags)
+{
+    ssize_t total = 0;
+
+    for (int i = 0;  i < iovcnt;  ++i) {
+        ssize_t res = send((const char *)iov[i].iov_base, iov[i].iov_len,
+                           flags);
+        if (res == -1)
+            return total ? total : -1;
+        total += res;
+        if ((size_t)res < iov[i].iov_len)
+            break;
+    }
+
+    return total;
+}
+
 void
 TransportBase::
 associate(std::shared_ptr<ConnectionHandler> newSlave)
@@ -1023,6 +1043,18 @@ recv(char * buf, size_t buf_size, int flags)
     return peer().recv(buf, buf_size, flags);
 }
 
+ssize_t
+SocketTransport::
+sendv(const struct iovec * iov, int iovcnt, int flags)
+{
+    // writev() doesn't take flags, and we need MSG_NOSIGNAL
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec *>(iov);
+    msg.msg_iovlen = iovcnt;
+    return ::sendmsg(getHandle(), &msg, flags);
+}
+
 int
 SocketTransport::
 closePeer()
@@ -13,6 +13,7 @@
 #include <boost/thread/locks.hpp>
 #include <ace/SOCK_Stream.h>
 #include <ace/Synch.h>
+#include <sys/uio.h>
 #include "jml/arch/exception.h"
 #include "jml/arch/demangle.h"
 #include "jml/utils/guard.h"
@@ -61,6 +62,13 @@ struct TransportBase : public std::enable_shared_from_this<TransportBase> {
     virtual ssize_t send(const char * buf, size_t len, int flags) = 0;
     virtual ssize_t recv(char * buf, size_t buf_size, int flags) = 0;
 
+    /** Send the given buffers one after the other, as far as possible
+        without blocking, returning the number of bytes sent.  By default
+        this is done with one send() per buffer; transports that can gather
+        the buffers into a single call should override it.
+    */
+    virtual ssize_t sendv(const struct iovec * iov, int iovcnt, int flags);
+
     // closeWhenHandlerFinished() should be used in almost all cases instead
     // of this, except when writing test code, in which case asyncClose()
     // should be called instead.
@@ -603,6 +611,7 @@ struct SocketTransport
 
     virtual ssize_t send(const char * buf, size_t len, int flags);
     virtual ssize_t recv(char * buf, size_t buf_size, int flags);
+    virtual ssize_t sendv(const struct iovec * iov, int iovcnt, int flags);
     virtual int closePeer();
 
     ACE_SOCK_Stream & peer() { return peer_; }
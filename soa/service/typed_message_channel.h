@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include "jml/utils/ring_buffer.h"
 #include "jml/arch/wakeup_fd.h"
 #include "soa/service/async_event_source.h"
@@ -20,11 +21,18 @@ struct TypedMessageChannel {
     ML::RingBufferSRMW<Message> buf;
 };
 
+/** Sink that accepts messages from any number of threads and delivers
+    them on the thread running the message loop it's attached to.
+
+    The wakeup fd is only written when the consumer may be about to go to
+    sleep; while it's busy draining the ring the producers just push.
+*/
 template<typename Message>
 struct TypedMessageSink: public AsyncEventSource {
 
-    TypedMessageSink(size_t bufferSize)
-        : wakeup(EFD_NONBLOCK), buf(bufferSize)
+    TypedMessageSink(size_t bufferSize, size_t maxBatchSize = 64)
+        : wakeup(EFD_NONBLOCK), buf(bufferSize),
+          maxBatchSize(maxBatchSize), wakeupPending(false)
     {
     }
 
@@ -33,22 +41,22 @@ struct TypedMessageSink: public AsyncEventSource {
     void push(const Message & message)
     {
         if (buf.tryPush(message))
-            wakeup.signal();
+            signal();
         else
             throw ML::Exception("the message queue is full");
     }
 
     void push(Message && message)
     {
-        buf.push(message);
-        wakeup.signal();
+        buf.push(std::move(message));
+        signal();
     }
 
     bool tryPush(Message && message)
     {
-        bool pushed = buf.tryPush(message);
+        bool pushed = buf.tryPush(std::move(message));
         if (pushed)
-            wakeup.signal();
+            signal();
 
         return pushed;
     }
@@ -66,26 +74,41 @@ struct TypedMessageSink: public AsyncEventSource {
 
     virtual bool processOne()
     {
-        // Try to do one
-        Message msg;
-        if (!buf.tryPop(msg))
+        // Drain a burst in one go
+        batch.clear();
+        if (!buf.tryPopMany(std::back_inserter(batch), maxBatchSize))
             return false;
-        onEvent(std::move(msg));
+        for (auto & msg: batch)
+            onEvent(std::move(msg));
+        batch.clear();
 
         // Are there more waiting for us?
         if (buf.couldPop())
             return true;
-        
-        // Warning: race condition... that's why we need the couldPop from
-        // the next instruction to be accurate
+
+        // We may go to sleep, so any producer from here on needs to write
+        // to the fd.  The couldPop afterwards catches a message pushed
+        // before the flag was cleared, whose producer didn't signal.
         wakeup.tryRead();
+        wakeupPending.store(false);
 
         return buf.couldPop();
     }
-    uint64_t size() const { return buf.ring.size() ; }
+
+    uint64_t size() const { return buf.capacity(); }
+
 private:
+    void signal()
+    {
+        if (!wakeupPending.exchange(true))
+            wakeup.signal();
+    }
+
     ML::Wakeup_Fd wakeup;
     ML::RingBufferSRMW<Message> buf;
+    size_t maxBatchSize;
+    std::atomic<bool> wakeupPending;
+    std::vector<Message> batch;
 };
 
 } // namespace Datacratic
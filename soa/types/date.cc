@@ -80,8 +80,321 @@ expectFixedWidthInt(ML::Parse_Context & context,
     return result;
 }
 
+
+/* Fast formatting and parsing of the common date formats.  These handle
+   dates from the epoch until the point where print() starts returning
+   "Inf", and leave everything else to the strftime based code.
+*/
+
+const char * const monthNames[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+const char * const weekdayNames[7] = {
+    "Sunday", "Monday", "Tuesday", "Wednesday",
+    "Thursday", "Friday", "Saturday"
+};
+
+const double powersOfTen[10] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+inline bool isFastPrintable(double secondsSinceEpoch)
+{
+    // false for NaN too
+    return secondsSinceEpoch >= 0.0 && secondsSinceEpoch < 100000000000.0;
+}
+
+inline bool isLeapYear(int year)
+{
+    return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+inline int daysInMonth(int year, int month)
+{
+    static const int days[12] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+    return month == 2 && isLeapYear(year) ? 29 : days[month - 1];
+}
+
+/** Number of days between 1970-01-01 and the given date of the proleptic
+    Gregorian calendar.  Only valid for years after year 0. */
+long long daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int era = year / 400;
+    unsigned yoe = year - era * 400;
+    unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097LL + doe - 719468;
+}
+
+/** Inverse of daysFromCivil(), for days on or after the epoch. */
+void civilFromDays(long long days, int & year, int & month, int & day)
+{
+    days += 719468;
+    long long era = days / 146097;
+    unsigned doe = days - era * 146097;
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yoe + era * 400 + (month <= 2);
+}
+
+inline char * write2(char * p, unsigned value)
+{
+    p[0] = '0' + value / 10;
+    p[1] = '0' + value % 10;
+    return p + 2;
+}
+
+inline char * write4(char * p, unsigned value)
+{
+    write2(p, value / 100);
+    return write2(p + 2, value % 100);
+}
+
+inline char * write3(char * p, const char * name)
+{
+    p[0] = name[0];
+    p[1] = name[1];
+    p[2] = name[2];
+    return p + 3;
 }
 
+/** Writes HH:MM:SS. */
+char * writeTime(char * p, unsigned secondOfDay)
+{
+    p = write2(p, secondOfDay / 3600);
+    *p++ = ':';
+    p = write2(p, secondOfDay / 60 % 60);
+    *p++ = ':';
+    return write2(p, secondOfDay % 60);
+}
+
+enum {
+    PRINT_PREFIX_LENGTH = 20,  ///< 2013-Apr-01 09:08:07
+    ISO_PREFIX_LENGTH = 19     ///< 2013-04-01T09:08:07
+};
+
+/** Writes the date and time of the given second either with named months,
+    as print() does, or in ISO 8601 format.
+*/
+
+char * writeDateTime(char * p, long long second, bool iso)
+{
+    int year, month, day;
+    civilFromDays(second / 86400, year, month, day);
+    unsigned secondOfDay = second % 86400;
+
+    p = write4(p, year);
+    *p++ = '-';
+    p = iso ? write2(p, month) : write3(p, monthNames[month - 1]);
+    *p++ = '-';
+    p = write2(p, day);
+    *p++ = iso ? 'T' : ' ';
+    return writeTime(p, secondOfDay);
+}
+
+/** The formatted date and time of the last second printed by this thread,
+    which is almost always the one being printed when logging.
+*/
+struct PrefixCache {
+    long long second;
+    char chars[PRINT_PREFIX_LENGTH];
+};
+
+__thread PrefixCache printCache = { -1, { 0 } };
+__thread PrefixCache isoCache = { -1, { 0 } };
+
+inline const char * cachedDateTime(PrefixCache & cache, long long second,
+                                   bool iso)
+{
+    if (cache.second != second) {
+        writeDateTime(cache.chars, second, iso);
+        cache.second = second;
+    }
+    return cache.chars;
+}
+
+/** Writes the given number of decimals of the fraction, rounded the way
+    "%.*f" does.  As with the printf based code, a fraction that rounds up
+    to a whole second prints as zeros.
+*/
+char * writeFraction(char * p, double fraction, unsigned digits)
+{
+    uint64_t scale = powersOfTen[digits];
+    uint64_t units = llrint(fraction * scale);
+    if (units >= scale)
+        units -= scale;
+    for (unsigned i = digits;  i > 0;  --i) {
+        p[i - 1] = '0' + units % 10;
+        units /= 10;
+    }
+    return p + digits;
+}
+
+size_t copyToBuffer(char * buffer, size_t bufferSize, const std::string & str)
+{
+    if (str.size() > bufferSize)
+        throw ML::Exception("date '%s' doesn't fit in a buffer of %zd chars",
+                            str.c_str(), bufferSize);
+    std::copy(str.begin(), str.end(), buffer);
+    return str.size();
+}
+
+inline bool matchChar(const char * & p, const char * e, char c)
+{
+    if (p == e || *p != c)
+        return false;
+    ++p;
+    return true;
+}
+
+inline bool matchDigits(const char * & p, const char * e, int numDigits,
+                        int & value)
+{
+    if (e - p < numDigits)
+        return false;
+    int result = 0;
+    for (int i = 0;  i < numDigits;  ++i) {
+        unsigned digit = p[i] - '0';
+        if (digit > 9)
+            return false;
+        result = result * 10 + digit;
+    }
+    p += numDigits;
+    value = result;
+    return true;
+}
+
+/** Matches HH:MM:SS, returning the number of seconds since midnight. */
+bool matchTimeOfDay(const char * & p, const char * e, int & seconds)
+{
+    int hours, minutes;
+    if (!matchDigits(p, e, 2, hours) || hours > 23
+        || !matchChar(p, e, ':')
+        || !matchDigits(p, e, 2, minutes) || minutes > 59
+        || !matchChar(p, e, ':')
+        || !matchDigits(p, e, 2, seconds) || seconds > 60)
+        return false;
+    seconds += hours * 3600 + minutes * 60;
+    return true;
+}
+
+/** Matches a three letter month name. */
+bool matchMonthName(const char * & p, const char * e, int & month)
+{
+    if (e - p < 3)
+        return false;
+    for (int i = 0;  i < 12;  ++i) {
+        if (std::equal(p, p + 3, monthNames[i])) {
+            p += 3;
+            month = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Matches a weekday name, either abbreviated to three letters or in full
+    depending on longName. */
+bool matchWeekdayName(const char * & p, const char * e, bool longName)
+{
+    for (const char * name: weekdayNames) {
+        size_t length = longName ? strlen(name) : 3;
+        if (size_t(e - p) >= length && std::equal(p, p + length, name)) {
+            p += length;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Matches the time zone that ends RFC 1123 and RFC 850 dates, which is
+    always GMT, and the end of the string. */
+inline bool matchGmt(const char * p, const char * e)
+{
+    return e - p == 4 && std::equal(p, e, " GMT");
+}
+
+/** Hand written parser for the full form of ISO 8601 date and times that
+    is used almost everywhere: "YYYY-MM-DD[(T| )HH:MM:SS[.fff][Z|+HH:MM]]".
+    Returns false for anything else, including invalid dates, so that the
+    general parser can deal with it (and throw the same errors).  The
+    arithmetic follows Iso8601Parser so that both give identical results.
+*/
+bool parseIso8601Fast(const char * p, const char * e, double & result)
+{
+    int year, month, day;
+    if (!matchDigits(p, e, 4, year) || year < 1400
+        || !matchChar(p, e, '-')
+        || !matchDigits(p, e, 2, month) || month < 1 || month > 12
+        || !matchChar(p, e, '-')
+        || !matchDigits(p, e, 2, day) || day < 1
+        || day > daysInMonth(year, month))
+        return false;
+
+    double date = daysFromCivil(year, month, day) * 86400.0;
+    if (p == e) {
+        result = date;
+        return true;
+    }
+
+    if (!matchChar(p, e, 'T') && !matchChar(p, e, ' '))
+        return false;
+
+    int seconds;
+    if (!matchTimeOfDay(p, e, seconds))
+        return false;
+
+    double time = seconds;
+
+    if (matchChar(p, e, '.')) {
+        int numDigits = 0;
+        int fraction = 0;
+        for (;  p != e && *p >= '0' && *p <= '9';  ++p, ++numDigits) {
+            if (numDigits == 9)
+                return false;
+            fraction = fraction * 10 + (*p - '0');
+        }
+        if (!numDigits)
+            return false;
+        time += fraction / powersOfTen[numDigits];
+    }
+
+    if (p != e && !matchChar(p, e, 'Z')) {
+        int sign;
+        if (matchChar(p, e, '+'))
+            sign = 1;
+        else if (matchChar(p, e, '-'))
+            sign = -1;
+        else return false;
+
+        int tzHours, tzMinutes = 0;
+        if (!matchDigits(p, e, 2, tzHours) || tzHours > 23)
+            return false;
+        matchChar(p, e, ':');
+        if (p != e && (!matchDigits(p, e, 2, tzMinutes) || tzMinutes > 59))
+            return false;
+
+        // like Iso8601Parser, the offset is added to the time
+        time += sign * (tzHours * 60 + tzMinutes) * 60.0;
+    }
+
+    if (p != e)
+        return false;
+
+    result = date + time;
+    return true;
+}
+
+} // file scope
+
 namespace Datacratic {
 
 
@@ -210,6 +523,55 @@ parseIso8601DateTime(const std::string & dateTimeStr)
         return Iso8601Parser::parseDateTimeString(dateTimeStr);
 }
 
+Date
+Date::
+parseRfc2616(const std::string & date)
+{
+    const char * p = date.c_str();
+    const char * e = p + date.size();
+
+    int year, month, day, seconds;
+    bool ok;
+
+    if (date.size() > 3 && date[3] == ',') {
+        // RFC 1123: Sun, 06 Nov 1994 08:49:37 GMT
+        ok = (matchWeekdayName(p, e, false)
+              && matchChar(p, e, ',') && matchChar(p, e, ' ')
+              && matchDigits(p, e, 2, day) && matchChar(p, e, ' ')
+              && matchMonthName(p, e, month) && matchChar(p, e, ' ')
+              && matchDigits(p, e, 4, year) && matchChar(p, e, ' ')
+              && matchTimeOfDay(p, e, seconds) && matchGmt(p, e));
+    }
+    else if (date.size() > 3 && date[3] == ' ') {
+        // asctime: Sun Nov  6 08:49:37 1994
+        ok = (matchWeekdayName(p, e, false) && matchChar(p, e, ' ')
+              && matchMonthName(p, e, month) && matchChar(p, e, ' ')
+              && (matchChar(p, e, ' ')
+                  ? matchDigits(p, e, 1, day) : matchDigits(p, e, 2, day))
+              && matchChar(p, e, ' ')
+              && matchTimeOfDay(p, e, seconds) && matchChar(p, e, ' ')
+              && matchDigits(p, e, 4, year)
+              && p == e);
+    }
+    else {
+        // RFC 850: Sunday, 06-Nov-94 08:49:37 GMT
+        ok = (matchWeekdayName(p, e, true)
+              && matchChar(p, e, ',') && matchChar(p, e, ' ')
+              && matchDigits(p, e, 2, day) && matchChar(p, e, '-')
+              && matchMonthName(p, e, month) && matchChar(p, e, '-')
+              && matchDigits(p, e, 2, year) && matchChar(p, e, ' ')
+              && matchTimeOfDay(p, e, seconds) && matchGmt(p, e));
+        year += year < 70 ? 2000 : 1900;
+    }
+
+    if (!ok || year < 1400 || day < 1 || day > daysInMonth(year, month))
+        throw ML::Exception("couldn't parse RFC 2616 date '%s'",
+                            date.c_str());
+
+    return fromSecondsSinceEpoch(daysFromCivil(year, month, day) * 86400.0
+                                 + seconds);
+}
+
 Date
 Date::
 notADate()
@@ -269,6 +631,11 @@ std::string
 Date::
 print(unsigned seconds_digits) const
 {
+    if (seconds_digits < 10 && isFastPrintable(secondsSinceEpoch_)) {
+        char buffer[32];
+        return string(buffer, print(buffer, sizeof(buffer), seconds_digits));
+    }
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -289,6 +656,29 @@ print(unsigned seconds_digits) const
     return result;
 }
 
+size_t
+Date::
+print(char * buffer, size_t bufferSize, unsigned seconds_digits) const
+{
+    if (seconds_digits >= 10 || !isFastPrintable(secondsSinceEpoch_))
+        return copyToBuffer(buffer, bufferSize, print(seconds_digits));
+
+    size_t length = PRINT_PREFIX_LENGTH
+        + (seconds_digits ? seconds_digits + 1 : 0);
+    if (length > bufferSize)
+        throw ML::Exception("Date::print(): buffer too small");
+
+    double whole;
+    double fraction = modf(secondsSinceEpoch_, &whole);
+    const char * prefix = cachedDateTime(printCache, whole, false);
+    char * p = std::copy(prefix, prefix + PRINT_PREFIX_LENGTH, buffer);
+    if (seconds_digits) {
+        *p++ = '.';
+        writeFraction(p, fraction, seconds_digits);
+    }
+    return length;
+}
+
 std::string
 Date::
 printRfc2616() const
@@ -303,6 +693,26 @@ printRfc2616() const
         else return "-Inf";
     }
 
+    if (isFastPrintable(secondsSinceEpoch_)) {
+        long long second = secondsSinceEpoch_;
+        int year, month, day;
+        civilFromDays(second / 86400, year, month, day);
+
+        char buffer[32];
+        char * p = write3(buffer, weekdayNames[(second / 86400 + 4) % 7]);
+        *p++ = ',';
+        *p++ = ' ';
+        p = write2(p, day);
+        *p++ = ' ';
+        p = write3(p, monthNames[month - 1]);
+        *p++ = ' ';
+        p = write4(p, year);
+        *p++ = ' ';
+        p = writeTime(p, second % 86400);
+        p = std::copy(" GMT", " GMT" + 4, p);
+        return string(buffer, p);
+    }
+
     return print("%a, %d %b %Y %H:%M:%S GMT");
 }
 
@@ -310,6 +720,11 @@ std::string
 Date::
 printIso8601(unsigned int fraction) const
 {
+    if (fraction < 10 && isFastPrintable(secondsSinceEpoch_)) {
+        char buffer[32];
+        return string(buffer, printIso8601(buffer, sizeof(buffer), fraction));
+    }
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -333,6 +748,29 @@ printIso8601(unsigned int fraction) const
     return result;
 }
 
+size_t
+Date::
+printIso8601(char * buffer, size_t bufferSize, unsigned int fraction) const
+{
+    if (fraction >= 10 || !isFastPrintable(secondsSinceEpoch_))
+        return copyToBuffer(buffer, bufferSize, printIso8601(fraction));
+
+    size_t length = ISO_PREFIX_LENGTH + (fraction ? fraction + 1 : 0) + 1;
+    if (length > bufferSize)
+        throw ML::Exception("Date::printIso8601(): buffer too small");
+
+    double whole;
+    double partial = modf(secondsSinceEpoch_, &whole);
+    const char * prefix = cachedDateTime(isoCache, whole, true);
+    char * p = std::copy(prefix, prefix + ISO_PREFIX_LENGTH, buffer);
+    if (fraction) {
+        *p++ = '.';
+        p = writeFraction(p, partial, fraction);
+    }
+    *p = 'Z';
+    return length;
+}
+
 std::string
 Date::
 printClassic() const
@@ -1259,6 +1697,19 @@ DB::Store_Reader & operator >> (ML::DB::Store_Reader & store, Date & date)
 /* ISO8601PARSER                                                             */
 /*****************************************************************************/
 
+Date
+Iso8601Parser::
+parseDateTimeString(const std::string & dateTimeStr)
+{
+    double seconds;
+    if (parseIso8601Fast(dateTimeStr.c_str(),
+                         dateTimeStr.c_str() + dateTimeStr.size(), seconds))
+        return Date::fromSecondsSinceEpoch(seconds);
+
+    Iso8601Parser parser(dateTimeStr);
+    return parser.expectDateTime();
+}
+
 Date
 Iso8601Parser::
 expectDateTime()
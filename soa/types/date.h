@@ -74,6 +74,13 @@ struct Date {
     static Date parseDefaultUtc(const std::string & date);
     static Date parseIso8601DateTime(const std::string & date);
 
+    /** Parse any of the three date formats allowed by RFC 2616 for HTTP
+        headers: "Sun, 06 Nov 1994 08:49:37 GMT" (RFC 1123),
+        "Sunday, 06-Nov-94 08:49:37 GMT" (RFC 850) and
+        "Sun Nov  6 08:49:37 1994" (asctime).
+    */
+    static Date parseRfc2616(const std::string & date);
+
     // Deprecated
     static Date parseIso8601(const std::string & date);
 
@@ -96,6 +103,18 @@ struct Date {
     std::string printRfc2616() const;
     std::string printClassic() const;
 
+    /** Versions of print(seconds_digits) and printIso8601(fraction) that
+        write into the given buffer instead of allocating a string, for
+        use on hot paths like logging.  They return the number of
+        characters written, without a terminating null, and throw if the
+        buffer is too small; 32 characters are enough for up to 9 digits.
+        The calendar part is cached per thread for the last second printed.
+    */
+    size_t print(char * buffer, size_t bufferSize,
+                 unsigned seconds_digits) const;
+    size_t printIso8601(char * buffer, size_t bufferSize,
+                        unsigned int fraction) const;
+
     bool operator == (const Date & other) const
     {
         return secondsSinceEpoch_ == other.secondsSinceEpoch_;
@@ -426,11 +445,11 @@ from_js_ref(const JSValue & val, Date *)
 
 struct Iso8601Parser : public ML::Parse_Context
 {
-    static Date parseDateTimeString(const std::string & dateTimeStr)
-    {
-        Iso8601Parser parser(dateTimeStr);
-        return parser.expectDateTime();
-    }
+    /** Parses the common YYYY-MM-DDTHH:MM:SS.fff+HH:MM forms without
+        going through Parse_Context, and anything else with
+        expectDateTime().
+    */
+    static Date parseDateTimeString(const std::string & dateTimeStr);
 
     static Date parseTimeString(const std::string & timeStr)
     {
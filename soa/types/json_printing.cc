@@ -8,6 +8,8 @@
 #include "jml/utils/exc_assert.h"
 
 #include "json_printing.h"
+#include <cstdio>
+#include <cstring>
 
 
 using namespace std;
@@ -54,4 +56,119 @@ writeStringUtf8(const Utf8String & s)
 }
 
 
+/*****************************************************************************/
+/* STRING JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+void
+StringJsonPrintingContext::
+writeLongLong(long long int i)
+{
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", i);
+    output.append(buf, n);
+}
+
+void
+StringJsonPrintingContext::
+writeUnsignedLongLong(unsigned long long int i)
+{
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%llu", i);
+    output.append(buf, n);
+}
+
+void
+StringJsonPrintingContext::
+writeDouble(double d)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.16g", d);
+    if (std::isfinite(d))
+        output.append(buf, n);
+    else writeEscaped(buf, n);
+}
+
+void
+StringJsonPrintingContext::
+writeJson(const Json::Value & val)
+{
+    switch (val.type()) {
+    case Json::nullValue:
+        writeNull();
+        break;
+    case Json::intValue:
+        writeLongLong(val.asInt());
+        break;
+    case Json::uintValue:
+        writeUnsignedLongLong(val.asUInt());
+        break;
+    case Json::realValue:
+        writeDouble(val.asDouble());
+        break;
+    case Json::stringValue: {
+        const char * s = val.asCString();
+        writeEscaped(s, strlen(s));
+        break;
+    }
+    case Json::booleanValue:
+        writeBool(val.asBool());
+        break;
+    case Json::arrayValue:
+        startArray(val.size());
+        for (unsigned i = 0;  i < val.size();  ++i) {
+            newArrayElement();
+            writeJson(val[i]);
+        }
+        endArray();
+        break;
+    case Json::objectValue:
+        startObject();
+        for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+            const char * name = it.memberNameC();
+            startMember(name, strlen(name));
+            writeJson(*it);
+        }
+        endObject();
+        break;
+    }
+}
+
+void
+StringJsonPrintingContext::
+writeEscaped(const char * s, size_t length)
+{
+    output += '\"';
+
+    const char * start = s, * end = s + length;
+    for (const char * p = s;  p != end;  ++p) {
+        unsigned char c = *p;
+        if (c >= ' ' && c != '\"' && c != '\\')
+            continue;
+
+        // Copy the run of characters that don't need escaping in one go
+        output.append(start, p);
+        start = p + 1;
+
+        switch (c) {
+        case '\t': output += "\\t";  break;
+        case '\n': output += "\\n";  break;
+        case '\r': output += "\\r";  break;
+        case '\b': output += "\\b";  break;
+        case '\f': output += "\\f";  break;
+        case '\\':
+        case '\"': output += '\\';  output += c;  break;
+        default: {
+            char buf[8];
+            int n = snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+            output.append(buf, n);
+        }
+        }
+    }
+
+    output.append(start, end);
+    output += '\"';
+}
+
+
 } // namespace Datacratic
@@ -206,6 +206,139 @@ struct StreamJsonPrintingContext
 };
 
 
+/*****************************************************************************/
+/* STRING JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+/** JSON printing context that appends compact JSON to a string.  Unlike
+    the stream version it doesn't go through an ostream, so the caller can
+    keep the same string from one message to the next and only pay for the
+    copy of the bytes.
+
+    Strings are written as UTF-8; only the characters that JSON requires
+    are escaped.
+*/
+
+struct StringJsonPrintingContext
+    : public JsonPrintingContext {
+
+    StringJsonPrintingContext(std::string & output)
+        : output(output)
+    {
+    }
+
+    std::string & output;
+
+    /* One entry per object or array we're in: the number of members or
+       elements written so far. */
+    std::vector<int> path;
+
+    virtual void startObject()
+    {
+        path.push_back(0);
+        output += '{';
+    }
+
+    virtual void startMember(const std::string & memberName)
+    {
+        startMember(memberName.c_str(), memberName.size());
+    }
+
+    void startMember(const char * memberName, size_t length)
+    {
+        if (path.back()++ != 0)
+            output += ',';
+        writeEscaped(memberName, length);
+        output += ':';
+    }
+
+    virtual void endObject()
+    {
+        path.pop_back();
+        output += '}';
+    }
+
+    virtual void startArray(int knownSize = -1)
+    {
+        path.push_back(0);
+        output += '[';
+    }
+
+    virtual void newArrayElement()
+    {
+        if (path.back()++ != 0)
+            output += ',';
+    }
+
+    virtual void endArray()
+    {
+        path.pop_back();
+        output += ']';
+    }
+
+    virtual void skip()
+    {
+        output += "null";
+    }
+
+    virtual void writeNull()
+    {
+        output += "null";
+    }
+
+    virtual void writeInt(int i)
+    {
+        writeLongLong(i);
+    }
+
+    virtual void writeUnsignedInt(unsigned int i)
+    {
+        writeUnsignedLongLong(i);
+    }
+
+    virtual void writeLong(long int i)
+    {
+        writeLongLong(i);
+    }
+
+    virtual void writeUnsignedLong(unsigned long int i)
+    {
+        writeUnsignedLongLong(i);
+    }
+
+    virtual void writeLongLong(long long int i);
+    virtual void writeUnsignedLongLong(unsigned long long int i);
+
+    virtual void writeFloat(float f)
+    {
+        writeDouble(f);
+    }
+
+    virtual void writeDouble(double d);
+
+    virtual void writeString(const std::string & s)
+    {
+        writeEscaped(s.data(), s.size());
+    }
+
+    virtual void writeStringUtf8(const Utf8String & s)
+    {
+        writeEscaped(s.rawData(), s.rawLength());
+    }
+
+    /** Writes the value without going through its string form. */
+    virtual void writeJson(const Json::Value & val);
+
+    virtual void writeBool(bool b)
+    {
+        output += (b ? "true": "false");
+    }
+
+    /** Append a quoted and escaped string. */
+    void writeEscaped(const char * s, size_t length);
+};
+
+
 /*****************************************************************************/
 /* STRUCTURED JSON PRINTING CONTEXT                                          */
 /*****************************************************************************/
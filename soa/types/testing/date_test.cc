@@ -4,6 +4,7 @@
 
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
+#include <functional>
 #include "soa/types/date.h"
 #include <boost/test/unit_test.hpp>
 #include "soa/jsoncpp/json.h"
@@ -572,3 +573,203 @@ BOOST_AUTO_TEST_CASE( test_second )
     }
 
 }
+
+namespace {
+
+/* The printf/strftime based printing that the fast paths replace. */
+
+string printReference(Date date, unsigned digits)
+{
+    string result = date.print("%Y-%b-%d %H:%M:%S");
+    if (digits)
+        result.append(ML::format("%0.*f", digits, date.fractionalSeconds()),
+                      1, -1);
+    return result;
+}
+
+string printIso8601Reference(Date date, unsigned digits)
+{
+    string result = date.print("%Y-%m-%dT%H:%M:%S");
+    result.append(ML::format("%.*fZ", digits, date.fractionalSeconds()),
+                  1, -1);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_fast_print )
+{
+    vector<Date> dates = {
+        Date::fromSecondsSinceEpoch(0),
+        Date::fromSecondsSinceEpoch(0.9999999999),
+        Date(2000, 2, 29, 23, 59, 59, 0.5),
+        Date(2012, 12, 31, 12, 0, 0, 0.125),
+        Date(4000, 3, 1),
+        Date::fromSecondsSinceEpoch(99999999999.75)
+    };
+
+    for (unsigned i = 0;  i < 10000;  ++i)
+        dates.push_back(Date::fromSecondsSinceEpoch
+                        (random() * 40.0 + random() / 2147483648.0));
+
+    for (Date date: dates) {
+        for (unsigned digits = 0;  digits < 10;  ++digits) {
+            BOOST_REQUIRE_EQUAL(date.print(digits),
+                                printReference(date, digits));
+            BOOST_REQUIRE_EQUAL(date.printIso8601(digits),
+                                printIso8601Reference(date, digits));
+
+            char buffer[32];
+            size_t n = date.print(buffer, sizeof(buffer), digits);
+            BOOST_REQUIRE_EQUAL(string(buffer, n), date.print(digits));
+            n = date.printIso8601(buffer, sizeof(buffer), digits);
+            BOOST_REQUIRE_EQUAL(string(buffer, n), date.printIso8601(digits));
+        }
+
+        BOOST_REQUIRE_EQUAL(date.printRfc2616(),
+                            date.print("%a, %d %b %Y %H:%M:%S GMT"));
+    }
+
+    // outside of the fast range
+    char buffer[32];
+    size_t n = Date::notADate().print(buffer, sizeof(buffer), 5);
+    BOOST_CHECK_EQUAL(string(buffer, n), "NaD");
+    Date old(1960, 5, 6, 1, 2, 3, 0.25);
+    n = old.print(buffer, sizeof(buffer), 2);
+    BOOST_CHECK_EQUAL(string(buffer, n), old.print(2));
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(Date::now().print(buffer, 20, 5), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_parse_iso8601 )
+{
+    vector<string> strs = {
+        "2013-04-01", "2012-02-29", "2013-04-01T09:08:07",
+        "2013-04-01 09:08:07", "2013-04-01T09:08:07Z",
+        "2013-04-01T09:08:07-04:00", "2013-04-01T09:08:07+0530",
+        "2013-04-01T09:08:07+05:00", "2013-04-01T23:59:60.5Z",
+        "2012-12-20T14:57:57.123456789+00:00"
+    };
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        Date date = Date::fromSecondsSinceEpoch(random() / 1000.0);
+        strs.push_back(date.printIso8601(i % 10));
+        strs.push_back(date.print("%Y-%m-%d %H:%M:%S")
+                       + ML::format(".%d-%02d:%02d", i, i % 24, i % 60));
+    }
+
+    for (const string & str: strs) {
+        Iso8601Parser parser(str);
+        BOOST_CHECK_EQUAL(Date::parseIso8601DateTime(str),
+                          parser.expectDateTime());
+    }
+
+    // invalid dates still go through the general parser
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-02-29"),
+                      std::exception);
+    BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-04-01T24:00:00"),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_rfc2616 )
+{
+    Date expected(1994, 11, 6, 8, 49, 37);
+    BOOST_CHECK_EQUAL(Date::parseRfc2616("Sun, 06 Nov 1994 08:49:37 GMT"),
+                      expected);
+    BOOST_CHECK_EQUAL(Date::parseRfc2616("Sunday, 06-Nov-94 08:49:37 GMT"),
+                      expected);
+    BOOST_CHECK_EQUAL(Date::parseRfc2616("Sun Nov  6 08:49:37 1994"),
+                      expected);
+    BOOST_CHECK_EQUAL(Date::parseRfc2616("Thu Dec 16 08:49:37 2010"),
+                      Date(2010, 12, 16, 8, 49, 37));
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        Date date = Date::fromSecondsSinceEpoch(random());
+        BOOST_CHECK_EQUAL(Date::parseRfc2616(date.printRfc2616()), date);
+    }
+
+    JML_TRACE_EXCEPTIONS(false);
+    for (string str: { "", "Sun, 06 Nov 1994 08:49:37", "Sun, 06 Nov 1994",
+                       "Sun, 31 Nov 1994 08:49:37 GMT",
+                       "Sun, 06 Nov 1994 08:49:37 EST",
+                       "Sun, 06 Nvo 1994 08:49:37 GMT",
+                       "Sun Nov  6 08:49:37 1994 GMT" }) {
+        BOOST_CHECK_THROW(Date::parseRfc2616(str), ML::Exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_date_print_parse_speed )
+{
+    int n = 200000;
+
+    // timestamps a few microseconds apart, as when logging
+    vector<Date> dates;
+    Date start = Date::now();
+    for (int i = 0;  i < n;  ++i)
+        dates.push_back(start.plusSeconds(i * 0.000005));
+
+    vector<string> iso, rfc;
+    for (int i = 0;  i < n;  i += 100) {
+        iso.push_back(dates[i].printIso8601(6));
+        rfc.push_back(dates[i].printRfc2616());
+    }
+
+    size_t total = 0;
+
+    auto time = [&] (const string & what, const std::function<void (int)> & fn)
+        {
+            Date before = Date::now();
+            for (int i = 0;  i < n;  ++i)
+                fn(i);
+            double elapsed = Date::now().secondsSince(before);
+            cerr << ML::format("%-36s %8.1f ns/op", what.c_str(),
+                               elapsed * 1e9 / n)
+                 << endl;
+        };
+
+    time("print(5) with strftime",
+         [&] (int i) { total += printReference(dates[i], 5).size(); });
+    time("print(5)",
+         [&] (int i) { total += dates[i].print(5).size(); });
+    time("print(5) into buffer",
+         [&] (int i)
+         {
+             char buffer[32];
+             total += dates[i].print(buffer, sizeof(buffer), 5);
+         });
+    time("printIso8601(6) into buffer",
+         [&] (int i)
+         {
+             char buffer[32];
+             total += dates[i].printIso8601(buffer, sizeof(buffer), 6);
+         });
+    time("Iso8601Parser::expectDateTime()",
+         [&] (int i)
+         {
+             Iso8601Parser parser(iso[i % iso.size()]);
+             total += parser.expectDateTime().secondsSinceEpoch();
+         });
+    time("parseIso8601DateTime()",
+         [&] (int i)
+         {
+             const string & str = iso[i % iso.size()];
+             total += Date::parseIso8601DateTime(str).secondsSinceEpoch();
+         });
+    time("parse() of RFC 2616 with strptime",
+         [&] (int i)
+         {
+             const string & str = rfc[i % rfc.size()];
+             total += Date::parse(str, "%a, %d %b %Y %H:%M:%S GMT")
+                 .secondsSinceEpoch();
+         });
+    time("parseRfc2616()",
+         [&] (int i)
+         {
+             const string & str = rfc[i % rfc.size()];
+             total += Date::parseRfc2616(str).secondsSinceEpoch();
+         });
+
+    BOOST_CHECK_NE(total, 0);
+}
@@ -63,3 +63,43 @@ BOOST_AUTO_TEST_CASE(test_utf8_round_trip_streaming_ascii)
         BOOST_CHECK_EQUAL(str, str2);
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_string_printing_context)
+{
+    Json::Value val;
+    val["str"] = "a\"b\\c\n\xe2\x80\xa2";
+    val["int"] = -3;
+    val["real"] = 0.25;
+    val["array"].append(true);
+    val["array"].append(Json::Value());
+
+    std::string output;
+
+    {
+        StringJsonPrintingContext context(output);
+        context.startObject();
+        context.startMember("value");
+        context.writeJson(val);
+        context.startMember("utf8");
+        context.writeStringUtf8(Utf8String("\xe2\x80\xa2skin"));
+        context.endObject();
+    }
+
+    cerr << output << endl;
+
+    BOOST_CHECK_EQUAL(output,
+                      "{\"value\":{\"array\":[true,null],\"int\":-3,"
+                      "\"real\":0.25,\"str\":\"a\\\"b\\\\c\\n\xe2\x80\xa2\"},"
+                      "\"utf8\":\"\xe2\x80\xa2skin\"}");
+
+    // The output is valid JSON that gives back the same value
+    BOOST_CHECK_EQUAL(Json::parse(output)["value"], val);
+
+    // Appends to what is already there
+    {
+        StringJsonPrintingContext context(output);
+        context.writeInt(1);
+    }
+
+    BOOST_CHECK_EQUAL(output.back(), '1');
+}